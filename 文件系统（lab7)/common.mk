@@ -14,6 +14,36 @@ CFLAGS += -ffreestanding -fno-common -nostdlib -mno-relax
 CFLAGS += -I.
 CFLAGS += $(shell $(CC) -fno-stack-protector -E -x c /dev/null >/dev/null 2>&1 && echo -fno-stack-protector)
 
+# hart数量的上限 (默认8, 见common.h); 实际的hart数由qemu的-smp (顶层Makefile的CPUNUM) 决定, 启动时发现
+ifdef NCPU
+CFLAGS += -DNCPU=$(NCPU)
+endif
+
+# 文件系统的block大小 (默认1024, 见common.h), 磁盘映像要用相同的大小创建 (顶层Makefile把它传给mkfs -b)
+ifdef BLOCK_SIZE
+CFLAGS += -DBLOCK_SIZE=$(BLOCK_SIZE)
+endif
+
+# 调试构建: make PMEM_POISON=1 时释放的物理页填充0x01, 帮助发现"释放后继续使用"
+ifdef PMEM_POISON
+CFLAGS += -DPMEM_POISON
+endif
+
+# make RVV=1 时编译memset / memmove的向量版本 (lib/str_rvv.S), 启动时hart支持V扩展才使用
+ifdef RVV
+CFLAGS += -DRVV
+endif
+
+# 调试构建: make LOCK_STAT=1 时统计每类锁的竞争 (见lib/lockstat.h, 用sys_lockstat读取)
+ifdef LOCK_STAT
+CFLAGS += -DLOCK_STAT
+endif
+
+# 调试构建: make TIME_STAT=1 时统计热路径的耗时 (见lib/tstat.h, 用sys_tstat读取)
+ifdef TIME_STAT
+CFLAGS += -DTIME_STAT
+endif
+
 # Disable PIE when possible (for Ubuntu 16.10 toolchain)
 ifneq ($(shell $(CC) -dumpspecs 2>/dev/null | grep -e '[^f]no-pie'),)
 CFLAGS += -fno-pie -no-pie
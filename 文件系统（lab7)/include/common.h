@@ -20,13 +20,25 @@ typedef enum {false = 0, true = 1} bool;
 #define NULL ((void*)0)
 #endif
 
-#define NCPU 2
+// hart数量的上限: 每个hart一份的数组的大小 (make NCPU=n 时由编译选项给出, 不超过32: hart位图是uint32)
+// 实际的hart数ncpu在启动时从设备树得到 (见proc/cpu.h), qemu的-smp不超过NCPU时不需要重新编译
+#ifndef NCPU
+#define NCPU 8
+#endif
+
+extern int ncpu;   // 启动时发现的hart数 (1 <= ncpu <= NCPU)
 
 // 页面大小 4KB
 #define PGSIZE 4096
 
-// 内核保留的物理页数量（防止用户程序耗尽内存）
+// 内核区域初始的物理页数量（边界是自适应的, 内核至少保留PMEM_KERNEL_RESERVE页, 见mem/pmem.h）
 #define KERNEL_PAGES 1024
 
-#define BLOCK_SIZE 1024 // 磁盘的block大小
+// 磁盘的block大小 (默认1KB): make BLOCK_SIZE=4096 时一个block正好一页, 映像用 mkfs -b 4096 创建
+#ifndef BLOCK_SIZE
+#define BLOCK_SIZE 1024
+#endif
+#if BLOCK_SIZE != 1024 && BLOCK_SIZE != 2048 && BLOCK_SIZE != 4096
+#error "BLOCK_SIZE must be 1024, 2048 or 4096"
+#endif
 #endif
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef __BLK_H__
+#define __BLK_H__
+
+#include "common.h"
+#include "dev/vio.h"
+
+/*
+    块设备请求队列: 位于buf cache和virtio驱动之间
+    buf的读写请求先进入队列(plug), 相邻block的同类请求合并成一个scatter-gather请求,
+    派发(unplug)时由电梯算法决定顺序, 通过virtio异步接口提交
+    文件系统的所有读写都经过这一层 (包括不排队的blk_rw_sg/blk_rw_poll), 因此可以整体切换到内存块设备
+*/
+
+#define BLK_ELV_NOOP     0  // 按到达顺序派发, 只与最近一个请求尝试合并
+#define BLK_ELV_SORT     1  // 按block_num单向扫描(C-LOOK)派发, 与任意排队请求合并
+#define BLK_ELV_DEADLINE 2  // 在SORT基础上为每个请求设置期限, 超期的请求优先派发
+
+#define BLK_QUEUE_MAX    32                 // 最多同时排队的请求数, 满了则先派发
+#define BLK_READ_EXPIRE  (50000ul)          // deadline: 读请求期限 (mtime单位, 约5ms)
+#define BLK_WRITE_EXPIRE (500000ul)         // deadline: 写请求期限 (约50ms)
+
+typedef struct buf buf_t;
+
+// 一个排队中的请求: 磁盘上连续的nbuf个block, 方向相同
+typedef struct blk_req {
+    bool   used;
+    bool   write;
+    uint32 nbuf;
+    buf_t* bufs[VIRTIO_MAX_SEG];  // bufs[i]->block_num == bufs[0]->block_num + i
+    uint64 seq;                    // 到达顺序
+    uint64 deadline;               // 期限 (mtime)
+} blk_req_t;
+
+void blk_init();
+bool blk_submit(buf_t* b, bool write, bool nowait); // 加入请求队列, 不等待完成
+void blk_unplug();                                  // 把排队的请求全部交给磁盘驱动
+void blk_wait(buf_t* b);                            // 等待b上的请求完成(必要时先派发)
+void blk_rw(buf_t* b, bool write);                  // 同步读写一个block
+void blk_set_elevator(int elv);                     // 切换电梯算法
+void blk_barrier();                                 // 写屏障: 派发队列并让已完成的写落盘
+void blk_rw_sg(uint64 sector, virtio_seg_t* seg, int nseg, bool write); // 不排队, 同步读写连续扇区
+void blk_rw_poll(buf_t* b, bool write);             // 不排队, 同步读写一个block
+void blk_use_ramdisk();                             // 之后的读写改由内存块设备完成
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef __CONSOLE_H__
+#define __CONSOLE_H__
+
+#include "common.h"
+
+/*
+    控制台设备 (主设备号DEV_CONSOLE): 输入来自UART接收中断, 输出写入UART发送缓冲区
+    输入: uart_intr把收到的字符交给console_intr, 经过行规程放入环形缓冲区 [r, e)
+        回显每个字符, '\r'转换为'\n'; 退格(^H / DEL)删除一个字符, ^U删除整行
+        一行结束 ('\n'或^D) 或缓冲区满时提交: [r, w)可以读出, 唤醒等待的读者; [w, e)是正在编辑的行
+    读: 没有提交的输入时睡眠, 之后一次复制最多len字节, 不跨过行尾 (环绕时分两段)
+        行首的^D是文件结束: 读取它返回0; 不在行首时留给下一次读取
+*/
+
+#define CONSOLE_BUF 256   // 输入缓冲区大小 (2的幂)
+
+void console_init();          // 注册控制台设备 (file_init重置设备列表之后)
+void console_intr(int c);     // UART收到一个字符 (中断处理中调用)
+bool console_ready();         // console_init是否已完成 (之前收到的字符留在UART接收缓冲区中)
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef __FDT_H__
+#define __FDT_H__
+
+#include "common.h"
+
+/*
+    扁平设备树 (FDT): qemu在a1中把设备树的物理地址传给每个hart (见boot/entry.S), hart 0记录在boot_dtb中
+    只解析启动时需要的信息: /cpus下cpu@N节点的reg (hartid), /chosen的bootargs (启动选项, 见lib/bootopt.h),
+    /memory@...的reg (物理内存的范围, 按根节点的#address-cells / #size-cells解析)
+    qemu把设备树放在物理内存的末尾, 它在pmem_init把空闲页串成链表时被覆盖: 必须在pmem_init之前解析
+*/
+
+#define FDT_MAGIC 0xd00dfeed
+
+extern uint64 boot_dtb;             // 设备树的物理地址 (0: 没有)
+
+int  fdt_count_harts(uint64 dtb);    // 设备树中最大的hartid + 1, 设备树无效或没有cpu节点返回0
+void fdt_bootargs(uint64 dtb, char* buf, uint32 len); // 复制/chosen/bootargs (截断, 以0结尾), 没有时为空串
+uint64 fdt_memory_end(uint64 dtb, uint64 base);       // 包含物理地址base的内存区域的结束地址, 没有找到返回0
+
+#endif
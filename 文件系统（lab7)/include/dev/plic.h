@@ -3,9 +3,34 @@
 
 #include "common.h"
 
-void plic_init(void);          // 设置中断优先级
-void plic_inithart(void);      // 使能中断开关
-int  plic_claim(void);         // 获取中断号
-void plic_complete(int irq);   // 告知中断响应完成
+/*
+    PLIC: 外部设备中断的路由
+        每个中断源有自己的亲和性 (接收它的hart的位图), 写入各hart的S态使能寄存器: 多个hart都使能时先claim的hart处理
+        UART默认发给PLIC_IRQ_HARTS中的所有hart
+        virtio磁盘默认只发给PLIC_IRQ_HARTS中编号最小的hart: 各队列的used环、锁和被唤醒进程的状态只在这个hart上处理, 缓存行不在hart之间来回传递
+        运行时可以用sys_irq_setaffinity修改 (与sys_sched_setaffinity配合, 把中断处理和延迟敏感的进程固定在某些hart上)
+    每个hart分别统计每个中断源被claim的次数 (见/proc/interrupts)
+    只支持编号小于PLIC_NIRQ的中断源 (一个使能字, qemu virt的virtio和UART都在其中)
+*/
 
-#endif
\ No newline at end of file
+// 接收外部设备中断的hart (位图), 编译时可以用 -DPLIC_IRQ_HARTS=... 修改, 默认所有hart
+#ifndef PLIC_IRQ_HARTS
+#define PLIC_IRQ_HARTS ((1u << ncpu) - 1)
+#endif
+
+// 接收virtio磁盘中断的hart (位图), 默认PLIC_IRQ_HARTS中编号最小的hart
+#ifndef PLIC_VIRTIO_HARTS
+#define PLIC_VIRTIO_HARTS (PLIC_IRQ_HARTS & -PLIC_IRQ_HARTS)
+#endif
+
+#define PLIC_NIRQ 32    // 支持的中断源数
+
+void   plic_init(void);                          // 设置中断优先级和默认亲和性
+void   plic_inithart(void);                      // 使能中断开关
+int    plic_claim(void);                         // 获取中断号 (并计数)
+void   plic_complete(int irq);                   // 告知中断响应完成
+int    plic_set_affinity(int irq, uint32 mask);  // 修改中断源的亲和性, 成功返回0, 中断源无效或掩码中没有存在的hart返回-1
+uint32 plic_get_affinity(int irq);               // 中断源的亲和性, 无效返回0
+uint64 plic_count(int irq, int hart);            // hart claim到中断源irq的次数
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef __RAMDISK_H__
+#define __RAMDISK_H__
+
+#include "common.h"
+#include "dev/vio.h"
+
+/*
+    内存块设备: 与virtio_disk_rw_sg相同的扇区 + 数据段接口, 读写直接在内存中复制, 同步完成
+    存储按页组织: 第i页保存字节偏移[i * PGSIZE, (i + 1) * PGSIZE), 第一次写入时才申请
+    没有写过的页读出全0 (从磁盘装入时全0的页也不保存), 页目录是伙伴系统中的一个连续块
+    内容不会写回磁盘: 启动选项ramdisk让根文件系统在内存中运行 (见blk_use_ramdisk), 重启后丢失
+*/
+
+#define RAMDISK_LOAD_BATCH 16  // 装入时一个virtio请求读入的页数 (不超过VIRTIO_MAX_SG)
+
+void   ramdisk_init(uint32 nblocks);                                       // 创建nblocks个block的空设备
+void   ramdisk_load();                                                     // 从virtio磁盘复制同样范围的内容
+void   ramdisk_rw_sg(uint64 sector, virtio_seg_t* seg, int nseg, bool write); // 读写连续扇区到多个数据段
+uint32 ramdisk_pages();                                                    // 已申请的数据页数
+
+#endif
@@ -3,20 +3,81 @@
 
 #include "lib/lock.h"
 
+/*
+    系统时钟: ticks按CLINT mtime推进, 每interval个mtime单位一个tick (下一个tick在mtime = next时开始)
+    M-mode的时钟中断只关闭自己 (mtimecmp置为最大值) 并转为S-mode软件中断, 下一次中断由S-mode直接写mtimecmp:
+        运行进程的hart在每个tick的边界中断一次 (时间片按tick计算)
+        tickless模式下空闲的hart把中断推迟到下一个真正的期限 (最早的超时, hart 0还有定时写回), 没有期限时不再中断
+        任何hart的时钟中断都按mtime补上错过的tick (负责计时的hart可能正在空闲), 并执行每个tick的工作
+    有Sstc扩展时 (M-mode启动时检测menvcfg.STCE) 不经过M-mode: S-mode写自己的stimecmp, 到期时直接产生S-mode时钟中断,
+        写入将来的时刻即清除中断; mtimecmp保持最大值, M-mode只转发处理器间中断
+    tick的周期和tickless模式可以在运行时修改 (sys_timer_config); 以tick为单位的间隔随周期一起变化
+
+    定时器 (ktimer_t): 到期时间是mtime, 不受tick周期限制 (sys_sleep、futex的超时)
+    分级时间轮: TW_LEVELS级, 每级TW_SIZE个槽位, 第0级一个刻度是2^TW_SHIFT个mtime单位 (约0.8ms), 每升一级放大TW_SIZE倍
+        定时器按距离到期的刻度数放进能容纳它的最低一级, 高一级的槽位在轮到它的那一圈开始时重新分散到低级 (cascade)
+        每级一个非空槽位的位图: 推进时跳过空槽位, 长时间空闲之后不必逐个刻度推进
+        到期时间按刻度向上取整: 定时器不会早于expire触发, 最多晚一个刻度
+    每个hart的下一次时钟中断取下一个tick的边界和最早的定时器中较早的一个; 任何hart的时钟中断都推进时间轮
+    到期的回调在时间轮的锁下执行 (关中断), 只能获取p->lk和等待队列的锁 (加锁顺序: 时间轮的锁 -> p->lk)
+*/
+
 // 计时器
+// ticks / next / interval由顺序锁保护: 写者 (推进tick的hart、修改周期) 把seq改为奇数, 写完再加1;
+// 读者不加锁, 读的前后seq不变且为偶数时读到的值一致 (ticks单独读是一次64位读, 总是一致的)
 typedef struct timer {
-    uint64 ticks;
-    spinlock_t lk;
+    volatile uint32 seq;      // 顺序锁
+    volatile uint64 ticks;    // 已经过的tick数
+    volatile uint64 next;     // 下一个tick开始的mtime
+    uint64 interval;          // tick的周期 (mtime单位)
+    spinlock_t lk;            // sys_sleep睡眠的条件锁 (不保护上面的字段)
 } timer_t;
 
-// 每隔INTERVAL个单位时间发生一次时钟中断(1e6大约为0.1s)
-#define INTERVAL 1000000
+// 默认每隔TIMER_INTERVAL个单位时间发生一次时钟中断(1e6大约为0.1s)
+#define TIMER_INTERVAL       1000000
+#define TIMER_INTERVAL_MIN   1000        // 周期的下限 (约0.1ms)
+#define TIMER_INTERVAL_MAX   10000000    // 周期的上限 (约1s)
+#define TIMER_MTIME_PER_US   10          // mtime每微秒的单位数
+#define TIMER_NS_PER_MTIME   100         // mtime一个单位的纳秒数 (10MHz)
+#define TIMER_TICKLESS       true        // 默认启用tickless
+
+#define CLOCK_MONOTONIC      0           // sys_clock_gettime: 启动以来的时间
 
-void   timer_init();       // 时钟初始化(in M-mode)
+void   timer_init();       // 时钟初始化(in M-mode), 检测Sstc
+
+extern bool timer_sstc;    // S-mode直接使用stimecmp
 
 void   timer_create();     // 时钟创建
-void   timer_update();     // 时钟更新(ticks++)
+uint64 timer_update();     // 按mtime推进ticks, 返回推进的tick数
 uint64 timer_get_ticks();  // 获取时钟的tick
+uint64 timer_get_mtime();  // 读取CLINT mtime (细粒度计时, 1e7约为1s)
+uint64 timer_get_ns();     // 启动以来的纳秒数 (由mtime换算, 精度100ns)
+bool   timer_tick_pending();     // 这次S-mode软件中断或时钟中断是否包含一个tick (取走标志)
+void   timer_send_ipi(int hart); // 向hart发送处理器间中断 (唤醒空闲的调度器)
+void   timer_rearm();            // 本hart的下一次时钟中断设为下一个tick的边界 (已关中断)
+void   timer_idle(uint64 deadline); // 空闲的hart等待中断之前 (已关中断): tickless时推迟到deadline这个tick或最早的定时器 (0: 没有期限)
+uint64 timer_config(uint64 interval, int tickless); // 设置周期 (0: 不变) 和tickless模式 (<0: 不变), 返回当前周期
+uint64 timer_tick_mtime(uint64 tick); // 第tick个tick开始的mtime (tick在将来时按当前的周期估计)
+
+// 定时器
+typedef struct ktimer {
+    uint64 expire;                 // 到期的mtime
+    void (*fn)(struct ktimer* t);  // 到期时在时间轮的锁下调用
+    void* arg;
+    struct ktimer* next;           // 槽位链表
+    struct ktimer** pprev;         // 指向自己的指针 (NULL: 不在时间轮中)
+} ktimer_t;
+
+#define TW_SHIFT   13              // 第0级的刻度 (2^13个mtime单位, 约0.8ms)
+#define TW_BITS    6
+#define TW_SIZE    (1 << TW_BITS)  // 每级的槽位数
+#define TW_MASK    (TW_SIZE - 1)
+#define TW_LEVELS  4               // 级数 (范围约2^37个mtime单位, 约3.8小时; 更远的定时器在最高一级中反复重新放置)
+
+void ktimer_init(ktimer_t* t, void (*fn)(ktimer_t*), void* arg);
+void ktimer_add(ktimer_t* t, uint64 expire); // 加入时间轮 (不能已在时间轮中)
+bool ktimer_del(ktimer_t* t);                // 移出时间轮, 已经触发时返回false (返回之后回调不会再执行)
+void ktimer_run();                           // 时钟中断: 推进时间轮, 执行到期的回调
 
 #endif
 
@@ -24,4 +85,3 @@ uint64 timer_get_ticks();  // 获取时钟的tick
 xv6内核运行在S-mode，但是始终中断只能在M-mode下产生和首次处理
 这是RISC-V的硬件限制
 */
-
@@ -3,9 +3,25 @@
 
 #include "common.h"
 
+/*
+    输出: 字符先放进发送缓冲区 (UART_TX_BUF字节的环形队列), 发送器空闲时写入THR:
+        uart_putc放入字符后立即写出发送器能接受的部分, 剩下的由发送器空的中断 (uart_intr) 继续写出
+        缓冲区满时在锁下等待发送器 (调用者可能在中断处理中或持有自旋锁, 不能睡眠)
+    panic之后用uart_putc_sync直接输出: 先用uart_flush_sync写出缓冲区中剩下的字符
+    输入: 中断上半部 (uart_intr) 只把接收FIFO中的字符取到接收缓冲区, 下半部 (uart_softirq, 见trap/softirq.h)
+        按顺序交给控制台的行规程并回显; 接收缓冲区满时丢弃新的字符
+*/
+#define UART_TX_BUF  1024   // 发送缓冲区大小
+#define UART_RX_BUF  256    // 接收缓冲区大小
+#define UART_FIFO    16     // 发送器空时一次最多写入的字符数 (16550的FIFO)
+
 void uart_init(void);
-void uart_putc_sync(int c);
+void uart_putc(int c);       // 缓冲输出
+void uart_putc_sync(int c);  // 等待发送器空闲后直接输出 (panic)
+void uart_flush_sync(void);  // 不加锁写出发送缓冲区中的所有字符 (panic)
+void uart_flush(void);       // 持锁写出发送缓冲区中的所有字符并等待发送器空闲 (关机前)
 int  uart_getc_sync(void);
-void uart_intr(void);
+void uart_intr(void);         // 中断上半部: 取出收到的字符, 触发SOFTIRQ_UART
+void uart_softirq(void);      // 中断下半部: 字符交给控制台, 继续写出发送缓冲区
 
 #endif
\ No newline at end of file
@@ -5,8 +5,46 @@
 
 typedef struct buf buf_t;
 
+#define VIRTIO_MAX_SEG 16  // 一个buf请求最多携带的block数 (每个请求占用n + 2个描述符)
+#define VIRTIO_MAX_SG  16  // virtio_disk_rw_sg一个请求最多携带的数据段数
+#define VIRTIO_NQUEUE  NCPU  // virtqueue数量上限: 所有设备共用, 每个设备每个hart一个队列(设备多时平分)
+#define VIRTIO_STRIPE_SECTORS 128  // 条带单元: 多个磁盘时逻辑扇区每64KB轮换一个设备 (mkfs -r 使用相同的单元)
+#define VIRTIO_POLL_BUDGET 100000  // 轮询模式下自旋检查used环的最大次数, 超出后睡眠等待中断
+
+#define VIO_HIST_BUCKETS  32  // 延迟直方图: 第i个桶统计耗时在[2^i, 2^(i+1))个rdtime周期内的请求
+#define VIO_DEPTH_BUCKETS 16  // 队列深度直方图: 第i个桶统计提交时队列中已有i个在途请求(最后一个桶包括更深的)
+
+// 磁盘请求统计 (sys_diskstat 拷贝给用户, 各队列汇总)
+typedef struct vio_stat {
+    uint64 reads;                         // 完成的读请求数
+    uint64 writes;                        // 完成的写请求数
+    uint64 flushes;                       // 完成的flush请求数
+    uint64 read_time;                     // 读请求总耗时 (rdtime周期)
+    uint64 write_time;                    // 写请求总耗时
+    uint64 read_hist[VIO_HIST_BUCKETS];   // 读请求延迟的log2直方图
+    uint64 write_hist[VIO_HIST_BUCKETS];  // 写请求延迟的log2直方图
+    uint64 depth_hist[VIO_DEPTH_BUCKETS]; // 提交时所在队列的在途请求数分布
+    uint64 depth_max;                     // 单个队列出现过的最大在途请求数
+    uint64 inflight;                      // 当前在途请求数
+} vio_stat_t;
+
+// 一个数据段: 直接映射的内核地址 + 字节数(512的倍数)
+typedef struct virtio_seg {
+    uint64 addr;
+    uint32 len;
+} virtio_seg_t;
+
 void virtio_disk_init();
-void virtio_disk_intr();
+void virtio_disk_intr(int slot);                          // 中断上半部: 应答设备, 触发SOFTIRQ_DISK
+void virtio_disk_softirq();                                // 中断下半部: 回收已应答的设备上完成的请求
 void virtio_disk_rw(buf_t *b, bool write);
+void virtio_disk_rw_multi(buf_t **bv, int n, bool write); // 一个请求读写连续的n个block
+void virtio_disk_rw_poll(buf_t *b, bool write);            // 同步读写一个block, 轮询等待完成
+void virtio_disk_set_poll(bool enable);                    // 设备级轮询模式开关
+void virtio_disk_rw_sg(uint64 sector, virtio_seg_t *seg, int nseg, bool write); // 一个请求读写连续扇区到多个数据段
+bool virtio_disk_submit(buf_t **bv, int n, bool write, bool wait_desc); // 异步提交连续的n个block, 立即返回
+void virtio_disk_wait(buf_t *b);               // 等待b上的异步请求完成
+void virtio_disk_flush();                      // 让已完成的写请求落盘 (VIRTIO_BLK_T_FLUSH)
+void virtio_disk_stat(vio_stat_t *st);         // 汇总各队列的请求统计
 
 #endif
@@ -2,7 +2,8 @@
 // virtio device definitions.
 // for both the mmio interface, and virtio descriptors.
 // only tested with qemu.
-// this is the "legacy" virtio interface.
+// supports both the "legacy" (version 1) and the modern (version 2)
+// virtio-mmio interface.
 //
 // the virtio spec:
 // https://docs.oasis-open.org/virtio/virtio/v1.1/virtio-v1.1.pdf
@@ -14,22 +15,31 @@
 // virtio mmio control registers, mapped starting at 0x10001000.
 // from qemu virtio_mmio.h
 #define VIRTIO_MMIO_MAGIC_VALUE 0x000 // 0x74726976
-#define VIRTIO_MMIO_VERSION 0x004     // version; 1 is legacy
+#define VIRTIO_MMIO_VERSION 0x004     // version; 1 is legacy, 2 is modern
 #define VIRTIO_MMIO_DEVICE_ID 0x008   // device type; 1 is net, 2 is disk
 #define VIRTIO_MMIO_VENDOR_ID 0x00c   // 0x554d4551
 #define VIRTIO_MMIO_DEVICE_FEATURES 0x010
+#define VIRTIO_MMIO_DEVICE_FEATURES_SEL 0x014 // modern: which 32 feature bits DEVICE_FEATURES shows
 #define VIRTIO_MMIO_DRIVER_FEATURES 0x020
-#define VIRTIO_MMIO_GUEST_PAGE_SIZE 0x028  // page size for PFN, write-only
+#define VIRTIO_MMIO_DRIVER_FEATURES_SEL 0x024 // modern
+#define VIRTIO_MMIO_GUEST_PAGE_SIZE 0x028  // legacy: page size for PFN, write-only
 #define VIRTIO_MMIO_QUEUE_SEL 0x030        // select queue, write-only
 #define VIRTIO_MMIO_QUEUE_NUM_MAX 0x034    // max size of current queue, read-only
 #define VIRTIO_MMIO_QUEUE_NUM 0x038        // size of current queue, write-only
-#define VIRTIO_MMIO_QUEUE_ALIGN 0x03c      // used ring alignment, write-only
-#define VIRTIO_MMIO_QUEUE_PFN 0x040        // physical page number for queue, read/write
-#define VIRTIO_MMIO_QUEUE_READY 0x044      // ready bit
+#define VIRTIO_MMIO_QUEUE_ALIGN 0x03c      // legacy: used ring alignment, write-only
+#define VIRTIO_MMIO_QUEUE_PFN 0x040        // legacy: physical page number for queue, read/write
+#define VIRTIO_MMIO_QUEUE_READY 0x044      // modern: ready bit
 #define VIRTIO_MMIO_QUEUE_NOTIFY 0x050     // write-only
 #define VIRTIO_MMIO_INTERRUPT_STATUS 0x060 // read-only
 #define VIRTIO_MMIO_INTERRUPT_ACK 0x064    // write-only
 #define VIRTIO_MMIO_STATUS 0x070           // read/write
+#define VIRTIO_MMIO_QUEUE_DESC_LOW 0x080   // modern: physical address for descriptor table, write-only
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH 0x084
+#define VIRTIO_MMIO_DRIVER_DESC_LOW 0x090  // modern: physical address for available ring, write-only
+#define VIRTIO_MMIO_DRIVER_DESC_HIGH 0x094
+#define VIRTIO_MMIO_DEVICE_DESC_LOW 0x0a0  // modern: physical address for used ring, write-only
+#define VIRTIO_MMIO_DEVICE_DESC_HIGH 0x0a4
+#define VIRTIO_MMIO_CONFIG 0x100           // device-specific configuration space
 
 // status register bits, from qemu virtio_config.h
 #define VIRTIO_CONFIG_S_ACKNOWLEDGE 1
@@ -39,16 +49,20 @@
 
 // device feature bits
 #define VIRTIO_BLK_F_RO 5          /* Disk is read-only */
+#define VIRTIO_BLK_F_FLUSH 9       /* Cache flush command support */
 #define VIRTIO_BLK_F_SCSI 7        /* Supports scsi command passthru */
 #define VIRTIO_BLK_F_CONFIG_WCE 11 /* Writeback mode available in config */
 #define VIRTIO_BLK_F_MQ 12         /* support more than one vq */
 #define VIRTIO_F_ANY_LAYOUT 27
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX 29
+#define VIRTIO_F_VERSION_1 32      /* modern device, required by version 2 transport */
 
-// this many virtio descriptors.
+// at most this many virtio descriptors per queue.
 // must be a power of two.
-#define NUM 8
+// 实际队列大小vq->num在初始化时协商: 不超过NUM和设备上限的最大2的幂
+// NUM = 128时 desc(2048B) + avail(262B, 含used_event)仍在第一页内, used(1030B, 含avail_event)在第二页内
+#define NUM 128
 
 struct VRingDesc
 {
@@ -59,6 +73,7 @@ struct VRingDesc
 };
 #define VRING_DESC_F_NEXT 1  // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
+#define VRING_DESC_F_INDIRECT 4 // buffer contains a table of descriptors
 
 struct VRingUsedElem
 {
@@ -69,10 +84,17 @@ struct VRingUsedElem
 // for disk ops
 #define VIRTIO_BLK_T_IN 0  // read the disk
 #define VIRTIO_BLK_T_OUT 1 // write the disk
+#define VIRTIO_BLK_T_FLUSH 4 // flush the device's volatile write cache
 
 struct UsedArea
 {
     uint16 flags;
     uint16 id;
-    struct VRingUsedElem elems[NUM];
+    struct VRingUsedElem elems[NUM]; // 只使用前vq->num个
+    // 紧跟在elems[vq->num]之后的是avail_event (VIRTIO_RING_F_EVENT_IDX):
+    // 设备希望在avail idx越过该值时才被通知
 };
+
+// VIRTIO_RING_F_EVENT_IDX: idx从old推进到new时是否越过了对方设置的event
+#define VRING_NEED_EVENT(event, new_idx, old_idx) \
+    ((uint16)((new_idx) - (event) - 1) < (uint16)((new_idx) - (old_idx)))
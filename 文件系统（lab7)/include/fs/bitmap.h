@@ -3,10 +3,32 @@
 
 #include "common.h"
 
+#define BITMAP_BITS_PER_BLOCK (BLOCK_SIZE * 8)  // 一个位图块(一个组)管理的bit数
+#define BITMAP_GROUP_MAX      1024              // 每个位图最多的位图块数 (1KB块时可管理8M个block)
+#define BITMAP_PIN_MAX        8                 // 每个位图常驻缓存的位图块数
+#define BITMAP_FREE_BATCH     64                // 批量释放表的容量
+#define BITMAP_POOL_BLOCKS    32                // 每个hart的池一次多预留的数据块数
+#define BITMAP_POOL_INODES    8                 // 每个hart的池一次多预留的inode数
+
+// 批量释放数据块: 先收集块号, 再按位图块合并更新 (截断/删除文件时使用)
+typedef struct bitmap_free_batch {
+    uint32 n;
+    uint32 blocks[BITMAP_FREE_BATCH];
+} bitmap_free_batch_t;
+
+void   bitmap_init();   // 统计各组空闲数并常驻前几个位图块 (读入超级块之后调用; 干净卸载过则使用超级块中的记录)
 uint32 bitmap_alloc_block();
+uint32 bitmap_alloc_extent(uint32 preferred_start, uint32* n); // 分配连续的数据块, *n输入期望块数, 输出实际块数
 uint16 bitmap_alloc_inode();
+uint16 bitmap_alloc_inode_near(uint16 near);        // 在near附近分配inode (near通常是父目录)
+uint32 bitmap_data_goal(uint16 inode_num);          // inode的数据块的期望起始块号
 void   bitmap_free_block(uint32 block_num);
 void   bitmap_free_inode(uint16 inode_num);
+void   bitmap_free_batch_add(bitmap_free_batch_t* batch, uint32 block_num); // 加入批量释放表 (满了自动提交)
+void   bitmap_free_batch_flush(bitmap_free_batch_t* batch);                 // 提交批量释放表
+void   bitmap_free_count(uint32* free_blocks, uint32* free_inodes); // 缓存的空闲数据块数/inode数 (包括池中预留的)
+void   bitmap_pool_drain();                                     // 各hart的池中预留的块和inode归还位图 (在日志操作中调用)
+void   bitmap_save_summary();                                   // 空闲总数和各组空闲数记录进超级块 (卸载时)
 void   bitmap_print(uint32 bitmap_block_num);
 
 #endif
\ No newline at end of file
@@ -3,25 +3,76 @@
 
 #include "lib/lock.h"
 
+// buf本身和它的data是否放在同一个物理页中 (1KB block时一页切出3个buf; 更大的block时data单独占页, 见buf.c)
+#define BUF_DATA_INLINE (BLOCK_SIZE * 4 <= PGSIZE)
+
 typedef struct buf {
     /* 
-        睡眠锁: 保护 data[BLOCK_SIZE] + disk
-        block_num + buf_ref 由 lk_buf_cache保护
+        睡眠锁: 保护 data[BLOCK_SIZE] + valid + dirty
+        disk 由磁盘驱动在请求提交/完成时修改
+        block_num + buf_ref 由所在哈希桶的自旋锁保护
     */
     sleeplock_t slk;
 
     uint32 block_num; // 对应的磁盘block编号
-    uint8  data[BLOCK_SIZE]; // block数据的缓存
+#if BUF_DATA_INLINE
+    uint8  data[BLOCK_SIZE] __attribute__((aligned(8))); // block数据的缓存 (8字节对齐, 位图按64位字访问)
+#else
+    uint8* data;      // block数据的缓存 (在单独的页中, 按BLOCK_SIZE对齐)
+#endif
     
     uint32 buf_ref; // 还有多少处引用没有释放 
-    bool disk;      // 在磁盘驱动中使用
+    bool disk;      // 在磁盘驱动中使用 (true: 磁盘请求在途)
+    uint8 disk_q;   // 在磁盘驱动中使用 (请求所在的virtqueue编号)
+    bool valid;     // data是否已从磁盘读入 (预读时在请求提交后即置true, 使用前需等待disk清零)
+    bool dirty;     // data已修改但尚未写回磁盘 (由slk保护)
+    bool logged;    // 在尚未提交的日志事务中: 不写回原位置, 不被淘汰 (由slk保护)
 
 } buf_t;
 
+// cluster: 磁盘上连续的多个block用一个磁盘请求读写 (1KB block时4 * BLOCK_SIZE = 一个页)
+#define BUF_CLUSTER 4
+
+// buf cache统计信息 (sys_bufstat 拷贝给用户)
+typedef struct buf_stat {
+    uint64 lookups;     // buf_read / buf_get_nofill 的调用次数
+    uint64 hits;        // 命中缓存的次数
+    uint64 misses;      // 未命中, 需要绑定新buf的次数
+    uint64 evictions;   // 淘汰了一个已绑定block的buf的次数
+    uint64 disk_reads;  // 同步读盘次数
+    uint64 sync_writes; // 非写回模式下buf_write同步写盘次数
+    uint64 writebacks;  // 写回模式下dirty buf写盘次数
+    uint64 prefetches;  // 成功提交的预读请求数
+    uint64 slk_wait;    // 等待buf睡眠锁的总时间 (mtime单位)
+    uint64 nbuf;        // 当前buf总数 (静态 + 动态扩容)
+} buf_stat_t;
+
+// 缓存替换策略 (buf_set_policy)
+#define BUF_POLICY_LRU 0  // 纯LRU
+#define BUF_POLICY_2Q  1  // 2Q, 抗顺序扫描 (默认)
+
 void   buf_init();
 buf_t* buf_read(uint32 block_num);
-void   buf_write(buf_t* buf);
+buf_t* buf_get_nofill(uint32 block_num); // 不读磁盘, 调用者需覆盖整个data
+void   buf_read_cluster(uint32 block_num, uint32 n, buf_t** bufs); // 读入连续的n个block (n <= BUF_CLUSTER)
+void   buf_write_cluster(buf_t** bufs, uint32 n);                  // 写连续的n个block
+bool   buf_prefetch(uint32 block_num);   // 异步预读, 不返回buf (放弃时返回false)
+void   buf_write(buf_t* buf);          // 写回模式下只标记dirty, 否则同步写盘
 void   buf_release(buf_t* buf);
+buf_t* buf_pin(uint32 block_num);      // 读入block并常驻缓存 (不会被淘汰), 返回时不持有睡眠锁
+void   buf_unpin(buf_t* buf);          // 解除常驻
+void   buf_pinned_lock(buf_t* buf);    // 访问常驻buf: 上锁 (不经过哈希查找)
+void   buf_pinned_unlock(buf_t* buf);  // 访问常驻buf: 解锁 (常驻buf不用buf_release)
+void   buf_set_writeback(bool enable); // 开关写回模式 (关闭时先刷盘)
+void   buf_set_policy(uint32 policy);  // 切换缓存替换策略
+void   buf_flusher();                  // 周期性/高水位刷盘 (进程上下文调用, 不可持有buf锁)
+void   buf_sync();                     // 立即写回全部dirty buf并落盘 (不可持有buf锁)
+void   buf_commit();                   // 组提交: 并发的调用者合并成一次buf_sync (不可持有buf锁)
+void   buf_log(buf_t* buf);            // 加入日志事务: 标记dirty和logged, 额外持有一个引用 (持有睡眠锁)
+void   buf_log_done(buf_t* buf);       // 事务已提交: 变回普通dirty buf并释放事务的引用 (不持有睡眠锁)
+void   buf_checkpoint(uint32* blocks, uint32 n); // 把这些块中仍然dirty的写回原位置并落盘 (不可持有buf锁)
+void   buf_direct_prepare(uint32 block_num, bool write); // 直接I/O前: 写回(读)或作废(写)缓存的副本
+void   buf_stat(buf_stat_t* st);     // 读取统计信息
 void   buf_print();
 
 #endif
\ No newline at end of file
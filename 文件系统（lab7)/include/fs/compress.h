@@ -0,0 +1,33 @@
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include "fs/inode.h"
+
+/*
+    透明压缩的普通文件 (flags & INODE_F_COMPRESS, 创建时用MODE_COMPRESS选择, 使用块指针映射, 不内联/打包)
+    压缩单位 (cluster) 是文件中对齐的一页 (PCACHE_BLOCKS个数据块), 第c个cluster占用数据块[c * PCACHE_BLOCKS, ...),
+    块映射本身就是cluster映射, 每个cluster的存储方式由哪些块已分配决定 (与文件大小无关):
+        全部是空洞:       内容全0
+        最后一个块已分配: 原样存放 (压缩后省不出一个块)
+        只有前k个块:      压缩存放, 第0块的开头是comp_header_t, 之后是clen字节的LZ4块格式数据
+    页缓存中是解压后的内容: 读入时解压, dirty页在写回时 (持有inode锁) 整页重新压缩, 按压缩后的大小重新分配cluster的块,
+    在此之前与延迟分配一样不会被替换; 页缓存没有可替换的页时经过临时页读改写 (comp_rw)
+    BLOCK_SIZE = PGSIZE时每个cluster只有一个块, 压缩不会生效, 文件按原样存放
+*/
+
+#define COMP_MAGIC 0x4C5A3443  // "LZ4C"
+
+// 压缩存放的cluster的块头
+typedef struct comp_header {
+    uint32 magic;  // COMP_MAGIC
+    uint32 clen;   // 压缩数据的字节数 (不含块头)
+} comp_header_t;
+
+#define COMP_BLOCKS_FOR(clen) ((sizeof(comp_header_t) + (clen) + BLOCK_SIZE - 1) / BLOCK_SIZE)  // 压缩数据占用的块数
+
+void   comp_read_cluster(inode_t* ip, uint32 c, uint64 page);   // 读出第c个cluster的内容到一页 (持有ip睡眠锁)
+void   comp_write_cluster(inode_t* ip, uint32 c, uint64 page);  // 把一页内容压缩后写成第c个cluster (独占持有ip睡眠锁)
+uint32 comp_rw(inode_t* ip, uint32 offset, uint32 len, void* addr, bool user, bool write); // 不经过页缓存读写 (临时页读改写)
+void   comp_truncate(inode_t* ip, uint32 size);                 // 截断后重写跨越size的cluster (size之后清零)
+
+#endif
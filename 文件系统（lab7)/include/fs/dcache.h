@@ -0,0 +1,34 @@
+#ifndef __DCACHE_H__
+#define __DCACHE_H__
+
+#include "fs/dir.h"
+
+/*
+    目录项缓存 (dcache): (父目录inode_num, 名称) -> inode_num
+    正向项: 名称存在; 负向项 (inode_num = INODE_NUM_UNUSED): 名称不存在
+    由dir_search_entry填充, dir_add_entry / dir_delete_entry 同步更新
+    调用者必须持有父目录的睡眠锁, 这样缓存内容与目录数据块保持一致
+    序列号: 每次目录项真正改变 (dcache_change / dcache_purge) 时加1
+    不持有inode睡眠锁的乐观路径查找在开始和结束时比较序列号, 不同则回退到加锁查找
+*/
+
+typedef struct dentry {
+    bool   valid;                   // 槽位是否有效
+    volatile bool referenced;       // 移到LRU链表尾部之后被查找命中过 (持有读锁时设置)
+    uint16 parent;                  // 父目录的inode_num
+    uint16 inode_num;               // 目录项的inode_num (INODE_NUM_UNUSED: 负向项)
+    char   name[DIR_NAME_LEN];      // 目录项名称 (与dirent_t相同, 不一定以0结尾)
+    struct dentry* hash_next;       // 哈希链表
+    struct dentry* lru_prev;        // LRU链表 (头部最久未使用)
+    struct dentry* lru_next;
+} dentry_t;
+
+void dcache_init();
+bool dcache_lookup(uint16 parent, char* name, uint16* inode_num);  // 命中返回true (*inode_num可能是负向项)
+void dcache_insert(uint16 parent, char* name, uint16 inode_num);   // 插入或更新 (查找结果)
+void dcache_change(uint16 parent, char* name, uint16 inode_num);   // 目录项被添加/删除 (序列号+1)
+void dcache_purge(uint16 parent);                                  // 删除父目录为parent的所有项 (序列号+1)
+uint32 dcache_seq_begin();                                         // 乐观查找开始: 读序列号
+bool dcache_seq_valid(uint32 seq);                                 // 乐观查找结束: 期间没有目录项改变
+
+#endif
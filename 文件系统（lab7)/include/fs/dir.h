@@ -17,14 +17,24 @@ uint16 dir_search_entry(inode_t* pip, char* name);
 uint32 dir_add_entry(inode_t* pip, uint16 inode_num, char* name);
 uint16 dir_delete_entry(inode_t* pip, char* name);
 uint32 dir_get_entries(inode_t* pip, uint32 len, void* dst, bool user); // NEW
+uint32 dir_read_entries(inode_t* pip, uint32* cookie, uint32 len, dirent_t* dst); // 从cookie处继续读取
 uint32 dir_change(char* path); // NEW
+void   dir_init();                // 初始化 (重命名锁)
 void   dir_print(inode_t* pip);
 
 
 inode_t* path_to_inode(char* path);
 inode_t* path_to_pinode(char* path, char* name);
-inode_t* path_create_inode(char* path, uint16 type, uint16 major, uint16 minor); // NEW
+inode_t* path_create_inode(char* path, uint16 type, uint16 major, uint16 minor, uint8 flags); // NEW
 uint32   path_link(char* old_path, char* new_path); // NEW
 uint32   path_unlink(char* path); // NEW
+uint32   path_rename(char* old_path, char* new_path); // 重命名 (替换已存在的普通文件)
+
+// 相对路径从目录dp开始解析 (dp = NULL: 当前工作目录)
+inode_t* path_to_inode_at(inode_t* dp, char* path);
+inode_t* path_to_pinode_at(inode_t* dp, char* path, char* name);
+inode_t* path_create_inode_at(inode_t* dp, char* path, uint16 type, uint16 major, uint16 minor, uint8 flags);
+uint32   path_link_at(inode_t* old_dp, char* old_path, inode_t* new_dp, char* new_path);
+uint32   path_unlink_at(inode_t* dp, char* path);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef __EXTENT_H__
+#define __EXTENT_H__
+
+#include "fs/inode.h"
+#include "fs/bitmap.h"
+
+/*
+    extent映射的inode (flags & INODE_F_EXTENT)
+    addrs区域(52字节)不再存放块指针, 而是一个extent树的根节点:
+        extent_header_t + EXTENT_ROOT_MAX个extent_t
+    depth = 0: 根节点中直接存放extent (逻辑起始块, 物理起始块, 长度)
+    depth = 1: 根节点中存放索引项 (覆盖的第一个逻辑块, 叶子块编号), 叶子块存放extent
+    节点内的项按逻辑起始块升序排列, 查找使用二分, 连续分配的块会合并进同一个extent
+*/
+
+typedef struct extent_header {
+    uint16 n;       // 节点内的有效项数
+    uint16 depth;   // 0: 叶子节点  1: 索引节点 (只有根节点可能是索引节点)
+} extent_header_t;
+
+typedef struct extent {
+    uint32 lstart;  // 逻辑起始块 (文件内的数据块序号)
+    uint32 pstart;  // 物理起始块 (索引项: 叶子块的磁盘编号)
+    uint32 len;     // 块数 (索引项不使用)
+} extent_t;
+
+#define EXTENT_ROOT_MAX ((N_ADDRS * sizeof(uint32) - sizeof(extent_header_t)) / sizeof(extent_t)) // 4
+#define EXTENT_NODE_MAX ((BLOCK_SIZE - sizeof(extent_header_t)) / sizeof(extent_t))               // 85
+
+uint32 extent_map(inode_t* ip, uint32 bn, bool alloc, uint32 fill);      // 查找(必要时分配)第bn个数据块
+void   extent_insert(inode_t* ip, uint32 bn, uint32 pstart, uint32 n);  // 记录映射[bn, bn + n) -> [pstart, pstart + n)
+void   extent_truncate(inode_t* ip, uint32 keep, bitmap_free_batch_t* batch); // 释放逻辑块号 >= keep 的数据块
+void   extent_free(inode_t* ip, bitmap_free_batch_t* batch);            // 释放所有数据块和叶子块
+
+#endif
@@ -10,25 +10,80 @@
 #define FD_FILE     2
 #define FD_DEVICE   3
 #define FD_PIPE     4
+#define FD_PROC     5   // /proc下的统计文件 (见fs/procfs.h)
+#define FD_TMP      6   // /tmp下的内存文件或目录 (见fs/tmpfs.h)
+#define FD_EPOLL    7   // 就绪通知的监视集合 (见fs/poll.h)
 
 // 文件打开方式 (readable writable)
 
 #define MODE_CREATE    0x1 // 文件不存在则创建
 #define MODE_READ      0x2 // 读文件
 #define MODE_WRITE     0x4 // 写文件
+#define MODE_EXTENT    0x8 // 与MODE_CREATE一起使用: 新文件使用extent映射
+#define MODE_DIRECT    0x10 // 直接I/O: 对齐的整块读写绕过页缓存
+#define MODE_COMPRESS  0x20 // 与MODE_CREATE一起使用: 新文件按页透明压缩 (见fs/compress.h, 优先于MODE_EXTENT)
+
+// fadvise访问模式提示 (与Linux的POSIX_FADV_*取值相同)
+// NORMAL / RANDOM / SEQUENTIAL 记录在file_t上, WILLNEED / DONTNEED 立即对指定范围生效
+
+#define FADV_NORMAL     0 // 默认: 识别出顺序访问后逐步扩大预读窗口
+#define FADV_RANDOM     1 // 随机访问: 不预读
+#define FADV_SEQUENTIAL 2 // 顺序扫描一次: 直接使用最大预读窗口, 读过的页优先被替换
+#define FADV_WILLNEED   3 // 即将访问: 立即读入范围内的页
+#define FADV_DONTNEED   4 // 不再访问: 写回范围内的dirty页并丢弃干净页
+
+// 预读模式 (file->ra_mode)
+#define RA_OFF    0 // 没有可识别的模式 (随机访问): 不预读
+#define RA_SEQ    1 // 顺序访问: 预读之后的ra_window个块, 窗口逐步翻倍
+#define RA_STRIDE 2 // 固定步长: 预读之后ra_window条相同步长的记录
+
+// *at系统调用的目录fd: 相对路径从当前工作目录开始
+#define AT_FDCWD       (-100)
 
 typedef struct inode inode_t;
+typedef struct pipe pipe_t;
+typedef struct tmpfs_node tmpfs_node_t;
+typedef struct epoll epoll_t;
+typedef struct poll_head poll_head_t;
 
 typedef struct file {
     uint16 type;      // 文件类型
     bool readable;    // 可读?
     bool writable;    // 可写?
-    uint32 ref;       // 引用数
+    bool direct;      // 直接I/O? (MODE_DIRECT)
+    uint32 ref;       // 引用数 (原子地修改, 归零的那次释放负责回收)
     uint16 major;     // 主设备号 (for device)
     uint32 offset;    // 偏移量   (for file)
     inode_t* ip;      // 对应的inode (for dir file device)
+    pipe_t* pipe;     // 对应的管道 (for pipe)
+    uint16 proc_node; // 统计文件的节点 PROC_* (for proc)
+    int proc_pid;     // /proc/<pid>/stat的进程 (for proc)
+    tmpfs_node_t* tmp; // 对应的节点 (for tmp)
+    epoll_t* ep;      // 对应的监视集合 (for epoll)
+
+    // 预读状态 (for file, 由ip->slk保护): 根据访问历史在关闭 / 顺序 / 固定步长之间切换
+    uint32 ra_next;   // 顺序访问时下一次read的起始偏移
+    uint32 ra_last;   // 上一次read的起始偏移
+    uint32 ra_stride; // 上一次read相对于再上一次的步长 (字节, 0表示没有向前的步长)
+    uint32 ra_window; // 当前预读窗口 (顺序: 块数, 步长: 记录数, 0表示不预读)
+    uint32 ra_end;    // 已提交预读的块序号上界 (不含)
+    uint8 ra_mode;    // RA_OFF / RA_SEQ / RA_STRIDE
+    uint8 ra_hits;    // 最近预读过的read中页仍在缓存的次数
+    uint8 ra_wasted;  // 最近预读过的read中页在使用前已被替换的次数
+    uint8 advice;     // 访问模式提示 (FADV_NORMAL / FADV_RANDOM / FADV_SEQUENTIAL)
+
+    // 目录遍历位置 (for dir和tmp的目录, dir_read_entries使用的不透明cookie, 0表示从头开始)
+    uint32 dir_cookie;
 } file_t;
 
+// readv/writev的一段用户缓冲区
+typedef struct iovec {
+    uint64 base;      // 用户缓冲区地址
+    uint32 len;       // 字节数
+} iovec_t;
+
+#define N_IOV 16      // 一次readv/writev最多的缓冲区段数
+
 typedef struct file_state {
     uint16 type;
     uint16 inode_num;
@@ -36,15 +91,18 @@ typedef struct file_state {
     uint32 size;
 } file_state_t;
 
+#define FSTAT_BATCH_MAX 64  // 一次fstatat_batch最多的文件数
+
 
 #define N_DEV 10    // 设备类型数
 
 #define DEV_CONSOLE 1    // 控制台的主设备号
 
-// 设备文件需要提供读写接口
+// 设备文件需要提供读写接口, 可以等待的设备另外提供poll接口 (返回当前状态POLL*, *head输出源)
 typedef struct dev {
     uint32 (*read)(uint32 len, uint64 dst, bool user_dst);
     uint32 (*write)(uint32 len, uint64 src, bool user_src);
+    uint32 (*poll)(poll_head_t** head);
 } dev_t;
 
 
@@ -52,11 +110,27 @@ void    file_init();
 file_t* file_alloc();
 file_t* file_create_dev(char* path, uint16 major, uint16 minor);
 file_t* file_open(char* path, uint32 open_mode);
+file_t* file_open_at(inode_t* dp, char* path, uint32 open_mode); // 相对路径从目录dp开始
 void    file_close(file_t* file);
 uint32  file_read(file_t* file, uint32 len, uint64 dst, bool user);
 uint32  file_write(file_t* file, uint32 len, uint64 src, bool user);
+uint32  file_pread(file_t* file, uint32 offset, uint32 len, uint64 dst, bool user);  // 指定偏移读, 不修改file->offset
+uint32  file_pwrite(file_t* file, uint32 offset, uint32 len, uint64 src, bool user); // 指定偏移写, 不修改file->offset
+uint32  file_readv(file_t* file, uint64 iov, uint32 iovcnt);  // 一次加锁读入多段用户缓冲区
+uint32  file_writev(file_t* file, uint64 iov, uint32 iovcnt); // 一次加锁写出多段用户缓冲区
+uint32  file_copy_range(file_t* in, file_t* out, uint32 len); // 在内核中从in复制到out（各自的当前偏移）
+int     file_clone(file_t* file, char* path);                  // reflink克隆: path处的新文件共享file的数据块
+uint32  file_splice(file_t* in, file_t* out, uint32 len);      // 在管道和文件(或管道)之间移动页引用 (见fs/pipe.h)
+uint32  file_vmsplice(file_t* file, uint64 iov, uint32 iovcnt); // 把用户页作为页引用排入管道
 uint32  file_lseek(file_t* file, uint32 offset, int flags);
 file_t* file_dup(file_t* file);
 int     file_stat(file_t* file, uint64 addr);
+int     file_stat_at(inode_t* dp, char* path, uint64 addr);     // 按路径获取文件状态
+int     file_stat_batch(inode_t* dp, uint64 names, int n, uint64 addr); // 一次获取目录下多个文件的状态
+int     file_getdents(file_t* file, uint64 addr, uint32 len);   // 从cookie处继续读取目录项
+int     file_truncate(file_t* file, uint32 size);               // 截断或扩展到size字节
+int     file_allocate(file_t* file, uint32 offset, uint32 len); // 预分配磁盘空间
+int     file_fsync(file_t* file);                               // 数据和元数据落盘 (组提交)
+int     file_advise(file_t* file, uint32 offset, uint32 len, int advice); // 访问模式提示 (len = 0: 到文件末尾)
 
 #endif
\ No newline at end of file
@@ -3,6 +3,16 @@
 
 #include "common.h"
 
+/*
+    快速挂载: 干净卸载(fs_unmount)时把两个位图的空闲总数和各组空闲数记录进超级块, state置为FS_STATE_CLEAN
+    挂载时state为CLEAN且记录自洽则直接使用, 不扫描位图; 否则(崩溃、旧镜像)逐块统计
+    挂载后立即把state改回DIRTY并落盘, 卸载之后再修改位图也会先改回DIRTY
+*/
+#define FS_STATE_CLEAN         0x434C454E  // "CLEN": 干净卸载, 空闲计数有效
+#define FS_STATE_DIRTY         0           // 已挂载或异常关机, 挂载时需要扫描位图
+#define FS_SUMMARY_INODE_GROUPS 8          // 记录空闲数的inode位图组数 (inode号为16位, 8组足够)
+#define FS_SUMMARY_DATA_GROUPS  448        // 记录空闲数的data位图组数 (1KB块时覆盖3.5GB, 更大的部分挂载时统计)
+
 // 超级块
 typedef struct super_block
 {
@@ -18,8 +28,43 @@ typedef struct super_block
     unsigned int data_blocks;
     unsigned int total_blocks;
 
+    unsigned int journal_magic;   // JOURNAL_MAGIC: 存在日志区 (旧的磁盘镜像没有, 挂载时创建)
+    unsigned int journal_start;   // 日志区起始块 (日志头)
+    unsigned int journal_blocks;  // 日志区块数
+
+    unsigned int state;           // FS_STATE_CLEAN / FS_STATE_DIRTY
+    unsigned int free_blocks;     // 干净卸载时的空闲数据块数
+    unsigned int free_inodes;     // 干净卸载时的空闲inode数
+    uint16 inode_group_free[FS_SUMMARY_INODE_GROUPS];  // inode位图各组的空闲数
+    uint16 data_group_free[FS_SUMMARY_DATA_GROUPS];    // data位图各组的空闲数
+
+    unsigned int swap_magic;      // SWAP_MAGIC: 文件系统之后有交换区 (见mem/swap.h, 旧的磁盘镜像没有)
+    unsigned int swap_start;      // 交换区起始块 (按页对齐)
+    unsigned int swap_blocks;     // 交换区块数
+
+    unsigned int refcnt_magic;    // REFCNT_MAGIC: 存在数据块引用计数表 (见fs/refcnt.h, 第一次克隆文件时创建)
+    unsigned int refcnt_start;    // 引用计数表起始块
+    unsigned int refcnt_blocks;   // 引用计数表块数
+
 } super_block_t;
 
+// 文件系统容量信息 (sys_statfs 拷贝给用户)
+typedef struct fs_stat {
+    uint32 block_size;    // block大小 (字节)
+    uint32 total_blocks;  // 磁盘总block数
+    uint32 data_blocks;   // 数据区block数
+    uint32 free_blocks;   // 空闲数据block数
+    uint32 inodes;        // inode总数
+    uint32 free_inodes;   // 空闲inode数
+} fs_stat_t;
+
 void fs_init();
+bool fs_mounted();              // fs_init是否已完成
+void fs_statfs(fs_stat_t* st);  // 查询文件系统容量 (使用位图缓存的空闲计数)
+void fs_sync();                 // 写回所有缓存的数据和元数据并落盘
+void fs_write_super();          // 超级块写回磁盘 (创建日志区等修改之后)
+void fs_commit_super();         // 超级块写回并立即落盘 (运行中修改超级块记录的位置之后)
+void fs_mark_dirty();           // 超级块标记为DIRTY并立即落盘 (挂载后、卸载后第一次修改位图前)
+void fs_unmount();              // 干净卸载: 写回所有数据, 记录空闲计数, 标记CLEAN
 
 #endif
\ No newline at end of file
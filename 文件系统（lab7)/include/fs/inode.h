@@ -7,10 +7,10 @@
 #define INODE_DISK_SIZE  64                             // 磁盘里inode的大小
 #define INODE_PER_BLOCK  (BLOCK_SIZE / INODE_DISK_SIZE) // 每个block里的inode数量
 
-// addrs相关字段
-#define N_ADDRS_1   10  // 管理 10 * BLOCK_SIZE = 10KB
-#define N_ADDRS_2   2   // 管理 2 * (BLOCK_SIZE / 4) * BLOCK_SIZE = 512KB
-#define N_ADDRS_3   1   // 管理 (BLOCK_SIZE / 4) * (BLOCK_SIZE / 4) * BLOCK_SIZE = 64MB
+// addrs相关字段 (括号中是1KB / 4KB block时的大小)
+#define N_ADDRS_1   10  // 管理 10 * BLOCK_SIZE (10KB / 40KB)
+#define N_ADDRS_2   2   // 管理 2 * (BLOCK_SIZE / 4) * BLOCK_SIZE (512KB / 8MB)
+#define N_ADDRS_3   1   // 管理 (BLOCK_SIZE / 4) * (BLOCK_SIZE / 4) * BLOCK_SIZE (64MB / 4GB)
 #define N_ADDRS     (N_ADDRS_1 + N_ADDRS_2 + N_ADDRS_3)
 
 // 每个block里面有多少个存储下一级block_num的entry
@@ -18,7 +18,8 @@
 
 // addrs字段可以容纳的最大空间（单个inode可以管理的最大空间）
 // 由于磁盘大小限制, 事实上达不到这个大小
-#define INODE_MAXSIZE ((N_ADDRS_1 + N_ADDRS_2 * ENTRY_PER_BLOCK + N_ADDRS_3 * ENTRY_PER_BLOCK * ENTRY_PER_BLOCK) * BLOCK_SIZE)
+#define INODE_MAPSIZE ((uint64)(N_ADDRS_1 + N_ADDRS_2 * ENTRY_PER_BLOCK + N_ADDRS_3 * ENTRY_PER_BLOCK * ENTRY_PER_BLOCK) * BLOCK_SIZE)
+#define INODE_MAXSIZE (INODE_MAPSIZE < 0x80000000ull ? INODE_MAPSIZE : 0x80000000ull) // 4KB block时可以映射4GB以上, 限制在2GB, 32位的offset + len检查不会回绕
 
 // type 选项
 #define FT_UNUSED 0
@@ -26,12 +27,28 @@
 #define FT_FILE   2
 #define FT_DEVICE 3
 
+// 每个inode缓存的最近块映射数
+#define INODE_MAP_CACHE 4
+
+// flags 选项
+#define INODE_F_EXTENT 0x1  // addrs存放extent树而不是块指针 (见fs/extent.h, 只用于普通文件)
+#define INODE_F_INLINE 0x2  // addrs直接存放文件内容 (size <= INODE_INLINE_MAX, 新建的普通文件默认使用)
+#define INODE_F_INDEX  0x4  // 哈希索引目录: 第0个数据块是索引根节点 (见kernel/fs/dir.c, 只用于目录)
+#define INODE_F_TAIL   0x8  // 内容在共享的尾块中 (size <= TAIL_FILE_MAX, 内联区放不下的小文件, 见fs/tail.h)
+#define INODE_F_PACKED (INODE_F_INLINE | INODE_F_TAIL)  // 内容不在自己的数据块中
+#define INODE_F_COMPRESS 0x10  // 按页透明压缩 (见fs/compress.h, 只用于普通文件, 使用块指针映射)
+#define INODE_F_SHARED   0x20  // 数据块可能与reflink克隆的文件共享 (见fs/refcnt.h), 写入共享的块时先复制
+
+// 内联数据的最大长度 (整个addrs区域)
+#define INODE_INLINE_MAX (N_ADDRS * sizeof(uint32))
+
 // inode_num 无效的inode号
 #define INODE_NUM_UNUSED 0xFFFF
 
 typedef struct inode {
     // 磁盘里的inode信息 (由slk保护)
-    uint16 type;                // inode 管理的文件类型
+    uint8  type;                // inode 管理的文件类型
+    uint8  flags;               // INODE_F_* (旧的磁盘映像中为0)
     uint16 major;               // 设备文件使用: 主设备号
     uint16 minor;               // 设备文件使用: 次设备号
     uint16 nlink;               // 链接数量 (nlink个文件名链接到这个inode)
@@ -40,9 +57,21 @@ typedef struct inode {
 
     // 内存里的inode信息
     uint16 inode_num;           // inode序号
-    uint32 ref;                 // 引用数 (由lk_icache保护)
+    uint32 ref;                 // 引用数 (原子地修改, 归零只在持有lk_icache写锁时发生)
     bool valid;                 // 上述磁盘里inode字段的有效性 (由slk保护)
+    bool dirty;                 // 内存中的size/addrs尚未写回inode表块 (由slk保护)
     sleeplock_t slk;            // 睡眠锁
+    // 块映射缓存 (由map_lk保护, inode_lock重新读入时清空)
+    uint32 map_bn[INODE_MAP_CACHE];     // 最近翻译过的数据块序号
+    uint32 map_block[INODE_MAP_CACHE];  // 对应的磁盘块编号 (0: 槽位无效)
+    uint32 map_next;            // 下一个替换的槽位
+    uint32 map_ind;             // 最近使用的最后一级索引块 (0: 无)
+    uint32 map_ind_base;        // map_ind覆盖的第一个数据块序号
+    spinlock_t map_lk;          // 保护映射缓存 (共享持有slk的读者会并发更新它)
+
+    struct inode* hash_next;    // icache哈希链表 (由lk_icache保护)
+    struct inode* lru_prev;     // ref == 0 时所在的空闲LRU链表 (由lk_icache保护)
+    struct inode* lru_next;
 
 } inode_t;
 
@@ -52,17 +81,30 @@ void     inode_init();                        // 初始化
 void     inode_rw(inode_t* ip, bool write);   // 读写inode元数据
 inode_t* inode_alloc(uint16 inode_num);       // 在内存申请或查询inode(ref++)
 inode_t* inode_create(uint16 type, uint16 major, uint16 minor); // 在磁盘里创建新的inode并在内存申请对应副本
+inode_t* inode_create_near(uint16 parent, uint16 type, uint16 major, uint16 minor, uint8 flags); // 同上, inode和数据尽量靠近父目录
 void     inode_free(inode_t* ip);             // 释放inode(ref--) 适时销毁
 inode_t* inode_dup(inode_t* ip);              // ref++
-void     inode_lock(inode_t* ip);             // 上锁 (valid = false 则从磁盘读入inode)
+void     inode_lock(inode_t* ip);             // 上锁 (valid = false 则从磁盘读入inode, 同一块中的其他inode一起装入icache)
+void     inode_prefetch(uint16 inode_num);    // 异步预读inode所在的inode表块
 void     inode_unlock(inode_t* ip);           // 解锁
+void     inode_lock_shared(inode_t* ip);      // 共享上锁 (只读, 多个读者可以并发)
+void     inode_unlock_shared(inode_t* ip);    // 释放共享锁
 void     inode_unlock_free(inode_t* ip);      // 解锁 + 释放
+void     inode_flush(inode_t* ip);            // 写回延迟的元数据 (持有睡眠锁)
+void     inode_sync();                        // 写回所有dirty inode的元数据
 
 // inode 管理的数据
 
+uint32   inode_locate_block(inode_t* ip, uint32 bn, bool alloc); // 第bn个数据块的磁盘编号 (alloc: 不存在则分配)
+void     inode_map_cluster(inode_t* ip, uint32 bn, uint32 n, uint32 keep, uint32* blocks); // 压缩文件: [bn, bn + n)只保留前keep个块
 uint32   inode_read_data(inode_t* ip, uint32 offset, uint32 len, void* dst, bool user);
+void     inode_readahead(inode_t* ip, uint32 bn, uint32 count); // 异步预读[bn, bn + count)
 uint32   inode_write_data(inode_t* ip, uint32 offset, uint32 len, void* src, bool user);
+uint32   inode_direct_rw(inode_t* ip, uint32 offset, uint32 len, uint64 uaddr, bool write); // 绕过buf cache的整块传输
 void     inode_free_data(inode_t* ip);
+void     inode_truncate(inode_t* ip, uint32 size);                  // 截断或扩展到size字节
+int      inode_fallocate(inode_t* ip, uint32 offset, uint32 len);  // 预分配[offset, offset + len)
+int      inode_clone(inode_t* dst, inode_t* src, uint32* bn);      // reflink克隆的一段 (共享src的数据块)
 
 // for debug
 
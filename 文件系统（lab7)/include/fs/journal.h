@@ -0,0 +1,45 @@
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include "common.h"
+
+/*
+    元数据预写日志 (write-ahead journal)
+    日志区: 磁盘上连续的JOURNAL_BLOCKS个块, 第0块是日志头, 之后是JOURNAL_LOG_MAX个日志块
+    事务: journal_begin / journal_log / journal_end 之间修改的元数据块 (位图、inode表、索引块、目录块)
+        journal_log只把buf标记为已记录: 它留在缓存中, 提交前不会写回原位置
+        同一个块在一个事务中被修改多次只记录一次 (吸收)
+    提交: 没有进行中的操作时, 把事务的所有块复制进日志块, 一次顺序写入日志区, 写屏障后写日志头(提交点)
+        并发的多个操作合并成一个事务, 攒够JOURNAL_COMMIT_HIGH个块、超时、或fsync时提交
+    检查点: 提交后这些块变回普通的dirty buf, 由buf cache的定时写回写到原位置(异步);
+        下一次提交覆盖日志区之前, 先把上一个事务中仍然dirty的块写回原位置
+    恢复: 挂载时日志头中记录的事务校验通过则把日志块复制到原位置
+    普通文件的数据经过页缓存直接写盘, 不记录日志
+*/
+
+#define JOURNAL_MAGIC       0x4A4E4C31                       // "JNL1"
+#define JOURNAL_LOG_MAX     64                               // 一个事务最多记录的块数 (日志块数)
+#define JOURNAL_BLOCKS      (JOURNAL_LOG_MAX + 1)            // 日志区块数 (日志头 + 日志块)
+#define JOURNAL_OP_MAX      16                               // 一个操作最多修改的元数据块数 (journal_begin预留)
+#define JOURNAL_COMMIT_HIGH (JOURNAL_LOG_MAX / 2)            // 事务攒够这些块时在操作结束时提交
+
+// 日志头 (日志区第0块)
+typedef struct journal_header {
+    uint32 magic;                    // JOURNAL_MAGIC
+    uint32 seq;                      // 事务序号
+    uint32 n;                        // 事务的块数 (0: 日志为空)
+    uint32 checksum;                 // n个日志块内容的校验和 (日志块写到一半时不匹配)
+    uint32 blocks[JOURNAL_LOG_MAX];  // 第i个日志块对应的原位置
+} journal_header_t;
+
+typedef struct buf buf_t;
+
+void journal_recover();          // 读入超级块之后、bitmap_init之前调用: 重放已提交的事务
+void journal_init();             // bitmap_init之后调用: 没有日志区时在数据区中分配, 启用日志
+void journal_begin();            // 开始一个操作 (必须在获取任何inode锁之前调用, 可以嵌套)
+void journal_log(buf_t* buf);    // 代替buf_write: 把修改过的元数据块加入当前事务 (持有buf睡眠锁)
+void journal_end();              // 结束操作 (最外层结束时可能触发提交)
+void journal_force();            // 提交当前事务并等待落盘 (fsync / sync, 不能在操作中调用; 没有日志时buf_commit)
+void journal_flusher();          // 定时提交 (进程上下文调用, 不可持有任何锁)
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __PCACHE_H__
+#define __PCACHE_H__
+
+#include "common.h"
+#include "lib/lock.h"
+
+/*
+    页缓存 (page cache): (inode_num, 页序号) -> 一个物理页, 保存文件内容中对齐的4KB
+    普通文件(FT_FILE)的数据读写都经过页缓存, 整页在磁盘和物理页之间传输, 不经过buf cache
+    (buf cache只缓存目录和元数据); 同一个文件的同一页在内存中只有一份, 映射了这个文件的所有进程共享它
+    ref: 映射这一页的页表项数 + 正在使用它的内核路径数, ref > 0 的页不会被替换
+    dirty: 页中尚未写回磁盘的块 (由定时写回 / 替换 / msync / munmap / 进程退出写回)
+    延迟分配: 写入不分配数据块, dirty的空洞块在写回时成段分配, 在此之前页不会被替换
+*/
+
+#define N_PCACHE 128                          // 页缓存的页数
+#define PCACHE_BLOCKS (PGSIZE / BLOCK_SIZE)   // 每页包含的数据块数
+
+typedef struct page {
+    uint16 inode_num;           // 所属文件 (INODE_NUM_UNUSED: 空闲或已脱离文件)
+    uint32 pgoff;               // 文件内的页序号
+    uint64 page;                // 物理页地址 (第一次使用时申请)
+    uint32 ref;                 // 引用数 (由lk_pcache保护)
+    bool valid;                 // 页内容已从文件读入 (由slk保护)
+    uint8 dirty;                // 第i位: 页内第i个块有未写回的修改 (由lk_pcache保护)
+    uint8 holes;                // 第i位: 第i个块在文件大小以内但尚未分配或与其他文件共享 (由lk_pcache保护)
+    bool writeback;             // 正在写回磁盘 (由lk_pcache保护)
+    uint32 blocks[PCACHE_BLOCKS]; // 页内每个块的磁盘编号 (0: 空洞或在文件末尾之后, 由lk_pcache保护)
+    sleeplock_t slk;            // 读入或写回页内容时持有
+    struct page* hash_next;     // 哈希链表 (由lk_pcache保护)
+    struct page* lru_prev;      // LRU链表 (头部最久未使用, 由lk_pcache保护)
+    struct page* lru_next;
+} page_t;
+
+typedef struct inode inode_t;
+
+void    pcache_init();
+page_t* pcache_get(inode_t* ip, uint32 pgoff, bool fill); // 获取文件的一页(ref++), fill: 必要时读入 (持有ip睡眠锁)
+page_t* pcache_find(uint64 pa);                           // 物理页对应的缓存页 (不修改ref)
+bool    pcache_resident(uint16 inode_num, uint32 pgoff);  // 这一页是否已在缓存中 (缺页统计)
+bool    pcache_present(uint16 inode_num, uint32 pgoff);   // 这一页是否在缓存中, 包括正在读入的页 (预读命中统计)
+uint32  pcache_get_cached(uint16 inode_num, uint32 pgoff, uint32 n, page_t** pages); // 取出范围内已缓存的页(ref++), 不读盘
+void    pcache_put(page_t* pg);                           // ref--
+void    pcache_mark_dirty(page_t* pg);                    // 标记整页被修改
+uint32  pcache_read(inode_t* ip, uint32 offset, uint32 len, uint64 dst, bool user);  // 经过页缓存读文件 (持有ip睡眠锁)
+uint32  pcache_write(inode_t* ip, uint32 offset, uint32 len, uint64 src, bool user); // 经过页缓存写文件 (独占持有ip睡眠锁, 延迟分配)
+bool    pcache_read_cached(uint16 inode_num, uint32 offset, uint64 dst); // 直接I/O读空洞: 复制缓存页中的一块到用户地址
+void    pcache_readahead(inode_t* ip, uint32 pgoff, uint32 npages); // 批量读入[pgoff, pgoff + npages)中不在缓存的页
+void    pcache_writeback(inode_t* ip, uint32 pgoff, uint32 npages); // 写回[pgoff, pgoff + npages)中的dirty页 (独占持有ip睡眠锁)
+void    pcache_fsync(inode_t* ip);                        // 写回文件的所有dirty页 (独占持有ip睡眠锁)
+void    pcache_remap(inode_t* ip);                        // 重新记录文件所有缓存页的块号和空洞 (独占持有ip睡眠锁)
+void    pcache_flush(uint16 inode_num, uint32 pgoff, uint32 npages); // 写回范围内已分配块上的修改 (直接I/O读之前)
+void    pcache_update(uint16 inode_num, uint32 offset, uint64 src, uint32 len, bool user); // 直接I/O写入文件后同步已缓存的页
+void    pcache_deactivate(uint16 inode_num, uint32 pgoff, uint32 npages, bool drop); // 范围内的页移到LRU头部, drop: 丢弃干净页
+void    pcache_truncate(uint16 inode_num, uint32 size);   // 文件截断到size: 丢弃之后的页, 清零跨越size的页的尾部
+void    pcache_flusher();                                 // 定时/高水位写回dirty页 (进程上下文调用, 不可持有inode锁)
+void    pcache_sync();                                    // 立即写回全部dirty页, 完成延迟分配 (不可持有任何锁)
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __PIPE_H__
+#define __PIPE_H__
+
+#include "common.h"
+#include "lib/lock.h"
+#include "fs/poll.h"
+
+/*
+    管道: 一页大小的环形缓冲区, 读端和写端各是一个FD_PIPE类型的file
+    nread / nwrite 是只增不减的字节计数, 缓冲区中的数据是 [nread, nwrite)
+    读者只在缓冲区为空时睡眠, 写者只在缓冲区满时睡眠,
+    所以写者只在"空 -> 非空"时唤醒读者, 读者只在"满 -> 不满"时唤醒写者
+    poll / epoll在读端和写端各自的源上等待 (见fs/poll.h), 同样只在这两种变化和关闭时通知
+
+    页引用 (splice / vmsplice): 除了环形缓冲区, 管道还可以排队最多PIPE_BUFS个页引用, 数据留在原来的物理页中不复制
+        at是排入时的nwrite: 环形缓冲区中在它之前写入的字节先读出, nread走到at时轮到这个页引用
+        页缓存页持有pg->ref (引用期间不会被替换), 其他页 (用户页, 复制出来的页) 持有一个pmem引用
+        页的内容在读出之前仍可能被修改 (文件被写入, 用户写vmsplice过的页), 与Linux相同
+    缓冲区为空: 环形缓冲区和页引用队列都为空; 写者和splice的发送方都在&nwrite上等待 (环形缓冲区满 / 队列满)
+*/
+
+#define PIPE_SIZE PGSIZE  // 环形缓冲区大小 (2的幂)
+#define N_PIPE    16      // 同时存在的管道数
+#define PIPE_BUFS 4       // 每个管道最多排队的页引用数 (所有管道最多固定N_PIPE * PIPE_BUFS个页缓存页)
+
+typedef struct page page_t;
+
+typedef struct pipe_buf {
+    uint32 at;            // 排入时的nwrite
+    uint32 off;           // 数据在页内的偏移
+    uint32 len;           // 数据长度 (off + len <= PGSIZE)
+    uint64 pa;            // 物理页
+    page_t* pg;           // 页缓存页 (持有pg->ref), NULL: 持有pa的一个pmem引用
+} pipe_buf_t;
+
+typedef struct pipe {
+    spinlock_t lk;        // 保护以下字段
+    uint8* data;          // 环形缓冲区 (一个物理页)
+    uint32 nread;         // 已读出的字节数
+    uint32 nwrite;        // 已写入的字节数
+    bool readopen;        // 读端是否仍打开
+    bool writeopen;       // 写端是否仍打开
+    bool used;            // 槽位是否被使用 (由lk_pipe保护)
+    pipe_buf_t bufs[PIPE_BUFS]; // 页引用队列, 其中是 [bhead, btail)
+    uint32 bhead;         // 已取出的页引用数
+    uint32 btail;         // 已排入的页引用数
+    poll_head_t rph;      // 等待可读的项 (读端)
+    poll_head_t wph;      // 等待可写的项 (写端)
+} pipe_t;
+
+typedef struct file file_t;
+
+void   pipe_init();
+int    pipe_alloc(file_t** rf, file_t** wf);                     // 创建管道和它的读端/写端file
+void   pipe_close(pipe_t* pi, bool writable);                    // 关闭一端, 两端都关闭时释放
+uint32 pipe_read(pipe_t* pi, uint32 len, uint64 dst, bool user);  // 缓冲区为空时睡眠, 写端关闭后返回0
+uint32 pipe_write(pipe_t* pi, uint32 len, uint64 src, bool user); // 缓冲区满时睡眠, 读端关闭后返回-1
+uint32 pipe_poll(pipe_t* pi, bool writable, poll_head_t** head);   // 一端当前的状态 POLL*, *head输出它的源
+int    pipe_give(pipe_t* pi, pipe_buf_t* buf);                      // 排入一个页引用 (队列满时睡眠), 读端已关闭返回-1 (引用仍属于调用者)
+uint32 pipe_take(pipe_t* pi, uint32 len, pipe_buf_t* buf, bool wait); // 取出开头最多len字节作为一个页引用, 返回字节数 (为空时wait决定是否睡眠)
+void   pipe_buf_put(pipe_buf_t* buf);                                // 放弃页引用
+
+#endif
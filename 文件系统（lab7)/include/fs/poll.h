@@ -0,0 +1,87 @@
+#ifndef __POLL_H__
+#define __POLL_H__
+
+#include "common.h"
+#include "lib/lock.h"
+
+/*
+    多个fd的就绪通知 (poll / 类似epoll的持久监视集合)
+    可以等待的源 (管道的读端和写端, 控制台) 各有一个poll_head_t, 挂着在它上面等待的项;
+    源的状态变化时 (管道 空->非空 / 满->不满 / 一端关闭, 控制台提交一行) 调用poll_wake,
+    匹配的项被放入所属实例的就绪链表并唤醒等待者, 等待者只检查就绪链表中的项 (O(就绪数))
+    水平触发: epoll_wait取出就绪项后重新检查它的状态, 仍然就绪的项放回链表, 下一次等待还会报告
+    没有源的文件 (普通文件, 目录, /proc, /tmp) 总是可读可写, 加入后一直在就绪链表中
+    sys_poll在内核栈上建立一个临时实例, 返回前拆除
+    锁的顺序: 源的锁 (pi->lk / cons.lk) -> head->lk -> ep->lk -> waitq.lk
+        检查文件状态时 (需要源的锁) 不持有head->lk和ep->lk; ep->slk串行化同一实例的ctl / wait / 关闭
+*/
+
+// 事件 (与Linux的取值相同); POLLERR / POLLHUP / POLLNVAL总是报告, 不需要在events中指定
+#define POLLIN   0x001   // 有数据可读 (或读到文件结束)
+#define POLLOUT  0x004   // 可以写入而不睡眠
+#define POLLERR  0x008   // 管道写端: 读端已关闭
+#define POLLHUP  0x010   // 管道读端: 写端已关闭
+#define POLLNVAL 0x020   // fd无效 (只用于sys_poll)
+
+// epoll_ctl的操作
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+#define POLL_MAX  32     // 一次sys_poll最多的fd数
+#define EPOLL_MAX 32     // 一次epoll_wait最多返回的事件数
+
+typedef struct pollfd {
+    int fd;              // 负数时忽略 (revents = 0)
+    int16 events;        // 关心的事件 POLLIN / POLLOUT
+    int16 revents;       // 输出: 发生的事件
+} pollfd_t;
+
+typedef struct epoll_event {
+    uint32 events;       // ctl: 关心的事件; wait: 发生的事件
+    uint64 data;         // 原样带回
+} epoll_event_t;
+
+typedef struct file file_t;
+typedef struct poll_entry poll_entry_t;
+typedef struct epoll epoll_t;
+
+// 一个可以等待的源
+typedef struct poll_head {
+    spinlock_t lk;               // 保护entries链表
+    poll_entry_t* entries;       // 在这个源上等待的项
+} poll_head_t;
+
+// 实例中监视的一个fd
+struct poll_entry {
+    epoll_t* ep;                 // 所属的实例
+    file_t* file;                // 监视的文件 (持有一个引用)
+    int fd;
+    uint32 events;               // 关心的事件 (由ep->slk保护, poll_wake不加锁读取)
+    uint64 data;                 // 报告时带回 (sys_poll: pollfd数组中的下标)
+    poll_head_t* head;           // 挂在哪个源上 (NULL: 文件没有源, 总是就绪)
+    poll_entry_t* head_next;     // head->entries链表 (由head->lk保护)
+    poll_entry_t* ready_next;    // 就绪链表 (由ep->lk保护)
+    bool ready;                  // 是否在就绪链表中 (由ep->lk保护)
+    poll_entry_t* next;          // 实例中所有项的链表 (由ep->slk保护)
+};
+
+// 一个监视集合 (epoll_create返回的FD_EPOLL文件, 或sys_poll的临时实例)
+struct epoll {
+    sleeplock_t slk;             // 串行化ctl / wait的检查 / 关闭
+    spinlock_t lk;               // 保护就绪链表, 也是等待者睡眠时持有的锁
+    poll_entry_t* items;         // 所有项
+    poll_entry_t* ready_head;    // 就绪链表 (FIFO)
+    poll_entry_t* ready_tail;
+};
+
+void     poll_init();                                       // 初始化项和实例的slab cache
+void     poll_head_init(poll_head_t* head, char* name);
+void     poll_wake(poll_head_t* head, uint32 mask);          // 源上发生了mask中的事件
+int      poll_fds(uint64 fds, uint32 nfds, int timeout);    // sys_poll (timeout: 毫秒, -1永远等待)
+file_t*  epoll_create();                                    // 新的FD_EPOLL文件
+void     epoll_close(epoll_t* ep);                          // 最后一个引用关闭时释放实例
+int      epoll_ctl(epoll_t* ep, int op, int fd, uint64 event);     // event: 用户地址 (DEL时可以为0)
+int      epoll_wait(epoll_t* ep, uint64 events, int max, int timeout);       // 返回报告的事件数
+
+#endif
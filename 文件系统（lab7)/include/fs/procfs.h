@@ -0,0 +1,42 @@
+#ifndef __PROCFS_H__
+#define __PROCFS_H__
+
+#include "common.h"
+#include "fs/file.h"
+
+/*
+    /proc: 只读的统计文件, 不在磁盘上 (没有inode, 也不出现在目录中)
+        打开以"/proc/"开头的绝对路径时由file_open_at转到procfs_open, 文件类型是FD_PROC
+        /proc/bufcache     buf cache的命中、淘汰和读写盘次数 (buf_stat)
+        /proc/meminfo      两个物理内存区域的总页数和空闲页数, 交换区和/tmp的使用, 缺页和换入换出计数,
+                           之后是各用途 (MEMTAG_*) 的内核页数、slab对象数和它们的最大值, 以及各hart上的申请次数
+        /proc/locks        锁竞争统计, 按等待cycle数降序 (make LOCK_STAT=1, 否则只有一行说明)
+        /proc/syscalls     被调用过的系统调用号的全局统计 (syscall_stat)
+        /proc/interrupts   每个外部中断源在各hart上的次数和亲和性 (dev/plic.h)
+        /proc/loadavg      1/5/15分钟的负载均值 (两位小数) 和当前可运行的进程数 (proc_loadavg)
+        /proc/cpustat      每个hart的用户态/内核态/空闲时间、运行队列等待时间 (mtime单位) 和切换次数
+        /proc/cmdline      启动选项 (见lib/bootopt.h), 一行
+        /proc/<pid>/stat   进程的状态快照、CPU时间和I/O统计 (proc_info), <pid>可以是self
+    每次read都重新生成整个文本 (申请PROCFS_BUF字节的临时缓冲区), 再从file->offset处复制:
+        一次读完看到的是同一时刻的统计; 分多次读取时各段可能来自不同时刻
+    每行是"名字 值"或空格分隔的表格, 数字都是十进制
+*/
+
+#define PROCFS_BUF_ORDER 1                         // 生成文本的缓冲区: 2^order页
+#define PROCFS_BUF (PGSIZE << PROCFS_BUF_ORDER)
+
+// file->proc_node
+#define PROC_BUFCACHE  1
+#define PROC_MEMINFO   2
+#define PROC_LOCKS     3
+#define PROC_SYSCALLS  4
+#define PROC_PID_STAT  5
+#define PROC_INTERRUPTS 6
+#define PROC_LOADAVG   7
+#define PROC_CPUSTAT   8
+#define PROC_CMDLINE   9
+
+file_t* procfs_open(char* path, uint32 open_mode);                    // path是"/proc/"之后的部分, 只能只读打开, 失败返回NULL
+uint32  procfs_read(file_t* file, uint32 len, uint64 dst, bool user);  // 从file->offset处读取并前移, 进程已退出时返回0
+
+#endif
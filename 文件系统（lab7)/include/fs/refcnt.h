@@ -0,0 +1,25 @@
+#ifndef __REFCNT_H__
+#define __REFCNT_H__
+
+#include "common.h"
+
+/*
+    数据块的引用计数表 (reflink克隆的文件共享数据块, 见file_clone)
+    表是数据区中连续的sb.refcnt_blocks个块, 每个数据块一个uint16项, 记录除第一个引用之外的引用数:
+        0表示块只属于一个文件 (或空闲), 所以从来没有克隆过的文件系统不需要初始化任何项,
+        表在第一次克隆时才创建 (旧的磁盘镜像没有, 超级块中的refcnt_magic为0)
+    释放数据块 (bitmap_free_block / bitmap_free_batch_add) 时先减少计数, 还有其他引用时块不回到位图
+    表中的块是元数据, 修改记录日志; 锁的顺序: inode睡眠锁 -> 表块buf
+*/
+
+#define REFCNT_MAGIC     0x52454643                // "REFC"
+#define REFCNT_PER_BLOCK (BLOCK_SIZE / sizeof(uint16))  // 一个表块中的项数
+#define REFCNT_MAX       0xFFFF                    // 一个块最多的额外引用数
+
+void refcnt_init();                // 初始化创建表用的锁
+int  refcnt_enable();              // 没有表时创建 (不能在日志操作中调用), 成功返回0
+bool refcnt_shared(uint32 block);  // 数据块是否被多于一个文件引用
+bool refcnt_get(uint32 block);     // 增加一个引用 (在日志操作中), 达到上限时返回false
+bool refcnt_put(uint32 block);     // 释放一个引用 (在日志操作中), 仍有其他引用时返回true (块不能释放)
+
+#endif
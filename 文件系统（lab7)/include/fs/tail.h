@@ -0,0 +1,51 @@
+#ifndef __TAIL_H__
+#define __TAIL_H__
+
+#include "fs/inode.h"
+
+/*
+    尾块打包的小文件 (flags & INODE_F_TAIL, 只用于普通文件)
+    内联区(52字节)放不下、但不超过TAIL_FILE_MAX字节的文件不独占数据块,
+    多个文件的内容共享一个尾块: 块的开头是tail_header_t (尾块映射: 每个分配单位属于哪个inode),
+    之后按TAIL_UNIT字节分成分配单位, 一个文件占用连续的若干单位
+    inode的addrs区域存放tail_loc_t (尾块编号, 起始单位, 单位数)
+    文件增长超过TAIL_FILE_MAX时迁移到普通数据块; 尾块中没有文件时释放
+    尾块中含有元数据 (尾块映射), 块内的所有修改 (包括文件内容) 都记录日志
+*/
+
+#define TAIL_MAGIC     0x5441494C                // "TAIL"
+#define TAIL_UNIT      64                        // 分配单位 (字节)
+#define TAIL_UNITS     (BLOCK_SIZE / TAIL_UNIT)  // 尾块中的单位数 (含块头占用的单位)
+#define TAIL_FILE_MAX  (BLOCK_SIZE / 2)          // 尾块打包的文件大小上限
+#define TAIL_FREE      0xFFFF                    // 尾块映射: 空闲单位
+#define TAIL_OWNER_HDR 0xFFFE                    // 尾块映射: 块头占用的单位
+
+// 尾块的块头 (尾块映射)
+typedef struct tail_header {
+    uint32 magic;              // TAIL_MAGIC
+    uint16 used;               // 已占用的单位数 (含块头)
+    uint16 reserved;
+    uint16 owner[TAIL_UNITS];  // 每个单位所属的inode_num
+} tail_header_t;
+
+#define TAIL_HDR_UNITS ((sizeof(tail_header_t) + TAIL_UNIT - 1) / TAIL_UNIT)  // 块头占用的单位数
+#define TAIL_UNITS_FOR(size) (((size) + TAIL_UNIT - 1) / TAIL_UNIT)          // size字节需要的单位数
+
+// 文件在尾块中的位置 (存放在inode的addrs区域)
+typedef struct tail_loc {
+    uint32 block;  // 尾块编号
+    uint32 start;  // 起始单位
+    uint32 units;  // 单位数 (可能多于文件大小需要的, 为增长预留)
+} tail_loc_t;
+
+#define TAIL_LOC(ip) ((tail_loc_t*)(ip)->addrs)
+#define TAIL_CAPACITY(loc) ((loc)->units * TAIL_UNIT)
+
+void   tail_init();
+void   tail_alloc(uint16 inode_num, uint32 units, tail_loc_t* loc);              // 分配units个清零的单位
+void   tail_grow(uint16 inode_num, tail_loc_t* loc, uint32 units, uint32 size);  // 扩大到units个单位, 保留前size字节
+void   tail_free(uint16 inode_num, tail_loc_t* loc);                             // 释放文件占用的单位
+void   tail_rw(tail_loc_t* loc, uint32 offset, uint32 len, void* addr, bool user, bool write); // 读写文件内容
+void   tail_zero(tail_loc_t* loc, uint32 offset, uint32 len);                    // 清零[offset, offset + len)
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __TMPFS_H__
+#define __TMPFS_H__
+
+#include "common.h"
+#include "fs/file.h"
+#include "fs/dir.h"
+#include "lib/lock.h"
+
+/*
+    /tmp: 只在内存中的文件系统, 没有inode、块映射、位图和buf, 关机后内容丢失
+        以"/tmp"开头的绝对路径由file.c和sysfile.c转到这里 (与/proc相同, 相对路径和chdir进入/tmp不支持)
+        文件类型是FD_TMP, file->tmp指向节点; 节点组成一棵树, 目录的子节点是一个按创建顺序的链表
+        文件数据是按页组织的: 前TMPFS_NDIRECT页的地址在节点中, 之后的在页目录中 (伙伴系统的连续块, 按需要加倍)
+        没有写过的页读出全0; 所有文件的数据页合计不超过TMPFS_MAX_PAGES
+    支持的操作: 打开/创建、读写(包括pread/pwrite/readv/writev)、lseek、fstat/fstatat、ftruncate、
+        getdents、mkdir、unlink (目录需为空)、rename (只在/tmp之内); 不支持硬链接、mmap和设备文件
+    加锁: tmpfs.lk (睡眠锁) 保护树的结构、节点的名字、nlink和ref; 节点的slk保护数据页和size
+        加锁顺序: tmpfs.lk -> node->slk; 读者共享持有slk
+    节点在从树中删除 (nlink = 0) 并且没有打开的文件 (ref = 0) 时释放
+*/
+
+#define TMPFS_NDIRECT       8       // 节点中直接记录的数据页数
+#define TMPFS_MAP_MAX_ORDER 3       // 页目录最大的阶 (2^3页 = 4096项)
+#define TMPFS_MAXSIZE       ((TMPFS_NDIRECT + (PGSIZE << TMPFS_MAP_MAX_ORDER) / sizeof(uint64)) * (uint64)PGSIZE)
+#define TMPFS_MAX_PAGES     8192    // 所有文件的数据页总数上限 (32MB)
+
+typedef struct tmpfs_node {
+    uint16 type;                    // FT_FILE 或 FT_DIR
+    uint16 ino;                     // 节点编号 (fstat的inode_num, getdents的inode_num)
+    uint16 nlink;                   // 在树中为1, 删除后为0
+    uint32 ref;                     // 打开的文件项数
+    uint32 size;                    // 文件: 字节数; 目录: 子节点数
+    char name[DIR_NAME_LEN];
+    struct tmpfs_node* parent;      // 根节点的parent是自己
+    struct tmpfs_node* child;       // 第一个子节点 (for dir)
+    struct tmpfs_node* next;        // 下一个兄弟节点
+    sleeplock_t slk;                // 保护数据页和size (for file)
+    uint64 direct[TMPFS_NDIRECT];   // 前TMPFS_NDIRECT个数据页, 0表示空洞
+    uint64* map;                    // 之后的数据页 (NULL表示还没有)
+    uint32 map_order;               // 页目录的阶
+} tmpfs_node_t;
+
+void    tmpfs_init();
+char*   tmpfs_path(char* path);                           // "/tmp"或"/tmp/..."返回之后的部分, 其他路径返回NULL
+file_t* tmpfs_open(char* path, uint32 open_mode);         // path是tmpfs_path的结果, 失败返回NULL
+void    tmpfs_close(tmpfs_node_t* node);                  // 最后一个文件项关闭时调用, 放弃打开时的引用
+uint32  tmpfs_rw(file_t* file, uint32* offset, uint32 len, uint64 addr, bool user, bool write); // 从*offset处读写并前移, 失败返回-1
+int     tmpfs_truncate(tmpfs_node_t* node, uint32 size);  // 截断或扩展到size字节
+void    tmpfs_fill_state(tmpfs_node_t* node, file_state_t* state);
+int     tmpfs_stat(char* path, file_state_t* state);
+int     tmpfs_getdents(file_t* file, uint64 addr, uint32 len); // 从file->dir_cookie处继续读取目录项
+int     tmpfs_mkdir(char* path);
+int     tmpfs_unlink(char* path);
+int     tmpfs_rename(char* old_path, char* new_path);     // 两个路径都在/tmp之内
+uint32  tmpfs_pages();                                    // 已申请的数据页数
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+#include "common.h"
+#include "lib/lock.h"
+
+/*
+    共享内存提交/完成队列 (类似io_uring)
+    两个物理页同时映射进用户地址空间和被内核直接访问(物理地址):
+        第0页: uring_ctl_t (偏移0) + 提交队列 URING_SQ_ENTRIES 个 uring_sqe_t (偏移URING_SQ_OFF)
+        第1页: 完成队列 URING_CQ_ENTRIES 个 uring_cqe_t
+    提交队列: 用户写入sqes[sq_tail % N]后增加sq_tail, 内核处理后增加sq_head
+    完成队列: 内核写入cqes[cq_tail % N]后增加cq_tail, 用户取走后增加cq_head
+    head / tail 是只增不减的计数, 各自只由一方修改
+    内核在sys_uring_enter中处理, 也在进程每次从陷阱返回用户态之前(系统调用、时钟中断)处理,
+    所以用户只写队列、轮询完成队列也能完成请求, 不需要每个请求陷入一次内核
+    URING_OP_FSYNC交给后台工作线程异步执行 (见proc/kwork.h): 完成项在落盘之后才出现, 顺序可能晚于之后提交的请求
+        在途的请求预留了完成队列的位置; 进程退出或exec之前等待它们完成 (uring_drain)
+    队列属于创建它的进程 (线程各自创建), 映射在(可能共享的)地址空间中
+*/
+
+#define URING_PAGES      2
+#define URING_SQ_OFF     64                           // 提交队列在第0页中的偏移
+#define URING_SQ_ENTRIES 64                           // 提交队列长度 (64 * 32字节)
+#define URING_CQ_ENTRIES (PGSIZE / sizeof(uring_cqe_t)) // 完成队列长度 (256)
+
+// 请求类型
+#define URING_OP_NOP    0
+#define URING_OP_READ   1   // fd, addr, len, offset
+#define URING_OP_WRITE  2   // fd, addr, len, offset
+#define URING_OP_FSYNC  3   // fd
+#define URING_OP_OPENAT 4   // fd = 目录fd (或AT_FDCWD), addr = 路径, len = open_mode
+
+#define URING_OFFSET_CUR 0xFFFFFFFF  // 读写使用并推进文件自身的偏移量
+
+typedef struct uring_sqe {
+    uint8 opcode;       // URING_OP_*
+    uint8 pad[3];
+    int fd;
+    uint64 addr;        // 用户缓冲区 / 路径
+    uint32 len;
+    uint32 offset;      // 文件偏移 (URING_OFFSET_CUR: 使用文件偏移量)
+    uint64 user_data;   // 原样带回完成项
+} uring_sqe_t;
+
+typedef struct uring_cqe {
+    uint64 user_data;   // 来自提交项
+    int res;            // 与对应系统调用的返回值相同
+    uint32 pad;
+} uring_cqe_t;
+
+typedef struct uring_ctl {
+    volatile uint32 sq_head;    // 内核修改
+    volatile uint32 sq_tail;    // 用户修改
+    volatile uint32 cq_head;    // 用户修改
+    volatile uint32 cq_tail;    // 内核修改
+    uint32 sq_entries;
+    uint32 cq_entries;
+} uring_ctl_t;
+
+// 进程的队列 (内核通过物理地址访问, ctl == NULL 表示没有创建)
+typedef struct uring {
+    uint64 va;                  // 映射的用户起始地址
+    uring_ctl_t* ctl;
+    uring_sqe_t* sqes;
+    uring_cqe_t* cqes;
+    spinlock_t lk;              // 保护cq_tail的推进和inflight (进程和工作线程都会写入完成项)
+    uint32 inflight;            // 交给工作线程、还没有写入完成项的请求数
+} uring_t;
+
+typedef struct proc proc_t;
+
+void   uring_init();                // 初始化异步请求的slab cache
+uint64 uring_setup(proc_t* p);     // 创建队列并映射进p的地址空间, 返回用户地址 (失败返回0)
+void   uring_drain(proc_t* p);     // 等待p交给工作线程的请求全部完成并放弃队列 (exec / 进程退出)
+bool   uring_pending(proc_t* p);   // 提交队列中有未处理的请求
+uint32 uring_process(proc_t* p);   // 处理提交队列 (完成队列满时停止), 返回处理的请求数
+bool   uring_overlap(proc_t* p, uint64 begin, uint32 npages); // [begin, begin + npages页)与队列重叠
+
+#endif
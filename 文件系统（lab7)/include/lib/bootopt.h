@@ -0,0 +1,22 @@
+#ifndef __BOOTOPT_H__
+#define __BOOTOPT_H__
+
+#include "common.h"
+
+/*
+    启动选项: qemu的-append (make qemu BOOTARGS="...") 放在设备树的/chosen/bootargs中, 是以空格分隔的单词
+    hart 0在pmem_init之前复制一份 (设备树之后被覆盖), 之后任何时候都可以查询
+        verbose      同步打印超级块等详细的启动信息 (默认只写入内核日志, 见lib/klog.h)
+        fs_selftest  挂载文件系统之后运行内置的文件读写和路径测试 (会在磁盘上创建文件)
+        ramdisk      把文件系统映像复制到内存块设备上运行, 所有修改在关机后丢失 (见dev/ramdisk.h)
+    用户程序从/proc/cmdline读取整个字符串, 由init运行的user/test.c解释的选项:
+        bench / bench=倍数  基准测试模式: 运行bench套件后关机 (make bench), 以bench_开头的单词选出要运行的程序
+*/
+
+#define BOOTARGS_LEN 128
+
+void bootopt_init(uint64 dtb);   // 从设备树复制启动选项
+bool bootopt(char* name);        // 启动选项中有单词name?
+char* bootopt_args(void);        // 整个启动选项字符串 (/proc/cmdline)
+
+#endif
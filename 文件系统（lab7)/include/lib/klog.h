@@ -0,0 +1,24 @@
+#ifndef __KLOG_H__
+#define __KLOG_H__
+
+#include "common.h"
+
+/*
+    内核日志: 每个hart一个KLOG_SIZE字节的环形缓冲区, 热路径 (调度、fork / wait / exit) 用klog代替printf
+    写入: 本hart关中断后只写自己的环, 不加锁也不与其他hart共享缓存行
+        字符先写到pos, 整条消息格式化完之后才发布到w: [d, w)总是完整的消息
+        还没有写出到UART的字节 [d, w) 不被覆盖, 环满时丢弃之后的字符 (计入dropped)
+    写出: 时钟中断发现有未写出的日志时提交一个后台工作 (kwork), 工作线程依次把各hart的 [d, w) 放入UART发送缓冲区
+        同一时刻只有一个写出者推进d; panic时不经过工作线程直接同步写出
+    读取 (sys_dmesg): 每个hart保留最近KLOG_SIZE字节, 按hart的顺序复制
+        复制时本hart可能继续写入: 复制之后重新读pos, 丢掉可能已被覆盖的最早部分
+*/
+
+#define KLOG_SIZE 4096    // 每个hart的环形缓冲区大小 (2的幂)
+
+void   klog(const char* fmt, ...);               // 格式同printf, 写入本hart的日志
+void   klog_kick();                              // 时钟中断: 有未写出的日志时提交写出工作
+void   klog_flush_sync();                        // panic: 同步写出所有未写出的日志
+uint32 klog_read(uint64 dst, uint32 len, bool user); // 复制保留的日志, 返回字节数
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __KSTAT_H__
+#define __KSTAT_H__
+
+#include "lib/percpu.h"
+
+/*
+    内核事件计数 (每个hart一份, 见lib/percpu.h), sys_kstat把各hart的和拷贝给用户
+    模块自己的统计 (buf cache等) 用同样的计数器组, 由各自的stat接口读取
+*/
+
+// 与用户态kstat_t一致
+typedef struct kstat {
+    uint64 syscalls;      // 系统调用
+    uint64 page_faults;   // 用户态缺页 (包括处理失败的)
+    uint64 cow_faults;    // 写时复制缺页
+    uint64 swap_outs;     // 换出的页
+    uint64 swap_ins;      // 换入的页
+    uint64 ctx_switches;  // 调度器切换到进程
+    uint64 steals;        // 从其他hart的运行队列窃取进程
+    uint64 wakeups;       // 睡眠的进程被唤醒
+    uint64 idles;         // 没有可运行的进程, 等待中断
+    uint64 dev_intrs;     // 外部设备中断
+    uint64 timer_intrs;   // 包含tick的时钟中断
+    uint64 softirqs;      // 执行的软中断下半部 (多次触发合并为一次)
+    uint64 fp_loads;      // 第一条浮点指令的陷阱中装入进程的浮点状态
+    uint64 fp_saves;      // 切换时保存修改过的浮点状态
+} kstat_t;
+
+typedef PCPU_DEFINE(kstat_t, kstat_pcpu_t);
+extern kstat_pcpu_t kstat_counter;
+
+#define KSTAT_ADD(field, n) PCPU_ADD(kstat_counter, field, n)
+#define KSTAT_INC(field)    KSTAT_ADD(field, 1)
+
+void kstat_read(kstat_t* st);   // 各hart的和
+
+#endif
@@ -3,32 +3,99 @@
 
 #include "common.h"
 
+/*
+    自旋锁有两种, 初始化时选择, 接口相同:
+        测试并设置 (spinlock_init): 等待者只读锁字, 看到释放后才尝试原子交换; 不保证公平
+        排队锁 (spinlock_init_ticket): 取一个号 (原子加next), 等到serving等于自己的号;
+            按到达的顺序交接, 不会有hart一直抢不到; 用于竞争激烈的锁
+    两种锁都用locked和cpuid记录持有者 (spinlock_holding)
+*/
 typedef struct spinlock {
     int locked;
     char* name;
     int cpuid;
+    bool ticket;              // 排队锁
+    volatile uint32 next;     // 排队锁: 下一个等待者取到的号
+    volatile uint32 serving;  // 排队锁: 持有锁的号
+#ifdef LOCK_STAT
+    struct lock_class* cls;   // 锁统计的类 (见lib/lockstat.h)
+    uint64 hold_start;        // 获得锁时的cycle
+#endif
 } spinlock_t;
 
 void push_off();
 void pop_off();
 
 void spinlock_init(spinlock_t* lk, char* name);
+void spinlock_init_ticket(spinlock_t* lk, char* name);
 void spinlock_acquire(spinlock_t* lk);
+bool spinlock_try_acquire(spinlock_t* lk);   // 不等待: 锁空闲时获得并返回true
 void spinlock_release(spinlock_t* lk);
 bool spinlock_holding(spinlock_t* lk); 
 
+/*
+    读写自旋锁: 读者之间并发, 写者独占; 写者优先
+        state: 低位是读者数, RW_WRITER位表示写者持有
+        wwait: 等待中的写者数, 不为0时新的读者等待 (写者不会被源源不断的读者饿死)
+    同一个hart不能重复获得读锁 (中间有写者在等待时会死锁), 持有读锁时只能原子地修改数据
+*/
+#define RW_WRITER (1u << 31)
+
+typedef struct rwspinlock {
+    volatile uint32 state;    // 读者数 | RW_WRITER
+    volatile uint32 wwait;    // 等待的写者数
+    char* name;
+    int cpuid;                // 持有写锁的hart
+#ifdef LOCK_STAT
+    struct lock_class* cls;   // 锁统计的类 (见lib/lockstat.h)
+    uint64 hold_start;        // 获得写锁时的cycle
+#endif
+} rwspinlock_t;
+
+void rwspinlock_init(rwspinlock_t* lk, char* name);
+void rwspinlock_acquire_read(rwspinlock_t* lk);
+void rwspinlock_release_read(rwspinlock_t* lk);
+void rwspinlock_acquire_write(rwspinlock_t* lk);
+void rwspinlock_release_write(rwspinlock_t* lk);
+bool rwspinlock_holding_write(rwspinlock_t* lk);
+
+
+/*
+    睡眠锁 (排他模式 + 共享模式, 等待中的排他请求优先)
+        等待者按先后进入锁自己的等待队列 (通过p->slq_next串起来), 各自睡眠在p->slq_waiting上:
+        释放时只唤醒队头的排他等待者或队头连续的共享等待者, 不会唤醒所有等待者再让它们重新竞争
+        自适应自旋: 排他持有者正在另一个hart上运行时, 先自旋等待最多SLEEPLOCK_SPIN次再睡眠
+        sleeplock_holding不加锁 (只有持有者自己会把owner从自己改掉), 可以放在频繁执行的断言中
+        优先级继承: 进入等待队列的进程优先级高于排他持有者时把持有者提升到自己的优先级 (见proc_pi_boost),
+        持有者释放最后一个提升过它的锁时回到原来的优先级; 只提升直接的持有者 (不沿着持有者等待的锁传递),
+        共享持有者不记录是谁, 不提升
+*/
+#define SLEEPLOCK_SPIN 4096
 
-// 睡眠锁
 typedef struct sleeplock {
-    int locked;         // 锁是否被持有
-    spinlock_t lk;      // 保护睡眠锁的自旋锁
-    char* name;         // 锁名称
-    int pid;            // 持有锁的进程ID
+    volatile int locked;     // 锁是否被排他持有
+    volatile int readers;    // 共享持有者数量
+    int wwait;               // 在队列中等待排他持有的进程数 (有等待者时不再授予新的共享持有)
+    spinlock_t lk;           // 保护睡眠锁的自旋锁
+    char* name;              // 锁名称
+    int pid;                 // 排他持有锁的进程ID
+    struct proc* volatile owner; // 排他持有锁的进程
+    struct proc* qhead;      // 等待队列 (先进先出)
+    struct proc* qtail;
+    bool pi_boosted;         // 等待者提升过持有者的优先级 (释放时恢复)
+#ifdef LOCK_STAT
+    struct lock_class* cls;   // 锁统计的类 (见lib/lockstat.h)
+    uint64 hold_start;        // 排他获得锁时的cycle
+#endif
 } sleeplock_t;
 
 void sleeplock_init(sleeplock_t* lk, char* name);
 void sleeplock_acquire(sleeplock_t* lk);
+bool sleeplock_try_acquire(sleeplock_t* lk);
 void sleeplock_release(sleeplock_t* lk);
 bool sleeplock_holding(sleeplock_t* lk);
+void sleeplock_acquire_shared(sleeplock_t* lk);   // 共享持有 (与其他共享持有者并发)
+void sleeplock_release_shared(sleeplock_t* lk);
+bool sleeplock_holding_any(sleeplock_t* lk);      // 当前进程排他持有, 或者锁处于共享持有状态
 
 #endif
\ No newline at end of file
@@ -0,0 +1,40 @@
+#ifndef __LOCKSTAT_H__
+#define __LOCKSTAT_H__
+
+#include "common.h"
+
+/*
+    锁竞争统计 (make LOCK_STAT=1 时编译进内核, 否则sys_lockstat返回-1)
+        同名的锁属于同一个类 ("buf_bucket"、"proc"等), 初始化锁时按名字找到或创建类, 类的数量超过N_LOCK_CLASS时归入最后一个类
+        每个类统计: 获得锁的次数、其中需要等待的次数、等待的总cycle数 (rdcycle)、最长的持有时间 (cycle)
+        自旋锁的等待是自旋, 睡眠锁的等待是睡眠; 睡眠锁的共享持有不计持有时间
+    计数器用原子操作更新 (同一个类的锁可能在不同的hart上同时被获得)
+*/
+
+#define N_LOCK_CLASS   64
+#define LOCK_NAME_LEN  16
+
+typedef struct lock_class {
+    char* name;
+    uint64 acquires;       // 获得锁的次数
+    uint64 contended;      // 需要等待的次数
+    uint64 wait_cycles;    // 等待的总cycle数
+    uint64 hold_max;       // 最长的持有时间 (cycle)
+} lock_class_t;
+
+// sys_lockstat报告的一项 (与用户态lockstat_t一致)
+typedef struct lockstat {
+    char name[LOCK_NAME_LEN];
+    uint64 acquires;
+    uint64 contended;
+    uint64 wait_cycles;
+    uint64 hold_max;
+} lockstat_t;
+
+lock_class_t* lockstat_class(char* name);                      // 名字对应的类 (初始化锁时调用)
+void lockstat_acquired(lock_class_t* cls, bool contended, uint64 wait); // 获得了锁, 等待了wait个cycle
+void lockstat_released(lock_class_t* cls, uint64 hold);       // 释放了持有hold个cycle的锁
+int  lockstat_report(uint8* order);                            // order[0..返回值)是按等待cycle数降序排列的类
+void lockstat_read(int cls, lockstat_t* st, bool reset);      // 读取第cls个类的统计 (reset: 之后清零)
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __PERCPU_H__
+#define __PERCPU_H__
+
+#include "common.h"
+
+/*
+    每个hart的统计计数器
+        计数器组是一个结构体 (字段都是uint64), 每个hart一份, 各自按缓存行对齐 (不同hart的计数器不在同一行)
+        PCPU_ADD只写本hart的那一份: 不加锁, 用原子加 (同一个hart上被中断打断、或者读出hart编号之后被迁移都不会丢失计数),
+        其他hart不会写这一行, 原子加不会引起缓存行在hart之间来回传递
+        读取时把所有hart的值加起来 (PCPU_SUM), 各字段分别求和, 不保证彼此严格一致
+    用法:
+        static PCPU_DEFINE(buf_stat_t, buf_counter);
+        PCPU_ADD(buf_counter, hits, 1);
+        st->hits = PCPU_SUM(buf_counter, hits);
+*/
+
+#define PCPU_LINE 64    // 缓存行大小
+
+#define PCPU_DEFINE(type, name) \
+    struct { type v; } __attribute__((aligned(PCPU_LINE))) name[NCPU]
+
+#define PCPU_ADD(name, field, n) \
+    __sync_fetch_and_add(&(name)[pcpu_id()].v.field, (uint64)(n))
+
+#define PCPU_SUM(name, field) \
+    pcpu_sum(&(name)[0].v.field, sizeof((name)[0]))
+
+// 本hart的编号 (tp, 与mycpuid相同; riscv.h不能被头文件包含)
+static inline int pcpu_id()
+{
+    uint64 x;
+    asm volatile("mv %0, tp" : "=r" (x));
+    return (int)x;
+}
+
+// 从first开始每隔stride字节一个计数器, 共NCPU个, 返回它们的和
+static inline uint64 pcpu_sum(volatile uint64* first, uint64 stride)
+{
+    uint64 sum = 0;
+    for (int i = 0; i < NCPU; i++) {
+        sum += *(volatile uint64*)((char*)first + i * stride);
+    }
+    return sum;
+}
+
+#endif
@@ -2,9 +2,12 @@
 #define __PRINT_H__
 
 #include "common.h"
+#include <stdarg.h>
 
 void print_init(void);
 void printf(const char* fmt, ...);
+void print_format(void (*putc)(int, void*), void* arg, const char* fmt, va_list ap); // 按printf的格式逐个字符输出到putc(c, arg)
+uint32 ksnprintf(char* buf, uint32 size, const char* fmt, ...); // 格式化到buf (截断, 总是以0结尾), 返回写入的字节数 (不含0)
 void panic(const char* warning);
 void assert(bool condition, const char* warning);
 
@@ -0,0 +1,42 @@
+#ifndef __PROF_H__
+#define __PROF_H__
+
+#include "common.h"
+
+/*
+    采样分析: 打开之后每个hart每经过prof_every个tick, 时钟中断记录一次被打断的位置
+        记录: 被打断的pc (sepc)、当前进程的pid (没有时为0)、hart、被打断时在用户态还是内核态
+        没有打开时时钟中断里只是一次对prof_every的判断
+    每个hart一个PROF_N条记录的环形缓冲区, 本hart在中断处理中写入 (不加锁); 还没有取出的记录不被覆盖, 环满时丢弃新的采样 (计入dropped)
+    取出: sys_prof按hart依次取出记录 (读者之间由prof_lk互斥)
+    用户态的prof_print把记录输出为文本行, 主机上的kernel/profsym按kernel-qemu和用户程序的ELF符号表解析
+*/
+
+#define PROF_N          512                           // 每个hart的记录数 (2的幂)
+#define PROF_READ_MAX   (PGSIZE / sizeof(prof_sample_t)) // 一次最多取出的记录数
+
+#define PROF_START 0   // sys_prof: 开始采样 (arg: 每隔几个tick采样一次, 0按1处理)
+#define PROF_STOP  1   // sys_prof: 停止采样
+#define PROF_READ  2   // sys_prof: 取出记录
+
+// 与用户态prof_sample_t一致
+typedef struct prof_sample {
+    uint64 pc;
+    uint32 pid;
+    uint16 hart;
+    uint16 user;    // 1: 用户态
+} prof_sample_t;
+
+extern volatile uint32 prof_every;
+
+#define PROF_TICK(pc, user) do { \
+    if (prof_every) prof_tick((pc), (user)); \
+} while (0)
+
+void   prof_init();
+void   prof_tick(uint64 pc, bool user);    // 时钟中断经过了一个tick (关中断)
+void   prof_start(uint32 every);
+void   prof_stop();
+uint32 prof_read(uint64 dst, uint32 n, uint64* dropped); // 取出最多n条记录到用户地址dst, 返回条数
+
+#endif
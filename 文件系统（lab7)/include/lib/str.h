@@ -3,6 +3,14 @@
 
 #include "common.h"
 
+// 按字处理的memset / memmove / memcmp, make RVV=1时长数据使用向量指令 (见lib/str.c)
+#define STR_VECTOR_MIN 256   // 使用向量指令的最小字节数
+
+extern bool str_vector;                 // hart支持V扩展并且编译了向量版本
+void str_vector_probe(uint64 misa);     // M-mode的start中调用 (hart 0)
+void* str_rvv_memset(void *dst, int c, uint64 n);           // str_rvv.S (n > 0)
+void* str_rvv_memcpy(void *dst, const void *src, uint64 n); // str_rvv.S (n > 0, 可以从前往后复制)
+
 void* memset(void *dst, int c, uint32 n);
 int memcmp(const void *v1, const void *v2, uint32 n);
 void* memmove(void *dst, const void *src, uint32 n);
@@ -0,0 +1,52 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "common.h"
+
+/*
+    追踪点: 调度、fork / clone / wait / exit等事件以定长的二进制记录写入每个hart的环形缓冲区
+        记录: 时刻 (mtime)、hart、当前进程的pid、事件号、两个参数 (含义见各事件)
+        按类别在运行时打开 (sys_trace), 没有打开时追踪点只是一次对trace_mask的判断
+    写入: 本hart关中断后写自己的环, 不加锁; 环满时覆盖最早的记录
+    读取: 读者按hart依次取出上一次读到之后的记录 (读者之间由trace_lk互斥), 被覆盖的记录计入lost
+        复制之后重新检查写入位置, 丢掉复制期间可能被覆盖的记录
+    用户态的trace_print按同一张表解码 (见user/user_lib.c)
+*/
+
+// 类别 (trace_mask的位)
+#define TRACE_SCHED   (1u << 0)   // 调度器切换进程
+#define TRACE_PROC    (1u << 1)   // 进程的创建、等待和退出
+
+// 事件号
+#define TRACE_EV_SWITCH  1        // 调度器切换进程 (arg0: 进程的pid, arg1: 优先级)
+#define TRACE_EV_FORK    2        // pid创建了子进程 (arg0: 子进程pid)
+#define TRACE_EV_CLONE   3        // pid创建了线程 (arg0: 线程pid, arg1: 入口地址)
+#define TRACE_EV_WAIT    4        // pid开始等待子进程 (arg0: 是否睡眠)
+#define TRACE_EV_REAP    5        // pid回收了子进程 (arg0: 子进程pid, arg1: 退出状态)
+#define TRACE_EV_EXIT    6        // pid退出 (arg0: 退出状态)
+
+#define TRACE_N      256          // 每个hart的记录数 (2的幂)
+#define TRACE_READ_MAX (PGSIZE / sizeof(trace_event_t)) // 一次最多读出的记录数
+
+// 与用户态trace_event_t一致
+typedef struct trace_event {
+    uint64 time;      // mtime
+    uint16 hart;
+    uint16 event;
+    uint32 pid;       // 当前进程 (没有时为0)
+    uint64 arg0;
+    uint64 arg1;
+} trace_event_t;
+
+extern volatile uint32 trace_mask;
+
+#define TRACE(cat, ev, a0, a1) do { \
+    if (trace_mask & (cat)) trace_record((ev), (uint64)(a0), (uint64)(a1)); \
+} while (0)
+
+void   trace_init();
+void   trace_record(uint16 event, uint64 arg0, uint64 arg1);
+uint32 trace_set(uint32 mask);                         // 设置打开的类别, 返回原来的
+uint32 trace_read(uint64 dst, uint32 n, uint64* lost); // 取出最多n条记录到用户地址dst, 返回条数
+
+#endif
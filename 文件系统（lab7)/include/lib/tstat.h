@@ -0,0 +1,57 @@
+#ifndef __TSTAT_H__
+#define __TSTAT_H__
+
+#include "common.h"
+
+/*
+    热路径计时 (make TIME_STAT=1 时编译进内核, 否则宏展开为空, sys_tstat返回-1)
+        TSTAT_BEGIN(t) 在当前作用域声明计时起点t (rdcycle), TSTAT_END(t, site) 把经过的cycle数计入site
+        起点放在别的变量中时 (跨函数, 如proc_sched到调度器), 用TSTAT_MARK(var)记录, 同样用TSTAT_END结束
+    每个计时点统计次数、总cycle数、最短和最长, 每个hart一份 (见lib/percpu.h), 读取时合并
+        开始和结束可能不在同一个hart上 (中间睡眠过): 计入结束时的hart
+*/
+
+// 计时点 (与用户态的TSTAT_*一致)
+#define TSTAT_BUF_HIT       0   // buf_read: 命中缓存
+#define TSTAT_BUF_MISS      1   // buf_read: 从磁盘读入
+#define TSTAT_LOCATE_BLOCK  2   // inode_locate_block
+#define TSTAT_SEARCH_INODE  3   // search_inode (路径解析)
+#define TSTAT_COPYIN        4   // uvm_copyin
+#define TSTAT_COPYOUT       5   // uvm_copyout
+#define TSTAT_SWTCH         6   // proc_sched进入swtch到调度器从swtch返回
+#define TSTAT_DISK_RW       7   // virtio_disk_rw
+#define N_TSTAT             8
+
+// 与用户态tstat_t一致
+typedef struct tstat {
+    uint64 count;
+    uint64 total;     // 总cycle数
+    uint64 min;
+    uint64 max;
+} tstat_t;
+
+#ifdef TIME_STAT
+
+static inline uint64 tstat_now()
+{
+    uint64 x;
+    asm volatile("rdcycle %0" : "=r" (x));
+    return x;
+}
+
+#define TSTAT_BEGIN(t)      uint64 t = tstat_now()
+#define TSTAT_MARK(var)     ((var) = tstat_now())
+#define TSTAT_END(t, site)  tstat_record((site), tstat_now() - (t))
+
+void tstat_record(int site, uint64 cycles);
+void tstat_read(int site, tstat_t* st);   // 各hart合并
+
+#else
+
+#define TSTAT_BEGIN(t)
+#define TSTAT_MARK(var)
+#define TSTAT_END(t, site)
+
+#endif
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __ASID_H__
+#define __ASID_H__
+
+#include "common.h"
+
+/*
+    ASID (地址空间标识): satp[59:44], TLB中的表项按ASID区分, 切换页表时不需要刷新整个TLB
+    内核页表使用ASID 0; 每个进程在第一次返回用户态时分配一个ASID, 同一代(generation)中ASID不重复使用
+    ASID用完时开始新的一代: 所有进程的ASID作废, 每个hart在下一次返回用户态之前刷新一次整个TLB,
+    进程返回用户态时发现自己的ASID属于旧的一代就重新分配
+    修改用户页表后调用asid_flush / asid_flush_page / asid_flush_range, 立即刷新这个地址空间在本hart上的表项:
+        连续的少量页 (不超过ASID_FLUSH_PAGES) 逐页刷新, 更大的范围刷新整个ASID
+    其他hart上的旧表项延迟刷新: 修改时把其他hart记入地址空间的asid_stale, 在这些hart上返回用户态之前先刷新这个ASID;
+        没有修改过页表的进程换hart时不需要刷新
+    共享的地址空间 (线程, 见proc/proc.h) 可能同时在别的hart的用户态运行: asid_active记录这些hart,
+        修改时向它们发送处理器间中断并等待它们进入内核 (asid_user_exit), 它们返回用户态之前按asid_stale刷新
+    硬件不支持ASID (ASID位数为0) 时所有页表都使用ASID 0, 由trampoline在每次切换页表时刷新整个TLB
+*/
+
+#define ASID_FLUSH_PAGES 16  // asid_flush_range逐页刷新的最大页数, 超过时刷新整个ASID
+
+struct proc;
+
+void   asid_init();                                 // hart 0启用分页后调用: 检测硬件支持的ASID位数
+uint64 asid_satp(struct proc* p);                   // 返回用户态前调用 (关中断): p在本hart上使用的satp值
+void   asid_user_exit(struct proc* p);              // 从用户态进入内核时调用 (关中断): 本hart不再使用p的用户地址空间
+void   asid_flush(struct proc* p);                  // p的页表有修改: 刷新本hart上p的地址空间的TLB表项
+void   asid_flush_page(struct proc* p, uint64 va);  // 同上, 只修改了va所在的一页
+void   asid_flush_range(struct proc* p, uint64 va, uint64 len); // 同上, 修改了[va, va + len)
+
+#endif
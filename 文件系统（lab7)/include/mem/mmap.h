@@ -3,15 +3,70 @@
 
 #include "common.h"
 
+/*
+    进程的空闲mmap区域: 按起始地址排序的AVL树 (proc->mmap是根节点), 区域之间互不相邻
+    每个节点记录子树中最大的空闲区域页数, 放置映射时跳过放不下的子树:
+    查找、分割(占用)和合并(归还)都是O(log n)
+*/
 typedef struct mmap_region {
-    uint64 begin;             // 起始地址
-    uint32 npages;            // 管理的页面数量
-    struct mmap_region* next; // 链表指针
+    uint64 begin;               // 起始地址
+    uint32 npages;              // 管理的页面数量
+    uint32 max_npages;          // 以这个节点为根的子树中最大的npages
+    int height;                 // 子树高度
+    struct mmap_region* left;   // 起始地址更小的区域
+    struct mmap_region* right;  // 起始地址更大的区域
 } mmap_region_t;
 
+// 文件映射的访问权限
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+
+// sys_mmap的标志
+#define MAP_POPULATE 0x1  // 立即分配并映射所有页 (默认在第一次访问时分配)
+
+#define N_MMAP_FILE 8  // 每个进程的文件映射数
+
+// 文件页 (文件映射和程序映像的只读页) 缺页时顺带映射同一窗口中已在页缓存中的页, 窗口按大小对齐
+#define FAULT_AROUND_DEFAULT 16  // 默认窗口页数 (64KB)
+#define FAULT_AROUND_MAX     32  // 窗口页数的上限 (mmap_fault_around在内核栈上记录窗口中的页)
+
+// 一个文件映射: [begin, begin + npages * PGSIZE) <-> 文件的第pgoff页开始的npages页
+// 页面在缺页时从页缓存映射(共享), 写回发生在msync / munmap / 进程退出
+typedef struct mmap_file {
+    uint64 begin;             // 起始地址 (file == NULL 表示槽位空闲)
+    uint32 npages;            // 页数
+    uint32 pgoff;             // 对应文件的起始页序号
+    bool writable;            // PROT_WRITE
+    struct file* file;        // 映射的文件 (持有一个引用)
+} mmap_file_t;
+
+struct proc;
+struct inode;
+
 void           mmap_init();
 mmap_region_t* mmap_region_alloc();
 void           mmap_region_free(mmap_region_t* mmap);
 void           mmap_show_mmaplist();
 
+mmap_region_t* mmap_tree_init();                                          // 整个mmap区域作为一个空闲区域的树
+mmap_region_t* mmap_tree_copy(mmap_region_t* root);                       // 复制整棵树 (fork)
+void           mmap_tree_destroy(mmap_region_t* root);                    // 释放整棵树
+mmap_region_t* mmap_tree_lookup(mmap_region_t* root, uint64 va);          // 包含va的空闲区域, 没有返回NULL
+uint64         mmap_tree_fit(mmap_region_t* root, uint32 npages, uint64 align); // 地址最低的能放下npages页且起点按align对齐的位置, 没有返回0
+mmap_region_t* mmap_tree_insert(mmap_region_t* root, uint64 begin, uint32 npages); // 插入空闲区域 (不合并), 返回新的根
+mmap_region_t* mmap_tree_remove(mmap_region_t* root, uint64 begin);       // 删除起点为begin的空闲区域, 返回新的根
+void           mmap_tree_print(mmap_region_t* root);                      // 按地址顺序输出 (for debug)
+
+uint64         mmap_file_map(struct file* file, uint64 begin, uint32 npages, uint32 pgoff, int prot); // 建立文件映射 (不分配页)
+bool           mmap_file_fault(uint64 va, bool write);          // 文件映射区域的缺页处理, 不属于文件映射返回false
+bool           mmap_file_mapped(struct proc* p, uint64 va);     // va是否属于p的某个文件映射
+int            mmap_file_sync(uint64 begin, uint32 npages);     // msync: 写回范围内被修改的页
+int            mmap_file_unmap(uint64 begin, uint32 npages);    // 解除整个文件映射, 不是文件映射返回-1
+void           mmap_file_fork(struct proc* p, struct proc* np); // 子进程继承文件映射
+void           mmap_file_exit(struct proc* p);                  // 进程退出: 写回并解除所有文件映射
+
+uint32         fault_around_set(uint32 pages);                  // 设置顺带映射的窗口页数, 返回之前的值
+uint32         mmap_fault_around(struct proc* p, struct inode* ip, uint64 va, uint64 begin, uint64 end,
+                                 uint32 pgoff, int perm, bool major); // 顺带映射va所在窗口中已缓存的文件页, 返回页数
+
 #endif
\ No newline at end of file
@@ -6,15 +6,111 @@
 // 来自kernel.ld
 extern char KERNEL_DATA[];
 extern char ALLOC_BEGIN[];
-extern char ALLOC_END[];
+extern char ALLOC_END[];   // 设备树中没有内存信息时使用的物理内存结束地址
 /*跨越 Linker 和 Compiler 的边界传递地址信息,如果设置为uint64C 编译器会认为：
 ALLOC_BEGIN 是一个存放在某处的 uint64 变量。
 链接器告诉编译器，这个变量存储在地址 X。
 编译器会去地址 X 读取 8个字节的内容。 但这不对！ 我们不想要地址 X 里的内容（那里可能是乱码），我们要的是 X 这个地址本身
 */
 
-void  pmem_init(void);
-void* pmem_alloc(bool in_kernel);
-void  pmem_free(uint64 page, bool in_kernel);
+/*
+    连续多页分配 (伙伴系统): 内核区域与用户区域之间单独划出PMEM_BUDDY_PAGES页,
+    起始地址按最大阶对齐, 阶为order的块是2^order个物理连续、按自身大小对齐的页
+    (PMEM_MAX_ORDER = 9 即2MB, 可以作为SV39的大页)
+*/
+#define PMEM_MAX_ORDER   9
+#define PMEM_BUDDY_PAGES 1024   // 伙伴系统管理的页数 (PMEM_MAX_ORDER阶块的整数倍)
+
+/*
+    物理内存的大小在启动时由设备树决定 (phys_top): 页帧元数据、内核区域、伙伴系统和用户区域依次排在ALLOC_BEGIN之后,
+    多出来的内存都属于用户区域 (内核区域可以从中借页)
+    内核区域与用户区域的边界是自适应的: KERNEL_PAGES只是内核区域的初始大小,
+    一个区域的空闲页用完时从另一个区域借页, 另一个区域至少保留自己的reserve
+    (内核区域保留PMEM_KERNEL_RESERVE页, 用户进程再多也借不走; 用户区域保留PMEM_USER_RESERVE页)
+    区域的可用页 (自己的空闲页 + 可以借的页) 低于低水位时调用这个区域注册的回收函数, 直到回到高水位
+*/
+#define PMEM_KERNEL_RESERVE 256   // 保证内核可用的页数 (1MB)
+#define PMEM_USER_RESERVE   64    // 用户区域不借给内核的页数
+#define PMEM_WMARK_LOW      128   // 可用页低于此值时回收
+#define PMEM_WMARK_HIGH     256   // 回收到此值为止
+#define PMEM_N_RECLAIM      4     // 每个区域最多注册的回收函数数
+
+// 回收函数: 尽量释放target页给所属的区域, 返回释放的页数
+// 在pmem_alloc返回前调用, 调用者可能持有任意自旋锁: 回收函数不能睡眠, 需要的锁已被本hart持有时直接返回0
+typedef uint32 (*pmem_reclaim_t)(uint32 target);
+
+/*
+    页帧元数据: [ALLOC_BEGIN, phys_top)中的每一页对应一个32位字 (放在ALLOC_BEGIN开头的几页中, 这几页不参与分配)
+    低24位是引用计数, 高8位是标志; 空闲页的元数据为0
+    申请时引用计数为1; 多个地址空间共享同一页时每多一个引用调用一次pmem_get, 放弃引用时调用pmem_put,
+    最后一个引用放弃时页才释放 (回到申请时的区域); pmem_free只能释放没有共享的页 (引用计数为1)
+*/
+#define PMEM_F_KERNEL  0x01  // 页帧标志: 从内核区域申请
+#define PMEM_F_BUDDY   0x02  // 页帧标志: 伙伴系统中的页 (pmem_alloc_order申请的块, 或拆分后的大页)
+#define PMEM_F_COW     0x04  // 页帧标志: 写时复制共享的用户页 (所有映射都是只读的, 写入时复制, 见uvm_cow_fault)
+#define PMEM_F_PINNED  0x08  // 页帧标志: 内核通过物理地址直接访问的用户页 (如uring的队列), fork时复制而不共享
+#define PMEM_F_SHARED  0x10  // 页帧标志: 共享内存对象的页 (见mem/shm.h), fork时直接共享并保持可写
+
+#define PMEM_ZERO      0x1   // pmem_alloc_flags: 调用者需要内容全0的页 (否则内容未知, 调用者会覆盖整页)
+#define PMEM_NORECLAIM 0x2   // pmem_alloc_flags: 不调用回收函数
+#define PMEM_TAG(tag)  ((uint32)(tag) << 8)  // pmem_alloc_flags: 页的用途 (MEMTAG_*), 计入这个子系统的页数
+
+/*
+    内核内存按用途 (子系统) 统计, 在/proc/meminfo中输出, 用来判断内核区域实际需要多少页
+        申请内核自己使用的页时用PMEM_TAG标记用途 (不论从哪个区域申请, 如页表和trapframe在用户区域),
+        每页的用途记在页帧元数据之后的字节数组中, 最后一个引用释放时减少对应的页数;
+        没有标记的页 (MEMTAG_NONE, 用户页和页缓存) 不统计
+        slab cache创建时指定用途: slab页按这个用途标记, 对象数由kmem_cache_alloc/free在本hart的计数器上统计
+    页数是全局的原子计数, 记录最大值; 对象数是各hart申请、释放次数之差, 最大值只在slab层补充对象时更新 (近似)
+*/
+#define MEMTAG_NONE      0   // 不统计
+#define MEMTAG_PGTBL     1   // 页表页 (包括页表页缓存中的)
+#define MEMTAG_KSTACK    2   // 内核栈
+#define MEMTAG_TRAPFRAME 3   // trapframe
+#define MEMTAG_BUF       4   // buf cache
+#define MEMTAG_INODE     5   // icache
+#define MEMTAG_FILE      6   // 文件项、管道、poll/epoll
+#define MEMTAG_PROC      7   // 进程、地址空间和文件描述符表
+#define MEMTAG_MMAP      8   // mmap区域、共享内存和交换区的记录
+#define MEMTAG_FS        9   // tmpfs和uring的内核对象
+#define MEMTAG_TEMP      10  // 系统调用等短暂使用的临时页
+#define N_MEMTAG         11
+
+typedef struct memtag_stat {
+    uint64 pages;           // 当前占用的页数
+    uint64 pages_max;       // 页数的最大值
+    uint64 objs;            // 当前分配出去的slab对象数
+    uint64 objs_max;        // 对象数的最大值 (近似)
+    uint64 allocs[NCPU];    // 各hart上申请页和对象的次数
+} memtag_stat_t;
+
+extern char* memtag_name[N_MEMTAG];
+
+extern uint64 phys_top;   // 物理内存结束地址 (pmem_init设置, 见memlayout.h)
+
+void  pmem_init(void);      // 从设备树得到物理内存大小 (在设备树被覆盖之前调用), 建立各区域
+void* pmem_alloc(bool in_kernel);                  // 申请一页, 内容全0 (= pmem_alloc_flags(in_kernel, PMEM_ZERO))
+void* pmem_alloc_flags(bool in_kernel, uint32 flags);
+bool  pmem_zero_idle(void);                        // 在后台清零一批空闲页 (工作线程), 没有可清零的页时返回false
+bool  pmem_zero_pending(void);                     // 是否有内容未知的空闲页可以清零 (不加锁的检查)
+void  pmem_free(uint64 page, bool in_kernel);    // 释放一页 (伙伴系统中的页作为0阶块还给伙伴系统, 见大页拆分)
+uint32 pmem_free_pages(bool in_kernel);   // 区域内可用的空闲页数, 包括可以借的页 (不加锁读取, 仅供参考)
+uint32 pmem_total_pages(bool in_kernel);  // 区域初始的页数 (之后区域之间互相借页, 仅供参考)
+void  pmem_register_reclaim(bool in_kernel, pmem_reclaim_t fn); // 注册区域的回收函数
+void  pmem_shrink(bool in_kernel);                 // 立即调用区域的回收函数 (用PMEM_NORECLAIM申请失败后, 在重试之前)
+void* pmem_alloc_order(uint32 order);             // 申请2^order个物理连续的页 (已清零, 失败返回NULL)
+void  pmem_free_order(uint64 page, uint32 order); // 释放pmem_alloc_order申请的块 (order与申请时相同)
+void  pmem_get(uint64 page);                      // 增加一个引用 (页必须已被申请)
+bool  pmem_put(uint64 page);                      // 放弃一个引用, 是最后一个引用时释放这一页并返回true
+void  pmem_put_order(uint64 page, uint32 order);  // 放弃pmem_alloc_order申请的块中每一页的一个引用
+uint32 pmem_refcount(uint64 page);                // 页的引用计数 (空闲页为0)
+uint32 pmem_frame_flags(uint64 page);             // 页的PMEM_F_*标志
+void  pmem_frame_set_flags(uint64 page, uint32 flags);   // 原子地设置页的标志 (页必须已被申请)
+void  pmem_frame_clear_flags(uint64 page, uint32 flags); // 原子地清除页的标志
+uint64 pmem_zero_page(void);                      // 全局的全0页: 标记PMEM_F_COW且引用计数不会降到1, 只能只读映射 (映射时pmem_get)
+void  memtag_obj_alloc(uint32 tag);               // 本hart申请了一个tag用途的slab对象
+void  memtag_obj_free(uint32 tag);                // 本hart释放了一个tag用途的slab对象
+void  memtag_obj_sample(uint32 tag);              // 更新tag用途的对象数最大值 (slab层补充对象时调用)
+void  memtag_read(uint32 tag, memtag_stat_t* st); // 读取tag用途的统计
 
 #endif
\ No newline at end of file
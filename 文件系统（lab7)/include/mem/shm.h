@@ -0,0 +1,44 @@
+#ifndef __SHM_H__
+#define __SHM_H__
+
+#include "common.h"
+#include "lib/lock.h"
+
+/*
+    共享内存对象: 一组物理页, 可以同时映射进多个进程的mmap区域 (零拷贝的进程间通信)
+    创建时申请全部页(清零)并标记PMEM_F_SHARED: 对象持有每页的一个引用, 每个映射再持有一个 (pmem_get)
+    fork时映射了对象的区域在子进程中映射同一组页并保持可写 (不写时复制), 子进程同样算一次映射
+    销毁只是不再接受新的映射: 对象在最后一个映射解除 (shm_unmap / exec / 进程退出) 后释放
+    对象号就是全局表中的下标
+*/
+
+#define N_SHM          16                       // 系统中共享内存对象的最大数量
+#define N_SHM_ATTACH   8                        // 每个进程最多同时映射的对象数
+#define SHM_MAX_PAGES  (PGSIZE / sizeof(uint64)) // 一个对象最多的页数 (页地址表占一页)
+
+typedef struct shm {
+    uint32 npages;    // 页数 (0: 槽位空闲)
+    uint64* pages;    // 每一页的物理地址 (一个内核页)
+    uint32 nattach;   // 映射数 (所有进程的)
+    bool removed;     // 已被销毁, nattach降为0时释放
+} shm_t;
+
+// 进程中的一个映射: [begin, begin + npages * PGSIZE) -> 对象shm (shm == NULL 表示槽位空闲)
+typedef struct shm_attach {
+    uint64 begin;
+    uint32 npages;
+    shm_t* shm;
+} shm_attach_t;
+
+struct proc;
+
+void   shm_init();
+int    shm_create(uint32 npages);                        // 创建对象, 成功返回id 失败返回-1
+uint64 shm_map(int id);                                  // 在当前进程的mmap区域中映射对象, 成功返回起始地址 失败返回-1
+int    shm_unmap(uint64 begin);                          // 解除起点为begin的映射, 成功返回0 失败返回-1
+int    shm_destroy(int id);                              // 销毁对象 (已有的映射仍然有效), 成功返回0 失败返回-1
+bool   shm_overlap(struct proc* p, uint64 begin, uint32 npages); // 范围是否与p的某个映射相交 (这些页不能用munmap解除)
+void   shm_fork(struct proc* p, struct proc* np);        // 子进程继承映射 (页表项已由uvm_copy_pgtbl共享)
+void   shm_exit(struct proc* p);                         // exec / 进程退出: 放弃所有映射 (页由销毁页表时释放)
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __SLAB_H__
+#define __SLAB_H__
+
+#include "common.h"
+#include "lib/lock.h"
+#include "mem/pmem.h"
+
+/*
+    slab分配器: 固定大小内核对象的缓存 (kmem_cache)
+    每个slab是一个内核物理页 (pmem_alloc_flags(true, 0)), 页首是slab_t, 之后切分成同样大小的对象,
+    空闲对象的第一个字串成页内的空闲链表; 对象所在的slab就是它所在的页, 释放时O(1)找到
+    有空闲对象的slab挂在cache的partial链表上, 全部分配出去的slab不在任何链表上;
+    全空的slab只保留一个, 其余立即归还pmem
+    每个hart有一个小的对象栈, 申请和释放先在本地完成 (只关中断), 空了或满了才以SLAB_CPU_BATCH个对象为单位访问cache锁
+    对象内容不清零, 也不保留上一次使用时的状态: 调用者负责初始化(包括锁)
+    每个cache属于一个用途 (MEMTAG_*, 见mem/pmem.h): slab页和对象数都计入这个用途
+*/
+
+#define SLAB_CPU_OBJS  16   // 每个hart本地栈最多缓存的对象数
+#define SLAB_CPU_BATCH 8    // 本地栈与slab之间一次转移的对象数
+
+typedef struct slab {
+    struct slab* prev;          // partial链表
+    struct slab* next;
+    struct kmem_cache* cache;   // 所属的cache
+    void* free;                 // 页内的空闲对象链表
+    uint32 inuse;               // 已分配出去的对象数 (包括各hart本地栈中的)
+} slab_t;
+
+typedef struct kmem_cpu_cache {
+    uint32 count;                  // 栈中的对象数
+    void* objs[SLAB_CPU_OBJS];     // objs[count - 1]是栈顶 (最近释放)
+} kmem_cpu_cache_t;
+
+typedef struct kmem_cache {
+    char* name;
+    uint32 obj_size;            // 对象大小 (按8字节对齐)
+    uint32 per_slab;            // 每个slab中的对象数
+    uint32 tag;                 // 用途 (MEMTAG_*)
+    spinlock_t lk;              // 保护以下字段 (各hart的本地栈只由自己在关中断时访问)
+    slab_t* partial;            // 有空闲对象的slab
+    uint32 nempty;              // partial中全空的slab数 (0或1)
+    uint32 nslab;               // slab总数
+    kmem_cpu_cache_t cpu[NCPU];
+} kmem_cache_t;
+
+void  kmem_cache_init(kmem_cache_t* cache, char* name, uint32 obj_size, uint32 tag); // 初始化空的cache (obj_size >= 8)
+void* kmem_cache_alloc(kmem_cache_t* cache);                             // 申请一个对象, 回收内核区域后仍然不足时返回NULL
+void  kmem_cache_free(kmem_cache_t* cache, void* obj);                   // 释放kmem_cache_alloc申请的对象
+
+#endif
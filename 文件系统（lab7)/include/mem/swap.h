@@ -0,0 +1,42 @@
+#ifndef __SWAP_H__
+#define __SWAP_H__
+
+#include "common.h"
+#include "mem/vmem.h"
+
+/*
+    交换区: 磁盘上文件系统之后的一段连续块 (mkfs创建, 记录在超级块中), 每个槽位存放一页
+    换出: 进程在自己的上下文中换出自己的冷页 (用户态被时钟中断打断且用户区域低于低水位时, 或缺页时申请不到页)
+        其他进程可能正睡眠在内核中并持有自己用户页的物理地址 (直接I/O等), 所以不换出别的进程的页; 线程共享的地址空间同理不换出
+        时钟算法: 指针mm->swap_hand沿程序映像和堆、用户栈、mmap区域循环扫描已映射的页,
+        PTE_A为1的页清除PTE_A并跳过, 为0的页作为牺牲页; 一批最多SWAP_BATCH页写入连续的槽位 (一个scatter-gather请求)
+        只换出引用计数为1、没有任何页帧标志的4KB私有页: 写时复制、共享内存、内核直接访问的页、页缓存页和大页都不换出
+    换出的页表项: V = 0, U = 1, PPN字段是槽位号, R/W/X保留原来的权限 (硬件不解释V = 0的页表项)
+    换入: 缺页时读回槽位的内容, 恢复原来的权限, 放弃对槽位的引用
+    fork时子进程的页表项引用同一个槽位 (槽位引用计数+1), 之后各自换入各自的副本
+    内核在持有自旋锁时访问用户缓冲区 (如管道) 之前用swap_prefault换入, 持有自旋锁时不换入也不换出
+*/
+
+#define SWAP_MAGIC      0x53574150                 // "SWAP"
+#define SWAP_BLOCKS_PER_PAGE (PGSIZE / BLOCK_SIZE)  // 一个槽位的块数
+#define SWAP_MAX_SLOTS  (PGSIZE / sizeof(uint16))  // 槽位上限 (引用计数表占一页)
+#define SWAP_BATCH      16                         // 一次换出的最多页数 (= VIRTIO_MAX_SG)
+#define SWAP_SCAN_MAX   2048                       // 一次换出最多检查的页数
+
+// 换出的页表项
+#define PTE_SWAPPED(pte)        (((pte) & (PTE_V | PTE_U)) == PTE_U)
+#define SWAP_TO_PTE(slot, perm) (((uint64)(slot) << 10) | ((perm) & (PTE_R | PTE_W | PTE_X)) | PTE_U)
+#define PTE_TO_SLOT(pte)        ((uint32)((pte) >> 10))
+
+void   swap_init();                                  // 挂载文件系统时调用: 超级块记录了交换区时启用
+uint32 swap_out(uint32 target);                      // 换出当前进程最多target个冷页, 返回换出的页数
+void   swap_balance();                               // 用户区域低于低水位时换出当前进程的一批冷页
+bool   swap_fault(uint64 va);                        // 当前进程va所在页已换出时换入, 否则返回false
+void   swap_prefault(uint64 va, uint64 len);         // 换入当前进程[va, va + len)中已换出的页 (持有自旋锁访问之前)
+uint64 swap_alloc_user(uint32 flags);                // 申请一个用户页, 失败时换出一批冷页再试一次
+void   swap_free(uint32 slot);                       // 页表项不再引用槽位
+bool   swap_fork(pgtbl_t src, pgtbl_t dst, uint64 begin, uint64 end); // 子进程共享[begin, end)中换出的页, 内存不足返回false
+uint64 swap_count(pgtbl_t pgtbl, uint64 begin, uint64 end); // [begin, end)中换出的页数
+void   swap_usage(uint32* nslot, uint32* used);          // 交换区的槽位数和被引用的槽位数 (不加锁读取, 仅供参考)
+
+#endif
@@ -41,6 +41,9 @@ typedef uint64* pgtbl_t;
 //高四位值表示 MODE,satp 0到43位存放的是PPN，最后硬件就知道了要开启SV39分页，根页表的地址在satp 0到43对应的位置
 #define SATP_SV39 (8L << 60)  // MODE = SV39
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12)) // 设置MODE和PPN字段
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK  (0xFFFFul << SATP_ASID_SHIFT)
+#define MAKE_SATP_ASID(pagetable, asid) (MAKE_SATP(pagetable) | ((uint64)(asid) << SATP_ASID_SHIFT)) // 同上, 再设置ASID字段 (见mem/asid.h)
 
 // 获取虚拟地址中的虚拟页(VPN)信息 占9bit
 #define VA_SHIFT(level)         (12 + 9 * (level))
@@ -59,6 +62,8 @@ typedef uint64* pgtbl_t;
 #define PTE_G (1L << 5) // global - 全局映射
 #define PTE_A (1L << 6) // accessed - 已访问
 #define PTE_D (1L << 7) // dirty - 已修改
+#define PTE_F (1L << 8) // RSW: 文件映射页 - 物理页属于页缓存, 不随页表复制或释放
+#define PTE_M (1L << 9) // RSW: 大页 - 这是映射2MB的1级叶子PTE (用户大页来自伙伴系统的MEGAPAGE_ORDER阶块)
 
 // 检查一个PTE是否是页表（而非叶子页）：R/W/X全为0表示这是指向下级页表的指针
 #define PTE_CHECK(pte) (((pte) & (PTE_R | PTE_W | PTE_X)) == 0)
@@ -66,38 +71,79 @@ typedef uint64* pgtbl_t;
 // 获取PTE的低10bit标志位信息
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 
+/*
+    大页 (megapage): 1级页表中的叶子PTE直接映射2MB, 虚拟地址和物理地址都按2MB对齐
+    vm_mappages遇到对齐且足够长的范围自动使用大页 (内核的物理内存直接映射就是这样建立的)
+    vm_getpte(alloc = false)落在大页中时返回这个1级PTE (带PTE_M), 物理地址用PTE_VA_TO_PA计算;
+    vm_getpte(alloc = true)落在大页中时先把大页拆成512个4KB的PTE
+*/
+#define MEGAPAGE_SIZE  (1ul << 21)
+#define MEGAPAGE_PAGES (MEGAPAGE_SIZE / PGSIZE)
+#define MEGAPAGE_ORDER 9    // 用户大页在伙伴系统中的阶 (= PMEM_MAX_ORDER)
+
+// 页表项映射的va所在4KB页的物理地址 (4KB叶子PTE或大页PTE)
+#define PTE_VA_TO_PA(pte, va) (PTE_TO_PA(pte) + (((pte) & PTE_M) ? (PG_ROUND_DOWN(va) & (MEGAPAGE_SIZE - 1)) : 0))
+
 // 定义一个相当大的VA, 规定所有VA不得大于它
 #define VA_MAX (1ul << 38)
 
 /*---------------------- in kvm.c -------------------------*/
 void   vm_print(pgtbl_t pgtbl);
 void   vm_print_2(pgtbl_t pgtbl);
+pgtbl_t vm_pgtbl_alloc();
+// 申请一页全0的页表页 (优先从页表页缓存中取, 内存不足返回NULL)
+void   vm_pgtbl_free(pgtbl_t pgtbl);
+// 释放512项都已清零的页表页 (放回页表页缓存)
 pte_t* vm_getpte(pgtbl_t pgtbl, uint64 va, bool alloc);
 //查表，给定一个VA，找到对应的 PTE在哪里，如果中间的页表不存在，则根据alloc参数决定是否创建新页表
 void   vm_mappages(pgtbl_t pgtbl, uint64 va, uint64 pa, uint64 len, int perm);
 // 建立映射，在页表里填好 PTE，让 VA指向 PA
+bool   vm_try_mappages(pgtbl_t pgtbl, uint64 va, uint64 pa, uint64 len, int perm);
+// 同上, 申请不到页表页时返回false (用户地址空间: 内存不足时让系统调用失败而不是panic)
+uint32 vm_map_sparse(pgtbl_t pgtbl, uint64 va, uint64* pa, uint32 n, int perm);
+// 第i页映射到pa[i] (0跳过), 只填写为0的PTE且不申请页表页, 返回映射的页数 (缺页时映射相邻的页)
 void   vm_unmappages(pgtbl_t pgtbl, uint64 va, uint64 len, bool freeit);
+void   vm_unmap_mapped(pgtbl_t pgtbl, uint64 va, uint64 len, bool freeit);
+// 同上, 但跳过没有映射的页 (按需分配的区域中可能只有一部分页已经映射)
+uint64 vm_next_mapped(pgtbl_t pgtbl, uint64 va, uint64 end);
+// [va, end)中第一个已映射的页, 没有返回end (跳过没有页表的范围)
 
 void   kvm_init();
 //内核页表初始化
 void   kvm_inithart();
 //启用，把页表地址写入 satp寄存器，执行sfence.vma指令刷新 TLB快表
+uint64 kvm_kstack_alloc();
+// 在内核栈区域映射一个新的内核栈, 返回它的虚拟地址 (区域用完或内存不足返回0)
+void   kvm_kstack_sync();
+// 别的hart映射了新的内核栈之后, 切换到可能使用它的进程之前刷新本hart的TLB
 
 
 /*------------------------ in uvm.c -----------------------*/
 void   uvm_show_mmaplist(mmap_region_t* mmap);
 
 void   uvm_destroy_pgtbl(pgtbl_t pgtbl);
-void   uvm_copy_pgtbl(pgtbl_t old, pgtbl_t new, uint64 heap_top, uint32 ustack_pages, mmap_region_t* mmap);
-
-void   uvm_mmap(uint64 begin, uint32 npages, int perm);
+bool   uvm_copy_pgtbl(pgtbl_t old, pgtbl_t new, uint64 heap_top, uint32 ustack_pages, mmap_region_t* mmap); // 内存不足返回false (由调用者销毁new)
+bool   uvm_cow_fault(pgtbl_t pgtbl, uint64 va);       // 写时复制页的写缺页处理 (不是写时复制页返回false)
+uint64 uvm_resident_pages(pgtbl_t pgtbl, uint64 begin, uint64 end); // [begin, end)中已映射的页数
+bool   uvm_kernel_overlap(pgtbl_t pgtbl, uint64 begin, uint32 npages); // 范围中是否有没有PTE_U的页 (线程的trapframe)
+uint64 uvm_pgtbl_pages(pgtbl_t pgtbl);                // 页表占用的页数
+
+bool   uvm_mmap(uint64 begin, uint32 npages, int perm, bool populate); // 匿名映射 (populate = false时页在第一次访问时分配)
+bool   uvm_mmap_fault(pgtbl_t pgtbl, uint64 va, bool write); // 匿名映射区域的缺页处理 (读访问映射全0页; 不属于匿名映射或已映射返回false)
 void   uvm_munmap(uint64 begin, uint32 npages);
-
-uint64 uvm_heap_grow(pgtbl_t pgtbl, uint64 heap_top, uint32 len);
+uint64 uvm_mmap_find(uint32 npages);                  // 第一个能容纳npages页的空闲区域起点 (没有返回0)
+uint64 uvm_mmap_find_aligned(uint32 npages, uint64 align); // 同上, 起点按align对齐
+bool   uvm_mmap_reserve(uint64 begin, uint32 npages); // 从空闲区域树中取出区域 (不建立映射)
+void   uvm_mmap_release(uint64 begin, uint32 npages); // 把区域归还空闲区域树并合并 (不解除映射)
+
+uint64 uvm_heap_grow(pgtbl_t pgtbl, uint64 heap_top, uint32 len);     // 只扩展地址范围, 页在第一次访问时分配
+bool   uvm_heap_fault(pgtbl_t pgtbl, uint64 heap_top, uint64 va, bool write); // 堆的缺页处理 (读访问映射全0页; 不在堆中或已映射返回false)
+bool   uvm_stack_fault(pgtbl_t pgtbl, uint64* ustack_pages, uint64 va, bool write); // 用户栈的缺页处理, 栈的范围扩展到va (不在栈区域中或已映射返回false)
 uint64 uvm_heap_ungrow(pgtbl_t pgtbl, uint64 heap_top, uint32 len);
 
 void   uvm_copyin(pgtbl_t pgtbl, uint64 dst, uint64 src, uint32 len);
 void   uvm_copyout(pgtbl_t pgtbl, uint64 dst, uint64 src, uint32 len);
 void   uvm_copyin_str(pgtbl_t pgtbl, uint64 dst, uint64 src, uint32 maxlen);
+uint64 uvm_user_pa(pgtbl_t pgtbl, uint64 va, bool write); // 用户地址的物理地址 (先做缺页处理), 地址无效返回0
 
 #endif
\ No newline at end of file
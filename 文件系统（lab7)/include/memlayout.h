@@ -5,6 +5,10 @@
 // 内核基地址
 #define KERNEL_BASE 0x80000000ul
 
+// qemu virt的sifive_test设备: 写入VIRT_TEST_POWEROFF时qemu退出 (关机)
+#define VIRT_TEST          0x100000ul
+#define VIRT_TEST_POWEROFF 0x5555
+
 // UART 相关
 #define UART_BASE  0x10000000ul
 #define UART_IRQ   10
@@ -28,8 +32,9 @@
 #define CLINT_MTIMECMP(hartid) (CLINT_BASE + 0x4000 + 8 * (hartid))
 #define CLINT_MTIME (CLINT_BASE + 0xBFF8)
 
-// 物理内存结束地址 (128MB)
-#define PHYSTOP (KERNEL_BASE + 128*1024*1024)
+// 物理内存结束地址: 启动时从设备树的/memory节点得到 (phys_top, 见mem/pmem.h), 没有时使用kernel.ld中的ALLOC_END (128MB)
+// 内核页表直接映射[KERNEL_BASE, phys_top), 更大的内存只使用前PHYSTOP_MAX - KERNEL_BASE字节
+#define PHYSTOP_MAX (KERNEL_BASE + 64ul*1024*1024*1024)
 
 // 用户态虚拟地址空间布局
 // 最大虚拟地址 (SV39: 2^38)
@@ -42,9 +47,25 @@
 // trapframe页：紧邻跳板页下方
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
 
-// 内核栈：每个CPU一个，从 TRAMPOLINE 往下分配
-// 每个栈由一个guard页和一个栈页组成
-#define KSTACK(cpu) (TRAMPOLINE - ((cpu) + 1) * 2 * PGSIZE)
+// 用户栈：[USTACK_BOTTOM, TRAPFRAME)整个保留给主线程的栈, exec只映射最高的一页,
+// 更低的页在第一次访问时映射 (见uvm_stack_fault), 栈的范围 (mm->ustack_pages) 随之扩展;
+// 栈区域下方的USTACK_GUARD页永远不映射, 栈溢出在这里缺页失败, 不会写进用户数据页和mmap区域
+#define USTACK_MAX    256   // 用户栈最多的页数 (1MB)
+#define USTACK_GUARD  16    // 栈区域下方的保护页数
+#define USTACK_BOTTOM (TRAPFRAME - USTACK_MAX * PGSIZE)
+
+// 用户数据页：用户态只读, 内核维护的时间和进程信息 (见proc/vdata.h)
+// 位于mmap区域和用户栈的保护页之间 (与跳板页在同一张0级页表中)
+#define VDATA (MMAP_END)
+
+// 内核栈区域：从 TRAMPOLINE 往下保留 KSTACK_MAX 个内核栈的虚拟地址 (只在内核页表中)
+// 每个栈由一个guard页和一个栈页组成, 申请进程描述符时按需映射 (见kvm_kstack_alloc)
+#define KSTACK_MAX  1024
+#define KSTACK(i)   (TRAMPOLINE - ((i) + 1) * 2 * PGSIZE)
+
+// mmap区域：位于用户数据页下方, 新进程的空闲mmap区域初始为整个区域
+#define MMAP_END   (USTACK_BOTTOM - USTACK_GUARD * PGSIZE - PGSIZE)
+#define MMAP_BEGIN (MMAP_END - 8096 * PGSIZE)
 
 #endif
 
@@ -55,5 +76,8 @@ PLIC负责管理外部设备中断（如UART键盘输入），负责中断优先
 */
 
 // virtio 相关
+// qemu virt有VIRTIO_NSLOT个virtio-mmio槽位, 第i个在VIRTIO_BASE + i * VIRTIO_STRIDE, 中断号VIRTIO_IRQ + i
 #define VIRTIO_BASE 0x10001000ul
 #define VIRTIO_IRQ 1
+#define VIRTIO_NSLOT 8
+#define VIRTIO_STRIDE 0x1000ul
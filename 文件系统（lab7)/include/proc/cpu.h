@@ -4,15 +4,37 @@
 #include "common.h"
 #include "proc/proc.h"
 
+// hart的CPU时间统计 (mtime单位, 只由自己的hart累加): 空闲时间 = 启动以来的mtime - user - system
+typedef struct hart_stat {
+    uint64 user;         // 进程的用户态时间
+    uint64 system;       // 进程的内核态时间 (包括内核线程)
+    uint64 wait;         // 在这个hart上开始运行的进程之前在运行队列中等待的时间
+    uint64 switches;     // 切换到进程的次数
+} hart_stat_t;
+
 typedef struct cpu {
     int noff;       // 关中断的深度
     int origin;     // 第一次关中断前的状态
     proc_t* proc;   // cpu上运行的进程
+    proc_t* prev;   // 直接切换时让出cpu的进程: 它的锁由切换到的进程放开 (见proc_sched)
+    volatile bool need_resched;  // 运行队列中来了优先级更高的进程: 在下一个抢占点让出cpu (见proc_resched)
+    uint32 softirq_pending; // 待处理的软中断 (第i位: SOFTIRQ_i, 见trap/softirq.h)
+    bool in_softirq;        // 正在执行软中断的下半部
     context_t ctx;  // 内核上下文暂存
+    hart_stat_t st; // CPU时间统计 (见proc_acct_enter)
 } cpu_t;
 
+/*
+    启动时hart 0从设备树得到hart数ncpu (cpu_discover, 见dev/fdt.h), 在其他hart离开等待之前完成:
+        hartid不小于ncpu的hart (设备树之外的, 或超出NCPU的) 停在启动代码中, 不进入调度器
+        设备树无效时只使用hart 0
+    每个hart一份的数组按上限NCPU静态分配, 调度、亲和性掩码和工作线程数只使用前ncpu个
+*/
+
+void    cpu_discover(uint64 dtb);   // 从设备树设置ncpu (hart 0在pmem_init之前调用)
 int     mycpuid(void);
 cpu_t*  mycpu(void);
+cpu_t*  cpu_of(int id);            // 第id个hart的cpu_t
 proc_t* myproc(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,86 @@
+#ifndef __EXEC_H__
+#define __EXEC_H__
+
+#include "common.h"
+
+/*
+    exec: 从文件系统中的ELF可执行文件建立新的用户地址空间
+    只解析ELF头和程序头, 不预先读入任何段: 每个PT_LOAD段记录在进程的exec_image_t中,
+    段内的页在第一次访问时由exec_fault映射:
+        只读段中完全由文件内容组成的页: 直接映射页缓存中的页 (PTE_F, 运行同一程序的进程共享),
+            同一窗口中已缓存的相邻页一起映射 (mmap_fault_around, 第一次缺页时批量读入窗口)
+        可写段的页和含有bss的页: 分配私有页, 复制文件中对应的部分, 其余为0
+    新地址空间布局: 段 (从PGSIZE开始) -> 堆 (image.end开始) ...... mmap区域 -> 用户数据页 -> 保护页
+        -> 用户栈 (保留USTACK_MAX页, 只映射最高的1页, 其余按需映射) -> trapframe -> trampoline
+    用户栈: 参数字符串在栈顶, 其下是以NULL结尾的argv数组; main(argc, argv)通过a0 / a1取得
+*/
+
+#define ELF_MAGIC     0x464C457FU  // "\x7FELF" (小端)
+#define ELF_PROG_LOAD 1            // 程序头类型: 需要加载的段
+
+// 程序头的flags
+#define ELF_PROG_FLAG_EXEC  0x1
+#define ELF_PROG_FLAG_WRITE 0x2
+#define ELF_PROG_FLAG_READ  0x4
+
+#define EXEC_SEG_MAX 4    // 可执行文件最多的PT_LOAD段数
+#define EXEC_MAXARG  16   // argv最多的参数个数
+#define EXEC_ARG_LEN 128  // 每个参数的最大长度 (包括'\0')
+
+// ELF文件头
+typedef struct elf_header {
+    uint32 magic;       // ELF_MAGIC
+    uint8  elf[12];
+    uint16 type;
+    uint16 machine;
+    uint32 version;
+    uint64 entry;       // 入口地址
+    uint64 phoff;       // 程序头表的文件偏移
+    uint64 shoff;
+    uint32 flags;
+    uint16 ehsize;
+    uint16 phentsize;
+    uint16 phnum;       // 程序头个数
+    uint16 shentsize;
+    uint16 shnum;
+    uint16 shstrndx;
+} elf_header_t;
+
+// ELF程序头
+typedef struct prog_header {
+    uint32 type;        // ELF_PROG_LOAD ...
+    uint32 flags;       // ELF_PROG_FLAG_*
+    uint64 off;         // 段在文件中的偏移
+    uint64 vaddr;       // 段的虚拟地址
+    uint64 paddr;
+    uint64 filesz;      // 文件中的字节数
+    uint64 memsz;       // 内存中的字节数 (>= filesz, 之后是bss)
+    uint64 align;
+} prog_header_t;
+
+// 一个PT_LOAD段: [va, va + memsz), 其中[va, va + filesz)来自文件的[off, off + filesz)
+typedef struct exec_seg {
+    uint64 va;
+    uint64 memsz;
+    uint64 off;         // off % PGSIZE == va % PGSIZE
+    uint64 filesz;
+    int perm;           // 页表项权限 (PTE_U | PTE_R / PTE_W / PTE_X)
+} exec_seg_t;
+
+// 进程的程序映像
+typedef struct exec_image {
+    struct inode* ip;   // 可执行文件 (持有一个引用, NULL表示没有: 第一个进程)
+    uint32 nseg;        // 段数
+    exec_seg_t seg[EXEC_SEG_MAX];
+    uint64 end;         // 最后一个段的末尾 (页对齐), 堆的下限
+} exec_image_t;
+
+struct proc;
+
+int  proc_exec(char* path, uint64 uargv);              // 执行新程序, 成功返回argc 失败返回-1 (原地址空间不变)
+int  proc_spawn(char* path, uint64 uargv);             // 创建执行新程序的子进程 (不复制地址空间), 成功返回pid 失败返回-1
+bool exec_fault(uint64 va, bool write);                // 程序映像的缺页处理, 不属于映像或已映射返回false
+void exec_fork(struct proc* p, struct proc* np);       // 子进程继承程序映像 (页面在子进程缺页时重新映射)
+void exec_release(struct proc* p);                     // 解除映像中页缓存页的映射, 释放可执行文件的引用
+
+#endif
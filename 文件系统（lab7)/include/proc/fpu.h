@@ -0,0 +1,32 @@
+#ifndef __FPU_H__
+#define __FPU_H__
+
+#include "common.h"
+
+/*
+    浮点状态的惰性切换 (F/D扩展)
+    context_t和trapframe_t只保存整数寄存器: 浮点寄存器保存在进程的fpstate_t中, 只在需要时切换
+    进程切换到某个hart上运行时sstatus.FS总是Off, 用户执行第一条浮点指令时产生非法指令异常,
+    fpu_trap把进程的状态装入寄存器并置FS = Clean, 然后重新执行这条指令 (硬件在写浮点寄存器后置Dirty)
+    进程离开hart时 (proc_sched) 只有FS = Dirty才保存, 然后置FS = Off
+    所以不使用浮点的进程切换时没有额外开销; 新进程和exec之后的状态全为0 (也不会读到其他进程留下的值)
+    内核自身不使用浮点寄存器 (内核中FS = Off时执行浮点指令会陷入内核异常)
+*/
+
+typedef struct fpstate {
+    uint64 f[32];     // f0 ~ f31 (按64位保存, 单精度值在低32位)
+    uint64 fcsr;      // 舍入模式和异常标志
+} fpstate_t;
+
+typedef struct proc proc_t;
+
+void fpu_save(fpstate_t* st);       // 寄存器 -> st (fpu.S, 调用者保证FS不是Off)
+void fpu_restore(fpstate_t* st);    // st -> 寄存器 (fpu.S, 调用者保证FS不是Off)
+
+void fpu_inithart();                        // 本hart的FS置为Off
+bool fpu_trap(proc_t* p, uint64 sstatus);   // 用户态非法指令异常: FS为Off时装入p的状态并返回true
+void fpu_switch_out(proc_t* p);             // p离开hart: Dirty时保存, 之后FS = Off
+void fpu_copy(proc_t* p, proc_t* np);       // fork / clone: 子进程继承当前的浮点状态
+void fpu_reset(proc_t* p);                  // exec: 状态清零, 下一次使用时重新装入
+
+#endif
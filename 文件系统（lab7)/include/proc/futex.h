@@ -0,0 +1,28 @@
+#ifndef __FUTEX_H__
+#define __FUTEX_H__
+
+#include "common.h"
+
+/*
+    futex: 用户态锁的睡眠与唤醒, 锁本身是用户内存中的一个32位字
+        没有竞争时用户态只做原子操作, 不进入内核; 有竞争时:
+        FUTEX_WAIT: 字的值仍等于val时睡眠, 直到被FUTEX_WAKE唤醒或超时 (timeout微秒, 0表示不超时)
+        FUTEX_WAKE: 唤醒最多val个等在这个字上的进程
+    等待者以字的物理地址为键, 散列到N_FUTEX_Q个等待队列之一 (通过p->futex_next串起来):
+        同一个地址空间的线程、以及映射了同一共享内存对象的进程都能互相唤醒
+        查找物理地址时按写访问做缺页处理: 写时复制的页先复制, 等待者和唤醒者看到的是之后真正被写的那一页
+    比较字的值和进入队列都在队列的锁下, 唤醒者也在锁下摘下等待者: 写字之后调用FUTEX_WAKE不会丢失唤醒
+    等待期间页可能被解除映射并重新使用: 之后在同一物理地址上的唤醒是虚假唤醒, 调用者总是重新检查字的值
+    超时由时间轮中的定时器唤醒 (见proc_sleep_until, 不受tick周期限制), 等待者自己离开队列
+*/
+
+#define FUTEX_WAIT  0
+#define FUTEX_WAKE  1
+
+#define N_FUTEX_Q   64    // 等待队列数
+
+void futex_init();
+int  futex_wait(uint64 uaddr, uint32 val, uint32 timeout); // 被唤醒返回0 超时返回1, 值不等或地址无效返回-1
+int  futex_wake(uint64 uaddr, uint32 n);                   // 返回唤醒的进程数, 地址无效返回-1
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __KWORK_H__
+#define __KWORK_H__
+
+#include "common.h"
+
+/*
+    后台工作线程池: KWORK_THREADS个内核线程 (见kthread_create) 共享一个先进先出的工作队列
+    工作项由提交者提供 (静态变量, 或嵌在自己申请的请求结构中), 在工作线程中以进程上下文执行:
+        开中断、不持有锁, 可以睡眠等待磁盘和睡眠锁, 但没有用户地址空间
+    工作项出队之后(执行之前) pending被清除, 执行期间可以被再次提交
+    工作线程的基础优先级是最低一级: 后台工作只使用前台进程剩下的CPU时间
+    内置的工作: 定时写回 (日志提交、页缓存、buf cache, 每KWORK_FLUSH_TICKS个tick一次)
+               和空闲页清零 (调度器没有可运行的进程时提交)
+*/
+
+#define KWORK_THREADS      ncpu   // 工作线程数: 每个hart一个
+#define KWORK_FLUSH_TICKS  10     // 定时写回的周期 (tick, 各模块自己的间隔和高水位在各自的flusher中判断)
+#define KWORK_ZERO_ROUNDS  8      // 清零工作每次最多清零的批数 (之后由下一次空闲再提交)
+
+typedef struct kwork {
+    void (*fn)(void* arg);    // 在工作线程中执行
+    void* arg;
+    struct kwork* next;       // 工作队列中的下一项
+    volatile bool pending;    // 已在队列中
+} kwork_t;
+
+void kwork_init();                 // 创建工作线程 (proc_init之后)
+bool kwork_queue(kwork_t* w);      // 提交工作项 (已在队列中返回false), 可以在中断处理中调用, 调用者不能持有进程锁
+void kwork_tick(uint64 ticks);     // 时钟中断 (推进了ticks的hart): 提交定时的工作
+uint64 kwork_next_tick();          // 下一次定时工作的tick (tickless的空闲hart 0在这时醒来)
+bool kwork_idle();                 // 调度器没有可运行的进程时调用: 有空闲页需要清零时提交清零工作并返回true
+
+#endif
@@ -3,13 +3,64 @@
 
 #include "common.h"
 #include "mem/mmap.h"
+#include "mem/shm.h"
 #include "lib/lock.h"
 #include "fs/file.h"
 #include "fs/inode.h"
-// 最大进程数
-#define NPROC 64
+#include "fs/uring.h"
+#include "proc/exec.h"
+#include "proc/fpu.h"
+#include "dev/timer.h"
+#include "syscall/sysnum.h"
+// 进程数没有固定的表: 描述符从slab申请, 内核栈按需映射, 上限是内核栈区域的大小 (memlayout.h的KSTACK_MAX)
+#define SCHED_HOT_TICKS 2    // 离开CPU不到这么多tick的进程在缓存中还是热的, 尽量不迁移到别的hart
 
-#define FILE_PER_PROC 16
+/*
+    多级反馈队列调度: 优先级0最高, 每个hart的运行队列中每个优先级一个先进先出队列
+    SCHED_SLICE(l): l级的时间片(tick), 用完时降一级; 在时间片用完之前睡眠的进程保持原来的级别
+    时钟中断时自己的队列中有更高优先级的进程就抢占当前进程
+    每SCHED_BOOST_TICKS个tick所有进程回到基础优先级 (防止低优先级的进程饿死)
+    基础优先级由sys_setpriority设置 (fork和spawn的子进程继承), 进程不会高于自己的基础优先级
+*/
+#define SCHED_LEVELS        4
+#define SCHED_SLICE(l)      (1u << (l))
+#define SCHED_BOOST_TICKS   64
+#define SCHED_PRIO_DEFAULT  1    // 新进程的基础优先级 (请求处理进程可以设为0, 批处理任务设为更低)
+#define SCHED_ALL_CPUS      ((1u << ncpu) - 1)  // 亲和性掩码: 所有hart (启动时发现的)
+
+/*
+    期限调度类 (sys_sched_setdeadline): 每个周期period内得到runtime的CPU时间, 在deadline (相对周期开始) 之前
+    期限进程先于所有普通 (MLFQ) 进程运行, 期限进程之间按绝对期限排序 (EDF), 时间按mtime计算, 不按tick
+        准入控制: 每个hart上期限进程的带宽 (runtime / period) 之和不超过SCHED_DL_BW_MAX,
+            进入期限类时选择亲和性掩码中剩余带宽最多的hart, 之后固定在那个hart上 (不被窃取, 不能修改亲和性)
+        运行时间用完时停止运行 (RUNNABLE但不在运行队列中), 下一个周期开始时由定时器补充运行时间并重新入队
+            在用户态用完时由定时器的回调要求让出 (不必等到下一个tick), 在内核中由下一个tick或抢占点发现
+        睡眠后醒来时剩余的运行时间在原来的期限之前按带宽用不完 (或期限已过) 就开始新的周期 (CBS的规则)
+    只有进程自己可以进入或离开期限类; fork的子进程是普通进程
+*/
+#define SCHED_DL_BW_SHIFT    20
+#define SCHED_DL_BW_MAX      ((90u << SCHED_DL_BW_SHIFT) / 100)        // 每个hart期限进程的带宽上限 (90%)
+#define SCHED_DL_RUNTIME_MIN (100ull * TIMER_MTIME_PER_US)             // 运行时间的下限 (100us)
+#define SCHED_DL_PERIOD_MAX  (10ull * 1000000 * TIMER_MTIME_PER_US)    // 周期的上限 (10s)
+#define SCHED_IS_DL(p)       ((p)->dl_runtime != 0)
+
+/*
+    CPU时间记账 (mtime单位): 进程从用户态陷入时计入用户态时间, 返回用户态和离开CPU时计入内核态时间,
+    开始运行时计入在运行队列中等待的时间 (从变为RUNNABLE开始); 同时累加到所在hart的hart_stat_t
+    离开CPU时睡眠的算主动切换, 仍可运行的 (时间片用完, 被抢占, 让出) 算被动切换
+    负载均值: 每LOAD_FREQ采样一次可运行的进程数 (运行队列中的和正在运行的), 按1/5/15分钟做指数平均
+        定点数 (FSHIFT位小数), 系数与Linux相同: e^(-5s/1min), e^(-5s/5min), e^(-5s/15min)
+*/
+#define FSHIFT      11
+#define FIXED_1     (1ul << FSHIFT)
+#define LOAD_FREQ   (5ull * 1000000 * TIMER_MTIME_PER_US)  // 采样间隔 (5s)
+#define EXP_1       1884
+#define EXP_5       2014
+#define EXP_15      2037
+
+#define FILE_PER_PROC 16                          // 进程内嵌的文件描述符表大小
+#define FILE_MAX_PROC (PGSIZE / sizeof(file_t*))  // 文件描述符表扩展为一整页后的上限 (512)
+#define FILE_HOLD_MAX 4                           // 一个系统调用最多同时使用的fd数 (见proc_fd_get)
 // 页表类型定义
 typedef uint64* pgtbl_t;
 
@@ -77,6 +128,59 @@ typedef struct trapframe {
     /* 280 */ uint64 t6;
 } trapframe_t;
 
+// 进程自己的系统调用统计 (sys_sysstat拷贝给用户时展开成sysstat_t)
+typedef struct sys_count {
+    uint32 calls;
+    uint32 errors;
+    uint64 time;
+} sys_count_t;
+
+// 进程的内存统计 (sys_memstat拷贝给用户)
+// 驻留页数和页表页数在查询时遍历页表得到, 其余是进程一直累加的计数
+typedef struct mem_stat {
+    uint64 rss_heap;      // 程序映像和堆中已映射的页数 [PGSIZE, heap_top)
+    uint64 rss_stack;     // 用户栈中已映射的页数
+    uint64 rss_mmap;      // mmap区域中已映射的页数 (匿名映射、文件映射、共享内存、uring)
+    uint64 pgtbl_pages;   // 页表占用的页数 (包括顶级页表)
+    uint64 minor_faults;  // 不需要读盘的缺页 (全0页、写时复制、已在页缓存中的文件页)
+    uint64 major_faults;  // 需要从磁盘读入文件页的缺页
+    uint64 cow_copies;    // 写时复制缺页中复制的页数
+    uint64 fork_shared;   // fork时与子进程共享的页数 (写时复制和共享内存)
+    uint64 fork_copied;   // fork时立即复制的页数 (PMEM_F_PINNED)
+    uint64 rss_swap;      // 已换出到交换区的页数
+    uint64 swap_outs;     // 换出的页数
+    uint64 swap_ins;      // 换入的页数 (同时计入major_faults)
+    uint64 fault_around;  // 缺页时顺带映射的文件页数 (这些页之后的访问不再缺页)
+} mem_stat_t;
+
+// 进程I/O统计 (与用户态iostat_t一致), 由当前进程在自己的上下文中累加 (PROC_IO_ADD)
+// 后台写回和预读线程提交的磁盘请求计入这些内核线程
+typedef struct io_stat {
+    uint64 rchar;         // 读到的字节数 (read / pread / readv, 包括管道、设备和统计文件)
+    uint64 wchar;         // 写出的字节数 (write / pwrite / writev)
+    uint64 buf_hits;      // buf_read时数据已在buf cache中
+    uint64 buf_misses;    // buf_read时需要读盘
+    uint64 disk_reqs;     // 提交的磁盘读写请求数 (一个请求可以包含多个block)
+    uint64 read_blocks;   // 从磁盘读入的block数
+    uint64 write_blocks;  // 写入磁盘的block数
+} io_stat_t;
+
+// 进程的CPU时间统计 (与用户态cpustat_t一致, mtime单位), 只由进程自己在自己的hart上累加
+// 被回收的子进程 (和它们回收过的子进程) 的时间在父进程的wait中加到c*字段
+typedef struct cpu_stat {
+    uint64 utime;         // 用户态时间
+    uint64 stime;         // 内核态时间 (系统调用, 陷阱和中断处理, 内核线程)
+    uint64 wait_time;     // 可以运行但在运行队列中等待的时间
+    uint64 nvcsw;         // 主动切换 (睡眠) 次数
+    uint64 nivcsw;        // 被动切换 (时间片用完, 被抢占, 让出) 次数
+    uint64 cutime;        // 已回收的子进程的用户态时间
+    uint64 cstime;        // 已回收的子进程的内核态时间
+} cpu_stat_t;
+
+// 给当前进程的I/O统计加n (没有当前进程时不计, 调用者包含proc/cpu.h)
+#define PROC_IO_ADD(field, n) \
+    do { proc_t* __p = myproc(); if (__p != NULL) __p->io.field += (n); } while (0)
+
 /* 
     进程状态集合
     可能的进程状态变换：
@@ -97,6 +201,64 @@ enum proc_state {
     ZOMBIE,       // 濒临死亡
 };
 
+/*
+    线程 (sys_clone): 与创建者共享地址空间(mm_t)和文件描述符表(fdtable_t)的进程,
+    有自己的pid、内核栈、trapframe、用户栈(由调用者提供)、当前目录和提交/完成队列, 与进程一样被调度
+    线程的父进程是创建它的进程, wait可以回收线程 (相当于join)
+    trapframe: 普通进程映射在TRAPFRAME; 线程的trapframe在共享的mmap区域中另占一页 (没有PTE_U, tf_va)
+    地址空间由最后一个退出的成员拆除 (写回文件映射、放弃程序映像和共享内存, 销毁页表)
+    共享时的修改在mm->lk下进行: 改变布局的系统调用 (见syscall.c)、用户态缺页、内核访问用户内存时的缺页
+        持有inode锁的系统调用在缺页时等待mm->lk, 而另一个线程持有mm->lk在文件映射的缺页中等待同一个inode锁时会死锁:
+        不要在一个线程读写文件的同时让另一个线程访问这个文件的映射中还没有映射的页
+    页表修改后其他hart上的旧表项: 正在用户态运行同一地址空间的hart发送处理器间中断并等待它们进入内核 (见mem/asid.h)
+    共享的地址空间不换出 (换出假设地址空间只在一个hart上运行); 有多个线程时exec失败
+*/
+typedef struct mm {
+    int ref;                 // 共享这个地址空间的(没有退出的)进程数, 原子地修改
+    sleeplock_t lk;          // 共享时保护下面的字段和页表的修改 (只有一个成员时不加锁)
+    pgtbl_t pgtbl;           // 用户态页表
+    uint32 asid;             // 地址空间标识 (0: 还没有分配, 见mem/asid.h)
+    uint32 asid_gen;         // asid所属的代
+    uint32 asid_stale;       // 可能缓存了旧映射的hart (位图, 在这些hart上返回用户态之前先刷新asid)
+    volatile uint32 asid_active; // 正在用户态运行这个地址空间的hart (位图, 修改页表时向它们发送处理器间中断)
+    uint64 heap_top;         // 用户堆顶(以字节为单位)
+    uint64 ustack_pages;     // 用户栈的范围 [TRAPFRAME - ustack_pages * PGSIZE, TRAPFRAME) 的页数 (其中的页不一定都已映射)
+    mmap_region_t* mmap;     // 用户可映射区域的起始节点
+    mmap_file_t fmap[N_MMAP_FILE]; // 文件映射
+    exec_image_t image;      // 程序映像 (exec加载的段, 页面按需映射)
+    shm_attach_t shm[N_SHM_ATTACH]; // 共享内存对象的映射
+    uint64 swap_hand;        // 换出时钟算法的指针 (见mem/swap.h)
+    struct mm* reap_next;    // 等待后台销毁的链表 (见proc_wait)
+} mm_t;
+
+// 文件描述符表 (线程之间共享)
+typedef struct fdtable {
+    int ref;                          // 共享这个表的(没有退出的)进程数, 原子地修改
+    spinlock_t lk;                    // 保护表项和容量
+    file_t* fd_small[FILE_PER_PROC];  // 内嵌的文件描述符表
+    file_t** filelist;                // 文件描述符表 (fd_small, 或用完后扩展出的一页)
+    uint32 nfile;                     // filelist的容量
+} fdtable_t;
+
+// 进程的状态快照 (/proc/<pid>/stat, 见fs/procfs.h)
+typedef struct proc_info {
+    int pid;
+    int ppid;                // 父进程 (没有父进程为0)
+    int state;               // enum proc_state
+    bool kthread;            // 内核线程?
+    int prio;
+    int base_prio;
+    int cpu;                 // 上一次运行(或将要运行)的hart
+    uint32 cpu_mask;
+    uint64 last_ran;         // 上一次离开CPU时的tick
+    uint64 syscalls;         // 系统调用次数 (各系统调用号之和)
+    uint64 sys_errors;
+    uint64 sys_time;         // 系统调用的总耗时 (mtime单位)
+    mem_stat_t mstat;        // 内存统计的计数器部分 (rss_*和pgtbl_pages为0)
+    io_stat_t io;
+    cpu_stat_t cstat;
+} proc_info_t;
+
 // 进程定义
 typedef struct proc {
     
@@ -107,33 +269,113 @@ typedef struct proc {
     int pid;                 // 标识符
     enum proc_state state;   // 进程状态
     struct proc* parent;     // 父进程
+    struct proc* children;   // 子进程链表 (下面五个字段由proc.c的lk_tree保护)
+    struct proc* sib_prev;   // 父进程子进程链表中的前一个和后一个
+    struct proc* sib_next;
+    struct proc* zombie_head;// 已退出、等待回收的子进程 (先进先出, 通过zombie_next串起来)
+    struct proc* zombie_tail;
+    struct proc* zombie_next;
     int exit_state;          // 进程退出时的状态(父进程可能关心)
     void* sleep_space;       // 睡眠是为在等待什么
+    struct proc* wq_next;    // 等待队列中的下一个进程 (SLEEPING的进程在sleep_space对应的等待队列中)
+    ktimer_t timer;          // 定时睡眠的定时器 (见proc_sleep_until)
+    void* timer_space;       // 定时器到期时唤醒的睡眠空间
+    bool timer_fired;        // 定时器已经到期 (p->lk保护, 还没有睡下时proc_sleep不再睡眠)
+    uint64 futex_key;        // 等待的futex字的物理地址 (0: 不在futex等待队列中, futex_next也由futex队列的锁保护)
+    struct proc* futex_next; // futex等待队列中的下一个进程
+    struct proc* slq_next;   // 睡眠锁等待队列中的下一个进程 (以下三个字段由睡眠锁的lk保护)
+    bool slq_shared;         // 等待共享持有
+    bool slq_waiting;        // 在睡眠锁的等待队列中 (释放者摘下时清除)
+    struct proc* pid_next;   // pid散列表中的下一个进程
+    struct proc* free_next;  // 空闲链表中的下一个槽位 (UNUSED时)
+    struct proc* rq_next;    // 运行队列中的下一个进程 (RUNNABLE的进程正好在一个运行队列中)
+    int rq_cpu;              // 上一次运行(或将要运行)的hart, 变为RUNNABLE时进入它的运行队列
+    uint64 last_ran;         // 上一次离开CPU时的tick (工作窃取的缓存亲和性判断)
+    int prio;                // 当前优先级 (0最高)
+    int base_prio;           // 基础优先级 (sys_setpriority)
+    int pi_count;            // 持有的、等待者提升过自己优先级的睡眠锁数 (优先级继承, 以下两个字段由p->lk保护)
+    int pi_saved;            // pi_count > 0时: 释放最后一个这样的锁后回到的优先级
+    uint32 slice_used;       // 在当前优先级上已经用掉的tick
+    uint64 boost_epoch;      // 上一次回到基础优先级的周期
+    uint32 cpu_mask;         // 亲和性: 可以运行的hart的位图 (sys_sched_setaffinity, fork和spawn的子进程继承)
+    uint64 dl_runtime;       // 期限调度 (0: 普通进程): 每个周期的运行时间 (mtime单位, 以下三个只由进程自己修改)
+    uint64 dl_deadline;      // 相对期限
+    uint64 dl_period;        // 周期
+    uint64 dl_bw;            // 占用的带宽 (runtime / period, 见SCHED_DL_BW_SHIFT)
+    uint64 dl_abs;           // 当前周期的绝对期限 (mtime)
+    uint64 dl_remain;        // 当前周期剩余的运行时间 (离开CPU时扣除)
+    uint64 dl_start;         // 这一次开始运行的mtime
+    bool dl_throttled;       // 运行时间用完, 等待下一个周期 (RUNNABLE但不在运行队列中)
+    ktimer_t dl_budget;      // 运行时间用完的定时器 (返回用户态之前设置)
+    ktimer_t dl_repl;        // 下一个周期开始时补充运行时间的定时器 (停止运行时设置)
+    void (*kfn)(void*);      // 内核线程执行的函数 (NULL: 用户进程, 见kthread_create)
+    void* karg;
 
-    pgtbl_t pgtbl;           // 用户态页表，进程独有的内存空间
-    uint64 heap_top;         // 用户堆顶(以字节为单位)
-    uint64 ustack_pages;     // 用户栈占用的页面数量
-    mmap_region_t* mmap;     // 用户可映射区域的起始节点
+    mm_t* mm;                // 用户地址空间 (线程之间共享, 内核线程和退出后为NULL)
+    mem_stat_t mstat;        // 内存统计 (只由进程自己修改)
+    io_stat_t io;            // I/O统计 (只由进程自己修改)
+    cpu_stat_t cstat;        // CPU时间统计 (只由进程自己修改)
+    uint64 acct_stamp;       // 上一次记账的mtime (陷入, 返回用户态, 开始运行)
+    uint64 ready_stamp;      // 上一次变为RUNNABLE的mtime
     trapframe_t* tf;         // 用户态内核态切换时的运行环境暂存空间，记录用户程序运行到哪里了
+    uint64 tf_va;            // tf在用户页表中的虚拟地址 (TRAPFRAME, 线程在mmap区域中)
+    fpstate_t fp;            // 浮点寄存器 (惰性切换, 不在hart的寄存器中时有效, 见proc/fpu.h)
 
     uint64 kstack;           // 内核栈的虚拟地址，记录内核态代码运行到哪里了
     context_t ctx;           // 内核态进程上下文，内核处理这个进程时用的栈
 
-    file_t* filelist[FILE_PER_PROC];  // 文件描述符表
+    fdtable_t* fdt;                    // 文件描述符表 (线程之间共享, 内核线程和退出后为NULL)
+    file_t* fd_hold[FILE_HOLD_MAX];    // 共享的表中取出的文件在系统调用期间持有的引用 (见proc_fd_get)
+    uint32 nhold;
     inode_t* cwd;                      // 当前工作目录
+    uring_t uring;                     // 提交/完成队列 (未创建时ctl = NULL)
+    uint32 journal_depth;              // 嵌套的日志操作层数 (journal_begin / journal_end)
+    sys_count_t sc[SYS_MAX + 1];       // 每个系统调用号的统计 (只由进程自己修改, 见syscall/syscall.h)
+    bool sysrec;                       // 录制系统调用 (见syscall/sysrec.h, fork/spawn/clone的子进程继承)
 } proc_t;
 
 
 void     proc_init();                                  // 进程模块初始化
 void     proc_make_first();                            // 创建第一个进程并切换到它执行
 pgtbl_t  proc_pgtbl_init(uint64 trapframe);            // 进程页表的初始化和基本映射
+void     proc_tf_init(proc_t* p);                      // 设置陷阱帧中不变的内核字段 (创建进程时, 之后返回用户态不再重写)
 proc_t*  proc_alloc();                                 // 进程申请
+int      kthread_create(void (*fn)(void*), void* arg, int prio); // 创建内核线程 (没有用户地址空间, fn不返回), 返回pid 失败返回-1
+void     proc_set_parent(proc_t* np, proc_t* p);       // 新进程np成为p的子进程 (np还没有运行)
 void     proc_free(proc_t* p);                         // 进程释放
 int      proc_fork();                                  // 复制子进程
+int      proc_clone(uint64 fn, uint64 arg, uint64 stack); // 创建共享地址空间和文件描述符表的线程, 返回pid 失败返回-1
+bool     mm_lock(proc_t* p);                           // 地址空间共享时获取mm->lk (已经持有时不再获取), 返回是否获取了
+void     mm_unlock(proc_t* p, bool locked);            // 放开mm_lock获取的锁
+void     proc_mem_stat(proc_t* p, mem_stat_t* st);     // p的内存统计
 int      proc_wait(uint64 addr);                       // 等待子进程退出
 void     proc_exit(int exit_state);                    // 进程退出
+int      proc_fd_alloc(proc_t* p, file_t* file);      // 为file分配最小的空闲fd (失败返回-1)
+file_t*  proc_fd_get(proc_t* p, int fd);               // fd对应的文件 (无效返回NULL), 表共享时持有引用到proc_fd_unhold
+file_t*  proc_fd_dup(proc_t* p, int fd);               // fd对应的文件的一个新引用 (由调用者关闭), 无效返回NULL
+void     proc_fd_unhold(proc_t* p);                    // 放弃proc_fd_get持有的引用 (系统调用返回时)
+file_t*  proc_fd_clear(proc_t* p, int fd);             // 从表中移除fd并返回它的文件 (由调用者关闭), 无效返回NULL
+int      proc_fd_copy(proc_t* p, proc_t* np);          // np的表复制p的表 (文件引用+1), 内存不足返回-1
+void     proc_ready(proc_t* p);                        // 进程变为RUNNABLE并进入运行队列 (调用者持有p->lk)
 void     proc_yield();                                 // 进程放弃CPU
+void     proc_tick();                                  // 时钟中断: 当前进程用掉一个tick, 时间片用完或有更高优先级的进程时放弃CPU
+void     proc_resched();                               // 抢占点: 本hart上有更高优先级的进程在排队时放弃CPU (不持有自旋锁)
+bool     proc_pi_boost(proc_t* owner, int prio, bool first); // 优先级继承: 睡眠锁的等待者提升持有者 (见lib/lock.h)
+void     proc_pi_restore();                            // 当前进程释放了一个提升过它的睡眠锁
+void     proc_cond_resched();                          // 内核中长循环的抢占点: 只在设置了need_resched且没有持有自旋锁时让出
+int      proc_setpriority(int pid, int prio);          // 设置进程的基础优先级 (pid = 0: 当前进程), 返回原来的基础优先级 失败返回-1
+int      proc_setaffinity(int pid, uint32 mask);       // 设置进程的亲和性掩码 (pid = 0: 当前进程), 成功返回0 失败返回-1
+int      proc_getaffinity(int pid);                    // 进程的亲和性掩码 (pid = 0: 当前进程), 失败返回-1
+int      proc_set_sysrec(int pid, bool on);            // 设置是否录制进程的系统调用 (pid = 0: 当前进程), 失败返回-1
+int      proc_setdeadline(uint64 runtime, uint64 deadline, uint64 period); // 当前进程进入期限调度类 (mtime单位, runtime = 0: 离开), 失败返回-1
+void     proc_dl_arm(proc_t* p);                       // 期限进程返回用户态之前: 设置运行时间用完的定时器
+bool     proc_info(int pid, proc_info_t* info);        // pid的状态快照, 进程不存在(或已退出)返回false
+void     proc_acct_enter(proc_t* p);                   // 从用户态陷入 (关中断): 之前的时间计入用户态
+void     proc_acct_leave(proc_t* p);                   // 返回用户态之前 (关中断): 之前的时间计入内核态
+void     proc_loadavg_tick();                          // 推进了tick的hart调用: 到了采样间隔时更新负载均值
+void     proc_loadavg(uint64 avg[3], int* running);    // 1/5/15分钟的负载均值 (FSHIFT位小数) 和当前可运行的进程数
 void     proc_sleep(void* sleep_space, spinlock_t* lk);// 进程睡眠
+bool     proc_sleep_until(void* sleep_space, spinlock_t* lk, uint64 expire); // 进程睡眠, 最迟在mtime到达expire时醒来 (返回是否已到期)
 void     proc_wakeup(void* sleep_space);               // 进程唤醒
 void     proc_sched();                                 // 进程切换到调度器
 void     proc_scheduler();  
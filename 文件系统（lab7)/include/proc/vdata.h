@@ -0,0 +1,41 @@
+#ifndef __VDATA_H__
+#define __VDATA_H__
+
+#include "common.h"
+
+/*
+    用户数据页: 内核维护的一页, 只读映射在每个用户地址空间的VDATA (见memlayout.h), 读它不需要陷入内核
+        时间: ticks / 下一个tick开始的mtime / 周期, 由时钟的写者在顺序锁下同步更新 (见timer_write_end)
+              读者读seq (偶数), 读字段, 再读seq不变则一致; 纳秒 = (rdtime - mtime_base) * ns_per_mtime
+              (用户态可以直接执行rdtime, 见timer_init中的scounteren)
+        hart数: 启动时cpu_discover写入 (用户程序按它把工作进程分布到各个hart)
+        进程: 每个hart一项, 从这个hart返回用户态时写入当前进程的pid并把seq加1, 同时把用户的tp寄存器设为hartid
+              用户态读tp得到hartid h, 读cpu[h].seq、pid, 再读tp和seq都不变时pid是自己的 (中间被打断过seq一定变化)
+              只有hart h写cpu[h], 而且写在这个hart返回用户态之前: 不需要锁
+    布局与用户态的vdata_t一致 (user/type.h)
+*/
+
+#define VDATA_NCPU 8    // 每个hart一项的数组大小 (不随NCPU变化, 用户程序不必重新编译)
+
+typedef struct vdata_cpu {
+    volatile uint32 seq;      // 每次从这个hart返回用户态加1
+    volatile uint32 pid;      // 最近一次从这个hart返回用户态的进程
+} vdata_cpu_t;
+
+typedef struct vdata {
+    volatile uint32 seq;           // 时间字段的顺序锁
+    uint32 ns_per_mtime;           // mtime一个单位的纳秒数
+    volatile uint64 ticks;         // 已经过的tick数
+    volatile uint64 tick_next;     // 下一个tick开始的mtime
+    volatile uint64 tick_interval; // tick的周期 (mtime单位)
+    uint64 mtime_base;             // CLOCK_MONOTONIC的起点 (mtime)
+    vdata_cpu_t cpu[VDATA_NCPU];
+    uint32 ncpu;                   // 运行的hart数
+} vdata_t;
+
+uint64 vdata_page();                                     // 数据页的物理地址
+void   vdata_set_ncpu(int n);                            // cpu_discover之后 (只调用一次)
+void   vdata_set_time(uint64 ticks, uint64 next, uint64 interval); // 时钟的写者 (持有时钟的顺序锁)
+void   vdata_enter_user(int pid);                        // 本hart返回用户态之前 (已关中断)
+
+#endif
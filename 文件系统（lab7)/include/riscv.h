@@ -27,6 +27,14 @@ static inline void  w_mstatus(uint64 x)
   asm volatile("csrw mstatus, %0" : : "r" (x));
 }
 
+// machine ISA register: 第i位表示支持扩展'A' + i
+static inline uint64 r_misa()
+{
+  uint64 x;
+  asm volatile("csrr %0, misa" : "=r" (x) );
+  return x;
+}
+
 // machine exception program counter, holds the
 // instruction address to which a return from
 // exception will go.
@@ -37,6 +45,11 @@ static inline void w_mepc(uint64 x)
 
 // Supervisor Status Register, sstatus
 
+#define SSTATUS_FS (3L << 13)  // Floating-point unit state
+#define SSTATUS_FS_OFF     (0L << 13)
+#define SSTATUS_FS_INITIAL (1L << 13)
+#define SSTATUS_FS_CLEAN   (2L << 13)
+#define SSTATUS_FS_DIRTY   (3L << 13)
 #define SSTATUS_SPP (1L << 8)  // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5) // Supervisor Previous Interrupt Enable
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
@@ -233,6 +246,50 @@ static inline uint64 r_mcounteren()
   return x;
 }
 
+// Supervisor Counter Enable: 允许U-mode读计数器 (bit 1: time)
+static inline uint64 r_scounteren()
+{
+  uint64 x;
+  asm volatile("csrr %0, scounteren" : "=r" (x) );
+  return x;
+}
+
+static inline void w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
+// Machine Environment Configuration (特权架构1.12, 旧的汇编器不认识名字, 用CSR编号)
+#define MENVCFG_STCE (1L << 63) // Sstc: S-mode可以使用stimecmp
+
+static inline uint64 r_menvcfg()
+{
+  uint64 x;
+  asm volatile("csrr %0, 0x30a" : "=r" (x) );
+  return x;
+}
+
+static inline void w_menvcfg(uint64 x)
+{
+  asm volatile("csrw 0x30a, %0" : : "r" (x));
+}
+
+// Supervisor Timer Compare (Sstc): time >= stimecmp时STIP置位, 写入更大的值后清除
+static inline void w_stimecmp(uint64 x)
+{
+  asm volatile("csrw 0x14d, %0" : : "r" (x));
+}
+
+#define SIP_STIP (1L << 5) // S-mode时钟中断挂起 (只读, Sstc时由stimecmp决定)
+
+// 处理器的cycle计数 (S-mode读取需要mcounteren.CY)
+static inline uint64 r_cycle()
+{
+  uint64 x;
+  asm volatile("csrr %0, cycle" : "=r" (x) );
+  return x;
+}
+
 // machine-mode cycle counter
 static inline uint64 r_time()
 {
@@ -295,6 +352,18 @@ static inline void sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// 只刷新一个ASID的表项 (全局映射除外)
+static inline void sfence_vma_asid(uint64 asid)
+{
+  asm volatile("sfence.vma zero, %0" : : "r" (asid) : "memory");
+}
+
+// 只刷新一个ASID中va所在页的表项
+static inline void sfence_vma_page(uint64 va, uint64 asid)
+{
+  asm volatile("sfence.vma %0, %1" : : "r" (va), "r" (asid) : "memory");
+}
+
 // 内存管理相关 - 保留基础工具宏
 
 #define PGSHIFT 12  // bits of offset within a page
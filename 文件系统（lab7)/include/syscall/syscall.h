@@ -3,9 +3,34 @@
 
 #include "common.h"
 
+// sys_batch的一项: 系统调用号和参数, 执行后内核写回返回值 (与用户态batch_call_t一致)
+typedef struct batch_call {
+    uint64 num;
+    uint64 args[6];
+    uint64 ret;
+} batch_call_t;
+
+#define N_BATCH 64    // 一次sys_batch最多的系统调用数
+
+// 一个系统调用号的统计 (与用户态sysstat_t一致, sys_sysstat拷贝给用户), 时间是mtime单位 (100ns), 包括睡眠的时间
+// 全局统计每个hart一份 (见lib/percpu.h); 每个进程自己的统计只有calls / errors / time
+#define SYSSTAT_HIST 8    // 延迟直方图的桶数: 第i个桶是 [4^i, 4^(i+1)) 个mtime单位 (第0个桶包括0, 最后一个桶没有上限)
+
+typedef struct sysstat {
+    uint64 calls;
+    uint64 errors;                // 返回-1的次数
+    uint64 time;                  // 总耗时
+    uint64 max;                   // 最长的一次
+    uint64 hist[SYSSTAT_HIST];    // 延迟直方图
+} sysstat_t;
+
+#define SYSSTAT_GLOBAL 0          // sys_sysstat: 所有进程
+#define SYSSTAT_SELF   1          // sys_sysstat: 当前进程
+
 // 系统调用主处理函数
 
 void syscall(void);
+void syscall_stat(int num, sysstat_t* st);    // 系统调用号num的全局统计 (各hart之和)
 
 // 基于参数寄存器编号的读取
 
@@ -24,8 +24,71 @@ uint64 sys_mkdir();
 uint64 sys_chdir();
 uint64 sys_link();
 uint64 sys_unlink();
+uint64 sys_bufstat();
+uint64 sys_diskstat();
+uint64 sys_statfs();
+uint64 sys_ftruncate();
+uint64 sys_fallocate();
+uint64 sys_openat();
+uint64 sys_mkdirat();
+uint64 sys_unlinkat();
+uint64 sys_linkat();
+uint64 sys_fstatat();
+uint64 sys_getdents();
+uint64 sys_rename();
+uint64 sys_pread();
+uint64 sys_pwrite();
+uint64 sys_readv();
+uint64 sys_writev();
+uint64 sys_pipe();
+uint64 sys_mmap_file();
+uint64 sys_msync();
+uint64 sys_copy_file_range();
+uint64 sys_fsync();
+uint64 sys_fdatasync();
+uint64 sys_sync();
+uint64 sys_uring_setup();
+uint64 sys_uring_enter();
+uint64 sys_fadvise();
+uint64 sys_umount();
+uint64 sys_poll();
+uint64 sys_epoll_create();
+uint64 sys_epoll_ctl();
+uint64 sys_epoll_wait();
+uint64 sys_sched_setdeadline();
+uint64 sys_clone_file();
+uint64 sys_fault_around();
+uint64 sys_poweroff();
+uint64 sys_sysrec();
+uint64 sys_splice();
+uint64 sys_vmsplice();
 
 uint64 sys_exec();
+uint64 sys_spawn();
+uint64 sys_shm_create();
+uint64 sys_shm_map();
+uint64 sys_shm_unmap();
+uint64 sys_shm_destroy();
+uint64 sys_memstat();
+uint64 sys_setpriority();
+uint64 sys_sched_setaffinity();
+uint64 sys_sched_getaffinity();
+uint64 sys_clone();
+uint64 sys_futex();
+uint64 sys_timer_config();
+uint64 sys_clock_gettime();
+uint64 sys_batch();
+uint64 sys_lockstat();
+uint64 sys_kstat();
+uint64 sys_dmesg();
+uint64 sys_trace();
+uint64 sys_sysstat();
+uint64 sys_prof();
+uint64 sys_tstat();
+uint64 sys_iostat();
+uint64 sys_cpustat();
+uint64 sys_irq_setaffinity();
+uint64 sys_fstatat_batch();
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,49 @@
+#ifndef __SYSREC_H__
+#define __SYSREC_H__
+
+#include "common.h"
+
+/*
+    系统调用录制 (工作负载的录制与回放, 见user/record.c和user/replay.c)
+        被标记的进程 (p->sysrec: sys_sysrec(SYSREC_START, pid)设置, fork/spawn/clone的子进程继承)
+        每完成一个系统调用, 在全局的记录缓冲区末尾追加一条定长记录:
+            开始时刻和耗时 (纳秒)、hart、pid、系统调用号、陷入时的6个参数、返回值,
+            参数是路径的系统调用另外复制路径的前SYSREC_PATH - 1字节 (调用之前复制, 其他缓冲区只有地址和长度)
+        不记录sys_sysrec自己 (录制工具的控制操作) 和不返回的sys_exit
+    缓冲区 (SYSREC_N条) 在第一次开始录制时从伙伴系统申请, 之后不释放, 由sysrec_lk保护;
+    读者 (SYSREC_READ) 按完成的顺序取出记录, 缓冲区满时新的记录丢弃并计入lost (回放需要完整的前缀, 不覆盖旧记录)
+*/
+
+#define SYSREC_START 0   // 标记进程 (0: 当前进程), 之后它和它创建的进程的系统调用都被记录
+#define SYSREC_STOP  1   // 取消标记 (已经创建的子进程不受影响)
+#define SYSREC_READ  2   // 取出记录
+
+#define SYSREC_PATH  32  // 记录中路径的最大字节数 (含结尾的0)
+#define SYSREC_ORDER 7   // 缓冲区: 2^order页
+
+// 与用户态sysrec_t一致
+typedef struct sysrec {
+    uint64 time;              // 开始时刻 (启动以来的纳秒数)
+    uint32 dur;               // 耗时 (纳秒, 超过4秒时饱和)
+    uint16 num;               // 系统调用号
+    uint16 hart;
+    uint32 pid;
+    uint32 pad;
+    uint64 args[6];           // a0 - a5
+    uint64 ret;
+    char   path[SYSREC_PATH]; // 路径参数 (没有时为空串)
+} sysrec_t;
+
+#define SYSREC_N        ((PGSIZE << SYSREC_ORDER) / sizeof(sysrec_t))
+#define SYSREC_READ_MAX (PGSIZE / sizeof(sysrec_t))   // 一次最多取出的记录数
+
+struct proc;
+
+void   sysrec_init();
+void   sysrec_path(struct proc* p, int num, char* path);        // 调用之前复制路径参数 (path有SYSREC_PATH字节)
+void   sysrec_record(struct proc* p, int num, uint64* args, char* path, uint64 start, uint64 dt, uint64 ret); // 追加一条记录 (mtime单位)
+int    sysrec_start(int pid);                                   // 标记进程, 没有这个进程或申请不到缓冲区返回-1
+int    sysrec_stop(int pid);                                    // 取消标记, 没有这个进程返回-1
+uint32 sysrec_read(uint64 dst, uint32 n, uint64* lost);         // 取出最多n条记录到用户地址dst, 返回条数
+
+#endif
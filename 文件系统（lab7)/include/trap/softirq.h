@@ -0,0 +1,27 @@
+#ifndef __SOFTIRQ_H__
+#define __SOFTIRQ_H__
+
+#include "common.h"
+
+/*
+    软中断 (中断的下半部): 设备中断的处理分成两半
+        上半部 (硬中断处理函数, 关中断) 只应答设备、取出必须立即取走的数据, 然后softirq_raise
+        下半部 (这里注册的处理函数) 在同一个hart退出陷阱之前执行: 开中断, 处理完成的请求、唤醒等待者
+    每个hart一个待处理掩码 (cpu->softirq_pending), 只由本hart在关中断时修改, 不需要锁;
+    下半部执行之前多次触发的中断合并为一次处理 (一批完成的请求一起回收)
+    下半部执行期间 (cpu->in_softirq):
+        嵌套的陷阱只执行上半部, 触发的软中断由外层的这一轮循环处理
+        不切换进程 (时间片到期、更高优先级的进程都留到外层陷阱的抢占点), 所以in_softirq总是属于当前的执行流
+    处理函数和硬中断处理函数一样不能睡眠, 只能使用自旋锁
+*/
+
+#define SOFTIRQ_DISK  0   // virtio磁盘: 回收used环上完成的请求, 唤醒等待者
+#define SOFTIRQ_UART  1   // 串口: 处理收到的字符 (行规程和回显), 继续写出发送缓冲区
+#define N_SOFTIRQ     2
+
+void softirq_register(int nr, void (*fn)(void)); // 设置下半部的处理函数 (设备初始化时)
+void softirq_raise(int nr);                      // 在本hart上触发 (硬中断处理中调用, 关中断)
+void softirq_run();                              // 执行本hart待处理的下半部, 直到没有新的触发 (退出陷阱之前调用, 关中断)
+bool softirq_active();                           // 本hart是否正在执行下半部 (嵌套的陷阱中不切换进程)
+
+#endif
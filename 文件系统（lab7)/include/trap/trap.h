@@ -23,6 +23,6 @@ void trap_user_return();
 // 辅助函数: 外设中断和时钟中断处理
 
 void external_interrupt_handler();
-void timer_interrupt_handler();
+bool timer_interrupt_handler();
 
 #endif
\ No newline at end of file
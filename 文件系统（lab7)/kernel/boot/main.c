@@ -3,13 +3,34 @@
 #include "dev/uart.h"
 #include "dev/timer.h"
 #include "dev/plic.h"
+#include "dev/vio.h"
 #include "mem/pmem.h"
 #include "mem/vmem.h"
 #include "mem/mmap.h"
+#include "mem/asid.h"
+#include "mem/shm.h"
 #include "trap/trap.h"
 #include "proc/proc.h"
+#include "proc/kwork.h"
+#include "proc/futex.h"
+#include "proc/fpu.h"
+#include "lib/trace.h"
+#include "syscall/sysrec.h"
+#include "lib/prof.h"
+#include "proc/cpu.h"
+#include "dev/fdt.h"
+#include "lib/bootopt.h"
+#include "lib/klog.h"
+#include "fs/uring.h"
 
-volatile static int started = 0;
+/*
+    启动分两个阶段, 其他hart不必等hart 0完成全部初始化:
+        阶段1: hart 0建好内核页表、全局定时器和PLIC优先级之后, 其他hart开始各自的初始化 (开启分页、陷阱入口、PLIC使能),
+               然后在等待阶段2期间清零空闲页 (与hart 0其余的初始化并行, 之后申请已清零的页不必再清零)
+        阶段2: hart 0初始化完所有模块, 所有hart开中断进入调度器
+    启动信息写入内核日志 (lib/klog.h), 由后台写出, 不在启动路径上同步等待UART
+*/
+static volatile int boot_stage = 0;
 
 int main()
 {
@@ -18,47 +39,77 @@ int main()
     if(cpuid == 0) {
         // CPU 0 进行初始化
         print_init();
+        bootopt_init(boot_dtb);   // 设备树在pmem_init之后被覆盖
+        cpu_discover(boot_dtb);
         pmem_init();
         kvm_init();
         trap_kernel_init();
+        plic_init();
+
+        // 阶段1: 其他hart开始初始化
+        __sync_synchronize();
+        boot_stage = 1;
+
         trap_kernel_inithart();
+        fpu_inithart();
         kvm_inithart();
-        plic_init();
+        asid_init();
         plic_inithart();
         uart_init();
+        virtio_disk_init();   // 根文件系统由第一个进程挂载 (fs_init会睡眠等待磁盘I/O, 见proc.c的fork_return)
         mmap_init();
+        shm_init();
         proc_init();
+        futex_init();
+        trace_init();
+        sysrec_init();
+        prof_init();
+        uring_init();
+        kwork_init();
         intr_on();
         
         printf("\n");
         printf("  xv6-riscv Lab6 - Process Management\n");
         printf("========================================\n\n");
         
+        // 阶段2: 所有hart进入调度器
         __sync_synchronize();
-        started = 1;
+        boot_stage = 2;
         
         // 创建第一个用户进程
-        printf("[Debug] main: CPU %d creating first user process\n", cpuid);
+        klog("main: hart %d creating first user process\n", cpuid);
         proc_make_first();
         
-        printf("[Debug] main: CPU %d entering scheduler\n", cpuid);
-        
         // 进入调度器，永不返回
         proc_scheduler();
         
         panic("scheduler returned");
         
     } else {
-        // 其他CPU等待CPU 0初始化完成
-        while(started == 0);
+        // 其他CPU等待CPU 0建好内核页表
+        while(boot_stage < 1);
         __sync_synchronize();
+
+        // 设备树中没有的hart不参与调度
+        if (cpuid >= ncpu) {
+            while (1)
+                asm volatile("wfi");
+        }
         
         kvm_inithart();
         trap_kernel_inithart();
+        fpu_inithart();
         plic_inithart();
+
+        // 等待CPU 0完成其余的初始化, 期间清零空闲页
+        while (boot_stage < 2 && pmem_zero_idle())
+            ;
+        while (boot_stage < 2)
+            ;
+        __sync_synchronize();
         intr_on();
         
-        printf("[Debug] main: CPU %d initialized, entering scheduler\n", cpuid);
+        klog("main: hart %d initialized, entering scheduler\n", cpuid);
         
         // 进入调度器
         proc_scheduler();
@@ -67,4 +118,4 @@ int main()
     }
     
     return 0;
-}
\ No newline at end of file
+}
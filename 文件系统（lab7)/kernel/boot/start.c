@@ -1,14 +1,20 @@
 #include "riscv.h"
 #include "memlayout.h"
 #include "dev/timer.h"
+#include "dev/fdt.h"
+#include "lib/str.h"
 
 void main(void);
 
 // 16字节对齐的 CPU 栈数组，每 CPU 4KB
 __attribute__ ((aligned (16))) uint8 CPU_stack[4096 * NCPU];
 
+// 有栈的hart数: entry.S让hartid不小于它的hart停下
+const uint64 start_ncpu_max = NCPU;
+
 // M-mode 下运行，完成权限配置后跳转到 main()
-void start(void)
+// dtb: qemu传入的设备树地址
+void start(uint64 dtb)
 {
     // 1. 设置 mstatus.MPP = S-mode
     //    mret 后将进入 S-mode
@@ -54,6 +60,11 @@ void start(void)
     //    后续 mycpuid() 通过读取 tp 获取 CPU ID
     int id = r_mhartid();
     w_tp(id);
+    if (id == 0) {
+        boot_dtb = dtb;
+        // misa只能在M-mode读: 是否使用向量版本的memset / memmove
+        str_vector_probe(r_misa());
+    }
     
     // 7. 初始化M-mode定时器中断
     timer_init();
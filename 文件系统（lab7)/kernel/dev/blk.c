@@ -0,0 +1,282 @@
+/*
+    块设备请求队列 (buf cache 与 virtio 驱动之间的调度层)
+    1. blk_submit() 把一个buf的读写请求放入队列, 与相邻block的同类请求合并
+    2. blk_unplug() 按电梯算法依次取出请求, 用virtio异步接口提交
+    3. blk_wait()   先派发队列中的请求, 再等待buf上的请求完成
+    4. blk_barrier() 写屏障, 让之前完成的写请求落盘
+    队列不会自己派发(没有专门的派发线程), 在队列满、有人等待或显式unplug时派发
+    切换到内存块设备(blk_use_ramdisk)之后不再排队: 提交时直接复制, 返回时请求已完成
+*/
+
+#include "dev/blk.h"
+#include "dev/ramdisk.h"
+#include "dev/timer.h"
+#include "fs/buf.h"
+#include "lib/lock.h"
+#include "lib/print.h"
+#include "lib/str.h"
+
+static struct {
+    spinlock_t lk;                  // 保护以下所有字段
+    sleeplock_t dispatch_lk;        // 串行化派发: 持有它时没有"已出队但尚未进入virtio"的请求
+    blk_req_t reqs[BLK_QUEUE_MAX];
+    uint32 n_req;                   // 排队中的请求数
+    uint64 seq;                     // 到达顺序计数
+    uint32 head_pos;                // 上一个派发请求的结束block (C-LOOK扫描位置)
+    blk_req_t* last;                // 最近一次加入或合并的请求 (NOOP只与它合并)
+    int elv;                        // 当前电梯算法
+    bool ram;                       // 文件系统在内存块设备上 (切换之后不再改变)
+} blkq;
+
+void blk_init()
+{
+    spinlock_init(&blkq.lk, "blk_queue");
+    sleeplock_init(&blkq.dispatch_lk, "blk_dispatch");
+    memset(blkq.reqs, 0, sizeof(blkq.reqs));
+    blkq.n_req = 0;
+    blkq.seq = 0;
+    blkq.head_pos = 0;
+    blkq.last = NULL;
+    blkq.elv = BLK_ELV_DEADLINE;
+    blkq.ram = false;
+}
+
+/*
+    之后的读写都交给已经创建并装入内容的内存块设备 (见dev/ramdisk.h)
+    调用时队列中和virtio上都不能有文件系统的请求 (fs_init在读入超级块之后、其他模块初始化之前调用)
+*/
+void blk_use_ramdisk()
+{
+    blk_unplug();
+    blkq.ram = true;
+}
+
+// 同步读写从sector开始的连续扇区: 不经过请求队列, 直接交给当前设备
+void blk_rw_sg(uint64 sector, virtio_seg_t* seg, int nseg, bool write)
+{
+    if (blkq.ram) {
+        ramdisk_rw_sg(sector, seg, nseg, write);
+    } else {
+        virtio_disk_rw_sg(sector, seg, nseg, write);
+    }
+}
+
+// 同步读写一个block, 不经过请求队列 (virtio上轮询等待完成)
+void blk_rw_poll(buf_t* b, bool write)
+{
+    if (blkq.ram) {
+        virtio_seg_t seg = { (uint64)b->data, BLOCK_SIZE };
+        ramdisk_rw_sg((uint64)b->block_num * (BLOCK_SIZE / 512), &seg, 1, write);
+    } else {
+        virtio_disk_rw_poll(b, write);
+    }
+}
+
+// 尝试把b合并进rq (前向或后向相邻, 方向相同且未满), 调用者持有blkq.lk
+static bool blk_try_merge(blk_req_t* rq, buf_t* b, bool write)
+{
+    if (!rq->used || rq->write != write || rq->nbuf >= VIRTIO_MAX_SEG) {
+        return false;
+    }
+
+    // 后向合并: b紧跟在rq之后
+    if (b->block_num == rq->bufs[rq->nbuf - 1]->block_num + 1) {
+        rq->bufs[rq->nbuf++] = b;
+        return true;
+    }
+
+    // 前向合并: b紧挨在rq之前
+    if (b->block_num + 1 == rq->bufs[0]->block_num) {
+        memmove(&rq->bufs[1], &rq->bufs[0], rq->nbuf * sizeof(buf_t*));
+        rq->bufs[0] = b;
+        rq->nbuf++;
+        return true;
+    }
+    return false;
+}
+
+// 把b放入队列(合并或新建请求), 队列已满时返回false, 调用者持有blkq.lk
+static bool blk_enqueue(buf_t* b, bool write)
+{
+    // 1. 合并: NOOP只看最近的请求, 其他算法检查所有排队请求
+    if (blkq.elv == BLK_ELV_NOOP) {
+        if (blkq.last != NULL && blk_try_merge(blkq.last, b, write)) {
+            return true;
+        }
+    } else {
+        for (int i = 0; i < BLK_QUEUE_MAX; i++) {
+            if (blk_try_merge(&blkq.reqs[i], b, write)) {
+                blkq.last = &blkq.reqs[i];
+                return true;
+            }
+        }
+    }
+
+    // 2. 新建请求
+    if (blkq.n_req == BLK_QUEUE_MAX) {
+        return false;
+    }
+    for (int i = 0; i < BLK_QUEUE_MAX; i++) {
+        blk_req_t* rq = &blkq.reqs[i];
+        if (!rq->used) {
+            rq->used = true;
+            rq->write = write;
+            rq->nbuf = 1;
+            rq->bufs[0] = b;
+            rq->seq = blkq.seq++;
+            rq->deadline = timer_get_mtime() + (write ? BLK_WRITE_EXPIRE : BLK_READ_EXPIRE);
+            blkq.n_req++;
+            blkq.last = rq;
+            return true;
+        }
+    }
+    panic("blk_enqueue: queue count mismatch");
+    return false;
+}
+
+// 按当前电梯算法选出下一个派发的请求, 队列为空时返回NULL, 调用者持有blkq.lk
+static blk_req_t* blk_pick()
+{
+    blk_req_t* best = NULL;
+
+    if (blkq.n_req == 0) {
+        return NULL;
+    }
+
+    // NOOP: 到达最早的请求
+    if (blkq.elv == BLK_ELV_NOOP) {
+        for (int i = 0; i < BLK_QUEUE_MAX; i++) {
+            blk_req_t* rq = &blkq.reqs[i];
+            if (rq->used && (best == NULL || rq->seq < best->seq)) {
+                best = rq;
+            }
+        }
+        return best;
+    }
+
+    // DEADLINE: 已超期的请求中期限最早的优先
+    if (blkq.elv == BLK_ELV_DEADLINE) {
+        uint64 now = timer_get_mtime();
+        for (int i = 0; i < BLK_QUEUE_MAX; i++) {
+            blk_req_t* rq = &blkq.reqs[i];
+            if (rq->used && rq->deadline <= now && (best == NULL || rq->deadline < best->deadline)) {
+                best = rq;
+            }
+        }
+        if (best != NULL) {
+            return best;
+        }
+    }
+
+    // SORT (C-LOOK): 扫描位置之后block_num最小的请求, 没有则回到最小的请求
+    blk_req_t* lowest = NULL;
+    for (int i = 0; i < BLK_QUEUE_MAX; i++) {
+        blk_req_t* rq = &blkq.reqs[i];
+        if (!rq->used) {
+            continue;
+        }
+        uint32 start = rq->bufs[0]->block_num;
+        if (lowest == NULL || start < lowest->bufs[0]->block_num) {
+            lowest = rq;
+        }
+        if (start >= blkq.head_pos && (best == NULL || start < best->bufs[0]->block_num)) {
+            best = rq;
+        }
+    }
+    return (best != NULL) ? best : lowest;
+}
+
+/*
+    把一个buf的读写请求放入队列, 返回时请求未必已提交给磁盘
+    b->disk在入队时即置为true, 调用者持有b的睡眠锁直到blk_wait()返回
+    队列已满时: nowait = true 直接返回false; 否则先派发队列再重试
+*/
+bool blk_submit(buf_t* b, bool write, bool nowait)
+{
+    if (blkq.ram) {
+        blk_rw_poll(b, write);
+        b->disk = false;
+        return true;
+    }
+    for (;;) {
+        spinlock_acquire(&blkq.lk);
+        if (blk_enqueue(b, write)) {
+            b->disk = true;
+            spinlock_release(&blkq.lk);
+            return true;
+        }
+        spinlock_release(&blkq.lk);
+
+        if (nowait) {
+            return false;
+        }
+        blk_unplug();
+    }
+}
+
+// 按电梯算法顺序把排队的请求全部提交给virtio (描述符不足时睡眠等待)
+void blk_unplug()
+{
+    sleeplock_acquire(&blkq.dispatch_lk);
+    for (;;) {
+        spinlock_acquire(&blkq.lk);
+        blk_req_t* rq = blk_pick();
+        if (rq == NULL) {
+            spinlock_release(&blkq.lk);
+            break;
+        }
+        blk_req_t req = *rq;
+        rq->used = false;
+        blkq.n_req--;
+        if (blkq.last == rq) {
+            blkq.last = NULL;
+        }
+        blkq.head_pos = req.bufs[0]->block_num + req.nbuf;
+        spinlock_release(&blkq.lk);
+
+        virtio_disk_submit(req.bufs, req.nbuf, req.write, true);
+    }
+    sleeplock_release(&blkq.dispatch_lk);
+}
+
+// 等待b上的请求完成
+// b的请求可能还在队列中, 或者正被其他进程派发: 先派发一次(会等待正在进行的派发结束)
+void blk_wait(buf_t* b)
+{
+    if (blkq.ram) {
+        return;
+    }
+    blk_unplug();
+    virtio_disk_wait(b);
+}
+
+// 同步读写一个block
+void blk_rw(buf_t* b, bool write)
+{
+    blk_submit(b, write, false);
+    blk_wait(b);
+}
+
+/*
+    写屏障: 返回时所有已经完成(blk_wait返回)的写请求都已持久化
+    先派发队列中的请求(保证屏障之前入队的请求先于flush进入设备), 再发送一次flush
+    fsync/日志提交只需要等待自己的写完成后调用一次, 不必把每个block都同步写
+*/
+void blk_barrier()
+{
+    if (blkq.ram) {
+        return;
+    }
+    blk_unplug();
+    virtio_disk_flush();
+}
+
+// 切换电梯算法 (BLK_ELV_*)
+void blk_set_elevator(int elv)
+{
+    assert(elv >= BLK_ELV_NOOP && elv <= BLK_ELV_DEADLINE, "blk_set_elevator: unknown elevator");
+    spinlock_acquire(&blkq.lk);
+    blkq.elv = elv;
+    blkq.last = NULL;
+    spinlock_release(&blkq.lk);
+}
@@ -0,0 +1,175 @@
+#include "dev/console.h"
+#include "dev/uart.h"
+#include "fs/file.h"
+#include "fs/poll.h"
+#include "mem/vmem.h"
+#include "mem/swap.h"
+#include "proc/cpu.h"
+#include "proc/proc.h"
+#include "lib/lock.h"
+#include "lib/str.h"
+#include "lib/print.h"
+
+#define CTRL(x)   ((x) - '@')
+#define BACKSPACE 0x100
+
+extern dev_t devlist[N_DEV];
+
+// 输入缓冲区 (见dev/console.h), r / w / e是只增不减的计数
+static struct {
+    spinlock_t lk;
+    char buf[CONSOLE_BUF];
+    uint32 r;   // 已读出
+    uint32 w;   // 已提交
+    uint32 e;   // 已输入 (包括正在编辑的行)
+    poll_head_t ph;  // 等待输入的项 (poll / epoll)
+} cons;
+
+// 第一个进程调用file_init之前中断已经打开, 这期间的输入不能交给还没初始化的cons
+static volatile bool ready = false;
+
+// 回显 (退格: 光标左移, 用空格盖住, 再左移)
+static void console_echo(int c)
+{
+    if (c == BACKSPACE) {
+        uart_putc('\b');
+        uart_putc(' ');
+        uart_putc('\b');
+    } else {
+        uart_putc(c);
+    }
+}
+
+void console_intr(int c)
+{
+    spinlock_acquire(&cons.lk);
+    switch (c) {
+    case CTRL('U'):
+        while (cons.e != cons.w && cons.buf[(cons.e - 1) % CONSOLE_BUF] != '\n') {
+            cons.e--;
+            console_echo(BACKSPACE);
+        }
+        break;
+    case CTRL('H'):
+    case '\x7f':
+        if (cons.e != cons.w) {
+            cons.e--;
+            console_echo(BACKSPACE);
+        }
+        break;
+    default:
+        if (c == 0 || cons.e - cons.r == CONSOLE_BUF) {
+            break;
+        }
+        if (c == '\r') {
+            c = '\n';
+        }
+        if (c != CTRL('D')) {
+            console_echo(c);
+        }
+        cons.buf[cons.e++ % CONSOLE_BUF] = c;
+        if (c == '\n' || c == CTRL('D') || cons.e - cons.r == CONSOLE_BUF) {
+            cons.w = cons.e;
+            proc_wakeup(&cons.r);
+            poll_wake(&cons.ph, POLLIN);
+        }
+        break;
+    }
+    spinlock_release(&cons.lk);
+}
+
+// 从控制台读出最多len字节
+static uint32 console_read(uint32 len, uint64 dst, bool user)
+{
+    // 持有cons.lk时复制用户缓冲区, 不能睡眠换入
+    if (user) {
+        swap_prefault(dst, len);
+    }
+    spinlock_acquire(&cons.lk);
+
+    // 1. 等待提交的输入
+    while (cons.r == cons.w) {
+        proc_sleep(&cons.r, &cons.lk);
+    }
+
+    // 2. 本次读出的字节数: 到行尾为止, 行首的^D读出0字节并被消耗
+    uint32 n = 0;
+    while (n < len && cons.r + n != cons.w) {
+        char c = cons.buf[(cons.r + n) % CONSOLE_BUF];
+        if (c == CTRL('D')) {
+            if (n == 0) {
+                cons.r++;
+            }
+            break;
+        }
+        n++;
+        if (c == '\n') {
+            break;
+        }
+    }
+
+    // 3. 一次复制, 环绕时分两段
+    uint32 done = 0;
+    while (done < n) {
+        uint32 pos = cons.r % CONSOLE_BUF;
+        uint32 k = CONSOLE_BUF - pos;
+        if (k > n - done) k = n - done;
+        if (user) {
+            uvm_copyout(myproc()->mm->pgtbl, dst + done, (uint64)&cons.buf[pos], k);
+        } else {
+            memmove((void*)(dst + done), &cons.buf[pos], k);
+        }
+        cons.r += k;
+        done += k;
+    }
+    spinlock_release(&cons.lk);
+    return done;
+}
+
+// 向控制台写入len字节: 分段复制到内核栈上, 再放入UART发送缓冲区
+static uint32 console_write(uint32 len, uint64 src, bool user)
+{
+    char tmp[128];
+    uint32 done = 0;
+    while (done < len) {
+        uint32 k = len - done;
+        if (k > sizeof(tmp)) k = sizeof(tmp);
+        if (user) {
+            uvm_copyin(myproc()->mm->pgtbl, (uint64)tmp, src + done, k);
+        } else {
+            memmove(tmp, (void*)(src + done), k);
+        }
+        for (uint32 i = 0; i < k; i++) {
+            uart_putc(tmp[i]);
+        }
+        done += k;
+    }
+    return done;
+}
+
+// 有提交的输入时可读, 输出总是可写
+static uint32 console_poll(poll_head_t** head)
+{
+    spinlock_acquire(&cons.lk);
+    uint32 mask = POLLOUT | (cons.r != cons.w ? POLLIN : 0);
+    spinlock_release(&cons.lk);
+    *head = &cons.ph;
+    return mask;
+}
+
+void console_init()
+{
+    spinlock_init(&cons.lk, "console");
+    cons.r = cons.w = cons.e = 0;
+    poll_head_init(&cons.ph, "console poll");
+    devlist[DEV_CONSOLE].read = console_read;
+    devlist[DEV_CONSOLE].write = console_write;
+    devlist[DEV_CONSOLE].poll = console_poll;
+    __sync_synchronize();
+    ready = true;
+}
+
+bool console_ready()
+{
+    return ready;
+}
@@ -0,0 +1,165 @@
+#include "dev/fdt.h"
+#include "lib/str.h"
+
+// 设备树的结构块由32位大端的记号组成 (见dev/fdt.h)
+#define FDT_BEGIN_NODE  1   // 节点开始, 后面是以0结尾的节点名 (补齐到4字节)
+#define FDT_END_NODE    2
+#define FDT_PROP        3   // 属性: 长度, 名字在字符串块中的偏移, 值 (补齐到4字节)
+#define FDT_NOP         4
+#define FDT_END         9
+
+#define FDT_MAX_SIZE    (1 << 20)   // 设备树大小的合理上限 (防止把无效的地址当作设备树)
+#define FDT_MAX_DEPTH   8           // 记录节点名的层数 (更深的节点的属性不交给回调)
+
+uint64 boot_dtb;
+
+// 遍历时每个属性调用一次: node[1..depth]是从根节点开始的节点名 (根节点的名字是"")
+typedef void (*fdt_prop_fn)(int depth, char** node, char* name, uint8* val, uint32 len, void* arg);
+
+static uint32 fdt32(uint8* p)
+{
+    return ((uint32)p[0] << 24) | ((uint32)p[1] << 16) | ((uint32)p[2] << 8) | p[3];
+}
+
+// 按顺序遍历所有属性, 设备树无效返回false
+static bool fdt_walk(uint64 dtb, fdt_prop_fn fn, void* arg)
+{
+    uint8* fdt = (uint8*)dtb;
+    if (dtb == 0 || dtb % 4 != 0 || fdt32(fdt) != FDT_MAGIC) {
+        return false;
+    }
+    uint32 total = fdt32(fdt + 4);
+    uint32 off_struct = fdt32(fdt + 8);
+    uint32 off_strings = fdt32(fdt + 12);
+    uint32 size_struct = fdt32(fdt + 36);
+    if (total > FDT_MAX_SIZE || off_struct + size_struct > total || off_strings > total) {
+        return false;
+    }
+
+    uint8* p = fdt + off_struct;
+    uint8* end = p + size_struct;
+    char* strings = (char*)fdt + off_strings;
+    char* node[FDT_MAX_DEPTH + 1];
+    int depth = 0;
+    while (p + 4 <= end) {
+        uint32 token = fdt32(p);
+        p += 4;
+        if (token == FDT_BEGIN_NODE) {
+            char* name = (char*)p;
+            depth++;
+            if (depth <= FDT_MAX_DEPTH) {
+                node[depth] = name;
+            }
+            p += (strlen(name) + 1 + 3) & ~3;
+        } else if (token == FDT_END_NODE) {
+            depth--;
+        } else if (token == FDT_PROP) {
+            uint32 len = fdt32(p);
+            if (depth >= 1 && depth <= FDT_MAX_DEPTH) {
+                fn(depth, node, strings + fdt32(p + 4), p + 8, len, arg);
+            }
+            p += 8 + ((len + 3) & ~3);
+        } else if (token == FDT_NOP) {
+            continue;
+        } else {
+            break;   // FDT_END或无效的记号
+        }
+    }
+    return true;
+}
+
+// /cpus/cpu@N的reg: /cpus的#address-cells是1, reg是一个32位的hartid (多个cell时取最后一个)
+static void fdt_hart_fn(int depth, char** node, char* name, uint8* val, uint32 len, void* arg)
+{
+    int* nhart = arg;
+    if (depth == 3 && strncmp(node[2], "cpus", 5) == 0 && strncmp(node[3], "cpu@", 4) == 0 &&
+        strncmp(name, "reg", 4) == 0 && len >= 4) {
+        int hart = (int)fdt32(val + len - 4) + 1;
+        if (hart > *nhart) {
+            *nhart = hart;
+        }
+    }
+}
+
+int fdt_count_harts(uint64 dtb)
+{
+    int nhart = 0;
+    if (!fdt_walk(dtb, fdt_hart_fn, &nhart)) {
+        return 0;
+    }
+    return nhart;
+}
+
+// fdt_bootargs的输出位置
+typedef struct fdt_str {
+    char* buf;
+    uint32 len;
+} fdt_str_t;
+
+static void fdt_bootargs_fn(int depth, char** node, char* name, uint8* val, uint32 len, void* arg)
+{
+    fdt_str_t* s = arg;
+    if (depth == 2 && strncmp(node[2], "chosen", 7) == 0 && strncmp(name, "bootargs", 9) == 0 && len > 0) {
+        safestrcpy(s->buf, (char*)val, (len < s->len) ? len : s->len);
+    }
+}
+
+void fdt_bootargs(uint64 dtb, char* buf, uint32 len)
+{
+    fdt_str_t s = { buf, len };
+    buf[0] = 0;
+    fdt_walk(dtb, fdt_bootargs_fn, &s);
+}
+
+// fdt_memory_end的状态: 根节点的#address-cells / #size-cells (在子节点之前出现), 包含base的内存区域的结束地址
+typedef struct fdt_mem {
+    uint32 addr_cells;
+    uint32 size_cells;
+    uint64 base;
+    uint64 end;
+} fdt_mem_t;
+
+// 读取cells个32位大端cell组成的数 (最多2个)
+static uint64 fdt_cells(uint8* p, uint32 cells)
+{
+    uint64 v = 0;
+    for (uint32 i = 0; i < cells; i++) {
+        v = (v << 32) | fdt32(p + 4 * i);
+    }
+    return v;
+}
+
+static void fdt_memory_fn(int depth, char** node, char* name, uint8* val, uint32 len, void* arg)
+{
+    fdt_mem_t* m = arg;
+    if (depth == 1 && len == 4) {
+        if (strncmp(name, "#address-cells", 15) == 0) {
+            m->addr_cells = fdt32(val);
+        } else if (strncmp(name, "#size-cells", 12) == 0) {
+            m->size_cells = fdt32(val);
+        }
+        return;
+    }
+    if (depth != 2 || strncmp(node[2], "memory", 6) != 0 || strncmp(name, "reg", 4) != 0 ||
+        m->addr_cells < 1 || m->addr_cells > 2 || m->size_cells < 1 || m->size_cells > 2) {
+        return;
+    }
+    // reg: 若干个(地址, 大小)对
+    uint32 entry = 4 * (m->addr_cells + m->size_cells);
+    for (uint32 off = 0; off + entry <= len; off += entry) {
+        uint64 addr = fdt_cells(val + off, m->addr_cells);
+        uint64 size = fdt_cells(val + off + 4 * m->addr_cells, m->size_cells);
+        if (addr <= m->base && m->base - addr < size) {
+            m->end = addr + size;
+        }
+    }
+}
+
+uint64 fdt_memory_end(uint64 dtb, uint64 base)
+{
+    fdt_mem_t m = { 2, 1, base, 0 };   // 没有指定时的默认值 (设备树规范)
+    if (!fdt_walk(dtb, fdt_memory_fn, &m)) {
+        return 0;
+    }
+    return m.end;
+}
@@ -4,12 +4,48 @@
 #include "dev/plic.h"
 #include "proc/proc.h"
 #include "proc/cpu.h"
+#include "lib/lock.h"
+#include "lib/percpu.h"
+
+// 路由 (见dev/plic.h): 每个中断源的亲和性, 修改时重写所有hart的使能寄存器
+static spinlock_t plic_lk;
+static uint32 plic_affinity[PLIC_NIRQ];
+
+// 每个hart claim到各中断源的次数 (每个hart一行, 只写自己的行)
+typedef struct plic_counter {
+    uint64 count[PLIC_NIRQ];
+} plic_counter_t;
+
+static PCPU_DEFINE(plic_counter_t, plic_counter);
+
+// hartid应当使能的中断源 (调用者持有plic_lk)
+static uint32 plic_enable_bits(int hartid)
+{
+    uint32 bits = 0;
+    for (int irq = 1; irq < PLIC_NIRQ; irq++) {
+        if (plic_affinity[irq] & (1u << hartid)) {
+            bits |= 1u << irq;
+        }
+    }
+    return bits;
+}
 
 // PLIC初始化
 void plic_init()
 {
+    spinlock_init(&plic_lk, "plic");
+
     // 设置中断优先级
     *(uint32*)(PLIC_PRIORITY(UART_IRQ)) = 1;
+    for (int slot = 0; slot < VIRTIO_NSLOT; slot++) {
+        *(uint32*)(PLIC_PRIORITY(VIRTIO_IRQ + slot)) = 1;
+    }
+
+    // 默认亲和性 (不在PLIC_IRQ_HARTS中的hart不接收设备中断)
+    plic_affinity[UART_IRQ] = PLIC_IRQ_HARTS;
+    for (int slot = 0; slot < VIRTIO_NSLOT; slot++) {
+        plic_affinity[VIRTIO_IRQ + slot] = PLIC_VIRTIO_HARTS;
+    }
 }
 
 // PLIC核心初始化
@@ -17,7 +53,9 @@ void plic_inithart()
 {   
     int hartid = mycpuid();
     // 使能中断开关
-    *(uint32*)PLIC_SENABLE(hartid) = (1 << UART_IRQ);
+    spinlock_acquire(&plic_lk);
+    *(uint32*)PLIC_SENABLE(hartid) = plic_enable_bits(hartid);
+    spinlock_release(&plic_lk);
     // 设置响应阈值，接收所有优先 > 0的中断
     *(uint32*)PLIC_SPRIORITY(hartid) = 0;
 }
@@ -27,6 +65,9 @@ int plic_claim(void)
 {
     int hartid = mycpuid();
     int irq = *(uint32*)PLIC_SCLAIM(hartid);
+    if (irq > 0 && irq < PLIC_NIRQ) {
+        PCPU_ADD(plic_counter, count[irq], 1);
+    }
     return irq;
 }
 
@@ -35,4 +76,39 @@ void plic_complete(int irq)
 {
     int hartid = mycpuid();
     *(uint32*)PLIC_SCLAIM(hartid) = irq;
-}
\ No newline at end of file
+}
+
+// 只能修改有处理函数的中断源; 其他hart的使能寄存器也在PLIC中, 可以直接改写
+// 已经pending的中断仍可能由原来的hart claim
+int plic_set_affinity(int irq, uint32 mask)
+{
+    mask &= (1u << ncpu) - 1;
+    bool virtio = (irq >= VIRTIO_IRQ && irq < VIRTIO_IRQ + VIRTIO_NSLOT);
+    if ((irq != UART_IRQ && !virtio) || mask == 0) {
+        return -1;
+    }
+
+    spinlock_acquire(&plic_lk);
+    plic_affinity[irq] = mask;
+    for (int hartid = 0; hartid < ncpu; hartid++) {
+        *(uint32*)PLIC_SENABLE(hartid) = plic_enable_bits(hartid);
+    }
+    spinlock_release(&plic_lk);
+    return 0;
+}
+
+uint32 plic_get_affinity(int irq)
+{
+    if (irq <= 0 || irq >= PLIC_NIRQ) {
+        return 0;
+    }
+    return plic_affinity[irq];
+}
+
+uint64 plic_count(int irq, int hart)
+{
+    if (irq <= 0 || irq >= PLIC_NIRQ || hart < 0 || hart >= NCPU) {
+        return 0;
+    }
+    return plic_counter[hart].v.count[irq];
+}
@@ -0,0 +1,136 @@
+#include "dev/ramdisk.h"
+#include "mem/pmem.h"
+#include "lib/lock.h"
+#include "lib/print.h"
+#include "lib/str.h"
+
+// 内存块设备 (见dev/ramdisk.h)
+
+static struct {
+    spinlock_t lk;      // 保护页目录中空位的填入和npage
+    uint64* pages;      // 页目录: 第i项是第i个数据页的地址, 0表示还没有写过
+    uint32 order;       // 页目录占用的伙伴系统块的阶
+    uint32 npage;       // 页目录项数
+    uint32 nalloc;      // 已申请的数据页数
+    uint64 size;        // 设备字节数
+} ram;
+
+void ramdisk_init(uint32 nblocks)
+{
+    spinlock_init(&ram.lk, "ramdisk");
+    ram.size = (uint64)nblocks * BLOCK_SIZE;
+    ram.npage = (ram.size + PGSIZE - 1) / PGSIZE;
+    ram.order = 0;
+    while (((uint64)PGSIZE << ram.order) < (uint64)ram.npage * sizeof(uint64)) {
+        ram.order++;
+    }
+    assert(ram.order <= PMEM_MAX_ORDER, "ramdisk_init: device too large");
+    ram.pages = (uint64*)pmem_alloc_order(ram.order);
+    assert(ram.pages != NULL, "ramdisk_init: no memory for page directory");
+    ram.nalloc = 0;
+}
+
+// 第i个数据页, 不存在时create = true则申请一个全0的页, 否则返回0
+static uint64 ramdisk_page(uint32 i, bool create)
+{
+    uint64 pa = ram.pages[i];
+    if (pa != 0 || !create) {
+        return pa;
+    }
+
+    // 数据页数量与设备大小成正比, 从用户区域申请 (内核区域不够时可以互相借页)
+    uint64 page = (uint64)pmem_alloc(false);
+    assert(page != 0, "ramdisk_page: out of memory");
+    spinlock_acquire(&ram.lk);
+    if (ram.pages[i] == 0) {
+        ram.pages[i] = page;
+        ram.nalloc++;
+        page = 0;
+    }
+    pa = ram.pages[i];
+    spinlock_release(&ram.lk);
+    if (page != 0) {
+        pmem_free(page, false);      // 另一个写者先填入了这一项
+    }
+    return pa;
+}
+
+// 字节偏移off开始的len字节与addr之间复制, 按数据页拆分
+static void ramdisk_copy(uint64 off, uint64 addr, uint32 len, bool write)
+{
+    while (len > 0) {
+        uint32 i = off / PGSIZE;
+        uint32 poff = off % PGSIZE;
+        uint32 n = PGSIZE - poff;
+        if (n > len) n = len;
+
+        uint64 pa = ramdisk_page(i, write);
+        if (write) {
+            memmove((void*)(pa + poff), (void*)addr, n);
+        } else if (pa != 0) {
+            memmove((void*)addr, (void*)(pa + poff), n);
+        } else {
+            memset((void*)addr, 0, n);
+        }
+        off += n;
+        addr += n;
+        len -= n;
+    }
+}
+
+// 与virtio_disk_rw_sg相同: 从sector开始的连续扇区, 数据依次分布在seg[0..nseg-1]中
+// 不同block的读写互不影响, 同一block的并发读写由上层(buf的睡眠锁、页缓存)串行化
+void ramdisk_rw_sg(uint64 sector, virtio_seg_t* seg, int nseg, bool write)
+{
+    uint64 off = sector * 512;
+    for (int i = 0; i < nseg; i++) {
+        assert(off + seg[i].len <= ram.size, "ramdisk_rw_sg: beyond end of device");
+        ramdisk_copy(off, seg[i].addr, seg[i].len, write);
+        off += seg[i].len;
+    }
+}
+
+static bool page_is_zero(uint64 page)
+{
+    uint64* p = (uint64*)page;
+    for (int i = 0; i < PGSIZE / sizeof(uint64); i++) {
+        if (p[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 每次用一个scatter-gather请求读入RAMDISK_LOAD_BATCH个数据页, 全0的页释放掉
+void ramdisk_load()
+{
+    virtio_seg_t seg[RAMDISK_LOAD_BATCH];
+
+    for (uint32 first = 0; first < ram.npage; first += RAMDISK_LOAD_BATCH) {
+        int n = 0;
+        for (uint32 i = first; i < ram.npage && n < RAMDISK_LOAD_BATCH; i++, n++) {
+            uint64 left = ram.size - (uint64)i * PGSIZE;
+            seg[n].addr = (uint64)pmem_alloc_flags(false, 0);
+            assert(seg[n].addr != 0, "ramdisk_load: out of memory");
+            seg[n].len = (left < PGSIZE) ? (uint32)left : PGSIZE;
+        }
+        virtio_disk_rw_sg((uint64)first * (PGSIZE / 512), seg, n, false);
+
+        for (int k = 0; k < n; k++) {
+            if (seg[k].len < PGSIZE) {
+                memset((void*)(seg[k].addr + seg[k].len), 0, PGSIZE - seg[k].len);
+            }
+            if (page_is_zero(seg[k].addr)) {
+                pmem_free(seg[k].addr, false);
+            } else {
+                ram.pages[first + k] = seg[k].addr;
+                ram.nalloc++;
+            }
+        }
+    }
+}
+
+uint32 ramdisk_pages()
+{
+    return ram.nalloc;
+}
@@ -1,6 +1,7 @@
 #include "lib/lock.h"
 #include "lib/print.h"
 #include "dev/timer.h"
+#include "proc/vdata.h"
 #include "memlayout.h"
 #include "riscv.h"
 
@@ -9,8 +10,12 @@
 // in trap.S M-mode时钟中断处理流程()
 extern void timer_vector();
 
-// 每个CPU在时钟中断中需要的临时空间,其中0 1 2用来保存a1 a2 a3寄存器，3保存CLINT_MTMECMP地址，4保存INTERVAL值
-static uint64 mscratch[NCPU][5];
+// 有Sstc扩展: S-mode直接设置stimecmp, 时钟中断直接作为S-mode时钟中断到来, 不经过M-mode (见timer_init)
+bool timer_sstc;
+
+// 每个CPU在时钟中断中需要的临时空间,其中0 1 2用来保存a1 a2 a3寄存器，3保存CLINT_MTMECMP地址，4不再使用 (周期由S-mode管理)
+// 5保存CLINT_MSIP地址，6是时钟中断留给S-mode的标志（S-mode软件中断也可能来自处理器间中断）
+static uint64 mscratch[NCPU][7];
 
 // 时钟初始化
 // called in start.c
@@ -18,18 +23,36 @@ void timer_init()
 {
     // 每个CPU都有独立的定时器中断源
     int id = r_mhartid();
-    
-    // 向CLINT请求定时器中断
-    // 设置 MTIMECMP = MTIME + INTERVAL
-    *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + INTERVAL;
+
+    // S-mode可以读time (Sstc的stimecmp也需要), U-mode也可以 (用户数据页的时间换算用rdtime)
+    // S-mode还可以读cycle (锁统计, 见lib/lockstat.h)
+    w_mcounteren(r_mcounteren() | 2 | 1);
+    w_scounteren(r_scounteren() | 2);
+
+    // 检测Sstc: menvcfg.STCE能置1说明支持 (不支持时这一位是只读的0)
+    // 支持时第一次中断由stimecmp产生, M-mode不再处理时钟中断 (mtimecmp保持最大值)
+    w_menvcfg(r_menvcfg() | MENVCFG_STCE);
+    timer_sstc = (r_menvcfg() & MENVCFG_STCE) != 0;
+    if (timer_sstc) {
+        *(uint64*)CLINT_MTIMECMP(id) = ~0ul;
+        w_stimecmp(*(uint64*)CLINT_MTIME + TIMER_INTERVAL);
+    } else {
+        // 向CLINT请求定时器中断
+        // 设置 MTIMECMP = MTIME + TIMER_INTERVAL (之后由S-mode设置, 见timer_rearm)
+        *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + TIMER_INTERVAL;
+    }
     
     // 在mscratch[]中为timer_vector准备信息
     // mscratch[0..2]: timer_vector保存寄存器的空间
     // mscratch[3]: CLINT MTIMECMP寄存器地址
-    // mscratch[4]: 定时器中断之间期望的间隔
+    // mscratch[4]: 不再使用
     uint64 *scratch = &mscratch[id][0];
+    // mscratch[5]: CLINT MSIP寄存器地址 (处理器间中断)
+    // mscratch[6]: 时钟中断发生过 (S-mode取走后清零)
     scratch[3] = CLINT_MTIMECMP(id);
-    scratch[4] = INTERVAL;
+    scratch[4] = 0;
+    scratch[5] = CLINT_MSIP(id);
+    scratch[6] = 0;
     w_mscratch((uint64)scratch);
     
     // 设置机器模式的陷阱处理程序,mtvec寄存器保存中断向量地址。当M-mode中断发生时，CPU自动跳转到这个地址执行
@@ -38,8 +61,9 @@ void timer_init()
     // 启用机器模式中断
     w_mstatus(r_mstatus() | MSTATUS_MIE);
     
-    // 启用机器模式定时器中断
-    w_mie(r_mie() | MIE_MTIE);
+    // 启用机器模式定时器中断和软件中断 (处理器间中断先到M-mode, 再转为S-mode软件中断)
+    // Sstc时只需要软件中断
+    w_mie(r_mie() | (timer_sstc ? 0 : MIE_MTIE) | MIE_MSIE);
     
     // mstatus.MIE 和 mie.MTIE 分别是全局中断开关和定时器中断开关
 }
@@ -47,26 +71,372 @@ void timer_init()
 
 /*--------------------- 工作在S-mode --------------------*/
 
-// 系统时钟
+// 系统时钟 (见dev/timer.h)
 timer_t sys_timer;
 
+// tickless模式
+static volatile bool timer_tickless;
+
+// 时间轮 (见dev/timer.h)
+static struct {
+    spinlock_t lk;
+    uint64 clk;                            // 已经处理过的刻度 (mtime >> TW_SHIFT)
+    uint32 n;                              // 时间轮中的定时器数
+    uint64 bitmap[TW_LEVELS];              // 非空的槽位
+    ktimer_t* slot[TW_LEVELS][TW_SIZE];
+} wheel;
+
 // 时钟创建(初始化系统时钟)
 void timer_create()
 {
+    sys_timer.seq = 0;
     sys_timer.ticks = 0;
+    sys_timer.interval = TIMER_INTERVAL;
+    sys_timer.next = timer_get_mtime() + TIMER_INTERVAL;
+    vdata_set_time(sys_timer.ticks, sys_timer.next, sys_timer.interval);
+    timer_tickless = TIMER_TICKLESS;
     spinlock_init(&sys_timer.lk, "timer");
+    spinlock_init(&wheel.lk, "wheel");
+    wheel.clk = timer_get_mtime() >> TW_SHIFT;
+}
+
+// 写者进入: seq从偶数改为奇数 (try为true时别的hart正在写就返回false, 否则等它写完)
+// 关中断: 同一个hart上被中断打断的写者会让中断中的读者一直等下去
+static bool timer_write_begin(bool try)
+{
+    push_off();
+    for (;;) {
+        uint32 seq = sys_timer.seq;
+        if (!(seq & 1) && __sync_bool_compare_and_swap(&sys_timer.seq, seq, seq + 1)) {
+            return true;
+        }
+        if (try) {
+            pop_off();
+            return false;
+        }
+    }
+}
+
+static void timer_write_end()
+{
+    vdata_set_time(sys_timer.ticks, sys_timer.next, sys_timer.interval);
+    __sync_synchronize();
+    sys_timer.seq++;
+    pop_off();
+}
+
+// 读者: 读到一致的ticks / next / interval (读的过程中有写者时重读)
+static void timer_read(uint64* ticks, uint64* next, uint64* interval)
+{
+    uint32 seq;
+    do {
+        seq = sys_timer.seq;
+        __sync_synchronize();
+        *ticks = sys_timer.ticks;
+        *next = sys_timer.next;
+        *interval = sys_timer.interval;
+        __sync_synchronize();
+    } while ((seq & 1) || seq != sys_timer.seq);
 }
 
-// 时钟更新(ticks++ with lock)
-void timer_update()
+// 时钟更新: 补上到现在为止经过的tick (不获取锁: 别的hart正在推进时直接返回, 由它执行每个tick的工作)
+// 返回推进的tick数 (别的hart已经推进过时返回0)
+uint64 timer_update()
 {
-    spinlock_acquire(&sys_timer.lk);
-    sys_timer.ticks++;
-    spinlock_release(&sys_timer.lk);
+    uint64 now = timer_get_mtime();
+    if (now < sys_timer.next || !timer_write_begin(true)) {
+        return 0;
+    }
+    uint64 n = 0;
+    if (now >= sys_timer.next) {
+        n = (now - sys_timer.next) / sys_timer.interval + 1;
+        sys_timer.ticks += n;
+        sys_timer.next += n * sys_timer.interval;
+    }
+    timer_write_end();
+    return n;
 }
 
 // 返回系统时钟ticks
 uint64 timer_get_ticks()
 {
     return sys_timer.ticks;
-}
\ No newline at end of file
+}
+
+// S-mode软件中断或时钟中断到来之后调用: 这次中断是否包含一个时钟中断
+// Sstc: STIP仍然挂起 (下一次设置stimecmp时清除); 否则取走M-mode留下的时钟中断标志
+// 返回false说明这次软件中断只是处理器间中断
+bool timer_tick_pending()
+{
+    if (timer_sstc) {
+        return (r_sip() & SIP_STIP) != 0;
+    }
+    return __sync_lock_test_and_set(&mscratch[r_tp()][6], 0) != 0;
+}
+
+// 向hart发送处理器间中断: 写CLINT_MSIP(hart)引发它的M-mode软件中断, 由timer_vector转为S-mode软件中断
+void timer_send_ipi(int hart)
+{
+    *(volatile uint32*)CLINT_MSIP(hart) = 1;
+}
+
+// 返回CLINT mtime (内核页表中映射了CLINT, S-mode可以直接读取)
+uint64 timer_get_mtime()
+{
+    return *(volatile uint64*)CLINT_MTIME;
+}
+
+// 设置本hart的下一次时钟中断 (Sstc: 写stimecmp同时清除STIP; 否则M-mode的时钟中断已经把mtimecmp置为最大值)
+// 已经过去的时刻立即引发中断, 处理时补上错过的tick
+static void timer_program(uint64 when)
+{
+    if (timer_sstc) {
+        w_stimecmp(when);
+    } else {
+        *(volatile uint64*)CLINT_MTIMECMP(r_tp()) = when;
+    }
+}
+
+static uint64 ktimer_next();
+
+void timer_rearm()
+{
+    uint64 when = ktimer_next();
+    timer_program(sys_timer.next < when ? sys_timer.next : when);
+}
+
+void timer_idle(uint64 deadline)
+{
+    if (!timer_tickless) {
+        return;
+    }
+    // 没有期限时只有处理器间中断和外部中断能唤醒
+    uint64 when = (deadline == 0) ? ~0ul : timer_tick_mtime(deadline);
+    uint64 t = ktimer_next();
+    timer_program(t < when ? t : when);
+}
+
+uint64 timer_tick_mtime(uint64 tick)
+{
+    uint64 ticks, when, interval;
+    timer_read(&ticks, &when, &interval);
+    if (tick > ticks + 1) {
+        when += (tick - ticks - 1) * interval;
+    }
+    return when;
+}
+
+uint64 timer_get_ns()
+{
+    return timer_get_mtime() * TIMER_NS_PER_MTIME;
+}
+
+// 先按旧的周期补上经过的tick, 下一个tick从现在开始按新的周期计算
+// 所有hart的下一次中断改到新的边界 (空闲的hart醒来后重新推迟)
+// Sstc时别的hart的stimecmp只能由它自己设置: 本hart立即改, 别的hart在下一次中断时改
+uint64 timer_config(uint64 interval, int tickless)
+{
+    if (tickless >= 0) {
+        timer_tickless = (tickless != 0);
+    }
+    timer_update();
+    timer_write_begin(false);
+    if (interval != 0) {
+        sys_timer.interval = interval;
+        sys_timer.next = timer_get_mtime() + interval;
+        if (timer_sstc) {
+            w_stimecmp(sys_timer.next);
+        } else {
+            for (int i = 0; i < ncpu; i++) {
+                *(volatile uint64*)CLINT_MTIMECMP(i) = sys_timer.next;
+            }
+        }
+    }
+    interval = sys_timer.interval;
+    timer_write_end();
+    return interval;
+}
+
+/*--------------------- 时间轮 (见dev/timer.h) --------------------*/
+
+void ktimer_init(ktimer_t* t, void (*fn)(ktimer_t*), void* arg)
+{
+    t->expire = 0;
+    t->fn = fn;
+    t->arg = arg;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+// 把t放进base之后的槽位 (调用者持有wheel.lk), 到期的刻度不晚于base时放进base所在的第0级槽位
+static void wheel_place(ktimer_t* t, uint64 base)
+{
+    uint64 when = (t->expire + (1ul << TW_SHIFT) - 1) >> TW_SHIFT;
+    if (when < base) {
+        when = base;
+    }
+    uint64 delta = when - base;
+    int level = 0;
+    while (level < TW_LEVELS - 1 && delta >= (1ul << (TW_BITS * (level + 1)))) {
+        level++;
+    }
+    // 超出范围: 先放在最高一级最远的槽位, 轮到时重新放置
+    if (delta >= (1ul << (TW_BITS * TW_LEVELS))) {
+        when = base + (1ul << (TW_BITS * TW_LEVELS)) - 1;
+    }
+    int idx = (when >> (TW_BITS * level)) & TW_MASK;
+    t->next = wheel.slot[level][idx];
+    if (t->next != NULL) {
+        t->next->pprev = &t->next;
+    }
+    wheel.slot[level][idx] = t;
+    t->pprev = &wheel.slot[level][idx];
+    wheel.bitmap[level] |= 1ul << idx;
+}
+
+// 把t从槽位中摘下 (调用者持有wheel.lk)
+static void wheel_unlink(ktimer_t* t)
+{
+    *t->pprev = t->next;
+    if (t->next != NULL) {
+        t->next->pprev = t->pprev;
+    }
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+// 槽位变空时清除位图中的位: 从t所在的链表头 (槽位) 反推出级和下标
+static void wheel_slot_check(ktimer_t** slot)
+{
+    if (*slot != NULL) {
+        return;
+    }
+    uint64 i = slot - &wheel.slot[0][0];
+    wheel.bitmap[i / TW_SIZE] &= ~(1ul << (i % TW_SIZE));
+}
+
+void ktimer_add(ktimer_t* t, uint64 expire)
+{
+    assert(t->pprev == NULL, "ktimer_add: timer already pending");
+    t->expire = expire;
+    spinlock_acquire(&wheel.lk);
+    if (wheel.n == 0) {
+        // 时间轮为空: 直接跳到现在, 不必逐圈推进
+        wheel.clk = timer_get_mtime() >> TW_SHIFT;
+    }
+    wheel_place(t, wheel.clk + 1);
+    wheel.n++;
+    spinlock_release(&wheel.lk);
+}
+
+bool ktimer_del(ktimer_t* t)
+{
+    spinlock_acquire(&wheel.lk);
+    bool pending = (t->pprev != NULL);
+    if (pending) {
+        // 链表头可能是槽位 (t是第一个): 先记下, 摘下之后检查槽位是否变空
+        ktimer_t** head = t->pprev;
+        wheel_unlink(t);
+        if (head >= &wheel.slot[0][0] && head < &wheel.slot[0][0] + TW_LEVELS * TW_SIZE) {
+            wheel_slot_check(head);
+        }
+        wheel.n--;
+    }
+    spinlock_release(&wheel.lk);
+    return pending;
+}
+
+// 第level级下标为idx的槽位中的定时器全部重新放置到base之后 (高一级的槽位轮到了)
+static void wheel_cascade(int level, int idx, uint64 base)
+{
+    ktimer_t* t = wheel.slot[level][idx];
+    wheel.slot[level][idx] = NULL;
+    wheel.bitmap[level] &= ~(1ul << idx);
+    while (t != NULL) {
+        ktimer_t* next = t->next;
+        t->next = NULL;
+        t->pprev = NULL;
+        wheel_place(t, base);
+        t = next;
+    }
+}
+
+// 下一个事件的刻度: 第0级的槽位是其中定时器到期的刻度, 高级的槽位是轮到它重新分散的刻度 (调用者持有wheel.lk)
+// 没有定时器返回最大值; 刻度之间没有事件, 推进时可以直接跳过
+static uint64 wheel_next_clk()
+{
+    uint64 best = ~0ul;
+    for (int level = 0; level < TW_LEVELS; level++) {
+        if (wheel.bitmap[level] == 0) {
+            continue;
+        }
+        // 这一级下一个要处理的槽位 (以这一级的刻度为单位), 从它开始循环找第一个非空的槽位
+        int shift = TW_BITS * level;
+        uint64 cur = (wheel.clk >> shift) + 1;
+        int idx = cur & TW_MASK;
+        uint64 rot = wheel.bitmap[level];
+        if (idx != 0) {
+            rot = (rot >> idx) | (rot << (TW_SIZE - idx));
+        }
+        uint64 when = (cur + __builtin_ctzl(rot)) << shift;
+        if (when < best) {
+            best = when;
+        }
+    }
+    return best;
+}
+
+void ktimer_run()
+{
+    uint64 now = timer_get_mtime() >> TW_SHIFT;
+    if (now <= wheel.clk) {
+        return;
+    }
+    spinlock_acquire(&wheel.lk);
+    for (uint64 c = wheel_next_clk(); c <= now; c = wheel_next_clk()) {
+        wheel.clk = c - 1;
+
+        // 新的一圈: 高一级对应的槽位分散下来 (这一级也转完一圈时再往上一级)
+        if ((c & TW_MASK) == 0) {
+            for (int level = 1; level < TW_LEVELS; level++) {
+                int idx = (c >> (TW_BITS * level)) & TW_MASK;
+                wheel_cascade(level, idx, c);
+                if (idx != 0) {
+                    break;
+                }
+            }
+        }
+
+        // 到期: 第0级槽位中的定时器都在刻度c到期
+        int idx = c & TW_MASK;
+        ktimer_t* t = wheel.slot[0][idx];
+        wheel.slot[0][idx] = NULL;
+        wheel.bitmap[0] &= ~(1ul << idx);
+        while (t != NULL) {
+            ktimer_t* next = t->next;
+            t->next = NULL;
+            t->pprev = NULL;
+            wheel.n--;
+            t->fn(t);
+            t = next;
+        }
+        wheel.clk = c;
+    }
+    // 到now为止没有别的事件 (别的hart可能已经推进到更晚)
+    if (now > wheel.clk) {
+        wheel.clk = now;
+    }
+    spinlock_release(&wheel.lk);
+}
+
+// 最早的事件的mtime (不晚于最早的定时器), 没有定时器返回最大值
+static uint64 ktimer_next()
+{
+    if (wheel.n == 0) {
+        return ~0ul;
+    }
+    spinlock_acquire(&wheel.lk);
+    uint64 c = wheel_next_clk();
+    spinlock_release(&wheel.lk);
+    return (c == ~0ul) ? ~0ul : c << TW_SHIFT;
+}
@@ -2,6 +2,9 @@
 
 #include "memlayout.h"
 #include "lib/lock.h"
+#include "dev/uart.h"
+#include "dev/console.h"
+#include "trap/softirq.h"
 
 // the UART control registers.
 // some have different meanings for
@@ -29,11 +32,37 @@
 #define ReadReg(reg)     (*(Reg(reg)))
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
-extern volatile int panicked; // from printf.c
+// 发送缓冲区 (见dev/uart.h)
+static struct {
+    spinlock_t lk;
+    char buf[UART_TX_BUF];
+    uint64 w;   // 累计放入的字符数
+    uint64 r;   // 累计写入THR的字符数
+} uart_tx;
+
+// 接收缓冲区: 上半部从RHR取出的字符, 由下半部交给控制台
+static struct {
+    spinlock_t lk;
+    char buf[UART_RX_BUF];
+    uint64 w;       // 累计收到的字符数
+    uint64 r;       // 累计交给控制台的字符数
+    uint64 lost;    // 缓冲区满时丢弃的字符数
+    bool draining;  // 有一个hart正在交给控制台 (其他hart的下半部直接返回, 保持字符的顺序)
+} uart_rx;
 
 // uart 初始化
 void uart_init(void)
 {
+  spinlock_init(&uart_tx.lk, "uart_tx");
+  uart_tx.w = 0;
+  uart_tx.r = 0;
+  spinlock_init(&uart_rx.lk, "uart_rx");
+  uart_rx.w = 0;
+  uart_rx.r = 0;
+  uart_rx.lost = 0;
+  uart_rx.draining = false;
+  softirq_register(SOFTIRQ_UART, uart_softirq);
+
   // 关闭中断
   WriteReg(IER, 0x00);
 
@@ -54,13 +83,60 @@ void uart_init(void)
   WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
 }
 
-// 单个字符输出
+// 发送器空时把缓冲区中最多UART_FIFO个字符写入THR (调用者持有uart_tx.lk)
+static void uart_tx_start(void)
+{
+  if (uart_tx.r == uart_tx.w || (ReadReg(LSR) & LSR_TX_IDLE) == 0) {
+    return;
+  }
+  for (int i = 0; i < UART_FIFO && uart_tx.r != uart_tx.w; i++) {
+    WriteReg(THR, uart_tx.buf[uart_tx.r % UART_TX_BUF]);
+    uart_tx.r++;
+  }
+}
+
+// 单个字符缓冲输出
+void uart_putc(int c)
+{
+  spinlock_acquire(&uart_tx.lk);
+
+  // 缓冲区满: 等发送器写出一部分 (不能睡眠)
+  while (uart_tx.w - uart_tx.r == UART_TX_BUF) {
+    uart_tx_start();
+  }
+  uart_tx.buf[uart_tx.w % UART_TX_BUF] = c;
+  uart_tx.w++;
+  uart_tx_start();
+
+  spinlock_release(&uart_tx.lk);
+}
+
+// panic: 写出缓冲区中剩下的字符 (持有锁的hart可能已经停下, 不加锁)
+void uart_flush_sync(void)
+{
+  while (uart_tx.r != uart_tx.w) {
+    uart_putc_sync(uart_tx.buf[uart_tx.r % UART_TX_BUF]);
+    uart_tx.r++;
+  }
+}
+
+// 关机前: 写出缓冲区中剩下的字符, 等最后一个字符离开发送器 (否则关机会截掉末尾的输出)
+void uart_flush(void)
+{
+  spinlock_acquire(&uart_tx.lk);
+  while (uart_tx.r != uart_tx.w) {
+    uart_putc_sync(uart_tx.buf[uart_tx.r % UART_TX_BUF]);
+    uart_tx.r++;
+  }
+  while ((ReadReg(LSR) & LSR_TX_IDLE) == 0);
+  spinlock_release(&uart_tx.lk);
+}
+
+// 单个字符同步输出
 void uart_putc_sync(int c)
 {
   push_off();
 
-  while(panicked);
-
   // 等待TX队列进入idle状态
   while((ReadReg(LSR) & LSR_TX_IDLE) == 0);
   
@@ -81,13 +157,48 @@ int uart_getc_sync(void)
   }
 }
 
-// 中断处理(键盘输入->屏幕输出)
+// 中断上半部: 清除中断, 把接收FIFO中的字符取到接收缓冲区 (FIFO只有16字节, 不能等), 触发SOFTIRQ_UART
 void uart_intr(void)
 {
+  // 读ISR清除发送器空的中断
+  ReadReg(ISR);
+
+  spinlock_acquire(&uart_rx.lk);
   while(1)
   {
     int c = uart_getc_sync();
     if(c == -1) break;
-    uart_putc_sync(c);
+    if(uart_rx.w - uart_rx.r == UART_RX_BUF) {
+      uart_rx.lost++;
+      continue;
+    }
+    uart_rx.buf[uart_rx.w % UART_RX_BUF] = c;
+    uart_rx.w++;
   }
+  spinlock_release(&uart_rx.lk);
+
+  softirq_raise(SOFTIRQ_UART);
+}
+
+// 中断下半部(键盘输入->控制台行规程和回显, 发送器空->继续写出发送缓冲区)
+// 每个字符在锁外交给控制台 (回显要获取uart_tx.lk); 控制台初始化之前字符留在接收缓冲区中
+void uart_softirq(void)
+{
+  spinlock_acquire(&uart_rx.lk);
+  if(!uart_rx.draining && console_ready()) {
+    uart_rx.draining = true;
+    while(uart_rx.r != uart_rx.w) {
+      int c = uart_rx.buf[uart_rx.r % UART_RX_BUF];
+      uart_rx.r++;
+      spinlock_release(&uart_rx.lk);
+      console_intr(c);
+      spinlock_acquire(&uart_rx.lk);
+    }
+    uart_rx.draining = false;
+  }
+  spinlock_release(&uart_rx.lk);
+
+  spinlock_acquire(&uart_tx.lk);
+  uart_tx_start();
+  spinlock_release(&uart_tx.lk);
 }
@@ -5,124 +5,361 @@
     virtio_init() // 初始化函数
     virtio_rw()   // 以block为单位的磁盘读写函数
     virtio_intr() // 磁盘激活的中断处理函数
+    另外提供异步提交接口 virtio_disk_submit() / virtio_disk_wait(): 提交后立即返回,
+    多个请求可以同时在途, 完成时逐个buf清除disk标记并唤醒, 供预读和批量写回使用
+    以及 virtio_disk_rw_multi(), 用一个请求读写磁盘上连续的多个block
+    和 virtio_disk_rw_sg(), 用一个请求读写一段连续扇区, 数据分散在多个内存段(buf或物理页)中
+    设备支持时默认启用间接描述符(一个请求只占环上一个描述符)和event-idx(减少通知和中断)
+    同步请求可以使用轮询模式: 先在used环上自旋有限次数, 超出预算才睡眠等待中断
+    virtio_disk_flush() 发送VIRTIO_BLK_T_FLUSH, 让已完成的写请求真正落盘(设备有写缓存时)
+    每个请求在提交和完成时用rdtime打时间戳, 统计延迟和队列深度直方图, 见virtio_disk_stat()
+    设备支持VIRTIO_BLK_F_MQ时每个hart使用自己的virtqueue(独立的环/锁), 提交不再互相竞争
+    同时支持legacy(version 1, QUEUE_PFN)和modern(version 2, 分别设置desc/avail/used地址)两种mmio接口,
+    队列大小与设备协商
+    多个磁盘: 启动时检查所有virtio-mmio槽位, 找到的块设备按槽位顺序组成一个条带卷(RAID-0),
+    逻辑扇区按VIRTIO_STRIPE_SECTORS一个单元轮流分布在各设备上, 对外的接口都按逻辑扇区/block编址;
+    跨越单元边界的请求拆成每个设备上的子请求, 全部提交之后再依次等待, 各设备的传输同时进行
+    只有一个设备时不拆分, 与单盘完全相同
 */
 
 #include "dev/virtio.h"
+#include "dev/vio.h"
 #include "fs/buf.h"
 #include "lib/lock.h"
 #include "lib/print.h"
 #include "lib/str.h"
+#include "mem/pmem.h"
 #include "mem/vmem.h"
+#include "proc/cpu.h"
 #include "proc/proc.h"
+#include "trap/softirq.h"
 #include "riscv.h"
 #include "memlayout.h"
+#include "lib/tstat.h"
 
-// the address of virtio mmio register r.
-#define R(r) ((volatile uint32 *)(VIRTIO_BASE + (r)))
+// the address of virtio mmio register r of device d.
+#define R(d, r) ((volatile uint32 *)((d)->base + (r)))
 
-static struct disk
+// used->elems[num]之后的avail_event (VIRTIO_RING_F_EVENT_IDX)
+#define VQ_AVAIL_EVENT(vq) (*(volatile uint16 *)&(vq)->used->elems[(vq)->num])
+
+// virtio_blk_config.num_queues (VIRTIO_BLK_F_MQ)
+#define BLK_CFG_NUM_QUEUES(d) ((volatile uint16 *)((d)->base + VIRTIO_MMIO_CONFIG + 34))
+// virtio_blk_config.capacity: 512字节扇区数 (64位, 分两次32位读)
+#define BLK_CFG_CAPACITY(d) ((volatile uint32 *)((d)->base + VIRTIO_MMIO_CONFIG))
+
+typedef struct vdev vdev_t;
+
+struct virtio_blk_outhdr
 {
-    // memory for virtio descriptors &c for queue 0.
-    // this is a global instead of allocated because it must
-    // be multiple contiguous pages, which kalloc()
-    // doesn't support, and page aligned.
-    char pages[2 * PGSIZE];
+    uint32 type;
+    uint32 reserved;
+    uint64 sector;
+};
+
+// 一个virtqueue: 描述符环 + 自己的锁和在途请求记录
+typedef struct vqueue
+{
+    // memory for virtio descriptors &c for this queue.
+    // the legacy interface needs two contiguous, page-aligned pages:
+    // an order-1 block from the buddy allocator (pmem_alloc_order).
+    // modern接口的三部分地址分别设置, 同样使用这两页
+    char *pages;
     struct VRingDesc *desc;
     uint16 *avail;
     struct UsedArea *used;
 
     // our own book-keeping.
+    uint32 num;      // 协商后的队列大小 (2的幂, 不超过NUM)
     char free[NUM];  // is a descriptor free?
-    uint16 used_idx; // we've looked this far in used[2..NUM].
+    uint16 used_idx; // we've looked this far in used[2..num]. (不取模, 与设备的idx一样自由递增)
+    int qid;         // 设备上的队列编号 (QUEUE_SEL / QUEUE_NOTIFY使用)
+    int id;          // 在disk.vq中的下标 (buf的disk_q)
+    vdev_t *dev;     // 所属的设备
 
     // track info about in-flight operations,
     // for use when completion interrupt arrives.
     // indexed by first descriptor index of chain.
     struct
     {
-        buf_t* b;
+        buf_t* b[VIRTIO_MAX_SEG];      // 请求涉及的buf (磁盘上连续), 完成时逐个清除disk标记
+        int nbuf;                      // b[]中的buf数量 (virtio_disk_rw_sg的请求为0)
         char status;
+        bool async;                    // 异步请求: 由中断处理函数回收描述符
+        bool done;                     // 请求已完成, 同步请求睡眠在&info[id]上等待
+        uint32 type;                   // VIRTIO_BLK_T_IN / OUT / FLUSH
+        uint64 start;                  // 提交时刻 (rdtime)
+        struct virtio_blk_outhdr hdr;  // 请求头, 异步请求返回后仍需有效, 不能放在栈上
+        struct VRingDesc indir[VIRTIO_MAX_SG + 2]; // 间接描述符表: 头 + 数据段 + 状态
     } info[NUM];
 
-    struct spinlock vdisk_lock;
+    uint32 inflight; // 在途请求数
+    vio_stat_t stat; // 本队列的统计 (inflight字段不使用)
 
-} __attribute__((aligned(PGSIZE))) disk;
+    spinlock_t lk;
 
-void virtio_disk_init()
+} vqueue_t;
+
+// 一个virtio-mmio块设备
+struct vdev
 {
-    uint32 status = 0;
+    uint64 base;     // mmio寄存器地址
+    int slot;        // virtio-mmio槽位 (中断号 = VIRTIO_IRQ + slot)
+    vqueue_t *vq;    // 本设备的队列: disk.vq[]中连续的nvq个
+    int nvq;         // 实际使用的队列数 (未协商VIRTIO_BLK_F_MQ时为1)
+    bool indirect;   // 已协商VIRTIO_RING_F_INDIRECT_DESC
+    bool event_idx;  // 已协商VIRTIO_RING_F_EVENT_IDX
+    bool flush;      // 已协商VIRTIO_BLK_F_FLUSH (否则设备没有易失写缓存, 写完成即落盘)
+    bool modern;     // version 2 mmio接口
+    uint64 capacity; // 扇区数
+};
 
-    spinlock_init(&disk.vdisk_lock, "virtio_disk");
+static struct disk
+{
+    vqueue_t vq[VIRTIO_NQUEUE]; // 所有设备的队列 (每个设备分到VIRTIO_NQUEUE / ndev个以内)
+    int nvq;                    // 已分配的队列数
+    vdev_t dev[VIRTIO_NSLOT];   // 条带卷的成员, 按槽位顺序
+    int ndev;
+    int slot_dev[VIRTIO_NSLOT]; // 槽位 -> dev[]下标, 没有块设备为-1
+    uint64 capacity;            // 条带卷的扇区数 (成员中最小的容量按单元取整后乘以ndev)
+    bool poll;                  // 设备级轮询模式: 所有同步请求都先轮询
+    uint32 intr_slots;          // 已应答、等待下半部回收的槽位 (第i位: 槽位i, 原子地修改)
+} disk;
+
+// 设备d上当前hart使用的队列
+// 取得编号后可能被调度到其他hart上, 这只影响负载分布, 不影响正确性(每个队列有自己的锁)
+static vqueue_t *virtio_disk_queue(vdev_t *d)
+{
+    return &d->vq[mycpuid() % d->nvq];
+}
 
-    if (*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
-        *R(VIRTIO_MMIO_VERSION) != 1 ||
-        *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
-        *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551)
+/*
+    逻辑扇区sector所在的设备, *dsector是设备上的扇区, *left是到条带单元末尾(含sector)的扇区数
+    只有一个设备时不拆分: *left没有限制
+*/
+static vdev_t *stripe_map(uint64 sector, uint64 *dsector, uint64 *left)
+{
+    assert(sector < disk.capacity, "virtio: sector beyond end of disk");
+    if (disk.ndev == 1)
     {
-        panic("could not find virtio disk");
+        *dsector = sector;
+        *left = disk.capacity - sector;
+        return &disk.dev[0];
+    }
+    uint64 chunk = sector / VIRTIO_STRIPE_SECTORS;
+    uint64 off = sector % VIRTIO_STRIPE_SECTORS;
+    *dsector = (chunk / disk.ndev) * VIRTIO_STRIPE_SECTORS + off;
+    *left = VIRTIO_STRIPE_SECTORS - off;
+    return &disk.dev[chunk % disk.ndev];
+}
+
+// 读取设备提供的feature位 (legacy接口只有低32位)
+static uint64 virtio_read_features(vdev_t *d)
+{
+    *R(d, VIRTIO_MMIO_DEVICE_FEATURES_SEL) = 0;
+    uint64 features = *R(d, VIRTIO_MMIO_DEVICE_FEATURES);
+    if (d->modern)
+    {
+        *R(d, VIRTIO_MMIO_DEVICE_FEATURES_SEL) = 1;
+        features |= (uint64)*R(d, VIRTIO_MMIO_DEVICE_FEATURES) << 32;
+    }
+    return features;
+}
+
+// 写入驱动接受的feature位
+static void virtio_write_features(vdev_t *d, uint64 features)
+{
+    *R(d, VIRTIO_MMIO_DRIVER_FEATURES_SEL) = 0;
+    *R(d, VIRTIO_MMIO_DRIVER_FEATURES) = (uint32)features;
+    if (d->modern)
+    {
+        *R(d, VIRTIO_MMIO_DRIVER_FEATURES_SEL) = 1;
+        *R(d, VIRTIO_MMIO_DRIVER_FEATURES) = (uint32)(features >> 32);
+    }
+}
+
+// 初始化设备d的第q个队列: 协商队列大小, 告诉设备环的位置
+static void virtio_queue_init(vdev_t *d, vqueue_t *vq, int q)
+{
+    spinlock_init(&vq->lk, "virtio_queue");
+    vq->qid = q;
+    vq->id = vq - disk.vq;
+    vq->dev = d;
+
+    *R(d, VIRTIO_MMIO_QUEUE_SEL) = q;
+    if (d->modern && *R(d, VIRTIO_MMIO_QUEUE_READY))
+        panic("virtio disk queue should not be ready");
+
+    // 不超过NUM和设备上限的最大2的幂; 不支持间接描述符时至少要放下一个满载请求
+    uint32 max = *R(d, VIRTIO_MMIO_QUEUE_NUM_MAX);
+    if (max == 0)
+        panic("virtio disk has no queue");
+    uint32 num = NUM;
+    while (num > max)
+        num >>= 1;
+    if (num < (d->indirect ? 1 : VIRTIO_MAX_SG + 2))
+        panic("virtio disk max queue too short");
+    vq->num = num;
+    *R(d, VIRTIO_MMIO_QUEUE_NUM) = num;
+
+    vq->pages = pmem_alloc_order(1);
+    if (vq->pages == NULL)
+        panic("virtio disk: no contiguous pages for queue");
+
+    // desc = pages -- num * VRingDesc
+    // avail = pages + num * 16 -- 2 * uint16, then num * uint16, then used_event
+    // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem, then avail_event
+
+    vq->desc = (struct VRingDesc *)vq->pages;
+    vq->avail = (uint16 *)(((char *)vq->desc) + num * sizeof(struct VRingDesc));
+    vq->used = (struct UsedArea *)(vq->pages + PGSIZE);
+
+    if (d->modern)
+    {
+        *R(d, VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint32)(uint64)vq->desc;
+        *R(d, VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint32)((uint64)vq->desc >> 32);
+        *R(d, VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint32)(uint64)vq->avail;
+        *R(d, VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint32)((uint64)vq->avail >> 32);
+        *R(d, VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint32)(uint64)vq->used;
+        *R(d, VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint32)((uint64)vq->used >> 32);
+        *R(d, VIRTIO_MMIO_QUEUE_READY) = 1;
+    }
+    else
+    {
+        // legacy: used环按PGSIZE对齐, 正好是第二页
+        *R(d, VIRTIO_MMIO_QUEUE_ALIGN) = PGSIZE;
+        *R(d, VIRTIO_MMIO_QUEUE_PFN) = ((uint64)vq->pages) >> 12;
     }
 
+    for (int i = 0; i < num; i++)
+        vq->free[i] = 1;
+}
+
+// 槽位base上是否是一个virtio块设备 (没有接设备的槽位DEVICE_ID为0)
+static bool virtio_probe(uint64 base)
+{
+    volatile uint32 *r = (volatile uint32 *)base;
+    uint32 version = r[VIRTIO_MMIO_VERSION / 4];
+
+    return r[VIRTIO_MMIO_MAGIC_VALUE / 4] == 0x74726976 &&
+           (version == 1 || version == 2) &&
+           r[VIRTIO_MMIO_DEVICE_ID / 4] == 2 &&
+           r[VIRTIO_MMIO_VENDOR_ID / 4] == 0x554d4551;
+}
+
+// 初始化一个设备, 从disk.vq中分配最多maxq个队列
+static void virtio_dev_init(vdev_t *d, int maxq)
+{
+    uint32 status = 0;
+
+    d->modern = (*R(d, VIRTIO_MMIO_VERSION) == 2);
+
+    // reset device
+    *R(d, VIRTIO_MMIO_STATUS) = status;
+
     status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
-    *R(VIRTIO_MMIO_STATUS) = status;
+    *R(d, VIRTIO_MMIO_STATUS) = status;
 
     status |= VIRTIO_CONFIG_S_DRIVER;
-    *R(VIRTIO_MMIO_STATUS) = status;
+    *R(d, VIRTIO_MMIO_STATUS) = status;
 
     // negotiate features
-    uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
-    features &= ~(1 << VIRTIO_BLK_F_RO);
-    features &= ~(1 << VIRTIO_BLK_F_SCSI);
-    features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
-    features &= ~(1 << VIRTIO_BLK_F_MQ);
-    features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-    features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-    features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
-    *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+    uint64 features = virtio_read_features(d);
+    features &= ~(1ull << VIRTIO_BLK_F_RO);
+    features &= ~(1ull << VIRTIO_BLK_F_SCSI);
+    features &= ~(1ull << VIRTIO_BLK_F_CONFIG_WCE);
+    features &= ~(1ull << VIRTIO_F_ANY_LAYOUT);
+    if (d->modern && !(features & (1ull << VIRTIO_F_VERSION_1)))
+        panic("virtio disk: modern device without VIRTIO_F_VERSION_1");
+    // 间接描述符、event-idx、多队列和flush在设备提供时保留
+    d->indirect = (features & (1ull << VIRTIO_RING_F_INDIRECT_DESC)) != 0;
+    d->event_idx = (features & (1ull << VIRTIO_RING_F_EVENT_IDX)) != 0;
+    d->flush = (features & (1ull << VIRTIO_BLK_F_FLUSH)) != 0;
+    d->nvq = 1;
+    if (features & (1ull << VIRTIO_BLK_F_MQ))
+    {
+        int n = *BLK_CFG_NUM_QUEUES(d);
+        if (n > ncpu)
+            n = ncpu;
+        if (n > maxq)
+            n = maxq;
+        d->nvq = (n < 1) ? 1 : n;
+    }
+    virtio_write_features(d, features);
 
     // tell device that feature negotiation is complete.
     status |= VIRTIO_CONFIG_S_FEATURES_OK;
-    *R(VIRTIO_MMIO_STATUS) = status;
+    *R(d, VIRTIO_MMIO_STATUS) = status;
 
-    // tell device we're completely ready.
-    status |= VIRTIO_CONFIG_S_DRIVER_OK;
-    *R(VIRTIO_MMIO_STATUS) = status;
+    // re-read status to ensure FEATURES_OK is set.
+    if (d->modern && !(*R(d, VIRTIO_MMIO_STATUS) & VIRTIO_CONFIG_S_FEATURES_OK))
+        panic("virtio disk FEATURES_OK unset");
 
-    *R(VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
+    if (!d->modern)
+        *R(d, VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
 
-    // initialize queue 0.
-    *R(VIRTIO_MMIO_QUEUE_SEL) = 0;
-    uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
-    if (max == 0)
-        panic("virtio disk has no queue 0");
-    if (max < NUM)
-        panic("virtio disk max queue too short");
-    *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+    d->capacity = BLK_CFG_CAPACITY(d)[0] | (uint64)BLK_CFG_CAPACITY(d)[1] << 32;
 
-    memset(disk.pages, 0, sizeof(disk.pages));
-    *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> 12;
+    // initialize queues 0..nvq-1.
+    d->vq = &disk.vq[disk.nvq];
+    disk.nvq += d->nvq;
+    for (int q = 0; q < d->nvq; q++)
+        virtio_queue_init(d, &d->vq[q], q);
 
-    // desc = pages -- num * VRingDesc
-    // avail = pages + 0x40 -- 2 * uint16, then num * uint16
-    // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
+    // tell device we're completely ready.
+    status |= VIRTIO_CONFIG_S_DRIVER_OK;
+    *R(d, VIRTIO_MMIO_STATUS) = status;
+}
 
-    disk.desc = (struct VRingDesc *)disk.pages;
-    disk.avail = (uint16 *)(((char *)disk.desc) + NUM * sizeof(struct VRingDesc));
-    disk.used = (struct UsedArea *)(disk.pages + PGSIZE);
+// 找到所有槽位上的块设备, 组成条带卷
+// plic.c and trap.c arrange for interrupts from VIRTIO_IRQ + slot.
+void virtio_disk_init()
+{
+    disk.ndev = 0;
+    for (int slot = 0; slot < VIRTIO_NSLOT; slot++)
+    {
+        disk.slot_dev[slot] = -1;
+        if (virtio_probe(VIRTIO_BASE + slot * VIRTIO_STRIDE))
+        {
+            disk.slot_dev[slot] = disk.ndev;
+            disk.dev[disk.ndev].base = VIRTIO_BASE + slot * VIRTIO_STRIDE;
+            disk.dev[disk.ndev].slot = slot;
+            disk.ndev++;
+        }
+    }
+    if (disk.ndev == 0)
+        panic("could not find virtio disk");
+    softirq_register(SOFTIRQ_DISK, virtio_disk_softirq);
 
-    for (int i = 0; i < NUM; i++)
-        disk.free[i] = 1;
+    // 队列平均分给各设备, 每个设备至少一个
+    assert(disk.ndev <= VIRTIO_NQUEUE, "virtio_disk_init: more disks than queues");
+    disk.nvq = 0;
+    uint64 min_cap = ~0ull;
+    for (int i = 0; i < disk.ndev; i++)
+    {
+        virtio_dev_init(&disk.dev[i], VIRTIO_NQUEUE / disk.ndev);
+        if (disk.dev[i].capacity < min_cap)
+            min_cap = disk.dev[i].capacity;
+    }
 
-    // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
+    // 多个设备时每个成员只使用整数个条带单元 (成员大小不同时以最小的为准)
+    if (disk.ndev == 1)
+        disk.capacity = min_cap;
+    else
+        disk.capacity = min_cap / VIRTIO_STRIPE_SECTORS * VIRTIO_STRIPE_SECTORS * disk.ndev;
+    if (disk.ndev > 1)
+        printf("virtio: %d disks striped, %d KB each, %d KB in total\n",
+               disk.ndev, (int)(min_cap / 2), (int)(disk.capacity / 2));
 }
 
 // find a free descriptor, mark it non-free, return its index.
-static int alloc_desc()
+static int alloc_desc(vqueue_t *vq)
 {
-    for (int i = 0; i < NUM; i++)
+    for (int i = 0; i < vq->num; i++)
     {
-        if (disk.free[i])
+        if (vq->free[i])
         {
-            disk.free[i] = 0;
+            vq->free[i] = 0;
             return i;
         }
     }
@@ -131,154 +368,600 @@ static int alloc_desc()
 
 // mark a descriptor as free.
 static void
-free_desc(int i)
+free_desc(vqueue_t *vq, int i)
 {
-    if (i >= NUM)
+    if (i >= vq->num)
         panic("virtio_disk_intr 1");
-    if (disk.free[i])
+    if (vq->free[i])
         panic("virtio_disk_intr 2");
-    disk.desc[i].addr = 0;
-    disk.free[i] = 1;
-    proc_wakeup(&disk.free[0]);
+    vq->desc[i].addr = 0;
+    vq->free[i] = 1;
+    proc_wakeup(&vq->free[0]);
 }
 
 // free a chain of descriptors.
 static void
-free_chain(int i)
+free_chain(vqueue_t *vq, int i)
 {
     while (1)
     {
-        free_desc(i);
-        if (disk.desc[i].flags & VRING_DESC_F_NEXT)
-            i = disk.desc[i].next;
+        free_desc(vq, i);
+        if (vq->desc[i].flags & VRING_DESC_F_NEXT)
+            i = vq->desc[i].next;
         else
             break;
     }
 }
 
+// allocate n descriptors (not necessarily contiguous).
 static int
-alloc3_desc(int *idx)
+alloc_descs(vqueue_t *vq, int *idx, int n)
 {
-    for (int i = 0; i < 3; i++)
+    for (int i = 0; i < n; i++)
     {
-        idx[i] = alloc_desc();
+        idx[i] = alloc_desc(vq);
         if (idx[i] < 0)
         {
             for (int j = 0; j < i; j++)
-                free_desc(idx[j]);
+                free_desc(vq, idx[j]);
             return -1;
         }
     }
     return 0;
 }
 
-void virtio_disk_rw(buf_t *b, bool write)
+// allocate the descriptors of a request with nseg data segments:
+// one for type/reserved/sector, one per data segment, one for a
+// 1-byte status result. 使用间接描述符时这些描述符放在info[].indir中,
+// 环上只需要一个描述符.
+// caller holds vq->lk. wait = false: 描述符不足时直接返回-1; wait = true: 睡眠等待
+static int
+virtio_disk_alloc(vqueue_t *vq, int *idx, int nseg, bool wait)
 {
-    uint64 sector = b->block_num * (BLOCK_SIZE / 512);
+    int n = vq->dev->indirect ? 1 : nseg + 2;
 
-    spinlock_acquire(&disk.vdisk_lock);
-
-    // the spec says that legacy block operations use three
-    // descriptors: one for type/reserved/sector, one for
-    // the data, one for a 1-byte status result.
-
-    // allocate the three descriptors.
-    int idx[3];
-    while (1)
+    while (alloc_descs(vq, idx, n) != 0)
     {
-        if (alloc3_desc(idx) == 0)
-        {
-            break;
-        }
-        proc_sleep(&disk.free[0], &disk.vdisk_lock);
+        if (!wait)
+            return -1;
+        proc_sleep(&vq->free[0], &vq->lk);
     }
+    return 0;
+}
 
-    // format the three descriptors.
-    // qemu's virtio-blk.c reads them.
+// fill in the descriptors of a request and notify the device.
+// a request is one header descriptor, nseg data descriptors (seg[] are
+// read/written in order starting at sector) and one status descriptor.
+// type is VIRTIO_BLK_T_IN / OUT / FLUSH (a flush has no data segment).
+// caller holds vq->lk, has allocated idx[0..nseg+1] and has filled
+// in info[idx[0]].b / nbuf / async.
+static void
+virtio_disk_start(vqueue_t *vq, uint32 type, uint64 sector, virtio_seg_t *seg, int nseg, int *idx)
+{
+    bool write = (type == VIRTIO_BLK_T_OUT);
 
-    struct virtio_blk_outhdr
+    // format the descriptors.
+    // qemu's virtio-blk.c reads them.
+    struct virtio_blk_outhdr *buf0 = &vq->info[idx[0]].hdr;
+
+    buf0->type = type;
+    buf0->reserved = 0;
+    buf0->sector = sector;
+
+    // 间接模式: 描述符链写在info[].indir中, 下标是表内下标0..nseg+1
+    struct VRingDesc *desc = vq->desc;
+    int chain[VIRTIO_MAX_SG + 2];
+    for (int i = 0; i < nseg + 2; i++)
+        chain[i] = vq->dev->indirect ? i : idx[i];
+    if (vq->dev->indirect)
+        desc = vq->info[idx[0]].indir;
+
+    // disk is a kernel global, which is direct mapped.
+    desc[chain[0]].addr = (uint64)buf0;
+    desc[chain[0]].len = sizeof(*buf0);
+    desc[chain[0]].flags = VRING_DESC_F_NEXT;
+    desc[chain[0]].next = chain[1];
+
+    for (int i = 0; i < nseg; i++)
     {
-        uint32 type;
-        uint32 reserved;
-        uint64 sector;
-    } buf0;
-
-    if (write)
-        buf0.type = VIRTIO_BLK_T_OUT; // write the disk
-    else
-        buf0.type = VIRTIO_BLK_T_IN; // read the disk
-    buf0.reserved = 0;
-    buf0.sector = sector;
-
-    // buf0 is on a kernel stack, which is not direct mapped,
-    // thus the call to kvmpa().
-    uint64 addr = PG_ROUND_DOWN((uint64)&buf0);
-    uint64 off  = ((uint64)&buf0) % PGSIZE;
-
-    pte_t* pte = vm_getpte(NULL, addr, false);
-    disk.desc[idx[0]].addr = (uint64)PTE_TO_PA(*pte) + off;
-    disk.desc[idx[0]].len = sizeof(buf0);
-    disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-    disk.desc[idx[0]].next = idx[1];
-
-    disk.desc[idx[1]].addr = (uint64)b->data;
-    disk.desc[idx[1]].len = BLOCK_SIZE;
-    if (write)
-        disk.desc[idx[1]].flags = 0; // device reads b->data
-    else
-        disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-    disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-    disk.desc[idx[1]].next = idx[2];
+        int d = chain[1 + i];
+        desc[d].addr = seg[i].addr;
+        desc[d].len = seg[i].len;
+        if (write)
+            desc[d].flags = 0; // device reads the segment
+        else
+            desc[d].flags = VRING_DESC_F_WRITE; // device writes the segment
+        desc[d].flags |= VRING_DESC_F_NEXT;
+        desc[d].next = chain[2 + i];
+    }
 
-    disk.info[idx[0]].status = 0;
-    disk.desc[idx[2]].addr = (uint64)&disk.info[idx[0]].status;
-    disk.desc[idx[2]].len = 1;
-    disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-    disk.desc[idx[2]].next = 0;
+    int st = chain[nseg + 1];
+    vq->info[idx[0]].status = 0;
+    vq->info[idx[0]].done = false;
+    vq->info[idx[0]].type = type;
+    desc[st].addr = (uint64)&vq->info[idx[0]].status;
+    desc[st].len = 1;
+    desc[st].flags = VRING_DESC_F_WRITE; // device writes the status
+    desc[st].next = 0;
 
-    // record   for virtio_disk_intr().
-    b->disk = true;
-    disk.info[idx[0]].b = b;
+    if (vq->dev->indirect)
+    {
+        vq->desc[idx[0]].addr = (uint64)vq->info[idx[0]].indir;
+        vq->desc[idx[0]].len = (nseg + 2) * sizeof(struct VRingDesc);
+        vq->desc[idx[0]].flags = VRING_DESC_F_INDIRECT;
+        vq->desc[idx[0]].next = 0;
+    }
 
     // avail[0] is flags
     // avail[1] tells the device how far to look in avail[2...].
     // avail[2...] are desc[] indices the device should process.
     // we only tell device the first index in our chain of descriptors.
-    disk.avail[2 + (disk.avail[1] % NUM)] = idx[0];
+    // 统计: 提交时的队列深度, 记录提交时刻
+    uint32 depth = vq->inflight < VIO_DEPTH_BUCKETS ? vq->inflight : VIO_DEPTH_BUCKETS - 1;
+    vq->stat.depth_hist[depth]++;
+    vq->inflight++;
+    if (vq->inflight > vq->stat.depth_max)
+        vq->stat.depth_max = vq->inflight;
+    vq->info[idx[0]].start = r_time();
+    if (type != VIRTIO_BLK_T_FLUSH)
+    {
+        uint32 bytes = 0;
+        for (int i = 0; i < nseg; i++)
+            bytes += seg[i].len;
+        PROC_IO_ADD(disk_reqs, 1);
+        if (write)
+            PROC_IO_ADD(write_blocks, bytes / BLOCK_SIZE);
+        else
+            PROC_IO_ADD(read_blocks, bytes / BLOCK_SIZE);
+    }
+
+    uint16 old_idx = vq->avail[1];
+    vq->avail[2 + (old_idx % vq->num)] = idx[0];
+    __sync_synchronize();
+    vq->avail[1] = old_idx + 1;
     __sync_synchronize();
-    disk.avail[1] = disk.avail[1] + 1;
 
-    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+    // event-idx: 设备还在处理之前的请求时(avail_event没有被越过)不需要通知
+    if (!vq->dev->event_idx || VRING_NEED_EVENT(VQ_AVAIL_EVENT(vq), (uint16)(old_idx + 1), old_idx))
+        *R(vq->dev, VIRTIO_MMIO_QUEUE_NOTIFY) = vq->qid; // value is queue number
+}
+
+// 把n个buf(磁盘上连续)转换为数据段, 记录到info中后启动请求
+// sector是bv[0]在vq所属设备上的扇区
+static void
+virtio_disk_start_bufs(vqueue_t *vq, uint64 sector, buf_t **bv, int n, bool write, int *idx, bool async)
+{
+    virtio_seg_t seg[VIRTIO_MAX_SEG];
+
+    for (int i = 0; i < n; i++)
+    {
+        seg[i].addr = (uint64)bv[i]->data;
+        seg[i].len = BLOCK_SIZE;
+
+        // record   for virtio_disk_intr().
+        bv[i]->disk = true;
+        bv[i]->disk_q = vq->id;
+        vq->info[idx[0]].b[i] = bv[i];
+    }
+    vq->info[idx[0]].nbuf = n;
+    vq->info[idx[0]].async = async;
+
+    uint32 type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    virtio_disk_start(vq, type, sector, seg, n, idx);
+}
+
+static void virtio_disk_reap(vqueue_t *vq);
+
+// 等待同步请求完成并回收描述符, 调用者持有vq->lk
+// poll = true: 先自旋检查used环(最多VIRTIO_POLL_BUDGET次), 省去中断和睡眠/唤醒的开销
+static void
+virtio_disk_finish(vqueue_t *vq, int id, bool poll)
+{
+    for (int spin = 0; poll && !vq->info[id].done && spin < VIRTIO_POLL_BUDGET; spin++)
+    {
+        virtio_disk_reap(vq);
+    }
 
     // Wait for virtio_disk_intr() to say request has finished.
-    while (b->disk == true)
+    while (!vq->info[id].done)
+    {
+        proc_sleep(&vq->info[id], &vq->lk);
+    }
+
+    for (int i = 0; i < vq->info[id].nbuf; i++)
+        vq->info[id].b[i] = 0;
+    vq->info[id].nbuf = 0;
+    free_chain(vq, id);
+}
+
+// 检查bv[]是数量合法且block_num连续的buf列表
+static void
+virtio_disk_check_bufs(buf_t **bv, int n, char *who)
+{
+    assert(n >= 1 && n <= VIRTIO_MAX_SEG, who);
+    for (int i = 1; i < n; i++)
+        assert(bv[i]->block_num == bv[0]->block_num + i, who);
+}
+
+// 条带卷上一个同步请求拆出的子请求: 所在队列和描述符链的头
+typedef struct
+{
+    vqueue_t *vq;
+    int id;
+} vpiece_t;
+
+#define VIRTIO_MAX_PIECES 8 // 一次最多同时在途的子请求数, 超出时先等待已提交的
+
+// 依次等待已提交的子请求完成
+static void
+stripe_finish(vpiece_t *piece, int *np, bool poll)
+{
+    for (int i = 0; i < *np; i++)
+    {
+        spinlock_acquire(&piece[i].vq->lk);
+        virtio_disk_finish(piece[i].vq, piece[i].id, poll);
+        spinlock_release(&piece[i].vq->lk);
+    }
+    *np = 0;
+}
+
+// 为下一个子请求分配描述符, 返回时持有vq->lk
+// 需要睡眠等待描述符时先等待自己已提交的子请求, 不在持有描述符时睡眠, 避免与其他进程互相等待
+static void
+stripe_alloc(vqueue_t *vq, int *idx, int nseg, vpiece_t *piece, int *np, bool poll)
+{
+    if (*np == VIRTIO_MAX_PIECES)
+        stripe_finish(piece, np, poll);
+    spinlock_acquire(&vq->lk);
+    if (*np > 0 && virtio_disk_alloc(vq, idx, nseg, false) == 0)
+        return;
+    if (*np > 0)
+    {
+        spinlock_release(&vq->lk);
+        stripe_finish(piece, np, poll);
+        spinlock_acquire(&vq->lk);
+    }
+    virtio_disk_alloc(vq, idx, nseg, true);
+}
+
+// 同步读写磁盘上连续的n个block, poll指定是否轮询等待完成
+// 按条带单元拆成子请求, 全部提交后再等待
+static void
+virtio_disk_rw_bufs(buf_t **bv, int n, bool write, bool poll)
+{
+    int idx[VIRTIO_MAX_SEG + 2];
+    vpiece_t piece[VIRTIO_MAX_PIECES];
+    int np = 0;
+
+    virtio_disk_check_bufs(bv, n, "virtio_disk_rw_multi: bad buf list");
+
+    for (int i = 0; i < n;)
+    {
+        uint64 dsector, left;
+        vdev_t *d = stripe_map(bv[i]->block_num * (BLOCK_SIZE / 512), &dsector, &left);
+        int cnt = left / (BLOCK_SIZE / 512);
+        if (cnt > n - i)
+            cnt = n - i;
+
+        vqueue_t *vq = virtio_disk_queue(d);
+        stripe_alloc(vq, idx, cnt, piece, &np, poll);
+        virtio_disk_start_bufs(vq, dsector, bv + i, cnt, write, idx, false);
+        spinlock_release(&vq->lk);
+        piece[np].vq = vq;
+        piece[np].id = idx[0];
+        np++;
+        i += cnt;
+    }
+    stripe_finish(piece, &np, poll);
+}
+
+// 用一个请求同步读写磁盘上连续的n个block (bv[i]->block_num == bv[0]->block_num + i)
+void virtio_disk_rw_multi(buf_t **bv, int n, bool write)
+{
+    virtio_disk_rw_bufs(bv, n, write, disk.poll);
+}
+
+// 同步读写一个block并轮询等待完成(与设备级设置无关), 用于延迟敏感的小请求
+void virtio_disk_rw_poll(buf_t *b, bool write)
+{
+    virtio_disk_rw_bufs(&b, 1, write, true);
+}
+
+// 设置设备级轮询模式
+void virtio_disk_set_poll(bool enable)
+{
+    disk.poll = enable;
+}
+
+void virtio_disk_rw(buf_t *b, bool write)
+{
+    TSTAT_BEGIN(t);
+    virtio_disk_rw_multi(&b, 1, write);
+    TSTAT_END(t, TSTAT_DISK_RW);
+}
+
+// 用一个请求同步读写从sector开始的一段连续扇区, 数据依次分布在seg[0..nseg-1]中
+// seg[i].addr是直接映射的内核地址(buf的data或pmem_alloc得到的物理页), len是512的倍数
+// 例如16个物理页组成的64KB读入只需要一次通知和一次中断
+// 条带卷上按单元边界拆成每个设备上的子请求(一个数据段也可能被拆开)
+void virtio_disk_rw_sg(uint64 sector, virtio_seg_t *seg, int nseg, bool write)
+{
+    int idx[VIRTIO_MAX_SG + 2];
+    virtio_seg_t sub[VIRTIO_MAX_SG];
+    vpiece_t piece[VIRTIO_MAX_PIECES];
+    int np = 0;
+
+    assert(nseg >= 1 && nseg <= VIRTIO_MAX_SG, "virtio_disk_rw_sg: bad segment count");
+    for (int i = 0; i < nseg; i++)
+        assert(seg[i].len > 0 && seg[i].len % 512 == 0, "virtio_disk_rw_sg: segment length not a multiple of 512");
+
+    int i = 0;       // 当前数据段
+    uint32 done = 0; // seg[i]中已经分配给之前子请求的字节数
+    while (i < nseg)
+    {
+        uint64 dsector, left;
+        vdev_t *d = stripe_map(sector, &dsector, &left);
+
+        // 从seg[i] + done开始取不超过left个扇区
+        int nsub = 0;
+        uint64 sectors = 0;
+        while (i < nseg && left > 0)
+        {
+            uint32 len = seg[i].len - done;
+            if (len / 512 > left)
+                len = left * 512;
+            sub[nsub].addr = seg[i].addr + done;
+            sub[nsub].len = len;
+            nsub++;
+            sectors += len / 512;
+            left -= len / 512;
+            done += len;
+            if (done == seg[i].len)
+            {
+                i++;
+                done = 0;
+            }
+        }
+
+        vqueue_t *vq = virtio_disk_queue(d);
+        stripe_alloc(vq, idx, nsub, piece, &np, disk.poll);
+        vq->info[idx[0]].nbuf = 0;
+        vq->info[idx[0]].async = false;
+        virtio_disk_start(vq, write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, dsector, sub, nsub, idx);
+        spinlock_release(&vq->lk);
+        piece[np].vq = vq;
+        piece[np].id = idx[0];
+        np++;
+        sector += sectors;
+    }
+    stripe_finish(piece, &np, disk.poll);
+}
+
+// 同步发送一个flush请求, 返回时之前已完成的写请求都已写入持久存储
+// 在途的写请求不保证被覆盖, 调用者需先等待自己关心的写请求完成
+// 没有提供VIRTIO_BLK_F_FLUSH的设备写完成即落盘, 不需要flush; 其余设备同时flush
+void virtio_disk_flush()
+{
+    int idx[2];
+    vpiece_t piece[VIRTIO_MAX_PIECES];
+    int np = 0;
+
+    for (int i = 0; i < disk.ndev; i++)
     {
-        proc_sleep(b, &disk.vdisk_lock);
+        if (!disk.dev[i].flush)
+            continue;
+        vqueue_t *vq = virtio_disk_queue(&disk.dev[i]);
+        stripe_alloc(vq, idx, 0, piece, &np, disk.poll);
+        vq->info[idx[0]].nbuf = 0;
+        vq->info[idx[0]].async = false;
+        virtio_disk_start(vq, VIRTIO_BLK_T_FLUSH, 0, NULL, 0, idx);
+        spinlock_release(&vq->lk);
+        piece[np].vq = vq;
+        piece[np].id = idx[0];
+        np++;
     }
+    stripe_finish(piece, &np, disk.poll);
+}
+
+// 异步提交一个读写请求(磁盘上连续的n个block), 请求进入可用环后立即返回, 不等待完成
+// wait_desc = false: 没有空闲描述符时不睡眠, 直接返回false (由调用者决定放弃还是改用同步读写)
+// wait_desc = true : 睡眠等待其他请求完成释放描述符, 总是返回true
+// 请求完成后中断处理函数清除每个bv[i]->disk并唤醒在bv[i]上等待的进程
+// 条带卷上按单元拆成多个异步请求; 第一个提交之后不再放弃, 后面的总是等待描述符
+// (异步请求的描述符由中断处理函数回收, 等待不会死锁)
+bool virtio_disk_submit(buf_t **bv, int n, bool write, bool wait_desc)
+{
+    int idx[VIRTIO_MAX_SEG + 2];
 
-    disk.info[idx[0]].b = 0;
-    free_chain(idx[0]);
+    virtio_disk_check_bufs(bv, n, "virtio_disk_submit: bad buf list");
 
-    spinlock_release(&disk.vdisk_lock);
+    for (int i = 0; i < n;)
+    {
+        uint64 dsector, left;
+        vdev_t *d = stripe_map(bv[i]->block_num * (BLOCK_SIZE / 512), &dsector, &left);
+        int cnt = left / (BLOCK_SIZE / 512);
+        if (cnt > n - i)
+            cnt = n - i;
+
+        vqueue_t *vq = virtio_disk_queue(d);
+        spinlock_acquire(&vq->lk);
+        if (virtio_disk_alloc(vq, idx, cnt, wait_desc || i > 0) != 0)
+        {
+            spinlock_release(&vq->lk);
+            return false;
+        }
+        virtio_disk_start_bufs(vq, dsector, bv + i, cnt, write, idx, true);
+        spinlock_release(&vq->lk);
+        i += cnt;
+    }
+    return true;
 }
 
-void virtio_disk_intr()
+// 等待b上的异步请求完成 (b->disk == false)
+// 调用者持有b的睡眠锁, 请求在途期间没有人能重新提交b, 因此disk_q(disk.vq[]的下标)是稳定的
+void virtio_disk_wait(buf_t *b)
 {
-    spinlock_acquire(&disk.vdisk_lock);
+    vqueue_t *vq = &disk.vq[b->disk_q];
 
-    while ((disk.used_idx % NUM) != (disk.used->id % NUM))
+    spinlock_acquire(&vq->lk);
+    while (b->disk == true)
     {
-        int id = disk.used->elems[disk.used_idx].id;
+        proc_sleep(b, &vq->lk);
+    }
+    spinlock_release(&vq->lk);
+}
+
+// 返回x的以2为底的对数(向下取整), 超出直方图范围的放入最后一个桶
+static int log2_bucket(uint64 x)
+{
+    int b = 0;
+    while (x > 1 && b < VIO_HIST_BUCKETS - 1)
+    {
+        x >>= 1;
+        b++;
+    }
+    return b;
+}
+
+// 请求完成时更新统计, 调用者持有vq->lk
+static void virtio_disk_account(vqueue_t *vq, int id)
+{
+    uint64 lat = r_time() - vq->info[id].start;
+
+    vq->inflight--;
+    switch (vq->info[id].type)
+    {
+    case VIRTIO_BLK_T_IN:
+        vq->stat.reads++;
+        vq->stat.read_time += lat;
+        vq->stat.read_hist[log2_bucket(lat)]++;
+        break;
+    case VIRTIO_BLK_T_OUT:
+        vq->stat.writes++;
+        vq->stat.write_time += lat;
+        vq->stat.write_hist[log2_bucket(lat)]++;
+        break;
+    default:
+        vq->stat.flushes++;
+        break;
+    }
+}
+
+// 处理vq的used环上所有已完成的请求, 调用者持有vq->lk
+// 由中断处理函数和轮询等待的提交者调用
+static void
+virtio_disk_reap(vqueue_t *vq)
+{
+    // event-idx: 处理完后把used_event设为下一个要看的位置, 再检查一次,
+    // 防止设备在我们设置used_event之前完成的请求不再产生中断
+    while (1)
+    {
+        __sync_synchronize();
+        if (vq->used_idx == vq->used->id)
+        {
+            if (!vq->dev->event_idx)
+                break;
+            vq->avail[2 + vq->num] = vq->used_idx; // used_event
+            __sync_synchronize();
+            if (vq->used_idx == vq->used->id)
+                break;
+            continue;
+        }
 
-        if (disk.info[id].status != 0)
+        int id = vq->used->elems[vq->used_idx % vq->num].id;
+
+        if (vq->info[id].status != 0)
             panic("virtio_disk_intr status");
 
-        disk.info[id].b->disk = false; // disk is done with buf
-        proc_wakeup(disk.info[id].b);
+        virtio_disk_account(vq, id);
+
+        // disk is done with the bufs.
+        // 逐个唤醒: 异步请求的每个buf可能有不同的进程在等待
+        for (int i = 0; i < vq->info[id].nbuf; i++)
+        {
+            vq->info[id].b[i]->disk = false;
+            proc_wakeup(vq->info[id].b[i]);
+        }
 
-        disk.used_idx = (disk.used_idx + 1) % NUM;
+        if (vq->info[id].async)
+        {
+            // nobody is waiting to free an async request's descriptors.
+            for (int i = 0; i < vq->info[id].nbuf; i++)
+                vq->info[id].b[i] = 0;
+            vq->info[id].nbuf = 0;
+            vq->info[id].async = false;
+            free_chain(vq, id);
+        }
+        else
+        {
+            vq->info[id].done = true;
+            proc_wakeup(&vq->info[id]);
+        }
+
+        vq->used_idx = vq->used_idx + 1;
     }
-    *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+}
 
-    spinlock_release(&disk.vdisk_lock);
+// 汇总各队列的请求统计到st
+void virtio_disk_stat(vio_stat_t *st)
+{
+    memset(st, 0, sizeof(*st));
+    for (int q = 0; q < disk.nvq; q++)
+    {
+        vqueue_t *vq = &disk.vq[q];
+
+        spinlock_acquire(&vq->lk);
+        st->reads += vq->stat.reads;
+        st->writes += vq->stat.writes;
+        st->flushes += vq->stat.flushes;
+        st->read_time += vq->stat.read_time;
+        st->write_time += vq->stat.write_time;
+        for (int i = 0; i < VIO_HIST_BUCKETS; i++)
+        {
+            st->read_hist[i] += vq->stat.read_hist[i];
+            st->write_hist[i] += vq->stat.write_hist[i];
+        }
+        for (int i = 0; i < VIO_DEPTH_BUCKETS; i++)
+            st->depth_hist[i] += vq->stat.depth_hist[i];
+        if (vq->stat.depth_max > st->depth_max)
+            st->depth_max = vq->stat.depth_max;
+        st->inflight += vq->inflight;
+        spinlock_release(&vq->lk);
+    }
+}
+
+// 一个设备的各队列共用一个中断(VIRTIO_IRQ + slot)
+// 上半部只应答并记下槽位, 回收和唤醒在下半部 (virtio_disk_softirq) 开中断进行;
+// 应答之后完成的请求会重新触发中断, 不会丢失
+void virtio_disk_intr(int slot)
+{
+    assert(slot >= 0 && slot < VIRTIO_NSLOT && disk.slot_dev[slot] >= 0, "virtio_disk_intr: no disk in slot");
+    vdev_t *d = &disk.dev[disk.slot_dev[slot]];
+
+    *R(d, VIRTIO_MMIO_INTERRUPT_ACK) = *R(d, VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+
+    __sync_fetch_and_or(&disk.intr_slots, 1u << slot);
+    softirq_raise(SOFTIRQ_DISK);
+}
+
+// 下半部: 取走所有已应答的槽位, 逐个队列回收完成的请求
+// 下半部执行之前到达的多次中断 (可能来自不同的hart) 合并为一次回收
+void virtio_disk_softirq()
+{
+    uint32 slots = __sync_fetch_and_and(&disk.intr_slots, 0);
+    for (int slot = 0; slot < VIRTIO_NSLOT; slot++)
+    {
+        if ((slots & (1u << slot)) == 0)
+            continue;
+        vdev_t *d = &disk.dev[disk.slot_dev[slot]];
+        for (int q = 0; q < d->nvq; q++)
+        {
+            vqueue_t *vq = &d->vq[q];
+
+            // 轮询者可能已经处理了这些请求
+            spinlock_acquire(&vq->lk);
+            virtio_disk_reap(vq);
+            spinlock_release(&vq->lk);
+        }
+    }
 }
@@ -1,107 +1,635 @@
 #include "fs/buf.h"
+#include "fs/journal.h"
 #include "fs/fs.h"
 #include "fs/bitmap.h"
+#include "fs/refcnt.h"
+#include "fs/inode.h"
+#include "proc/proc.h"
+#include "proc/cpu.h"
 #include "lib/print.h"
+#include "lib/str.h"
 
 // 全局超级块（外部定义，来自文件系统初始化模块）
 extern super_block_t sb;
 
+// 位图块按64位字访问: 小端序下第w个字的第k位就是该块管理的第w*64+k个bit
+#define BITMAP_WORDS (BLOCK_SIZE / sizeof(uint64))
+
+/*
+    位图可以跨越多个磁盘块, 每个位图块管理BITMAP_BITS_PER_BLOCK个bit, 称为一个组
+    每个组在内存中记录空闲数(由该位图块的睡眠锁保护), 分配时直接跳过已满的组
+    前BITMAP_PIN_MAX个位图块常驻缓存, 其余的经过buf_read
+    每个hart有一个预留池: 从位图中一次预留一批 (在位图中置为已分配, 记录日志), 之后的分配直接从池中取,
+    不获取位图块的睡眠锁, 两个hart上并发增长的不同文件不再在同一个位图块上排队
+        数据块池是一段连续的块: 没有偏好, 或者请求正好从池的开头继续 (顺序增长的文件) 时从池中取,
+            否则把剩余部分归还位图, 在请求的位置分配时多预留一批
+        inode池是同一个组中的若干inode: 请求的inode在另一个组时归还, 在新的组重新预留
+        池中的bit不算在nfree中 (单独计数pooled, bitmap_free_count把它们算作空闲)
+        归还: 位图中找不到空闲bit时归还所有hart的池再找一次, 空闲数不多时不再多预留; fs_sync (卸载) 时全部归还
+        崩溃时池中的预留在磁盘上是已分配的 (泄漏, 每个hart最多一批), 与ext4的预分配相同
+    锁的顺序: pool->lk只保护池本身 (自旋锁), 持有时不访问位图
+*/
+typedef struct bitmap_group {
+    uint32 nfree;   // 组内空闲bit数
+    buf_t* pin;     // 常驻的位图块 (NULL: 每次经过buf_read)
+} bitmap_group_t;
+
+// 位图的内存状态（bitmap_init之后有效）
+typedef struct bitmap_state {
+    uint32 start;   // 第一个位图块的磁盘块编号
+    uint32 nbits;   // 有效bit数（超出部分视为已分配）
+    uint32 ngroups; // 位图块数
+    uint32 nfree;   // 空闲bit总数（原子增减）
+    uint32 hint;    // next-fit: 下一次从这个bit所在的字开始扫描（只是提示, 不加锁）
+    uint32 pooled;  // 预留在各hart的池中、还没有分配出去的bit数（原子增减）
+    bitmap_group_t group[BITMAP_GROUP_MAX];
+} bitmap_state_t;
+
+static bitmap_state_t inode_bitmap_state;
+static bitmap_state_t data_bitmap_state;
+
+// 每个hart的预留池
+typedef struct bitmap_pool {
+    spinlock_t lk;
+    uint32 next;                        // 数据块池: data位图中的[next, next + len)
+    uint32 len;
+    uint32 ipos;                        // inode池: inode[ipos, ninode)
+    uint32 ninode;
+    uint32 inode[BITMAP_POOL_INODES];
+} bitmap_pool_t;
+
+static bitmap_pool_t pools[NCPU];
+
+static uint32 popcount64(uint64 x);
+
+/**
+ * @brief 静态辅助函数：获取第g个位图块的缓冲区并上锁（常驻的位图块直接访问）
+ * @param st 位图状态
+ * @param g 组号
+ * @return 持有睡眠锁的缓冲区，使用完后调用bitmap_unlock
+ */
+static buf_t* bitmap_lock(bitmap_state_t* st, uint32 g)
+{
+    buf_t* buf = st->group[g].pin;
+    if (buf == NULL) {
+        return buf_read(st->start + g);
+    }
+    buf_pinned_lock(buf);
+    return buf;
+}
+
+/**
+ * @brief 静态辅助函数：释放bitmap_lock获取的缓冲区
+ * @param st 位图状态
+ * @param g 组号
+ * @param buf 位图块的缓冲区
+ */
+static void bitmap_unlock(bitmap_state_t* st, uint32 g, buf_t* buf)
+{
+    if (buf == st->group[g].pin) {
+        buf_pinned_unlock(buf);
+    } else {
+        buf_release(buf);
+    }
+}
+
 /**
- * @brief 静态辅助函数：在指定位图磁盘块中，查找第一个空闲bit并置为1（已分配）
- * @param bitmap_block 存储位图的磁盘块编号
- * @return 找到的空闲bit的序号（从0开始，范围：0 ~ BLOCK_SIZE*8-1）
+ * @brief 静态辅助函数：第g个组的有效bit数（只有最后一个组可能不满）
  */
-static uint32 bitmap_search_and_set(uint32 bitmap_block)
+static uint32 bitmap_group_bits(bitmap_state_t* st, uint32 g)
 {
-    uint32 byte_idx;    // 缓冲区数据中的字节索引（0 ~ BLOCK_SIZE-1）
-    uint32 bit_shift;   // 字节内的bit偏移量（0 ~ 7）
-    uint8 bit_cmp;      // bit判断掩码（用于定位单个bit）
+    uint32 left = st->nbits - g * BITMAP_BITS_PER_BLOCK;
+    return left < BITMAP_BITS_PER_BLOCK ? left : BITMAP_BITS_PER_BLOCK;
+}
+
+/**
+ * @brief 静态辅助函数：读取第w个字, 超出有效范围的bit视为已分配
+ * @param words 位图块数据
+ * @param w 字序号
+ * @param nbits 该组的有效bit数
+ */
+static uint64 bitmap_word(uint64* words, uint32 w, uint32 nbits)
+{
+    uint64 x = words[w];
+    if ((w + 1) * 64 > nbits) {
+        x |= ~((1ull << (nbits - w * 64)) - 1);
+    }
+    return x;
+}
+
+/**
+ * @brief 静态辅助函数：修改位图之前调用, 超级块还标记着CLEAN(卸载之后)时先改为DIRTY并落盘
+ * @note 调用者不能持有位图块的睡眠锁
+ */
+static void bitmap_modify()
+{
+    if (sb.state == FS_STATE_CLEAN) {
+        fs_mark_dirty();
+    }
+}
 
-    // 1. 调用buf层函数，读取存储位图的磁盘块到缓冲区
-    buf_t* bitmap_buf = buf_read(bitmap_block);
-    assert(bitmap_buf != NULL, "bitmap_search_and_set: read bitmap block failed");
+/**
+ * @brief 静态辅助函数：检查超级块中记录的各组空闲数是否可信
+ * @param summary 各组空闲数（记录了前nsummary组）
+ * @param nsummary 记录的组数
+ * @param ngroups 位图的组数
+ * @param nbits 有效bit数
+ * @param total 记录的空闲总数
+ * @return 每组不超过组内bit数, 且总和与记录的总数一致（超出记录范围的组还要扫描, 总和只需不超过总数）
+ */
+static bool bitmap_summary_valid(uint16* summary, uint32 nsummary, uint32 ngroups, uint32 nbits, uint32 total)
+{
+    uint32 n = (ngroups < nsummary) ? ngroups : nsummary;
+    uint32 sum = 0;
+    for (uint32 g = 0; g < n; g++) {
+        uint32 left = nbits - g * BITMAP_BITS_PER_BLOCK;
+        if (summary[g] > (left < BITMAP_BITS_PER_BLOCK ? left : BITMAP_BITS_PER_BLOCK)) {
+            return false;
+        }
+        sum += summary[g];
+    }
+    return (ngroups <= nsummary) ? sum == total : sum <= total;
+}
 
-    // 2. 遍历缓冲区中的所有字节（每个字节对应8个bit）
-    for (byte_idx = 0; byte_idx < BLOCK_SIZE; byte_idx++) {
-        bit_cmp = 1;  // 初始化掩码，从第0位开始判断（0b00000001）
+/**
+ * @brief 静态辅助函数：统计各组的空闲bit数, 初始化内存状态
+ * @param st 要初始化的位图状态
+ * @param start 第一个位图块的磁盘块编号
+ * @param nblocks 位图块数
+ * @param nbits 有效bit数
+ * @param summary 超级块中记录的各组空闲数（NULL: 全部扫描）
+ * @param nsummary 记录的组数, 之后的组仍然扫描
+ */
+static void bitmap_state_init(bitmap_state_t* st, uint32 start, uint32 nblocks, uint32 nbits,
+                              uint16* summary, uint32 nsummary)
+{
+    assert(nbits > 0 && nbits <= nblocks * BITMAP_BITS_PER_BLOCK, "bitmap_state_init: invalid bit count");
+    assert(nblocks <= BITMAP_GROUP_MAX, "bitmap_state_init: too many bitmap blocks");
+
+    st->start = start;
+    st->nbits = nbits;
+    st->ngroups = (nbits + BITMAP_BITS_PER_BLOCK - 1) / BITMAP_BITS_PER_BLOCK;
+    st->nfree = 0;
+    st->hint = 0;
+    st->pooled = 0;
+
+    for (uint32 g = 0; g < st->ngroups; g++) {
+        st->group[g].pin = (g < BITMAP_PIN_MAX) ? buf_pin(start + g) : NULL;
+
+        // 干净卸载时记录过: 不读位图块
+        if (summary != NULL && g < nsummary) {
+            st->group[g].nfree = summary[g];
+            st->nfree += summary[g];
+            continue;
+        }
 
-        // 3. 遍历当前字节的所有8个bit，查找第一个空闲bit（值为0）
-        for (bit_shift = 0; bit_shift <= 7; bit_shift++) {
-            // 判断当前bit是否为空闲（与运算结果为0表示空闲）
-            if ((bit_cmp & bitmap_buf->data[byte_idx]) == 0) {
-                // 4. 找到空闲bit，将其置为1（已分配，或运算）
-                bitmap_buf->data[byte_idx] |= bit_cmp;
+        buf_t* buf = bitmap_lock(st, g);
+        uint64* words = (uint64*)buf->data;
+        uint32 gbits = bitmap_group_bits(st, g);
+        uint32 used = 0;
+        for (uint32 w = 0; w * 64 < gbits; w++) {
+            used += popcount64(~bitmap_word(words, w, gbits));
+        }
+        st->group[g].nfree = used;
+        st->nfree += used;
+        bitmap_unlock(st, g, buf);
+    }
+}
 
-                // 5. 强制写入磁盘，保证位图数据与磁盘同步
-                buf_write(bitmap_buf);
+/**
+ * @brief 统计inode位图和data位图各组的空闲数, 常驻前BITMAP_PIN_MAX个位图块
+ * @note 必须在读入超级块之后、第一次分配之前调用
+ *       位图块数由布局推出: inode位图在inode区之前, data位图在data区之前
+ *       超级块标记为CLEAN且记录自洽时直接使用记录的各组空闲数（与磁盘大小无关）, 否则逐块统计
+ */
+void bitmap_init()
+{
+    uint32 inode_bits = sb.inode_blocks * INODE_PER_BLOCK;
+    uint32 inode_groups = (inode_bits + BITMAP_BITS_PER_BLOCK - 1) / BITMAP_BITS_PER_BLOCK;
+    uint32 data_groups = (sb.data_blocks + BITMAP_BITS_PER_BLOCK - 1) / BITMAP_BITS_PER_BLOCK;
+    bool clean = sb.state == FS_STATE_CLEAN &&
+        bitmap_summary_valid(sb.inode_group_free, FS_SUMMARY_INODE_GROUPS, inode_groups, inode_bits, sb.free_inodes) &&
+        bitmap_summary_valid(sb.data_group_free, FS_SUMMARY_DATA_GROUPS, data_groups, sb.data_blocks, sb.free_blocks);
+
+    bitmap_state_init(&inode_bitmap_state, sb.inode_bitmap_start, sb.inode_start - sb.inode_bitmap_start,
+                      inode_bits, clean ? sb.inode_group_free : NULL, FS_SUMMARY_INODE_GROUPS);
+    bitmap_state_init(&data_bitmap_state, sb.data_bitmap_start, sb.data_start - sb.data_bitmap_start,
+                      sb.data_blocks, clean ? sb.data_group_free : NULL, FS_SUMMARY_DATA_GROUPS);
+    if (!clean) {
+        printf("bitmap_init: not cleanly unmounted, free counts rebuilt from bitmaps\n");
+    }
+    for (int i = 0; i < NCPU; i++) {
+        spinlock_init(&pools[i].lk, "bitmap_pool");
+        pools[i].len = pools[i].ipos = pools[i].ninode = 0;
+    }
+}
 
-                // 6. 释放缓冲区引用，允许buf层回收复用
-                buf_release(bitmap_buf);
+/**
+ * @brief 静态辅助函数：计算64位字末尾连续0的个数（count trailing zeros）
+ * @param x 非0的64位字
+ * @return 最低的1所在的bit序号（0 ~ 63）
+ * @note 内核不链接libgcc, 不能使用__builtin_ctzll, 用二分查找实现
+ */
+static uint32 ctz64(uint64 x)
+{
+    uint32 n = 0;
+    if ((x & 0xFFFFFFFFull) == 0) { n += 32; x >>= 32; }
+    if ((x & 0xFFFFull) == 0)     { n += 16; x >>= 16; }
+    if ((x & 0xFFull) == 0)       { n += 8;  x >>= 8; }
+    if ((x & 0xFull) == 0)        { n += 4;  x >>= 4; }
+    if ((x & 0x3ull) == 0)        { n += 2;  x >>= 2; }
+    if ((x & 0x1ull) == 0)        { n += 1; }
+    return n;
+}
 
-                // 7. 返回该bit的全局序号（字节索引*8 + 字节内偏移量）
-                return byte_idx * 8 + bit_shift;
+/**
+ * @brief 静态辅助函数：计算64位字中1的个数
+ * @param x 64位字
+ * @return 置位的bit数
+ */
+static uint32 popcount64(uint64 x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (uint32)((x * 0x0101010101010101ull) >> 56);
+}
+
+/**
+ * @brief 静态辅助函数：在位图中查找最多max个空闲bit并置为1（已分配）
+ * @param st 位图状态
+ * @param goal 从这个bit所在的字开始查找（通常是st->hint, 即next-fit）
+ * @param out 输出：找到的bit序号（升序, 在同一个组中）
+ * @param max 最多的个数（至少为1）
+ * @return 找到的个数, 位图中没有空闲bit（其他hart抢先分配走了, 或者都在池中）时返回0
+ * @note 从goal所在的组开始, 跳过已满的组; 组内按64位字扫描, 跳过全1的字, 用ctz定位字内的0;
+ *       在第一个有空闲bit的组中取到max个或取完为止, 一次加锁、一次写回
+ */
+static uint32 bitmap_search_and_set(bitmap_state_t* st, uint32 goal, uint32* out, uint32 max)
+{
+    assert(st->nbits > 0, "bitmap_search_and_set: bitmap_init not called");
+    bitmap_modify();
+
+    // 1. 位图已满则快速失败
+    if (st->nfree == 0) {
+        return 0;
+    }
+
+    // 2. 从goal所在的组开始逐组查找, 最后回到起始组的前半部分
+    uint32 hint = (goal < st->nbits) ? goal : 0;
+    uint32 g0 = hint / BITMAP_BITS_PER_BLOCK;
+    for (uint32 i = 0; i <= st->ngroups; i++) {
+        uint32 g = (g0 + i) % st->ngroups;
+        if (st->group[g].nfree == 0) {
+            continue;   // 未加锁的快速检查, 加锁后再确认
+        }
+
+        buf_t* bitmap_buf = bitmap_lock(st, g);
+        uint64* words = (uint64*)bitmap_buf->data;
+        uint32 gbits = bitmap_group_bits(st, g);
+        uint32 nwords = (gbits + 63) / 64;
+        uint32 w0 = (i == 0) ? (hint % BITMAP_BITS_PER_BLOCK) / 64 : 0;
+        uint32 cnt = 0;
+
+        // 3. 组内从w0开始遍历64位字, 全1的字没有空闲bit, 直接跳过
+        for (uint32 w = w0; w < nwords && cnt < max && cnt < st->group[g].nfree; w++) {
+            uint64 x = bitmap_word(words, w, gbits);
+
+            // 4. 取反后最低的1就是空闲bit, 置为1（已分配）
+            while (x != ~0ull && cnt < max) {
+                uint32 bit = ctz64(~x);
+                x |= 1ull << bit;
+                words[w] |= 1ull << bit;
+                out[cnt++] = g * BITMAP_BITS_PER_BLOCK + w * 64 + bit;
             }
+        }
 
-            // 8. 掩码左移一位，判断下一个bit
-            bit_cmp = bit_cmp << 1;
+        // 5. 写回位图块并释放缓冲区
+        if (cnt > 0) {
+            st->group[g].nfree -= cnt;
+            __sync_fetch_and_sub(&st->nfree, cnt);
+            journal_log(bitmap_buf);
+            bitmap_unlock(st, g, bitmap_buf);
+            st->hint = out[cnt - 1];
+            return cnt;
         }
+        bitmap_unlock(st, g, bitmap_buf);
+        proc_cond_resched();    // 组内没有找到 (其他hart分配走了): 换下一组之前是一个抢占点
     }
 
-    // 9. 遍历完所有bit，无空闲资源，报错并退出
-    buf_release(bitmap_buf);  // 释放缓冲区，避免死锁
-    panic("bitmap_search_and_set: no free bit available in block ");
-    return 0;  // 不可达，仅满足函数返回值要求
+    // 6. 其他hart抢先分配走了最后的空闲bit
+    return 0;
+}
+
+/**
+ * @brief 静态辅助函数：把池中预留的[start, start + len)（在同一个组中）归还位图
+ * @param st 位图状态
+ * @param start 第一个bit的序号
+ * @param len bit数
+ */
+static void bitmap_unreserve(bitmap_state_t* st, uint32 start, uint32 len)
+{
+    bitmap_modify();
+
+    uint32 g = start / BITMAP_BITS_PER_BLOCK;
+    uint32 off = start % BITMAP_BITS_PER_BLOCK;
+    buf_t* bitmap_buf = bitmap_lock(st, g);
+    uint64* words = (uint64*)bitmap_buf->data;
+    for (uint32 b = off; b < off + len; b++) {
+        if ((words[b / 64] & (1ull << (b % 64))) == 0) {
+            bitmap_unlock(st, g, bitmap_buf);
+            panic("bitmap_unreserve: reserved bit is free");
+        }
+        words[b / 64] &= ~(1ull << (b % 64));
+    }
+    st->group[g].nfree += len;
+    __sync_fetch_and_add(&st->nfree, len);
+    __sync_fetch_and_sub(&st->pooled, len);
+    journal_log(bitmap_buf);
+    bitmap_unlock(st, g, bitmap_buf);
 }
 
 /**
- * @brief 静态辅助函数：在指定位图磁盘块中，将指定序号的bit置为0（空闲）
- * @param bitmap_block 存储位图的磁盘块编号
- * @param num 要置为空闲的bit序号（从0开始，范围：0 ~ BLOCK_SIZE*8-1）
+ * @brief 静态辅助函数：摘下pool中剩余的数据块并归还位图
  */
-static void bitmap_unset(uint32 bitmap_block, uint32 num)
+static void bitmap_pool_flush_data(bitmap_pool_t* pool)
 {
-    // 1. 计算该bit对应的字节索引和字节内偏移量
-    uint32 byte_idx = num / 8;    // 字节索引 = bit序号 / 8（整数除法）
-    uint32 bit_shift = num % 8;   // 字节内偏移 = bit序号 % 8
-    uint8 bit_cmp = 1 << bit_shift;  // 构建bit判断/操作掩码
+    spinlock_acquire(&pool->lk);
+    uint32 next = pool->next;
+    uint32 len = pool->len;
+    pool->len = 0;
+    spinlock_release(&pool->lk);
+    if (len > 0) {
+        bitmap_unreserve(&data_bitmap_state, next, len);
+    }
+}
 
-    // 2. 合法性校验：字节索引不能超过磁盘块大小（避免越界访问）
-    if (byte_idx >= BLOCK_SIZE) {
-        panic("bitmap_unset: invalid bit num  (byte index out of range)");
+/**
+ * @brief 静态辅助函数：摘下pool中剩余的inode并归还位图
+ */
+static void bitmap_pool_flush_inode(bitmap_pool_t* pool)
+{
+    uint32 inode[BITMAP_POOL_INODES];
+    spinlock_acquire(&pool->lk);
+    uint32 n = pool->ninode - pool->ipos;
+    memmove(inode, pool->inode + pool->ipos, n * sizeof(uint32));
+    pool->ipos = pool->ninode = 0;
+    spinlock_release(&pool->lk);
+    for (uint32 i = 0; i < n; i++) {
+        bitmap_unreserve(&inode_bitmap_state, inode[i], 1);
     }
+}
 
-    // 3. 调用buf层函数，读取存储位图的磁盘块到缓冲区
-    buf_t* bitmap_buf = buf_read(bitmap_block);
+/**
+ * @brief 归还所有hart的池中的预留（位图中找不到空闲bit时, fs_sync时）
+ * @note 在日志操作中调用（归还会修改位图块）
+ */
+void bitmap_pool_drain()
+{
+    for (int i = 0; i < ncpu; i++) {
+        bitmap_pool_flush_data(&pools[i]);
+        bitmap_pool_flush_inode(&pools[i]);
+    }
+}
+
+/**
+ * @brief 静态辅助函数：将位图中指定序号的bit置为0（空闲）
+ * @param st 位图状态
+ * @param num 要置为空闲的bit序号（从0开始，范围：0 ~ st->nbits-1）
+ */
+static void bitmap_unset(bitmap_state_t* st, uint32 num)
+{
+    // 1. 合法性校验：不能超出有效范围（避免越界访问）
+    if (num >= st->nbits) {
+        panic("bitmap_unset: invalid bit num (out of range)");
+    }
+
+    bitmap_modify();
+
+    // 2. 计算组号以及组内的字节索引和字节内偏移量
+    uint32 g = num / BITMAP_BITS_PER_BLOCK;
+    uint32 off = num % BITMAP_BITS_PER_BLOCK;
+    uint32 byte_idx = off / 8;
+    uint8 bit_cmp = 1 << (off % 8);
+
+    // 3. 获取存储位图的磁盘块的缓冲区
+    buf_t* bitmap_buf = bitmap_lock(st, g);
     assert(bitmap_buf != NULL, "bitmap_unset: read bitmap block failed");
 
     // 4. 校验该bit是否已经是空闲状态（避免重复释放）
     if ((bitmap_buf->data[byte_idx] & bit_cmp) == 0) {
-        buf_release(bitmap_buf);  // 释放缓冲区，避免死锁
+        bitmap_unlock(st, g, bitmap_buf);  // 释放缓冲区，避免死锁
         panic("bitmap_unset: bit in block  is already free");
     }
 
     // 5. 将该bit置为0（空闲，与运算取反掩码）
     bitmap_buf->data[byte_idx] &= ~bit_cmp;
+    st->group[g].nfree++;
+    __sync_fetch_and_add(&st->nfree, 1);
 
-    // 6. 强制写入磁盘，保证位图数据与磁盘同步
-    buf_write(bitmap_buf);
+    // 6. 写回位图块
+    journal_log(bitmap_buf);
 
-    // 7. 释放缓冲区引用，允许buf层回收复用
-    buf_release(bitmap_buf);
+    // 7. 释放缓冲区
+    bitmap_unlock(st, g, bitmap_buf);
 }
 
 /**
  * @brief 分配一个空闲的数据块（返回数据块的磁盘块编号）
  * @return 空闲数据块的磁盘块编号
+ * @note 没有位置偏好的单块分配, 优先从本hart的池中取; 新数据块内容被清零（不读取磁盘上的旧内容）
  */
 uint32 bitmap_alloc_block()
 {
-    // 1. 在位图数据块中查找并分配一个空闲bit
-    uint32 free_bit_num = bitmap_search_and_set(sb.data_bitmap_start);
+    uint32 n = 1;
+    return bitmap_alloc_extent(0, &n);
+}
+
+/**
+ * @brief 静态辅助函数：在第g个组中从start开始查找最长的空闲bit串（不超过want）
+ * @param words 位图块数据
+ * @param gbits 该组的有效bit数
+ * @param start 组内起始bit
+ * @param want 期望的长度, 找到这么长的串就立即返回
+ * @param len 输出：找到的长度（0表示没有空闲bit）
+ * @return 串的组内起始bit
+ */
+static uint32 bitmap_find_run(uint64* words, uint32 gbits, uint32 start, uint32 want, uint32* len)
+{
+    uint32 best = 0, best_len = 0, run = 0, run_len = 0;
+
+    for (uint32 bit = start; bit < gbits;) {
+        uint64 x = bitmap_word(words, bit / 64, gbits);
+
+        // 不在空闲串中时整字跳过全1的字
+        if (run_len == 0 && x == ~0ull) {
+            bit = (bit / 64 + 1) * 64;
+            continue;
+        }
+
+        if (x & (1ull << (bit % 64))) {
+            run_len = 0;
+        } else {
+            if (run_len == 0) {
+                run = bit;
+            }
+            if (++run_len > best_len) {
+                best = run;
+                best_len = run_len;
+                if (best_len == want) {
+                    break;
+                }
+            }
+        }
+        bit++;
+    }
+
+    *len = best_len;
+    return best;
+}
+
+/**
+ * @brief 静态辅助函数：从hint所在的组开始, 在第一个有空闲块的组里取最长的空闲串（不超过want）并置为已分配
+ * @param st 位图状态（data位图）
+ * @param hint 起始bit
+ * @param want 期望的长度
+ * @param len 输出：串的长度（0: 位图中没有空闲块）
+ * @return 串的起始bit
+ * @note 串不会跨越组（一个组最多BITMAP_BITS_PER_BLOCK个块）
+ */
+static uint32 bitmap_take_run(bitmap_state_t* st, uint32 hint, uint32 want, uint32* len)
+{
+    bitmap_modify();
+    *len = 0;
+
+    // 1. 数据区已满则快速失败
+    if (st->nfree == 0) {
+        return 0;
+    }
+
+    // 2. 从起始组开始逐组查找, 跳过已满的组, 最后回到起始组的前半部分
+    uint32 g0 = hint / BITMAP_BITS_PER_BLOCK;
+    for (uint32 i = 0; i <= st->ngroups; i++) {
+        uint32 g = (g0 + i) % st->ngroups;
+        if (st->group[g].nfree == 0) {
+            continue;
+        }
+
+        buf_t* bitmap_buf = bitmap_lock(st, g);
+        uint64* words = (uint64*)bitmap_buf->data;
+        uint32 gbits = bitmap_group_bits(st, g);
+        uint32 start = (i == 0) ? hint % BITMAP_BITS_PER_BLOCK : 0;
+        uint32 run = bitmap_find_run(words, gbits, start, want, len);
+        if (*len == 0) {
+            bitmap_unlock(st, g, bitmap_buf);
+            continue;
+        }
+
+        // 3. 把整个串置为已分配, 一次写回位图块
+        for (uint32 b = run; b < run + *len; b++) {
+            words[b / 64] |= 1ull << (b % 64);
+        }
+        st->group[g].nfree -= *len;
+        __sync_fetch_and_sub(&st->nfree, *len);
+        journal_log(bitmap_buf);
+        bitmap_unlock(st, g, bitmap_buf);
+
+        uint32 num = g * BITMAP_BITS_PER_BLOCK + run;
+        st->hint = num + *len;
+        if (st->hint >= st->nbits) {
+            st->hint = 0;
+        }
+        return num;
+    }
+
+    // 4. 其他hart抢先分配走了最后的空闲块
+    return 0;
+}
+
+/**
+ * @brief 静态辅助函数：清零data位图中从num开始的len个新数据块, 返回第一个块的磁盘块编号
+ */
+static uint32 bitmap_zero_blocks(uint32 num, uint32 len)
+{
+    uint32 block_num = sb.data_start + num;
+    for (uint32 b = 0; b < len; b++) {
+        buf_t* buf = buf_get_nofill(block_num + b);
+        memset(buf->data, 0, BLOCK_SIZE);
+        buf_write(buf);
+        buf_release(buf);
+    }
+    return block_num;
+}
+
+/**
+ * @brief 分配一段磁盘上连续的空闲数据块
+ * @param preferred_start 希望的起始磁盘块编号（例如文件上一个数据块之后; 0表示没有偏好）
+ * @param n 输入：希望的块数; 输出：实际分配的块数（1 ~ 输入值）
+ * @return 第一个数据块的磁盘块编号
+ * @note 没有偏好或者preferred_start正好是本hart的池的开头时从池中取（不加位图块的锁）;
+ *       否则归还池中剩余的块, 从preferred_start所在的组开始取最长的空闲串, 同时多预留BITMAP_POOL_BLOCKS块放进池中
+ *       （空闲块不多时不多预留）; 新数据块内容被清零
+ */
+uint32 bitmap_alloc_extent(uint32 preferred_start, uint32* n)
+{
+    bitmap_state_t* st = &data_bitmap_state;
+    uint32 want = *n;
+
+    assert(want > 0, "bitmap_alloc_extent: zero length");
+    assert(st->nbits > 0, "bitmap_alloc_extent: bitmap_init not called");
+
+    // 1. 确定起始bit: 优先使用preferred_start, 否则使用next-fit提示
+    bool prefer = preferred_start >= sb.data_start && preferred_start - sb.data_start < st->nbits;
+    uint32 hint = prefer ? preferred_start - sb.data_start : st->hint;
+
+    // 2. 本hart的池
+    bitmap_pool_t* pool = &pools[mycpuid()];
+    spinlock_acquire(&pool->lk);
+    if (pool->len > 0 && (!prefer || hint == pool->next)) {
+        uint32 num = pool->next;
+        uint32 len = (want < pool->len) ? want : pool->len;
+        pool->next += len;
+        pool->len -= len;
+        spinlock_release(&pool->lk);
+        __sync_fetch_and_sub(&st->pooled, len);
+        *n = len;
+        return bitmap_zero_blocks(num, len);
+    }
+    spinlock_release(&pool->lk);
+
+    // 3. 池中剩余的块不在需要的位置: 归还, 在新位置多预留一批
+    bitmap_pool_flush_data(pool);
+    uint32 extra = (st->nfree > 2 * ncpu * BITMAP_POOL_BLOCKS) ? BITMAP_POOL_BLOCKS : 0;
+    uint32 len;
+    uint32 num = bitmap_take_run(st, hint, want + extra, &len);
+    if (len == 0) {
+        // 空闲块可能都在其他hart的池中: 全部归还后再找一次
+        bitmap_pool_drain();
+        num = bitmap_take_run(st, hint, want, &len);
+        if (len == 0) {
+            panic("bitmap_alloc_extent: no free block available");
+        }
+    }
 
-    // 2. 转换为数据块的磁盘块编号（数据区域起始块 + bit序号）
-    // 解释：data_bitmap中的第N个bit，对应data区域的第N个数据块
-    return sb.data_start + free_bit_num;
+    // 4. 多出的部分放进池中 (这期间同一个hart上的另一个进程已经放进了一批时归还)
+    if (len > want) {
+        uint32 rest = len - want;
+        __sync_fetch_and_add(&st->pooled, rest);
+        spinlock_acquire(&pool->lk);
+        bool fill = (pool->len == 0);
+        if (fill) {
+            pool->next = num + want;
+            pool->len = rest;
+        }
+        spinlock_release(&pool->lk);
+        if (!fill) {
+            bitmap_unreserve(st, num + want, rest);
+        }
+        len = want;
+    }
+
+    *n = len;
+    return bitmap_zero_blocks(num, len);
 }
 
 /**
@@ -115,16 +643,136 @@ void bitmap_free_block(uint32 block_num)
         panic("bitmap_free_block: invalid data block num  (less than data start )");
     }
 
-    // 2. 转换为data位图中的bit序号（数据块编号 - 数据区域起始块）
+    // 1.5 reflink共享的块: 只释放一个引用
+    if (refcnt_put(block_num)) {
+        return;
+    }
+
+    // 2. 转换为data位图中的bit序号（数据块编号 - 数据区域起始块）, 范围由bitmap_unset检查
     uint32 bit_num = block_num - sb.data_start;
 
-    // 3. 校验bit序号是否超出data位图的最大范围（避免越界）
-    if (bit_num >= (sb.data_blocks * BLOCK_SIZE * 8)) {
-        panic("bitmap_free_block: invalid data block num (out of data area range)");
+    // 3. 置位data位图中对应的bit为空闲
+    bitmap_unset(&data_bitmap_state, bit_num);
+}
+
+/**
+ * @brief 把一个待释放的数据块加入批量释放表, 表满时先提交
+ * @param batch 批量释放表（调用者初始化n = 0, 最后调用bitmap_free_batch_flush）
+ * @param block_num 要释放的数据块磁盘编号
+ */
+void bitmap_free_batch_add(bitmap_free_batch_t* batch, uint32 block_num)
+{
+    if (block_num < sb.data_start || block_num - sb.data_start >= data_bitmap_state.nbits) {
+        panic("bitmap_free_batch_add: invalid data block num");
     }
+    if (refcnt_put(block_num)) {
+        return;  // 还被其他文件共享
+    }
+    if (batch->n == BITMAP_FREE_BATCH) {
+        bitmap_free_batch_flush(batch);
+    }
+    batch->blocks[batch->n++] = block_num;
+}
 
-    // 4. 置位data位图中对应的bit为空闲
-    bitmap_unset(sb.data_bitmap_start, bit_num);
+/**
+ * @brief 提交批量释放表: 同一个位图块上的释放只上锁、写回一次
+ * @param batch 批量释放表, 返回时清空
+ */
+void bitmap_free_batch_flush(bitmap_free_batch_t* batch)
+{
+    bitmap_state_t* st = &data_bitmap_state;
+    if (batch->n > 0) {
+        bitmap_modify();
+    }
+
+    // 每一轮取出第一个未处理的块所在的组, 处理表中属于该组的所有块（已处理的置0）
+    for (uint32 i = 0; i < batch->n; i++) {
+        if (batch->blocks[i] == 0) {
+            continue;
+        }
+        uint32 g = (batch->blocks[i] - sb.data_start) / BITMAP_BITS_PER_BLOCK;
+        buf_t* bitmap_buf = bitmap_lock(st, g);
+        uint32 freed = 0;
+
+        for (uint32 j = i; j < batch->n; j++) {
+            if (batch->blocks[j] == 0) {
+                continue;
+            }
+            uint32 num = batch->blocks[j] - sb.data_start;
+            if (num / BITMAP_BITS_PER_BLOCK != g) {
+                continue;
+            }
+            uint32 off = num % BITMAP_BITS_PER_BLOCK;
+            uint8 bit_cmp = 1 << (off % 8);
+            if ((bitmap_buf->data[off / 8] & bit_cmp) == 0) {
+                bitmap_unlock(st, g, bitmap_buf);
+                panic("bitmap_free_batch_flush: block is already free");
+            }
+            bitmap_buf->data[off / 8] &= ~bit_cmp;
+            batch->blocks[j] = 0;
+            freed++;
+        }
+
+        st->group[g].nfree += freed;
+        __sync_fetch_and_add(&st->nfree, freed);
+        journal_log(bitmap_buf);
+        bitmap_unlock(st, g, bitmap_buf);
+    }
+    batch->n = 0;
+}
+
+/**
+ * @brief 静态辅助函数：分配一个inode, 优先从本hart的池中取
+ * @param goal 从这个inode所在的字开始查找
+ * @param any 池中的inode都可以用（否则只用与goal在同一个组的）
+ * @return inode序号
+ * @note 池不能用时归还它, 从goal开始预留BITMAP_POOL_INODES + 1个（空闲inode不多时只取一个）, 第一个返回
+ */
+static uint16 bitmap_inode_take(uint32 goal, bool any)
+{
+    bitmap_state_t* st = &inode_bitmap_state;
+
+    // 1. 本hart的池
+    bitmap_pool_t* pool = &pools[mycpuid()];
+    spinlock_acquire(&pool->lk);
+    if (pool->ipos < pool->ninode &&
+        (any || pool->inode[pool->ipos] / BITMAP_BITS_PER_BLOCK == goal / BITMAP_BITS_PER_BLOCK)) {
+        uint32 num = pool->inode[pool->ipos++];
+        spinlock_release(&pool->lk);
+        __sync_fetch_and_sub(&st->pooled, 1);
+        return (uint16)num;
+    }
+    spinlock_release(&pool->lk);
+
+    // 2. 归还池中的inode, 在goal附近重新预留
+    bitmap_pool_flush_inode(pool);
+    uint32 got[BITMAP_POOL_INODES + 1];
+    uint32 max = (st->nfree > 2 * ncpu * BITMAP_POOL_INODES) ? BITMAP_POOL_INODES + 1 : 1;
+    uint32 cnt = bitmap_search_and_set(st, goal, got, max);
+    if (cnt == 0) {
+        bitmap_pool_drain();
+        cnt = bitmap_search_and_set(st, goal, got, 1);
+        if (cnt == 0) {
+            panic("bitmap_alloc_inode: no free inode available");
+        }
+    }
+
+    // 3. 其余的放进池中
+    if (cnt > 1) {
+        __sync_fetch_and_add(&st->pooled, cnt - 1);
+        spinlock_acquire(&pool->lk);
+        bool fill = (pool->ipos == pool->ninode);
+        if (fill) {
+            memmove(pool->inode, got + 1, (cnt - 1) * sizeof(uint32));
+            pool->ipos = 0;
+            pool->ninode = cnt - 1;
+        }
+        spinlock_release(&pool->lk);
+        for (uint32 i = 1; !fill && i < cnt; i++) {
+            bitmap_unreserve(st, got[i], 1);
+        }
+    }
+    return (uint16)got[0];
 }
 
 /**
@@ -133,11 +781,34 @@ void bitmap_free_block(uint32 block_num)
  */
 uint16 bitmap_alloc_inode()
 {
-    // 1. 在位图inode块中查找并分配一个空闲bit
-    uint32 free_bit_num = bitmap_search_and_set(sb.inode_bitmap_start);
+    return bitmap_inode_take(inode_bitmap_state.hint, true);
+}
 
-    // 2. 转换为uint16类型返回（inode序号范围通常较小，满足uint16存储）
-    return (uint16)free_bit_num;
+/**
+ * @brief 在指定inode附近分配一个空闲的inode（同一目录下的文件尽量落在相邻的inode块）
+ * @param near 希望靠近的inode序号（通常是父目录）
+ * @return 空闲inode的序号（本hart的池中有同一组的inode时取池中的, 否则从near所在的64位字开始查找, 找不到时向后回绕）
+ */
+uint16 bitmap_alloc_inode_near(uint16 near)
+{
+    return bitmap_inode_take(near, false);
+}
+
+/**
+ * @brief 计算inode的数据块的期望起始位置
+ * @param inode_num inode序号
+ * @return 数据区中与inode序号成比例的磁盘块编号
+ * @note 数据区按inode数等分, 每个inode对应一小段; 相邻的inode（同一目录下的文件）
+ *       的数据也相邻, 不同目录的数据分散到整个数据区, 给文件增长留出空间
+ */
+uint32 bitmap_data_goal(uint16 inode_num)
+{
+    uint32 per_inode = data_bitmap_state.nbits / inode_bitmap_state.nbits;
+    uint32 off = (uint32)inode_num * per_inode;
+    if (off >= data_bitmap_state.nbits) {
+        off = 0;
+    }
+    return sb.data_start + off;
 }
 
 /**
@@ -147,45 +818,70 @@ uint16 bitmap_alloc_inode()
 void bitmap_free_inode(uint16 inode_num)
 {
     // 1. 置位inode位图中对应的bit为空闲（强制转换为uint32适配函数参数）
-    bitmap_unset(sb.inode_bitmap_start, (uint32)inode_num);
+    bitmap_unset(&inode_bitmap_state, (uint32)inode_num);
+}
+
+/**
+ * @brief 查询空闲的数据块数和inode数（读取缓存的空闲计数, 不扫描位图）
+ * @param free_blocks 输出：空闲数据块数
+ * @param free_inodes 输出：空闲inode数
+ */
+void bitmap_free_count(uint32* free_blocks, uint32* free_inodes)
+{
+    *free_blocks = data_bitmap_state.nfree + data_bitmap_state.pooled;
+    *free_inodes = inode_bitmap_state.nfree + inode_bitmap_state.pooled;
+}
+
+/**
+ * @brief 静态辅助函数：把前n组的空闲数复制进超级块的记录
+ */
+static void bitmap_state_save(bitmap_state_t* st, uint16* summary, uint32 n)
+{
+    for (uint32 g = 0; g < n; g++) {
+        summary[g] = (g < st->ngroups) ? st->group[g].nfree : 0;
+    }
+}
+
+/**
+ * @brief 把两个位图的空闲总数和各组空闲数记录进超级块（由调用者写回）
+ * @note 卸载时调用: 所有修改都已写回 (fs_sync已经归还了池中的预留), 之后不再有并发的分配和释放, 不需要加锁
+ */
+void bitmap_save_summary()
+{
+    assert(inode_bitmap_state.pooled == 0 && data_bitmap_state.pooled == 0, "bitmap_save_summary: pools not drained");
+    sb.free_inodes = inode_bitmap_state.nfree;
+    sb.free_blocks = data_bitmap_state.nfree;
+    bitmap_state_save(&inode_bitmap_state, sb.inode_group_free, FS_SUMMARY_INODE_GROUPS);
+    bitmap_state_save(&data_bitmap_state, sb.data_group_free, FS_SUMMARY_DATA_GROUPS);
 }
 
 /**
  * @brief 打印指定位图磁盘块中所有已分配的bit序号（调试用）
  * @param bitmap_block_num 存储位图的磁盘块编号
+ * @note 序号是该位图块内的序号
  */
 void bitmap_print(uint32 bitmap_block_num)
 {
-    uint8 bit_cmp;      // bit判断掩码
-    uint32 byte_idx;    // 缓冲区数据中的字节索引
-    uint32 bit_shift;   // 字节内的bit偏移量
-
     printf("\n===================== Bitmap Debug Info =====================\n");
     printf("Bitmap block num: %d\n", bitmap_block_num);
     printf("Allocated bits (start from 0):\n\n");
 
-    // 1. 调用buf层函数，读取存储位图的磁盘块到缓冲区
+    // 1. 获取存储位图的磁盘块的缓冲区
     buf_t* bitmap_buf = buf_read(bitmap_block_num);
     assert(bitmap_buf != NULL, "bitmap_print: read bitmap block failed");
-
-    // 2. 遍历缓冲区中的所有字节（每个字节对应8个bit）
-    for (byte_idx = 0; byte_idx < BLOCK_SIZE; byte_idx++) {
-        bit_cmp = 1;  // 初始化掩码，从第0位开始判断（0b00000001）
-
-        // 3. 遍历当前字节的所有8个bit，查找已分配的bit（值为1）
-        for (bit_shift = 0; bit_shift <= 7; bit_shift++) {
-            // 判断当前bit是否已分配（与运算结果非0表示已分配）
-            if (bit_cmp & bitmap_buf->data[byte_idx]) {
-                printf("  Bit %d is allocated\n", byte_idx * 8 + bit_shift);
-            }
-
-            // 4. 掩码左移一位，判断下一个bit
-            bit_cmp = bit_cmp << 1;
+    uint64* words = (uint64*)bitmap_buf->data;
+
+    // 2. 按64位字遍历, 全0的字直接跳过; 每次取出最低的1并清除
+    for (uint32 w = 0; w < BITMAP_WORDS; w++) {
+        uint64 x = words[w];
+        while (x != 0) {
+            printf("  Bit %d is allocated\n", w * 64 + ctz64(x));
+            x &= x - 1;
         }
     }
 
-    // 5. 释放缓冲区引用，允许buf层回收复用
+    // 3. 释放缓冲区
     buf_release(bitmap_buf);
 
     printf("\n===================== Bitmap Print Over =====================\n\n");
-}
\ No newline at end of file
+}
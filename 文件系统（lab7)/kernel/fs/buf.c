@@ -1,145 +1,990 @@
 #include "fs/buf.h"
+#include "dev/blk.h"
 #include "dev/vio.h"
+#include "dev/timer.h"
 #include "lib/lock.h"
 #include "lib/print.h"
 #include "lib/str.h"
+#include "lib/percpu.h"
+#include "mem/pmem.h"
+#include "mem/slab.h"
+#include "proc/proc.h"
+#include "proc/cpu.h"
+#include "lib/tstat.h"
 
-#define N_BLOCK_BUF 64
+#define N_BLOCK_BUF 64          // 静态分配的buf数量（buf cache的最小规模）
+#define N_BUF_BUCKET 1031       // 哈希桶数量（取素数，使block_num分布均匀; 按N_BUF_MAX配置, 平均冲突链不超过4）
 #define BLOCK_NUM_UNUSED 0xFFFFFFFF
 
+#define BUF_HASH(block_num) ((block_num) % N_BUF_BUCKET)
+
+// 写回相关参数
+#define BUF_FLUSH_INTERVAL 50              // 每隔多少个tick写回一次dirty buf (约5s)
+#define BUF_DIRTY_HIGH (n_buf / 2)         // dirty buf数量达到高水位时不等定时器直接写回
+
 // 将buf包装成双向循环链表的node（用于管理缓冲区的链表结构）
 typedef struct buf_node {
     buf_t buf;                // 核心缓冲区数据（作为第一个成员，支持直接强制类型转换）
-    struct buf_node* next;    // 链表后继节点指针
-    struct buf_node* prev;    // 链表前驱节点指针
+    struct buf_node* next;    // 桶内链表后继节点指针
+    struct buf_node** pprev;  // 指向前驱节点的next（或桶的first）, NULL表示不在链表中
+    struct buf_bucket* bucket; // 所在的桶（只在持有lk_buf_evict时改变, 未绑定的buf不能由block_num算出）
+    uint64 lru_stamp;         // 替换策略使用的时间戳（跨桶比较新旧, 含义由策略决定）
+    uint8 queue;              // 替换策略使用的队列标记（2Q: A1in / Am）
 } buf_node_t;
 
+/*
+    动态扩容: 未命中且没有未绑定的buf时, 从内核物理页区申请一页切分成若干buf
+        BUF_DATA_INLINE: 页首是buf_page_t, 之后是BUF_PER_PAGE个buf (data在buf中)
+        否则: 一页只放data (PGSIZE / BLOCK_SIZE个block), 描述它的buf_page_t从slab申请
+    内核空闲页不足时把所有buf都空闲的页归还给pmem
+    内核区域可以向用户区域借页, 空闲内存多时buf cache可以长到N_BUF_MAX;
+    任一区域的可用页低于pmem的低水位时pmem调用buf_reclaim收缩
+*/
+#define N_BUF_MAX     4096    // buf总数上限
+#define BUF_PMEM_HIGH 256     // 内核区空闲页多于此值才扩容
+#define BUF_PMEM_LOW  128     // 内核区空闲页少于此值时收缩, 直到恢复到BUF_PMEM_HIGH
+#if BUF_DATA_INLINE
+#define BUF_PER_PAGE  ((PGSIZE - sizeof(struct buf_page*)) / sizeof(buf_node_t))
+#else
+#define BUF_PER_PAGE  (PGSIZE / BLOCK_SIZE)
+#endif
+
+typedef struct buf_page {
+    struct buf_page* next;             // 已申请的页链表
+#if !BUF_DATA_INLINE
+    uint8* data;                       // nodes[i].buf.data = data + i * BLOCK_SIZE
+#endif
+    buf_node_t nodes[BUF_PER_PAGE];
+} buf_page_t;
+
+/*
+    哈希桶: 每个桶拥有独立的自旋锁和链表
+    桶内链表是哈希冲突链, 刚释放的buf放在头部（first）以加快命中查找
+    桶头只有一个指针（没有哨兵节点, 否则每个桶带着一整个buf）, 桶数按N_BUF_MAX配置也只占几页
+    淘汰顺序由替换策略(buf_policy_t)和lru_stamp/queue决定, 与链表顺序无关
+    命中路径只持有一个桶锁, 不同hart访问不同桶时互不阻塞
+*/
+typedef struct buf_bucket {
+    spinlock_t lk;            // 保护桶内链表, 以及桶内buf的buf_ref、block_num
+    buf_node_t* first;        // 桶内双向链表的第一个节点（NULL结尾）
+} buf_bucket_t;
+
 // 全局buf cache管理变量
-static buf_node_t buf_cache[N_BLOCK_BUF];  // 固定大小的缓冲区数组（共64个缓冲区）
-static buf_node_t head_buf;                // 双向循环链表哨兵头节点：->next 已分配/最近使用 | ->prev 空闲/最少使用（LRU）
-static spinlock_t lk_buf_cache;            // 保护链表结构、buf_ref、block_num的自旋锁
-
-// 【内部辅助函数】双向循环链表节点迁移/插入（从原位置移除，插入到head的指定侧）
-// head_next=true：插入到head->next（已分配/最近使用侧）
-// head_next=false：插入到head->prev（空闲/最少使用侧）
-static void insert_head(buf_node_t* buf_node, bool head_next)
-{
-    // 第一步：将节点从原有链表位置中移除（如果节点已在链表中）
-    if (buf_node->next != NULL && buf_node->prev != NULL) {
-        buf_node->next->prev = buf_node->prev;  // 后继节点的前驱指向当前节点的前驱
-        buf_node->prev->next = buf_node->next;  // 前驱节点的后继指向当前节点的后继
-    }
-
-    // 第二步：将节点插入到哨兵头节点的指定侧
-    if (head_next) {
-        // 插入到head->next（已分配/最近使用侧，链表头部）
-        buf_node->prev = &head_buf;
-        buf_node->next = head_buf.next;
-        head_buf.next->prev = buf_node;
-        head_buf.next = buf_node;
+static buf_node_t buf_cache[N_BLOCK_BUF];      // 静态缓冲区数组（共64个缓冲区）
+#if !BUF_DATA_INLINE
+static uint8 buf_cache_data[N_BLOCK_BUF][BLOCK_SIZE] __attribute__((aligned(PGSIZE)));
+static kmem_cache_t buf_page_cache;            // 动态扩容的buf_page_t
+#endif
+static buf_page_t* buf_pages;                  // 动态扩容申请的页（由lk_buf_evict保护）
+static uint32 n_buf;                           // 当前buf总数（由lk_buf_evict保护）
+static uint32 n_unbound;                       // 尚未绑定block的buf数量（由lk_buf_evict保护）
+static uint32 n_waiters;                       // 等待空闲buf的进程数（原子增减, 睡眠在&n_waiters上）
+static buf_bucket_t buf_bucket[N_BUF_BUCKET];  // 以block_num为键的哈希桶
+static spinlock_t lk_buf_evict;                // 串行化淘汰路径（一次只有一个hart在桶间迁移buf）
+static uint64 lru_clock;                       // 单调递增的时间戳源（原子自增）
+
+// 写回模式管理变量
+static bool buf_writeback = true;              // true: buf_write只标记dirty, 由flusher批量写盘
+static uint32 n_dirty;                         // 当前dirty buf数量（原子增减）
+static uint64 last_flush_tick;                 // 上一次定时写回的tick
+static int flushing;                           // 是否有hart正在执行定时写回（test-and-set）
+static spinlock_t lk_commit;                   // 保护组提交的以下三个字段
+static uint64 commit_started;                  // 已经开始的组提交次数
+static uint64 commit_done;                     // 已经完成的组提交次数（等待者睡眠在&commit_done上）
+static bool committing;                        // 是否有组提交正在进行
+
+// 统计信息（每个hart一份, 见lib/percpu.h）
+static PCPU_DEFINE(buf_stat_t, buf_counter);
+
+#define BUF_COUNT(field, n) PCPU_ADD(buf_counter, field, n)
+
+/*
+    可替换的缓存替换策略
+    on_bind    : 未命中时buf绑定到新block之后调用（持有lk_buf_evict）
+    on_release : buf_ref归零时调用（持有所在桶锁）
+    on_evict   : buf被选为牺牲者、解除与旧block的绑定之前调用（持有lk_buf_evict）
+    better     : a是否比b更适合被淘汰（持有lk_buf_evict和a、b所在桶锁）
+*/
+typedef struct buf_policy {
+    char* name;
+    void (*on_bind)(buf_node_t* node);
+    void (*on_release)(buf_node_t* node);
+    void (*on_evict)(buf_node_t* node);
+    bool (*better)(buf_node_t* a, buf_node_t* b);
+} buf_policy_t;
+
+// 2Q队列标记（LRU策略下新绑定的buf统一标记为Q_AM, 便于两种策略之间切换）
+#define Q_A1IN 0
+#define Q_AM   1
+
+static uint32 twoq_a1in_cnt;              // 标记为A1in的buf数量（由lk_buf_evict保护）
+
+// ---------------------- LRU: 淘汰最久未被释放的buf ----------------------
+
+static void lru_on_bind(buf_node_t* node)
+{
+    node->queue = Q_AM;
+}
+
+static void lru_on_release(buf_node_t* node)
+{
+    node->lru_stamp = __sync_fetch_and_add(&lru_clock, 1);
+}
+
+static void lru_on_evict(buf_node_t* node)
+{
+    // 切换策略前由2Q放入A1in的buf
+    if (node->queue == Q_A1IN) {
+        twoq_a1in_cnt--;
+    }
+}
+
+static bool lru_better(buf_node_t* a, buf_node_t* b)
+{
+    return a->lru_stamp < b->lru_stamp;
+}
+
+static buf_policy_t policy_lru = {
+    "lru", lru_on_bind, lru_on_release, lru_on_evict, lru_better,
+};
+
+/*
+    ---------------------- 2Q: 抗扫描的替换策略 ----------------------
+    A1in: 第一次被访问的block, FIFO（驻留期间的再次访问不提升, 吸收同一块的连续小读写）
+    A1out: 从A1in淘汰的block_num记录（不占用buf, 只记编号）
+    Am  : 在A1out中被再次访问的block, LRU
+    一次大的顺序读只会在A1in中轮转, 反复使用的超级块/位图/inode块/目录块留在Am中
+*/
+#define TWOQ_KIN  (n_buf / 4)         // A1in目标大小: 超过时优先淘汰A1in
+#define TWOQ_KOUT (N_BUF_MAX / 2)     // A1out记录的block_num数量
+
+static uint32 twoq_a1out[TWOQ_KOUT];      // A1out环形队列（由lk_buf_evict保护）
+static uint32 twoq_a1out_head;            // 下一个写入位置
+
+// A1out中查找并移除block_num, 找到返回true
+static bool twoq_a1out_take(uint32 block_num)
+{
+    for (int i = 0; i < TWOQ_KOUT; i++) {
+        if (twoq_a1out[i] == block_num) {
+            twoq_a1out[i] = BLOCK_NUM_UNUSED;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void twoq_on_bind(buf_node_t* node)
+{
+    node->lru_stamp = __sync_fetch_and_add(&lru_clock, 1);
+    if (twoq_a1out_take(node->buf.block_num)) {
+        node->queue = Q_AM;
     } else {
-        // 插入到head->prev（空闲/最少使用侧，链表尾部，符合LRU策略）
-        buf_node->next = &head_buf;
-        buf_node->prev = head_buf.prev;
-        head_buf.prev->next = buf_node;
-        head_buf.prev = buf_node;
+        node->queue = Q_A1IN;
+        twoq_a1in_cnt++;
     }
 }
 
+static void twoq_on_release(buf_node_t* node)
+{
+    // A1in是FIFO, 只有Am按最近使用排序
+    if (node->queue == Q_AM) {
+        node->lru_stamp = __sync_fetch_and_add(&lru_clock, 1);
+    }
+}
+
+static void twoq_on_evict(buf_node_t* node)
+{
+    if (node->queue == Q_A1IN) {
+        twoq_a1in_cnt--;
+        twoq_a1out[twoq_a1out_head] = node->buf.block_num;
+        twoq_a1out_head = (twoq_a1out_head + 1) % TWOQ_KOUT;
+    }
+}
+
+static bool twoq_better(buf_node_t* a, buf_node_t* b)
+{
+    if (a->queue != b->queue) {
+        // A1in超过目标大小时优先淘汰A1in, 否则优先淘汰Am
+        bool prefer_a1in = twoq_a1in_cnt > TWOQ_KIN;
+        return (a->queue == Q_A1IN) == prefer_a1in;
+    }
+    return a->lru_stamp < b->lru_stamp;
+}
+
+static buf_policy_t policy_2q = {
+    "2q", twoq_on_bind, twoq_on_release, twoq_on_evict, twoq_better,
+};
+
+static buf_policy_t* buf_policies[] = { &policy_lru, &policy_2q };
+static buf_policy_t* buf_policy = &policy_2q;  // 当前使用的替换策略（由lk_buf_evict保护切换）
+
+// 【内部辅助函数】将节点从所在链表中摘除
+static void list_remove(buf_node_t* buf_node)
+{
+    if (buf_node->next != NULL) {
+        buf_node->next->pprev = buf_node->pprev;
+    }
+    *buf_node->pprev = buf_node->next;
+    buf_node->next = NULL;
+    buf_node->pprev = NULL;
+    buf_node->bucket = NULL;
+}
+
+// 【内部辅助函数】将节点插入到桶链表头部（最近使用侧）, 若已在链表中则先摘除
+static void list_push_front(buf_bucket_t* bucket, buf_node_t* buf_node)
+{
+    if (bucket->first == buf_node) {
+        return;
+    }
+    if (buf_node->pprev != NULL) {
+        list_remove(buf_node);
+    }
+    buf_node->next = bucket->first;
+    if (bucket->first != NULL) {
+        bucket->first->pprev = &buf_node->next;
+    }
+    buf_node->pprev = &bucket->first;
+    buf_node->bucket = bucket;
+    bucket->first = buf_node;
+}
+
+// 【内部辅助函数】在桶中查找block_num对应的节点，未命中返回NULL
+// 调用者需持有bucket->lk
+static buf_node_t* bucket_lookup(buf_bucket_t* bucket, uint32 block_num)
+{
+    for (buf_node_t* node = bucket->first; node != NULL; node = node->next) {
+        if (node->buf.block_num == block_num) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+// 【内部辅助函数】初始化一个未绑定block的buf节点
+static void buf_node_init(buf_node_t* node)
+{
+    buf_t* buf = &node->buf;
+
+    // 1. 初始化缓冲区核心字段（空闲状态）
+    buf->block_num = BLOCK_NUM_UNUSED;  // 未绑定任何磁盘块
+    buf->buf_ref = 0;                   // 初始无引用
+    buf->disk = false;                  // 初始未与磁盘同步（清零，避免脏数据）
+    buf->dirty = false;                 // 初始无待写回数据
+    buf->valid = false;                 // 初始data无效
+    buf->logged = false;                // 不在日志事务中
+    memset(buf->data, 0, BLOCK_SIZE);   // 缓存数据区域清零
+
+    // 2. 初始化缓冲区睡眠锁（保护data数据和磁盘操作）
+    sleeplock_init(&buf->slk, "buf_sleeplock");
+
+    // 3. 初始化链表节点指针（初始为NULL，标记未加入链表）
+    node->next = NULL;
+    node->pprev = NULL;
+    node->bucket = NULL;
+    node->lru_stamp = 0;
+    node->queue = Q_AM;                 // 未绑定的buf不计入A1in
+}
+
+static uint32 buf_reclaim(uint32 target);
+
 // 【对外接口】buf cache初始化（必须在使用其他buf接口前调用）
 void buf_init()
 {
-    // 1. 初始化buf cache全局自旋锁（保护链表和引用计数）
-    spinlock_init(&lk_buf_cache, "buf_cache");
+    // 1. 初始化淘汰路径的自旋锁和写回状态
+    spinlock_init(&lk_buf_evict, "buf_evict");
+    lru_clock = 0;
+    n_dirty = 0;
+    last_flush_tick = 0;
+    flushing = 0;
+    spinlock_init(&lk_commit, "buf_commit");
+    commit_started = 0;
+    commit_done = 0;
+    committing = false;
+    buf_pages = NULL;
+    // buf页属于内核区域, 但用户区域紧张时归还它们也能让用户区域借到页
+    // (pcache_grab持有lk_pcache申请用户页时可能调用buf_reclaim; 内核区域没有注册pcache_reclaim,
+    //  buf_grow持有lk_buf_evict申请内核页时不会反过来获取lk_pcache)
+    pmem_register_reclaim(true, buf_reclaim);
+    pmem_register_reclaim(false, buf_reclaim);
+#if !BUF_DATA_INLINE
+    kmem_cache_init(&buf_page_cache, "buf_page", sizeof(buf_page_t), MEMTAG_BUF);
+#endif
+    n_buf = N_BLOCK_BUF;
+    n_unbound = N_BLOCK_BUF;
+    n_waiters = 0;
+    memset(buf_counter, 0, sizeof(buf_counter));
+    twoq_a1in_cnt = 0;
+    twoq_a1out_head = 0;
+    for (int i = 0; i < TWOQ_KOUT; i++) {
+        twoq_a1out[i] = BLOCK_NUM_UNUSED;
+    }
 
-    // 2. 初始化哨兵头节点，构建空的双向循环链表
-    head_buf.next = &head_buf;
-    head_buf.prev = &head_buf;
+    // 2. 初始化每个哈希桶的自旋锁和哨兵头节点
+    for (int i = 0; i < N_BUF_BUCKET; i++) {
+        spinlock_init_ticket(&buf_bucket[i].lk, "buf_bucket");
+        buf_bucket[i].first = NULL;
+    }
 
-    // 3. 遍历初始化所有缓冲区节点，加入空闲链表（head->prev侧）
+    // 3. 遍历初始化所有缓冲区节点，轮流分配到各个桶中
     for (int i = 0; i < N_BLOCK_BUF; i++) {
-        buf_node_t* curr_node = &buf_cache[i];
-        buf_t* curr_buf = &curr_node->buf;
+#if !BUF_DATA_INLINE
+        buf_cache[i].buf.data = buf_cache_data[i];
+#endif
+        buf_node_init(&buf_cache[i]);
+        // 空闲缓冲区可以放在任意桶里, 淘汰时会迁移到目标桶
+        list_push_front(&buf_bucket[i % N_BUF_BUCKET], &buf_cache[i]);
+    }
+}
 
-        // 3.1 初始化缓冲区核心字段（空闲状态）
-        curr_buf->block_num = BLOCK_NUM_UNUSED;  // 未绑定任何磁盘块
-        curr_buf->buf_ref = 0;                   // 初始无引用
-        curr_buf->disk = false;                  // 初始未与磁盘同步（清零，避免脏数据）
-        memset(curr_buf->data, 0, BLOCK_SIZE);   // 缓存数据区域清零
+// 【内部辅助函数】申请一个buf页并设置其中每个buf的data, 失败返回NULL
+static buf_page_t* buf_page_alloc()
+{
+#if BUF_DATA_INLINE
+    return (buf_page_t*)pmem_alloc_flags(true, PMEM_ZERO | PMEM_TAG(MEMTAG_BUF));
+#else
+    buf_page_t* page = (buf_page_t*)kmem_cache_alloc(&buf_page_cache);
+    if (page == NULL) {
+        return NULL;
+    }
+    page->data = (uint8*)pmem_alloc_flags(true, PMEM_ZERO | PMEM_TAG(MEMTAG_BUF));
+    if (page->data == NULL) {
+        kmem_cache_free(&buf_page_cache, page);
+        return NULL;
+    }
+    for (int i = 0; i < BUF_PER_PAGE; i++) {
+        page->nodes[i].buf.data = page->data + i * BLOCK_SIZE;
+    }
+    return page;
+#endif
+}
 
-        // 3.2 初始化缓冲区睡眠锁（保护data数据和磁盘操作）
-        sleeplock_init(&curr_buf->slk, "buf_sleeplock");
+// 【内部辅助函数】归还buf_page_alloc申请的页
+static void buf_page_free(buf_page_t* page)
+{
+#if BUF_DATA_INLINE
+    pmem_free((uint64)page, true);
+#else
+    pmem_free((uint64)page->data, true);
+    kmem_cache_free(&buf_page_cache, page);
+#endif
+}
 
-        // 3.3 初始化链表节点指针（初始为NULL，标记未加入链表）
-        curr_node->next = NULL;
-        curr_node->prev = NULL;
+// 【内部辅助函数】页内第i个buf所在的桶是否与前面的某个buf相同（同一个桶只上锁一次）
+static bool buf_page_bucket_seen(buf_page_t* page, int i)
+{
+    for (int j = 0; j < i; j++) {
+        if (page->nodes[j].bucket == page->nodes[i].bucket) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    【内部辅助函数】收缩: 把所有buf都空闲（未引用、干净、无在途I/O）的动态页归还给pmem
+    直到内核区空闲页恢复到BUF_PMEM_HIGH以上
+    调用者必须持有lk_buf_evict, 且不持有任何桶锁
+    每一页只锁住页内buf所在的桶（最多BUF_PER_PAGE个）: 持有lk_buf_evict时buf不会换桶,
+    而同时持有多个桶锁的路径都已被lk_buf_evict串行化, 上锁顺序无关紧要
+*/
+static void buf_shrink()
+{
+    buf_page_t** pp = &buf_pages;
+
+    while (*pp != NULL && pmem_free_pages(true) < BUF_PMEM_HIGH) {
+        buf_page_t* page = *pp;
+        buf_bucket_t* buckets[BUF_PER_PAGE];
+        int n_locked = 0;
+        bool idle = true;
+
+        // 1. 锁住页内buf所在的桶, 检查页内buf是否都空闲
+        for (int i = 0; i < BUF_PER_PAGE; i++) {
+            if (!buf_page_bucket_seen(page, i)) {
+                buckets[n_locked] = page->nodes[i].bucket;
+                spinlock_acquire(&buckets[n_locked]->lk);
+                n_locked++;
+            }
+        }
+        for (int i = 0; i < BUF_PER_PAGE; i++) {
+            buf_t* buf = &page->nodes[i].buf;
+            if (buf->buf_ref != 0 || buf->dirty || buf->disk) {
+                idle = false;
+                break;
+            }
+        }
 
-        // 3.4 将节点插入到空闲链表（head->prev侧，符合LRU策略）
-        insert_head(curr_node, false);
+        // 2. 全部空闲则从桶中摘除
+        if (idle) {
+            for (int i = 0; i < BUF_PER_PAGE; i++) {
+                buf_node_t* node = &page->nodes[i];
+                if (node->buf.block_num == BLOCK_NUM_UNUSED) {
+                    n_unbound--;
+                } else {
+                    buf_policy->on_evict(node);
+                    BUF_COUNT(evictions, 1);
+                }
+                list_remove(node);
+            }
+        }
+        for (int i = n_locked - 1; i >= 0; i--) {
+            spinlock_release(&buckets[i]->lk);
+        }
+
+        // 3. 归还物理页
+        if (idle) {
+            *pp = page->next;
+            n_buf -= BUF_PER_PAGE;
+            buf_page_free(page);
+        } else {
+            pp = &page->next;
+        }
     }
 }
 
-// 【对外接口】读取指定磁盘块到缓冲区（合并xv6 bget()逻辑，支持LRU缓存）
-// 功能：优先查找缓存，未缓存则分配空闲缓冲区从磁盘读取，无空闲则panic
-buf_t* buf_read(uint32 block_num)
+/*
+    【内部辅助函数】pmem回收函数: 收缩动态buf页, 返回归还的页数
+    buf_grow持有lk_buf_evict申请物理页, 这时直接返回0
+*/
+static uint32 buf_reclaim(uint32 target)
+{
+    if (spinlock_holding(&lk_buf_evict)) {
+        return 0;
+    }
+    spinlock_acquire(&lk_buf_evict);
+    uint32 before = n_buf;
+    buf_shrink();
+    uint32 freed = (before - n_buf) / BUF_PER_PAGE;
+    spinlock_release(&lk_buf_evict);
+    return freed;
+}
+
+/*
+    【内部辅助函数】扩容: 申请一个内核物理页, 切分成BUF_PER_PAGE个未绑定的buf
+    达到N_BUF_MAX或内核区空闲页不多时不扩容（空闲页过少时顺便收缩）, 成功返回true
+    调用者必须持有lk_buf_evict, 且不持有任何桶锁
+*/
+static bool buf_grow()
+{
+    uint32 free_pages = pmem_free_pages(true);
+
+    if (free_pages < BUF_PMEM_LOW) {
+        buf_shrink();
+        return false;
+    }
+    if (n_buf + BUF_PER_PAGE > N_BUF_MAX || free_pages < BUF_PMEM_HIGH) {
+        return false;
+    }
+
+    buf_page_t* page = buf_page_alloc();
+    if (page == NULL) {
+        return false;
+    }
+    page->next = buf_pages;
+    buf_pages = page;
+
+    for (int i = 0; i < BUF_PER_PAGE; i++) {
+        buf_node_t* node = &page->nodes[i];
+        buf_bucket_t* bucket = &buf_bucket[(n_buf + i) % N_BUF_BUCKET];
+        buf_node_init(node);
+        spinlock_acquire(&bucket->lk);
+        list_push_front(bucket, node);
+        spinlock_release(&bucket->lk);
+    }
+    n_buf += BUF_PER_PAGE;
+    n_unbound += BUF_PER_PAGE;
+    return true;
+}
+
+// 【内部辅助函数】有buf变为可淘汰时唤醒等待空闲buf的进程
+// 在lk_buf_evict保护下唤醒, 与buf_get中"检查 -> 睡眠"的过程互斥, 不会丢失唤醒
+static void buf_wakeup_waiters()
+{
+    if (n_waiters > 0) {
+        spinlock_acquire(&lk_buf_evict);
+        proc_wakeup(&n_waiters);
+        spinlock_release(&lk_buf_evict);
+    }
+}
+
+/*
+    【内部辅助函数】淘汰路径: 在所有桶中选出最久未使用的空闲buf并迁移到目标桶
+    调用者必须持有lk_buf_evict, 且不持有任何桶锁
+    返回时持有目标桶的锁, 返回的buf已绑定block_num且buf_ref=1（valid = false）
+    若其他hart已经把该block读入缓存, 则直接返回已有的buf（buf_ref++）
+    dirty buf和预读尚未完成的buf不会被选为牺牲者: 没有可用的空闲buf时返回NULL,
+    此时不持有任何桶锁, 由调用者决定写回dirty buf后重试还是放弃（磁盘I/O会睡眠, 不能在自旋锁内完成）
+*/
+static buf_node_t* buf_evict(uint32 block_num, buf_bucket_t* target)
+{
+    buf_node_t* victim = NULL;
+    buf_bucket_t* victim_bucket = NULL;
+
+    // 1. 持有淘汰锁后再次查找: 命中路径不会插入新buf, 所以这次结果是可信的
+    spinlock_acquire(&target->lk);
+    victim = bucket_lookup(target, block_num);
+    if (victim != NULL) {
+        victim->buf.buf_ref++;
+        return victim;
+    }
+    spinlock_release(&target->lk);
+
+    // 2. 逐个桶扫描, 按替换策略找到最适合淘汰的空闲buf（从未使用过的buf优先）
+    //    扫描过程中一直持有当前最佳候选所在桶的锁, 保证候选不会被其他hart引用
+    //    只有淘汰路径会同时持有两个桶锁, 而淘汰路径已被lk_buf_evict串行化, 不会死锁
+    //    只有持有lk_buf_evict的路径会让桶变空或变为非空（桶内移动不会经过空状态）, 空桶不必上锁检查
+    for (int i = 0; i < N_BUF_BUCKET; i++) {
+        buf_bucket_t* bucket = &buf_bucket[i];
+        bool keep = false;
+
+        if (bucket->first == NULL) {
+            continue;
+        }
+        spinlock_acquire(&bucket->lk);
+        for (buf_node_t* node = bucket->first; node != NULL; node = node->next) {
+            if (node->buf.buf_ref != 0 || node->buf.dirty || node->buf.disk) {
+                continue;
+            }
+            if (victim != NULL) {
+                if (victim->buf.block_num == BLOCK_NUM_UNUSED) {
+                    break;
+                }
+                if (node->buf.block_num != BLOCK_NUM_UNUSED && !buf_policy->better(node, victim)) {
+                    continue;
+                }
+            }
+            if (victim_bucket != NULL && victim_bucket != bucket) {
+                spinlock_release(&victim_bucket->lk);
+            }
+            victim = node;
+            victim_bucket = bucket;
+            keep = true;
+        }
+
+        if (!keep) {
+            spinlock_release(&bucket->lk);
+        }
+    }
+
+    // 3. 没有可用的空闲buf
+    if (victim == NULL) {
+        return NULL;
+    }
+
+    // 4. 从原桶中摘除, 绑定到新的磁盘块
+    if (victim->buf.block_num != BLOCK_NUM_UNUSED) {
+        buf_policy->on_evict(victim);
+        BUF_COUNT(evictions, 1);
+    } else {
+        n_unbound--;
+    }
+    list_remove(victim);
+    victim->buf.block_num = block_num;
+    victim->buf.buf_ref = 1;
+    victim->buf.valid = false;
+    buf_policy->on_bind(victim);
+    spinlock_release(&victim_bucket->lk);
+
+    // 5. 挂入目标桶（持有目标桶锁返回）
+    spinlock_acquire(&target->lk);
+    list_push_front(target, victim);
+    return victim;
+}
+
+// 【内部辅助函数】解除buf_flush_batch对buf的临时引用（不改变LRU顺序, 没有持有睡眠锁）
+static void buf_unref(buf_node_t* node)
+{
+    buf_bucket_t* bucket = &buf_bucket[BUF_HASH(node->buf.block_num)];
+    spinlock_acquire(&bucket->lk);
+    assert(node->buf.buf_ref > 0, "buf_drop_ref: buf ref count is zero");
+    node->buf.buf_ref--;
+    bool idle = (node->buf.buf_ref == 0);
+    spinlock_release(&bucket->lk);
+
+    if (idle) {
+        buf_wakeup_waiters();
+    }
+}
+
+// 【内部辅助函数】放开睡眠锁并解除buf_flush_batch对buf的临时引用
+static void buf_drop_ref(buf_node_t* node)
+{
+    sleeplock_release(&node->buf.slk);
+    buf_unref(node);
+}
+
+// 【内部辅助函数】等待buf_flush_batch提交的写请求完成, 清除dirty并解除固定
+static void buf_flush_wait(buf_t** bufs, int n)
+{
+    for (int i = 0; i < n; i++) {
+        blk_wait(bufs[i]);
+        bufs[i]->dirty = false;
+        __sync_fetch_and_sub(&n_dirty, 1);
+        buf_drop_ref((buf_node_t*)bufs[i]);
+    }
+}
+
+/*
+    【内部辅助函数】批量写回dirty buf
+    only_free = true : 只写回没有被引用的dirty buf（淘汰路径使用, 调用者可能持有其他buf的睡眠锁）
+                       收集之后别的进程可能命中并锁住其中的buf, 再等待调用者持有的buf: 这里阻塞上锁会形成ABBA死锁,
+                       所以每个buf都只尝试上锁, 失败的直接放弃; 返回实际写回的buf数量
+    only_free = false: 写回所有dirty buf（调用者不能持有任何buf的睡眠锁, 否则会死锁）, 返回本次固定的buf数量
+    先在桶锁保护下给目标buf加引用（防止被淘汰）, 再按block_num排序后依次异步提交,
+    让磁盘尽量顺序访问且同时有多个请求在途（一次最多固定BUF_FLUSH_MAX个）
+*/
+#define BUF_FLUSH_MAX 64
+
+static int buf_flush_batch(bool only_free)
+{
+    buf_node_t* batch[BUF_FLUSH_MAX];
+    int n = 0;
+
+    // 1. 收集并固定dirty buf
+    for (int i = 0; i < N_BUF_BUCKET && n < BUF_FLUSH_MAX; i++) {
+        buf_bucket_t* bucket = &buf_bucket[i];
+        spinlock_acquire(&bucket->lk);
+        for (buf_node_t* node = bucket->first; node != NULL && n < BUF_FLUSH_MAX; node = node->next) {
+            if (node->buf.dirty && !node->buf.logged && (!only_free || node->buf.buf_ref == 0)) {
+                node->buf.buf_ref++;
+                batch[n++] = node;
+            }
+        }
+        spinlock_release(&bucket->lk);
+    }
+
+    // 2. 按block_num升序排列（插入排序, n不超过BUF_FLUSH_MAX）
+    for (int i = 1; i < n; i++) {
+        buf_node_t* key = batch[i];
+        int j = i - 1;
+        while (j >= 0 && batch[j]->buf.block_num > key->buf.block_num) {
+            batch[j + 1] = batch[j];
+            j--;
+        }
+        batch[j + 1] = key;
+    }
+
+    // 3. 依次把写请求放入块设备队列（持有睡眠锁后再次确认dirty, 期间可能已被其他hart写回）
+    //    相邻block的请求由块设备层合并成一个磁盘请求, 全部入队后统一派发和等待
+    //    已有请求在途（持有它们的睡眠锁）时只尝试上锁: 持有多个睡眠锁时等待别人可能形成死锁,
+    //    上锁失败则先等待在途请求完成、释放全部睡眠锁后再阻塞上锁 (only_free时放弃这个buf)
+    buf_t* inflight[BUF_FLUSH_MAX];
+    int n_inflight = 0;
+    int written = 0;
+
+    for (int i = 0; i < n; i++) {
+        if (only_free) {
+            if (!sleeplock_try_acquire(&batch[i]->buf.slk)) {
+                buf_unref(batch[i]);
+                continue;
+            }
+        } else if (n_inflight == 0) {
+            sleeplock_acquire(&batch[i]->buf.slk);
+        } else if (!sleeplock_try_acquire(&batch[i]->buf.slk)) {
+            buf_flush_wait(inflight, n_inflight);
+            n_inflight = 0;
+            sleeplock_acquire(&batch[i]->buf.slk);
+        }
+        if (!batch[i]->buf.dirty || batch[i]->buf.logged) {
+            buf_drop_ref(batch[i]);
+            continue;
+        }
+
+        blk_submit(&batch[i]->buf, true, false);
+        BUF_COUNT(writebacks, 1);
+        inflight[n_inflight++] = &batch[i]->buf;
+        written++;
+    }
+
+    // 4. 等待剩余的在途请求
+    buf_flush_wait(inflight, n_inflight);
+    return only_free ? written : n;
+}
+
+// 【内部辅助函数】获取block_num对应的缓冲区并持有其睡眠锁（xv6 bget()），不读取磁盘
+// 功能：命中时只持有block_num所在桶的锁；未命中时进入串行化的淘汰路径
+// 返回时若有预读请求在途则已等待其完成, data是否有效由buf->valid表示
+static buf_t* buf_get(uint32 block_num)
 {
     // 入参合法性校验：无效磁盘块编号直接报错
     if (block_num == BLOCK_NUM_UNUSED) {
-        panic("buf_read: invalid block number (BLOCK_NUM_UNUSED)");
+        panic("buf_get: invalid block number (BLOCK_NUM_UNUSED)");
     }
 
+    buf_bucket_t* bucket = &buf_bucket[BUF_HASH(block_num)];
     buf_node_t* target_node = NULL;
 
-    // 第一步：获取自旋锁，保护链表遍历和引用计数操作
-    spinlock_acquire(&lk_buf_cache);
+    BUF_COUNT(lookups, 1);
 
-    // 第二步：遍历已分配链表（head->next侧），查找是否已缓存该磁盘块
-    for (target_node = head_buf.next; target_node != &head_buf; target_node = target_node->next) {
-        if (target_node->buf.block_num == block_num) {
-            // 找到已缓存的缓冲区，增加引用计数（标记新增一个使用者）
-            target_node->buf.buf_ref++;
+    // 第一步：获取桶锁，在桶内查找是否已缓存该磁盘块
+    spinlock_acquire(&bucket->lk);
+    target_node = bucket_lookup(bucket, block_num);
+    if (target_node != NULL) {
+        // 找到已缓存的缓冲区，增加引用计数（标记新增一个使用者）
+        target_node->buf.buf_ref++;
+        spinlock_release(&bucket->lk);
+        BUF_COUNT(hits, 1);
+    } else {
+        spinlock_release(&bucket->lk);
+        BUF_COUNT(misses, 1);
 
-            // 释放自旋锁（链表操作完成，后续操作不涉及链表）
-            spinlock_release(&lk_buf_cache);
+        // 第二步：未命中，进入淘汰路径（返回时持有目标桶锁）
+        // 没有未绑定的buf时先尝试扩容; 空闲buf全部是dirty时先写回再重试;
+        // 所有buf都在使用中时睡眠等待其他进程释放
+        for (;;) {
+            spinlock_acquire(&lk_buf_evict);
+            if (n_unbound == 0) {
+                buf_grow();
+            }
+            target_node = buf_evict(block_num, bucket);
+            if (target_node != NULL) {
+                break;
+            }
+            spinlock_release(&lk_buf_evict);
 
-            // 第三步：获取缓冲区睡眠锁，保护核心数据访问（排他性，确保数据安全）
-            sleeplock_acquire(&target_node->buf.slk);
+            if (buf_flush_batch(true) > 0) {
+                continue;
+            }
 
-            // 直接返回已缓存的缓冲区（无需从磁盘读取，提升效率）
-            return &target_node->buf;
+            // 先登记为等待者再检查一次, 之后释放buf的进程一定能看到n_waiters > 0
+            spinlock_acquire(&lk_buf_evict);
+            __sync_fetch_and_add(&n_waiters, 1);
+            target_node = buf_evict(block_num, bucket);
+            if (target_node != NULL) {
+                __sync_fetch_and_sub(&n_waiters, 1);
+                break;
+            }
+            proc_sleep(&n_waiters, &lk_buf_evict);
+            __sync_fetch_and_sub(&n_waiters, 1);
+            spinlock_release(&lk_buf_evict);
         }
+        spinlock_release(&bucket->lk);
+        spinlock_release(&lk_buf_evict);
     }
 
-    // 第三步：未找到缓存，遍历空闲链表（head->prev侧，LRU策略：从最少使用侧查找空闲）
-    for (target_node = head_buf.prev; target_node != &head_buf; target_node = target_node->prev) {
-        if (target_node->buf.buf_ref == 0) {  // 引用计数为0，表示无进程使用，为空闲缓冲区
-            // 初始化空闲缓冲区，绑定目标磁盘块
-            target_node->buf.block_num = block_num;
-            target_node->buf.buf_ref = 1;  // 引用计数置1（当前调用者为第一个使用者）
-            target_node->buf.disk = false; // 重置磁盘同步标志（准备从磁盘读取数据）
+    // 第三步：获取缓冲区睡眠锁，保护磁盘I/O和数据访问（统计等待时间）
+    buf_t* buf = &target_node->buf;
+    uint64 wait_start = timer_get_mtime();
+    sleeplock_acquire(&buf->slk);
+    BUF_COUNT(slk_wait, timer_get_mtime() - wait_start);
 
-            // 释放自旋锁（链表操作完成，后续操作不涉及链表）
-            spinlock_release(&lk_buf_cache);
+    // 第四步：预读请求尚未完成则等待
+    if (buf->disk) {
+        blk_wait(buf);
+    }
+    return buf;
+}
 
-            // 第四步：获取缓冲区睡眠锁，保护磁盘I/O和数据访问
-            sleeplock_acquire(&target_node->buf.slk);
+// 【对外接口】读取指定磁盘块到缓冲区（返回时持有睡眠锁）
+buf_t* buf_read(uint32 block_num)
+{
+    TSTAT_BEGIN(t);
+    buf_t* buf = buf_get(block_num);
+
+    // data无效则从磁盘读取（false=读操作）
+    if (!buf->valid) {
+        blk_rw(buf, false);
+        buf->valid = true;
+        BUF_COUNT(disk_reads, 1);
+        PROC_IO_ADD(buf_misses, 1);
+        TSTAT_END(t, TSTAT_BUF_MISS);
+    } else {
+        PROC_IO_ADD(buf_hits, 1);
+        TSTAT_END(t, TSTAT_BUF_HIT);
+    }
+    return buf;
+}
+
+// 【对外接口】读入从block_num开始的连续n个block（n <= BUF_CLUSTER）, bufs[i]对应block_num + i
+// 每个buf都持有睡眠锁, 由调用者逐个buf_release; 未缓存的连续block合并成一个磁盘请求
+void buf_read_cluster(uint32 block_num, uint32 n, buf_t** bufs)
+{
+    assert(n >= 1 && n <= BUF_CLUSTER && n <= VIRTIO_MAX_SEG, "buf_read_cluster: bad cluster size");
+
+    // 1. 按block_num升序获取并锁住全部buf
+    for (uint32 i = 0; i < n; i++) {
+        bufs[i] = buf_get(block_num + i);
+    }
 
-            // 第五步：调用虚拟磁盘驱动，从磁盘读取数据到缓冲区（false=读操作）
-            virtio_disk_rw(&target_node->buf, false);
+    // 2. 无效的buf全部放入块设备队列（连续的由块设备层合并成一个请求）, 再统一等待
+    for (uint32 i = 0; i < n; i++) {
+        if (!bufs[i]->valid) {
+            blk_submit(bufs[i], false, false);
+            BUF_COUNT(disk_reads, 1);
+            PROC_IO_ADD(buf_misses, 1);
+            bufs[i]->valid = true;
+        } else {
+            PROC_IO_ADD(buf_hits, 1);
+        }
+    }
+    for (uint32 i = 0; i < n; i++) {
+        if (bufs[i]->disk) {
+            blk_wait(bufs[i]);
+        }
+    }
+}
+
+// 【对外接口】写连续的n个block（bufs[i]->block_num == bufs[0]->block_num + i, 调用者持有全部睡眠锁）
+// 写回模式下只标记dirty（写回时会再次合并）, 否则用一个磁盘请求同步写盘
+void buf_write_cluster(buf_t** bufs, uint32 n)
+{
+    assert(n >= 1 && n <= BUF_CLUSTER && n <= VIRTIO_MAX_SEG, "buf_write_cluster: bad cluster size");
 
-            // 标记缓冲区已与磁盘同步，返回缓冲区指针
-            target_node->buf.disk = true;
-            return &target_node->buf;
+    if (buf_writeback || n == 1) {
+        for (uint32 i = 0; i < n; i++) {
+            buf_write(bufs[i]);
         }
+        return;
     }
 
-    // 第四步：无空闲缓冲区可用，直接panic报错（缓冲区耗尽）
-    spinlock_release(&lk_buf_cache);  // 释放自旋锁，避免死锁
-    panic("buf_read: no free buf available (all  bufs are in use)");
-    return NULL;  // 不可达，仅用于满足函数返回值要求
+    for (uint32 i = 0; i < n; i++) {
+        assert(sleeplock_holding(&bufs[i]->slk), "buf_write_cluster: not holding buf sleeplock");
+    }
+    for (uint32 i = 0; i < n; i++) {
+        blk_submit(bufs[i], true, false);
+    }
+    BUF_COUNT(sync_writes, 1);
+    for (uint32 i = 0; i < n; i++) {
+        blk_wait(bufs[i]);
+        if (bufs[i]->dirty) {
+            bufs[i]->dirty = false;
+            __sync_fetch_and_sub(&n_dirty, 1);
+        }
+    }
+}
+
+// 【对外接口】获取指定磁盘块的缓冲区但不从磁盘读取（返回时持有睡眠锁）
+// 用于整块覆盖写: 调用者必须在释放前写满整个data, 否则其中是其他block的残留数据
+buf_t* buf_get_nofill(uint32 block_num)
+{
+    buf_t* buf = buf_get(block_num);
+    buf->valid = true;
+    return buf;
+}
+
+// 【对外接口】异步预读指定磁盘块到缓冲区, 不等待磁盘完成
+// 已缓存时返回true; 没有可用的空闲buf、或者磁盘队列已满时直接放弃并返回false（预读只是优化）
+bool buf_prefetch(uint32 block_num)
+{
+    if (block_num == BLOCK_NUM_UNUSED) {
+        return false;
+    }
+
+    buf_bucket_t* bucket = &buf_bucket[BUF_HASH(block_num)];
+    buf_node_t* target_node = NULL;
+
+    // 1. 已经在缓存中（或正在预读）则不需要再读
+    spinlock_acquire(&bucket->lk);
+    target_node = bucket_lookup(bucket, block_num);
+    spinlock_release(&bucket->lk);
+    if (target_node != NULL) {
+        return true;
+    }
+
+    // 2. 绑定一个空闲buf（可以扩容, 但不为预读写回dirty buf或等待）
+    spinlock_acquire(&lk_buf_evict);
+    if (n_unbound == 0) {
+        buf_grow();
+    }
+    target_node = buf_evict(block_num, bucket);
+    if (target_node == NULL) {
+        spinlock_release(&lk_buf_evict);
+        return false;
+    }
+    spinlock_release(&bucket->lk);
+    spinlock_release(&lk_buf_evict);
+
+    // 3. 持有睡眠锁提交读请求: 请求在途期间b->disk = true, 访问者在buf_read中等待完成
+    buf_t* buf = &target_node->buf;
+    bool ok = true;
+    sleeplock_acquire(&buf->slk);
+    if (!buf->valid && !buf->disk) {
+        ok = blk_submit(buf, false, true);
+        buf->valid = ok;
+        if (ok) {
+            BUF_COUNT(prefetches, 1);
+        }
+    }
+    buf_release(buf);
+    return ok;
+}
+
+/*
+    常驻buf: 额外持有一个引用, 因此永远不会被淘汰或收缩
+    持有者保存buf指针, 之后通过buf_pinned_lock()/buf_pinned_unlock()直接访问,
+    不需要哈希查找, 也不修改引用计数和替换策略状态
+*/
+
+// 【对外接口】读入block并常驻缓存, 返回的buf不持有睡眠锁
+buf_t* buf_pin(uint32 block_num)
+{
+    buf_t* buf = buf_read(block_num);
+    sleeplock_release(&buf->slk);
+    return buf;
+}
+
+// 【对外接口】解除常驻（之后buf可以被正常淘汰）, 调用者不能持有它的睡眠锁
+void buf_unpin(buf_t* buf)
+{
+    sleeplock_acquire(&buf->slk);
+    buf_release(buf);
+}
+
+// 【对外接口】访问常驻buf前获取睡眠锁
+void buf_pinned_lock(buf_t* buf)
+{
+    BUF_COUNT(lookups, 1);
+    BUF_COUNT(hits, 1);
+    sleeplock_acquire(&buf->slk);
+}
+
+// 【对外接口】访问常驻buf结束后释放睡眠锁（不减少引用计数）
+void buf_pinned_unlock(buf_t* buf)
+{
+    assert(sleeplock_holding(&buf->slk), "buf_pinned_unlock: not holding buf sleeplock");
+    sleeplock_release(&buf->slk);
 }
 
-// 【对外接口】将缓冲区数据写入磁盘（强制同步，保证内存与磁盘数据一致）
+// 【对外接口】直接I/O（绕过buf cache读写block_num）之前处理它在cache中的副本
+// 读: dirty副本先同步写盘, 使磁盘上是最新数据; 写: 副本作废（之后的buf_read重新从磁盘读入）
+// 调用者持有文件的inode锁, 期间不会有其他进程通过buf cache读写这个数据块
+void buf_direct_prepare(uint32 block_num, bool write)
+{
+    buf_bucket_t* bucket = &buf_bucket[BUF_HASH(block_num)];
+
+    // 1. 未缓存则无需处理
+    spinlock_acquire(&bucket->lk);
+    buf_node_t* node = bucket_lookup(bucket, block_num);
+    if (node == NULL) {
+        spinlock_release(&bucket->lk);
+        return;
+    }
+    node->buf.buf_ref++;
+    spinlock_release(&bucket->lk);
+
+    // 2. 上锁并等待在途的预读/写回
+    buf_t* buf = &node->buf;
+    sleeplock_acquire(&buf->slk);
+    if (buf->disk) {
+        blk_wait(buf);
+    }
+
+    // 3. 读之前写回dirty数据, 写之前丢弃副本
+    if (buf->dirty) {
+        if (!write) {
+            blk_rw_poll(buf, true);
+            BUF_COUNT(writebacks, 1);
+        }
+        buf->dirty = false;
+        __sync_fetch_and_sub(&n_dirty, 1);
+    }
+    if (write) {
+        buf->valid = false;
+    }
+    buf_release(buf);
+}
+
+// 【对外接口】将缓冲区数据写入磁盘
+// 写回模式下只标记dirty, 由buf_flusher()/淘汰路径批量写盘; 关闭写回模式时同步写盘
 void buf_write(buf_t* buf)
 {
     // 入参合法性校验：缓冲区指针不能为空
@@ -150,11 +995,97 @@ void buf_write(buf_t* buf)
     // 断言：验证调用者是否持有缓冲区睡眠锁（确保数据访问安全，防止非法写入）
     assert(sleeplock_holding(&buf->slk), "buf_write: not holding buf sleeplock (illegal write)");
 
+    // 写回模式: 同一个block的多次修改只需要一次磁盘I/O
+    // 在未提交的日志事务中的block也只标记dirty, 提交之前不能写到原位置
+    if (buf_writeback || buf->logged) {
+        if (!buf->dirty) {
+            buf->dirty = true;
+            __sync_fetch_and_add(&n_dirty, 1);
+        }
+        return;
+    }
+
     // 调用虚拟磁盘驱动，将缓冲区数据写入磁盘（true=写操作）
-    virtio_disk_rw(buf, true);
+    // 单个block的同步写（多为元数据）绕过块设备队列直接提交并轮询等待完成, 比中断+睡眠唤醒的开销小
+    blk_rw_poll(buf, true);
+    BUF_COUNT(sync_writes, 1);
 
     // 标记缓冲区已与磁盘同步，避免重复写入
-    buf->disk = true;
+    if (buf->dirty) {
+        buf->dirty = false;
+        __sync_fetch_and_sub(&n_dirty, 1);
+    }
+}
+
+// 【对外接口】把buf加入日志事务（调用者持有睡眠锁, 由journal_log调用）
+// 标记dirty和logged: 写回和淘汰都跳过它, 额外的引用保证提交时它仍在缓存中
+void buf_log(buf_t* buf)
+{
+    assert(sleeplock_holding(&buf->slk), "buf_log: not holding buf sleeplock");
+    assert(!buf->logged, "buf_log: buf already logged");
+
+    buf->logged = true;
+    if (!buf->dirty) {
+        buf->dirty = true;
+        __sync_fetch_and_add(&n_dirty, 1);
+    }
+
+    buf_bucket_t* bucket = &buf_bucket[BUF_HASH(buf->block_num)];
+    spinlock_acquire(&bucket->lk);
+    buf->buf_ref++;
+    spinlock_release(&bucket->lk);
+}
+
+// 【对外接口】日志事务已提交: buf变回普通的dirty buf（由定时写回写到原位置）, 释放事务持有的引用
+// 调用者不持有它的睡眠锁
+void buf_log_done(buf_t* buf)
+{
+    sleeplock_acquire(&buf->slk);
+    assert(buf->logged, "buf_log_done: buf not logged");
+    buf->logged = false;
+    buf_release(buf);
+}
+
+// 【对外接口】检查点: 把blocks中仍然dirty的block写回原位置, 最后一次写屏障（n <= BUF_FLUSH_MAX）
+// 不在缓存中、已经写回、或者又加入了新事务的block跳过; 调用者不能持有任何buf的睡眠锁
+void buf_checkpoint(uint32* blocks, uint32 n)
+{
+    assert(n <= BUF_FLUSH_MAX, "buf_checkpoint: too many blocks");
+    buf_t* inflight[BUF_FLUSH_MAX];
+    int n_inflight = 0;
+
+    for (uint32 i = 0; i < n; i++) {
+        // 1. 查找并固定
+        buf_bucket_t* bucket = &buf_bucket[BUF_HASH(blocks[i])];
+        spinlock_acquire(&bucket->lk);
+        buf_node_t* node = bucket_lookup(bucket, blocks[i]);
+        if (node == NULL || !node->buf.dirty) {
+            spinlock_release(&bucket->lk);
+            continue;
+        }
+        node->buf.buf_ref++;
+        spinlock_release(&bucket->lk);
+
+        // 2. 与buf_flush_batch相同: 已有请求在途时只尝试上锁
+        if (n_inflight == 0) {
+            sleeplock_acquire(&node->buf.slk);
+        } else if (!sleeplock_try_acquire(&node->buf.slk)) {
+            buf_flush_wait(inflight, n_inflight);
+            n_inflight = 0;
+            sleeplock_acquire(&node->buf.slk);
+        }
+        if (!node->buf.dirty || node->buf.logged) {
+            buf_drop_ref(node);
+            continue;
+        }
+        blk_submit(&node->buf, true, false);
+        BUF_COUNT(writebacks, 1);
+        inflight[n_inflight++] = &node->buf;
+    }
+
+    // 3. 等待完成并落盘
+    buf_flush_wait(inflight, n_inflight);
+    blk_barrier();
 }
 
 // 【对外接口】释放缓冲区引用（减少引用计数，支持LRU缓存策略）
@@ -174,52 +1105,176 @@ void buf_release(buf_t* buf)
     // 第二步：将buf_t*转换为buf_node_t*（利用buf是buf_node_t第一个成员的特性，安全转换）
     buf_node_t* target_node = (buf_node_t*)buf;
 
-    // 第三步：获取自旋锁，保护引用计数修改和链表操作
-    spinlock_acquire(&lk_buf_cache);
+    // 第三步：获取所在桶的锁（buf_ref>0时block_num不会改变，桶是确定的）
+    buf_bucket_t* bucket = &buf_bucket[BUF_HASH(buf->block_num)];
+    spinlock_acquire(&bucket->lk);
 
     // 第四步：减少引用计数（标记调用者已释放该缓冲区）
     assert(target_node->buf.buf_ref > 0, "buf_release: buf ref count is zero (double release)");
     target_node->buf.buf_ref--;
 
-    // 第五步：如果引用计数归0（无任何进程使用），执行LRU策略：迁移到最少使用侧（head->prev）
-    if (target_node->buf.buf_ref == 0) {
-        insert_head(target_node, false);  // 插入到head->prev，标记为空闲/最少使用
+    // 第五步：如果引用计数归0，移动到桶内链表头部并通知替换策略
+    bool idle = (target_node->buf.buf_ref == 0);
+    if (idle) {
+        buf_policy->on_release(target_node);
+        list_push_front(bucket, target_node);
+    }
+
+    // 第六步：释放桶锁, 唤醒等待空闲buf的进程
+    spinlock_release(&bucket->lk);
+    if (idle) {
+        buf_wakeup_waiters();
     }
+}
+
+// 【对外接口】开关写回模式, 关闭时先把已有的dirty buf写回
+// 调用者不能持有任何buf的睡眠锁
+void buf_set_writeback(bool enable)
+{
+    buf_writeback = enable;
+    if (!enable) {
+        buf_sync();
+    }
+}
+
+// 【对外接口】定时写回: 距离上次写回超过BUF_FLUSH_INTERVAL个tick, 或dirty buf达到高水位
+// 由后台工作线程定时调用（见proc/kwork.h）, 调用者不能持有任何buf的睡眠锁
+void buf_flusher()
+{
+    // 内核区内存紧张时归还空闲的动态buf页
+    if (buf_pages != NULL && pmem_free_pages(true) < BUF_PMEM_LOW) {
+        spinlock_acquire(&lk_buf_evict);
+        buf_shrink();
+        spinlock_release(&lk_buf_evict);
+    }
+
+    if (n_dirty == 0) {
+        return;
+    }
+
+    uint64 now = timer_get_ticks();
+    if (n_dirty < BUF_DIRTY_HIGH && now - last_flush_tick < BUF_FLUSH_INTERVAL) {
+        return;
+    }
+
+    // 同一时刻只允许一个hart执行定时写回, 其他hart直接返回
+    if (__sync_lock_test_and_set(&flushing, 1) != 0) {
+        return;
+    }
+    last_flush_tick = now;
+    while (buf_flush_batch(false) == BUF_FLUSH_MAX)
+        ;
+    __sync_lock_release(&flushing);
+}
+
+// 【对外接口】立即写回全部dirty buf并落盘（调用者不能持有任何buf的睡眠锁）
+// 每批写请求都已等待完成, 最后只需要一次写屏障
+void buf_sync()
+{
+    while (buf_flush_batch(false) == BUF_FLUSH_MAX)
+        ;
+    blk_barrier();
+}
 
-    // 第六步：释放自旋锁（链表和引用计数操作完成）
-    spinlock_release(&lk_buf_cache);
+// 【对外接口】组提交: 写回全部dirty buf并落盘, 同时到来的多个调用者合并成一次写回
+// 调用者需要一次在它到来之后才开始的写回（之前开始的那次可能漏掉它的数据）:
+// 写回进行中到来的调用者都等待下一次, 由其中一个执行, 其余的睡眠等待它完成
+// 调用者不能持有任何buf的睡眠锁
+void buf_commit()
+{
+    spinlock_acquire(&lk_commit);
+    uint64 target = commit_started + 1;
+    while (commit_done < target) {
+        if (committing) {
+            proc_sleep(&commit_done, &lk_commit);
+            continue;
+        }
+        committing = true;
+        commit_started++;
+        spinlock_release(&lk_commit);
+
+        buf_sync();
+
+        spinlock_acquire(&lk_commit);
+        commit_done = commit_started;
+        committing = false;
+        proc_wakeup(&commit_done);
+    }
+    spinlock_release(&lk_commit);
+}
+
+// 【对外接口】切换替换策略（BUF_POLICY_LRU / BUF_POLICY_2Q）
+// 已缓存的buf保留原有的时间戳和队列标记, 新策略逐步接管
+void buf_set_policy(uint32 policy)
+{
+    if (policy >= sizeof(buf_policies) / sizeof(buf_policies[0])) {
+        printf("buf_set_policy: unknown policy %d\n", policy);
+        return;
+    }
+
+    spinlock_acquire(&lk_buf_evict);
+    buf_policy = buf_policies[policy];
+    spinlock_release(&lk_buf_evict);
+}
+
+// 【对外接口】读取buf cache统计信息（各字段分别把所有hart的计数加起来, 不保证彼此严格一致）
+void buf_stat(buf_stat_t* st)
+{
+    st->lookups = PCPU_SUM(buf_counter, lookups);
+    st->hits = PCPU_SUM(buf_counter, hits);
+    st->misses = PCPU_SUM(buf_counter, misses);
+    st->evictions = PCPU_SUM(buf_counter, evictions);
+    st->disk_reads = PCPU_SUM(buf_counter, disk_reads);
+    st->sync_writes = PCPU_SUM(buf_counter, sync_writes);
+    st->writebacks = PCPU_SUM(buf_counter, writebacks);
+    st->prefetches = PCPU_SUM(buf_counter, prefetches);
+    st->slk_wait = PCPU_SUM(buf_counter, slk_wait);
+    st->nbuf = n_buf;
 }
 
 // 【对外接口】打印当前buf cache的状态（用于调试，查看缓冲区使用情况）
 void buf_print()
 {
     printf("\n===================== buf_cache status =====================\n");
-    printf("Total bufs: %d\n", N_BLOCK_BUF);
-    printf("Format: buf [index] | ref [count] | block [num] | data [first 8 bytes]\n\n");
-
-    buf_node_t* curr_node = NULL;
+    printf("Total bufs: %d (static %d), buckets: %d, dirty: %d, policy: %s\n",
+           n_buf, N_BLOCK_BUF, N_BUF_BUCKET, n_dirty, buf_policy->name);
+    buf_stat_t st;
+    buf_stat(&st);
+    printf("lookups: %d, hits: %d, misses: %d, evictions: %d\n",
+           (int)st.lookups, (int)st.hits, (int)st.misses, (int)st.evictions);
+    printf("Format: buf [index, -1 for dynamic bufs] | ref [count] | block [num] | data [first 8 bytes]\n\n");
 
-    // 获取自旋锁，保护链表遍历（避免遍历过程中链表结构被修改）
-    spinlock_acquire(&lk_buf_cache);
+    // 逐个桶遍历（每次只持有一个桶锁, 跳过空桶）
+    for (int i = 0; i < N_BUF_BUCKET; i++) {
+        buf_bucket_t* bucket = &buf_bucket[i];
+        spinlock_acquire(&bucket->lk);
+        if (bucket->first == NULL) {
+            spinlock_release(&bucket->lk);
+            continue;
+        }
 
-    // 遍历已分配链表（head->next侧），打印所有缓冲区状态
-    for (curr_node = head_buf.next; curr_node != &head_buf; curr_node = curr_node->next) {
-        buf_t* curr_buf = &curr_node->buf;
-        int buf_index = (int)(curr_node - buf_cache);  // 计算缓冲区在数组中的索引
+        printf("bucket [%d]:\n", i);
+        for (buf_node_t* curr_node = bucket->first; curr_node != NULL; curr_node = curr_node->next) {
+            buf_t* curr_buf = &curr_node->buf;
+            // 计算缓冲区在静态数组中的索引（动态扩容的buf为-1）
+            int buf_index = -1;
+            if (curr_node >= buf_cache && curr_node < buf_cache + N_BLOCK_BUF) {
+                buf_index = (int)(curr_node - buf_cache);
+            }
 
-        // 打印缓冲区核心信息
-        printf("buf [%2d] | ref [%2d] | block [0x%08X] | data [",
-               buf_index, curr_buf->buf_ref, curr_buf->block_num);
+            // 打印缓冲区核心信息
+            printf("buf [%d] | ref [%d] | block [%x] | data [",
+                   buf_index, curr_buf->buf_ref, curr_buf->block_num);
 
-        // 打印缓冲区数据的前8个字节（用于调试，查看数据内容）
-        for (int i = 0; i < 8; i++) {
-            printf("%02X ", curr_buf->data[i]);
+            // 打印缓冲区数据的前8个字节（用于调试，查看数据内容）
+            for (int j = 0; j < 8; j++) {
+                printf("%x ", curr_buf->data[j]);
+            }
+            printf("]\n");
         }
-        printf("]\n");
-    }
 
-    // 释放自旋锁（遍历完成）
-    spinlock_release(&lk_buf_cache);
+        spinlock_release(&bucket->lk);
+    }
 
     printf("=============================================================\n\n");
-}
\ No newline at end of file
+}
@@ -0,0 +1,368 @@
+#include "fs/buf.h"
+#include "fs/pcache.h"
+#include "fs/compress.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "proc/cpu.h"
+#include "lib/print.h"
+#include "lib/str.h"
+
+/*
+    压缩文件的cluster读写 (见fs/compress.h)
+    编解码使用LZ4的块格式: 一串序列, 每个序列是 token (高4位字面量长度, 低4位匹配长度-4) + 长度扩展字节
+    + 字面量 + 2字节的匹配距离 (小端) + 匹配长度扩展字节, 最后一个序列只有字面量
+    压缩是单趟的贪心匹配: 4字节的哈希表记录每个哈希最近出现的位置, 命中且内容相同就向后扩展匹配
+    cluster的块经过buf cache读写 (与页缓存没有可替换的页时的普通文件相同), 只由持有inode锁的进程访问
+    临时页 (快照 / 压缩输出 / 哈希表) 每次从内核区域申请; 写回时申请失败就原样存放
+*/
+
+#define LZ4_MINMATCH      4    // 最短匹配
+#define LZ4_LAST_LITERALS 5    // 最后至少5个字节是字面量
+#define LZ4_MFLIMIT       12   // 匹配的起点距离结尾至少12个字节
+#define LZ4_HASH_LOG      11   // 哈希表项数的log2 (2048个uint16, 一页)
+
+static uint32 lz4_read32(const uint8* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32)p[3] << 24);
+}
+
+static uint32 lz4_hash(uint32 v)
+{
+    return (v * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+// 输出长度的扩展字节 (len已减去token中的15)
+static void lz4_put_len(uint8* dst, uint32* op, uint32 len)
+{
+    for (; len >= 255; len -= 255) {
+        dst[(*op)++] = 255;
+    }
+    dst[(*op)++] = len;
+}
+
+// 输出一个序列 (mlen = 0: 最后一个只有字面量的序列), 超出cap返回false
+static bool lz4_emit(uint8* dst, uint32 cap, uint32* op, const uint8* lit, uint32 nlit, uint32 dist, uint32 mlen)
+{
+    uint32 need = 1 + nlit + nlit / 255 + 1 + (mlen ? 2 + mlen / 255 + 1 : 0);
+    if (*op + need > cap) {
+        return false;
+    }
+
+    uint8* token = dst + (*op)++;
+    *token = (nlit >= 15 ? 15 : nlit) << 4;
+    if (nlit >= 15) {
+        lz4_put_len(dst, op, nlit - 15);
+    }
+    memmove(dst + *op, lit, nlit);
+    *op += nlit;
+
+    if (mlen != 0) {
+        dst[(*op)++] = dist & 0xFF;
+        dst[(*op)++] = dist >> 8;
+        uint32 m = mlen - LZ4_MINMATCH;
+        *token |= (m >= 15 ? 15 : m);
+        if (m >= 15) {
+            lz4_put_len(dst, op, m - 15);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief LZ4块格式压缩
+ * @param src 输入（不超过64KB）
+ * @param n 输入字节数
+ * @param dst 输出缓冲区
+ * @param cap 输出缓冲区大小
+ * @param table 哈希表（1 << LZ4_HASH_LOG项, 内容任意）
+ * @return 压缩后的字节数, 超过cap时返回0
+ */
+static uint32 lz4_compress(const uint8* src, uint32 n, uint8* dst, uint32 cap, uint16* table)
+{
+    uint32 pos = 0, anchor = 0, op = 0;
+
+    memset(table, 0, sizeof(uint16) << LZ4_HASH_LOG);
+    if (n >= LZ4_MFLIMIT) {
+        while (pos <= n - LZ4_MFLIMIT) {
+            // 1. 查哈希表: 同一哈希最近出现的位置, 内容相同才是匹配
+            uint32 v = lz4_read32(src + pos);
+            uint32 h = lz4_hash(v);
+            uint32 ref = table[h];
+            table[h] = pos;
+            if (ref >= pos || lz4_read32(src + ref) != v) {
+                pos++;
+                continue;
+            }
+
+            // 2. 向后扩展匹配 (最后LZ4_LAST_LITERALS个字节留给字面量)
+            uint32 mlen = LZ4_MINMATCH;
+            while (pos + mlen < n - LZ4_LAST_LITERALS && src[ref + mlen] == src[pos + mlen]) {
+                mlen++;
+            }
+            if (!lz4_emit(dst, cap, &op, src + anchor, pos - anchor, pos - ref, mlen)) {
+                return 0;
+            }
+            pos += mlen;
+            anchor = pos;
+        }
+    }
+
+    // 3. 剩余的字节作为最后一个序列的字面量
+    if (!lz4_emit(dst, cap, &op, src + anchor, n - anchor, 0, 0)) {
+        return 0;
+    }
+    return op;
+}
+
+// 读入长度扩展字节, 越界返回false
+static bool lz4_get_len(const uint8* src, uint32 n, uint32* ip, uint32* len)
+{
+    uint8 b;
+    do {
+        if (*ip >= n) {
+            return false;
+        }
+        b = src[(*ip)++];
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+/**
+ * @brief LZ4块格式解压
+ * @param src 压缩数据
+ * @param n 压缩数据的字节数
+ * @param dst 输出缓冲区
+ * @param cap 输出缓冲区大小
+ * @return 解压后的字节数, 数据损坏（越界或距离无效）时返回-1
+ */
+static int lz4_decompress(const uint8* src, uint32 n, uint8* dst, uint32 cap)
+{
+    uint32 ip = 0, op = 0;
+
+    while (ip < n) {
+        // 1. 字面量
+        uint8 token = src[ip++];
+        uint32 nlit = token >> 4;
+        if (nlit == 15 && !lz4_get_len(src, n, &ip, &nlit)) {
+            return -1;
+        }
+        if (nlit > n - ip || nlit > cap - op) {
+            return -1;
+        }
+        memmove(dst + op, src + ip, nlit);
+        ip += nlit;
+        op += nlit;
+        if (ip == n) {
+            break;
+        }
+
+        // 2. 匹配: 从已输出的内容复制 (距离可能小于长度, 逐字节复制)
+        if (n - ip < 2) {
+            return -1;
+        }
+        uint32 dist = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        uint32 mlen = token & 15;
+        if (mlen == 15 && !lz4_get_len(src, n, &ip, &mlen)) {
+            return -1;
+        }
+        mlen += LZ4_MINMATCH;
+        if (dist == 0 || dist > op || mlen > cap - op) {
+            return -1;
+        }
+        for (uint32 i = 0; i < mlen; i++, op++) {
+            dst[op] = dst[op - dist];
+        }
+    }
+    return op;
+}
+
+// 一页内容是否全为0
+static bool comp_page_zero(const uint8* page)
+{
+    const uint64* p = (const uint64*)page;
+    for (uint32 i = 0; i < PGSIZE / sizeof(uint64); i++) {
+        if (p[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 读出压缩文件第c个cluster的内容
+ * @param ip 内存inode指针（调用者至少共享持有睡眠锁）
+ * @param c cluster序号（文件内的页序号）
+ * @param page 目标页（内核地址, PGSIZE字节）
+ * @note 原样存放的cluster逐块读出（空洞清零）, 压缩存放的cluster先把前k个块拼接在临时页中再解压
+ */
+void comp_read_cluster(inode_t* ip, uint32 c, uint64 page)
+{
+    uint32 blocks[PCACHE_BLOCKS];
+    for (uint32 i = 0; i < PCACHE_BLOCKS; i++) {
+        blocks[i] = inode_locate_block(ip, c * PCACHE_BLOCKS + i, false);
+    }
+
+    // 1. 原样存放, 或者整个cluster都是空洞
+    if (blocks[PCACHE_BLOCKS - 1] != 0 || blocks[0] == 0) {
+        for (uint32 i = 0; i < PCACHE_BLOCKS; i++) {
+            uint8* dst = (uint8*)page + i * BLOCK_SIZE;
+            if (blocks[i] == 0) {
+                memset(dst, 0, BLOCK_SIZE);
+                continue;
+            }
+            buf_t* buf = buf_read(blocks[i]);
+            memmove(dst, buf->data, BLOCK_SIZE);
+            buf_release(buf);
+        }
+        return;
+    }
+
+    // 2. 压缩存放: 拼接前k个块
+    uint8* in = (uint8*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+    assert(in != NULL, "comp_read_cluster: out of memory");
+    uint32 k = 0;
+    while (k < PCACHE_BLOCKS && blocks[k] != 0) {
+        buf_t* buf = buf_read(blocks[k]);
+        memmove(in + k * BLOCK_SIZE, buf->data, BLOCK_SIZE);
+        buf_release(buf);
+        k++;
+    }
+
+    // 3. 检查块头后解压（压缩的总是整页）
+    comp_header_t* hdr = (comp_header_t*)in;
+    assert(hdr->magic == COMP_MAGIC && hdr->clen <= PGSIZE && COMP_BLOCKS_FOR(hdr->clen) == k,
+           "comp_read_cluster: bad cluster header");
+    int n = lz4_decompress(in + sizeof(comp_header_t), hdr->clen, (uint8*)page, PGSIZE);
+    assert(n == PGSIZE, "comp_read_cluster: corrupt compressed data");
+    pmem_free((uint64)in, true);
+}
+
+/**
+ * @brief 把一页内容写成压缩文件的第c个cluster
+ * @param ip 内存inode指针（调用者独占持有睡眠锁, 在日志事务中）
+ * @param c cluster序号（文件内的页序号）
+ * @param page 源页（内核地址, 可能同时被映射者修改）
+ * @note 1. 先取一份快照, 文件末尾之后的部分清零（映射者可能写过那里）
+ *       2. 全0: 释放cluster的所有块; 压缩后至少省出一个块: 压缩存放; 否则原样存放
+ *       3. 按需要的块数重新映射cluster（保留已有的块, 多出的块释放）后经过buf cache写出
+ */
+void comp_write_cluster(inode_t* ip, uint32 c, uint64 page)
+{
+    assert(sleeplock_holding(&ip->slk), "comp_write_cluster: not holding inode sleeplock");
+
+    uint8* work = (uint8*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+    uint8* out = (uint8*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+    uint16* table = (uint16*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+    uint8* src = (uint8*)page;
+    uint32 keep = PCACHE_BLOCKS;
+
+    // 1. 快照（申请失败时直接使用源页, 原样存放）
+    if (work != NULL) {
+        uint32 offset = c * PGSIZE;
+        uint32 n = 0;
+        if (offset < ip->size) {
+            n = ip->size - offset;
+            if (n > PGSIZE) n = PGSIZE;
+        }
+        memmove(work, src, n);
+        memset(work + n, 0, PGSIZE - n);
+        src = work;
+    }
+
+    // 2. 选择存放方式
+    if (work != NULL && comp_page_zero(work)) {
+        keep = 0;
+    } else if (PCACHE_BLOCKS > 1 && work != NULL && out != NULL && table != NULL) {
+        comp_header_t* hdr = (comp_header_t*)out;
+        uint32 cap = (PCACHE_BLOCKS - 1) * BLOCK_SIZE;  // 至少省出一个块
+        uint32 clen = lz4_compress(work, PGSIZE, out + sizeof(comp_header_t), cap - sizeof(comp_header_t), table);
+        if (clen != 0) {
+            hdr->magic = COMP_MAGIC;
+            hdr->clen = clen;
+            keep = COMP_BLOCKS_FOR(clen);
+            memset(out + sizeof(comp_header_t) + clen, 0, keep * BLOCK_SIZE - sizeof(comp_header_t) - clen);
+            src = out;
+        }
+    }
+
+    // 3. 重新映射并写出
+    uint32 blocks[PCACHE_BLOCKS];
+    inode_map_cluster(ip, c * PCACHE_BLOCKS, PCACHE_BLOCKS, keep, blocks);
+    for (uint32 i = 0; i < keep; i++) {
+        buf_t* buf = buf_get_nofill(blocks[i]);
+        memmove(buf->data, src + i * BLOCK_SIZE, BLOCK_SIZE);
+        buf_write(buf);
+        buf_release(buf);
+    }
+
+    if (work != NULL) pmem_free((uint64)work, true);
+    if (out != NULL) pmem_free((uint64)out, true);
+    if (table != NULL) pmem_free((uint64)table, true);
+}
+
+/**
+ * @brief 不经过页缓存读写压缩文件（页缓存没有可替换的页时使用）
+ * @param ip 内存inode指针（读: 至少共享持有睡眠锁; 写: 独占持有, 在日志事务中）
+ * @param offset 文件偏移
+ * @param len 字节数（读: 调用者已截断到文件末尾）
+ * @param addr 缓冲区地址
+ * @param user addr是否为用户态地址
+ * @param write true=写文件（必要时扩展文件大小）, false=读文件
+ * @return 传输的字节数
+ * @note 每个涉及的cluster解压到临时页中, 写入时修改后整页重新压缩写回
+ */
+uint32 comp_rw(inode_t* ip, uint32 offset, uint32 len, void* addr, bool user, bool write)
+{
+    uint8* page = (uint8*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+    assert(page != NULL, "comp_rw: out of memory");
+
+    uint32 done = 0;
+    while (done < len) {
+        uint32 c = (offset + done) / PGSIZE;
+        uint32 in_page = (offset + done) % PGSIZE;
+        uint32 n = PGSIZE - in_page;
+        if (n > len - done) n = len - done;
+
+        comp_read_cluster(ip, c, (uint64)page);
+        uint8* data = page + in_page;
+        uint64 uaddr = (uint64)addr + done;
+        if (write) {
+            if (user) {
+                uvm_copyin(myproc()->mm->pgtbl, (uint64)data, uaddr, n);
+            } else {
+                memmove(data, (void*)uaddr, n);
+            }
+            if (offset + done + n > ip->size) {
+                ip->size = offset + done + n;
+                ip->dirty = true;
+            }
+            comp_write_cluster(ip, c, (uint64)page);
+        } else {
+            if (user) {
+                uvm_copyout(myproc()->mm->pgtbl, uaddr, (uint64)data, n);
+            } else {
+                memmove((void*)uaddr, data, n);
+            }
+        }
+        done += n;
+    }
+
+    pmem_free((uint64)page, true);
+    return done;
+}
+
+// 压缩文件截断到size之后: 跨越size的cluster清零size之后的部分重新写回（之后再扩展时读出的是0）
+void comp_truncate(inode_t* ip, uint32 size)
+{
+    if (size % PGSIZE == 0) {
+        return;
+    }
+    uint8* page = (uint8*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+    assert(page != NULL, "comp_truncate: out of memory");
+    comp_read_cluster(ip, size / PGSIZE, (uint64)page);
+    memset(page + size % PGSIZE, 0, PGSIZE - size % PGSIZE);
+    comp_write_cluster(ip, size / PGSIZE, (uint64)page);
+    pmem_free((uint64)page, true);
+}
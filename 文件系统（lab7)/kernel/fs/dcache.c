@@ -0,0 +1,221 @@
+#include "fs/dcache.h"
+#include "fs/inode.h"
+#include "lib/lock.h"
+#include "lib/str.h"
+#include "lib/print.h"
+
+/*
+    目录项缓存
+    1. 以(parent, name)为键的哈希表, 命中时不必读目录数据块也不必扫描目录项
+    2. 所有槽位挂在一条LRU链表上, 需要新槽位时替换最久未使用的项
+    以上所有字段由lk_dcache保护 (读写自旋锁): 查找只持有读锁, 多个hart可以同时查找;
+    查找不移动LRU链表, 只设置命中项的referenced, 替换时跳过并清除referenced的项移到尾部 (第二次机会)
+*/
+#define N_DENTRY       256
+#define N_DENTRY_HASH  64
+static dentry_t dcache[N_DENTRY];
+static dentry_t* dcache_hash[N_DENTRY_HASH];
+static dentry_t* dcache_lru_head;   // 最久未使用
+static dentry_t* dcache_lru_tail;   // 最近使用
+static rwspinlock_t lk_dcache;
+static volatile uint32 dcache_seq;  // 目录项改变的次数 (在lk_dcache内修改)
+
+// ---------------------- 哈希表与LRU链表（调用者持有lk_dcache） ----------------------
+// (parent, name)对应的哈希桶
+static uint32 dcache_bucket(uint16 parent, char* name)
+{
+    uint32 h = parent;
+    for (uint32 i = 0; i < DIR_NAME_LEN && name[i] != 0; i++) {
+        h = h * 31 + (uint8)name[i];
+    }
+    return h % N_DENTRY_HASH;
+}
+
+// 把项移到LRU链表尾部（最近使用）
+static void dcache_touch(dentry_t* de)
+{
+    if (de == dcache_lru_tail) {
+        return;
+    }
+    // 1. 从原位置摘除
+    if (de->lru_prev != NULL) {
+        de->lru_prev->lru_next = de->lru_next;
+    } else {
+        dcache_lru_head = de->lru_next;
+    }
+    de->lru_next->lru_prev = de->lru_prev;
+
+    // 2. 追加到尾部
+    de->lru_prev = dcache_lru_tail;
+    de->lru_next = NULL;
+    dcache_lru_tail->lru_next = de;
+    dcache_lru_tail = de;
+}
+
+// 在哈希表中查找(parent, name), 未命中返回NULL
+static dentry_t* dcache_find(uint32 bucket, uint16 parent, char* name)
+{
+    for (dentry_t* de = dcache_hash[bucket]; de != NULL; de = de->hash_next) {
+        if (de->parent == parent && strncmp(de->name, name, DIR_NAME_LEN) == 0) {
+            return de;
+        }
+    }
+    return NULL;
+}
+
+// 把有效项从哈希表中移除并标记无效
+static void dcache_unhash(dentry_t* de)
+{
+    dentry_t** pp = &dcache_hash[dcache_bucket(de->parent, de->name)];
+    while (*pp != NULL) {
+        if (*pp == de) {
+            *pp = de->hash_next;
+            de->hash_next = NULL;
+            de->valid = false;
+            return;
+        }
+        pp = &(*pp)->hash_next;
+    }
+    panic("dcache_unhash: dentry not in hash table");
+}
+
+// ---------------------- 对外接口 ----------------------
+/**
+ * @brief 初始化目录项缓存: 所有槽位无效, 按顺序挂在LRU链表上
+ */
+void dcache_init()
+{
+    rwspinlock_init(&lk_dcache, "dcache");
+    for (int i = 0; i < N_DENTRY_HASH; i++) {
+        dcache_hash[i] = NULL;
+    }
+    for (int i = 0; i < N_DENTRY; i++) {
+        dcache[i].valid = false;
+        dcache[i].referenced = false;
+        dcache[i].hash_next = NULL;
+        dcache[i].lru_prev = (i > 0) ? &dcache[i - 1] : NULL;
+        dcache[i].lru_next = (i + 1 < N_DENTRY) ? &dcache[i + 1] : NULL;
+    }
+    dcache_lru_head = &dcache[0];
+    dcache_lru_tail = &dcache[N_DENTRY - 1];
+    dcache_seq = 0;
+}
+
+/**
+ * @brief 查询目录项缓存
+ * @param parent 父目录的inode_num
+ * @param name 目录项名称
+ * @param inode_num 输出：命中时的inode_num（负向项为INODE_NUM_UNUSED）
+ * @return 命中返回true, 未命中返回false
+ */
+bool dcache_lookup(uint16 parent, char* name, uint16* inode_num)
+{
+    rwspinlock_acquire_read(&lk_dcache);
+    dentry_t* de = dcache_find(dcache_bucket(parent, name), parent, name);
+    if (de != NULL) {
+        *inode_num = de->inode_num;
+        de->referenced = true;
+    }
+    rwspinlock_release_read(&lk_dcache);
+    return de != NULL;
+}
+
+/**
+ * @brief 静态辅助函数：插入或更新一个目录项
+ * @param change 目录项本身发生了改变（序列号+1）
+ */
+static void dcache_set(uint16 parent, char* name, uint16 inode_num, bool change)
+{
+    uint32 bucket = dcache_bucket(parent, name);
+
+    rwspinlock_acquire_write(&lk_dcache);
+    if (change) {
+        dcache_seq++;
+    }
+
+    // 1. 已有的项直接更新
+    dentry_t* de = dcache_find(bucket, parent, name);
+
+    // 2. 否则替换最久未使用的槽位 (之后又被查找命中过的项移到尾部, 最多转一圈)
+    if (de == NULL) {
+        while (dcache_lru_head->valid && dcache_lru_head->referenced) {
+            dcache_lru_head->referenced = false;
+            dcache_touch(dcache_lru_head);
+        }
+        de = dcache_lru_head;
+        if (de->valid) {
+            dcache_unhash(de);
+        }
+        de->valid = true;
+        de->parent = parent;
+        strncpy(de->name, name, DIR_NAME_LEN);
+        de->hash_next = dcache_hash[bucket];
+        dcache_hash[bucket] = de;
+    }
+    de->inode_num = inode_num;
+    de->referenced = false;
+    dcache_touch(de);
+
+    rwspinlock_release_write(&lk_dcache);
+}
+
+/**
+ * @brief 记录一次查找的结果（inode_num = INODE_NUM_UNUSED 表示负向项）
+ * @param parent 父目录的inode_num
+ * @param name 目录项名称
+ * @param inode_num 目录项的inode_num
+ * @note 调用者必须持有父目录的睡眠锁
+ */
+void dcache_insert(uint16 parent, char* name, uint16 inode_num)
+{
+    dcache_set(parent, name, inode_num, false);
+}
+
+/**
+ * @brief 目录项被添加（inode_num有效）或删除（inode_num = INODE_NUM_UNUSED）
+ * @param parent 父目录的inode_num
+ * @param name 目录项名称
+ * @param inode_num 目录项的新inode_num
+ * @note 调用者必须持有父目录的睡眠锁; 进行中的乐观查找会失效
+ */
+void dcache_change(uint16 parent, char* name, uint16 inode_num)
+{
+    dcache_set(parent, name, inode_num, true);
+}
+
+/**
+ * @brief 删除父目录为parent的所有项（目录被删除, 它的inode_num可能被重新使用）
+ * @param parent 父目录的inode_num
+ */
+void dcache_purge(uint16 parent)
+{
+    rwspinlock_acquire_write(&lk_dcache);
+    dcache_seq++;
+    for (int i = 0; i < N_DENTRY; i++) {
+        if (dcache[i].valid && dcache[i].parent == parent) {
+            dcache_unhash(&dcache[i]);
+        }
+    }
+    rwspinlock_release_write(&lk_dcache);
+}
+
+/**
+ * @brief 乐观查找开始时读取序列号
+ */
+uint32 dcache_seq_begin()
+{
+    uint32 seq = dcache_seq;
+    __sync_synchronize();
+    return seq;
+}
+
+/**
+ * @brief 乐观查找结束时检查序列号
+ * @param seq dcache_seq_begin的返回值
+ * @return 期间没有目录项改变返回true（查找结果可用）
+ */
+bool dcache_seq_valid(uint32 seq)
+{
+    __sync_synchronize();
+    return dcache_seq == seq;
+}
@@ -1,15 +1,395 @@
 #include "fs/fs.h"
 #include "fs/buf.h"
+#include "fs/journal.h"
 #include "fs/inode.h"
 #include "fs/dir.h"
+#include "fs/dcache.h"
 #include "fs/bitmap.h"
 #include "mem/vmem.h"
 #include "lib/str.h"
 #include "lib/print.h"
 #include "proc/cpu.h"
+#include "lib/tstat.h"
+
+/*
+    目录的两种格式
+    1. 线性目录: 只有第0个数据块, 顺序存放dirent_t (BLOCK_SIZE = 1024时最多32个目录项), 查找时线性扫描
+    2. 哈希索引目录 (flags & INODE_F_INDEX): 线性目录写满时转换而来, 结构类似ext3/4的HTree
+       第0个数据块是索引根节点, 目录项存放在叶子块中, 按名字的哈希值分到不同的叶子:
+           根节点 --(levels = 1时经过一层中间节点)--> 叶子块 (dirent_t数组)
+       索引节点 = dir_index_header_t + 按hash升序排列的dir_index_entry_t
+       第i项负责[entries[i].hash, entries[i + 1].hash)的哈希值, entries[0].hash总是0
+       叶子块写满时按哈希值对半分裂, 同一个哈希值的目录项总在同一个叶子中
+       查找只需读 根节点 (+ 中间节点) + 1个叶子块, 索引节点通常常驻buf cache
+    索引节点的开头伪装成一个空目录项 (name[0] = 0), 按线性格式扫描时不会被当成有效目录项
+*/
+
+#define DIR_PER_BLOCK    (BLOCK_SIZE / sizeof(dirent_t)) // 每个数据块的目录项数
+#define DIR_INDEX_MAGIC  0x58444944                      // "DIDX"
+#define DIR_INDEX_LEVELS 1                               // 根节点下最多1层中间节点
+
+typedef struct dir_index_header {
+    uint16 inode_num;   // INODE_NUM_UNUSED
+    uint8  zero;        // 对应dirent_t.name[0], 总是0
+    uint8  levels;      // 根节点: 中间节点的层数 (0或1); 中间节点: 0
+    uint32 magic;       // DIR_INDEX_MAGIC
+    uint32 count;       // 有效索引项数
+    uint8  pad[20];     // 补齐到sizeof(dirent_t)
+} dir_index_header_t;
+
+typedef struct dir_index_entry {
+    uint32 hash;        // 子节点负责的最小哈希值
+    uint32 block;       // 子节点的磁盘块编号
+} dir_index_entry_t;
+
+// 每个索引节点的索引项数 (124)
+#define DIR_INDEX_MAX ((BLOCK_SIZE - sizeof(dir_index_header_t)) / sizeof(dir_index_entry_t))
+
+// 索引节点中的第一个索引项
+#define DIR_INDEX_ENTRIES(hdr) ((dir_index_entry_t*)((dir_index_header_t*)(hdr) + 1))
+
+// ---------------------- 哈希索引辅助函数 ----------------------
+/**
+ * @brief 静态辅助函数：目录项名称的哈希值 (FNV-1a, 最多DIR_NAME_LEN个字符)
+ */
+static uint32 dir_hash(char* name)
+{
+    uint32 h = 2166136261u;
+    for (uint32 i = 0; i < DIR_NAME_LEN && name[i] != 0; i++) {
+        h = (h ^ (uint8)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief 静态辅助函数：二分查找索引节点中最后一个hash <= 目标值的索引项
+ * @return 索引项下标 (entries[0].hash = 0, 一定存在)
+ */
+static uint32 dir_index_search(dir_index_header_t* hdr, uint32 hash)
+{
+    dir_index_entry_t* ent = DIR_INDEX_ENTRIES(hdr);
+    uint32 lo = 0, hi = hdr->count - 1;
+    while (lo < hi) {
+        uint32 mid = (lo + hi + 1) / 2;
+        if (ent[mid].hash <= hash) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief 静态辅助函数：向索引节点插入一个索引项（保持hash升序, 调用者保证有空位）
+ */
+static void dir_index_insert(dir_index_header_t* hdr, uint32 hash, uint32 block)
+{
+    dir_index_entry_t* ent = DIR_INDEX_ENTRIES(hdr);
+    uint32 i = hdr->count;
+    while (i > 0 && ent[i - 1].hash > hash) {
+        ent[i] = ent[i - 1];
+        i--;
+    }
+    ent[i].hash = hash;
+    ent[i].block = block;
+    hdr->count++;
+}
+
+/**
+ * @brief 静态辅助函数：在哈希索引目录中找到负责hash的叶子块
+ * @param pip 目录inode（已上锁）
+ * @param hash 名称的哈希值
+ * @param path 输出：经过的索引节点块编号, path[0]为根节点（可为NULL）
+ * @param levels 输出：根节点下中间节点的层数（可为NULL）
+ * @return 叶子块的磁盘编号
+ */
+static uint32 dir_index_lookup(inode_t* pip, uint32 hash, uint32* path, uint32* levels)
+{
+    uint32 block_num = inode_locate_block(pip, 0, false);
+    buf_t* buf = buf_read(block_num);
+    dir_index_header_t* hdr = (dir_index_header_t*)buf->data;
+    uint32 depth = hdr->levels;
+    if (levels != NULL) {
+        *levels = depth;
+    }
+
+    for (uint32 l = 0; ; l++) {
+        hdr = (dir_index_header_t*)buf->data;
+        assert(hdr->magic == DIR_INDEX_MAGIC && hdr->count > 0, "dir_index_lookup: bad index block");
+        if (path != NULL) {
+            path[l] = block_num;
+        }
+        block_num = DIR_INDEX_ENTRIES(hdr)[dir_index_search(hdr, hash)].block;
+        buf_release(buf);
+        if (l == depth) {
+            return block_num;
+        }
+        buf = buf_read(block_num);
+    }
+}
+
+/**
+ * @brief 静态辅助函数：在目录末尾追加一个清零的数据块（仅用于哈希索引目录）
+ * @param pip 目录inode（已上锁）
+ * @param buf 输出：新数据块的缓冲区（持有睡眠锁）
+ * @return 新数据块的磁盘编号, 目录已达最大大小返回0
+ * @note 只修改内存中的size, 由调用者写回inode
+ */
+static uint32 dir_new_block(inode_t* pip, buf_t** buf)
+{
+    if (pip->size + BLOCK_SIZE > INODE_MAXSIZE) {
+        return 0;
+    }
+    uint32 block_num = inode_locate_block(pip, pip->size / BLOCK_SIZE, true);
+    *buf = buf_get_nofill(block_num);
+    memset((*buf)->data, 0, BLOCK_SIZE);
+    pip->size += BLOCK_SIZE;
+    return block_num;
+}
+
+/**
+ * @brief 静态辅助函数：名称为name的目录项所在（或应该在）的数据块
+ * @return 数据块的磁盘编号
+ */
+static uint32 dir_name_block(inode_t* pip, char* name)
+{
+    if (pip->flags & INODE_F_INDEX) {
+        return dir_index_lookup(pip, dir_hash(name), NULL, NULL);
+    }
+    return inode_locate_block(pip, 0, false);
+}
+
+/**
+ * @brief 静态辅助函数：按索引顺序返回第idx个存放目录项的数据块
+ * @return 数据块的磁盘编号, idx超出范围返回0
+ */
+static uint32 dir_leaf_block(inode_t* pip, uint32 idx)
+{
+    // 1. 线性目录只有第0个数据块
+    if (!(pip->flags & INODE_F_INDEX)) {
+        return (idx == 0) ? inode_locate_block(pip, 0, false) : 0;
+    }
+
+    // 2. 哈希索引目录: 依次跳过前面的叶子
+    buf_t* buf = buf_read(inode_locate_block(pip, 0, false));
+    dir_index_header_t* hdr = (dir_index_header_t*)buf->data;
+    dir_index_entry_t* ent = DIR_INDEX_ENTRIES(hdr);
+    uint32 block_num = 0;
 
-// 简化假设：每个目录文件仅占用1个数据块，最多存储 BLOCK_SIZE/sizeof(dirent_t) 个目录项
-// 注：DIR_NAME_LEN=30，sizeof(dirent_t)=32，BLOCK_SIZE=512时，最多支持16个目录项
+    if (hdr->levels == 0) {
+        if (idx < hdr->count) {
+            block_num = ent[idx].block;
+        }
+    } else {
+        for (uint32 i = 0; i < hdr->count; i++) {
+            buf_t* ibuf = buf_read(ent[i].block);
+            dir_index_header_t* ihdr = (dir_index_header_t*)ibuf->data;
+            if (idx < ihdr->count) {
+                block_num = DIR_INDEX_ENTRIES(ihdr)[idx].block;
+                buf_release(ibuf);
+                break;
+            }
+            idx -= ihdr->count;
+            buf_release(ibuf);
+        }
+    }
+    buf_release(buf);
+    return block_num;
+}
+
+/**
+ * @brief 静态辅助函数：把写满的线性目录转换为哈希索引目录
+ * @param pip 目录inode（已上锁）
+ * @return 成功返回true
+ * @note 原数据块的内容整体移到一个新的叶子块, 第0个数据块改写为只有一个索引项的根节点;
+ *       之后插入时叶子会按哈希值逐步分裂
+ */
+static bool dir_make_index(inode_t* pip)
+{
+    // 1. 原数据块的内容复制到新的叶子块
+    pip->size = BLOCK_SIZE;
+    buf_t* lbuf;
+    uint32 leaf = dir_new_block(pip, &lbuf);
+    if (leaf == 0) {
+        return false;
+    }
+    buf_t* rbuf = buf_read(inode_locate_block(pip, 0, false));
+    memmove(lbuf->data, rbuf->data, BLOCK_SIZE);
+
+    // 2. 第0个数据块改写为索引根节点
+    memset(rbuf->data, 0, BLOCK_SIZE);
+    dir_index_header_t* hdr = (dir_index_header_t*)rbuf->data;
+    hdr->inode_num = INODE_NUM_UNUSED;
+    hdr->magic = DIR_INDEX_MAGIC;
+    hdr->levels = 0;
+    hdr->count = 0;
+    dir_index_insert(hdr, 0, leaf);
+
+    journal_log(lbuf);
+    journal_log(rbuf);
+    buf_release(lbuf);
+    buf_release(rbuf);
+
+    // 3. 标记为哈希索引目录
+    pip->flags |= INODE_F_INDEX;
+    inode_rw(pip, true);
+    return true;
+}
+
+/**
+ * @brief 静态辅助函数：叶子分裂后向最后一级索引节点登记新叶子, 索引节点满时分裂
+ * @param pip 目录inode（已上锁）
+ * @param path dir_index_lookup得到的索引节点路径（可能被修改）
+ * @param levels 根节点下中间节点的层数
+ * @param hash 新叶子负责的最小哈希值
+ * @param block 新叶子的磁盘编号
+ * @return 成功返回true, 索引已满返回false
+ */
+static bool dir_index_add(inode_t* pip, uint32* path, uint32 levels, uint32 hash, uint32 block)
+{
+    buf_t *buf, *nbuf, *rbuf;
+    dir_index_header_t *hdr, *nhdr;
+
+    // 1. 最后一级索引节点还有空位: 直接插入
+    buf = buf_read(path[levels]);
+    hdr = (dir_index_header_t*)buf->data;
+    if (hdr->count < DIR_INDEX_MAX) {
+        dir_index_insert(hdr, hash, block);
+        journal_log(buf);
+        buf_release(buf);
+        return true;
+    }
+    buf_release(buf);
+
+    // 2. 根节点已满且没有中间层: 所有索引项下移到新的中间节点, 根节点只保留指向它的一项
+    if (levels == 0) {
+        uint32 mid = dir_new_block(pip, &nbuf);
+        if (mid == 0) {
+            return false;
+        }
+        buf = buf_read(path[0]);
+        hdr = (dir_index_header_t*)buf->data;
+        memmove(nbuf->data, buf->data, BLOCK_SIZE);
+        ((dir_index_header_t*)nbuf->data)->levels = 0;
+        hdr->levels = 1;
+        hdr->count = 0;
+        dir_index_insert(hdr, 0, mid);
+        journal_log(nbuf);
+        journal_log(buf);
+        buf_release(nbuf);
+        buf_release(buf);
+        path[1] = mid;
+        levels = 1;
+    }
+
+    // 3. 中间节点已满: 根节点也满时索引已满
+    rbuf = buf_read(path[0]);
+    if (((dir_index_header_t*)rbuf->data)->count == DIR_INDEX_MAX) {
+        buf_release(rbuf);
+        return false;
+    }
+    uint32 sibling = dir_new_block(pip, &nbuf);
+    if (sibling == 0) {
+        buf_release(rbuf);
+        return false;
+    }
+
+    // 4. 中间节点对半分裂, 后一半移到新节点, 新节点登记到根节点
+    buf = buf_read(path[1]);
+    hdr = (dir_index_header_t*)buf->data;
+    nhdr = (dir_index_header_t*)nbuf->data;
+    uint32 keep = hdr->count / 2;
+    nhdr->inode_num = INODE_NUM_UNUSED;
+    nhdr->magic = DIR_INDEX_MAGIC;
+    nhdr->levels = 0;
+    nhdr->count = hdr->count - keep;
+    memmove(DIR_INDEX_ENTRIES(nhdr), DIR_INDEX_ENTRIES(hdr) + keep, nhdr->count * sizeof(dir_index_entry_t));
+    hdr->count = keep;
+
+    if (hash >= DIR_INDEX_ENTRIES(nhdr)[0].hash) {
+        dir_index_insert(nhdr, hash, block);
+    } else {
+        dir_index_insert(hdr, hash, block);
+    }
+    dir_index_insert((dir_index_header_t*)rbuf->data, DIR_INDEX_ENTRIES(nhdr)[0].hash, sibling);
+
+    journal_log(nbuf);
+    journal_log(buf);
+    journal_log(rbuf);
+    buf_release(nbuf);
+    buf_release(buf);
+    buf_release(rbuf);
+    return true;
+}
+
+/**
+ * @brief 静态辅助函数：分裂写满的叶子块, 哈希值较大的一半移到新叶子
+ * @param pip 目录inode（已上锁）
+ * @param leaf 叶子块的磁盘编号
+ * @param path dir_index_lookup得到的索引节点路径
+ * @param levels 根节点下中间节点的层数
+ * @return 成功返回true, 索引已满或无法分裂时返回false
+ */
+static bool dir_split_leaf(inode_t* pip, uint32 leaf, uint32* path, uint32 levels)
+{
+    buf_t* buf = buf_read(leaf);
+    dirent_t* de = (dirent_t*)buf->data;
+    uint32 hash[DIR_PER_BLOCK];
+    dirent_t tmp;
+
+    // 1. 按哈希值对目录项插入排序
+    for (uint32 i = 0; i < DIR_PER_BLOCK; i++) {
+        uint32 h = dir_hash(de[i].name);
+        uint32 j = i;
+        tmp = de[i];
+        while (j > 0 && hash[j - 1] > h) {
+            hash[j] = hash[j - 1];
+            de[j] = de[j - 1];
+            j--;
+        }
+        hash[j] = h;
+        de[j] = tmp;
+    }
+
+    // 2. 选择分裂点: 尽量居中, 且两侧的哈希值不相同
+    uint32 mid = DIR_PER_BLOCK / 2;
+    while (mid < DIR_PER_BLOCK && hash[mid] == hash[mid - 1]) {
+        mid++;
+    }
+    if (mid == DIR_PER_BLOCK) {
+        mid = DIR_PER_BLOCK / 2;
+        while (mid > 0 && hash[mid] == hash[mid - 1]) {
+            mid--;
+        }
+    }
+    if (mid == 0) {
+        buf_release(buf);
+        return false;
+    }
+
+    // 3. 分配新叶子并登记到索引
+    buf_t* nbuf;
+    uint32 sibling = dir_new_block(pip, &nbuf);
+    if (sibling == 0 || !dir_index_add(pip, path, levels, hash[mid], sibling)) {
+        if (sibling != 0) {
+            buf_release(nbuf); // 未登记的空数据块留在目录末尾, 不影响查找
+        }
+        buf_release(buf);
+        inode_rw(pip, true);
+        return false;
+    }
+
+    // 4. [mid, DIR_PER_BLOCK)移到新叶子
+    memmove(nbuf->data, &de[mid], (DIR_PER_BLOCK - mid) * sizeof(dirent_t));
+    memset(&de[mid], 0, (DIR_PER_BLOCK - mid) * sizeof(dirent_t));
+    journal_log(nbuf);
+    journal_log(buf);
+    buf_release(nbuf);
+    buf_release(buf);
+    inode_rw(pip, true);
+    return true;
+}
 
 // ---------------------- 目录项核心操作 ----------------------
 /**
@@ -28,25 +408,31 @@ uint16 dir_search_entry(inode_t *pip, char *name)
 
     dirent_t *de;
     buf_t *dir_buf = NULL;
+    uint16 target_inum = INODE_NUM_UNUSED;
+
+    // 2. 先查目录项缓存（负向项同样直接返回）
+    if (dcache_lookup(pip->inode_num, name, &target_inum)) {
+        return target_inum;
+    }
 
-    // 2. 读取目录对应的唯一数据块
-    dir_buf = buf_read(pip->addrs[0]);
+    // 3. 读取目录项所在的数据块（哈希索引目录先经过索引找到叶子块）
+    dir_buf = buf_read(dir_name_block(pip, name));
     assert(dir_buf != NULL, "dir_search_entry: read directory block failed");
 
-    // 3. 遍历所有目录项，查找匹配名称
+    // 4. 遍历所有目录项，查找匹配名称
     for (uint32 offset = 0; offset < BLOCK_SIZE; offset += sizeof(dirent_t)) {
         de = (dirent_t *)(dir_buf->data + offset);
         // 跳过空目录项，匹配非空目录项名称
         if (de->name[0] != 0 && strncmp(de->name, name, DIR_NAME_LEN) == 0) {
-            uint16 target_inum = de->inode_num;
-            buf_release(dir_buf);
-            return target_inum;
+            target_inum = de->inode_num;
+            break;
         }
     }
-
-    // 4. 未找到匹配目录项，返回失败
     buf_release(dir_buf);
-    return INODE_NUM_UNUSED;
+
+    // 5. 结果（包括未找到）记入目录项缓存
+    dcache_insert(pip->inode_num, name, target_inum);
+    return target_inum;
 }
 
 /**
@@ -54,8 +440,9 @@ uint16 dir_search_entry(inode_t *pip, char *name)
  * @param pip 目录对应的inode指针（已上锁）
  * @param inode_num 新目录项对应的inode序号
  * @param name 新目录项的名称
- * @return 成功返回目录项在数据块中的偏移量，失败返回BLOCK_SIZE
- * @note 调用者必须持有pip的睡眠锁，且pip必须是目录类型（FT_DIR）
+ * @return 成功返回目录项在其数据块中的偏移量，失败返回BLOCK_SIZE
+ * @note 调用者必须持有pip的睡眠锁，且pip必须是目录类型（FT_DIR）;
+ *       线性目录写满时转换为哈希索引目录, 叶子块写满时分裂
  */
 uint32 dir_add_entry(inode_t *pip, uint16 inode_num, char *name)
 {
@@ -72,37 +459,53 @@ uint32 dir_add_entry(inode_t *pip, uint16 inode_num, char *name)
 
     dirent_t *de;
     buf_t *dir_buf = NULL;
+    uint32 path[DIR_INDEX_LEVELS + 1], levels = 0;
 
-    // 3. 读取目录对应的唯一数据块
-    dir_buf = buf_read(pip->addrs[0]);
-    assert(dir_buf != NULL, "dir_add_entry: read directory block failed");
-
-    // 4. 遍历查找空闲目录项（名称为空或inode_num无效）
-    for (uint32 offset = 0; offset < BLOCK_SIZE; offset += sizeof(dirent_t)) {
-        de = (dirent_t *)(dir_buf->data + offset);
-        if (de->name[0] == 0 || de->inode_num == INODE_NUM_UNUSED) {
-            // 5. 填写新目录项数据
-            de->inode_num = inode_num;
-            strncpy(de->name, name, DIR_NAME_LEN); // 截断过长名称，保证不越界
-
-            // 6. 同步到磁盘并释放缓冲区
-            buf_write(dir_buf);
-            buf_release(dir_buf);
-
-            // 7. 更新目录inode大小（记录有效数据长度）
-            if (offset + sizeof(dirent_t) > pip->size) {
-                pip->size = offset + sizeof(dirent_t);
-                inode_rw(pip, true); // 同步inode元数据到磁盘
+    for (;;) {
+        // 3. 读取目录项应该存放的数据块（线性目录为第0个数据块）
+        uint32 block_num;
+        if (pip->flags & INODE_F_INDEX) {
+            block_num = dir_index_lookup(pip, dir_hash(name), path, &levels);
+        } else {
+            block_num = inode_locate_block(pip, 0, false);
+        }
+        dir_buf = buf_read(block_num);
+        assert(dir_buf != NULL, "dir_add_entry: read directory block failed");
+
+        // 4. 遍历查找空闲目录项（名称为空或inode_num无效）
+        for (uint32 offset = 0; offset < BLOCK_SIZE; offset += sizeof(dirent_t)) {
+            de = (dirent_t *)(dir_buf->data + offset);
+            if (de->name[0] == 0 || de->inode_num == INODE_NUM_UNUSED) {
+                // 5. 填写新目录项数据
+                de->inode_num = inode_num;
+                strncpy(de->name, name, DIR_NAME_LEN); // 截断过长名称，保证不越界
+
+                // 6. 同步到磁盘并释放缓冲区, 更新目录项缓存
+                journal_log(dir_buf);
+                buf_release(dir_buf);
+                dcache_change(pip->inode_num, name, inode_num);
+
+                // 7. 更新线性目录inode大小（记录有效数据长度）
+                if (!(pip->flags & INODE_F_INDEX) && offset + sizeof(dirent_t) > pip->size) {
+                    pip->size = offset + sizeof(dirent_t);
+                    inode_rw(pip, true); // 同步inode元数据到磁盘
+                }
+
+                // 8. 返回成功的偏移量
+                return offset;
             }
+        }
+        buf_release(dir_buf);
 
-            // 8. 返回成功的偏移量
-            return offset;
+        // 9. 数据块已满: 线性目录转换为哈希索引目录, 叶子块分裂, 然后重试
+        if (!(pip->flags & INODE_F_INDEX)) {
+            if (!dir_make_index(pip)) {
+                return BLOCK_SIZE;
+            }
+        } else if (!dir_split_leaf(pip, block_num, path, levels)) {
+            return BLOCK_SIZE;
         }
     }
-
-    // 9. 无空闲目录项，返回失败
-    buf_release(dir_buf);
-    return BLOCK_SIZE;
 }
 
 /**
@@ -110,7 +513,7 @@ uint32 dir_add_entry(inode_t *pip, uint16 inode_num, char *name)
  * @param pip 目录对应的inode指针（已上锁）
  * @param name 要删除的目录项名称
  * @return 成功返回目录项对应的inode_num，失败返回INODE_NUM_UNUSED
- * @note 调用者必须持有pip的睡眠锁，且pip必须是目录类型（FT_DIR）
+ * @note 调用者必须持有pip的睡眠锁，且pip必须是目录类型（FT_DIR）; 变空的叶子块不回收
  */
 uint16 dir_delete_entry(inode_t *pip, char *name)
 {
@@ -122,8 +525,8 @@ uint16 dir_delete_entry(inode_t *pip, char *name)
     dirent_t *de;
     buf_t *dir_buf = NULL;
 
-    // 2. 读取目录对应的唯一数据块
-    dir_buf = buf_read(pip->addrs[0]);
+    // 2. 读取目录项所在的数据块
+    dir_buf = buf_read(dir_name_block(pip, name));
     assert(dir_buf != NULL, "dir_delete_entry: read directory block failed");
 
     // 3. 遍历查找匹配目录项
@@ -135,9 +538,10 @@ uint16 dir_delete_entry(inode_t *pip, char *name)
             // 4. 清空目录项（标记为空闲）
             memset(de, 0, sizeof(dirent_t));
 
-            // 5. 同步到磁盘并释放缓冲区
-            buf_write(dir_buf);
+            // 5. 同步到磁盘并释放缓冲区, 目录项缓存改为负向项
+            journal_log(dir_buf);
             buf_release(dir_buf);
+            dcache_change(pip->inode_num, name, INODE_NUM_UNUSED);
 
             // 6. 返回成功的inode_num
             return target_inum;
@@ -156,7 +560,8 @@ uint16 dir_delete_entry(inode_t *pip, char *name)
  * @param dst 目标缓冲区地址（用户态/内核态）
  * @param user true=用户态缓冲区，false=内核态缓冲区
  * @return 实际读取的字节数（sizeof(dirent_t)的整数倍）
- * @note 调用者必须持有pip的睡眠锁，且pip必须是目录类型（FT_DIR）
+ * @note 调用者必须持有pip的睡眠锁，且pip必须是目录类型（FT_DIR）;
+ *       哈希索引目录按索引顺序（哈希值顺序）返回
  */
 uint32 dir_get_entries(inode_t* pip, uint32 len, void* dst, bool user)
 {
@@ -167,40 +572,94 @@ uint32 dir_get_entries(inode_t* pip, uint32 len, void* dst, bool user)
     if (len == 0) return 0;
 
     uint32 total_read = 0;
+    uint32 block_num;
     dirent_t *de;
     buf_t *dir_buf = NULL;
 
-    // 2. 读取目录对应的唯一数据块
-    dir_buf = buf_read(pip->addrs[0]);
-    assert(dir_buf != NULL, "dir_get_entries: read directory block failed");
+    // 2. 依次读取存放目录项的数据块
+    for (uint32 idx = 0; total_read < len && (block_num = dir_leaf_block(pip, idx)) != 0; idx++) {
+        dir_buf = buf_read(block_num);
+        assert(dir_buf != NULL, "dir_get_entries: read directory block failed");
+
+        // 3. 遍历目录项，复制有效项到目标缓冲区
+        for (uint32 offset = 0; offset < BLOCK_SIZE && total_read < len; offset += sizeof(dirent_t)) {
+            de = (dirent_t *)(dir_buf->data + offset);
+
+            // 4. 跳过空目录项，复制有效目录项
+            if (de->name[0] != 0 && de->inode_num != INODE_NUM_UNUSED) {
+                // 检查剩余缓冲区空间，避免越界
+                if (total_read + sizeof(dirent_t) > len) {
+                    len = total_read;
+                    break;
+                }
+
+                // 5. 区分用户态/内核态缓冲区拷贝
+                if (user) {
+                    uvm_copyout(myproc()->mm->pgtbl, (uint64)dst + total_read,
+                               (uint64)de, sizeof(dirent_t));
+                } else {
+                    memmove((char*)dst + total_read, de, sizeof(dirent_t));
+                }
+
+                // 6. 更新已读取字节数
+                total_read += sizeof(dirent_t);
+            }
+        }
 
-    // 3. 遍历目录项，复制有效项到目标缓冲区
-    for (uint32 offset = 0; offset < BLOCK_SIZE && total_read < len; offset += sizeof(dirent_t)) {
-        de = (dirent_t *)(dir_buf->data + offset);
+        // 7. 释放缓冲区
+        buf_release(dir_buf);
+    }
 
-        // 4. 跳过空目录项，复制有效目录项
-        if (de->name[0] != 0 && de->inode_num != INODE_NUM_UNUSED) {
-            // 检查剩余缓冲区空间，避免越界
-            if (total_read + sizeof(dirent_t) > len) {
-                break;
-            }
+    // 8. 返回实际读取字节数
+    return total_read;
+}
 
-            // 5. 区分用户态/内核态缓冲区拷贝
-            if (user) {
-                uvm_copyout(myproc()->pgtbl, (uint64)dst + total_read,
-                           (uint64)de, sizeof(dirent_t));
-            } else {
-                memmove((char*)dst + total_read, de, sizeof(dirent_t));
+/**
+ * @brief 从cookie处继续读取有效目录项到内核缓冲区
+ * @param pip 目录对应的inode指针（已上锁）
+ * @param cookie 输入/输出：遍历位置（0表示从头开始, 返回时指向下一个未读的位置）
+ * @param len 缓冲区字节数
+ * @param dst 内核缓冲区
+ * @return 读取的字节数（sizeof(dirent_t)的整数倍）, 0表示目录已遍历完
+ * @note cookie = 叶子序号 * DIR_PER_BLOCK + 叶子内槽位, 调用者不应解释它;
+ *       遍历期间叶子分裂时, 被移动的目录项可能重复返回或被跳过
+ */
+uint32 dir_read_entries(inode_t* pip, uint32* cookie, uint32 len, dirent_t* dst)
+{
+    assert(sleeplock_holding(&pip->slk), "dir_read_entries: not holding inode sleep lock");
+    assert(pip->type == FT_DIR, "dir_read_entries: inode is not a directory");
+
+    uint32 idx = *cookie / DIR_PER_BLOCK;
+    uint32 slot = *cookie % DIR_PER_BLOCK;
+    uint32 max = len / sizeof(dirent_t);
+    uint32 n = 0, block_num;
+
+    // 1. 从cookie指向的叶子和槽位开始, 逐块复制有效目录项
+    while (n < max && (block_num = dir_leaf_block(pip, idx)) != 0) {
+        buf_t* buf = buf_read(block_num);
+        dirent_t* de = (dirent_t*)buf->data;
+        for (; slot < DIR_PER_BLOCK && n < max; slot++) {
+            if (de[slot].name[0] != 0 && de[slot].inode_num != INODE_NUM_UNUSED) {
+                dst[n++] = de[slot];
             }
+        }
+        buf_release(buf);
 
-            // 6. 更新已读取字节数
-            total_read += sizeof(dirent_t);
+        // 2. 当前叶子读完, 转到下一个
+        if (slot == DIR_PER_BLOCK) {
+            idx++;
+            slot = 0;
         }
     }
 
-    // 7. 释放缓冲区，返回实际读取字节数
-    buf_release(dir_buf);
-    return total_read;
+    // 3. 遍历之后通常会stat每个目录项: 预读它们的inode表块
+    for (uint32 i = 0; i < n; i++) {
+        inode_prefetch(dst[i].inode_num);
+    }
+
+    // 4. 记录下一次开始的位置
+    *cookie = idx * DIR_PER_BLOCK + slot;
+    return n * sizeof(dirent_t);
 }
 
 /**
@@ -254,14 +713,18 @@ void dir_print(inode_t *pip)
     printf("\ninode_num = %d dirents:\n", pip->inode_num);
 
     dirent_t *de;
-    buf_t *buf = buf_read(pip->addrs[0]);
-    for (uint32 offset = 0; offset < BLOCK_SIZE; offset += sizeof(dirent_t))
+    uint32 block_num;
+    for (uint32 idx = 0; (block_num = dir_leaf_block(pip, idx)) != 0; idx++)
     {
-        de = (dirent_t *)(buf->data + offset);
-        if (de->name[0] != 0)
-            printf("inum = %d dirent = %s\n", de->inode_num, de->name);
+        buf_t *buf = buf_read(block_num);
+        for (uint32 offset = 0; offset < BLOCK_SIZE; offset += sizeof(dirent_t))
+        {
+            de = (dirent_t *)(buf->data + offset);
+            if (de->name[0] != 0)
+                printf("inum = %d dirent = %s\n", de->inode_num, de->name);
+        }
+        buf_release(buf);
     }
-    buf_release(buf);
 }
 
 // ---------------------- 路径解析核心操作 ----------------------
@@ -293,14 +756,85 @@ static char *skip_element(char *path, char *name)
     return path;
 }
 
+/**
+ * @brief 乐观路径查找：只使用目录项缓存, 不获取任何inode的睡眠锁
+ * @param dp 相对路径的起始目录（NULL则为当前工作目录）
+ * @param path 待解析的路径字符串
+ * @param name 用于存储最后一个路径元素名称
+ * @param find_parent true=查找父目录inode，false=查找路径本身inode
+ * @param ipp 输出：查找结果（路径不存在时为NULL）
+ * @return true表示结果可用; 缓存未命中或期间有目录项改变时返回false, 调用者回退到加锁查找
+ * @note 缓存中存在以X为父目录的项, 说明X是目录（目录被删除时dcache_purge会清除这些项）,
+ *       所以中间的路径元素不必加锁检查类型
+ */
+static bool search_inode_fast(inode_t* dp, char* path, char* name, bool find_parent, inode_t** ipp)
+{
+    proc_t* p = myproc();
+    if (dp == NULL) {
+        dp = p->cwd;
+    }
+    uint16 inum = (*path == '/' || dp == NULL) ? INODE_ROOT : dp->inode_num;
+    uint16 next;
+    uint32 seq = dcache_seq_begin();
+
+    // 1. 逐段查询目录项缓存
+    *ipp = NULL;
+    while ((path = skip_element(path, name)) != 0) {
+        if (find_parent && *path == '\0') {
+            break;
+        }
+        if (!dcache_lookup(inum, name, &next)) {
+            return false;
+        }
+        // 负向项: 最后一个元素不存在则结果确定, 中间元素不存在交给加锁查找报告
+        if (next == INODE_NUM_UNUSED) {
+            return *path == '\0' && dcache_seq_valid(seq);
+        }
+        inum = next;
+    }
+
+    // 2. 查找父目录但路径中没有元素（例如"/"）: 交给加锁查找处理
+    if (find_parent && path == 0) {
+        return false;
+    }
+
+    // 3. 取得inode引用后确认期间没有目录项改变（inode_num不会已被释放重用）
+    inode_t* ip = inode_alloc(inum);
+    if (ip == NULL || !dcache_seq_valid(seq)) {
+        if (ip != NULL) inode_free(ip);
+        return false;
+    }
+
+    // 4. 查找父目录时还需确认它是目录（元数据已读入时不必加锁）
+    if (find_parent) {
+        bool is_dir;
+        if (ip->valid) {
+            __sync_synchronize();
+            is_dir = (ip->type == FT_DIR);
+        } else {
+            inode_lock(ip);
+            is_dir = (ip->type == FT_DIR);
+            inode_unlock(ip);
+        }
+        if (!is_dir) {
+            inode_free(ip);
+            ip = NULL;
+        }
+    }
+
+    *ipp = ip;
+    return true;
+}
+
 /**
  * @brief 查找路径对应的inode（或其父目录inode）
+ * @param dp 相对路径的起始目录（NULL则为当前工作目录）
  * @param path 待解析的路径字符串
  * @param name 用于存储最后一个路径元素名称
  * @param find_parent true=查找父目录inode，false=查找路径本身inode
  * @return 成功返回inode指针，失败返回NULL
  */
-static inode_t* search_inode(char* path, char* name, bool find_parent)
+static inode_t* search_inode_walk(inode_t* dp, char* path, char* name, bool find_parent)
 {
     assert(path != NULL, "search_inode: invalid NULL path");
     assert(name != NULL, "search_inode: invalid NULL name buffer");
@@ -308,9 +842,16 @@ static inode_t* search_inode(char* path, char* name, bool find_parent)
     inode_t* ip = NULL;
     inode_t* next_ip = NULL;
 
-    // 1. 确定起始目录（绝对路径→根目录，相对路径→当前工作目录）
+    // 0. 先尝试只查目录项缓存的乐观查找
+    if (search_inode_fast(dp, path, name, find_parent, &ip)) {
+        return ip;
+    }
+
+    // 1. 确定起始目录（绝对路径→根目录，相对路径→dp或当前工作目录）
     if (*path == '/') {
         ip = inode_alloc(INODE_ROOT); // 根目录inode序号固定为0
+    } else if (dp != NULL) {
+        ip = inode_dup(dp);
     } else {
         proc_t* p = myproc();
         if (p->cwd != NULL) {
@@ -361,38 +902,62 @@ static inode_t* search_inode(char* path, char* name, bool find_parent)
     return ip;
 }
 
+// 路径解析 (计时见lib/tstat.h)
+static inode_t* search_inode(inode_t* dp, char* path, char* name, bool find_parent)
+{
+    TSTAT_BEGIN(t);
+    inode_t* ip = search_inode_walk(dp, path, name, find_parent);
+    TSTAT_END(t, TSTAT_SEARCH_INODE);
+    return ip;
+}
+
 /**
  * @brief 查找路径对应的inode
+ * @param dp 相对路径的起始目录（NULL则为当前工作目录）
  * @param path 待解析的路径字符串（绝对路径/相对路径）
  * @return 成功返回inode指针，失败返回NULL
  */
-inode_t* path_to_inode(char* path)
+inode_t* path_to_inode_at(inode_t* dp, char* path)
 {
     char name[DIR_NAME_LEN];
-    return search_inode(path, name, false);
+    return search_inode(dp, path, name, false);
 }
 
 /**
  * @brief 查找路径对应的inode的父目录inode
+ * @param dp 相对路径的起始目录（NULL则为当前工作目录）
  * @param path 待解析的路径字符串（绝对路径/相对路径）
  * @param name 用于存储路径最后一个元素的名称
  * @return 成功返回父目录inode指针，失败返回NULL
  */
-inode_t* path_to_pinode(char* path, char* name)
+inode_t* path_to_pinode_at(inode_t* dp, char* path, char* name)
 {
     assert(name != NULL, "path_to_pinode: invalid NULL name buffer");
-    return search_inode(path, name, true);
+    return search_inode(dp, path, name, true);
+}
+
+// 相对路径从当前工作目录开始
+inode_t* path_to_inode(char* path)
+{
+    return path_to_inode_at(NULL, path);
+}
+
+inode_t* path_to_pinode(char* path, char* name)
+{
+    return path_to_pinode_at(NULL, path, name);
 }
 
 /**
  * @brief 查找或创建路径对应的inode
+ * @param dp 相对路径的起始目录（NULL则为当前工作目录）
  * @param path 待解析的路径字符串（绝对路径/相对路径）
  * @param type 要创建的inode类型（FT_DIR/FT_FILE/FT_DEVICE）
  * @param major 主设备号（设备文件使用，普通文件填0）
  * @param minor 次设备号（设备文件使用，普通文件填0）
+ * @param flags INODE_F_*（例如INODE_F_EXTENT）
  * @return 成功返回inode指针，失败返回NULL
  */
-inode_t* path_create_inode(char* path, uint16 type, uint16 major, uint16 minor)
+inode_t* path_create_inode_at(inode_t* dp, char* path, uint16 type, uint16 major, uint16 minor, uint8 flags)
 {
     assert(path != NULL, "path_create_inode: invalid NULL path");
     assert(type >= FT_UNUSED && type <= FT_DEVICE, "path_create_inode: invalid inode type");
@@ -402,7 +967,7 @@ inode_t* path_create_inode(char* path, uint16 type, uint16 major, uint16 minor)
     inode_t* ip = NULL;
 
     // 1. 获取父目录inode
-    pip = path_to_pinode(path, name);
+    pip = path_to_pinode_at(dp, path, name);
     if (pip == NULL) {
         printf("path_create_inode: cannot find parent directory for %s\n", path);
         return NULL;
@@ -426,8 +991,8 @@ inode_t* path_create_inode(char* path, uint16 type, uint16 major, uint16 minor)
         return ip;
     }
 
-    // 3. 不存在，创建新inode
-    ip = inode_create(type, major, minor);
+    // 3. 不存在，在父目录附近创建新inode
+    ip = inode_create_near(pip->inode_num, type, major, minor, flags);
     if (ip == NULL) {
         inode_unlock_free(pip);
         printf("path_create_inode: cannot create new inode for %s\n", path);
@@ -462,13 +1027,20 @@ inode_t* path_create_inode(char* path, uint16 type, uint16 major, uint16 minor)
     return ip;
 }
 
+inode_t* path_create_inode(char* path, uint16 type, uint16 major, uint16 minor, uint8 flags)
+{
+    return path_create_inode_at(NULL, path, type, major, minor, flags);
+}
+
 /**
  * @brief 为已有文件创建硬链接（目录不支持链接）
+ * @param old_dp old_path的起始目录（NULL则为当前工作目录）
  * @param old_path 源文件路径
+ * @param new_dp new_path的起始目录（NULL则为当前工作目录）
  * @param new_path 新链接文件路径
  * @return 0表示成功，-1表示失败
  */
-uint32 path_link(char* old_path, char* new_path)
+uint32 path_link_at(inode_t* old_dp, char* old_path, inode_t* new_dp, char* new_path)
 {
     assert(old_path != NULL, "path_link: invalid NULL old path");
     assert(new_path != NULL, "path_link: invalid NULL new path");
@@ -478,7 +1050,7 @@ uint32 path_link(char* old_path, char* new_path)
     inode_t* pip = NULL;
 
     // 1. 获取源文件inode
-    ip = path_to_inode(old_path);
+    ip = path_to_inode_at(old_dp, old_path);
     if (ip == NULL) {
         printf("path_link: cannot find source file %s\n", old_path);
         return (uint32)-1;
@@ -494,7 +1066,7 @@ uint32 path_link(char* old_path, char* new_path)
     }
 
     // 3. 获取新链接文件的父目录inode
-    pip = path_to_pinode(new_path, name);
+    pip = path_to_pinode_at(new_dp, new_path, name);
     if (pip == NULL) {
         inode_unlock_free(ip);
         printf("path_link: cannot find parent directory for %s\n", new_path);
@@ -521,6 +1093,11 @@ uint32 path_link(char* old_path, char* new_path)
     return 0;
 }
 
+uint32 path_link(char* old_path, char* new_path)
+{
+    return path_link_at(NULL, old_path, NULL, new_path);
+}
+
 /**
  * @brief 检查目录unlink操作是否合法（是否为空目录，仅保留.和..）
  * @param ip 目录对应的inode指针（已上锁）
@@ -549,10 +1126,11 @@ static bool check_unlink(inode_t* ip)
 
 /**
  * @brief 删除文件/目录的硬链接（删除目录项，更新链接数）
+ * @param dp 相对路径的起始目录（NULL则为当前工作目录）
  * @param path 待删除链接的文件/目录路径
  * @return 0表示成功，-1表示失败
  */
-uint32 path_unlink(char* path)
+uint32 path_unlink_at(inode_t* dp, char* path)
 {
     assert(path != NULL, "path_unlink: invalid NULL path");
 
@@ -561,7 +1139,7 @@ uint32 path_unlink(char* path)
     inode_t* ip = NULL;
 
     // 1. 获取父目录inode
-    pip = path_to_pinode(path, name);
+    pip = path_to_pinode_at(dp, path, name);
     if (pip == NULL) {
         printf("path_unlink: cannot find parent directory for %s\n", path);
         return (uint32)-1;
@@ -602,8 +1180,9 @@ uint32 path_unlink(char* path)
     // 6. 从父目录中删除目录项
     dir_delete_entry(pip, name);
 
-    // 7. 目录特殊处理：父目录链接数-1
+    // 7. 目录特殊处理：父目录链接数-1, 丢弃被删除目录下的缓存项
     if (ip->type == FT_DIR) {
+        dcache_purge(ip->inode_num);
         pip->nlink--;
         inode_rw(pip, true); // 同步父目录元数据到磁盘
     }
@@ -618,4 +1197,289 @@ uint32 path_unlink(char* path)
     // 10. 释放目标inode引用，返回成功
     inode_unlock_free(ip);
     return 0;
-}
\ No newline at end of file
+}
+
+uint32 path_unlink(char* path)
+{
+    return path_unlink_at(NULL, path);
+}
+
+// ---------------------- 重命名 ----------------------
+// 跨目录的重命名互相串行 (目录树的形状在检查祖先关系期间不会改变)
+static sleeplock_t lk_rename;
+
+/**
+ * @brief 初始化目录模块（重命名锁）
+ */
+void dir_init()
+{
+    sleeplock_init(&lk_rename, "rename");
+}
+
+/**
+ * @brief 静态辅助函数：修改目录项指向的inode
+ * @param pip 目录inode（已上锁）
+ * @param name 目录项名称
+ * @param inode_num 新的inode_num
+ * @return 原来的inode_num，目录项不存在返回INODE_NUM_UNUSED
+ */
+static uint16 dir_replace_entry(inode_t* pip, char* name, uint16 inode_num)
+{
+    buf_t* buf = buf_read(dir_name_block(pip, name));
+    dirent_t* de = (dirent_t*)buf->data;
+    uint16 old = INODE_NUM_UNUSED;
+
+    for (uint32 i = 0; i < DIR_PER_BLOCK; i++) {
+        if (de[i].name[0] != 0 && strncmp(de[i].name, name, DIR_NAME_LEN) == 0) {
+            old = de[i].inode_num;
+            de[i].inode_num = inode_num;
+            journal_log(buf);
+            dcache_change(pip->inode_num, name, inode_num);
+            break;
+        }
+    }
+    buf_release(buf);
+    return old;
+}
+
+/**
+ * @brief 静态辅助函数：线性目录中原地修改目录项的名称（只写一次数据块）
+ * @param pip 目录inode（已上锁, 不是哈希索引目录）
+ * @return 成功返回true
+ */
+static bool dir_rename_entry(inode_t* pip, char* old_name, char* new_name)
+{
+    buf_t* buf = buf_read(inode_locate_block(pip, 0, false));
+    dirent_t* de = (dirent_t*)buf->data;
+    bool ok = false;
+
+    for (uint32 i = 0; i < DIR_PER_BLOCK; i++) {
+        if (de[i].name[0] != 0 && strncmp(de[i].name, old_name, DIR_NAME_LEN) == 0) {
+            strncpy(de[i].name, new_name, DIR_NAME_LEN);
+            journal_log(buf);
+            dcache_change(pip->inode_num, old_name, INODE_NUM_UNUSED);
+            dcache_change(pip->inode_num, new_name, de[i].inode_num);
+            ok = true;
+            break;
+        }
+    }
+    buf_release(buf);
+    return ok;
+}
+
+/**
+ * @brief 静态辅助函数：目录dp是否等于目录anc或在它下面
+ * @note 沿着".."向上走到根目录, 调用者持有lk_rename且不持有路径上任何目录的睡眠锁
+ */
+static bool dir_is_ancestor(uint16 anc, inode_t* dp)
+{
+    inode_t* ip = inode_dup(dp);
+    while (ip->inode_num != anc) {
+        if (ip->inode_num == INODE_ROOT) {
+            inode_free(ip);
+            return false;
+        }
+        inode_lock(ip);
+        uint16 parent = dir_search_entry(ip, "..");
+        inode_unlock_free(ip);
+        if (parent == INODE_NUM_UNUSED) {
+            return false;
+        }
+        ip = inode_alloc(parent);
+    }
+    inode_free(ip);
+    return true;
+}
+
+/**
+ * @brief 静态辅助函数：把已存在的目录项name改为指向inode_num, 原来的文件链接数-1
+ * @param pip 目录inode（已上锁）
+ * @param src_dir 被移动的是否为目录
+ * @return 成功返回0，失败返回-1（不替换目录, 也不用目录替换普通文件）
+ */
+static uint32 rename_replace(inode_t* pip, char* name, uint16 inode_num, uint16 target, bool src_dir)
+{
+    inode_t* tip = inode_alloc(target);
+    inode_lock(tip);
+    if (tip->type == FT_DIR || src_dir) {
+        inode_unlock_free(tip);
+        return (uint32)-1;
+    }
+
+    dir_replace_entry(pip, name, inode_num);
+    tip->nlink--;
+    inode_rw(tip, true);
+    inode_unlock_free(tip);
+    return 0;
+}
+
+/**
+ * @brief 静态辅助函数：查询目录项指向的inode是否为目录
+ */
+static bool rename_is_dir(uint16 inode_num)
+{
+    inode_t* ip = inode_alloc(inode_num);
+    inode_lock(ip);
+    bool is_dir = (ip->type == FT_DIR);
+    inode_unlock_free(ip);
+    return is_dir;
+}
+
+/**
+ * @brief 静态辅助函数：同一目录内的重命名（持有pip的睡眠锁）
+ * @note 线性目录直接改写目录项名称; 其余情况添加新目录项后删除旧目录项, inode的nlink不变
+ */
+static uint32 rename_same_dir(inode_t* pip, char* old_name, char* new_name)
+{
+    // 1. 源目录项必须存在, 同名直接成功
+    uint16 inum = dir_search_entry(pip, old_name);
+    if (inum == INODE_NUM_UNUSED) {
+        return (uint32)-1;
+    }
+    if (strncmp(old_name, new_name, DIR_NAME_LEN) == 0) {
+        return 0;
+    }
+
+    // 2. 目标已存在: 原地替换目标目录项, 再删除源目录项
+    uint16 target = dir_search_entry(pip, new_name);
+    if (target == inum) {
+        return 0;   // 同一个文件的两个链接, 什么都不做
+    }
+    if (target != INODE_NUM_UNUSED) {
+        if (rename_replace(pip, new_name, inum, target, rename_is_dir(inum)) != 0) {
+            return (uint32)-1;
+        }
+        dir_delete_entry(pip, old_name);
+        return 0;
+    }
+
+    // 3. 线性目录: 原地改名
+    if (!(pip->flags & INODE_F_INDEX)) {
+        return dir_rename_entry(pip, old_name, new_name) ? 0 : (uint32)-1;
+    }
+
+    // 4. 哈希索引目录: 新名字可能属于另一个叶子
+    if (dir_add_entry(pip, inum, new_name) == BLOCK_SIZE) {
+        return (uint32)-1;
+    }
+    dir_delete_entry(pip, old_name);
+    return 0;
+}
+
+/**
+ * @brief 静态辅助函数：跨目录的重命名（调用者持有lk_rename）
+ * @note 两个父目录按"祖先在前"的顺序上锁, 与先锁父目录再锁子目录的其他操作一致;
+ *       移动目录时更新它的".."和两个父目录的nlink, 禁止把目录移到它自己下面
+ */
+static uint32 rename_cross_dir(inode_t* opip, char* old_name, inode_t* npip, char* new_name)
+{
+    uint32 ret = (uint32)-1;
+
+    // 1. 确定源inode及其类型
+    inode_lock(opip);
+    uint16 inum = dir_search_entry(opip, old_name);
+    inode_unlock(opip);
+    if (inum == INODE_NUM_UNUSED) {
+        return ret;
+    }
+    bool is_dir = rename_is_dir(inum);
+    if (is_dir && dir_is_ancestor(inum, npip)) {
+        return ret;
+    }
+
+    // 2. 按祖先在前的顺序锁住两个父目录
+    inode_t* first = dir_is_ancestor(npip->inode_num, opip) ? npip : opip;
+    inode_t* second = (first == opip) ? npip : opip;
+    inode_lock(first);
+    inode_lock(second);
+
+    // 3. 上锁期间源目录项可能已被删除: 重新确认
+    if (dir_search_entry(opip, old_name) != inum) {
+        goto out;
+    }
+
+    // 4. 在新目录中登记（目标已存在则原地替换）
+    uint16 target = dir_search_entry(npip, new_name);
+    if (target == inum) {
+        ret = 0;
+        goto out;
+    }
+    if (target != INODE_NUM_UNUSED) {
+        if (rename_replace(npip, new_name, inum, target, is_dir) != 0) {
+            goto out;
+        }
+    } else if (dir_add_entry(npip, inum, new_name) == BLOCK_SIZE) {
+        goto out;
+    }
+
+    // 5. 删除旧目录项
+    dir_delete_entry(opip, old_name);
+
+    // 6. 目录: ".."改为指向新父目录, 链接数从旧父目录转到新父目录
+    if (is_dir) {
+        inode_t* ip = inode_alloc(inum);
+        inode_lock(ip);
+        dir_replace_entry(ip, "..", npip->inode_num);
+        inode_unlock_free(ip);
+        opip->nlink--;
+        npip->nlink++;
+        inode_rw(opip, true);
+        inode_rw(npip, true);
+    }
+    ret = 0;
+
+out:
+    inode_unlock(second);
+    inode_unlock(first);
+    return ret;
+}
+
+/**
+ * @brief 重命名文件/目录（一次操作完成, 源inode的nlink不变）
+ * @param old_path 原路径
+ * @param new_path 新路径（已存在的普通文件会被替换）
+ * @return 0表示成功，-1表示失败
+ */
+uint32 path_rename(char* old_path, char* new_path)
+{
+    assert(old_path != NULL, "path_rename: invalid NULL old path");
+    assert(new_path != NULL, "path_rename: invalid NULL new path");
+
+    char old_name[DIR_NAME_LEN], new_name[DIR_NAME_LEN];
+    uint32 ret = (uint32)-1;
+
+    // 1. 获取两个父目录
+    inode_t* opip = path_to_pinode(old_path, old_name);
+    if (opip == NULL) {
+        printf("path_rename: cannot find parent directory for %s\n", old_path);
+        return ret;
+    }
+    inode_t* npip = path_to_pinode(new_path, new_name);
+    if (npip == NULL) {
+        inode_free(opip);
+        printf("path_rename: cannot find parent directory for %s\n", new_path);
+        return ret;
+    }
+
+    // 2. 校验：禁止移动.和..
+    if (strncmp(old_name, ".", DIR_NAME_LEN) == 0 || strncmp(old_name, "..", DIR_NAME_LEN) == 0 ||
+        strncmp(new_name, ".", DIR_NAME_LEN) == 0 || strncmp(new_name, "..", DIR_NAME_LEN) == 0) {
+        printf("path_rename: cannot rename . or ..\n");
+    }
+    // 3. 同一目录: 只锁一次
+    else if (opip->inode_num == npip->inode_num) {
+        inode_lock(opip);
+        ret = rename_same_dir(opip, old_name, new_name);
+        inode_unlock(opip);
+    }
+    // 4. 跨目录
+    else {
+        sleeplock_acquire(&lk_rename);
+        ret = rename_cross_dir(opip, old_name, npip, new_name);
+        sleeplock_release(&lk_rename);
+    }
+
+    inode_free(npip);
+    inode_free(opip);
+    return ret;
+}
@@ -0,0 +1,312 @@
+#include "fs/buf.h"
+#include "fs/journal.h"
+#include "fs/bitmap.h"
+#include "fs/extent.h"
+#include "fs/inode.h"
+#include "lib/print.h"
+#include "lib/str.h"
+
+/*
+    extent树 (见fs/extent.h)
+    所有函数的调用者必须持有inode睡眠锁; 根节点修改后由调用者负责inode_rw写回
+*/
+
+// 根节点就是inode的addrs区域
+#define EXTENT_ROOT(ip) ((extent_header_t*)(ip)->addrs)
+
+// 节点中的第一个项
+#define EXTENT_FIRST(hdr) ((extent_t*)((extent_header_t*)(hdr) + 1))
+
+/**
+ * @brief 静态辅助函数：二分查找节点中最后一个lstart <= bn的项
+ * @param ext 节点的项数组
+ * @param n 项数
+ * @param bn 逻辑块号
+ * @return 项的下标, 所有项的lstart都大于bn时返回-1
+ */
+static int extent_search(extent_t* ext, uint32 n, uint32 bn)
+{
+    int lo = 0, hi = (int)n - 1, ret = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (ext[mid].lstart <= bn) {
+            ret = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief 静态辅助函数：在叶子节点中查找bn对应的物理块
+ * @return 物理块编号, bn未映射时返回0
+ */
+static uint32 extent_leaf_lookup(extent_header_t* hdr, uint32 bn)
+{
+    extent_t* ext = EXTENT_FIRST(hdr);
+    int i = extent_search(ext, hdr->n, bn);
+    if (i >= 0 && bn - ext[i].lstart < ext[i].len) {
+        return ext[i].pstart + (bn - ext[i].lstart);
+    }
+    return 0;
+}
+
+/**
+ * @brief 静态辅助函数：向叶子节点插入映射, 能与相邻的extent合并时直接合并
+ * @param hdr 叶子节点
+ * @param max 节点容量
+ * @return 成功返回true, 节点已满时返回false（节点不变）
+ */
+static bool extent_leaf_insert(extent_header_t* hdr, uint32 max, uint32 bn, uint32 pstart, uint32 n)
+{
+    extent_t* ext = EXTENT_FIRST(hdr);
+    int i = extent_search(ext, hdr->n, bn);
+
+    // 1. 接在前一个extent之后（逻辑和物理都连续）
+    if (i >= 0 && ext[i].lstart + ext[i].len == bn && ext[i].pstart + ext[i].len == pstart) {
+        ext[i].len += n;
+        // 正好补上与后一个extent之间的空隙: 两者合并
+        if (i + 1 < hdr->n && ext[i].lstart + ext[i].len == ext[i + 1].lstart &&
+            ext[i].pstart + ext[i].len == ext[i + 1].pstart) {
+            ext[i].len += ext[i + 1].len;
+            memmove(&ext[i + 1], &ext[i + 2], (hdr->n - i - 2) * sizeof(extent_t));
+            hdr->n--;
+        }
+        return true;
+    }
+
+    // 2. 接在后一个extent之前
+    if (i + 1 < hdr->n && bn + n == ext[i + 1].lstart && pstart + n == ext[i + 1].pstart) {
+        ext[i + 1].lstart = bn;
+        ext[i + 1].pstart = pstart;
+        ext[i + 1].len += n;
+        return true;
+    }
+
+    // 3. 新建extent
+    if (hdr->n == max) {
+        return false;
+    }
+    memmove(&ext[i + 2], &ext[i + 1], (hdr->n - i - 1) * sizeof(extent_t));
+    ext[i + 1].lstart = bn;
+    ext[i + 1].pstart = pstart;
+    ext[i + 1].len = n;
+    hdr->n++;
+    return true;
+}
+
+/**
+ * @brief 静态辅助函数：分配一个清零的叶子块
+ * @param buf 输出：叶子块的缓冲区（持有睡眠锁）
+ * @return 叶子块编号
+ */
+static uint32 extent_new_leaf(buf_t** buf)
+{
+    uint32 block_num = bitmap_alloc_block();
+    *buf = buf_get_nofill(block_num);
+    memset((*buf)->data, 0, BLOCK_SIZE);
+    return block_num;
+}
+
+/**
+ * @brief 查找inode的第bn个数据块, 不存在且alloc = true时分配
+ * @param ip 内存inode指针（extent映射）
+ * @param bn 数据块序号
+ * @param alloc 不存在时是否分配
+ * @param fill 分配时使用的块号（0则新分配, 优先紧接在第bn-1个数据块之后）
+ * @return 数据块的磁盘编号, 不存在且不分配时返回0
+ */
+uint32 extent_map(inode_t* ip, uint32 bn, bool alloc, uint32 fill)
+{
+    extent_header_t* root = EXTENT_ROOT(ip);
+    uint32 block_num = 0;
+
+    // 1. 查找: depth = 0直接在根节点中查找, 否则先找到叶子块
+    if (root->depth == 0) {
+        block_num = extent_leaf_lookup(root, bn);
+    } else {
+        int i = extent_search(EXTENT_FIRST(root), root->n, bn);
+        if (i >= 0) {
+            buf_t* buf = buf_read(EXTENT_FIRST(root)[i].pstart);
+            block_num = extent_leaf_lookup((extent_header_t*)buf->data, bn);
+            buf_release(buf);
+        }
+    }
+    if (block_num != 0 || !alloc) {
+        return block_num;
+    }
+
+    // 2. 分配: 尽量接在前一个数据块之后, 这样能合并进已有的extent
+    if (fill == 0) {
+        uint32 n = 1;
+        uint32 prev = (bn > 0) ? extent_map(ip, bn - 1, false, 0) : 0;
+        fill = bitmap_alloc_extent(prev != 0 ? prev + 1 : bitmap_data_goal(ip->inode_num), &n);
+    }
+    extent_insert(ip, bn, fill, 1);
+    return fill;
+}
+
+/**
+ * @brief 记录映射: 文件的[bn, bn + n)存放在磁盘的[pstart, pstart + n)
+ * @param ip 内存inode指针（extent映射）
+ * @param bn 逻辑起始块（这一段必须尚未映射）
+ * @param pstart 物理起始块
+ * @param n 块数
+ * @note 根节点满时把所有extent移入一个叶子块, 根节点变为索引节点;
+ *       叶子块满时对半分裂; 根节点中的索引项也满时extent树已满, 报错
+ */
+void extent_insert(inode_t* ip, uint32 bn, uint32 pstart, uint32 n)
+{
+    assert(sleeplock_holding(&ip->slk), "extent_insert: not holding inode sleeplock");
+    extent_header_t* root = EXTENT_ROOT(ip);
+
+    // 1. 根节点是叶子节点: 直接插入, 满了则下移到叶子块
+    if (root->depth == 0) {
+        if (extent_leaf_insert(root, EXTENT_ROOT_MAX, bn, pstart, n)) {
+            return;
+        }
+        buf_t* buf;
+        uint32 leaf = extent_new_leaf(&buf);
+        extent_header_t* hdr = (extent_header_t*)buf->data;
+        memmove(hdr, root, sizeof(extent_header_t) + root->n * sizeof(extent_t));
+        journal_log(buf);
+        buf_release(buf);
+
+        root->depth = 1;
+        root->n = 1;
+        EXTENT_FIRST(root)[0].lstart = EXTENT_FIRST(hdr)[0].lstart;
+        EXTENT_FIRST(root)[0].pstart = leaf;
+        EXTENT_FIRST(root)[0].len = 0;
+    }
+
+    // 2. 根节点是索引节点: 找到负责bn的叶子块（bn比所有项都小时用第一个叶子）
+    for (;;) {
+        extent_t* idx = EXTENT_FIRST(root);
+        int i = extent_search(idx, root->n, bn);
+        if (i < 0) {
+            i = 0;
+            idx[0].lstart = bn;
+        }
+
+        buf_t* buf = buf_read(idx[i].pstart);
+        extent_header_t* hdr = (extent_header_t*)buf->data;
+        if (extent_leaf_insert(hdr, EXTENT_NODE_MAX, bn, pstart, n)) {
+            journal_log(buf);
+            buf_release(buf);
+            return;
+        }
+
+        // 3. 叶子块已满: 后一半移到新的叶子块, 在根节点中插入对应的索引项后重试
+        if (root->n == EXTENT_ROOT_MAX) {
+            buf_release(buf);
+            panic("extent_insert: extent tree is full");
+        }
+        buf_t* nbuf;
+        uint32 leaf = extent_new_leaf(&nbuf);
+        extent_header_t* nhdr = (extent_header_t*)nbuf->data;
+        uint32 keep = hdr->n / 2;
+        nhdr->n = hdr->n - keep;
+        nhdr->depth = 0;
+        memmove(EXTENT_FIRST(nhdr), EXTENT_FIRST(hdr) + keep, nhdr->n * sizeof(extent_t));
+        hdr->n = keep;
+        journal_log(nbuf);
+        journal_log(buf);
+
+        memmove(&idx[i + 2], &idx[i + 1], (root->n - i - 1) * sizeof(extent_t));
+        idx[i + 1].lstart = EXTENT_FIRST(nhdr)[0].lstart;
+        idx[i + 1].pstart = leaf;
+        idx[i + 1].len = 0;
+        root->n++;
+
+        buf_release(nbuf);
+        buf_release(buf);
+    }
+}
+
+/**
+ * @brief 静态辅助函数：截断叶子节点, 释放逻辑块号 >= keep 的数据块
+ * @param hdr 叶子节点
+ * @param keep 保留[0, keep)
+ * @param batch 批量释放表
+ * @return 节点是否有变化
+ */
+static bool extent_leaf_truncate(extent_header_t* hdr, uint32 keep, bitmap_free_batch_t* batch)
+{
+    extent_t* ext = EXTENT_FIRST(hdr);
+    uint32 n = 0;
+    bool changed = false;
+
+    for (uint32 i = 0; i < hdr->n; i++) {
+        // 1. 整个extent都在keep之后则全部释放, 跨越keep则只释放尾部
+        uint32 from = (ext[i].lstart >= keep) ? 0 : keep - ext[i].lstart;
+        if (from < ext[i].len) {
+            for (uint32 b = from; b < ext[i].len; b++) {
+                bitmap_free_batch_add(batch, ext[i].pstart + b);
+            }
+            ext[i].len = from;
+            changed = true;
+        }
+        // 2. 保留非空的extent
+        if (ext[i].len > 0) {
+            ext[n++] = ext[i];
+        }
+    }
+    hdr->n = n;
+    return changed;
+}
+
+/**
+ * @brief 截断extent树: 释放逻辑块号 >= keep 的数据块, 变空的叶子块一并释放
+ * @param ip 内存inode指针（extent映射）
+ * @param keep 保留[0, keep)
+ * @param batch 批量释放表
+ */
+void extent_truncate(inode_t* ip, uint32 keep, bitmap_free_batch_t* batch)
+{
+    assert(sleeplock_holding(&ip->slk), "extent_truncate: not holding inode sleeplock");
+    extent_header_t* root = EXTENT_ROOT(ip);
+
+    // 1. 根节点是叶子节点
+    if (root->depth == 0) {
+        extent_leaf_truncate(root, keep, batch);
+        return;
+    }
+
+    // 2. 逐个截断叶子块, 删除变空的叶子
+    extent_t* idx = EXTENT_FIRST(root);
+    uint32 n = 0;
+    for (uint32 i = 0; i < root->n; i++) {
+        buf_t* buf = buf_read(idx[i].pstart);
+        extent_header_t* hdr = (extent_header_t*)buf->data;
+        if (extent_leaf_truncate(hdr, keep, batch) && hdr->n > 0) {
+            journal_log(buf);
+        }
+        bool empty = (hdr->n == 0);
+        buf_release(buf);
+
+        if (empty) {
+            bitmap_free_batch_add(batch, idx[i].pstart);
+        } else {
+            idx[n++] = idx[i];
+        }
+    }
+    root->n = n;
+
+    // 3. 所有叶子都被删除: 根节点恢复为空的叶子节点
+    if (n == 0) {
+        root->depth = 0;
+    }
+}
+
+/**
+ * @brief 释放inode的所有数据块和叶子块, 根节点清空（仍为extent映射）
+ * @param ip 内存inode指针（extent映射）
+ * @param batch 批量释放表
+ */
+void extent_free(inode_t* ip, bitmap_free_batch_t* batch)
+{
+    extent_truncate(ip, 0, batch);
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+}
@@ -4,81 +4,108 @@
 #include "fs/bitmap.h"
 #include "fs/inode.h"
 #include "fs/file.h"
+#include "fs/pipe.h"
+#include "fs/pcache.h"
+#include "fs/journal.h"
+#include "fs/procfs.h"
+#include "fs/tmpfs.h"
+#include "fs/poll.h"
+#include "fs/refcnt.h"
+#include "dev/console.h"
+#include "dev/vio.h"
 #include "mem/vmem.h"
+#include "mem/pmem.h"
+#include "mem/slab.h"
 #include "proc/cpu.h"
+#include "proc/proc.h"
+#include "proc/kwork.h"
 #include "lib/print.h"
+#include "lib/str.h"
+#include "riscv.h"
 
 // 设备列表(存储各类设备的读写接口，全局可见)
 dev_t devlist[N_DEV];
 
-// 文件表（ftable）配置：最大32个文件同时打开
-#define N_FILE 32
-file_t ftable[N_FILE];    // 全局文件表
-spinlock_t lk_ftable;     // 保护文件表的自旋锁（引用计数、文件查找/分配）
+// 文件表（ftable）: 文件项从slab cache申请, 没有固定上限
+// 引用计数原子地修改, 不需要锁: 文件项不在任何可以查找的表中, 只有已经持有引用的人可以复制它,
+// 所以计数归零之后不会再被增加, 让计数归零的那一次放弃负责释放
+static kmem_cache_t file_cache;
+
+// 交给后台工作线程的预读: 读者不用等预读的页读完就可以返回
+typedef struct file_ra_work {
+    kwork_t work;
+    inode_t* ip;        // 持有一个引用
+    uint32 bn;
+    uint32 count;
+} file_ra_work_t;
+
+static kmem_cache_t ra_work_cache;
 
 // ---------------------- 基础初始化 ----------------------
 /**
  * @brief 初始化文件表（ftable）和设备列表（devlist）
- * @note 必须在文件系统初始化后、进程创建前调用
+ * @note 第一个进程第一次运行时调用 (在fs_init之前, 见proc.c的fork_return)
  */
 void file_init()
 {
-    // 1. 初始化文件表全局自旋锁
-    spinlock_init(&lk_ftable, "ftable");
+    // 1. 文件项和异步预读请求的slab cache
+    kmem_cache_init(&file_cache, "file", sizeof(file_t), MEMTAG_FILE);
+    kmem_cache_init(&ra_work_cache, "file_ra", sizeof(file_ra_work_t), MEMTAG_FILE);
 
-    // 2. 遍历初始化文件表中的所有文件项（空闲状态）
-    for (int i = 0; i < N_FILE; i++) {
-        file_t* file = &ftable[i];
-        file->ref = 0;                // 引用计数初始化为0（空闲）
-        file->type = FD_UNUSED;       // 类型标记为未使用
-        file->readable = false;       // 默认不可读
-        file->writable = false;       // 默认不可写
-        file->major = 0;              // 默认主设备号为0
-        file->offset = 0;             // 默认偏移量为0
-        file->ip = NULL;              // 默认无关联inode
-    }
+    // 3. 初始化管道表和就绪通知
+    pipe_init();
+    poll_init();
 
     // 3. 遍历初始化设备列表（默认无读写接口）
     for (int i = 0; i < N_DEV; i++) {
         devlist[i].read = NULL;       // 默认无读接口
         devlist[i].write = NULL;      // 默认无写接口
+        devlist[i].poll = NULL;       // 默认总是可读可写
     }
+
+    // 4. 注册控制台设备
+    console_init();
 }
 
 // ---------------------- 文件项分配与释放 ----------------------
 /**
- * @brief 在文件表（ftable）中分配一个空闲文件项
- * @return 空闲文件项指针（引用计数初始化为1）
- * @note 无空闲文件项时panic报错
+ * @brief 从slab cache中分配一个文件项
+ * @return 空闲文件项指针（引用计数初始化为1），内存不足时返回NULL
+ * @note 分配和释放都是O(1); 全空的slab页归还给pmem
  */
 file_t* file_alloc()
 {
-    // 1. 获取文件表自旋锁，保护文件表遍历和修改
-    spinlock_acquire(&lk_ftable);
-
-    // 2. 遍历文件表，查找第一个空闲文件项（引用计数为0）
-    for (int i = 0; i < N_FILE; i++) {
-        file_t* file = &ftable[i];
-        if (file->ref == 0) {
-            // 3. 初始化空闲文件项的核心字段
-            file->ref = 1;                // 引用计数置1（标记被使用）
-            file->type = FD_UNUSED;       // 类型暂标记为未使用
-            file->readable = false;       // 默认不可读
-            file->writable = false;       // 默认不可写
-            file->major = 0;              // 默认主设备号为0
-            file->offset = 0;             // 默认偏移量为0
-            file->ip = NULL;              // 默认无关联inode
-
-            // 4. 释放自旋锁，返回分配的文件项
-            spinlock_release(&lk_ftable);
-            return file;
-        }
+    // 1. 申请文件项（其他进程还看不到它）
+    file_t* file = (file_t*)kmem_cache_alloc(&file_cache);
+    if (file == NULL) {
+        return NULL;
     }
 
-    // 5. 无空闲文件项，报错退出
-    spinlock_release(&lk_ftable);
-    panic("file_alloc: no free file in ftable");
-    return NULL;  // 不可达，仅满足函数返回值要求
+    // 2. 初始化空闲文件项的核心字段
+    file->ref = 1;                // 引用计数置1（标记被使用）
+    file->type = FD_UNUSED;       // 类型暂标记为未使用
+    file->readable = false;       // 默认不可读
+    file->writable = false;       // 默认不可写
+    file->direct = false;         // 默认经过页缓存
+    file->major = 0;              // 默认主设备号为0
+    file->offset = 0;             // 默认偏移量为0
+    file->ip = NULL;              // 默认无关联inode
+    file->pipe = NULL;            // 默认无关联管道
+    file->proc_node = 0;          // 默认不是统计文件
+    file->proc_pid = 0;
+    file->tmp = NULL;             // 默认不是/tmp下的文件
+    file->ep = NULL;              // 默认不是监视集合
+    file->ra_next = 0;            // 从文件头开始读视为顺序访问
+    file->ra_last = 0;
+    file->ra_stride = 0;
+    file->ra_window = 0;          // 尚未开始预读
+    file->ra_end = 0;
+    file->ra_mode = RA_OFF;
+    file->ra_hits = 0;
+    file->ra_wasted = 0;
+    file->advice = FADV_NORMAL;   // 没有访问模式提示
+    file->dir_cookie = 0;         // 目录从头开始遍历
+    return file;
 }
 
 /**
@@ -89,40 +116,41 @@ void file_close(file_t* file)
 {
     assert(file != NULL, "file_close: invalid NULL file pointer");
 
-    // 1. 获取文件表自旋锁，保护引用计数修改
-    spinlock_acquire(&lk_ftable);
-
-    // 2. 校验引用计数合法性（避免重复关闭）
-    if (file->ref < 1) {
-        spinlock_release(&lk_ftable);
+    // 1. 原子地引用计数-1, 校验引用计数合法性（避免重复关闭）
+    uint32 old = __sync_fetch_and_sub(&file->ref, 1);
+    if (old < 1) {
         panic("file_close: file ref count is less than 1 (double close)");
     }
 
-    // 3. 引用计数-1
-    file->ref--;
-
-    // 4. 若引用计数归0（无任何进程使用），释放关联资源
-    if (file->ref == 0) {
+    // 2. 若引用计数归0（无任何进程使用），释放关联资源
+    if (old == 1) {
         inode_t* ip = file->ip;  // 保存关联inode，后续释放
+        pipe_t* pipe = file->pipe;
+        tmpfs_node_t* tmp = file->tmp;
+        epoll_t* ep = file->ep;
+        bool writable = file->writable;
 
-        // 4.1 重置文件项字段，标记为空闲
-        file->type = FD_UNUSED;
-        file->readable = false;
-        file->writable = false;
-        file->major = 0;
-        file->offset = 0;
-        file->ip = NULL;
-
-        // 4.2 释放自旋锁（后续操作不涉及文件表）
-        spinlock_release(&lk_ftable);
+        // 2.1 文件项还给slab cache（已经没有其他引用）
+        kmem_cache_free(&file_cache, file);
 
-        // 4.3 释放关联的inode（若存在）
+        // 2.2 释放关联的inode（若存在, 最后一个引用时可能写回或销毁inode）
         if (ip != NULL) {
+            journal_begin();
             inode_free(ip);
+            journal_end();
+        }
+        // 2.3 关闭管道的对应一端
+        if (pipe != NULL) {
+            pipe_close(pipe, writable);
+        }
+        // 2.4 放弃/tmp节点的引用（已删除的节点在这里释放）
+        if (tmp != NULL) {
+            tmpfs_close(tmp);
+        }
+        // 2.5 释放监视集合 (关闭其中各项的文件)
+        if (ep != NULL) {
+            epoll_close(ep);
         }
-    } else {
-        // 5. 引用计数仍大于0，直接释放自旋锁
-        spinlock_release(&lk_ftable);
     }
 }
 
@@ -140,7 +168,9 @@ file_t* file_create_dev(char* path, uint16 major, uint16 minor)
     assert(major < N_DEV, "file_create_dev: major device number out of range");
 
     // 1. 根据路径创建设备类型inode（FT_DEVICE）
-    inode_t* ip = path_create_inode(path, FT_DEVICE, major, minor);
+    journal_begin();
+    inode_t* ip = path_create_inode(path, FT_DEVICE, major, minor, 0);
+    journal_end();
     if (ip == NULL) {
         printf("file_create_dev: create inode for path %s failed\n", path);
         return NULL;
@@ -166,24 +196,41 @@ file_t* file_create_dev(char* path, uint16 major, uint16 minor)
 
 /**
  * @brief 打开一个文件（支持普通文件、目录、设备文件）
+ * @param dp 相对路径的起始目录（NULL则为当前工作目录）
  * @param path 文件路径
  * @param open_mode 打开模式（MODE_CREATE/MODE_READ/MODE_WRITE）
  * @return 打开文件对应的文件项指针，失败返回NULL
  */
-file_t* file_open(char* path, uint32 open_mode)
+file_t* file_open_at(inode_t* dp, char* path, uint32 open_mode)
 {
     assert(path != NULL, "file_open: invalid NULL path");
 
     inode_t* ip = NULL;
     file_t* file = NULL;
 
+    // 0. /proc下的统计文件没有inode (绝对路径, 与dp无关)
+    if (strncmp(path, "/proc/", 6) == 0) {
+        return procfs_open(path + 6, open_mode);
+    }
+    // /tmp下的文件在内存文件系统中 (同样是绝对路径)
+    char* tpath = tmpfs_path(path);
+    if (tpath != NULL) {
+        return tmpfs_open(tpath, open_mode);
+    }
+
     // 1. 根据打开模式获取/创建inode
     if (open_mode & MODE_CREATE) {
-        // 模式包含创建：文件不存在则创建（默认创建普通文件FT_FILE）
-        ip = path_create_inode(path, FT_FILE, 0, 0);
+        // 模式包含创建：文件不存在则创建（默认创建普通文件FT_FILE, MODE_EXTENT选择extent映射, MODE_COMPRESS选择压缩）
+        uint8 flags = (open_mode & MODE_EXTENT) ? INODE_F_EXTENT : 0;
+        if (open_mode & MODE_COMPRESS) {
+            flags = INODE_F_COMPRESS;
+        }
+        journal_begin();
+        ip = path_create_inode_at(dp, path, FT_FILE, 0, 0, flags);
+        journal_end();
     } else {
         // 模式不包含创建：仅查找已有文件的inode
-        ip = path_to_inode(path);
+        ip = path_to_inode_at(dp, path);
     }
 
     // 2. 校验inode获取/创建结果
@@ -216,6 +263,8 @@ file_t* file_open(char* path, uint32 open_mode)
     // 6. 根据打开模式设置读写权限
     file->readable = (open_mode & MODE_READ) ? true : false;
     file->writable = (open_mode & MODE_WRITE) ? true : false;
+    // 压缩文件的数据块中不是文件内容, 总是经过页缓存
+    file->direct = (open_mode & MODE_DIRECT) && file->type == FD_FILE && !(ip->flags & INODE_F_COMPRESS);
 
     // 7. 初始化文件项其他字段
     file->offset = 0;             // 初始偏移量为0
@@ -226,6 +275,265 @@ file_t* file_open(char* path, uint32 open_mode)
     return file;
 }
 
+file_t* file_open(char* path, uint32 open_mode)
+{
+    return file_open_at(NULL, path, open_mode);
+}
+
+#define RA_MIN_BLOCKS 4   // 识别出顺序访问后的初始预读窗口
+#define RA_MAX_BLOCKS (2 * VIRTIO_MAX_SG * PCACHE_BLOCKS) // 预读窗口上限: 两个满的磁盘请求（一个被读取时另一个在传输）
+#define RA_STRIDE_MIN 2   // 识别出固定步长后的初始预读记录数
+#define RA_STRIDE_MAX 8   // 步长预读的记录数上限
+#define RA_SAMPLE 16      // 预读命中统计的衰减周期（次）
+#define RA_WILLNEED_MAX (N_PCACHE / 2 * PCACHE_BLOCKS) // FADV_WILLNEED一次最多读入的块数（页缓存的一半）
+
+// 工作线程中执行预读, 之后放弃inode的引用（最后一个引用时可能销毁inode, 需要日志操作）
+static void file_ra_fn(void* arg)
+{
+    file_ra_work_t* ra = (file_ra_work_t*)arg;
+    inode_lock_shared(ra->ip);
+    inode_readahead(ra->ip, ra->bn, ra->count);
+    inode_unlock_shared(ra->ip);
+    journal_begin();
+    inode_free(ra->ip);
+    journal_end();
+    kmem_cache_free(&ra_work_cache, ra);
+}
+
+/**
+ * @brief 辅助函数：把[bn, bn + count)的预读交给工作线程
+ * @param ip 内存inode指针（调用者持有睡眠锁）
+ * @note 申请不到请求时在当前上下文中同步预读
+ */
+static void file_readahead_async(inode_t* ip, uint32 bn, uint32 count)
+{
+    file_ra_work_t* ra = (file_ra_work_t*)kmem_cache_alloc(&ra_work_cache);
+    if (ra == NULL) {
+        inode_readahead(ip, bn, count);
+        return;
+    }
+    ra->work.fn = file_ra_fn;
+    ra->work.arg = ra;
+    ra->work.pending = false;
+    ra->ip = inode_dup(ip);
+    ra->bn = bn;
+    ra->count = count;
+    kwork_queue(&ra->work);
+}
+
+// 辅助函数：read之前检查上一次预读是否覆盖了本次读取的第一页, 统计预读命中 / 浪费
+// 预读过的页在使用前已被替换（页缓存压力大）时窗口减半; 最近RA_SAMPLE次中较早的统计逐步衰减
+static void file_ra_account(file_t* file, uint32 offset)
+{
+    if (file->ra_mode == RA_OFF || file->ra_window == 0 || offset / BLOCK_SIZE >= file->ra_end ||
+        (file->ip->flags & INODE_F_PACKED)) {
+        return;
+    }
+    bool predicted = (file->ra_mode == RA_SEQ) ? (offset == file->ra_next)
+                                               : (offset == file->ra_last + file->ra_stride);
+    if (!predicted) {
+        return;
+    }
+
+    if (pcache_present(file->ip->inode_num, offset / PGSIZE)) {
+        file->ra_hits++;
+    } else {
+        uint32 min = (file->ra_mode == RA_SEQ) ? RA_MIN_BLOCKS : RA_STRIDE_MIN;
+        file->ra_wasted++;
+        file->ra_window = (file->ra_window / 2 > min) ? file->ra_window / 2 : min;
+    }
+    if (file->ra_hits + file->ra_wasted >= RA_SAMPLE) {
+        file->ra_hits /= 2;
+        file->ra_wasted /= 2;
+    }
+}
+
+/**
+ * @brief 辅助函数：根据访问历史决定预读模式和窗口
+ * @param file 文件指针（调用者持有file->ip的睡眠锁）
+ * @param offset 本次读取的起始偏移
+ * @param len 本次实际读取的字节数
+ * @note 紧接上一次的末尾: 顺序预读, 窗口从RA_MIN_BLOCKS开始翻倍;
+ *       连续两次相同的向前步长（大于读取长度）: 预读之后几条同样步长、同样长度的记录;
+ *       其他情况（随机访问）不预读; 最近的预读命中率低于80%时窗口不再增长
+ */
+static void file_readahead(file_t* file, uint32 offset, uint32 len)
+{
+    if (len == 0 || file->advice == FADV_RANDOM) {
+        return;
+    }
+
+    // 1. 由访问历史判断模式（FADV_SEQUENTIAL: 总是按顺序访问处理）
+    bool sequential = (offset == file->ra_next);
+    uint32 stride = (offset > file->ra_last) ? offset - file->ra_last : 0;
+    uint8 mode = RA_OFF;
+    if (sequential || file->advice == FADV_SEQUENTIAL) {
+        mode = RA_SEQ;
+    } else if (stride > len && stride == file->ra_stride) {
+        mode = RA_STRIDE;
+    }
+
+    // 2. 模式改变或顺序访问中断: 预读重新开始
+    if (mode != file->ra_mode || (mode == RA_SEQ && !sequential)) {
+        file->ra_window = 0;
+        file->ra_end = 0;
+    }
+    file->ra_mode = mode;
+    file->ra_next = offset + len;
+    file->ra_last = offset;
+    file->ra_stride = stride;
+    bool ramp = (file->ra_wasted * 4 <= file->ra_hits);
+
+    // 3. 顺序访问: 扩大窗口（FADV_SEQUENTIAL直接使用最大窗口）, 提交窗口内尚未提交过的块
+    if (mode == RA_SEQ) {
+        if (file->advice == FADV_SEQUENTIAL) {
+            file->ra_window = RA_MAX_BLOCKS;
+        } else if (file->ra_window == 0) {
+            file->ra_window = RA_MIN_BLOCKS;
+        } else if (ramp && file->ra_window < RA_MAX_BLOCKS) {
+            file->ra_window = (file->ra_window * 2 < RA_MAX_BLOCKS) ? file->ra_window * 2 : RA_MAX_BLOCKS;
+        }
+        uint32 next_bn = file->ra_next / BLOCK_SIZE;
+        uint32 start = next_bn > file->ra_end ? next_bn : file->ra_end;
+        uint32 end = next_bn + file->ra_window;
+        if (start < end) {
+            file_readahead_async(file->ip, start, end - start);
+            file->ra_end = end;
+        }
+        return;
+    }
+
+    // 4. 固定步长: 之后ra_window条记录中尚未提交过的部分（文件末尾之后的记录不预读）
+    if (mode == RA_STRIDE) {
+        if (file->ra_window == 0) {
+            file->ra_window = RA_STRIDE_MIN;
+        } else if (ramp && file->ra_window < RA_STRIDE_MAX) {
+            file->ra_window *= 2;
+        }
+        for (uint32 k = 1; k <= file->ra_window; k++) {
+            uint64 rec = offset + (uint64)k * stride;
+            if (rec >= file->ip->size) {
+                break;
+            }
+            uint32 start = rec / BLOCK_SIZE;
+            uint32 end = (rec + len - 1) / BLOCK_SIZE + 1;
+            if (start < file->ra_end) {
+                start = file->ra_end;
+            }
+            if (start < end) {
+                file_readahead_async(file->ip, start, end - start);
+                file->ra_end = end;
+            }
+        }
+    }
+}
+
+/**
+ * @brief 辅助函数：计算本次读写中可以走直接I/O的前缀长度
+ * @param file 文件指针（调用者持有file->ip的睡眠锁）
+ * @param offset 文件偏移
+ * @param len 请求的字节数
+ * @param addr 用户缓冲区地址
+ * @param user 是否为用户态缓冲区
+ * @param write true=写, false=读
+ * @return 可以直接传输的字节数（BLOCK_SIZE的整数倍, 0表示全部走buf cache）
+ * @note 要求: MODE_DIRECT打开、用户缓冲区512字节对齐、文件偏移块对齐;
+ *       读不能越过文件末尾, 也不处理内联/尾块打包的文件（没有自己的数据块）;
+ *       与其他文件共享块（reflink）的文件的修改可能还在页缓存中等待写时复制, 总是走页缓存
+ */
+static uint32 file_direct_len(file_t* file, uint32 offset, uint32 len, uint64 addr, bool user, bool write)
+{
+    if (!file->direct || !user || offset % BLOCK_SIZE != 0 || addr % 512 != 0 ||
+        (file->ip->flags & INODE_F_SHARED)) {
+        return 0;
+    }
+    if (!write) {
+        if ((file->ip->flags & INODE_F_PACKED) || offset >= file->ip->size) {
+            return 0;
+        }
+        if (len > file->ip->size - offset) {
+            len = file->ip->size - offset;
+        }
+    }
+    return len - len % BLOCK_SIZE;
+}
+
+/**
+ * @brief 辅助函数：从文件的offset处读取数据（普通文件/目录）
+ * @param file 文件指针（调用者共享持有file->ip的睡眠锁）
+ * @param offset 文件偏移
+ * @param len 要读取的字节数
+ * @param dst 目标缓冲区地址
+ * @param user true=用户态缓冲区，false=内核态缓冲区
+ * @return 实际读取的字节数
+ */
+static uint32 file_read_inode(file_t* file, uint32 offset, uint32 len, uint64 dst, bool user)
+{
+    uint32 ret_bytes = 0;
+
+    // 直接I/O: 对齐的整块部分直接从磁盘读进用户页, 剩下的尾部（或遇到无效页后的部分）走页缓存
+    uint32 direct = file_direct_len(file, offset, len, dst, user, false);
+    if (direct > 0) {
+        ret_bytes = inode_direct_rw(file->ip, offset, direct, dst, false);
+    }
+    // 预读命中统计在读取之前（读取会重新读入已被替换的页）
+    if (file->type == FD_FILE && !file->direct) {
+        file_ra_account(file, offset);
+    }
+    if (ret_bytes == direct) {
+        ret_bytes += inode_read_data(file->ip, offset + ret_bytes, len - ret_bytes, (void*)(dst + ret_bytes), user);
+    }
+    // 顺序访问时预读后续数据块（直接I/O不使用缓存, 预读没有意义）
+    if (file->type == FD_FILE && !file->direct) {
+        file_readahead(file, offset, ret_bytes);
+        // FADV_SEQUENTIAL: 已经完整读过的页不会再读, 移到LRU头部优先被替换
+        uint32 first = offset / PGSIZE, end = (offset + ret_bytes) / PGSIZE;
+        if (file->advice == FADV_SEQUENTIAL && end > first) {
+            pcache_deactivate(file->ip->inode_num, first, end - first, false);
+        }
+    }
+    return ret_bytes;
+}
+
+/**
+ * @brief 辅助函数：向文件的offset处写入数据（普通文件）
+ * @param file 文件指针（调用者独占持有file->ip的睡眠锁）
+ * @param offset 文件偏移
+ * @param len 要写入的字节数
+ * @param src 源缓冲区地址
+ * @param user true=用户态缓冲区，false=内核态缓冲区
+ * @return 实际写入的字节数
+ */
+static uint32 file_write_inode(file_t* file, uint32 offset, uint32 len, uint64 src, bool user)
+{
+    uint32 ret_bytes = 0;
+
+    // 直接I/O: 对齐的整块部分直接从用户页写到磁盘, 剩下的尾部走页缓存
+    uint32 direct = file_direct_len(file, offset, len, src, user, true);
+    if (direct > 0) {
+        ret_bytes = inode_direct_rw(file->ip, offset, direct, src, true);
+        // 直接I/O绕过了页缓存: 同步已缓存的页（读者和映射者看到新内容）
+        pcache_update(file->ip->inode_num, offset, src, ret_bytes, user);
+    }
+    if (ret_bytes == direct) {
+        ret_bytes += inode_write_data(file->ip, offset + ret_bytes, len - ret_bytes, (void*)(src + ret_bytes), user);
+    }
+    return ret_bytes;
+}
+
+// 辅助函数：读写的字节数计入当前进程的I/O统计（失败的-1不计）, 原样返回n
+static uint32 file_io_account(uint32 n, bool write)
+{
+    if (n != (uint32)-1) {
+        if (write) {
+            PROC_IO_ADD(wchar, n);
+        } else {
+            PROC_IO_ADD(rchar, n);
+        }
+    }
+    return n;
+}
+
 // ---------------------- 文件读写操作 ----------------------
 /**
  * @brief 从文件中读取数据
@@ -254,20 +562,33 @@ uint32 file_read(file_t* file, uint32 len, uint64 dst, bool user)
             ret_bytes = devlist[file->major].read(len, dst, user);
         }
     }
+    // 管道：从环形缓冲区读出
+    else if (file->type == FD_PIPE) {
+        ret_bytes = pipe_read(file->pipe, len, dst, user);
+    }
+    // 统计文件：生成文本后从当前偏移量读取
+    else if (file->type == FD_PROC) {
+        ret_bytes = procfs_read(file, len, dst, user);
+    }
+    // /tmp下的文件：从内存中的页复制
+    else if (file->type == FD_TMP) {
+        ret_bytes = tmpfs_rw(file, &file->offset, len, dst, user, false);
+    }
     // 3. 普通文件/目录：调用inode数据读取接口
     else if (file->type == FD_FILE || file->type == FD_DIR) {
         if (file->ip == NULL) return 0;
 
-        inode_lock(file->ip);
+        // 读者共享inode锁, 同一个文件的并发读不互相阻塞
+        inode_lock_shared(file->ip);
         // 从当前偏移量开始读取数据
-        ret_bytes = inode_read_data(file->ip, file->offset, len, (void*)dst, user);
+        ret_bytes = file_read_inode(file, file->offset, len, dst, user);
         // 更新文件偏移量（向后移动实际读取的字节数）
         file->offset += ret_bytes;
-        inode_unlock(file->ip);
+        inode_unlock_shared(file->ip);
     }
 
     // 4. 返回实际读取的字节数
-    return ret_bytes;
+    return file_io_account(ret_bytes, false);
 }
 
 /**
@@ -297,23 +618,580 @@ uint32 file_write(file_t* file, uint32 len, uint64 src, bool user)
             ret_bytes = devlist[file->major].write(len, src, user);
         }
     }
+    // 管道：写入环形缓冲区
+    else if (file->type == FD_PIPE) {
+        ret_bytes = pipe_write(file->pipe, len, src, user);
+    }
+    // /tmp下的文件：写入内存中的页（不经过日志）
+    else if (file->type == FD_TMP) {
+        ret_bytes = tmpfs_rw(file, &file->offset, len, src, user, true);
+    }
     // 3. 普通文件：调用inode数据写入接口（目录不支持写入）
     else if (file->type == FD_FILE) {
         if (file->ip == NULL) return 0;
 
+        journal_begin();
         inode_lock(file->ip);
         // 从当前偏移量开始写入数据
-        ret_bytes = inode_write_data(file->ip, file->offset, len, (void*)src, user);
+        ret_bytes = file_write_inode(file, file->offset, len, src, user);
         // 更新文件偏移量（向后移动实际写入的字节数）
         file->offset += ret_bytes;
         inode_unlock(file->ip);
+        journal_end();
     }
 
     // 4. 返回实际写入的字节数
-    return ret_bytes;
+    return file_io_account(ret_bytes, true);
 }
 
 // ---------------------- 文件偏移量调整 ----------------------
+/**
+ * @brief 从文件的指定偏移处读取数据, 不使用也不修改file->offset
+ * @param file 已打开的文件项指针（普通文件或目录）
+ * @param offset 文件偏移
+ * @param len 要读取的字节数
+ * @param dst 目标缓冲区地址（用户态/内核态）
+ * @param user true=用户态缓冲区，false=内核态缓冲区
+ * @return 实际读取的字节数，不可读或不支持定位（设备）时返回-1
+ * @note 共享同一个fd的多个读者可以并发地读不同位置, 不需要先lseek
+ */
+uint32 file_pread(file_t* file, uint32 offset, uint32 len, uint64 dst, bool user)
+{
+    assert(file != NULL, "file_pread: invalid NULL file pointer");
+    if (file->type == FD_TMP) {
+        return file_io_account(tmpfs_rw(file, &offset, len, dst, user, false), false);
+    }
+    if (!file->readable || (file->type != FD_FILE && file->type != FD_DIR) || file->ip == NULL) {
+        return -1;
+    }
+    if (len == 0) return 0;
+
+    inode_lock_shared(file->ip);
+    uint32 ret_bytes = file_read_inode(file, offset, len, dst, user);
+    inode_unlock_shared(file->ip);
+    return file_io_account(ret_bytes, false);
+}
+
+/**
+ * @brief 向文件的指定偏移处写入数据, 不使用也不修改file->offset
+ * @param file 已打开的文件项指针（普通文件）
+ * @param offset 文件偏移
+ * @param len 要写入的字节数
+ * @param src 源缓冲区地址（用户态/内核态）
+ * @param user true=用户态缓冲区，false=内核态缓冲区
+ * @return 实际写入的字节数，不可写或不是普通文件时返回-1
+ */
+uint32 file_pwrite(file_t* file, uint32 offset, uint32 len, uint64 src, bool user)
+{
+    assert(file != NULL, "file_pwrite: invalid NULL file pointer");
+    if (file->type == FD_TMP) {
+        return file_io_account(tmpfs_rw(file, &offset, len, src, user, true), true);
+    }
+    if (!file->writable || file->type != FD_FILE || file->ip == NULL) {
+        return -1;
+    }
+    if (len == 0) return 0;
+
+    journal_begin();
+    inode_lock(file->ip);
+    uint32 ret_bytes = file_write_inode(file, offset, len, src, user);
+    inode_unlock(file->ip);
+    journal_end();
+    return file_io_account(ret_bytes, true);
+}
+
+/**
+ * @brief 辅助函数：readv/writev的公共部分, 整个分散/聚集在一次inode加锁内完成
+ * @param file 已打开的文件项指针
+ * @param iov 用户空间的iovec_t数组地址
+ * @param iovcnt 数组长度（不超过N_IOV）
+ * @param write true=writev, false=readv
+ * @return 实际传输的总字节数，失败返回-1
+ * @note 某一段传输不完整（文件末尾、超出大小上限）时停止, 不再处理后面的段;
+ *       写入只在内存中更新size并标记dirty, 多段写只产生一次元数据写回
+ */
+static uint32 file_rw_iov(file_t* file, uint64 iov, uint32 iovcnt, bool write)
+{
+    iovec_t vec[N_IOV];
+    uint32 total = 0;
+
+    // 1. 权限和参数检查, 把iovec数组复制到内核
+    if ((write && !file->writable) || (!write && !file->readable) || iovcnt > N_IOV) {
+        return -1;
+    }
+    if (iovcnt == 0) {
+        return 0;
+    }
+    uvm_copyin(myproc()->mm->pgtbl, (uint64)vec, iov, iovcnt * sizeof(iovec_t));
+
+    // 2. 设备文件：逐段调用设备的读写接口
+    if (file->type == FD_DEVICE) {
+        if (file->major >= N_DEV) {
+            return -1;
+        }
+        dev_t* dev = &devlist[file->major];
+        for (uint32 i = 0; i < iovcnt; i++) {
+            uint32 n = 0;
+            if (write && dev->write != NULL) {
+                n = dev->write(vec[i].len, vec[i].base, true);
+            } else if (!write && dev->read != NULL) {
+                n = dev->read(vec[i].len, vec[i].base, true);
+            }
+            total += n;
+            if (n < vec[i].len) break;
+        }
+        return total;
+    }
+
+    // 2.5 管道：逐段读写环形缓冲区
+    if (file->type == FD_PIPE) {
+        for (uint32 i = 0; i < iovcnt; i++) {
+            uint32 n = write ? pipe_write(file->pipe, vec[i].len, vec[i].base, true)
+                             : pipe_read(file->pipe, vec[i].len, vec[i].base, true);
+            if (n == (uint32)-1) {
+                return total > 0 ? total : n;
+            }
+            total += n;
+            if (n < vec[i].len) break;
+        }
+        return total;
+    }
+
+    // 2.6 统计文件：每段重新生成文本, 从当前偏移量读取
+    if (file->type == FD_PROC) {
+        if (write) {
+            return -1;
+        }
+        for (uint32 i = 0; i < iovcnt; i++) {
+            uint32 n = procfs_read(file, vec[i].len, vec[i].base, true);
+            if (n == (uint32)-1) {
+                return total > 0 ? total : n;
+            }
+            total += n;
+            if (n < vec[i].len) break;
+        }
+        return total;
+    }
+
+    // 2.7 /tmp下的文件：逐段从file->offset开始读写
+    if (file->type == FD_TMP) {
+        for (uint32 i = 0; i < iovcnt; i++) {
+            uint32 n = tmpfs_rw(file, &file->offset, vec[i].len, vec[i].base, true, write);
+            if (n == (uint32)-1) {
+                return total > 0 ? total : n;
+            }
+            total += n;
+            if (n < vec[i].len) break;
+        }
+        return total;
+    }
+
+    // 3. 普通文件（readv还支持目录）：一次加锁, 各段依次从file->offset开始传输
+    if ((file->type != FD_FILE && (write || file->type != FD_DIR)) || file->ip == NULL) {
+        return -1;
+    }
+    if (write) {
+        journal_begin();
+        inode_lock(file->ip);
+    } else {
+        inode_lock_shared(file->ip);
+    }
+    for (uint32 i = 0; i < iovcnt; i++) {
+        uint32 n;
+        if (write) {
+            n = file_write_inode(file, file->offset, vec[i].len, vec[i].base, true);
+        } else {
+            n = file_read_inode(file, file->offset, vec[i].len, vec[i].base, true);
+        }
+        file->offset += n;
+        total += n;
+        if (n < vec[i].len) break;
+    }
+    if (write) {
+        inode_unlock(file->ip);
+        journal_end();
+    } else {
+        inode_unlock_shared(file->ip);
+    }
+    return total;
+}
+
+/**
+ * @brief 从文件当前偏移处依次读入多段用户缓冲区
+ * @param file 已打开的文件项指针
+ * @param iov 用户空间的iovec_t数组地址
+ * @param iovcnt 数组长度（不超过N_IOV）
+ * @return 实际读取的总字节数，失败返回-1
+ */
+uint32 file_readv(file_t* file, uint64 iov, uint32 iovcnt)
+{
+    assert(file != NULL, "file_readv: invalid NULL file pointer");
+    return file_io_account(file_rw_iov(file, iov, iovcnt, false), false);
+}
+
+/**
+ * @brief 把多段用户缓冲区依次写到文件当前偏移处
+ * @param file 已打开的文件项指针
+ * @param iov 用户空间的iovec_t数组地址
+ * @param iovcnt 数组长度（不超过N_IOV）
+ * @return 实际写入的总字节数，失败返回-1
+ */
+uint32 file_writev(file_t* file, uint64 iov, uint32 iovcnt)
+{
+    assert(file != NULL, "file_writev: invalid NULL file pointer");
+    return file_io_account(file_rw_iov(file, iov, iovcnt, true), true);
+}
+
+/**
+ * @brief 在内核中把in从当前偏移开始的len字节复制到out的当前偏移处, 数据不经过用户空间
+ * @param in 源文件（可读的普通文件）
+ * @param out 目标文件（可写的普通文件）
+ * @param len 要复制的字节数（超出源文件末尾的部分不复制）
+ * @return 实际复制的字节数（两个文件的偏移量都前进这么多），失败返回-1
+ * @note 源文件的页缓存页直接作为写入的源缓冲区, 每一段只有一次内存复制;
+ *       两个inode按inode_num顺序加锁（源共享、目标独占）, 同一文件内范围重叠时返回-1;
+ *       总是复制数据; 复制整个文件时file_clone只共享数据块, 不复制
+ */
+uint32 file_copy_range(file_t* in, file_t* out, uint32 len)
+{
+    assert(in != NULL && out != NULL, "file_copy_range: invalid NULL file pointer");
+    if (!in->readable || !out->writable || in->type != FD_FILE || out->type != FD_FILE ||
+        in->ip == NULL || out->ip == NULL || in->ip->type != FT_FILE || out->ip->type != FT_FILE) {
+        return -1;
+    }
+
+    // 1. 加锁: 同一文件只加一次独占锁, 否则按inode_num顺序避免两个方向的复制互相等待
+    inode_t* src = in->ip;
+    inode_t* dst = out->ip;
+    journal_begin();
+    if (src == dst) {
+        inode_lock(dst);
+    } else if (src->inode_num < dst->inode_num) {
+        inode_lock_shared(src);
+        inode_lock(dst);
+    } else {
+        inode_lock(dst);
+        inode_lock_shared(src);
+    }
+
+    // 2. 截断到源文件末尾, 检查同一文件内的重叠
+    uint32 off_in = in->offset, off_out = out->offset;
+    uint32 done = 0;
+    if (off_in >= src->size) {
+        len = 0;
+    } else if (len > src->size - off_in) {
+        len = src->size - off_in;
+    }
+    bool overlap = (src == dst && len > 0 && off_in < off_out + len && off_out < off_in + len);
+    if (overlap) {
+        len = 0;
+    }
+
+    // 3. 预读源文件, 然后逐页从页缓存写入目标文件
+    if (len > 0 && !in->direct) {
+        uint32 n_blocks = (off_in % BLOCK_SIZE + len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        inode_readahead(src, off_in / BLOCK_SIZE, n_blocks < RA_MAX_BLOCKS ? n_blocks : RA_MAX_BLOCKS);
+    }
+    while (done < len) {
+        uint32 in_page = (off_in + done) % PGSIZE;
+        uint32 n = PGSIZE - in_page;
+        if (n > len - done) n = len - done;
+
+        page_t* pg = pcache_get(src, (off_in + done) / PGSIZE, true);
+        if (pg == NULL) {
+            break;
+        }
+        uint32 w = inode_write_data(dst, off_out + done, n, (void*)(pg->page + in_page), false);
+        pcache_put(pg);
+        done += w;
+        if (w < n) {
+            break;
+        }
+    }
+
+    // 4. 解锁, 更新偏移量
+    if (src != dst) {
+        inode_unlock_shared(src);
+    }
+    inode_unlock(dst);
+    journal_end();
+    if (overlap) {
+        return -1;
+    }
+    in->offset += done;
+    out->offset += done;
+    return done;
+}
+
+// ---------------------- splice / vmsplice ----------------------
+/**
+ * @brief 静态辅助函数：普通文件 -> 管道, 页缓存页作为页引用排入管道 (不复制)
+ * @param in 源文件（可读的普通文件）
+ * @param pi 目标管道
+ * @param len 最多移动的字节数（超出文件末尾的部分不移动）
+ * @return 移动的字节数（源文件偏移前进这么多）, 一个字节都没移动时读端已关闭返回-1
+ * @note 每一页只在取页时持有inode锁, 排入管道（可能睡眠）时不持有
+ */
+static uint32 splice_from_file(file_t* in, pipe_t* pi, uint32 len)
+{
+    inode_t* ip = in->ip;
+    uint32 off = in->offset, done = 0;
+    bool broken = false;
+    while (done < len) {
+        inode_lock_shared(ip);
+        if (done == 0 && !in->direct && off < ip->size) {
+            uint32 n_blocks = (off % BLOCK_SIZE + len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            inode_readahead(ip, off / BLOCK_SIZE, n_blocks < RA_MAX_BLOCKS ? n_blocks : RA_MAX_BLOCKS);
+        }
+        pipe_buf_t buf = {0};
+        if (off + done < ip->size) {
+            buf.off = (off + done) % PGSIZE;
+            buf.len = PGSIZE - buf.off;
+            if (buf.len > len - done) buf.len = len - done;
+            if (buf.len > ip->size - (off + done)) buf.len = ip->size - (off + done);
+            buf.pg = pcache_get(ip, (off + done) / PGSIZE, true);
+        }
+        inode_unlock_shared(ip);
+        if (buf.pg == NULL) {
+            break;
+        }
+        buf.pa = buf.pg->page;
+        if (pipe_give(pi, &buf) < 0) {
+            pipe_buf_put(&buf);
+            broken = true;
+            break;
+        }
+        done += buf.len;
+    }
+    in->offset += done;
+    return (done == 0 && broken) ? (uint32)-1 : done;
+}
+
+/**
+ * @brief 静态辅助函数：管道 -> 普通文件, 从管道取出的页直接作为写入的源缓冲区 (只有写入页缓存的一次复制)
+ * @param pi 源管道
+ * @param out 目标文件（可写的普通文件）
+ * @param len 最多移动的字节数
+ * @return 写入的字节数（目标文件偏移前进这么多）
+ * @note 只在第一次取出时等待写者; 写入不完整时已经取出的剩余数据丢弃
+ */
+static uint32 splice_to_file(pipe_t* pi, file_t* out, uint32 len)
+{
+    inode_t* ip = out->ip;
+    uint32 done = 0;
+    while (done < len) {
+        pipe_buf_t buf;
+        uint32 n = pipe_take(pi, len - done, &buf, done == 0);
+        if (n == 0) {
+            break;
+        }
+        journal_begin();
+        inode_lock(ip);
+        uint32 w = inode_write_data(ip, out->offset, n, (void*)(buf.pa + buf.off), false);
+        out->offset += w;
+        inode_unlock(ip);
+        journal_end();
+        pipe_buf_put(&buf);
+        done += w;
+        if (w < n) {
+            break;
+        }
+    }
+    return done;
+}
+
+/**
+ * @brief 静态辅助函数：管道 -> 管道, 页引用从一个管道转交给另一个 (环形缓冲区中的字节复制一次)
+ * @param in 源管道
+ * @param out 目标管道（与in不同）
+ * @param len 最多移动的字节数
+ * @return 移动的字节数, 一个字节都没移动时目标的读端已关闭返回-1
+ * @note 目标的读端关闭时已经取出的那一段丢弃
+ */
+static uint32 splice_pipe(pipe_t* in, pipe_t* out, uint32 len)
+{
+    uint32 done = 0;
+    while (done < len) {
+        pipe_buf_t buf;
+        uint32 n = pipe_take(in, len - done, &buf, done == 0);
+        if (n == 0) {
+            break;
+        }
+        if (pipe_give(out, &buf) < 0) {
+            pipe_buf_put(&buf);
+            return done > 0 ? done : (uint32)-1;
+        }
+        done += n;
+    }
+    return done;
+}
+
+/**
+ * @brief 在管道和文件(或另一个管道)之间移动数据, 移动页引用而不是复制 (见fs/pipe.h)
+ * @param in 源（可读的普通文件或管道）
+ * @param out 目标（可写的普通文件或管道）, 至少一方是管道
+ * @param len 最多移动的字节数
+ * @return 移动的字节数（普通文件的偏移前进这么多）, 失败返回-1
+ * @note 文件 -> 管道: 页缓存页排入管道, 读者直接从页缓存复制; 管道 -> 管道: 转交页引用;
+ *       管道 -> 文件: 写入页缓存时复制一次 (页缓存页属于文件, 不能直接换成管道中的页)
+ */
+uint32 file_splice(file_t* in, file_t* out, uint32 len)
+{
+    assert(in != NULL && out != NULL, "file_splice: invalid NULL file pointer");
+    if (!in->readable || !out->writable) {
+        return -1;
+    }
+    bool in_file = (in->type == FD_FILE && in->ip != NULL && in->ip->type == FT_FILE);
+    bool out_file = (out->type == FD_FILE && out->ip != NULL && out->ip->type == FT_FILE);
+    if (in->type == FD_PIPE && out->type == FD_PIPE) {
+        return (in->pipe != out->pipe) ? splice_pipe(in->pipe, out->pipe, len) : (uint32)-1;
+    }
+    if (in_file && out->type == FD_PIPE) {
+        return splice_from_file(in, out->pipe, len);
+    }
+    if (in->type == FD_PIPE && out_file) {
+        return splice_to_file(in->pipe, out, len);
+    }
+    return -1;
+}
+
+/**
+ * @brief 静态辅助函数：用户地址va所在页中[off, off + len)的页引用 (vmsplice)
+ * @param p 当前进程
+ * @param va 用户地址
+ * @param buf 输出：页引用 (off / len由调用者填写)
+ * @return 成功返回0, 地址无效或内存不足返回-1
+ * @note 私有的普通用户页直接增加pmem引用; 页缓存页、大页和带共享/写时复制等标志的页
+ *       随映射有自己的生命周期, 复制这一段到新页
+ */
+static int vmsplice_page(proc_t* p, uint64 va, uint32 off, uint32 len, pipe_buf_t* buf)
+{
+    bool locked = mm_lock(p);
+    uint64 pa = uvm_user_pa(p->mm->pgtbl, va, false);
+    if (pa != 0) {
+        pa = PG_ROUND_DOWN(pa);
+        if (pmem_frame_flags(pa) == 0 && pcache_find(pa) == NULL) {
+            pmem_get(pa);
+        } else {
+            uint64 copy = (uint64)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_FILE));  // 只读取复制过的部分, 不需要清零
+            if (copy != 0) {
+                memmove((void*)(copy + off), (void*)(pa + off), len);
+            }
+            pa = copy;
+        }
+    }
+    mm_unlock(p, locked);
+    buf->pa = pa;
+    buf->pg = NULL;
+    return pa != 0 ? 0 : -1;
+}
+
+/**
+ * @brief 把多段用户缓冲区所在的页作为页引用排入管道, 不复制
+ * @param file 管道的写端
+ * @param iov 用户空间的iovec_t数组地址
+ * @param iovcnt 数组长度（不超过N_IOV）
+ * @return 排入的总字节数, 失败返回-1（已经排入一部分时返回这部分）
+ * @note 读者读出之前调用者不应修改这些页 (否则读到修改后的内容), 与Linux的vmsplice相同
+ */
+uint32 file_vmsplice(file_t* file, uint64 iov, uint32 iovcnt)
+{
+    assert(file != NULL, "file_vmsplice: invalid NULL file pointer");
+    iovec_t vec[N_IOV];
+    if (file->type != FD_PIPE || !file->writable || iovcnt > N_IOV) {
+        return -1;
+    }
+    if (iovcnt == 0) {
+        return 0;
+    }
+    proc_t* p = myproc();
+    uvm_copyin(p->mm->pgtbl, (uint64)vec, iov, iovcnt * sizeof(iovec_t));
+
+    // 每一页的一段排入一个页引用
+    uint32 total = 0;
+    for (uint32 i = 0; i < iovcnt; i++) {
+        uint64 va = vec[i].base;
+        uint32 left = vec[i].len;
+        while (left > 0) {
+            pipe_buf_t buf;
+            buf.off = va % PGSIZE;
+            buf.len = PGSIZE - buf.off;
+            if (buf.len > left) buf.len = left;
+            if (vmsplice_page(p, va, buf.off, buf.len, &buf) < 0) {
+                return total > 0 ? total : (uint32)-1;
+            }
+            if (pipe_give(file->pipe, &buf) < 0) {
+                pipe_buf_put(&buf);
+                return total > 0 ? total : (uint32)-1;
+            }
+            total += buf.len;
+            va += buf.len;
+            left -= buf.len;
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief reflink克隆: 在path处创建一个新文件, 与file共享全部数据块, 之后任何一方写入共享的块时先复制
+ * @param file 源文件（可读的普通文件, 不是extent映射）
+ * @param path 新文件的路径（不能已经存在）
+ * @return 成功返回0, 失败返回-1（新文件已经创建时删除）
+ * @note 只修改元数据, 代价与文件的块数成正比而不是字节数; 第一次克隆时创建数据块引用计数表;
+ *       每个日志操作克隆一段（见inode_clone）, 段之间释放两个inode的锁,
+ *       克隆期间对源文件的修改可能只有一部分出现在新文件中
+ */
+int file_clone(file_t* file, char* path)
+{
+    assert(file != NULL && path != NULL, "file_clone: invalid NULL pointer");
+    inode_t* src = file->ip;
+    if (file->type != FD_FILE || !file->readable || src == NULL || src->type != FT_FILE ||
+        (src->flags & INODE_F_EXTENT)) {
+        return -1;
+    }
+    if (refcnt_enable() < 0) {
+        return -1;
+    }
+
+    // 1. 创建新文件（与源文件的压缩选项相同）, 路径已经存在时失败
+    journal_begin();
+    inode_t* dst = path_to_inode(path);
+    if (dst != NULL) {
+        inode_free(dst);
+        journal_end();
+        return -1;
+    }
+    dst = path_create_inode(path, FT_FILE, 0, 0, src->flags & INODE_F_COMPRESS);
+    journal_end();
+    if (dst == NULL) {
+        return -1;
+    }
+
+    // 2. 逐段克隆, 两个inode按inode_num顺序加锁
+    inode_t* first = (src->inode_num < dst->inode_num) ? src : dst;
+    inode_t* second = (first == src) ? dst : src;
+    uint32 bn = 0;
+    int ret = 1;
+    while (ret == 1) {
+        journal_begin();
+        inode_lock(first);
+        inode_lock(second);
+        ret = inode_clone(dst, src, &bn);
+        inode_unlock(second);
+        inode_unlock(first);
+        journal_end();
+    }
+
+    // 3. 失败: 删除新文件（已共享的块只释放引用）
+    journal_begin();
+    inode_free(dst);
+    if (ret < 0) {
+        path_unlink(path);
+    }
+    journal_end();
+    return ret;
+}
+
 // 偏移量调整标志定义
 #define LSEEK_SET 0  // file->offset = offset（绝对偏移）
 #define LSEEK_ADD 1  // file->offset += offset（相对增加）
@@ -330,13 +1208,19 @@ uint32 file_lseek(file_t* file, uint32 offset, int flags)
 {
     assert(file != NULL, "file_lseek: invalid NULL file pointer");
 
-    // 1. 仅支持普通文件（FD_FILE）
-    if (file->type != FD_FILE) {
-        printf("file_lseek: only support FD_FILE type\n");
+    // 1. 目录: LSEEK_SET设置遍历cookie（0重新从头开始, 或恢复之前保存的cookie）
+    if ((file->type == FD_DIR || (file->type == FD_TMP && file->tmp->type == FT_DIR)) && flags == LSEEK_SET) {
+        file->dir_cookie = offset;
+        return offset;
+    }
+
+    // 2. 其余只支持普通文件（FD_FILE、FD_TMP）和统计文件（FD_PROC, 回到开头重新读取）
+    if (file->type != FD_FILE && file->type != FD_PROC && file->type != FD_TMP) {
+        printf("file_lseek: only support FD_FILE, FD_TMP and FD_PROC type\n");
         return (uint32)-1;
     }
 
-    // 2. 根据标志调整偏移量
+    // 3. 根据标志调整偏移量
     switch (flags) {
         case LSEEK_SET:
             // 绝对偏移：直接设置为指定值
@@ -360,7 +1244,7 @@ uint32 file_lseek(file_t* file, uint32 offset, int flags)
             return (uint32)-1;
     }
 
-    // 3. 返回调整后的偏移量
+    // 4. 返回调整后的偏移量
     return file->offset;
 }
 
@@ -374,21 +1258,176 @@ file_t* file_dup(file_t* file)
 {
     assert(file != NULL, "file_dup: invalid NULL file pointer");
 
-    // 1. 获取文件表自旋锁，保护引用计数修改
-    spinlock_acquire(&lk_ftable);
+    // 调用者持有引用 (计数不会同时归零): 原子地+1即可
+    uint32 old = __sync_fetch_and_add(&file->ref, 1);
+    assert(old > 0, "file_dup: file ref count is zero (invalid file)");
+    return file;
+}
 
-    // 2. 校验引用计数合法性
-    assert(file->ref > 0, "file_dup: file ref count is zero (invalid file)");
+// ---------------------- 文件大小与空间管理 ----------------------
+/**
+ * @brief 把普通文件截断（或扩展）到size字节
+ * @param file 已打开的文件项指针（需要写权限）
+ * @param size 新的文件大小
+ * @return 0表示成功，-1表示失败
+ */
+int file_truncate(file_t* file, uint32 size)
+{
+    assert(file != NULL, "file_truncate: invalid NULL file pointer");
 
-    // 3. 引用计数+1
-    file->ref++;
+    if (file->type == FD_TMP) {
+        return file->writable ? tmpfs_truncate(file->tmp, size) : -1;
+    }
 
-    // 4. 释放自旋锁，返回原文件项指针
-    spinlock_release(&lk_ftable);
-    return file;
+    if (file->type != FD_FILE || !file->writable || file->ip == NULL) {
+        return -1;
+    }
+    if (size > INODE_MAXSIZE) {
+        return -1;
+    }
+
+    journal_begin();
+    inode_lock(file->ip);
+    inode_truncate(file->ip, size);
+    inode_unlock(file->ip);
+    journal_end();
+    return 0;
+}
+
+/**
+ * @brief 为普通文件的[offset, offset + len)预先分配连续的磁盘空间
+ * @param file 已打开的文件项指针（需要写权限）
+ * @param offset 起始偏移量
+ * @param len 长度
+ * @return 0表示成功，-1表示失败
+ */
+int file_allocate(file_t* file, uint32 offset, uint32 len)
+{
+    assert(file != NULL, "file_allocate: invalid NULL file pointer");
+
+    if (file->type != FD_FILE || !file->writable || file->ip == NULL) {
+        return -1;
+    }
+
+    journal_begin();
+    inode_lock(file->ip);
+    int ret = inode_fallocate(file->ip, offset, len);
+    inode_unlock(file->ip);
+    journal_end();
+    return ret;
+}
+
+/**
+ * @brief 把文件的数据和元数据写到磁盘上（fsync / fdatasync）
+ * @param file 已打开的文件项指针（普通文件或目录）
+ * @return 0表示成功，-1表示失败
+ * @note 1. 页缓存中文件的dirty页直接写盘（落在空洞上的修改先分配数据块）
+ *       2. inode的size/addrs写进日志事务（读回数据也需要它们, fdatasync同样写回;
+ *          这个文件系统的inode没有时间戳, 所以fdatasync与fsync做的事情相同）
+ *       3. 组提交: 并发的调用者的修改在同一个事务中, 一次顺序的日志写入后全部落盘
+ */
+int file_fsync(file_t* file)
+{
+    assert(file != NULL, "file_fsync: invalid NULL file pointer");
+
+    // /tmp下的文件不需要落盘
+    if (file->type == FD_TMP) {
+        return 0;
+    }
+
+    if ((file->type != FD_FILE && file->type != FD_DIR) || file->ip == NULL) {
+        return -1;
+    }
+
+    journal_begin();
+    inode_lock(file->ip);
+    if (file->ip->type == FT_FILE) {
+        pcache_fsync(file->ip);
+    }
+    inode_flush(file->ip);
+    inode_unlock(file->ip);
+    journal_end();
+
+    journal_force();
+    return 0;
+}
+
+/**
+ * @brief 访问模式提示（fadvise）
+ * @param file 已打开的文件项指针（普通文件）
+ * @param offset 范围起始偏移（WILLNEED / DONTNEED使用）
+ * @param len 范围长度, 0表示到文件末尾
+ * @param advice FADV_*
+ * @return 0表示成功，-1表示失败
+ * @note 1. NORMAL / RANDOM / SEQUENTIAL 修改file->advice, 影响之后的预读窗口和读过的页在LRU中的位置
+ *       2. WILLNEED 把范围内的页读入页缓存（最多RA_WILLNEED_MAX块）
+ *       3. DONTNEED 先写回范围内的dirty页, 再丢弃没有被使用的干净页
+ */
+int file_advise(file_t* file, uint32 offset, uint32 len, int advice)
+{
+    assert(file != NULL, "file_advise: invalid NULL file pointer");
+
+    if (file->type != FD_FILE || file->ip == NULL || advice < FADV_NORMAL || advice > FADV_DONTNEED) {
+        return -1;
+    }
+
+    // 1. 记录在文件项上的提示（预读状态重新开始）
+    if (advice <= FADV_SEQUENTIAL) {
+        inode_lock(file->ip);
+        file->advice = advice;
+        file->ra_mode = RA_OFF;
+        file->ra_window = 0;
+        file->ra_end = 0;
+        inode_unlock(file->ip);
+        return 0;
+    }
+
+    // 2. 范围截断到文件末尾（DONTNEED写回时可能为空洞分配数据块, 是一个日志操作）
+    if (advice == FADV_WILLNEED) {
+        inode_lock_shared(file->ip);
+    } else {
+        journal_begin();
+        inode_lock(file->ip);
+    }
+    uint32 size = file->ip->size;
+    if (offset < size && (len == 0 || len > size - offset)) {
+        len = size - offset;
+    }
+    if (offset < size && len > 0) {
+        uint32 pgoff = offset / PGSIZE;
+        uint32 npages = (offset + len - 1) / PGSIZE + 1 - pgoff;
+        if (advice == FADV_WILLNEED) {
+            // 3. 在后台读入范围内的页（内联文件没有数据块, inode_readahead直接返回）
+            uint32 bn = offset / BLOCK_SIZE;
+            uint32 count = (offset + len - 1) / BLOCK_SIZE + 1 - bn;
+            file_readahead_async(file->ip, bn, count < RA_WILLNEED_MAX ? count : RA_WILLNEED_MAX);
+        } else {
+            // 4. 写回后丢弃（部分覆盖的首尾页同样丢弃, 之后再读会重新读入）
+            pcache_writeback(file->ip, pgoff, npages);
+            pcache_deactivate(file->ip->inode_num, pgoff, npages, true);
+        }
+    }
+    if (advice == FADV_WILLNEED) {
+        inode_unlock_shared(file->ip);
+    } else {
+        inode_unlock(file->ip);
+        journal_end();
+    }
+    return 0;
 }
 
 // ---------------------- 文件状态查询 ----------------------
+// 辅助函数：上锁读取inode元数据, 填充文件状态
+static void file_fill_state(inode_t* ip, file_state_t* state)
+{
+    inode_lock(ip);
+    state->type = ip->type;
+    state->inode_num = ip->inode_num;
+    state->nlink = ip->nlink;
+    state->size = ip->size;
+    inode_unlock(ip);
+}
+
 /**
  * @brief 获取文件状态信息（普通文件/目录）
  * @param file 已打开的文件项指针
@@ -407,21 +1446,209 @@ int file_stat(file_t* file, uint64 addr)
         if (file->ip == NULL) return -1;
 
         // 2. 上锁读取inode元数据，填充文件状态
-        inode_lock(file->ip);
-        state.type = file->ip->type;
-        state.inode_num = file->ip->inode_num;
-        state.nlink = file->ip->nlink;
-        state.size = file->ip->size;
-        inode_unlock(file->ip);
+        file_fill_state(file->ip, &state);
 
         // 3. 将状态信息拷贝到用户态缓冲区
-        uvm_copyout(myproc()->pgtbl, addr, (uint64)&state, sizeof(file_state_t));
+        uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&state, sizeof(file_state_t));
 
         // 4. 返回成功
         return 0;
     }
 
+    // /tmp下的文件或目录：节点的状态（没有inode, inode_num是节点编号）
+    if (file->type == FD_TMP) {
+        tmpfs_fill_state(file->tmp, &state);
+        uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&state, sizeof(file_state_t));
+        return 0;
+    }
+
+    // 统计文件：普通文件, 没有inode, 大小未知 (读到返回0为止)
+    if (file->type == FD_PROC) {
+        state.type = FT_FILE;
+        state.inode_num = 0;
+        state.nlink = 1;
+        state.size = 0;
+        uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&state, sizeof(file_state_t));
+        return 0;
+    }
+
     // 5. 不支持的文件类型，返回失败
     printf("file_stat: unsupported file type %d\n", file->type);
     return -1;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 按路径获取文件状态信息（不需要先打开文件）
+ * @param dp 相对路径的起始目录（NULL则为当前工作目录）
+ * @param path 文件路径
+ * @param addr 用户态缓冲区地址（用于存储文件状态）
+ * @return 0表示成功，-1表示失败
+ */
+int file_stat_at(inode_t* dp, char* path, uint64 addr)
+{
+    assert(path != NULL, "file_stat_at: invalid NULL path");
+    assert(addr != 0, "file_stat_at: invalid zero address");
+
+    file_state_t state;
+
+    // 0. /tmp下的文件在内存文件系统中
+    char* tpath = tmpfs_path(path);
+    if (tpath != NULL) {
+        if (tmpfs_stat(tpath, &state) < 0) {
+            return -1;
+        }
+        uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&state, sizeof(file_state_t));
+        return 0;
+    }
+
+    // 1. 查找路径对应的inode
+    inode_t* ip = path_to_inode_at(dp, path);
+    if (ip == NULL) {
+        return -1;
+    }
+
+    // 2. 填充文件状态并释放引用
+    file_fill_state(ip, &state);
+    inode_free(ip);
+
+    // 3. 将状态信息拷贝到用户态缓冲区
+    uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&state, sizeof(file_state_t));
+    return 0;
+}
+
+/**
+ * @brief 一次获取同一目录下多个文件的状态信息
+ * @param dp 目录（NULL则为当前工作目录）
+ * @param names 用户态dirent_t数组地址（只使用name, 可以直接传入getdents的结果）
+ * @param n 文件数（不超过FSTAT_BATCH_MAX）
+ * @param addr 用户态file_state_t数组地址（n项, 不存在的文件type为FT_UNUSED）
+ * @return 存在的文件数，失败返回-1
+ * @note 目录只上锁一次, 在其中查出所有名称对应的inode_num (经过目录项缓存);
+ *       解锁目录之后再逐个读取inode ("."和".."也不会和目录的锁冲突)
+ */
+int file_stat_batch(inode_t* dp, uint64 names, int n, uint64 addr)
+{
+    assert(names != 0, "file_stat_batch: invalid zero names address");
+    assert(addr != 0, "file_stat_batch: invalid zero address");
+
+    if (n < 0 || n > FSTAT_BATCH_MAX) {
+        return -1;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    // 1. 内核页: 前半页是目录项, 后半页是文件状态
+    char* page = (char*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+    if (page == NULL) {
+        return -1;
+    }
+    dirent_t* de = (dirent_t*)page;
+    file_state_t* states = (file_state_t*)(page + PGSIZE / 2);
+    uvm_copyin(myproc()->mm->pgtbl, (uint64)de, names, n * sizeof(dirent_t));
+
+    // 2. 起始目录的引用
+    inode_t* ip;
+    if (dp != NULL) {
+        ip = inode_dup(dp);
+    } else if (myproc()->cwd != NULL) {
+        ip = inode_dup(myproc()->cwd);
+    } else {
+        ip = inode_alloc(INODE_ROOT);
+    }
+
+    // 3. 持有目录的锁完成所有查找
+    inode_lock(ip);
+    if (ip->type != FT_DIR) {
+        inode_unlock_free(ip);
+        pmem_free((uint64)page, true);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        // 名称不一定以0结尾; 空名称和含'/'的名称按不存在处理
+        char name[DIR_NAME_LEN + 1];
+        bool valid = (de[i].name[0] != 0);
+        int len = 0;
+        while (len < DIR_NAME_LEN && de[i].name[len] != 0) {
+            name[len] = de[i].name[len];
+            if (name[len] == '/') {
+                valid = false;
+            }
+            len++;
+        }
+        name[len] = 0;
+        states[i].inode_num = valid ? dir_search_entry(ip, name) : INODE_NUM_UNUSED;
+    }
+    inode_unlock_free(ip);
+    for (int i = 0; i < n; i++) {
+        inode_prefetch(states[i].inode_num);
+    }
+
+    // 4. 逐个读取inode元数据
+    int found = 0;
+    for (int i = 0; i < n; i++) {
+        inode_t* fp = NULL;
+        if (states[i].inode_num != INODE_NUM_UNUSED) {
+            fp = inode_alloc(states[i].inode_num);
+        }
+        if (fp == NULL) {
+            memset(&states[i], 0, sizeof(file_state_t));
+            states[i].type = FT_UNUSED;
+            states[i].inode_num = INODE_NUM_UNUSED;
+            continue;
+        }
+        file_fill_state(fp, &states[i]);
+        inode_free(fp);
+        found++;
+    }
+
+    // 5. 整块拷贝给用户
+    uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)states, n * sizeof(file_state_t));
+    pmem_free((uint64)page, true);
+    return found;
+}
+
+// ---------------------- 目录遍历 ----------------------
+/**
+ * @brief 从file->dir_cookie处继续读取目录项, 直到用户缓冲区放满或目录结束
+ * @param file 已打开的目录文件项指针
+ * @param addr 用户态缓冲区地址（dirent_t数组）
+ * @param len 用户缓冲区字节数
+ * @return 读取的字节数（sizeof(dirent_t)的整数倍, 0表示已到目录末尾），失败返回-1
+ * @note 目录项先收集到一个内核页中, 每满一页用一次uvm_copyout整块拷贝给用户
+ */
+int file_getdents(file_t* file, uint64 addr, uint32 len)
+{
+    assert(file != NULL, "file_getdents: invalid NULL file pointer");
+
+    if (file->type == FD_TMP) {
+        return tmpfs_getdents(file, addr, len);
+    }
+
+    if (file->type != FD_DIR || file->ip == NULL) {
+        return -1;
+    }
+
+    // 1. 申请内核页作为中转缓冲区
+    dirent_t* page = (dirent_t*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+    if (page == NULL) {
+        return -1;
+    }
+
+    // 2. 一页一页地读取并拷贝
+    uint32 total = 0;
+    inode_lock(file->ip);
+    while (total + sizeof(dirent_t) <= len) {
+        uint32 want = (len - total < PGSIZE) ? len - total : PGSIZE;
+        uint32 got = dir_read_entries(file->ip, &file->dir_cookie, want, page);
+        if (got == 0) {
+            break;
+        }
+        uvm_copyout(myproc()->mm->pgtbl, addr + total, (uint64)page, got);
+        total += got;
+    }
+    inode_unlock(file->ip);
+
+    pmem_free((uint64)page, true);
+    return total;
+}
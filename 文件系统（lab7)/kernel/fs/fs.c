@@ -1,13 +1,24 @@
 #include "fs/fs.h"
+#include "dev/blk.h"
+#include "dev/ramdisk.h"
 #include "fs/buf.h"
 #include "fs/bitmap.h"
 #include "fs/inode.h"
 #include "fs/dir.h"
+#include "fs/dcache.h"
+#include "fs/pcache.h"
+#include "fs/journal.h"
+#include "fs/tail.h"
+#include "fs/refcnt.h"
+#include "fs/tmpfs.h"
+#include "mem/swap.h"
 #include "lib/str.h"
 #include "lib/print.h"
+#include "lib/bootopt.h"
 
 // 超级块全局变量（你的原有代码）
 super_block_t sb;
+static bool mounted = false;    // fs_init完成之前为false (第一个进程第一次运行时挂载)
 #define FS_MAGIC 0x12345678
 #define SB_BLOCK_NUM 0
 
@@ -38,24 +49,84 @@ static void sb_print()
     printf("inode start = %d\n", sb.inode_start);
     printf("data bitmap start = %d\n", sb.data_bitmap_start);
     printf("data start = %d\n", sb.data_start);
+    if (sb.journal_magic == JOURNAL_MAGIC) {
+        printf("journal start = %d\n", sb.journal_start);
+        printf("journal blocks = %d\n", sb.journal_blocks);
+    }
+    printf("state = %s\n", sb.state == FS_STATE_CLEAN ? "clean" : "dirty");
 }
 
-void fs_init()
+// 查询文件系统容量: 总量来自超级块, 空闲数来自位图缓存的计数
+void fs_statfs(fs_stat_t* st)
+{
+    st->block_size = sb.block_size;
+    st->total_blocks = sb.total_blocks;
+    st->data_blocks = sb.data_blocks;
+    st->inodes = sb.inode_blocks * INODE_PER_BLOCK;
+    bitmap_free_count(&st->free_blocks, &st->free_inodes);
+}
+
+// 写回整个文件系统: 页缓存中的dirty页直接写盘（延迟分配的页先分配数据块）, dirty inode写进日志事务并提交, 最后组提交落盘
+void fs_sync()
+{
+    pcache_sync();
+    journal_begin();
+    inode_sync();
+    bitmap_pool_drain();
+    journal_end();
+    journal_force();
+    buf_commit();
+}
+
+// 超级块写回磁盘（经过buf cache, 由调用者决定何时落盘）
+void fs_write_super()
 {
-    // ========== 前置：文件系统基础初始化（你的原有代码，保留） ==========
-    buf_init();
     buf_t* buf = buf_read(SB_BLOCK_NUM);
-    memmove(&sb, buf->data, sizeof(sb));
-    assert(sb.magic == FS_MAGIC, "fs_init: magic error");
-    assert(sb.block_size == BLOCK_SIZE, "fs_init: block size mismatch");
+    memmove(buf->data, &sb, sizeof(sb));
+    buf_write(buf);
     buf_release(buf);
-    sb_print();
+}
+
+// 超级块写回并立即落盘（只写超级块这一个block, 调用者可以持有其他buf的睡眠锁）
+void fs_commit_super()
+{
+    uint32 block_num = SB_BLOCK_NUM;
+    fs_write_super();
+    buf_checkpoint(&block_num, 1);
+}
+
+// 根文件系统是否已经挂载
+bool fs_mounted()
+{
+    return mounted;
+}
 
-    // ========== 测试1：文件读写测试（先执行，完整释放资源） ==========
+// 超级块标记为DIRTY并立即落盘
+// 挂载后马上调用: 之后崩溃的话下次挂载不会相信超级块中的空闲计数
+void fs_mark_dirty()
+{
+    sb.state = FS_STATE_DIRTY;
+    fs_commit_super();
+}
+
+// 干净卸载: 写回所有数据和元数据, 空闲计数记录进超级块并标记CLEAN, 下次挂载不扫描位图
+// 之后再修改位图会先调用fs_mark_dirty
+void fs_unmount()
+{
+    fs_sync();
+    bitmap_save_summary();
+    sb.state = FS_STATE_CLEAN;
+    fs_commit_super();
+}
+
+// 文件读写和路径/目录的自测 (启动参数fs_selftest)
+// 在已挂载的文件系统上运行: 每一步修改都包在日志操作中, 测试文件最后全部删除, 不在磁盘上留下残留
+static void fs_selftest()
+{
+    // ========== 测试1：文件读写测试（匿名inode, 结束时销毁） ==========
     printf("\n=====================================");
     printf("\n开始：文件读写测试");
     printf("\n=====================================");
-    inode_init(); // 初始化inode模块（测试1专用）
     uint32 ret = 0;
 
     // 步骤1：初始化测试数组str
@@ -64,8 +135,9 @@ void fs_init()
     }
 
     // 步骤2：创建文件inode并加锁
+    journal_begin();
     inode_t* nip = inode_create(FT_FILE, 0, 0);
-    assert(nip != NULL, "fs_init: create inode fail");
+    assert(nip != NULL, "fs_selftest: create inode fail");
     inode_lock(nip);
 
     // 步骤3：第一次查看inode初始状态
@@ -73,22 +145,24 @@ void fs_init()
 
     // 步骤4：第一次写入（偏移0，长度BLOCK_SIZE/2）
     ret = inode_write_data(nip, 0, BLOCK_SIZE / 2, str, false);
-    assert(ret == BLOCK_SIZE / 2, "fs_init: first write fail");
+    assert(ret == BLOCK_SIZE / 2, "fs_selftest: first write fail");
 
-    // 步骤5：第二次写入（关键修正：计算剩余写入长度，避免断言失败）
+    // 步骤5：第二次写入剩余部分
     uint32 second_write_len = (2 * BLOCK_SIZE) - (BLOCK_SIZE / 2);
     ret = inode_write_data(nip, BLOCK_SIZE / 2, second_write_len, str + BLOCK_SIZE / 2, false);
-    assert(ret == second_write_len, "fs_init: second write fail");
+    assert(ret == second_write_len, "fs_selftest: second write fail");
 
     // 步骤6：一次性读取完整数据到tmp
     ret = inode_read_data(nip, 0, 2 * BLOCK_SIZE, tmp, false);
-    assert(ret == 2 * BLOCK_SIZE, "fs_init: read data fail");
+    assert(ret == 2 * BLOCK_SIZE, "fs_selftest: read data fail");
 
     // 步骤7：第二次查看inode写入后状态
     inode_print(nip);
 
-    // 步骤8：释放inode资源（解锁+释放，无残留）
+    // 步骤8：没有目录项指向它, 链接数清零后由最后一次释放回收inode和数据块
+    nip->nlink = 0;
     inode_unlock_free(nip);
+    journal_end();
 
     // 步骤9：验证读写结果并打印
     if (blockcmp(tmp, str) == true) {
@@ -97,78 +171,144 @@ void fs_init()
         printf("\n[文件读写测试] 失败！\n");
     }
 
-    // ========== 测试2：路径/目录/文件测试（无残留，顺序执行） ==========
+    // ========== 测试2：路径/目录/文件测试（在/fs_selftest下进行, 结束时删除） ==========
     printf("\n=====================================");
     printf("\n开始：路径/目录/文件测试");
     printf("\n=====================================");
-    // 重新初始化inode模块（清理测试1的残留状态，可选，根据你的实现调整）
-    inode_init();
 
-    // 步骤1：创建所需inode（根目录+2个子目录+1个文件）
-    inode_t* ip_root = inode_alloc(INODE_ROOT); // 根目录inode
-    inode_t* ip_user = inode_create(FT_DIR, 0, 0); // user目录inode
-    inode_t* ip_work = inode_create(FT_DIR, 0, 0); // work目录inode
-    inode_t* ip_hello = inode_create(FT_FILE, 0, 0); // hello.txt文件inode
-    // 校验inode创建结果
-    assert(ip_root != NULL, "fs_init: alloc root inode fail");
-    assert(ip_user != NULL, "fs_init: create user dir fail");
-    assert(ip_work != NULL, "fs_init: create work dir fail");
-    assert(ip_hello != NULL, "fs_init: create hello.txt fail");
-
-    // 步骤2：所有inode加锁（保证操作安全）
-    inode_lock(ip_root);
-    inode_lock(ip_user);
-    inode_lock(ip_work);
-    inode_lock(ip_hello);
-
-    // 步骤3：创建多级目录项（/ → user → work → hello.txt）
-    dir_add_entry(ip_root, ip_user->inode_num, "user");
-    dir_add_entry(ip_user, ip_work->inode_num, "work");
-    dir_add_entry(ip_work, ip_hello->inode_num, "hello.txt");
+    // 步骤1：创建多级目录和文件（/fs_selftest → work → hello.txt）, 上次测试中断留下的同名项直接重用
+    // 与系统调用一样, 每个创建和删除各自是一个日志操作
+    char* test_path = "/fs_selftest/work/hello.txt";
+    journal_begin();
+    inode_t* ip_top = path_create_inode("/fs_selftest", FT_DIR, 0, 0, 0);
+    journal_end();
+    assert(ip_top != NULL, "fs_selftest: create /fs_selftest fail");
+    journal_begin();
+    inode_t* ip_work = path_create_inode("/fs_selftest/work", FT_DIR, 0, 0, 0);
+    journal_end();
+    assert(ip_work != NULL, "fs_selftest: create work dir fail");
+    journal_begin();
+    inode_t* ip_hello = path_create_inode(test_path, FT_FILE, 0, 0, 0);
+    journal_end();
+    assert(ip_hello != NULL, "fs_selftest: create hello.txt fail");
 
-    // 步骤4：向hello.txt写入数据（"hello world"）
+    // 步骤2：向hello.txt写入数据（"hello world"）
+    journal_begin();
+    inode_lock(ip_hello);
     ret = inode_write_data(ip_hello, 0, 11, "hello world", false);
-    assert(ret == 11, "fs_init: write hello.txt fail");
+    assert(ret == 11, "fs_selftest: write hello.txt fail");
+    inode_unlock_free(ip_hello);
+    inode_free(ip_work);
+    inode_free(ip_top);
+    journal_end();
 
-    // 步骤5：解锁inode（仅解锁，不释放，后续路径查找还需使用）
-    inode_unlock(ip_hello);
-    inode_unlock(ip_work);
-    inode_unlock(ip_user);
-    inode_unlock(ip_root);
-
-    // 步骤6：路径查找（测试path_to_pinode和path_to_inode）
-    char* test_path = "/user/work/hello.txt";
+    // 步骤3：路径查找（测试path_to_pinode和path_to_inode）
     char file_name[DIR_NAME_LEN] = {0}; // 存储最后一个文件名
     inode_t* tmp_pinode = path_to_pinode(test_path, file_name);
     inode_t* tmp_inode = path_to_inode(test_path);
-
-    // 步骤7：校验路径查找结果
-    assert(tmp_pinode != NULL, "fs_init: path_to_pinode return NULL");
-    assert(tmp_inode != NULL, "fs_init: path_to_inode return NULL");
+    assert(tmp_pinode != NULL, "fs_selftest: path_to_pinode return NULL");
+    assert(tmp_inode != NULL, "fs_selftest: path_to_inode return NULL");
     printf("\n[路径测试] 找到文件名：%s\n", file_name);
 
-    // 步骤8：打印tmp_pinode信息并释放
+    // 步骤4：打印tmp_pinode信息并释放
     inode_lock(tmp_pinode);
     printf("\n[tmp_pinode 信息]");
     inode_print(tmp_pinode);
     inode_unlock_free(tmp_pinode);
 
-    // 步骤9：打印tmp_inode信息，读取文件内容并释放
+    // 步骤5：打印tmp_inode信息，读取文件内容并释放
     inode_lock(tmp_inode);
     printf("\n[tmp_inode 信息]");
     inode_print(tmp_inode);
-    // 读取hello.txt内容
     char read_buf[12] = {0};
-    ret = inode_read_data(tmp_inode, 0, tmp_inode->size, read_buf, false);
-    assert(ret == 11, "fs_init: read hello.txt fail");
+    ret = inode_read_data(tmp_inode, 0, 11, read_buf, false);
+    assert(ret == 11, "fs_selftest: read hello.txt fail");
     printf("\n[文件读取测试] hello.txt 内容：%s\n", read_buf);
     inode_unlock_free(tmp_inode);
 
+    // 步骤6：由内向外删除测试文件和目录
+    char* unlink_paths[] = { test_path, "/fs_selftest/work", "/fs_selftest" };
+    for (int i = 0; i < 3; i++) {
+        journal_begin();
+        ret = path_unlink(unlink_paths[i]);
+        journal_end();
+        assert(ret == 0, "fs_selftest: unlink fail");
+    }
+
     // ========== 测试结束：打印最终结果 ==========
     printf("\n=====================================");
     printf("\n所有测试执行完毕！\n");
     printf("=====================================\n");
+}
+
+// 超级块记录的布局: 各区域依次相接, 位图块数足够管理对应的bit且不超过BITMAP_GROUP_MAX
+static bool sb_geometry_valid()
+{
+    uint32 ibitmap = sb.inode_start - sb.inode_bitmap_start;
+    uint32 dbitmap = sb.data_start - sb.data_bitmap_start;
+    uint64 inodes = (uint64)sb.inode_blocks * INODE_PER_BLOCK;
+    return sb.inode_bitmap_start == SB_BLOCK_NUM + 1 &&
+           sb.inode_start > sb.inode_bitmap_start &&
+           sb.data_bitmap_start == sb.inode_start + sb.inode_blocks &&
+           sb.data_start > sb.data_bitmap_start &&
+           sb.total_blocks == sb.data_start + sb.data_blocks &&
+           sb.inode_blocks > 0 && inodes <= 65536 && sb.data_blocks > 0 &&
+           (uint64)ibitmap * BITMAP_BITS_PER_BLOCK >= inodes && ibitmap <= BITMAP_GROUP_MAX &&
+           (uint64)dbitmap * BITMAP_BITS_PER_BLOCK >= sb.data_blocks && dbitmap <= BITMAP_GROUP_MAX;
+}
 
-    // 调试用：暂停查看结果（可注释，后续删除）
-    while (1);
-}
\ No newline at end of file
+void fs_init()
+{
+    // ========== 前置：文件系统基础初始化（你的原有代码，保留） ==========
+    blk_init();
+    buf_init();
+    buf_t* buf = buf_read(SB_BLOCK_NUM);
+    memmove(&sb, buf->data, sizeof(sb));
+    assert(sb.magic == FS_MAGIC, "fs_init: magic error");
+    if (sb.block_size != BLOCK_SIZE) {
+        printf("fs_init: image has %d-byte blocks, kernel built with BLOCK_SIZE=%d (mkfs -b / make BLOCK_SIZE=)\n",
+               sb.block_size, BLOCK_SIZE);
+        panic("fs_init: block size mismatch");
+    }
+    assert(sb_geometry_valid(), "fs_init: bad geometry");
+    buf_release(buf);
+    if (bootopt("verbose")) {
+        sb_print();
+    }
+
+    // 内存中的根文件系统: 把映像复制到内存块设备, 之后的修改不写回磁盘 (交换区仍在磁盘上)
+    // 已缓存的超级块与复制的内容相同, 不必丢弃
+    if (bootopt("ramdisk")) {
+        ramdisk_init(sb.total_blocks);
+        ramdisk_load();
+        blk_use_ramdisk();
+        printf("fs_init: running on ramdisk (%d blocks, %d pages loaded)\n", sb.total_blocks, ramdisk_pages());
+    }
+
+    // 重放日志中已提交的事务（位图、inode表可能在其中, 必须在读入它们之前）
+    journal_recover();
+
+    // 超级块已常驻在sb中; 常驻位图块, 分配/释放不再与用户数据争抢buf
+    bitmap_init();
+    journal_init();
+    fs_mark_dirty();
+
+    // 文件系统之后的交换区
+    swap_init();
+
+    // inode、尾块分配、目录项缓存、页缓存和目录模块
+    inode_init();
+    tail_init();
+    refcnt_init();
+    dcache_init();
+    pcache_init();
+    dir_init();
+
+    // 挂载在/tmp的内存文件系统
+    tmpfs_init();
+    mounted = true;
+
+    if (bootopt("fs_selftest")) {
+        fs_selftest();
+    }
+}
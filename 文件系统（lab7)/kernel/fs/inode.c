@@ -1,19 +1,213 @@
+#include "dev/blk.h"
 #include "fs/buf.h"
+#include "fs/journal.h"
 #include "fs/bitmap.h"
+#include "fs/extent.h"
 #include "fs/inode.h"
 #include "fs/fs.h"
+#include "fs/pcache.h"
+#include "fs/tail.h"
+#include "fs/compress.h"
+#include "fs/refcnt.h"
 #include "mem/vmem.h"
+#include "mem/pmem.h"
+#include "mem/slab.h"
 #include "proc/cpu.h"
+#include "riscv.h"
 #include "lib/print.h"
 #include "lib/str.h"
+#include "lib/tstat.h"
 
 // 全局超级块（外部定义，来自文件系统初始化模块）
 extern super_block_t sb;
 
-// 内存中的inode缓存（icache）配置：最大32个inode同时缓存
-#define N_INODE 32
-static inode_t icache[N_INODE];    // 内存inode缓存数组
-static spinlock_t lk_icache;       // 保护icache的自旋锁（引用计数、inode查找/分配）
+/*
+    内存中的inode缓存（icache）
+    1. 以inode_num为键的哈希表: 查找不必遍历整个icache
+    2. ref == 0 的inode不会立即失效, 按释放顺序挂在空闲LRU链表上(头部最旧)
+       再次打开时直接命中, 元数据仍然valid, 不必重新读inode表块
+    3. inode从slab cache申请: 不足N_INODE个或内核区可用页充足时申请新的inode,
+       否则从空闲LRU链表头部取出最久未使用的inode并移出哈希表
+    4. 超过N_INODE个时, 内核区可用页低于低水位后引用归零的inode直接还给slab,
+       pmem回收内核区域时icache_reclaim把空闲LRU链表头部超出N_INODE的inode还给slab
+    5. 从磁盘读入一个inode时, 同一inode表块中其他已使用、还不在icache中的inode一起装入
+       (ref == 0, 挂在空闲LRU链表头部, 最先被替换), 之后stat同一目录下的文件不必再读这个块
+    以上所有字段由lk_icache保护 (读写自旋锁): 修改哈希表、LRU链表时持有写锁;
+    查找已被引用的inode只需要读锁, 在读锁下原子地增加ref (ref > 0时inode不在LRU链表上, 不会被替换或释放)
+    ref始终原子地修改: 复制引用 (inode_dup) 和不是最后一个的释放 (ref > 1时CAS减1) 不需要锁,
+    ref从1减到0 (挂上LRU链表或销毁) 只在写锁下进行, 此时读锁下的查找不会同时把它从0加回来
+*/
+#define N_INODE       256   // icache至少保留的inode数
+#define N_INODE_HASH  64
+#define INODE_HASH(inode_num) ((inode_num) % N_INODE_HASH)
+#define ICACHE_FILL_MAX 16  // 批量装入时一次最多装入的邻居数（块大时只装入前面的一部分）
+static kmem_cache_t inode_cache;             // 内存inode的slab cache
+static uint32 n_icache;                      // icache中的inode数
+static bool icache_ready;                    // inode_cache已初始化
+static inode_t* icache_hash[N_INODE_HASH];   // 哈希链表头（经hash_next串联）
+static inode_t* icache_lru_head;             // 空闲LRU链表: 最久未使用
+static inode_t* icache_lru_tail;             // 空闲LRU链表: 最近释放
+static rwspinlock_t lk_icache;               // 保护icache的读写锁（引用计数、哈希表、空闲LRU链表）
+static uint64 icache_unhash_gen;             // inode移出哈希表的次数（批量装入期间是否有inode被替换）
+
+/*
+    最近使用的inode表块常驻缓存: 每个槽位持有一个常驻buf（buf_pin）
+    命中时直接拿到buf指针, 不经过buf层的哈希查找, 也不会被用户数据挤出
+    users > 0 的槽位正在被使用, 不能替换; buf == NULL 表示正在读入
+*/
+#define N_INODE_BLOCK_PIN 8
+static struct {
+    uint32 block_num;
+    buf_t* buf;
+    uint32 users;
+    uint64 stamp;
+} inode_block_pin[N_INODE_BLOCK_PIN];
+static uint64 inode_block_clock;   // 槽位LRU时间戳
+static spinlock_t lk_inode_pin;    // 保护inode_block_pin
+
+static void inode_map_reset(inode_t* ip);
+static uint32 inode_unshare_block(inode_t* ip, uint32 bn, uint32 old);
+
+// 读空洞时拷贝给用户的全0数据
+static uint8 zero_block[BLOCK_SIZE];
+
+// ---------------------- icache 哈希表与空闲LRU链表（调用者持有lk_icache） ----------------------
+// 把ref == 0的inode追加到空闲LRU链表尾部（最近释放）
+static void icache_lru_push(inode_t* ip)
+{
+    ip->lru_next = NULL;
+    ip->lru_prev = icache_lru_tail;
+    if (icache_lru_tail != NULL) {
+        icache_lru_tail->lru_next = ip;
+    } else {
+        icache_lru_head = ip;
+    }
+    icache_lru_tail = ip;
+}
+
+// 把ref == 0的inode插入空闲LRU链表头部（最先被替换, 批量装入的inode使用）
+static void icache_lru_push_head(inode_t* ip)
+{
+    ip->lru_prev = NULL;
+    ip->lru_next = icache_lru_head;
+    if (icache_lru_head != NULL) {
+        icache_lru_head->lru_prev = ip;
+    } else {
+        icache_lru_tail = ip;
+    }
+    icache_lru_head = ip;
+}
+
+// 把inode从空闲LRU链表中摘除（重新被引用或被替换）
+static void icache_lru_remove(inode_t* ip)
+{
+    if (ip->lru_prev != NULL) {
+        ip->lru_prev->lru_next = ip->lru_next;
+    } else {
+        icache_lru_head = ip->lru_next;
+    }
+    if (ip->lru_next != NULL) {
+        ip->lru_next->lru_prev = ip->lru_prev;
+    } else {
+        icache_lru_tail = ip->lru_prev;
+    }
+    ip->lru_prev = NULL;
+    ip->lru_next = NULL;
+}
+
+// 在哈希表中查找inode_num对应的inode（无论ref是否为0）, 未命中返回NULL
+static inode_t* icache_lookup(uint16 inode_num)
+{
+    for (inode_t* ip = icache_hash[INODE_HASH(inode_num)]; ip != NULL; ip = ip->hash_next) {
+        if (ip->inode_num == inode_num) {
+            return ip;
+        }
+    }
+    return NULL;
+}
+
+// 持有读锁: ref > 0时原子地+1, 返回false说明ref == 0 (需要在写锁下从空闲LRU链表摘除)
+static bool icache_ref_get(inode_t* ip)
+{
+    for (;;) {
+        uint32 ref = ip->ref;
+        if (ref == 0) {
+            return false;
+        }
+        if (__sync_bool_compare_and_swap(&ip->ref, ref, ref + 1)) {
+            return true;
+        }
+    }
+}
+
+// 把inode从哈希表中移除
+static void icache_unhash(inode_t* ip)
+{
+    inode_t** pp = &icache_hash[INODE_HASH(ip->inode_num)];
+    while (*pp != NULL) {
+        if (*pp == ip) {
+            *pp = ip->hash_next;
+            ip->hash_next = NULL;
+            icache_unhash_gen++;
+            return;
+        }
+        pp = &(*pp)->hash_next;
+    }
+    panic("icache_unhash: inode not in hash table");
+}
+
+// 初始化刚从slab申请的内存inode（空闲状态）
+static void icache_setup(inode_t* ip)
+{
+    // 初始化inode睡眠锁（保护元数据和有效性）
+    sleeplock_init(&ip->slk, "inode");
+    spinlock_init(&ip->map_lk, "inode_map");
+    // 初始化默认字段（空闲状态）
+    ip->inode_num = INODE_NUM_UNUSED;
+    ip->ref = 0;
+    ip->valid = false;
+    ip->dirty = false;
+    ip->type = FT_UNUSED;
+    ip->hash_next = NULL;
+    ip->lru_prev = NULL;
+    ip->lru_next = NULL;
+}
+
+// 从slab申请一个空闲的内存inode（调用者持有lk_icache）, 内存不足时返回NULL
+static inode_t* icache_new()
+{
+    inode_t* ip = (inode_t*)kmem_cache_alloc(&inode_cache);
+    if (ip == NULL) {
+        return NULL;
+    }
+    icache_setup(ip);
+    n_icache++;
+    return ip;
+}
+
+// pmem回收函数: 从空闲LRU链表头部释放超出N_INODE的inode, 返回估计归还的页数
+// icache_new持有lk_icache申请slab时直接返回0
+static uint32 icache_reclaim(uint32 target)
+{
+    if (rwspinlock_holding_write(&lk_icache)) {
+        return 0;
+    }
+    uint32 goal = target * inode_cache.per_slab;
+    uint32 freed = 0;
+    rwspinlock_acquire_write(&lk_icache);
+    while (freed < goal && n_icache > N_INODE && icache_lru_head != NULL) {
+        inode_t* ip = icache_lru_head;
+        icache_lru_remove(ip);
+        if (ip->inode_num != INODE_NUM_UNUSED) {
+            icache_unhash(ip);
+        }
+        n_icache--;
+        kmem_cache_free(&inode_cache, ip);
+        freed++;
+    }
+    rwspinlock_release_write(&lk_icache);
+    return freed / inode_cache.per_slab;
+}
 
 // ---------------------- 基础初始化 ----------------------
 /**
@@ -21,23 +215,120 @@ static spinlock_t lk_icache;       // 保护icache的自旋锁（引用计数、
  */
 void inode_init()
 {
-    // 1. 初始化icache全局自旋锁
-    spinlock_init(&lk_icache, "icache");
+    // 1. 初始化icache全局自旋锁和inode表块常驻缓存
+    rwspinlock_init(&lk_icache, "icache");
+    spinlock_init(&lk_inode_pin, "inode_pin");
+    inode_block_clock = 0;
+    for (int i = 0; i < N_INODE_BLOCK_PIN; i++) {
+        inode_block_pin[i].block_num = 0;   // 0是超级块, 不会是inode表块
+        inode_block_pin[i].buf = NULL;
+        inode_block_pin[i].users = 0;
+        inode_block_pin[i].stamp = 0;
+    }
 
-    // 2. 遍历初始化所有内存inode的睡眠锁和默认字段
-    for (int i = 0; i < N_INODE; i++) {
-        inode_t* ip = &icache[i];
-        // 初始化inode睡眠锁（保护元数据和有效性）
-        sleeplock_init(&ip->slk, "inode");
-        // 初始化默认字段（空闲状态）
-        ip->inode_num = INODE_NUM_UNUSED;
-        ip->ref = 0;
-        ip->valid = false;
-        ip->type = FT_UNUSED;
+    // 2. 第一次调用时初始化slab cache; 重新初始化时空闲的inode还给slab, 仍被引用的inode不再被icache管理
+    if (!icache_ready) {
+        kmem_cache_init(&inode_cache, "inode", sizeof(inode_t), MEMTAG_INODE);
+        pmem_register_reclaim(true, icache_reclaim);
+        icache_ready = true;
+    }
+    while (icache_lru_head != NULL) {
+        inode_t* ip = icache_lru_head;
+        icache_lru_remove(ip);
+        kmem_cache_free(&inode_cache, ip);
     }
+    n_icache = 0;
+    icache_unhash_gen++;
+    for (int i = 0; i < N_INODE_HASH; i++) {
+        icache_hash[i] = NULL;
+    }
+    icache_lru_head = NULL;
+    icache_lru_tail = NULL;
 }
 
 // ---------------------- 与inode本身相关（元数据管理） ----------------------
+/**
+ * @brief 辅助函数：获取inode表块的缓冲区并上锁（优先使用常驻槽位）
+ * @param block_num inode表块的磁盘块编号
+ * @param slot 返回使用的槽位序号，未使用槽位时为-1
+ * @return 持有睡眠锁的缓冲区，使用完后调用inode_block_unlock
+ */
+static buf_t* inode_block_lock(uint32 block_num, int* slot)
+{
+    spinlock_acquire(&lk_inode_pin);
+
+    // 1. 命中常驻槽位（若正在读入则等待）
+    for (int i = 0; i < N_INODE_BLOCK_PIN; i++) {
+        if (inode_block_pin[i].block_num == block_num) {
+            inode_block_pin[i].users++;
+            inode_block_pin[i].stamp = ++inode_block_clock;
+            while (inode_block_pin[i].buf == NULL) {
+                proc_sleep(&inode_block_pin[i], &lk_inode_pin);
+            }
+            buf_t* buf = inode_block_pin[i].buf;
+            spinlock_release(&lk_inode_pin);
+            buf_pinned_lock(buf);
+            *slot = i;
+            return buf;
+        }
+    }
+
+    // 2. 未命中: 替换最久未使用且空闲的槽位
+    int victim = -1;
+    for (int i = 0; i < N_INODE_BLOCK_PIN; i++) {
+        if (inode_block_pin[i].users == 0 &&
+            (victim < 0 || inode_block_pin[i].stamp < inode_block_pin[victim].stamp)) {
+            victim = i;
+        }
+    }
+
+    // 3. 所有槽位都在使用中: 退回普通的buf_read
+    if (victim < 0) {
+        spinlock_release(&lk_inode_pin);
+        *slot = -1;
+        return buf_read(block_num);
+    }
+
+    // 4. 占用槽位后再做磁盘I/O（会睡眠, 不能持有自旋锁）
+    buf_t* old = inode_block_pin[victim].buf;
+    inode_block_pin[victim].block_num = block_num;
+    inode_block_pin[victim].buf = NULL;
+    inode_block_pin[victim].users = 1;
+    inode_block_pin[victim].stamp = ++inode_block_clock;
+    spinlock_release(&lk_inode_pin);
+
+    if (old != NULL) {
+        buf_unpin(old);
+    }
+    buf_t* buf = buf_pin(block_num);
+
+    spinlock_acquire(&lk_inode_pin);
+    inode_block_pin[victim].buf = buf;
+    proc_wakeup(&inode_block_pin[victim]);
+    spinlock_release(&lk_inode_pin);
+
+    buf_pinned_lock(buf);
+    *slot = victim;
+    return buf;
+}
+
+/**
+ * @brief 辅助函数：释放inode_block_lock获取的缓冲区
+ * @param buf 缓冲区指针
+ * @param slot inode_block_lock返回的槽位序号
+ */
+static void inode_block_unlock(buf_t* buf, int slot)
+{
+    if (slot < 0) {
+        buf_release(buf);
+        return;
+    }
+    buf_pinned_unlock(buf);
+    spinlock_acquire(&lk_inode_pin);
+    inode_block_pin[slot].users--;
+    spinlock_release(&lk_inode_pin);
+}
+
 /**
  * @brief 同步inode元数据（磁盘↔内存）
  * @param ip 内存inode指针
@@ -53,8 +344,9 @@ void inode_rw(inode_t* ip, bool write)
     // 公式：inode区域起始块 + inode序号 / 每个块可存储的inode数量
     uint32 block_num = sb.inode_start + (ip->inode_num / INODE_PER_BLOCK);
 
-    // 3. 调用buf层读取对应磁盘块
-    buf_t* inode_buf = buf_read(block_num);
+    // 3. 获取对应磁盘块的缓冲区（最近使用的inode表块常驻缓存）
+    int slot;
+    buf_t* inode_buf = inode_block_lock(block_num, &slot);
     assert(inode_buf != NULL, "inode_rw: read inode block failed");
 
     // 4. 计算该inode在磁盘块中的偏移量（每个inode固定64字节）
@@ -64,15 +356,84 @@ void inode_rw(inode_t* ip, bool write)
     if (write) {
         // 内存inode元数据 → 磁盘（仅同步前64字节，对应INODE_DISK_SIZE）
         memmove(disk_inode, &ip->type, INODE_DISK_SIZE);
-        // 强制写入磁盘，保证数据持久化
-        buf_write(inode_buf);
+        ip->dirty = false;
+        // 加入日志事务（与同一操作的其他元数据一起提交）
+        journal_log(inode_buf);
     } else {
         // 磁盘 → 内存inode元数据（加载磁盘上的inode信息）
         memmove(&ip->type, disk_inode, INODE_DISK_SIZE);
     }
 
-    // 6. 释放缓冲区引用，允许buf层回收复用
-    buf_release(inode_buf);
+    // 6. 释放缓冲区
+    inode_block_unlock(inode_buf, slot);
+}
+
+/**
+ * @brief 辅助函数：把ip所在inode表块中其他已使用、还不在icache中的inode装入icache（批量装入）
+ * @param ip 刚从磁盘读入的内存inode（调用者持有睡眠锁）
+ * @note icache已满且内核区内存不充足时不装入（不为预先装入的inode替换已缓存的inode）;
+ *       inode表块只在持有内存inode时才被修改, 读块期间没有inode移出哈希表时,
+ *       仍不在icache中的inode在磁盘上的内容就是最新的; 否则放弃这一次装入
+ */
+static void icache_fill_block(inode_t* ip)
+{
+    uint16 first = ip->inode_num - ip->inode_num % INODE_PER_BLOCK;
+    inode_t* fresh[ICACHE_FILL_MAX];
+    uint32 n = 0;
+
+    // 1. 读锁下找出不在icache中的邻居, 记录替换代数
+    rwspinlock_acquire_read(&lk_icache);
+    uint64 gen = icache_unhash_gen;
+    bool room = (n_icache < N_INODE || pmem_free_pages(true) >= PMEM_WMARK_HIGH);
+    uint64 absent = 0;
+    for (uint32 i = 0; room && i < INODE_PER_BLOCK; i++) {
+        if (first + i != ip->inode_num && icache_lookup(first + i) == NULL) {
+            absent |= 1ull << i;
+        }
+    }
+    rwspinlock_release_read(&lk_icache);
+    if (absent == 0) {
+        return;
+    }
+
+    // 2. 申请内存inode, 从inode表块复制磁盘上的字段（只保留已使用的inode）
+    for (uint32 i = 0; i < INODE_PER_BLOCK; i++) {
+        if ((absent & (1ull << i)) == 0) {
+            continue;
+        }
+        inode_t* fp = (n < ICACHE_FILL_MAX) ? (inode_t*)kmem_cache_alloc(&inode_cache) : NULL;
+        if (fp == NULL) {
+            break;
+        }
+        icache_setup(fp);
+        fp->inode_num = first + i;
+        fresh[n++] = fp;
+    }
+    int slot;
+    buf_t* buf = inode_block_lock(sb.inode_start + first / INODE_PER_BLOCK, &slot);
+    for (uint32 i = 0; i < n; i++) {
+        memmove(&fresh[i]->type, buf->data + (fresh[i]->inode_num % INODE_PER_BLOCK) * INODE_DISK_SIZE,
+                INODE_DISK_SIZE);
+    }
+    inode_block_unlock(buf, slot);
+
+    // 3. 写锁下加入哈希表和空闲LRU链表头部（期间被其他进程装入的、未使用的inode放弃）
+    rwspinlock_acquire_write(&lk_icache);
+    bool stale = (gen != icache_unhash_gen);
+    for (uint32 i = 0; i < n; i++) {
+        inode_t* fp = fresh[i];
+        if (stale || fp->type == FT_UNUSED || icache_lookup(fp->inode_num) != NULL) {
+            kmem_cache_free(&inode_cache, fp);
+            continue;
+        }
+        inode_map_reset(fp);
+        fp->valid = true;
+        fp->hash_next = icache_hash[INODE_HASH(fp->inode_num)];
+        icache_hash[INODE_HASH(fp->inode_num)] = fp;
+        icache_lru_push_head(fp);
+        n_icache++;
+    }
+    rwspinlock_release_write(&lk_icache);
 }
 
 /**
@@ -83,42 +444,55 @@ void inode_rw(inode_t* ip, bool write)
  */
 inode_t* inode_alloc(uint16 inode_num)
 {
-    inode_t* free_inode = NULL;
-
-    // 1. 获取icache自旋锁，保护缓存遍历和引用计数修改
-    spinlock_acquire(&lk_icache);
-
-    // 2. 遍历icache，查找已缓存的对应inode
-    for (int i = 0; i < N_INODE; i++) {
-        inode_t* ip = &icache[i];
-        // 找到已缓存且被引用的inode（ref>0）
-        if (ip->ref > 0 && ip->inode_num == inode_num) {
-            // 引用计数+1，标记新增使用者
-            ip->ref++;
-            // 释放自旋锁，返回找到的inode
-            spinlock_release(&lk_icache);
-            return ip;
-        }
-        // 记录第一个空闲inode（ref=0，未被使用）
-        if (free_inode == NULL && ip->ref == 0) {
-            free_inode = ip;
+    // 1. 读锁下查找: 命中正在被引用的inode时原子地增加引用计数 (最常见的情况, 多个hart可以同时查找)
+    rwspinlock_acquire_read(&lk_icache);
+    inode_t* ip = icache_lookup(inode_num);
+    if (ip != NULL && icache_ref_get(ip)) {
+        rwspinlock_release_read(&lk_icache);
+        return ip;
+    }
+    rwspinlock_release_read(&lk_icache);
+
+    // 2. 获取icache写锁, 重新查找 (释放读锁期间可能有变化)
+    rwspinlock_acquire_write(&lk_icache);
+    ip = icache_lookup(inode_num);
+    if (ip != NULL) {
+        // ref == 0 的inode在空闲LRU链表上, 重新被引用时摘除（元数据保持valid）
+        if (ip->ref == 0) {
+            icache_lru_remove(ip);
         }
+        __sync_fetch_and_add(&ip->ref, 1);  // ref > 0时其他持有者可能同时无锁地释放
+        rwspinlock_release_write(&lk_icache);
+        return ip;
     }
 
-    // 3. 未找到已缓存inode，分配空闲inode
-    if (free_inode == NULL) {
-        spinlock_release(&lk_icache);
-        panic("inode_alloc: no free inode in icache");
+    // 3. 未找到已缓存inode: 申请新的inode, 不行则取出最久未使用的空闲inode
+    ip = NULL;
+    if (icache_lru_head == NULL || n_icache < N_INODE || pmem_free_pages(true) >= PMEM_WMARK_HIGH) {
+        ip = icache_new();
+    }
+    if (ip == NULL) {
+        ip = icache_lru_head;
+        if (ip == NULL) {
+            rwspinlock_release_write(&lk_icache);
+            panic("inode_alloc: no free inode in icache");
+        }
+        icache_lru_remove(ip);
+        if (ip->inode_num != INODE_NUM_UNUSED) {
+            icache_unhash(ip);
+        }
     }
 
-    // 4. 初始化空闲inode的核心字段
-    free_inode->inode_num = inode_num;
-    free_inode->ref = 1;          // 引用计数初始化为1
-    free_inode->valid = false;    // 标记元数据无效，需后续从磁盘加载
+    // 4. 初始化空闲inode的核心字段并加入哈希表
+    ip->inode_num = inode_num;
+    ip->ref = 1;          // 引用计数初始化为1
+    ip->valid = false;    // 标记元数据无效，需后续从磁盘加载
+    ip->hash_next = icache_hash[INODE_HASH(inode_num)];
+    icache_hash[INODE_HASH(inode_num)] = ip;
 
     // 5. 释放自旋锁，返回新分配的inode
-    spinlock_release(&lk_icache);
-    return free_inode;
+    rwspinlock_release_write(&lk_icache);
+    return ip;
 }
 
 /**
@@ -130,8 +504,27 @@ inode_t* inode_alloc(uint16 inode_num)
  */
 inode_t* inode_create(uint16 type, uint16 major, uint16 minor)
 {
-    // 1. 在位图中分配空闲inode（磁盘层面）
-    uint16 inode_num = bitmap_alloc_inode();
+    return inode_create_near(INODE_NUM_UNUSED, type, major, minor, 0);
+}
+
+/**
+ * @brief 在父目录附近创建新inode（分配策略见bitmap_alloc_inode_near/bitmap_data_goal）
+ * @param parent 父目录的inode序号（INODE_NUM_UNUSED表示没有偏好）
+ * @param type inode类型（FT_DIR/FT_FILE/FT_DEVICE）
+ * @param major 主设备号（设备文件使用）
+ * @param minor 次设备号（设备文件使用）
+ * @param flags INODE_F_*（INODE_F_EXTENT / INODE_F_COMPRESS只对普通文件有效, 不能同时使用）
+ * @return 内存inode指针（未上锁，已完成磁盘初始化）
+ */
+inode_t* inode_create_near(uint16 parent, uint16 type, uint16 major, uint16 minor, uint8 flags)
+{
+    assert(type == FT_FILE || (flags & (INODE_F_EXTENT | INODE_F_COMPRESS)) == 0,
+           "inode_create: extent mapping or compression for non-regular file");
+    assert((flags & INODE_F_EXTENT) == 0 || (flags & INODE_F_COMPRESS) == 0,
+           "inode_create: compressed files use block pointers");
+
+    // 1. 在位图中分配空闲inode（磁盘层面）, 尽量靠近父目录
+    uint16 inode_num = (parent == INODE_NUM_UNUSED) ? bitmap_alloc_inode() : bitmap_alloc_inode_near(parent);
     assert(inode_num != INODE_NUM_UNUSED, "inode_create: alloc inode failed");
 
     // 2. 在内存icache中分配对应inode缓存
@@ -143,6 +536,10 @@ inode_t* inode_create(uint16 type, uint16 major, uint16 minor)
 
     // 3.1 填充核心元数据
     ip->type = type;
+    ip->flags = flags;
+    if (type == FT_FILE && (flags & (INODE_F_EXTENT | INODE_F_COMPRESS)) == 0) {
+        ip->flags |= INODE_F_INLINE;    // 普通文件先把数据内联在inode中, 增长后再迁移到数据块（压缩文件总是按cluster存放）
+    }
     ip->major = major;
     ip->minor = minor;
     ip->nlink = 1;    // 初始链接数为1
@@ -155,8 +552,9 @@ inode_t* inode_create(uint16 type, uint16 major, uint16 minor)
 
     // 3.3 特殊处理：目录类型inode，分配初始数据块（存储.和..）
     if (type == FT_DIR) {
-        // 分配第一个数据块，用于存储目录项
-        ip->addrs[0] = bitmap_alloc_block();
+        // 分配第一个数据块，用于存储目录项（放在inode对应的数据段）
+        uint32 n = 1;
+        ip->addrs[0] = bitmap_alloc_extent(bitmap_data_goal(inode_num), &n);
         ip->size = 0;  // 后续目录项添加会更新size
         inode_rw(ip, true); // 同步到磁盘
     }
@@ -200,20 +598,95 @@ void inode_free(inode_t* ip)
 {
     assert(ip != NULL, "inode_free: invalid NULL inode pointer");
 
-    // 1. 获取icache自旋锁，保护引用计数修改和销毁操作
-    spinlock_acquire(&lk_icache);
+    // 0. 不是最后一个引用: 无锁地CAS减1 (计数不会因此归零, 不涉及LRU链表和销毁)
+    while (1) {
+        uint32 ref = ip->ref;
+        assert(ref > 0, "inode_free: inode ref count is zero (double free)");
+        if (ref == 1) {
+            break;
+        }
+        if (__sync_bool_compare_and_swap(&ip->ref, ref, ref - 1)) {
+            return;
+        }
+    }
+
+    // 1. 最后一个引用: 先写回延迟的元数据（没有其他持有者, 上锁不会死锁）
+    if (ip->ref == 1 && ip->dirty) {
+        sleeplock_acquire(&ip->slk);
+        inode_flush(ip);
+        sleeplock_release(&ip->slk);
+    }
+
+    // 2. 获取icache自旋锁，保护引用计数归零和销毁操作
+    //    (释放睡眠锁之后可能又有人引用了它, 下面按当时的ref判断)
+    rwspinlock_acquire_write(&lk_icache);
 
-    // 2. 判断是否需要销毁磁盘inode（最后一个引用+无链接+元数据有效）
+    // 3. 判断是否需要销毁磁盘inode（最后一个引用+无链接+元数据有效）
     if (ip->ref == 1 && ip->valid && ip->nlink == 0) {
         inode_destroy(ip);
     }
 
-    // 3. 引用计数-1（确保不会出现负引用）
-    assert(ip->ref > 0, "inode_free: inode ref count is zero (double free)");
-    ip->ref--;
+    // 4. 引用计数-1（确保不会出现负引用; 其他持有者可能同时无锁地减1, 必须原子地修改）
+    uint32 old = __sync_fetch_and_sub(&ip->ref, 1);
+    assert(old > 0, "inode_free: inode ref count is zero (double free)");
+
+    // 5. 最后一个引用释放后挂到空闲LRU链表尾部, 元数据保留以便再次打开时命中;
+    //    icache超过N_INODE且内核区内存紧张时直接还给slab
+    if (old == 1) {
+        if (n_icache > N_INODE && pmem_free_pages(true) < PMEM_WMARK_LOW) {
+            icache_unhash(ip);
+            n_icache--;
+            kmem_cache_free(&inode_cache, ip);
+        } else {
+            icache_lru_push(ip);
+        }
+    }
+
+    // 6. 释放自旋锁
+    rwspinlock_release_write(&lk_icache);
+}
+
+/**
+ * @brief 写回inode的延迟元数据（dirty时调用inode_rw）
+ * @param ip 内存inode指针
+ * @note 调用者必须持有inode睡眠锁
+ */
+void inode_flush(inode_t* ip)
+{
+    assert(sleeplock_holding(&ip->slk), "inode_flush: not holding inode sleeplock");
+    if (ip->valid && ip->dirty) {
+        inode_rw(ip, true);
+    }
+}
 
-    // 4. 释放自旋锁
-    spinlock_release(&lk_icache);
+/**
+ * @brief 写回icache中所有dirty inode的元数据（写入buf cache, 落盘由buf_sync负责）
+ * @note 调用者不能持有任何inode睡眠锁
+ */
+void inode_sync()
+{
+    for (int b = 0; b < N_INODE_HASH; b++) {
+        // 1. 在哈希桶中找一个被引用的dirty inode; 持有引用期间inode不会被替换, 之后才能睡眠等待它的锁
+        //    写回后它不再dirty, 每次都从桶头重新查找
+        rwspinlock_acquire_write(&lk_icache);
+        inode_t* ip = icache_hash[b];
+        while (ip != NULL && (ip->ref == 0 || !ip->valid || !ip->dirty)) {
+            ip = ip->hash_next;
+        }
+        if (ip == NULL) {
+            rwspinlock_release_write(&lk_icache);
+            continue;
+        }
+        __sync_fetch_and_add(&ip->ref, 1);
+        rwspinlock_release_write(&lk_icache);
+
+        // 2. 上锁写回后释放引用
+        sleeplock_acquire(&ip->slk);
+        inode_flush(ip);
+        sleeplock_release(&ip->slk);
+        inode_free(ip);
+        b--;
+    }
 }
 
 /**
@@ -225,14 +698,8 @@ inode_t* inode_dup(inode_t* ip)
 {
     assert(ip != NULL && ip->ref > 0, "inode_dup: invalid inode or ref count zero");
 
-    // 1. 获取icache自旋锁，保护引用计数修改
-    spinlock_acquire(&lk_icache);
-
-    // 2. 引用计数+1
-    ip->ref++;
-
-    // 3. 释放自旋锁，返回原inode指针
-    spinlock_release(&lk_icache);
+    // 调用者持有引用 (ref > 0, 不会同时归零, inode不会被替换): 不需要锁, 原子地+1即可
+    __sync_fetch_and_add(&ip->ref, 1);
     return ip;
 }
 
@@ -250,10 +717,63 @@ void inode_lock(inode_t* ip)
     // 2. 若元数据无效，从磁盘加载inode信息
     if (ip->valid == false) {
         inode_rw(ip, false);
+        inode_map_reset(ip);
+        ip->dirty = false;
         ip->valid = true;
+        icache_fill_block(ip);
+    }
+}
+
+/**
+ * @brief 异步预读inode所在的inode表块（目录遍历时为之后的stat做准备）
+ * @param inode_num inode序号
+ * @note 已经在icache中且有效时不读; 同一块的多个inode只有第一次提交读请求
+ */
+void inode_prefetch(uint16 inode_num)
+{
+    if (inode_num == INODE_NUM_UNUSED) {
+        return;
+    }
+    rwspinlock_acquire_read(&lk_icache);
+    inode_t* ip = icache_lookup(inode_num);
+    bool cached = (ip != NULL && ip->valid);
+    rwspinlock_release_read(&lk_icache);
+    if (!cached) {
+        buf_prefetch(sb.inode_start + inode_num / INODE_PER_BLOCK);
+    }
+}
+
+/**
+ * @brief 以共享模式给inode上锁（只读访问: inode_read_data/inode_readahead）
+ * @param ip 内存inode指针
+ * @note 多个共享持有者可以并发读; 元数据无效时先排他上锁读入
+ */
+void inode_lock_shared(inode_t* ip)
+{
+    assert(ip != NULL && ip->ref > 0, "inode_lock_shared: invalid inode or ref count zero");
+
+    for (;;) {
+        sleeplock_acquire_shared(&ip->slk);
+        if (ip->valid) {
+            return;
+        }
+        // 元数据无效: 换成排他模式从磁盘读入后重试
+        sleeplock_release_shared(&ip->slk);
+        inode_lock(ip);
+        inode_unlock(ip);
     }
 }
 
+/**
+ * @brief 释放inode_lock_shared获取的共享锁
+ * @param ip 内存inode指针
+ */
+void inode_unlock_shared(inode_t* ip)
+{
+    assert(ip != NULL, "inode_unlock_shared: invalid NULL inode pointer");
+    sleeplock_release_shared(&ip->slk);
+}
+
 /**
  * @brief 给inode解锁
  * @param ip 内存inode指针
@@ -286,13 +806,22 @@ void inode_unlock_free(inode_t* ip)
  * @param entry 地址项指针
  * @param bn 数据块序号
  * @param size 当前层级的块数量
+ * @param alloc 地址项为空时是否分配新块（false则返回0）
+ * @param fill 数据块地址项为空时填入的块号（0则调用bitmap_alloc_block分配, 索引块总是新分配）
+ * @param ind 输出：最后一级索引块的磁盘编号（直接映射时不修改）
  * @return 数据块的磁盘编号
  */
-static uint32 locate_block(uint32* entry, uint32 bn, uint32 size)
+static uint32 locate_block(uint32* entry, uint32 bn, uint32 size, bool alloc, uint32 fill, uint32* ind)
 {
+    bool fresh = false;
+
     // 1. 若地址项为空，分配新数据块并绑定
     if (*entry == 0) {
-        *entry = bitmap_alloc_block();
+        if (!alloc) {
+            return 0;
+        }
+        *entry = (size == 1 && fill != 0) ? fill : bitmap_alloc_block();
+        fresh = true;
     }
 
     // 2. 若当前是一级映射，直接返回数据块编号
@@ -307,26 +836,52 @@ static uint32 locate_block(uint32* entry, uint32 bn, uint32 size)
     uint32 ret = 0;
 
     // 4. 读取当前元数据块，查找下一级地址项
-    buf_t* buf = buf_read(*entry);
+    //    新分配的索引块内容全为0, 获取缓冲区后直接清零, 不需要从磁盘读取
+    buf_t* buf;
+    if (fresh) {
+        buf = buf_get_nofill(*entry);
+        memset(buf->data, 0, BLOCK_SIZE);
+    } else {
+        buf = buf_read(*entry);
+    }
     next_entry = (uint32*)(buf->data) + (bn / next_size);
-    ret = locate_block(next_entry, next_bn, next_size);
+    uint32 old_entry = *next_entry;
+    if (next_size == 1) {
+        *ind = *entry;
+    }
+    ret = locate_block(next_entry, next_bn, next_size, alloc, fill, ind);
+
+    // 5. 下一级地址项有变化（新分配了块）则写回索引块
+    if (fresh || *next_entry != old_entry) {
+        journal_log(buf);
+    }
 
-    // 5. 释放缓冲区，返回递归结果
+    // 6. 释放缓冲区，返回递归结果
     buf_release(buf);
     return ret;
 }
 
 /**
- * @brief 定位inode管理的第bn个数据块（不存在则创建）
+ * @brief 辅助函数：从inode的addrs开始逐级查找第bn个数据块（不经过映射缓存）
  * @param ip 内存inode指针
  * @param bn 数据块序号（从0开始）
+ * @param alloc 数据块不存在时是否创建（false则返回0）
+ * @param fill 数据块不存在时使用的块号（0则新分配一个块）
+ * @param ind 输出：最后一级索引块的磁盘编号（直接映射时为0）
  * @return 数据块的磁盘编号
  */
-static uint32 inode_locate_block(inode_t* ip, uint32 bn)
+static uint32 inode_map_walk(inode_t* ip, uint32 bn, bool alloc, uint32 fill, uint32* ind)
 {
+    *ind = 0;
+
+    // 0. extent映射的inode在extent树中查找
+    if (ip->flags & INODE_F_EXTENT) {
+        return extent_map(ip, bn, alloc, fill);
+    }
+
     // 1. 一级映射区域（直接映射，N_ADDRS_1个块）
     if (bn < N_ADDRS_1) {
-        return locate_block(&ip->addrs[bn], bn, 1);
+        return locate_block(&ip->addrs[bn], bn, 1, alloc, fill, ind);
     }
 
     // 2. 二级映射区域（间接映射，N_ADDRS_2 * ENTRY_PER_BLOCK个块）
@@ -335,7 +890,7 @@ static uint32 inode_locate_block(inode_t* ip, uint32 bn)
         uint32 size = ENTRY_PER_BLOCK;
         uint32 idx = bn / size;
         uint32 b = bn % size;
-        return locate_block(&ip->addrs[N_ADDRS_1 + idx], b, size);
+        return locate_block(&ip->addrs[N_ADDRS_1 + idx], b, size, alloc, fill, ind);
     }
 
     // 3. 三级映射区域（二级间接映射，N_ADDRS_3 * ENTRY_PER_BLOCK^2个块）
@@ -344,7 +899,7 @@ static uint32 inode_locate_block(inode_t* ip, uint32 bn)
         uint32 size = ENTRY_PER_BLOCK * ENTRY_PER_BLOCK;
         uint32 idx = bn / size;
         uint32 b = bn % size;
-        return locate_block(&ip->addrs[N_ADDRS_1 + N_ADDRS_2 + idx], b, size);
+        return locate_block(&ip->addrs[N_ADDRS_1 + N_ADDRS_2 + idx], b, size, alloc, fill, ind);
     }
 
     // 4. 超出最大映射范围，报错退出
@@ -353,148 +908,867 @@ static uint32 inode_locate_block(inode_t* ip, uint32 bn)
 }
 
 /**
- * @brief 从inode中读取数据
+ * @brief 清空inode的块映射缓存（addrs重新读入或数据块被释放时调用）
  * @param ip 内存inode指针
- * @param offset 读取起始偏移量（字节）
- * @param len 读取字节数
- * @param dst 目标缓冲区指针
- * @param user true=用户态缓冲区，false=内核态缓冲区
- * @return 实际读取的字节数
- * @note 调用者必须持有inode睡眠锁
  */
-uint32 inode_read_data(inode_t* ip, uint32 offset, uint32 len, void* dst, bool user)
+static void inode_map_reset(inode_t* ip)
 {
-    assert(sleeplock_holding(&ip->slk), "inode_read_data: not holding inode sleeplock");
-    assert(dst != NULL, "inode_read_data: invalid NULL dst pointer");
+    for (int i = 0; i < INODE_MAP_CACHE; i++) {
+        ip->map_block[i] = 0;
+    }
+    ip->map_next = 0;
+    ip->map_ind = 0;
+}
 
-    // 1. 边界检查：偏移量超出文件大小，返回0
-    if (offset > ip->size) {
-        return 0;
+/**
+ * @brief 定位inode管理的第bn个数据块，先查映射缓存（alloc = true时不存在则创建）
+ * @param ip 内存inode指针
+ * @param bn 数据块序号（从0开始）
+ * @param alloc 数据块不存在时是否创建（false则返回0）
+ * @param fill 数据块不存在时使用的块号（0则新分配一个块）
+ * @return 数据块的磁盘编号
+ * @note 映射一旦建立就不会改变（只有释放/截断数据块、压缩文件重写cluster和写时复制会清除, 同时清空缓存）, 所以只缓存非0的结果
+ *       1. 最近的INODE_MAP_CACHE个翻译直接命中, 不读任何元数据块
+ *       2. 与上一次落在同一个最后一级索引块的bn只读这一个索引块
+ *       3. 否则从addrs逐级查找, 并记录最后一级索引块
+ */
+static uint32 inode_map_block(inode_t* ip, uint32 bn, bool alloc, uint32 fill)
+{
+    // 1. 命中最近的翻译（共享持有inode锁的读者可能并发访问映射缓存, 由map_lk保护）
+    spinlock_acquire(&ip->map_lk);
+    for (int i = 0; i < INODE_MAP_CACHE; i++) {
+        if (ip->map_block[i] != 0 && ip->map_bn[i] == bn) {
+            uint32 hit = ip->map_block[i];
+            spinlock_release(&ip->map_lk);
+            return hit;
+        }
+    }
+    uint32 ind = ip->map_ind;
+    uint32 ind_base = ip->map_ind_base;
+    spinlock_release(&ip->map_lk);
+
+    // 2. 命中上一次的最后一级索引块: 直接读取其中的地址项
+    uint32 block_num;
+    if (ind != 0 && bn >= ind_base && bn - ind_base < ENTRY_PER_BLOCK) {
+        buf_t* buf = buf_read(ind);
+        uint32* entry = (uint32*)buf->data + (bn - ind_base);
+        if (*entry == 0 && alloc) {
+            *entry = (fill != 0) ? fill : bitmap_alloc_block();
+            journal_log(buf);
+        }
+        block_num = *entry;
+        buf_release(buf);
+    } else {
+        // 3. 逐级查找, 记录最后一级索引块以及它覆盖的第一个bn
+        block_num = inode_map_walk(ip, bn, alloc, fill, &ind);
+        if (ind != 0) {
+            spinlock_acquire(&ip->map_lk);
+            ip->map_ind = ind;
+            ip->map_ind_base = bn - (bn - N_ADDRS_1) % ENTRY_PER_BLOCK;
+            spinlock_release(&ip->map_lk);
+        }
     }
 
-    // 2. 调整读取长度：避免超出文件末尾
-    if (offset + len > ip->size) {
-        len = ip->size - offset;
+    // 4. 记录非0的翻译（循环替换）
+    if (block_num != 0) {
+        spinlock_acquire(&ip->map_lk);
+        ip->map_bn[ip->map_next] = bn;
+        ip->map_block[ip->map_next] = block_num;
+        ip->map_next = (ip->map_next + 1) % INODE_MAP_CACHE;
+        spinlock_release(&ip->map_lk);
     }
+    return block_num;
+}
 
-    uint32 total_read = 0;
-    uint32 block_num, block_offset, read_len;
+/**
+ * @brief 定位inode管理的第bn个数据块（alloc = true时不存在则创建）
+ * @param ip 内存inode指针
+ * @param bn 数据块序号（从0开始）
+ * @param alloc 数据块不存在时是否创建（false则返回0）
+ * @return 数据块的磁盘编号
+ */
+uint32 inode_locate_block(inode_t* ip, uint32 bn, bool alloc)
+{
+    TSTAT_BEGIN(t);
+    uint32 block_num = inode_map_block(ip, bn, alloc, 0);
+    TSTAT_END(t, TSTAT_LOCATE_BLOCK);
+    return block_num;
+}
 
-    // 3. 循环读取数据，直到完成或无更多数据
-    while (total_read < len) {
-        // 3.1 计算当前数据块编号和块内偏移
-        block_num = inode_locate_block(ip, offset / BLOCK_SIZE);
-        block_offset = offset % BLOCK_SIZE;
+/**
+ * @brief 辅助函数：为[bn, bn + count)中尚未分配的数据块成段分配磁盘上连续的块
+ * @param ip 内存inode指针
+ * @param bn 起始数据块序号
+ * @param count 数据块数量
+ * @note 每一段连续的空洞用一次bitmap_alloc_extent分配, 优先紧接在前一个数据块之后;
+ *       连续的空间不足时分成多段; 与其他文件共享的块（reflink）先复制出这个文件自己的一份,
+ *       所以写数据块的路径（页缓存写回、buf cache、直接I/O）在写之前都经过这里
+ */
+static void inode_alloc_range(inode_t* ip, uint32 bn, uint32 count)
+{
+    uint32 end = bn + count;
+
+    while (bn < end) {
+        // 1. 跳过已经分配的数据块（共享的块写时复制）
+        uint32 block_num = inode_locate_block(ip, bn, false);
+        if (block_num != 0) {
+            if ((ip->flags & INODE_F_SHARED) && refcnt_shared(block_num)) {
+                inode_unshare_block(ip, bn, block_num);
+            }
+            bn++;
+            continue;
+        }
 
-        // 3.2 计算本次可读取的字节数
-        read_len = BLOCK_SIZE - block_offset;
-        if (read_len > len - total_read) {
-            read_len = len - total_read;
+        // 2. 统计从bn开始的连续空洞
+        uint32 holes = 1;
+        while (bn + holes < end && inode_locate_block(ip, bn + holes, false) == 0) {
+            holes++;
         }
 
-        // 3.3 读取数据块到缓冲区
-        buf_t* buf = buf_read(block_num);
+        // 3. 希望紧接在文件的前一个数据块之后, 没有前一个块时放在inode对应的数据段
+        uint32 preferred = bitmap_data_goal(ip->inode_num);
+        if (bn > 0) {
+            uint32 prev = inode_locate_block(ip, bn - 1, false);
+            if (prev != 0) {
+                preferred = prev + 1;
+            }
+        }
 
-        // 3.4 复制数据到目标缓冲区（区分用户态/内核态）
-        if (user) {
-            // 用户态缓冲区：通过虚拟内存拷贝（uvm_copyout）
-            uvm_copyout(myproc()->pgtbl, (uint64)dst + total_read,
-                       (uint64)(buf->data + block_offset), read_len);
+        // 4. 分配一段连续的块并逐个填入地址项（extent映射的inode整段记录为一个extent）
+        //    addrs可能改变, 元数据需要写回
+        ip->dirty = true;
+        uint32 got = holes;
+        uint32 start = bitmap_alloc_extent(preferred, &got);
+        if (ip->flags & INODE_F_EXTENT) {
+            extent_insert(ip, bn, start, got);
         } else {
-            // 内核态缓冲区：直接内存拷贝
-            memmove((char*)dst + total_read, buf->data + block_offset, read_len);
+            for (uint32 i = 0; i < got; i++) {
+                inode_map_block(ip, bn + i, true, start + i);
+            }
         }
-
-        // 3.5 释放缓冲区，更新统计信息
-        buf_release(buf);
-        total_read += read_len;
-        offset += read_len;
+        bn += got;
     }
-
-    // 4. 返回实际读取的字节数
-    return total_read;
 }
 
 /**
- * @brief 向inode中写入数据（可能扩展数据块）
+ * @brief 辅助函数：解除第bn个数据块的映射（不释放块, 只用于块指针映射的inode）
  * @param ip 内存inode指针
- * @param offset 写入起始偏移量（字节）
- * @param len 写入字节数
- * @param src 源缓冲区指针
- * @param user true=用户态缓冲区，false=内核态缓冲区
- * @return 实际写入的字节数
- * @note 调用者必须持有inode睡眠锁
+ * @param bn 数据块序号
+ * @return 原来的数据块磁盘编号（本来就是空洞时返回0）
+ * @note 变空的索引块保留到截断时释放; 调用者负责清空映射缓存
  */
-uint32 inode_write_data(inode_t* ip, uint32 offset, uint32 len, void* src, bool user)
+static uint32 inode_unmap_block(inode_t* ip, uint32 bn)
 {
-    assert(sleeplock_holding(&ip->slk), "inode_write_data: not holding inode sleeplock");
-    assert(src != NULL, "inode_write_data: invalid NULL src pointer");
-
-    // 1. 边界检查：偏移量超出最大限制，返回0
-    if (offset > INODE_MAXSIZE) {
+    uint32 ind;
+    uint32 block_num = inode_map_walk(ip, bn, false, 0, &ind);
+    if (block_num == 0) {
         return 0;
     }
-
-    // 2. 边界检查：写入后超出最大限制，返回0
-    if (offset + len > INODE_MAXSIZE) {
-        return 0;
+    if (ind == 0) {
+        ip->addrs[bn] = 0;
+        ip->dirty = true;
+    } else {
+        buf_t* buf = buf_read(ind);
+        ((uint32*)buf->data)[(bn - N_ADDRS_1) % ENTRY_PER_BLOCK] = 0;
+        journal_log(buf);
+        buf_release(buf);
     }
+    return block_num;
+}
 
-    uint32 total_written = 0;
-    uint32 block_num, block_offset, write_len;
+/**
+ * @brief 辅助函数：写时复制, 第bn个数据块换成一个内容相同的新块, 释放对共享块的引用
+ * @param ip 内存inode指针（调用者独占持有睡眠锁, 在日志事务中, 块指针映射）
+ * @param bn 数据块序号
+ * @param old 当前映射的块（与其他文件共享）
+ * @return 新的数据块磁盘编号
+ * @note 新块尽量紧接在前一个数据块之后; 旧块经过bitmap_free_block只减少引用计数
+ *       （同时有另一个文件也在复制时, 后完成的一方释放的是最后一个引用, 块回到位图）
+ */
+static uint32 inode_unshare_block(inode_t* ip, uint32 bn, uint32 old)
+{
+    // 1. 分配新块
+    uint32 preferred = bitmap_data_goal(ip->inode_num);
+    if (bn > 0) {
+        uint32 prev = inode_locate_block(ip, bn - 1, false);
+        if (prev != 0) {
+            preferred = prev + 1;
+        }
+    }
+    uint32 got = 1;
+    uint32 block_num = bitmap_alloc_extent(preferred, &got);
+
+    // 2. 复制内容（数据块不记录日志）
+    buf_t* from = buf_read(old);
+    buf_t* to = buf_get_nofill(block_num);
+    memmove(to->data, from->data, BLOCK_SIZE);
+    buf_write(to);
+    buf_release(to);
+    buf_release(from);
+
+    // 3. 换掉映射, 释放一个引用
+    inode_unmap_block(ip, bn);
+    inode_map_reset(ip);
+    inode_map_block(ip, bn, true, block_num);
+    ip->dirty = true;
+    bitmap_free_block(old);
+    return block_num;
+}
 
-    // 3. 循环写入数据，直到完成
+/**
+ * @brief 压缩文件重写一个cluster之前调整它的块: [bn, bn + keep)保证已分配, [bn + keep, bn + n)解除映射并释放
+ * @param ip 内存inode指针（调用者独占持有睡眠锁, 在日志事务中）
+ * @param bn cluster的第一个数据块序号
+ * @param n cluster的块数
+ * @param keep 需要的块数（0: 整个cluster变成空洞）
+ * @param blocks 输出: 前keep个块的磁盘编号
+ * @note 已有的块原地保留（cluster不会在磁盘上搬家）, 缺少的块成段分配;
+ *       与其他文件共享的块（reflink）不能原地重写, 同样解除映射（只释放一个引用）后重新分配
+ */
+void inode_map_cluster(inode_t* ip, uint32 bn, uint32 n, uint32 keep, uint32* blocks)
+{
+    assert(sleeplock_holding(&ip->slk), "inode_map_cluster: not holding inode sleeplock");
+    assert((ip->flags & (INODE_F_EXTENT | INODE_F_PACKED)) == 0, "inode_map_cluster: not a block-mapped file");
+
+    // 1. 释放多出的块和共享的块（先释放再分配, 空出的块可以马上被这个cluster重新使用）
+    bitmap_free_batch_t batch;
+    batch.n = 0;
+    bool freed = false;
+    for (uint32 i = 0; i < n; i++) {
+        if (i < keep) {
+            uint32 cur = (ip->flags & INODE_F_SHARED) ? inode_locate_block(ip, bn + i, false) : 0;
+            if (cur == 0 || !refcnt_shared(cur)) {
+                continue;
+            }
+        }
+        uint32 block_num = inode_unmap_block(ip, bn + i);
+        if (block_num != 0) {
+            bitmap_free_batch_add(&batch, block_num);
+            freed = true;
+        }
+    }
+    if (freed) {
+        bitmap_free_batch_flush(&batch);
+        inode_map_reset(ip);
+    }
+
+    // 2. 分配缺少的块
+    if (keep > 0) {
+        inode_alloc_range(ip, bn, keep);
+    }
+    for (uint32 i = 0; i < keep; i++) {
+        blocks[i] = inode_locate_block(ip, bn + i, false);
+    }
+}
+
+/**
+ * @brief 辅助函数：从第bn个数据块开始，统计磁盘上连续存放的数据块数量（构成一个cluster）
+ * @param ip 内存inode指针
+ * @param bn 起始数据块序号
+ * @param first 第bn个数据块的磁盘编号
+ * @param max 最多统计的块数（不超过BUF_CLUSTER）
+ * @param alloc 后续数据块不存在时是否创建
+ * @return 连续数据块的数量（至少为1）
+ */
+static uint32 inode_cluster_len(inode_t* ip, uint32 bn, uint32 first, uint32 max, bool alloc)
+{
+    uint32 n = 1;
+    if (max > BUF_CLUSTER) {
+        max = BUF_CLUSTER;
+    }
+    while (n < max && inode_locate_block(ip, bn + n, alloc) == first + n) {
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief 辅助函数：经过buf cache读取数据块中的数据（目录, 或页缓存没有可替换的页时的普通文件）
+ * @param ip 内存inode指针（调用者持有睡眠锁, 不是内联数据）
+ * @param offset 读取起始偏移量（字节）
+ * @param len 读取字节数（调用者已截断到文件末尾）
+ * @param dst 目标缓冲区指针
+ * @param user true=用户态缓冲区，false=内核态缓冲区
+ * @return 实际读取的字节数
+ */
+static uint32 inode_read_blocks(inode_t* ip, uint32 offset, uint32 len, void* dst, bool user)
+{
+    uint32 total_read = 0;
+    uint32 block_num, block_offset, read_len;
+    buf_t* bufs[BUF_CLUSTER];
+
+    // 循环读取数据，直到完成
+    while (total_read < len) {
+        // 1. 计算当前数据块编号和块内偏移（只查找, 不分配）
+        uint32 bn = offset / BLOCK_SIZE;
+        block_num = inode_locate_block(ip, bn, false);
+        block_offset = offset % BLOCK_SIZE;
+
+        // 2. 空洞（稀疏文件中未写过的块）: 读出全0, 不分配磁盘块
+        if (block_num == 0) {
+            read_len = BLOCK_SIZE - block_offset;
+            if (read_len > len - total_read) {
+                read_len = len - total_read;
+            }
+            if (user) {
+                uvm_copyout(myproc()->mm->pgtbl, (uint64)dst + total_read, (uint64)zero_block, read_len);
+            } else {
+                memset((char*)dst + total_read, 0, read_len);
+            }
+            total_read += read_len;
+            offset += read_len;
+            continue;
+        }
+
+        // 3. 剩余数据覆盖的数据块中, 磁盘上连续的部分作为一个cluster一次读入
+        uint32 n_blocks = (block_offset + (len - total_read) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        uint32 n = inode_cluster_len(ip, bn, block_num, n_blocks, false);
+        buf_read_cluster(block_num, n, bufs);
+
+        for (uint32 i = 0; i < n; i++) {
+            // 3.1 计算本次可读取的字节数
+            read_len = BLOCK_SIZE - block_offset;
+            if (read_len > len - total_read) {
+                read_len = len - total_read;
+            }
+
+            // 3.2 复制数据到目标缓冲区（区分用户态/内核态）
+            if (user) {
+                // 用户态缓冲区：通过虚拟内存拷贝（uvm_copyout）
+                uvm_copyout(myproc()->mm->pgtbl, (uint64)dst + total_read,
+                           (uint64)(bufs[i]->data + block_offset), read_len);
+            } else {
+                // 内核态缓冲区：直接内存拷贝
+                memmove((char*)dst + total_read, bufs[i]->data + block_offset, read_len);
+            }
+
+            // 3.3 释放缓冲区，更新统计信息
+            buf_release(bufs[i]);
+            total_read += read_len;
+            offset += read_len;
+            block_offset = 0;
+        }
+    }
+
+    return total_read;
+}
+
+/**
+ * @brief 从inode中读取数据
+ * @param ip 内存inode指针
+ * @param offset 读取起始偏移量（字节）
+ * @param len 读取字节数
+ * @param dst 目标缓冲区指针
+ * @param user true=用户态缓冲区，false=内核态缓冲区
+ * @return 实际读取的字节数
+ * @note 调用者必须持有inode睡眠锁
+ */
+uint32 inode_read_data(inode_t* ip, uint32 offset, uint32 len, void* dst, bool user)
+{
+    assert(sleeplock_holding_any(&ip->slk), "inode_read_data: not holding inode sleeplock");
+    assert(dst != NULL, "inode_read_data: invalid NULL dst pointer");
+
+    // 1. 边界检查：偏移量超出文件大小，返回0
+    if (offset > ip->size) {
+        return 0;
+    }
+
+    // 2. 调整读取长度：避免超出文件末尾
+    if (offset + len > ip->size) {
+        len = ip->size - offset;
+    }
+
+    // 2.5 内联数据直接从inode中拷贝, 不读数据块
+    if (ip->flags & INODE_F_INLINE) {
+        uint8* data = (uint8*)ip->addrs + offset;
+        if (user) {
+            uvm_copyout(myproc()->mm->pgtbl, (uint64)dst, (uint64)data, len);
+        } else {
+            memmove(dst, data, len);
+        }
+        return len;
+    }
+
+    // 2.6 尾块打包的小文件从共享的尾块中读取（容量总是覆盖文件大小）
+    if (ip->flags & INODE_F_TAIL) {
+        tail_rw(TAIL_LOC(ip), offset, len, dst, user, false);
+        return len;
+    }
+
+    // 3. 目录经过buf cache; 普通文件经过页缓存, 页缓存没有可替换的页时这一页改走buf cache（压缩文件经过临时页解压）
+    if (ip->type != FT_FILE) {
+        return inode_read_blocks(ip, offset, len, dst, user);
+    }
+    uint32 total_read = 0;
+    while (total_read < len) {
+        total_read += pcache_read(ip, offset + total_read, len - total_read, (uint64)dst + total_read, user);
+        if (total_read < len) {
+            uint32 n = PGSIZE - (offset + total_read) % PGSIZE;
+            if (n > len - total_read) n = len - total_read;
+            if (ip->flags & INODE_F_COMPRESS) {
+                total_read += comp_rw(ip, offset + total_read, n, (char*)dst + total_read, user, false);
+            } else {
+                total_read += inode_read_blocks(ip, offset + total_read, n, (char*)dst + total_read, user);
+            }
+        }
+    }
+
+    // 4. 返回实际读取的字节数
+    return total_read;
+}
+
+/**
+ * @brief 预读inode管理的从第bn个数据块开始的count个数据块
+ * @param ip 内存inode指针
+ * @param bn 起始数据块序号（从0开始）
+ * @param count 预读的数据块数量
+ * @note 调用者必须持有inode的睡眠锁；只预读文件大小范围内已分配的块；
+ *       普通文件把覆盖这些块的页成批读入页缓存, 目录异步预读进buf cache（磁盘队列已满或没有空闲buf时提前停止）
+ */
+void inode_readahead(inode_t* ip, uint32 bn, uint32 count)
+{
+    assert(sleeplock_holding_any(&ip->slk), "inode_readahead: not holding inode sleeplock");
+
+    // 1. 截断到文件末尾（内联数据和尾块打包的文件没有自己的数据块）
+    if (ip->flags & INODE_F_PACKED) {
+        return;
+    }
+    uint32 n_blocks = (ip->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (bn >= n_blocks) {
+        return;
+    }
+    if (count > n_blocks - bn) {
+        count = n_blocks - bn;
+    }
+
+    // 1.5 普通文件: 预读覆盖这些块的页
+    if (ip->type == FT_FILE) {
+        uint32 first = bn / PCACHE_BLOCKS;
+        pcache_readahead(ip, first, (bn + count - 1) / PCACHE_BLOCKS + 1 - first);
+        return;
+    }
+
+    // 2. 逐块提交预读请求（不分配新块）
+    for (uint32 i = 0; i < count; i++) {
+        uint32 block_num = inode_locate_block(ip, bn + i, false);
+        if (block_num == 0) {
+            continue;
+        }
+        if (!buf_prefetch(block_num)) {
+            break;
+        }
+    }
+
+    // 3. 预读请求在块设备队列中合并后统一派发
+    blk_unplug();
+}
+
+/**
+ * @brief 辅助函数：经过buf cache向数据块写入数据（目录、内联数据迁移, 或页缓存没有可替换的页时的普通文件）
+ * @param ip 内存inode指针（调用者独占持有睡眠锁, 不是内联数据）
+ * @param offset 写入起始偏移量（字节）
+ * @param len 写入字节数
+ * @param src 源缓冲区指针
+ * @param user true=用户态缓冲区，false=内核态缓冲区
+ * @return 实际写入的字节数
+ */
+static uint32 inode_write_blocks(inode_t* ip, uint32 offset, uint32 len, void* src, bool user)
+{
+    uint32 total_written = 0;
+    uint32 block_num, block_offset, write_len;
+    buf_t* bufs[BUF_CLUSTER];
+
+    // 循环写入数据，直到完成
     while (total_written < len) {
-        // 3.1 计算当前数据块编号和块内偏移
-        block_num = inode_locate_block(ip, offset / BLOCK_SIZE);
+        // 1. 计算当前数据块编号和块内偏移
+        uint32 bn = offset / BLOCK_SIZE;
+        block_num = inode_locate_block(ip, bn, true);
         block_offset = offset % BLOCK_SIZE;
 
-        // 3.2 计算本次可写入的字节数
+        // 2. 对齐的整块覆盖: 磁盘上连续的数据块作为一个cluster, 不读旧内容, 一次写出
+        uint32 n_full = (block_offset == 0) ? (len - total_written) / BLOCK_SIZE : 0;
+        if (n_full >= 2) {
+            uint32 n = inode_cluster_len(ip, bn, block_num, n_full, true);
+            for (uint32 i = 0; i < n; i++) {
+                bufs[i] = buf_get_nofill(block_num + i);
+                if (user) {
+                    uvm_copyin(myproc()->mm->pgtbl, (uint64)bufs[i]->data,
+                              (uint64)src + total_written + i * BLOCK_SIZE, BLOCK_SIZE);
+                } else {
+                    memmove(bufs[i]->data, (char*)src + total_written + i * BLOCK_SIZE, BLOCK_SIZE);
+                }
+            }
+            buf_write_cluster(bufs, n);
+            for (uint32 i = 0; i < n; i++) {
+                buf_release(bufs[i]);
+            }
+            total_written += n * BLOCK_SIZE;
+            offset += n * BLOCK_SIZE;
+            continue;
+        }
+
+        // 3. 计算本次可写入的字节数
         write_len = BLOCK_SIZE - block_offset;
         if (write_len > len - total_written) {
             write_len = len - total_written;
         }
 
-        // 3.3 读取数据块到缓冲区
-        buf_t* buf = buf_read(block_num);
+        // 4. 读取数据块到缓冲区（整块覆盖时旧内容会被丢弃, 不需要从磁盘读取）
+        buf_t* buf;
+        if (block_offset == 0 && write_len == BLOCK_SIZE) {
+            buf = buf_get_nofill(block_num);
+        } else {
+            buf = buf_read(block_num);
+        }
 
-        // 3.4 复制数据到缓冲区（区分用户态/内核态）
+        // 5. 复制数据到缓冲区（区分用户态/内核态）
         if (user) {
             // 用户态缓冲区：通过虚拟内存拷贝（uvm_copyin）
-            uvm_copyin(myproc()->pgtbl, (uint64)(buf->data + block_offset),
+            uvm_copyin(myproc()->mm->pgtbl, (uint64)(buf->data + block_offset),
                       (uint64)src + total_written, write_len);
         } else {
             // 内核态缓冲区：直接内存拷贝
             memmove(buf->data + block_offset, (char*)src + total_written, write_len);
         }
 
-        // 3.5 强制写入磁盘，释放缓冲区
-        buf_write(buf);
+        // 6. 写入缓冲区（目录块是元数据, 记录日志）, 释放缓冲区
+        if (ip->type == FT_DIR) {
+            journal_log(buf);
+        } else {
+            buf_write(buf);
+        }
         buf_release(buf);
 
-        // 3.6 更新统计信息
+        // 7. 更新统计信息
         total_written += write_len;
         offset += write_len;
     }
 
-    // 4. 更新inode文件大小（若写入超出原有大小）
+    // 更新inode文件大小（若写入超出原有大小, 元数据只标记dirty）
     if (offset > ip->size) {
         ip->size = offset;
+        ip->dirty = true;
     }
 
-    // 5. 将更新后的inode元数据写入磁盘
-    inode_rw(ip, true);
+    return total_written;
+}
+
+/**
+ * @brief 辅助函数：把内联数据迁移到数据块（文件增长到放不下时调用）
+ * @param ip 内存inode指针（内联数据）
+ * @note 迁移后addrs恢复为块指针, inode标记为dirty
+ */
+static void inode_inline_migrate(inode_t* ip)
+{
+    uint8 data[INODE_INLINE_MAX];
+    uint32 size = ip->size;
+
+    memmove(data, ip->addrs, size);
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->flags &= ~INODE_F_INLINE;
+    inode_map_reset(ip);
+    ip->size = 0;
+    ip->dirty = true;
+
+    // 内联文件的缓存页（如果有）与数据一致或更新（映射者的修改）, 数据直接写进数据块
+    if (size > 0) {
+        inode_write_blocks(ip, 0, size, data, false);
+    }
+}
+
+/**
+ * @brief 辅助函数：为尾块打包的文件选择单位数（增长时按倍数预留, 减少重新分配）
+ * @param ip 内存inode指针（尾块打包）
+ * @param need 至少需要的单位数
+ */
+static uint32 inode_tail_units(inode_t* ip, uint32 need)
+{
+    uint32 units = (ip->flags & INODE_F_TAIL) ? TAIL_LOC(ip)->units * 2 : need;
+    if (units < need) units = need;
+    if (units > TAIL_UNITS_FOR(TAIL_FILE_MAX)) units = TAIL_UNITS_FOR(TAIL_FILE_MAX);
+    return units;
+}
+
+/**
+ * @brief 辅助函数：把内联数据搬进尾块（文件增长到内联区放不下、但不超过TAIL_FILE_MAX时调用）
+ * @param ip 内存inode指针（内联数据的普通文件）
+ * @param size 即将写到的文件大小（决定分配的单位数）
+ */
+static void inode_inline_to_tail(inode_t* ip, uint32 size)
+{
+    uint8 data[INODE_INLINE_MAX];
+    uint32 old = ip->size;
+
+    memmove(data, ip->addrs, old);
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->flags = (ip->flags & ~INODE_F_INLINE) | INODE_F_TAIL;
+    tail_alloc(ip->inode_num, inode_tail_units(ip, TAIL_UNITS_FOR(size)), TAIL_LOC(ip));
+    if (old > 0) {
+        tail_rw(TAIL_LOC(ip), 0, old, data, false, true);
+    }
+    ip->dirty = true;
+}
+
+/**
+ * @brief 辅助函数：把尾块中的内容迁移到数据块（文件增长超过TAIL_FILE_MAX, 或需要真正的数据块时调用）
+ * @param ip 内存inode指针（尾块打包）
+ * @note 内容经过一个小缓冲区分段复制; 迁移后addrs恢复为块指针, 释放尾块中的单位
+ */
+static void inode_tail_migrate(inode_t* ip)
+{
+    tail_loc_t loc = *TAIL_LOC(ip);
+    uint32 size = ip->size;
+    uint8 chunk[TAIL_UNIT * 2];
+
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->flags &= ~INODE_F_TAIL;
+    inode_map_reset(ip);
+    ip->size = 0;
+    ip->dirty = true;
+
+    for (uint32 off = 0; off < size; off += sizeof(chunk)) {
+        uint32 n = size - off < sizeof(chunk) ? size - off : sizeof(chunk);
+        tail_rw(&loc, off, n, chunk, false, false);
+        inode_write_blocks(ip, off, n, chunk, false);
+    }
+    tail_free(ip->inode_num, &loc);
+}
+
+/**
+ * @brief 辅助函数：内联或尾块打包的文件迁移到数据块
+ */
+static void inode_unpack(inode_t* ip)
+{
+    if (ip->flags & INODE_F_INLINE) {
+        inode_inline_migrate(ip);
+    } else if (ip->flags & INODE_F_TAIL) {
+        inode_tail_migrate(ip);
+    }
+}
+
+/**
+ * @brief 向inode中写入数据（可能扩展数据块）
+ * @param ip 内存inode指针
+ * @param offset 写入起始偏移量（字节）
+ * @param len 写入字节数
+ * @param src 源缓冲区指针
+ * @param user true=用户态缓冲区，false=内核态缓冲区
+ * @return 实际写入的字节数
+ * @note 调用者必须持有inode睡眠锁
+ */
+uint32 inode_write_data(inode_t* ip, uint32 offset, uint32 len, void* src, bool user)
+{
+    assert(sleeplock_holding(&ip->slk), "inode_write_data: not holding inode sleeplock");
+    assert(src != NULL, "inode_write_data: invalid NULL src pointer");
+
+    // 1. 边界检查：偏移量超出最大限制，返回0
+    if (offset > INODE_MAXSIZE) {
+        return 0;
+    }
+
+    // 2. 边界检查：写入后超出最大限制，返回0
+    if (offset + len > INODE_MAXSIZE) {
+        return 0;
+    }
+
+    // 2.5 内联数据: 写入后仍然放得下则直接写进inode, 否则先迁移到数据块
+    if (ip->flags & INODE_F_INLINE) {
+        if (offset + len <= INODE_INLINE_MAX) {
+            uint8* data = (uint8*)ip->addrs + offset;
+            if (user) {
+                uvm_copyin(myproc()->mm->pgtbl, (uint64)data, (uint64)src, len);
+            } else {
+                memmove(data, src, len);
+            }
+            if (offset + len > ip->size) {
+                ip->size = offset + len;
+            }
+            ip->dirty = true;
+            // 内联数据不经过页缓存: 同步映射者共享的缓存页
+            pcache_update(ip->inode_num, offset, (uint64)src, len, user);
+            return len;
+        }
+        if (offset + len <= TAIL_FILE_MAX) {
+            inode_inline_to_tail(ip, offset + len);
+        } else {
+            inode_inline_migrate(ip);
+        }
+    }
+
+    // 2.6 尾块打包: 写入后不超过TAIL_FILE_MAX则写进尾块（容量不够时扩大）, 否则先迁移到数据块
+    if (ip->flags & INODE_F_TAIL) {
+        if (offset + len <= TAIL_FILE_MAX) {
+            tail_loc_t* loc = TAIL_LOC(ip);
+            if (offset + len > TAIL_CAPACITY(loc)) {
+                tail_grow(ip->inode_num, loc, inode_tail_units(ip, TAIL_UNITS_FOR(offset + len)), ip->size);
+            }
+            tail_rw(loc, offset, len, src, user, true);
+            if (offset + len > ip->size) {
+                ip->size = offset + len;
+            }
+            ip->dirty = true;
+            // 同内联数据, 不经过页缓存
+            pcache_update(ip->inode_num, offset, (uint64)src, len, user);
+            return len;
+        }
+        inode_tail_migrate(ip);
+    }
+
+    // 3. 目录经过buf cache: 按写入范围成段分配数据块, 让目录在磁盘上尽量连续（之后可以按cluster读写）
+    if (ip->type != FT_FILE) {
+        if (len > 0) {
+            uint32 first = offset / BLOCK_SIZE;
+            inode_alloc_range(ip, first, (offset + len + BLOCK_SIZE - 1) / BLOCK_SIZE - first);
+        }
+        return inode_write_blocks(ip, offset, len, src, user);
+    }
+
+    // 4. 普通文件经过页缓存, 延迟分配: 数据块等到写回时按最终的dirty范围成段分配
+    //    页缓存被dirty页占满时先写回本文件的页腾出空间, 仍然没有可替换的页时这一页改走buf cache（立即分配）
+    //    压缩文件的这一页经过临时页读改写, 立即压缩写回
+    uint32 total_written = 0;
+    bool synced = false;
+    while (total_written < len) {
+        total_written += pcache_write(ip, offset + total_written, len - total_written, (uint64)src + total_written, user);
+        if (total_written < len && !synced) {
+            pcache_fsync(ip);
+            synced = true;
+            continue;
+        }
+        if (total_written < len) {
+            uint32 bn = (offset + total_written) / BLOCK_SIZE;
+            uint32 n = PGSIZE - (offset + total_written) % PGSIZE;
+            if (n > len - total_written) n = len - total_written;
+            if (ip->flags & INODE_F_COMPRESS) {
+                total_written += comp_rw(ip, offset + total_written, n, (char*)src + total_written, user, true);
+                continue;
+            }
+            inode_alloc_range(ip, bn, (offset + total_written + n + BLOCK_SIZE - 1) / BLOCK_SIZE - bn);
+            total_written += inode_write_blocks(ip, offset + total_written, n, (char*)src + total_written, user);
+        }
+    }
+
+    // 5. 元数据只标记dirty, 由inode_flush在最后一个引用释放或sync时写回
+    //    连续的小追加只在内存中更新size, 不会每次都重写inode表块
 
     // 6. 返回实际写入的字节数
     return total_written;
 }
 
+/**
+ * @brief 直接I/O: 在磁盘和用户页之间传输整块数据, 不经过buf cache
+ * @param ip 内存inode指针（读: 至少共享持有睡眠锁; 写: 独占持有）
+ * @param offset 文件偏移（BLOCK_SIZE的整数倍）
+ * @param len 字节数（BLOCK_SIZE的整数倍）
+ * @param uaddr 当前进程的用户缓冲区地址（512字节对齐）
+ * @param write true=写文件, false=读文件
+ * @return 实际传输的字节数（遇到无效的用户页时提前结束）
+ * @note 磁盘上连续的数据块和它们的用户页组成一个scatter-gather请求（最多VIRTIO_MAX_SG段）;
+ *       读: 空洞直接给用户清零; 写: 先用inode_alloc_range成段分配整个范围, 内联/尾块打包的数据先迁移
+ */
+uint32 inode_direct_rw(inode_t* ip, uint32 offset, uint32 len, uint64 uaddr, bool write)
+{
+    assert(sleeplock_holding_any(&ip->slk), "inode_direct_rw: not holding inode sleeplock");
+    assert(offset % BLOCK_SIZE == 0 && len % BLOCK_SIZE == 0 && uaddr % 512 == 0,
+           "inode_direct_rw: unaligned transfer");
+
+    pgtbl_t pgtbl = myproc()->mm->pgtbl;
+    uint32 bn = offset / BLOCK_SIZE;
+    uint32 nblocks = len / BLOCK_SIZE;
+    uint32 done = 0;
+    bool bad = false;
+
+    // 1. 写: 检查大小上限, 预先分配整个范围（尽量连续, 这样一个请求能覆盖更多的块）
+    if (write) {
+        assert(sleeplock_holding(&ip->slk), "inode_direct_rw: write without exclusive inode lock");
+        if (offset + len > INODE_MAXSIZE) {
+            return 0;
+        }
+        inode_unpack(ip);
+        inode_alloc_range(ip, bn, nblocks);
+    }
+
+    // 1.5 读: 页缓存中这个范围的修改先写回磁盘
+    if (!write) {
+        pcache_flush(ip->inode_num, offset / PGSIZE, (offset + len + PGSIZE - 1) / PGSIZE - offset / PGSIZE);
+    }
+
+    while (done < nblocks && !bad) {
+        uint32 first = inode_locate_block(ip, bn + done, false);
+
+        // 2. 空洞（只有读会遇到）: 延迟分配的数据还在页缓存中, 真正的空洞给用户缓冲区清零
+        if (first == 0) {
+            if (!pcache_read_cached(ip->inode_num, (bn + done) * BLOCK_SIZE, uaddr + done * BLOCK_SIZE)) {
+                uvm_copyout(pgtbl, uaddr + done * BLOCK_SIZE, (uint64)zero_block, BLOCK_SIZE);
+            }
+            done++;
+            continue;
+        }
+
+        // 3. 收集磁盘上连续的数据块, 每块的用户内存按页拆成段（物理相邻的段合并）
+        virtio_seg_t seg[VIRTIO_MAX_SG];
+        int nseg = 0;
+        uint32 n = 0;
+        while (done + n < nblocks && nseg + 2 <= VIRTIO_MAX_SG) {
+            if (n > 0 && inode_locate_block(ip, bn + done + n, false) != first + n) {
+                break;
+            }
+            // 一个块最多跨两个用户页: 先检查完整个块, 再把它的段追加进请求
+            uint64 va = uaddr + (done + n) * BLOCK_SIZE;
+            virtio_seg_t piece[2];
+            int npiece = 0;
+            for (uint32 left = BLOCK_SIZE; left > 0; npiece++) {
+                pte_t* pte = vm_getpte(pgtbl, PG_ROUND_DOWN(va), false);
+                if (pte == NULL || (*pte & (PTE_V | PTE_U)) != (PTE_V | PTE_U) || (!write && !(*pte & PTE_W))) {
+                    bad = true;
+                    break;
+                }
+                uint32 chunk = PGSIZE - (va % PGSIZE);
+                if (chunk > left) chunk = left;
+                piece[npiece].addr = PTE_VA_TO_PA(*pte, va) + (va % PGSIZE);
+                piece[npiece].len = chunk;
+                va += chunk;
+                left -= chunk;
+            }
+            if (bad) {
+                break;
+            }
+            for (int i = 0; i < npiece; i++) {
+                if (nseg > 0 && seg[nseg - 1].addr + seg[nseg - 1].len == piece[i].addr) {
+                    seg[nseg - 1].len += piece[i].len;
+                } else {
+                    seg[nseg++] = piece[i];
+                }
+            }
+            n++;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        // 4. 处理buf cache中的副本, 然后一个请求完成传输
+        for (uint32 i = 0; i < n; i++) {
+            buf_direct_prepare(first + i, write);
+        }
+        blk_rw_sg((uint64)first * (BLOCK_SIZE / 512), seg, nseg, write);
+        done += n;
+    }
+
+    // 5. 写: 扩展文件大小（元数据只标记dirty）
+    if (write && offset + done * BLOCK_SIZE > ip->size) {
+        ip->size = offset + done * BLOCK_SIZE;
+        ip->dirty = true;
+    }
+    return done * BLOCK_SIZE;
+}
+
 /**
  * @brief 辅助函数：递归释放inode管理的数据块（包括元数据块）
  * @param block_num 数据块/元数据块编号
  * @param level 映射层级（0=数据块，1=二级元数据块，2=三级元数据块）
+ * @param batch 批量释放表（块号先收集起来, 按位图块合并更新）
  */
-static void data_free(uint32 block_num, uint32 level)
+static void data_free(uint32 block_num, uint32 level, bitmap_free_batch_t* batch)
 {
     assert(block_num != 0, "data_free: block_num is zero (invalid block)");
 
@@ -507,15 +1781,16 @@ static void data_free(uint32 block_num, uint32 level)
     buf_t* buf = buf_read(block_num);
     for (uint32* addr = (uint32*)buf->data; addr < (uint32*)(buf->data + BLOCK_SIZE); addr++) {
         if (*addr == 0) {
-            break; // 无更多下级块，退出循环
+            continue; // 空洞（稀疏文件中间可能有未分配的块）, 继续检查后面的地址项
         }
-        data_free(*addr, level - 1); // 递归释放下一级
+        data_free(*addr, level - 1, batch); // 递归释放下一级
     }
     buf_release(buf); // 释放当前元数据块缓冲区
+    proc_cond_resched(); // 大文件有成千上万个块: 每个元数据块之后是一个抢占点
 
 ret:
-    // 3. 释放当前块（位图层面回收）
-    bitmap_free_block(block_num);
+    // 3. 释放当前块（加入批量释放表, 位图层面稍后统一回收）
+    bitmap_free_batch_add(batch, block_num);
     return;
 }
 
@@ -528,10 +1803,31 @@ void inode_free_data(inode_t* ip)
 {
     assert(sleeplock_holding(&ip->slk), "inode_free_data: not holding inode sleeplock");
 
+    // 文件的缓存页不再对应任何数据（inode_num可能很快被复用）
+    pcache_truncate(ip->inode_num, 0);
+
+    bitmap_free_batch_t batch;
+    batch.n = 0;
+
+    // 0. 内联数据没有数据块; 尾块打包: 释放尾块中的单位; extent映射的inode: 释放extent树, 跳过块指针的处理
+    if (ip->flags & INODE_F_INLINE) {
+        memset(ip->addrs, 0, sizeof(ip->addrs));
+        goto done;
+    }
+    if (ip->flags & INODE_F_TAIL) {
+        tail_free(ip->inode_num, TAIL_LOC(ip));
+        ip->flags = (ip->flags & ~INODE_F_TAIL) | INODE_F_INLINE;
+        goto done;
+    }
+    if (ip->flags & INODE_F_EXTENT) {
+        extent_free(ip, &batch);
+        goto done;
+    }
+
     // 1. 释放一级映射数据块（层级0）
     for (int i = 0; i < N_ADDRS_1; i++) {
         if (ip->addrs[i] != 0) {
-            data_free(ip->addrs[i], 0);
+            data_free(ip->addrs[i], 0, &batch);
             ip->addrs[i] = 0; // 清空地址项
         }
     }
@@ -539,7 +1835,7 @@ void inode_free_data(inode_t* ip)
     // 2. 释放二级映射数据块（层级1）
     for (int i = 0; i < N_ADDRS_2; i++) {
         if (ip->addrs[N_ADDRS_1 + i] != 0) {
-            data_free(ip->addrs[N_ADDRS_1 + i], 1);
+            data_free(ip->addrs[N_ADDRS_1 + i], 1, &batch);
             ip->addrs[N_ADDRS_1 + i] = 0; // 清空地址项
         }
     }
@@ -547,16 +1843,288 @@ void inode_free_data(inode_t* ip)
     // 3. 释放三级映射数据块（层级2）
     for (int i = 0; i < N_ADDRS_3; i++) {
         if (ip->addrs[N_ADDRS_1 + N_ADDRS_2 + i] != 0) {
-            data_free(ip->addrs[N_ADDRS_1 + N_ADDRS_2 + i], 2);
+            data_free(ip->addrs[N_ADDRS_1 + N_ADDRS_2 + i], 2, &batch);
             ip->addrs[N_ADDRS_1 + N_ADDRS_2 + i] = 0; // 清空地址项
         }
     }
 
-    // 4. 重置文件大小，同步到磁盘
+done:
+    // 4. 提交剩余的批量释放, 已释放块的映射不再有效
+    bitmap_free_batch_flush(&batch);
+    inode_map_reset(ip);
+
+    // 5. 重置文件大小，同步到磁盘
     ip->size = 0;
     inode_rw(ip, true);
 }
 
+/**
+ * @brief 辅助函数：释放一棵映射子树中数据块序号 >= keep 的部分
+ * @param entry 子树根的地址项
+ * @param base 子树覆盖的第一个数据块序号
+ * @param span 子树覆盖的数据块数
+ * @param level 映射层级（0=数据块，1=二级元数据块，2=三级元数据块）
+ * @param keep 保留[0, keep)
+ * @param batch 批量释放表
+ * @return 地址项*entry是否被清零
+ */
+static bool data_truncate(uint32* entry, uint32 base, uint32 span, uint32 level, uint32 keep,
+                          bitmap_free_batch_t* batch)
+{
+    // 1. 空的地址项, 或整棵子树都在保留范围内
+    if (*entry == 0 || base + span <= keep) {
+        return false;
+    }
+
+    // 2. 整棵子树都在keep之后: 全部释放
+    if (base >= keep) {
+        data_free(*entry, level, batch);
+        *entry = 0;
+        return true;
+    }
+
+    // 3. 子树跨越keep: 递归截断下一级, 有地址项清零时写回索引块
+    buf_t* buf = buf_read(*entry);
+    uint32* next = (uint32*)buf->data;
+    uint32 child = span / ENTRY_PER_BLOCK;
+    bool changed = false;
+    for (uint32 j = 0; j < ENTRY_PER_BLOCK; j++) {
+        if (data_truncate(&next[j], base + j * child, child, level - 1, keep, batch)) {
+            changed = true;
+        }
+    }
+    if (changed) {
+        journal_log(buf);
+    }
+    buf_release(buf);
+    return false;
+}
+
+/**
+ * @brief 把文件截断（或扩展）到size字节
+ * @param ip 内存inode指针
+ * @param size 新的文件大小
+ * @note 调用者必须持有inode睡眠锁; 扩展时不分配数据块（新的部分是空洞）;
+ *       缩小时释放size之后的数据块和变空的索引块, 并清零最后一个块中size之后的部分
+ */
+void inode_truncate(inode_t* ip, uint32 size)
+{
+    assert(sleeplock_holding(&ip->slk), "inode_truncate: not holding inode sleeplock");
+
+    if (size < ip->size) {
+        pcache_truncate(ip->inode_num, size);
+    }
+
+    // 1. 扩展: 只修改size（尾块打包的文件超出容量时扩大, 超出TAIL_FILE_MAX时迁移到数据块）
+    if (size >= ip->size) {
+        if ((ip->flags & INODE_F_TAIL) && size > TAIL_CAPACITY(TAIL_LOC(ip))) {
+            if (size <= TAIL_FILE_MAX) {
+                tail_grow(ip->inode_num, TAIL_LOC(ip), inode_tail_units(ip, TAIL_UNITS_FOR(size)), ip->size);
+            } else {
+                inode_tail_migrate(ip);
+            }
+        }
+        ip->size = size;
+        ip->dirty = true;
+        return;
+    }
+
+    // 2. 内联数据: 清零被截掉的部分
+    if (ip->flags & INODE_F_INLINE) {
+        memset((uint8*)ip->addrs + size, 0, ip->size - size);
+        ip->size = size;
+        ip->dirty = true;
+        return;
+    }
+
+    // 2.5 尾块打包: 截断到0时释放尾块中的单位（回到空的内联文件）, 否则清零被截掉的部分
+    if (ip->flags & INODE_F_TAIL) {
+        if (size == 0) {
+            tail_free(ip->inode_num, TAIL_LOC(ip));
+            ip->flags = (ip->flags & ~INODE_F_TAIL) | INODE_F_INLINE;
+        } else {
+            tail_zero(TAIL_LOC(ip), size, ip->size - size);
+        }
+        ip->size = size;
+        ip->dirty = true;
+        return;
+    }
+
+    // 3. 释放[keep, ...)的数据块（压缩文件按cluster释放, 跨越size的cluster整个保留）
+    uint32 keep = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (ip->flags & INODE_F_COMPRESS) {
+        keep = (size + PGSIZE - 1) / PGSIZE * PCACHE_BLOCKS;
+    }
+    bitmap_free_batch_t batch;
+    batch.n = 0;
+    if (ip->flags & INODE_F_EXTENT) {
+        extent_truncate(ip, keep, &batch);
+    } else {
+        for (uint32 i = 0; i < N_ADDRS_1; i++) {
+            data_truncate(&ip->addrs[i], i, 1, 0, keep, &batch);
+        }
+        for (uint32 i = 0; i < N_ADDRS_2; i++) {
+            data_truncate(&ip->addrs[N_ADDRS_1 + i], N_ADDRS_1 + i * ENTRY_PER_BLOCK,
+                          ENTRY_PER_BLOCK, 1, keep, &batch);
+        }
+        for (uint32 i = 0; i < N_ADDRS_3; i++) {
+            data_truncate(&ip->addrs[N_ADDRS_1 + N_ADDRS_2 + i],
+                          N_ADDRS_1 + N_ADDRS_2 * ENTRY_PER_BLOCK + i * ENTRY_PER_BLOCK * ENTRY_PER_BLOCK,
+                          ENTRY_PER_BLOCK * ENTRY_PER_BLOCK, 2, keep, &batch);
+        }
+    }
+    bitmap_free_batch_flush(&batch);
+    inode_map_reset(ip);
+
+    // 4. 最后一个块中size之后的部分清零（之后再扩展时读出的是0）, 压缩文件重写跨越size的cluster
+    if (ip->flags & INODE_F_COMPRESS) {
+        comp_truncate(ip, size);
+    } else if (size % BLOCK_SIZE != 0) {
+        uint32 block_num = inode_locate_block(ip, size / BLOCK_SIZE, false);
+        if (block_num != 0 && (ip->flags & INODE_F_SHARED) && refcnt_shared(block_num)) {
+            block_num = inode_unshare_block(ip, size / BLOCK_SIZE, block_num);
+        }
+        if (block_num != 0) {
+            buf_t* buf = buf_read(block_num);
+            memset(buf->data + size % BLOCK_SIZE, 0, BLOCK_SIZE - size % BLOCK_SIZE);
+            buf_write(buf);
+            buf_release(buf);
+        }
+    }
+
+    // 5. 元数据只标记dirty
+    ip->size = size;
+    ip->dirty = true;
+}
+
+/**
+ * @brief 为[offset, offset + len)预先分配数据块（尽量连续）, 必要时扩展文件大小
+ * @param ip 内存inode指针
+ * @param offset 起始偏移量（字节）
+ * @param len 长度（字节）
+ * @return 成功返回0, 超出最大文件大小返回-1
+ * @note 调用者必须持有inode睡眠锁; 之后写入这个范围时不再经过分配器
+ */
+int inode_fallocate(inode_t* ip, uint32 offset, uint32 len)
+{
+    assert(sleeplock_holding(&ip->slk), "inode_fallocate: not holding inode sleeplock");
+
+    if (offset > INODE_MAXSIZE || len > INODE_MAXSIZE - offset) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    // 1. 内联/尾块打包的数据先迁移到数据块
+    inode_unpack(ip);
+
+    // 2. 成段分配（已分配的块保持不变）; 压缩文件的块在写回时按压缩后的大小分配, 只扩展文件大小
+    if (!(ip->flags & INODE_F_COMPRESS)) {
+        uint32 first = offset / BLOCK_SIZE;
+        inode_alloc_range(ip, first, (offset + len + BLOCK_SIZE - 1) / BLOCK_SIZE - first);
+    }
+
+    // 3. 扩展文件大小, 元数据只标记dirty
+    if (offset + len > ip->size) {
+        ip->size = offset + len;
+    }
+    ip->dirty = true;
+    return 0;
+}
+
+#define CLONE_TABLE_MAX 8  // inode_clone一段最多涉及的引用计数表块数 (加上索引块、位图块和inode表块不超过JOURNAL_OP_MAX)
+
+/**
+ * @brief reflink克隆的一段: dst映射到src的同一批数据块, 每块增加一个引用
+ * @param dst 新文件（调用者独占持有睡眠锁, 在日志操作中, 空的普通文件, 与src的压缩选项相同）
+ * @param src 源文件（调用者独占持有睡眠锁）
+ * @param bn 输入: 这一段开始的数据块序号（第一段为0）; 输出: 下一段开始的序号
+ * @return 全部完成返回0（dst的大小设为src的大小）, 还有剩余返回1, 失败返回-1
+ * @note 每段先写回src的dirty页（延迟分配的块分配出来, 压缩文件的页压缩写回）, 之后重新记录src缓存页的空洞,
+ *       共享块上的修改只在持有inode锁时经过写时复制写回;
+ *       一段不超过一个最后一级索引块覆盖的范围, 涉及的引用计数表块不超过CLONE_TABLE_MAX个, 一个日志操作放得下;
+ *       内联/尾块打包的源文件没有自己的数据块, 一次复制内容; extent映射的文件不支持
+ */
+int inode_clone(inode_t* dst, inode_t* src, uint32* bn)
+{
+    assert(sleeplock_holding(&dst->slk) && sleeplock_holding(&src->slk), "inode_clone: not holding inode sleeplock");
+    assert(dst->type == FT_FILE && src->type == FT_FILE, "inode_clone: not a regular file");
+
+    if ((src->flags | dst->flags) & INODE_F_EXTENT) {
+        return -1;
+    }
+    pcache_fsync(src);
+
+    // 1. 内联/尾块打包: 复制内容（不超过TAIL_FILE_MAX字节）
+    if (src->flags & INODE_F_PACKED) {
+        uint8* page = (uint8*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+        if (page == NULL) {
+            return -1;
+        }
+        uint32 n = inode_read_data(src, 0, src->size, page, false);
+        uint32 w = inode_write_data(dst, 0, n, page, false);
+        pmem_free((uint64)page, true);
+        return (w == n) ? 0 : -1;
+    }
+
+    // 2. 这一段的范围: 到当前最后一级索引块覆盖的范围末尾
+    inode_unpack(dst);
+    uint32 end = (src->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (src->flags & INODE_F_COMPRESS) {
+        end = (src->size + PGSIZE - 1) / PGSIZE * PCACHE_BLOCKS;
+    }
+    uint32 limit = N_ADDRS_1;
+    if (*bn >= N_ADDRS_1) {
+        limit = *bn - (*bn - N_ADDRS_1) % ENTRY_PER_BLOCK + ENTRY_PER_BLOCK;
+    }
+    if (limit > end) {
+        limit = end;
+    }
+
+    // 3. 逐块增加引用并映射（涉及的表块达到上限时提前结束这一段）
+    uint32 table[CLONE_TABLE_MAX];
+    uint32 ntable = 0;
+    bool shared = false;
+    for (; *bn < limit; (*bn)++) {
+        uint32 block_num = inode_locate_block(src, *bn, false);
+        if (block_num == 0) {
+            continue;
+        }
+        uint32 t = (block_num - sb.data_start) / REFCNT_PER_BLOCK;
+        uint32 k = 0;
+        while (k < ntable && table[k] != t) {
+            k++;
+        }
+        if (k == ntable) {
+            if (ntable == CLONE_TABLE_MAX) {
+                break;
+            }
+            table[ntable++] = t;
+        }
+        if (!refcnt_get(block_num)) {
+            return -1;
+        }
+        inode_map_block(dst, *bn, true, block_num);
+        shared = true;
+    }
+
+    // 4. 两个文件都标记为可能共享; src已缓存的页重新记录空洞
+    if (shared) {
+        src->flags |= INODE_F_SHARED;
+        dst->flags |= INODE_F_SHARED;
+        src->dirty = true;
+        dst->dirty = true;
+        pcache_remap(src);
+    }
+    if (*bn < end) {
+        return 1;
+    }
+    dst->size = src->size;
+    dst->dirty = true;
+    return 0;
+}
+
 // ---------------------- 调试辅助函数 ----------------------
 static char* inode_types[] = {
     "INODE_UNUSED",
@@ -0,0 +1,340 @@
+#include "fs/journal.h"
+#include "fs/fs.h"
+#include "fs/buf.h"
+#include "fs/bitmap.h"
+#include "dev/blk.h"
+#include "dev/vio.h"
+#include "dev/timer.h"
+#include "proc/cpu.h"
+#include "proc/proc.h"
+#include "lib/lock.h"
+#include "lib/print.h"
+#include "lib/klog.h"
+#include "lib/str.h"
+
+/*
+    元数据日志 (见fs/journal.h)
+    提交由最后一个结束的操作、fsync、或者后台工作线程定时调用的journal_flusher完成
+    提交期间不允许开始新的操作; 每个操作在journal_begin时预留JOURNAL_OP_MAX个日志块
+    进程的嵌套层数记录在proc->journal_depth, 只有最外层的begin/end参与计数
+*/
+
+extern super_block_t sb;
+
+#define JOURNAL_COMMIT_INTERVAL 30   // 事务最多等待多少个tick就提交 (约3s, 早于buf cache的定时写回)
+
+static struct {
+    spinlock_t lk;                   // 保护以下所有字段
+    bool on;                         // 日志区可用 (journal_init之后不再改变)
+    uint32 start;                    // 日志区起始块 (日志头)
+    uint32 outstanding;              // 进行中的最外层操作数
+    bool committing;                 // 正在提交 (提交期间journal_begin等待)
+    bool force;                      // 有调用者在等待当前事务提交 (最后一个操作结束时立即提交)
+    uint64 seq;                      // 已完成的提交次数 (等待者睡眠在&journal上)
+    uint64 last_commit;              // 上一次提交的tick
+    uint32 n;                        // 当前事务的块数
+    buf_t* bufs[JOURNAL_LOG_MAX];    // 当前事务的块 (logged, 各持有一个引用)
+    uint32 n_ckpt;                   // 上一个事务写进日志区的块数
+    uint32 ckpt[JOURNAL_LOG_MAX];    // 上一个事务的块 (覆盖日志区之前需要确认它们已写回原位置)
+} journal;
+
+// 提交时日志块内容的副本 (复制之后不再持有buf的睡眠锁) 和日志头
+static uint8 journal_data[JOURNAL_LOG_MAX * BLOCK_SIZE] __attribute__((aligned(PGSIZE)));
+static uint8 journal_head[BLOCK_SIZE] __attribute__((aligned(8)));
+
+// 日志块内容的校验和（FNV-1a, 按32位字计算）
+static uint32 journal_checksum(uint8* data, uint32 n)
+{
+    uint32* w = (uint32*)data;
+    uint32 sum = 2166136261u;
+    for (uint32 i = 0; i < n * BLOCK_SIZE / sizeof(uint32); i++) {
+        sum ^= w[i];
+        sum *= 16777619u;
+    }
+    return sum;
+}
+
+/**
+ * @brief 静态辅助函数：在日志区和内存之间直接传输连续的n个块（不经过buf cache, 一个磁盘请求）
+ * @param block_num 起始块号
+ * @param data 内核地址
+ * @param n 块数（每BUF_CLUSTER块一个数据段, 最多VIRTIO_MAX_SG段）
+ * @param write true=写磁盘
+ * @note buf cache中日志区的副本先作废（例如创建日志区时清零留下的dirty buf）, 之后不会再写到日志区
+ */
+static void journal_io(uint32 block_num, uint8* data, uint32 n, bool write)
+{
+    virtio_seg_t seg[VIRTIO_MAX_SG];
+    int nseg = 0;
+
+    for (uint32 i = 0; i < n; i += BUF_CLUSTER) {
+        uint32 len = (n - i < BUF_CLUSTER) ? n - i : BUF_CLUSTER;
+        assert(nseg < VIRTIO_MAX_SG, "journal_io: too many segments");
+        seg[nseg].addr = (uint64)data + i * BLOCK_SIZE;
+        seg[nseg].len = len * BLOCK_SIZE;
+        nseg++;
+    }
+    for (uint32 i = 0; i < n; i++) {
+        buf_direct_prepare(block_num + i, write);
+    }
+    blk_rw_sg((uint64)block_num * (BLOCK_SIZE / 512), seg, nseg, write);
+}
+
+/**
+ * @brief 重放日志中已提交的事务（挂载时, 读入超级块之后、bitmap_init之前调用）
+ * @note 日志头记录了n个块且校验和匹配: 把日志块复制到原位置并落盘, 之后清空日志头;
+ *       校验和不匹配说明崩溃发生在下一次提交写日志块的过程中, 日志头中的事务早已写回原位置, 直接丢弃
+ */
+void journal_recover()
+{
+    spinlock_init(&journal.lk, "journal");
+    if (sb.journal_magic != JOURNAL_MAGIC) {
+        return;
+    }
+
+    // 1. 读日志头
+    journal_header_t* hdr = (journal_header_t*)journal_head;
+    journal_io(sb.journal_start, journal_head, 1, false);
+    if (hdr->magic != JOURNAL_MAGIC || hdr->n == 0 || hdr->n > JOURNAL_LOG_MAX) {
+        return;
+    }
+
+    // 2. 读日志块并校验, 复制到原位置
+    journal_io(sb.journal_start + 1, journal_data, hdr->n, false);
+    if (journal_checksum(journal_data, hdr->n) == hdr->checksum) {
+        for (uint32 i = 0; i < hdr->n; i++) {
+            buf_t* buf = buf_get_nofill(hdr->blocks[i]);
+            memmove(buf->data, journal_data + i * BLOCK_SIZE, BLOCK_SIZE);
+            buf_write(buf);
+            buf_release(buf);
+        }
+        buf_sync();
+        klog("journal: replayed transaction %d (%d blocks)\n", hdr->seq, hdr->n);
+    } else {
+        printf("journal: discarded torn transaction %d\n", hdr->seq);
+    }
+
+    // 3. 清空日志头
+    hdr->n = 0;
+    journal_io(sb.journal_start, journal_head, 1, true);
+    blk_barrier();
+}
+
+/**
+ * @brief 启用日志（bitmap_init之后调用）
+ * @note 旧的磁盘镜像没有日志区: 在数据区中分配连续的JOURNAL_BLOCKS个块（已清零, 日志头为空）,
+ *       记录进超级块; 找不到足够长的空闲串时不使用日志, 元数据照常直接写回
+ */
+void journal_init()
+{
+    // 1. 没有日志区则创建
+    if (sb.journal_magic != JOURNAL_MAGIC) {
+        uint32 n = JOURNAL_BLOCKS;
+        uint32 start = bitmap_alloc_extent(sb.data_start, &n);
+        if (n < JOURNAL_BLOCKS) {
+            for (uint32 i = 0; i < n; i++) {
+                bitmap_free_block(start + i);
+            }
+            printf("journal: no room for %d contiguous blocks, running without a journal\n", JOURNAL_BLOCKS);
+            return;
+        }
+        sb.journal_magic = JOURNAL_MAGIC;
+        sb.journal_start = start;
+        sb.journal_blocks = JOURNAL_BLOCKS;
+        fs_write_super();
+        buf_sync();
+        klog("journal: created at block %d (%d blocks)\n", start, JOURNAL_BLOCKS);
+    }
+
+    // 2. 启用
+    journal.start = sb.journal_start;
+    journal.last_commit = timer_get_ticks();
+    journal.on = true;
+}
+
+/**
+ * @brief 静态辅助函数：提交当前事务
+ * @note 调用者持有journal.lk, 且没有进行中的操作、没有正在进行的提交; 返回时仍持有journal.lk
+ *       1. 检查点: 上一个事务中仍然dirty的块写回原位置（之后才能覆盖日志区）
+ *       2. 复制事务中的块（被直接I/O作废的块不记录）
+ *       3. 日志块一次顺序写入, 写屏障, 写日志头（提交点）, 写屏障
+ *       4. 这些块变回普通dirty buf, 由buf cache异步写回原位置
+ */
+static void journal_commit()
+{
+    journal.committing = true;
+    uint32 n = journal.n;
+    spinlock_release(&journal.lk);
+
+    if (n > 0) {
+        // 1. 检查点
+        if (journal.n_ckpt > 0) {
+            buf_checkpoint(journal.ckpt, journal.n_ckpt);
+        }
+
+        // 2. 复制
+        journal_header_t* hdr = (journal_header_t*)journal_head;
+        uint32 m = 0;
+        for (uint32 i = 0; i < n; i++) {
+            buf_t* buf = journal.bufs[i];
+            buf_pinned_lock(buf);
+            if (buf->valid) {
+                memmove(journal_data + m * BLOCK_SIZE, buf->data, BLOCK_SIZE);
+                hdr->blocks[m++] = buf->block_num;
+            }
+            buf_pinned_unlock(buf);
+        }
+
+        // 3. 写日志
+        if (m > 0) {
+            journal_io(journal.start + 1, journal_data, m, true);
+            blk_barrier();
+            hdr->magic = JOURNAL_MAGIC;
+            hdr->seq = journal.seq + 1;
+            hdr->n = m;
+            hdr->checksum = journal_checksum(journal_data, m);
+            journal_io(journal.start, journal_head, 1, true);
+            blk_barrier();
+        }
+
+        // 4. 交给buf cache写回原位置
+        for (uint32 i = 0; i < n; i++) {
+            buf_log_done(journal.bufs[i]);
+        }
+        memmove(journal.ckpt, hdr->blocks, m * sizeof(uint32));
+        journal.n_ckpt = m;
+    }
+
+    spinlock_acquire(&journal.lk);
+    journal.n = 0;
+    journal.committing = false;
+    journal.force = false;
+    journal.seq++;
+    journal.last_commit = timer_get_ticks();
+    proc_wakeup(&journal);
+}
+
+/**
+ * @brief 开始一个修改元数据的操作
+ * @note 必须在获取任何inode锁之前调用: 这里可能睡眠等待提交, 而提交要等所有进行中的操作结束;
+ *       嵌套调用只增加当前进程的层数; 事务剩余空间不够预留JOURNAL_OP_MAX块时等待
+ */
+void journal_begin()
+{
+    proc_t* p = myproc();
+    if (p == NULL || p->journal_depth++ > 0 || !journal.on) {
+        return;
+    }
+
+    spinlock_acquire(&journal.lk);
+    while (journal.committing ||
+           journal.n + (journal.outstanding + 1) * JOURNAL_OP_MAX > JOURNAL_LOG_MAX) {
+        proc_sleep(&journal, &journal.lk);
+    }
+    journal.outstanding++;
+    spinlock_release(&journal.lk);
+}
+
+/**
+ * @brief 把修改过的元数据块加入当前事务（代替buf_write）
+ * @param buf 缓冲区（调用者持有睡眠锁）
+ * @note 不在操作中（初始化、没有包进操作的路径）或事务已满（超出预留）时退化为buf_write
+ */
+void journal_log(buf_t* buf)
+{
+    proc_t* p = myproc();
+    if (!journal.on || p == NULL || p->journal_depth == 0) {
+        buf_write(buf);
+        return;
+    }
+    assert(sleeplock_holding(&buf->slk), "journal_log: not holding buf sleeplock");
+
+    // 已经在当前事务中: 提交时复制的是最新内容
+    if (buf->logged) {
+        return;
+    }
+
+    spinlock_acquire(&journal.lk);
+    if (journal.n == JOURNAL_LOG_MAX) {
+        spinlock_release(&journal.lk);
+        buf_write(buf);
+        return;
+    }
+    journal.bufs[journal.n++] = buf;
+    buf_log(buf);
+    spinlock_release(&journal.lk);
+}
+
+/**
+ * @brief 结束操作: 最外层的最后一个操作结束时, 事务足够大或有人在等待则提交
+ * @note 调用者不能持有inode锁和buf锁
+ */
+void journal_end()
+{
+    proc_t* p = myproc();
+    if (p == NULL) {
+        return;
+    }
+    assert(p->journal_depth > 0, "journal_end: not in an operation");
+    if (--p->journal_depth > 0 || !journal.on) {
+        return;
+    }
+
+    spinlock_acquire(&journal.lk);
+    journal.outstanding--;
+    if (journal.outstanding == 0 && !journal.committing &&
+        (journal.n >= JOURNAL_COMMIT_HIGH || journal.force)) {
+        journal_commit();
+    }
+    proc_wakeup(&journal);  // 释放了预留的空间
+    spinlock_release(&journal.lk);
+}
+
+/**
+ * @brief 提交当前事务并等待它落盘（fsync / sync）
+ * @note 调用者之前的修改都已经在事务中（操作已经结束）; 正在进行的提交可能不包含它们, 等待下一次;
+ *       事务为空且没有提交在进行时说明已经提交过了, 只需要一次写屏障让调用者直接写盘的数据落盘;
+ *       没有日志时退化为buf_commit
+ */
+void journal_force()
+{
+    if (!journal.on) {
+        buf_commit();
+        return;
+    }
+
+    spinlock_acquire(&journal.lk);
+    uint64 target = journal.seq + (journal.committing ? 2 : 1);
+    while (journal.seq < target) {
+        if (journal.n == 0 && !journal.committing) {
+            spinlock_release(&journal.lk);
+            blk_barrier();
+            return;
+        }
+        if (!journal.committing && journal.outstanding == 0) {
+            journal_commit();
+            continue;
+        }
+        journal.force = true;
+        proc_sleep(&journal, &journal.lk);
+    }
+    spinlock_release(&journal.lk);
+}
+
+/**
+ * @brief 定时提交: 事务非空且距离上次提交超过JOURNAL_COMMIT_INTERVAL个tick
+ * @note 由后台工作线程定时调用（见proc/kwork.h）, 调用者不能持有任何锁
+ */
+void journal_flusher()
+{
+    if (!journal.on || journal.n == 0 ||
+        timer_get_ticks() - journal.last_commit < JOURNAL_COMMIT_INTERVAL) {
+        return;
+    }
+
+    spinlock_acquire(&journal.lk);
+    if (journal.n > 0 && !journal.committing && journal.outstanding == 0) {
+        journal_commit();
+    }
+    spinlock_release(&journal.lk);
+}
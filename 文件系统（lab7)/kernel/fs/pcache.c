@@ -0,0 +1,1150 @@
+#include "fs/pcache.h"
+#include "fs/buf.h"
+#include "fs/inode.h"
+#include "fs/journal.h"
+#include "fs/compress.h"
+#include "fs/refcnt.h"
+#include "dev/blk.h"
+#include "dev/timer.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "proc/cpu.h"
+#include "lib/lock.h"
+#include "lib/str.h"
+#include "lib/print.h"
+
+/*
+    页缓存
+    1. 以(inode_num, pgoff)为键的哈希表, 所有页挂在一条LRU链表上
+    2. 需要新页时从LRU头部开始找ref == 0且干净的页替换; 都是dirty时先写回最久未使用的一页
+    3. 物理页从用户区申请 (它们会被映射进用户页表), 申请后留在缓存中; 用户区内存紧张时pmem调用pcache_reclaim,
+       没有被使用的干净页归还物理页, 下一次使用时重新申请
+    4. 读入时记录页内每个块的磁盘编号, 之后写回不需要inode锁 (定时写回和替换都不持有inode锁);
+       在文件大小以内却没有分配的块 (空洞, 内联文件) 上的修改只能由持有inode锁的pcache_writeback分配后写回
+    5. 延迟分配: write()不分配数据块, 新写入的块在页中是dirty的空洞, 页不会被替换;
+       写回时(fsync / msync / sync / 定时写回)再把相邻的这类页合成一段, 一次bitmap_alloc_extent分配;
+       写回之前文件就被删除或截断的话, 这些块从来不会经过位图
+    以上所有字段由lk_pcache保护, 页内容的读入和写回由每页的slk串行化
+*/
+#define N_PCACHE_HASH 61
+#define PCACHE_ALL_BLOCKS ((1 << PCACHE_BLOCKS) - 1) // 页内所有块
+#define PCACHE_FLUSH_INTERVAL 50                     // 每隔多少个tick写回一次dirty页 (约5s)
+#define PCACHE_DIRTY_HIGH (N_PCACHE / 2)             // dirty页达到高水位时不等定时器直接写回
+#define PCACHE_FREE_MIN (N_PCACHE / 2)               // pcache_get_cached保留的没有被使用的页数
+static page_t pcache[N_PCACHE];
+static page_t* pcache_hash[N_PCACHE_HASH];
+static page_t* pcache_lru_head;   // 最久未使用
+static page_t* pcache_lru_tail;   // 最近使用
+static uint32 pcache_n_dirty;     // dirty页数量
+static uint64 pcache_last_flush;  // 上一次定时写回的tick
+static int pcache_flushing;       // 正在定时写回 (原子变量)
+static spinlock_t lk_pcache;
+
+// ---------------------- 哈希表与LRU链表（调用者持有lk_pcache） ----------------------
+// (inode_num, pgoff)对应的哈希桶
+static uint32 pcache_bucket(uint16 inode_num, uint32 pgoff)
+{
+    return (inode_num * 131 + pgoff) % N_PCACHE_HASH;
+}
+
+// 把页移到LRU链表尾部（最近使用）
+static void pcache_touch(page_t* pg)
+{
+    if (pg == pcache_lru_tail) {
+        return;
+    }
+    // 1. 从原位置摘除
+    if (pg->lru_prev != NULL) {
+        pg->lru_prev->lru_next = pg->lru_next;
+    } else {
+        pcache_lru_head = pg->lru_next;
+    }
+    pg->lru_next->lru_prev = pg->lru_prev;
+
+    // 2. 追加到尾部
+    pg->lru_prev = pcache_lru_tail;
+    pg->lru_next = NULL;
+    pcache_lru_tail->lru_next = pg;
+    pcache_lru_tail = pg;
+}
+
+// 把页移到LRU链表头部（下一次需要新页时最先被替换）
+static void pcache_age(page_t* pg)
+{
+    if (pg == pcache_lru_head) {
+        return;
+    }
+    // 1. 从原位置摘除
+    pg->lru_prev->lru_next = pg->lru_next;
+    if (pg->lru_next != NULL) {
+        pg->lru_next->lru_prev = pg->lru_prev;
+    } else {
+        pcache_lru_tail = pg->lru_prev;
+    }
+
+    // 2. 插入到头部
+    pg->lru_prev = NULL;
+    pg->lru_next = pcache_lru_head;
+    pcache_lru_head->lru_prev = pg;
+    pcache_lru_head = pg;
+}
+
+// 在哈希表中查找(inode_num, pgoff), 未命中返回NULL
+static page_t* pcache_lookup(uint16 inode_num, uint32 pgoff)
+{
+    for (page_t* pg = pcache_hash[pcache_bucket(inode_num, pgoff)]; pg != NULL; pg = pg->hash_next) {
+        if (pg->inode_num == inode_num && pg->pgoff == pgoff) {
+            return pg;
+        }
+    }
+    return NULL;
+}
+
+// 设置页的dirty位图, 维护dirty页计数
+static void pcache_set_dirty(page_t* pg, uint8 dirty)
+{
+    if (pg->dirty == 0 && dirty != 0) {
+        pcache_n_dirty++;
+    } else if (pg->dirty != 0 && dirty == 0) {
+        pcache_n_dirty--;
+    }
+    pg->dirty = dirty;
+}
+
+// 把页从哈希表中移除: 之后按(inode_num, pgoff)再也找不到它
+static void pcache_unhash(page_t* pg)
+{
+    page_t** pp = &pcache_hash[pcache_bucket(pg->inode_num, pg->pgoff)];
+    while (*pp != NULL) {
+        if (*pp == pg) {
+            *pp = pg->hash_next;
+            pg->hash_next = NULL;
+            pg->inode_num = INODE_NUM_UNUSED;
+            pcache_set_dirty(pg, 0);
+            pg->holes = 0;
+            memset(pg->blocks, 0, sizeof(pg->blocks));
+            return;
+        }
+        pp = &(*pp)->hash_next;
+    }
+    panic("pcache_unhash: page not in hash table");
+}
+
+// ---------------------- 磁盘读写（不经过buf cache） ----------------------
+/**
+ * @brief 静态辅助函数：在磁盘和物理页之间传输页内的块, 磁盘上连续的块用一个请求
+ * @param page 物理页地址
+ * @param blocks 页内每个块的磁盘编号（0: 没有对应的磁盘块）
+ * @param mask 要传输的块（位图）
+ * @param write true=写磁盘, false=读磁盘（没有磁盘块的部分清零）
+ * @note buf cache中同一块的副本先由buf_direct_prepare处理, 两边看到的数据保持一致
+ */
+static void pcache_io(uint64 page, uint32* blocks, uint8 mask, bool write)
+{
+    for (uint32 i = 0; i < PCACHE_BLOCKS;) {
+        // 1. 跳过不传输的块（读: 空洞清零）
+        if (blocks[i] == 0 || !(mask & (1 << i))) {
+            if (!write) {
+                memset((uint8*)page + i * BLOCK_SIZE, 0, BLOCK_SIZE);
+            }
+            i++;
+            continue;
+        }
+
+        // 2. 磁盘上连续的块合并成一个请求
+        uint32 n = 1;
+        while (i + n < PCACHE_BLOCKS && (mask & (1 << (i + n))) && blocks[i + n] == blocks[i] + n) {
+            n++;
+        }
+        for (uint32 k = 0; k < n; k++) {
+            buf_direct_prepare(blocks[i] + k, write);
+        }
+        virtio_seg_t seg = { page + i * BLOCK_SIZE, n * BLOCK_SIZE };
+        blk_rw_sg((uint64)blocks[i] * (BLOCK_SIZE / 512), &seg, 1, write);
+        i += n;
+    }
+}
+
+/**
+ * @brief 静态辅助函数：重新记录页内每个块的磁盘编号和空洞
+ * @param ip 内存inode指针（调用者持有睡眠锁）
+ * @param pg 缓存页（调用者持有引用）
+ * @note 文件末尾之后的块记为0且不算空洞; 内联/尾块打包的文件在文件大小以内的块都是空洞,
+ *       压缩文件也一样（块里是压缩数据, 不能按块写回）, dirty页因此只在持有inode锁时整页压缩写回;
+ *       与其他文件共享的块（reflink）保留块号用于读入, 但也算空洞: 修改只在持有inode锁时经过写时复制写回
+ */
+static void pcache_map(inode_t* ip, page_t* pg)
+{
+    uint32 blocks[PCACHE_BLOCKS];
+    uint8 holes = 0;
+    for (uint32 i = 0; i < PCACHE_BLOCKS; i++) {
+        uint32 bn = pg->pgoff * PCACHE_BLOCKS + i;
+        blocks[i] = 0;
+        if ((uint64)bn * BLOCK_SIZE < ip->size) {
+            if (!(ip->flags & (INODE_F_PACKED | INODE_F_COMPRESS))) {
+                blocks[i] = inode_locate_block(ip, bn, false);
+            }
+            if (blocks[i] == 0 || ((ip->flags & INODE_F_SHARED) && refcnt_shared(blocks[i]))) {
+                holes |= 1 << i;
+            }
+        }
+    }
+    spinlock_acquire(&lk_pcache);
+    memmove(pg->blocks, blocks, sizeof(blocks));
+    pg->holes = holes;
+    spinlock_release(&lk_pcache);
+}
+
+// 文件末尾之后的部分清零, 页内容生效（调用者持有pg->slk和ip睡眠锁）
+static void pcache_fill_done(inode_t* ip, page_t* pg)
+{
+    uint32 offset = pg->pgoff * PGSIZE;
+    uint32 n = 0;
+    if (offset < ip->size) {
+        n = ip->size - offset;
+        if (n > PGSIZE) n = PGSIZE;
+    }
+    memset((uint8*)pg->page + n, 0, PGSIZE - n);
+    pg->valid = true;
+}
+
+// 读入页内容（调用者持有pg->slk和ip睡眠锁）: 内联/尾块打包的文件经过inode_read_data复制, 压缩文件解压, 否则直接从磁盘读入
+static void pcache_fill(inode_t* ip, page_t* pg)
+{
+    pcache_map(ip, pg);
+    if (ip->flags & INODE_F_PACKED) {
+        if (pg->pgoff == 0) {
+            inode_read_data(ip, 0, ip->size, (void*)pg->page, false);
+        }
+    } else if (ip->flags & INODE_F_COMPRESS) {
+        comp_read_cluster(ip, pg->pgoff, pg->page);
+    } else {
+        pcache_io(pg->page, pg->blocks, PCACHE_ALL_BLOCKS, false);
+    }
+    pcache_fill_done(ip, pg);
+}
+
+/**
+ * @brief 静态辅助函数：把页中已分配块上的修改写回磁盘（不需要inode锁）
+ * @param pg 缓存页（调用者持有引用）
+ * @return 修改全部写回（或页本来就干净）返回true; 修改落在空洞上时不写回, 返回false
+ * @note 先清除dirty再写回, 写回期间的修改会重新标记; writeback期间截断文件的进程等待写回结束
+ */
+static bool pcache_clean(page_t* pg)
+{
+    uint32 blocks[PCACHE_BLOCKS];
+
+    // 1. 取出要写回的块（页已脱离文件时dirty为0）
+    sleeplock_acquire(&pg->slk);
+    spinlock_acquire(&lk_pcache);
+    uint8 mask = pg->dirty;
+    if (mask == 0 || (mask & pg->holes)) {
+        spinlock_release(&lk_pcache);
+        sleeplock_release(&pg->slk);
+        return mask == 0;
+    }
+    pcache_set_dirty(pg, 0);
+    memmove(blocks, pg->blocks, sizeof(blocks));
+    pg->writeback = true;
+    spinlock_release(&lk_pcache);
+
+    // 2. 写回（文件末尾之后的块没有磁盘编号, 不写）
+    pcache_io(pg->page, blocks, mask, true);
+
+    spinlock_acquire(&lk_pcache);
+    pg->writeback = false;
+    spinlock_release(&lk_pcache);
+    sleeplock_release(&pg->slk);
+    return true;
+}
+
+/**
+ * @brief 静态辅助函数：找到文件的第pgoff页(ref++), 不在缓存中时替换一个空闲页（内容无效）
+ * @param ip 内存inode指针
+ * @param pgoff 文件内的页序号
+ * @return 缓存页, 所有页都在使用中或申请物理页失败时返回NULL
+ */
+static page_t* pcache_grab(inode_t* ip, uint32 pgoff)
+{
+    for (;;) {
+        // 1. 命中: 增加引用
+        spinlock_acquire(&lk_pcache);
+        page_t* pg = pcache_lookup(ip->inode_num, pgoff);
+        if (pg != NULL) {
+            pg->ref++;
+            pcache_touch(pg);
+            spinlock_release(&lk_pcache);
+            return pg;
+        }
+
+        // 2. 未命中: 从LRU头部找一个没有被使用的干净页, 同时记下最久未使用的可写回的dirty页
+        page_t* victim = NULL;
+        for (pg = pcache_lru_head; pg != NULL; pg = pg->lru_next) {
+            if (pg->ref != 0) {
+                continue;
+            }
+            if (pg->dirty == 0) {
+                break;
+            }
+            if (victim == NULL && (pg->dirty & pg->holes) == 0) {
+                victim = pg;
+            }
+        }
+
+        // 3. 没有干净页: 写回dirty页后重试（写回期间不持有lk_pcache）
+        if (pg == NULL) {
+            if (victim == NULL) {
+                spinlock_release(&lk_pcache);
+                return NULL;
+            }
+            victim->ref++;
+            spinlock_release(&lk_pcache);
+            pcache_clean(victim);
+            pcache_put(victim);
+            continue;
+        }
+
+        // 4. 替换
+        if (pg->inode_num != INODE_NUM_UNUSED) {
+            pcache_unhash(pg);
+        }
+        if (pg->page == 0) {
+            pg->page = (uint64)pmem_alloc_flags(false, 0);  // 内容由pcache_fill或写入填充
+            if (pg->page == 0) {
+                spinlock_release(&lk_pcache);
+                return NULL;
+            }
+        }
+        pg->inode_num = ip->inode_num;
+        pg->pgoff = pgoff;
+        pg->valid = false;
+        uint32 b = pcache_bucket(pg->inode_num, pgoff);
+        pg->hash_next = pcache_hash[b];
+        pcache_hash[b] = pg;
+        pg->ref++;
+        pcache_touch(pg);
+        spinlock_release(&lk_pcache);
+        return pg;
+    }
+}
+
+/**
+ * @brief 静态辅助函数：pmem回收函数, 从LRU头部开始归还没有被使用的干净页的物理页
+ * @param target 希望归还的页数
+ * @return 归还的页数
+ * @note pcache_grab持有lk_pcache申请物理页, 这时直接返回0
+ */
+static uint32 pcache_reclaim(uint32 target)
+{
+    if (spinlock_holding(&lk_pcache)) {
+        return 0;
+    }
+    uint32 n = 0;
+    spinlock_acquire(&lk_pcache);
+    for (page_t* pg = pcache_lru_head; pg != NULL && n < target; pg = pg->lru_next) {
+        if (pg->ref != 0 || pg->dirty != 0 || pg->writeback || pg->page == 0) {
+            continue;
+        }
+        if (pg->inode_num != INODE_NUM_UNUSED) {
+            pcache_unhash(pg);
+        }
+        pmem_free(pg->page, false);
+        pg->page = 0;
+        pg->valid = false;
+        n++;
+    }
+    spinlock_release(&lk_pcache);
+    return n;
+}
+
+// ---------------------- 对外接口 ----------------------
+/**
+ * @brief 初始化页缓存: 所有页空闲（尚未申请物理页）, 按顺序挂在LRU链表上
+ */
+void pcache_init()
+{
+    spinlock_init(&lk_pcache, "pcache");
+    for (int i = 0; i < N_PCACHE_HASH; i++) {
+        pcache_hash[i] = NULL;
+    }
+    for (int i = 0; i < N_PCACHE; i++) {
+        pcache[i].inode_num = INODE_NUM_UNUSED;
+        pcache[i].page = 0;
+        pcache[i].ref = 0;
+        pcache[i].valid = false;
+        pcache[i].dirty = 0;
+        pcache[i].holes = 0;
+        pcache[i].writeback = false;
+        memset(pcache[i].blocks, 0, sizeof(pcache[i].blocks));
+        sleeplock_init(&pcache[i].slk, "page");
+        pcache[i].hash_next = NULL;
+        pcache[i].lru_prev = (i > 0) ? &pcache[i - 1] : NULL;
+        pcache[i].lru_next = (i + 1 < N_PCACHE) ? &pcache[i + 1] : NULL;
+    }
+    pcache_lru_head = &pcache[0];
+    pcache_lru_tail = &pcache[N_PCACHE - 1];
+    pmem_register_reclaim(false, pcache_reclaim);
+    pcache_n_dirty = 0;
+    pcache_last_flush = 0;
+    pcache_flushing = 0;
+}
+
+/**
+ * @brief 获取文件的第pgoff页(ref++), 不在缓存中时替换一个空闲页
+ * @param ip 内存inode指针（调用者至少共享持有睡眠锁）
+ * @param pgoff 文件内的页序号
+ * @param fill 内容无效时是否读入（false: 调用者马上覆盖整页）
+ * @return 缓存页, 所有页都在使用中或申请物理页失败时返回NULL
+ * @note 文件末尾之后的部分为0
+ */
+page_t* pcache_get(inode_t* ip, uint32 pgoff, bool fill)
+{
+    assert(sleeplock_holding_any(&ip->slk), "pcache_get: not holding inode sleeplock");
+
+    page_t* pg = pcache_grab(ip, pgoff);
+    if (pg == NULL) {
+        return NULL;
+    }
+
+    // 读入页内容（同一页的并发读入由slk串行化, 只有第一个读入）
+    sleeplock_acquire(&pg->slk);
+    if (!pg->valid) {
+        if (fill) {
+            pcache_fill(ip, pg);
+        } else {
+            pg->valid = true;
+        }
+    }
+    sleeplock_release(&pg->slk);
+    return pg;
+}
+
+/**
+ * @brief 查找物理页pa对应的缓存页（用于解除映射时由页表项找到缓存页）
+ * @param pa 物理页地址
+ * @return 缓存页, 不属于页缓存时返回NULL
+ */
+page_t* pcache_find(uint64 pa)
+{
+    page_t* ret = NULL;
+    spinlock_acquire(&lk_pcache);
+    for (int i = 0; i < N_PCACHE; i++) {
+        if (pcache[i].page == pa) {
+            ret = &pcache[i];
+            break;
+        }
+    }
+    spinlock_release(&lk_pcache);
+    return ret;
+}
+
+/**
+ * @brief 释放一个引用
+ * @param pg 缓存页
+ */
+void pcache_put(page_t* pg)
+{
+    spinlock_acquire(&lk_pcache);
+    assert(pg->ref > 0, "pcache_put: ref is zero");
+    pg->ref--;
+    spinlock_release(&lk_pcache);
+}
+
+/**
+ * @brief 标记整页被修改（已脱离文件的页不需要写回）
+ * @param pg 缓存页（调用者持有引用）
+ */
+void pcache_mark_dirty(page_t* pg)
+{
+    spinlock_acquire(&lk_pcache);
+    if (pg->inode_num != INODE_NUM_UNUSED) {
+        pcache_set_dirty(pg, PCACHE_ALL_BLOCKS);
+    }
+    spinlock_release(&lk_pcache);
+}
+
+/**
+ * @brief 经过页缓存读取文件[offset, offset + len)
+ * @param ip 内存inode指针（至少共享持有睡眠锁, 普通文件）
+ * @param offset 文件偏移
+ * @param len 字节数（调用者已截断到文件末尾）
+ * @param dst 目标地址（用户态/内核态）
+ * @param user dst是否为用户态地址
+ * @return 实际读取的字节数, 页缓存没有可替换的页时提前返回（调用者改走buf cache）
+ */
+uint32 pcache_read(inode_t* ip, uint32 offset, uint32 len, uint64 dst, bool user)
+{
+    uint32 done = 0;
+    while (done < len) {
+        uint32 in_page = (offset + done) % PGSIZE;
+        uint32 n = PGSIZE - in_page;
+        if (n > len - done) n = len - done;
+
+        page_t* pg = pcache_get(ip, (offset + done) / PGSIZE, true);
+        if (pg == NULL) {
+            break;
+        }
+        if (user) {
+            uvm_copyout(myproc()->mm->pgtbl, dst + done, pg->page + in_page, n);
+        } else {
+            memmove((void*)(dst + done), (uint8*)pg->page + in_page, n);
+        }
+        pcache_put(pg);
+        done += n;
+    }
+    return done;
+}
+
+/**
+ * @brief 直接I/O读遇到空洞时, 从页缓存复制延迟分配的数据
+ * @param inode_num 文件的inode_num
+ * @param offset 文件偏移（BLOCK_SIZE的整数倍）
+ * @param dst 当前进程的用户地址
+ * @return 这一块在页缓存中（内容有效）并已复制返回true, 否则返回false（调用者清零）
+ */
+bool pcache_read_cached(uint16 inode_num, uint32 offset, uint64 dst)
+{
+    spinlock_acquire(&lk_pcache);
+    page_t* pg = pcache_lookup(inode_num, offset / PGSIZE);
+    if (pg == NULL || !pg->valid) {
+        spinlock_release(&lk_pcache);
+        return false;
+    }
+    pg->ref++;
+    spinlock_release(&lk_pcache);
+
+    uvm_copyout(myproc()->mm->pgtbl, dst, pg->page + offset % PGSIZE, BLOCK_SIZE);
+    pcache_put(pg);
+    return true;
+}
+
+/**
+ * @brief 文件的第pgoff页是否在页缓存中且内容有效（只用于缺页统计, 返回后可能马上改变）
+ */
+bool pcache_resident(uint16 inode_num, uint32 pgoff)
+{
+    spinlock_acquire(&lk_pcache);
+    page_t* pg = pcache_lookup(inode_num, pgoff);
+    bool ret = (pg != NULL && pg->valid);
+    spinlock_release(&lk_pcache);
+    return ret;
+}
+
+/**
+ * @brief 取出[pgoff, pgoff + n)中已在缓存中且内容有效的页(ref++), 不读盘（缺页时顺带映射相邻的页）
+ * @param pages 输出: 第i项是第pgoff + i页, 不在缓存中或没有取出时为NULL
+ * @return 取出的页数
+ * @note 取出之后没有被使用的页至少还剩PCACHE_FREE_MIN个, 避免映射相邻的页占满页缓存
+ */
+uint32 pcache_get_cached(uint16 inode_num, uint32 pgoff, uint32 n, page_t** pages)
+{
+    uint32 got = 0;
+    spinlock_acquire(&lk_pcache);
+    uint32 n_free = 0;
+    for (page_t* pg = pcache_lru_head; pg != NULL; pg = pg->lru_next) {
+        if (pg->ref == 0) {
+            n_free++;
+        }
+    }
+    for (uint32 i = 0; i < n; i++) {
+        page_t* pg = pcache_lookup(inode_num, pgoff + i);
+        pages[i] = NULL;
+        if (pg == NULL || !pg->valid || (pg->ref == 0 && n_free <= PCACHE_FREE_MIN)) {
+            continue;
+        }
+        if (pg->ref == 0) {
+            n_free--;
+        }
+        pg->ref++;
+        pcache_touch(pg);
+        pages[i] = pg;
+        got++;
+    }
+    spinlock_release(&lk_pcache);
+    return got;
+}
+
+/**
+ * @brief 文件的第pgoff页是否在页缓存中（包括正在读入的页, 用于判断预读的页是否在使用前被替换）
+ */
+bool pcache_present(uint16 inode_num, uint32 pgoff)
+{
+    spinlock_acquire(&lk_pcache);
+    bool ret = (pcache_lookup(inode_num, pgoff) != NULL);
+    spinlock_release(&lk_pcache);
+    return ret;
+}
+
+/**
+ * @brief 经过页缓存写入文件[offset, offset + len), 写入的块标记dirty, 必要时扩展文件大小
+ * @param ip 内存inode指针（独占持有睡眠锁, 普通文件且不是内联数据）
+ * @param offset 文件偏移
+ * @param len 字节数（不分配数据块: 落在空洞上的块等到写回时延迟分配）
+ * @param src 源地址（用户态/内核态）
+ * @param user src是否为用户态地址
+ * @return 实际写入的字节数, 页缓存没有可替换的页时提前返回（调用者改走buf cache）
+ * @note 整页覆盖时不读旧内容; 写入后重新记录页内块的磁盘编号（文件可能刚刚扩展）
+ */
+uint32 pcache_write(inode_t* ip, uint32 offset, uint32 len, uint64 src, bool user)
+{
+    assert(sleeplock_holding(&ip->slk), "pcache_write: not holding inode sleeplock");
+
+    uint32 done = 0;
+    while (done < len) {
+        uint32 in_page = (offset + done) % PGSIZE;
+        uint32 n = PGSIZE - in_page;
+        if (n > len - done) n = len - done;
+
+        // 1. 取出页（整页覆盖时不读入）
+        page_t* pg = pcache_get(ip, (offset + done) / PGSIZE, n != PGSIZE);
+        if (pg == NULL) {
+            break;
+        }
+
+        // 2. 复制
+        if (user) {
+            uvm_copyin(myproc()->mm->pgtbl, pg->page + in_page, src + done, n);
+        } else {
+            memmove((uint8*)pg->page + in_page, (void*)(src + done), n);
+        }
+        done += n;
+
+        // 3. 扩展文件大小（元数据只标记dirty）, 然后标记写入的块
+        if (offset + done > ip->size) {
+            ip->size = offset + done;
+            ip->dirty = true;
+        }
+        pcache_map(ip, pg);
+        uint8 mask = 0;
+        for (uint32 i = in_page / BLOCK_SIZE; i <= (in_page + n - 1) / BLOCK_SIZE; i++) {
+            mask |= 1 << i;
+        }
+        spinlock_acquire(&lk_pcache);
+        pcache_set_dirty(pg, pg->dirty | mask);
+        spinlock_release(&lk_pcache);
+        pcache_put(pg);
+    }
+    return done;
+}
+
+/**
+ * @brief 静态辅助函数：缓存页run[0..n)在磁盘上首尾相接, 用一个scatter-gather请求读入
+ * @param ip 内存inode指针
+ * @param run 缓存页（调用者持有引用和slk, 返回时全部释放）
+ * @param n 页数
+ */
+static void pcache_fill_run(inode_t* ip, page_t** run, int n)
+{
+    virtio_seg_t seg[VIRTIO_MAX_SG];
+    for (int i = 0; i < n; i++) {
+        for (uint32 k = 0; k < PCACHE_BLOCKS; k++) {
+            buf_direct_prepare(run[i]->blocks[k], false);
+        }
+        seg[i].addr = run[i]->page;
+        seg[i].len = PGSIZE;
+    }
+    blk_rw_sg((uint64)run[0]->blocks[0] * (BLOCK_SIZE / 512), seg, n, false);
+
+    for (int i = 0; i < n; i++) {
+        pcache_fill_done(ip, run[i]);
+        sleeplock_release(&run[i]->slk);
+        pcache_put(run[i]);
+    }
+}
+
+// 页内的块都已分配且在磁盘上连续（调用者持有pg->slk, blocks已记录）
+static bool pcache_contiguous(page_t* pg)
+{
+    for (uint32 i = 0; i < PCACHE_BLOCKS; i++) {
+        if (pg->blocks[i] == 0 || pg->blocks[i] != pg->blocks[0] + i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 预读: 读入[pgoff, pgoff + npages)中不在缓存的页
+ * @param ip 内存inode指针（至少共享持有睡眠锁, 普通文件且不是内联数据）
+ * @param pgoff 起始页序号
+ * @param npages 页数
+ * @note 在磁盘上首尾相接的整页（最多VIRTIO_MAX_SG页）合并成一个请求, 其余的页逐页读入（压缩文件逐页解压）;
+ *       只预读文件大小范围内的页, 页缓存没有可替换的页时提前停止
+ */
+void pcache_readahead(inode_t* ip, uint32 pgoff, uint32 npages)
+{
+    assert(sleeplock_holding_any(&ip->slk), "pcache_readahead: not holding inode sleeplock");
+
+    // 1. 截断到文件末尾
+    uint32 last = (ip->size + PGSIZE - 1) / PGSIZE;
+    if (pgoff >= last) {
+        return;
+    }
+    if (npages > last - pgoff) {
+        npages = last - pgoff;
+    }
+
+    page_t* run[VIRTIO_MAX_SG];
+    int nrun = 0;
+    for (uint32 i = 0; i < npages; i++) {
+        // 2. 跳过已经在缓存中的页（持有slk之后再检查, 其他进程可能刚刚读入）
+        page_t* pg = pcache_grab(ip, pgoff + i);
+        if (pg == NULL) {
+            break;
+        }
+        sleeplock_acquire(&pg->slk);
+        if (pg->valid) {
+            sleeplock_release(&pg->slk);
+            pcache_put(pg);
+            continue;
+        }
+        pcache_map(ip, pg);
+        if (ip->flags & INODE_F_COMPRESS) {
+            comp_read_cluster(ip, pg->pgoff, pg->page);
+            pcache_fill_done(ip, pg);
+            sleeplock_release(&pg->slk);
+            pcache_put(pg);
+            continue;
+        }
+
+        // 3. 不能接在当前请求之后: 先提交当前请求
+        bool contiguous = pcache_contiguous(pg);
+        if (nrun > 0 && (!contiguous || nrun == VIRTIO_MAX_SG ||
+                         pg->blocks[0] != run[nrun - 1]->blocks[PCACHE_BLOCKS - 1] + 1)) {
+            pcache_fill_run(ip, run, nrun);
+            nrun = 0;
+        }
+
+        // 4. 整页连续的页加入请求, 否则单独读入
+        if (contiguous) {
+            run[nrun++] = pg;
+        } else {
+            pcache_io(pg->page, pg->blocks, PCACHE_ALL_BLOCKS, false);
+            pcache_fill_done(ip, pg);
+            sleeplock_release(&pg->slk);
+            pcache_put(pg);
+        }
+    }
+    if (nrun > 0) {
+        pcache_fill_run(ip, run, nrun);
+    }
+}
+
+/**
+ * @brief 静态辅助函数：压缩文件的dirty页整页压缩写回（cluster的块由comp_write_cluster重新分配）
+ * @param ip 内存inode指针（调用者独占持有睡眠锁）
+ * @param pg 缓存页（调用者持有引用）
+ * @note 与pcache_clean一样先清除dirty再写回, 写回期间的修改会重新标记
+ */
+static void pcache_compress(inode_t* ip, page_t* pg)
+{
+    sleeplock_acquire(&pg->slk);
+    spinlock_acquire(&lk_pcache);
+    bool dirty = (pg->dirty != 0);
+    if (dirty) {
+        pcache_set_dirty(pg, 0);
+        pg->writeback = true;
+    }
+    spinlock_release(&lk_pcache);
+
+    if (dirty) {
+        if (pg->pgoff * PGSIZE < ip->size) {
+            comp_write_cluster(ip, pg->pgoff, pg->page);
+        }
+        spinlock_acquire(&lk_pcache);
+        pg->writeback = false;
+        spinlock_release(&lk_pcache);
+    }
+    sleeplock_release(&pg->slk);
+}
+
+/**
+ * @brief 静态辅助函数：在持有inode锁的情况下写回一个dirty页
+ * @param ip 内存inode指针（调用者独占持有睡眠锁）
+ * @param pg 缓存页（调用者持有引用）
+ * @param holes 修改是否落在空洞上（调用者在lk_pcache下读取）
+ * @note 只写回文件大小以内的部分, 映射不会扩展文件;
+ *       修改落在空洞上时先为这一页分配数据块（内联文件先迁移到数据块）, 压缩文件整页压缩写回
+ */
+static void pcache_writeback_page(inode_t* ip, page_t* pg, bool holes)
+{
+    // 0. 压缩文件: 不按块写回
+    if (ip->flags & INODE_F_COMPRESS) {
+        pcache_compress(ip, pg);
+        return;
+    }
+
+    // 1. 为空洞分配数据块, 重新记录块号
+    uint32 offset = pg->pgoff * PGSIZE;
+    if (holes && offset < ip->size) {
+        uint32 n = ip->size - offset;
+        if (n > PGSIZE) n = PGSIZE;
+        inode_fallocate(ip, offset, n);
+        pcache_map(ip, pg);
+    }
+
+    // 2. 写回
+    pcache_clean(pg);
+}
+
+/**
+ * @brief 静态辅助函数：为[pgoff, pgoff + npages)中修改落在空洞上的页分配数据块
+ * @param ip 内存inode指针（调用者独占持有睡眠锁）
+ * @param pgoff 起始页序号
+ * @param npages 页数
+ * @note 收集这些页按页序号排序, 页序号相邻的合成一段, 每段一次inode_fallocate（一次bitmap_alloc_extent）,
+ *       这样延迟分配的整个dirty范围在磁盘上连续; 只分配到文件大小为止;
+ *       压缩文件跳过（写回时才知道每一页压缩后需要的块数）
+ */
+static void pcache_delalloc(inode_t* ip, uint32 pgoff, uint32 npages)
+{
+    uint32 run[N_PCACHE];
+    uint32 n = 0;
+
+    if (ip->flags & INODE_F_COMPRESS) {
+        return;
+    }
+
+    // 1. 收集并按页序号插入排序
+    spinlock_acquire(&lk_pcache);
+    for (int i = 0; i < N_PCACHE; i++) {
+        page_t* pg = &pcache[i];
+        if (pg->inode_num != ip->inode_num || (pg->dirty & pg->holes) == 0 ||
+            pg->pgoff < pgoff || pg->pgoff - pgoff >= npages) {
+            continue;
+        }
+        uint32 k = n++;
+        while (k > 0 && run[k - 1] > pg->pgoff) {
+            run[k] = run[k - 1];
+            k--;
+        }
+        run[k] = pg->pgoff;
+    }
+    spinlock_release(&lk_pcache);
+
+    // 2. 相邻的页合成一段分配（页仍是dirty的空洞, 不会被替换）
+    for (uint32 i = 0; i < n;) {
+        uint32 j = i + 1;
+        while (j < n && run[j] == run[j - 1] + 1) {
+            j++;
+        }
+        uint32 start = run[i] * PGSIZE;
+        uint32 end = run[j - 1] * PGSIZE + PGSIZE;
+        if (end > ip->size) end = ip->size;
+        if (start < end) {
+            inode_fallocate(ip, start, end - start);
+        }
+        i = j;
+    }
+}
+
+/**
+ * @brief 把文件[pgoff, pgoff + npages)范围内的dirty页写回磁盘
+ * @param ip 内存inode指针（调用者独占持有睡眠锁）
+ * @param pgoff 起始页序号
+ * @param npages 页数
+ * @note 先为范围内延迟分配的页成段分配数据块
+ */
+void pcache_writeback(inode_t* ip, uint32 pgoff, uint32 npages)
+{
+    assert(sleeplock_holding(&ip->slk), "pcache_writeback: not holding inode sleeplock");
+    pcache_delalloc(ip, pgoff, npages);
+
+    for (uint32 i = 0; i < npages; i++) {
+        // 找到dirty页, 持有引用防止被替换
+        spinlock_acquire(&lk_pcache);
+        page_t* pg = pcache_lookup(ip->inode_num, pgoff + i);
+        if (pg == NULL || pg->dirty == 0) {
+            spinlock_release(&lk_pcache);
+            continue;
+        }
+        bool holes = (pg->dirty & pg->holes) != 0;
+        pg->ref++;
+        spinlock_release(&lk_pcache);
+
+        pcache_writeback_page(ip, pg, holes);
+        pcache_put(pg);
+    }
+}
+
+/**
+ * @brief 写回文件的所有dirty页（fsync使用, 扫描整个页缓存而不是逐页查找文件的每一页）
+ * @param ip 内存inode指针（调用者独占持有睡眠锁）
+ */
+void pcache_fsync(inode_t* ip)
+{
+    assert(sleeplock_holding(&ip->slk), "pcache_fsync: not holding inode sleeplock");
+    pcache_delalloc(ip, 0, 0xFFFFFFFF);
+
+    for (int i = 0; i < N_PCACHE; i++) {
+        page_t* pg = &pcache[i];
+        spinlock_acquire(&lk_pcache);
+        if (pg->inode_num != ip->inode_num || pg->dirty == 0) {
+            spinlock_release(&lk_pcache);
+            continue;
+        }
+        bool holes = (pg->dirty & pg->holes) != 0;
+        pg->ref++;
+        spinlock_release(&lk_pcache);
+
+        pcache_writeback_page(ip, pg, holes);
+        pcache_put(pg);
+    }
+}
+
+/**
+ * @brief 重新记录文件所有缓存页的块号和空洞（reflink克隆之后, 共享的块成为空洞）
+ * @param ip 内存inode指针（调用者独占持有睡眠锁）
+ */
+void pcache_remap(inode_t* ip)
+{
+    assert(sleeplock_holding(&ip->slk), "pcache_remap: not holding inode sleeplock");
+
+    for (int i = 0; i < N_PCACHE; i++) {
+        page_t* pg = &pcache[i];
+        spinlock_acquire(&lk_pcache);
+        if (pg->inode_num != ip->inode_num) {
+            spinlock_release(&lk_pcache);
+            continue;
+        }
+        pg->ref++;
+        spinlock_release(&lk_pcache);
+
+        pcache_map(ip, pg);
+        pcache_put(pg);
+    }
+}
+
+/**
+ * @brief 把文件[pgoff, pgoff + npages)范围内已分配块上的修改写回磁盘（直接I/O读之前调用）
+ * @param inode_num 文件的inode_num
+ * @param pgoff 起始页序号
+ * @param npages 页数
+ */
+void pcache_flush(uint16 inode_num, uint32 pgoff, uint32 npages)
+{
+    for (uint32 i = 0; i < npages; i++) {
+        spinlock_acquire(&lk_pcache);
+        page_t* pg = pcache_lookup(inode_num, pgoff + i);
+        if (pg == NULL || pg->dirty == 0) {
+            spinlock_release(&lk_pcache);
+            continue;
+        }
+        pg->ref++;
+        spinlock_release(&lk_pcache);
+
+        pcache_clean(pg);
+        pcache_put(pg);
+    }
+}
+
+/**
+ * @brief 直接I/O或内联数据写入文件之后, 把同样的数据写进已缓存的页, 读者和映射者立即看到新内容
+ * @param inode_num 文件的inode_num
+ * @param offset 写入的文件偏移
+ * @param src 写入的数据（用户态/内核态）
+ * @param len 字节数
+ * @param user src是否为用户态地址
+ */
+void pcache_update(uint16 inode_num, uint32 offset, uint64 src, uint32 len, bool user)
+{
+    uint32 done = 0;
+    while (done < len) {
+        uint32 pgoff = (offset + done) / PGSIZE;
+        uint32 in_page = (offset + done) % PGSIZE;
+        uint32 n = PGSIZE - in_page;
+        if (n > len - done) n = len - done;
+
+        // 1. 找到已缓存且内容有效的页（持有引用, 复制期间不持有lk_pcache）
+        spinlock_acquire(&lk_pcache);
+        page_t* pg = pcache_lookup(inode_num, pgoff);
+        if (pg != NULL && pg->valid) {
+            pg->ref++;
+        } else {
+            pg = NULL;
+        }
+        spinlock_release(&lk_pcache);
+
+        // 2. 复制
+        if (pg != NULL) {
+            uint8* dst = (uint8*)pg->page + in_page;
+            if (user) {
+                uvm_copyin(myproc()->mm->pgtbl, (uint64)dst, src + done, n);
+            } else {
+                memmove(dst, (void*)(src + done), n);
+            }
+            pcache_put(pg);
+        }
+        done += n;
+    }
+}
+
+/**
+ * @brief 文件[pgoff, pgoff + npages)范围内的页不会很快再被访问（fadvise / 顺序读过的页）
+ * @param inode_num 文件的inode_num
+ * @param pgoff 起始页序号
+ * @param npages 页数
+ * @param drop true: 没有被使用的干净页直接脱离文件; false: 只移到LRU头部, 优先被替换
+ * @note dirty页、正在写回或仍被映射的页不会被丢弃, 也移到LRU头部
+ */
+void pcache_deactivate(uint16 inode_num, uint32 pgoff, uint32 npages, bool drop)
+{
+    spinlock_acquire(&lk_pcache);
+    for (int i = 0; i < N_PCACHE; i++) {
+        page_t* pg = &pcache[i];
+        if (pg->inode_num != inode_num || pg->pgoff < pgoff || pg->pgoff - pgoff >= npages) {
+            continue;
+        }
+        if (drop && pg->ref == 0 && pg->dirty == 0 && !pg->writeback) {
+            pcache_unhash(pg);
+            pg->valid = false;
+        }
+        pcache_age(pg);
+    }
+    spinlock_release(&lk_pcache);
+}
+
+/**
+ * @brief 文件被截断到size字节（删除文件时size = 0）
+ * @param inode_num 文件的inode_num
+ * @param size 新的文件大小
+ * @note 调用者在释放数据块之前调用: 先等待正在写回的页完成, 之后不会再写这些块;
+ *       完全在size之后的页脱离文件: 仍被映射的页留给映射者直到解除映射, 但不会再写回;
+ *       跨越size的页把尾部清零, 与文件再次扩展后读到的0一致, size之后的块不再写回
+ */
+void pcache_truncate(uint16 inode_num, uint32 size)
+{
+    spinlock_acquire(&lk_pcache);
+    for (int i = 0; i < N_PCACHE; i++) {
+        page_t* pg = &pcache[i];
+        if (pg->inode_num != inode_num) {
+            continue;
+        }
+        uint32 offset = pg->pgoff * PGSIZE;
+        if (offset + PGSIZE <= size) {
+            continue;
+        }
+
+        // 1. 正在写回: 等待写回结束（写回持有slk）后重新检查这一页
+        if (pg->writeback) {
+            pg->ref++;
+            spinlock_release(&lk_pcache);
+            sleeplock_acquire(&pg->slk);
+            sleeplock_release(&pg->slk);
+            spinlock_acquire(&lk_pcache);
+            pg->ref--;
+            i--;
+            continue;
+        }
+
+        // 2. 脱离文件, 或者丢弃size之后的块
+        if (offset >= size) {
+            pcache_unhash(pg);
+            pg->valid = false;
+        } else {
+            uint32 keep = (size - offset + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            for (uint32 k = keep; k < PCACHE_BLOCKS; k++) {
+                pg->blocks[k] = 0;
+            }
+            pcache_set_dirty(pg, pg->dirty & ((1 << keep) - 1));
+            pg->holes &= (1 << keep) - 1;
+            if (pg->valid) {
+                memset((uint8*)pg->page + (size - offset), 0, offset + PGSIZE - size);
+            }
+        }
+    }
+    spinlock_release(&lk_pcache);
+}
+
+/**
+ * @brief 静态辅助函数：文件是否还有修改落在空洞上的页（调用者持有lk_pcache）
+ */
+static bool pcache_has_delalloc(uint16 inode_num)
+{
+    for (int i = 0; i < N_PCACHE; i++) {
+        if (pcache[i].inode_num == inode_num && (pcache[i].dirty & pcache[i].holes) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 静态辅助函数：获取inode锁, 延迟分配并写回文件的所有dirty页
+ * @param inode_num 文件的inode_num（从页中读出, 文件可能已被删除）
+ * @note 先持有引用再确认页还在: 文件销毁时页已经脱离, 持有引用之后文件不会再被销毁;
+ *       页不在了就不上锁（已销毁的inode从磁盘读入后nlink为0, 不能让inode_free再销毁一次）
+ */
+static void pcache_sync_inode(uint16 inode_num)
+{
+    journal_begin();
+    inode_t* ip = inode_alloc(inode_num);
+    spinlock_acquire(&lk_pcache);
+    bool live = pcache_has_delalloc(inode_num);
+    spinlock_release(&lk_pcache);
+    if (live) {
+        inode_lock(ip);
+        pcache_fsync(ip);
+        inode_unlock(ip);
+    }
+    inode_free(ip);
+    journal_end();
+}
+
+/**
+ * @brief 写回全部dirty页: 先无锁写回已分配块上的修改, 再逐个文件持有inode锁完成延迟分配
+ * @note 调用者不能持有任何锁; 写回期间其他进程可以继续使用这些页
+ */
+void pcache_sync()
+{
+    for (int i = 0; i < N_PCACHE; i++) {
+        page_t* pg = &pcache[i];
+        spinlock_acquire(&lk_pcache);
+        if (pg->dirty == 0 || (pg->dirty & pg->holes)) {
+            spinlock_release(&lk_pcache);
+            continue;
+        }
+        pg->ref++;
+        spinlock_release(&lk_pcache);
+
+        pcache_clean(pg);
+        pcache_put(pg);
+    }
+
+    for (int i = 0; i < N_PCACHE; i++) {
+        page_t* pg = &pcache[i];
+        spinlock_acquire(&lk_pcache);
+        if ((pg->dirty & pg->holes) == 0) {
+            spinlock_release(&lk_pcache);
+            continue;
+        }
+        uint16 inode_num = pg->inode_num;
+        spinlock_release(&lk_pcache);
+
+        pcache_sync_inode(inode_num);
+    }
+}
+
+/**
+ * @brief 定时写回: 距离上次写回超过PCACHE_FLUSH_INTERVAL个tick, 或dirty页达到高水位
+ * @note 由后台工作线程定时调用（见proc/kwork.h）, 调用者不能持有任何锁
+ */
+void pcache_flusher()
+{
+    if (pcache_n_dirty == 0) {
+        return;
+    }
+
+    uint64 now = timer_get_ticks();
+    if (pcache_n_dirty < PCACHE_DIRTY_HIGH && now - pcache_last_flush < PCACHE_FLUSH_INTERVAL) {
+        return;
+    }
+
+    // 同一时刻只允许一个hart执行定时写回, 其他hart直接返回
+    if (__sync_lock_test_and_set(&pcache_flushing, 1) != 0) {
+        return;
+    }
+    pcache_last_flush = now;
+    pcache_sync();
+    __sync_lock_release(&pcache_flushing);
+}
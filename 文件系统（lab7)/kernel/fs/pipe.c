@@ -0,0 +1,439 @@
+#include "fs/pipe.h"
+#include "fs/file.h"
+#include "fs/pcache.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "mem/swap.h"
+#include "proc/cpu.h"
+#include "proc/proc.h"
+#include "lib/str.h"
+#include "lib/print.h"
+
+/*
+    管道表: 槽位的分配和释放由lk_pipe保护, 管道内部的状态由pi->lk保护
+    读写直接在用户缓冲区和环形缓冲区之间复制, 每次最多两段 (环绕时); 页引用中的数据直接从它的物理页复制
+*/
+static pipe_t pipes[N_PIPE];
+static spinlock_t lk_pipe;
+
+/**
+ * @brief 初始化管道表
+ */
+void pipe_init()
+{
+    spinlock_init(&lk_pipe, "pipe table");
+    for (int i = 0; i < N_PIPE; i++) {
+        spinlock_init(&pipes[i].lk, "pipe");
+        poll_head_init(&pipes[i].rph, "pipe poll");
+        poll_head_init(&pipes[i].wph, "pipe poll");
+        pipes[i].used = false;
+    }
+}
+
+/**
+ * @brief 创建管道, 以及它的读端和写端文件项
+ * @param rf 输出：读端file（只读）
+ * @param wf 输出：写端file（只写）
+ * @return 成功返回0，管道表已满或内存不足返回-1
+ */
+int pipe_alloc(file_t** rf, file_t** wf)
+{
+    // 1. 分配管道槽位
+    pipe_t* pi = NULL;
+    spinlock_acquire(&lk_pipe);
+    for (int i = 0; i < N_PIPE; i++) {
+        if (!pipes[i].used) {
+            pi = &pipes[i];
+            pi->used = true;
+            break;
+        }
+    }
+    spinlock_release(&lk_pipe);
+    if (pi == NULL) {
+        return -1;
+    }
+
+    // 2. 分配环形缓冲区
+    pi->data = (uint8*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_FILE));  // 只读取写入过的部分, 不需要清零
+    if (pi->data == NULL) {
+        spinlock_acquire(&lk_pipe);
+        pi->used = false;
+        spinlock_release(&lk_pipe);
+        return -1;
+    }
+    pi->nread = 0;
+    pi->nwrite = 0;
+    pi->bhead = 0;
+    pi->btail = 0;
+    pi->readopen = true;
+    pi->writeopen = true;
+
+    // 3. 读端和写端（文件项不足时回收已申请的部分）
+    *rf = file_alloc();
+    *wf = (*rf != NULL) ? file_alloc() : NULL;
+    if (*wf == NULL) {
+        if (*rf != NULL) {
+            file_close(*rf);
+        }
+        pmem_free((uint64)pi->data, true);
+        spinlock_acquire(&lk_pipe);
+        pi->used = false;
+        spinlock_release(&lk_pipe);
+        return -1;
+    }
+    (*rf)->type = FD_PIPE;
+    (*rf)->readable = true;
+    (*rf)->pipe = pi;
+
+    (*wf)->type = FD_PIPE;
+    (*wf)->writable = true;
+    (*wf)->pipe = pi;
+    return 0;
+}
+
+/**
+ * @brief 关闭管道的一端, 唤醒另一端可能在睡眠的进程; 两端都关闭后释放管道
+ * @param pi 管道
+ * @param writable true=关闭写端, false=关闭读端
+ */
+void pipe_close(pipe_t* pi, bool writable)
+{
+    spinlock_acquire(&pi->lk);
+    if (writable) {
+        pi->writeopen = false;
+        proc_wakeup(&pi->nread);    // 读者看到EOF
+        poll_wake(&pi->rph, POLLHUP);
+    } else {
+        pi->readopen = false;
+        proc_wakeup(&pi->nwrite);   // 写者看到读端关闭
+        poll_wake(&pi->wph, POLLERR);
+    }
+    bool last = !pi->readopen && !pi->writeopen;
+    spinlock_release(&pi->lk);
+
+    if (last) {
+        for (; pi->bhead != pi->btail; pi->bhead++) {
+            pipe_buf_put(&pi->bufs[pi->bhead % PIPE_BUFS]);
+        }
+        pmem_free((uint64)pi->data, true);
+        pi->data = NULL;
+        spinlock_acquire(&lk_pipe);
+        pi->used = false;
+        spinlock_release(&lk_pipe);
+    }
+}
+
+/**
+ * @brief 静态辅助函数：缓冲区为空 (环形缓冲区和页引用队列都为空)
+ * @param pi 管道（调用者持有pi->lk）
+ */
+static bool pipe_empty(pipe_t* pi)
+{
+    return pi->nread == pi->nwrite && pi->bhead == pi->btail;
+}
+
+/**
+ * @brief 静态辅助函数：缓冲区已满 (环形缓冲区满或页引用队列满, 写者或splice的发送方可能在睡眠)
+ * @param pi 管道（调用者持有pi->lk）
+ */
+static bool pipe_full(pipe_t* pi)
+{
+    return pi->nwrite - pi->nread == PIPE_SIZE || pi->btail - pi->bhead == PIPE_BUFS;
+}
+
+/**
+ * @brief 静态辅助函数：开头是否轮到页引用 (环形缓冲区中在它之前的字节都已读出)
+ * @param pi 管道（调用者持有pi->lk）
+ * @return 队列头部的页引用, 没有页引用或还没有轮到时返回NULL
+ */
+static pipe_buf_t* pipe_head_buf(pipe_t* pi)
+{
+    if (pi->bhead == pi->btail || pi->bufs[pi->bhead % PIPE_BUFS].at != pi->nread) {
+        return NULL;
+    }
+    return &pi->bufs[pi->bhead % PIPE_BUFS];
+}
+
+/**
+ * @brief 静态辅助函数：环形缓冲区中在下一个页引用之前可以读出的字节数
+ * @param pi 管道（调用者持有pi->lk）
+ */
+static uint32 pipe_ring_avail(pipe_t* pi)
+{
+    uint32 end = (pi->bhead != pi->btail) ? pi->bufs[pi->bhead % PIPE_BUFS].at : pi->nwrite;
+    return end - pi->nread;
+}
+
+/**
+ * @brief 静态辅助函数：在管道的一段数据和调用者缓冲区之间复制
+ * @param data 环形缓冲区内或页引用中的地址（调用者持有pi->lk）
+ * @param addr 调用者缓冲区地址
+ * @param len 字节数（不跨越环形缓冲区末尾或页的末尾）
+ * @param user 是否为用户态缓冲区
+ * @param to_pipe true=写入管道, false=从管道读出
+ */
+static void pipe_copy(uint8* data, uint64 addr, uint32 len, bool user, bool to_pipe)
+{
+    if (user && to_pipe) {
+        uvm_copyin(myproc()->mm->pgtbl, (uint64)data, addr, len);
+    } else if (user) {
+        uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)data, len);
+    } else if (to_pipe) {
+        memmove(data, (void*)addr, len);
+    } else {
+        memmove((void*)addr, data, len);
+    }
+}
+
+/**
+ * @brief 从管道读出数据
+ * @param pi 管道
+ * @param len 最多读取的字节数
+ * @param dst 目标缓冲区地址
+ * @param user 是否为用户态缓冲区
+ * @return 实际读取的字节数（缓冲区为空且写端已关闭时返回0）
+ * @note 只读出已有的数据, 不等待凑满len
+ */
+uint32 pipe_read(pipe_t* pi, uint32 len, uint64 dst, bool user)
+{
+    // 持有pi->lk时复制用户缓冲区, 不能睡眠换入
+    if (user) {
+        swap_prefault(dst, len);
+    }
+    spinlock_acquire(&pi->lk);
+
+    // 1. 缓冲区为空: 等待写者（写端关闭则返回EOF）
+    while (pipe_empty(pi) && pi->writeopen) {
+        proc_sleep(&pi->nread, &pi->lk);
+    }
+
+    // 2. 按写入的顺序读出现有数据: 环形缓冲区环绕时分两段复制, 轮到页引用时从它的页复制, 读完后放弃引用
+    bool was_full = pipe_full(pi);
+    uint32 done = 0;
+    while (done < len && !pipe_empty(pi)) {
+        pipe_buf_t* b = pipe_head_buf(pi);
+        uint32 n = len - done;
+        if (b != NULL) {
+            if (n > b->len) n = b->len;
+            pipe_copy((uint8*)(b->pa + b->off), dst + done, n, user, false);
+            b->off += n;
+            b->len -= n;
+            if (b->len == 0) {
+                pipe_buf_put(b);
+                pi->bhead++;
+            }
+        } else {
+            uint32 pos = pi->nread % PIPE_SIZE;
+            if (n > PIPE_SIZE - pos) n = PIPE_SIZE - pos;
+            if (n > pipe_ring_avail(pi)) n = pipe_ring_avail(pi);
+            pipe_copy(pi->data + pos, dst + done, n, user, false);
+            pi->nread += n;
+        }
+        done += n;
+    }
+
+    // 3. 写者只会在缓冲区满时睡眠: 只有"满 -> 不满"时才需要唤醒
+    if (was_full && done > 0) {
+        proc_wakeup(&pi->nwrite);
+        poll_wake(&pi->wph, POLLOUT);
+    }
+    spinlock_release(&pi->lk);
+    return done;
+}
+
+/**
+ * @brief 向管道写入数据
+ * @param pi 管道
+ * @param len 要写入的字节数
+ * @param src 源缓冲区地址
+ * @param user 是否为用户态缓冲区
+ * @return 实际写入的字节数（一个字节都没写入时读端已关闭则返回-1）
+ * @note 缓冲区满时睡眠, 直到全部写入或读端关闭
+ */
+uint32 pipe_write(pipe_t* pi, uint32 len, uint64 src, bool user)
+{
+    uint32 done = 0;
+    if (user) {
+        swap_prefault(src, len);
+    }
+    spinlock_acquire(&pi->lk);
+
+    while (done < len) {
+        // 1. 读端已关闭: 没有人会读了
+        if (!pi->readopen) {
+            spinlock_release(&pi->lk);
+            return done > 0 ? done : (uint32)-1;
+        }
+
+        // 2. 缓冲区已满: 等待读者
+        uint32 used = pi->nwrite - pi->nread;
+        if (used == PIPE_SIZE) {
+            proc_sleep(&pi->nwrite, &pi->lk);
+            continue;
+        }
+
+        // 3. 写入空闲空间中连续的一段
+        uint32 pos = pi->nwrite % PIPE_SIZE;
+        uint32 n = PIPE_SIZE - used;
+        if (n > PIPE_SIZE - pos) n = PIPE_SIZE - pos;
+        if (n > len - done) n = len - done;
+        pipe_copy(pi->data + pos, src + done, n, user, true);
+        pi->nwrite += n;
+        done += n;
+
+        // 4. 读者只会在缓冲区为空时睡眠: 只有"空 -> 非空"时才需要唤醒
+        if (used == 0 && pi->bhead == pi->btail) {
+            proc_wakeup(&pi->nread);
+            poll_wake(&pi->rph, POLLIN);
+        }
+    }
+
+    spinlock_release(&pi->lk);
+    return done;
+}
+
+/**
+ * @brief 管道一端当前的状态 (poll / epoll使用)
+ * @param pi 管道
+ * @param writable true=写端, false=读端
+ * @param head 输出：这一端的源
+ * @return 读端: POLLIN (有数据) | POLLHUP (写端已关闭); 写端: POLLOUT (不满) | POLLERR (读端已关闭)
+ */
+uint32 pipe_poll(pipe_t* pi, bool writable, poll_head_t** head)
+{
+    uint32 mask = 0;
+    spinlock_acquire(&pi->lk);
+    if (writable) {
+        if (pi->nwrite - pi->nread < PIPE_SIZE) mask |= POLLOUT;
+        if (!pi->readopen) mask |= POLLERR;
+    } else {
+        if (!pipe_empty(pi)) mask |= POLLIN;
+        if (!pi->writeopen) mask |= POLLHUP;
+    }
+    spinlock_release(&pi->lk);
+    *head = writable ? &pi->wph : &pi->rph;
+    return mask;
+}
+
+/**
+ * @brief 把一个页引用排入管道, 读者读到这里时直接从这一页复制 (splice / vmsplice)
+ * @param pi 管道
+ * @param buf 页引用 (off / len / pa / pg, at由这里填写), 成功时引用转交给管道
+ * @return 成功返回0, 读端已关闭返回-1（引用仍属于调用者）
+ * @note 队列满时睡眠, 直到读者取走一个页引用或读端关闭
+ */
+int pipe_give(pipe_t* pi, pipe_buf_t* buf)
+{
+    assert(buf->len > 0 && buf->off + buf->len <= PGSIZE, "pipe_give: invalid page range");
+    spinlock_acquire(&pi->lk);
+    while (pi->readopen && pi->btail - pi->bhead == PIPE_BUFS) {
+        proc_sleep(&pi->nwrite, &pi->lk);
+    }
+    if (!pi->readopen) {
+        spinlock_release(&pi->lk);
+        return -1;
+    }
+
+    // 排在已经写入的字节之后; 读者只会在缓冲区为空时睡眠
+    bool was_empty = pipe_empty(pi);
+    buf->at = pi->nwrite;
+    pi->bufs[pi->btail % PIPE_BUFS] = *buf;
+    pi->btail++;
+    if (was_empty) {
+        proc_wakeup(&pi->nread);
+        poll_wake(&pi->rph, POLLIN);
+    }
+    spinlock_release(&pi->lk);
+    return 0;
+}
+
+/**
+ * @brief 从管道开头取出最多len字节, 作为一个页引用交给调用者 (splice的发送方是管道)
+ * @param pi 管道
+ * @param len 最多取出的字节数
+ * @param buf 输出：页引用（调用者用完后pipe_buf_put）
+ * @param wait 缓冲区为空时是否等待写者
+ * @return 取出的字节数（为空且不等待或写端已关闭时返回0, 内存不足返回0）
+ * @note 开头是整个页引用时直接转交, 不复制; 环形缓冲区中的字节或页引用的一部分复制到一个新页 (最多一页)
+ */
+uint32 pipe_take(pipe_t* pi, uint32 len, pipe_buf_t* buf, bool wait)
+{
+    uint8* tmp = NULL;
+    uint32 n = 0;
+    spinlock_acquire(&pi->lk);
+    while (len > 0) {
+        // 1. 缓冲区为空: 等待写者（不等待或写端关闭则返回0）
+        if (pipe_empty(pi)) {
+            if (!wait || !pi->writeopen) {
+                break;
+            }
+            proc_sleep(&pi->nread, &pi->lk);
+            continue;
+        }
+        bool was_full = pipe_full(pi);
+        pipe_buf_t* b = pipe_head_buf(pi);
+
+        // 2. 整个页引用: 直接转交
+        if (b != NULL && b->len <= len) {
+            *buf = *b;
+            n = b->len;
+            pi->bhead++;
+        } else {
+            // 3. 需要复制: 在锁外申请新页后重新检查（期间其他读者可能已经取走了数据）
+            if (tmp == NULL) {
+                spinlock_release(&pi->lk);
+                tmp = (uint8*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_FILE));  // 只读取复制过的部分, 不需要清零
+                if (tmp == NULL) {
+                    return 0;
+                }
+                spinlock_acquire(&pi->lk);
+                continue;
+            }
+            if (b != NULL) {
+                n = len;
+                memmove(tmp, (uint8*)(b->pa + b->off), n);
+                b->off += n;
+                b->len -= n;
+            } else {
+                // 环形缓冲区不超过一页, 环绕时分两段
+                uint32 pos = pi->nread % PIPE_SIZE;
+                n = pipe_ring_avail(pi);
+                if (n > len) n = len;
+                uint32 first = (n < PIPE_SIZE - pos) ? n : PIPE_SIZE - pos;
+                memmove(tmp, pi->data + pos, first);
+                memmove(tmp + first, pi->data, n - first);
+                pi->nread += n;
+            }
+            buf->off = 0;
+            buf->len = n;
+            buf->pa = (uint64)tmp;
+            buf->pg = NULL;
+            tmp = NULL;
+        }
+
+        // 4. 写者只会在缓冲区满时睡眠
+        if (was_full) {
+            proc_wakeup(&pi->nwrite);
+            poll_wake(&pi->wph, POLLOUT);
+        }
+        break;
+    }
+    spinlock_release(&pi->lk);
+    if (tmp != NULL) {
+        pmem_free((uint64)tmp, true);
+    }
+    return n;
+}
+
+/**
+ * @brief 放弃一个页引用 (页缓存页ref--, 其他页放弃pmem引用, 最后一个引用时释放)
+ * @param buf 页引用
+ */
+void pipe_buf_put(pipe_buf_t* buf)
+{
+    if (buf->pg != NULL) {
+        pcache_put(buf->pg);
+    } else {
+        pmem_put(buf->pa);
+    }
+}
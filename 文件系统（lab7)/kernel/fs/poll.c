@@ -0,0 +1,452 @@
+#include "fs/poll.h"
+#include "fs/file.h"
+#include "fs/pipe.h"
+#include "dev/timer.h"
+#include "mem/pmem.h"
+#include "mem/slab.h"
+#include "mem/vmem.h"
+#include "proc/cpu.h"
+#include "proc/proc.h"
+#include "lib/print.h"
+#include "lib/str.h"
+
+// 就绪通知 (见fs/poll.h)
+
+extern dev_t devlist[N_DEV];
+
+static kmem_cache_t entry_cache;
+static kmem_cache_t epoll_cache;
+
+void poll_init()
+{
+    kmem_cache_init(&entry_cache, "poll_entry", sizeof(poll_entry_t), MEMTAG_FILE);
+    kmem_cache_init(&epoll_cache, "epoll", sizeof(epoll_t), MEMTAG_FILE);
+}
+
+void poll_head_init(poll_head_t* head, char* name)
+{
+    spinlock_init(&head->lk, name);
+    head->entries = NULL;
+}
+
+// 文件当前的状态 (可能包含events之外的事件), head非NULL时输出等待的源 (NULL: 没有源)
+static uint32 poll_file(file_t* file, poll_head_t** head)
+{
+    poll_head_t* h = NULL;
+    uint32 mask = 0;
+    if (file->type == FD_PIPE) {
+        mask = pipe_poll(file->pipe, file->writable, &h);
+    } else if (file->type == FD_DEVICE && file->major < N_DEV && devlist[file->major].poll != NULL) {
+        mask = devlist[file->major].poll(&h);
+    } else {
+        mask = POLLIN | POLLOUT;
+    }
+    if (!file->readable) mask &= ~POLLIN;
+    if (!file->writable) mask &= ~POLLOUT;
+    if (head) *head = h;
+    return mask;
+}
+
+// 把项放到就绪链表尾部 (已经在链表中时不变), 调用者持有ep->lk
+static void ready_push(epoll_t* ep, poll_entry_t* e)
+{
+    if (e->ready) {
+        return;
+    }
+    e->ready = true;
+    e->ready_next = NULL;
+    if (ep->ready_tail != NULL) {
+        ep->ready_tail->ready_next = e;
+    } else {
+        ep->ready_head = e;
+    }
+    ep->ready_tail = e;
+}
+
+// 把项移出就绪链表, 调用者持有ep->lk
+static void ready_remove(epoll_t* ep, poll_entry_t* e)
+{
+    if (!e->ready) {
+        return;
+    }
+    poll_entry_t* prev = NULL;
+    for (poll_entry_t* x = ep->ready_head; x != e; x = x->ready_next) {
+        prev = x;
+    }
+    if (prev != NULL) {
+        prev->ready_next = e->ready_next;
+    } else {
+        ep->ready_head = e->ready_next;
+    }
+    if (ep->ready_tail == e) {
+        ep->ready_tail = prev;
+    }
+    e->ready = false;
+}
+
+// 项就绪: 放入就绪链表并唤醒实例的等待者
+static void entry_ready(poll_entry_t* e)
+{
+    epoll_t* ep = e->ep;
+    spinlock_acquire(&ep->lk);
+    ready_push(ep, e);
+    proc_wakeup(ep);
+    spinlock_release(&ep->lk);
+}
+
+/**
+ * @brief 源上发生了mask中的事件: 唤醒关心这些事件的项所属的实例
+ * @param head 源
+ * @param mask POLLIN / POLLOUT / POLLERR / POLLHUP
+ * @note 调用者持有源的锁 (改变状态的同一个临界区中), 所以没有项时可以不加锁直接返回:
+ *       加入项的一方在head->lk下挂上项之后才会在源的锁下检查状态
+ */
+void poll_wake(poll_head_t* head, uint32 mask)
+{
+    if (head->entries == NULL) {
+        return;
+    }
+    spinlock_acquire(&head->lk);
+    for (poll_entry_t* e = head->entries; e != NULL; e = e->head_next) {
+        if (mask & (e->events | POLLERR | POLLHUP)) {
+            entry_ready(e);
+        }
+    }
+    spinlock_release(&head->lk);
+}
+
+static void epoll_setup(epoll_t* ep)
+{
+    sleeplock_init(&ep->slk, "epoll");
+    spinlock_init(&ep->lk, "epoll ready");
+    ep->items = NULL;
+    ep->ready_head = NULL;
+    ep->ready_tail = NULL;
+}
+
+/**
+ * @brief 监视一个文件: 先挂到源上再检查状态, 其间发生的事件不会丢失
+ * @param ep 实例 (调用者持有ep->slk, 或者实例还不可见)
+ * @param file 文件 (成功时项接管这个引用)
+ * @return 新的项, 内存不足返回NULL
+ */
+static poll_entry_t* entry_add(epoll_t* ep, int fd, file_t* file, uint32 events, uint64 data)
+{
+    poll_entry_t* e = (poll_entry_t*)kmem_cache_alloc(&entry_cache);
+    if (e == NULL) {
+        return NULL;
+    }
+    e->ep = ep;
+    e->file = file;
+    e->fd = fd;
+    e->events = events & (POLLIN | POLLOUT);
+    e->data = data;
+    e->ready = false;
+    e->ready_next = NULL;
+    e->next = ep->items;
+    ep->items = e;
+
+    // 1. 挂到源上
+    poll_file(file, &e->head);
+    if (e->head != NULL) {
+        spinlock_acquire(&e->head->lk);
+        e->head_next = e->head->entries;
+        e->head->entries = e;
+        spinlock_release(&e->head->lk);
+    }
+
+    // 2. 已经就绪 (或者没有源) 的项直接进入就绪链表
+    if (poll_file(file, NULL) & (e->events | POLLERR | POLLHUP)) {
+        spinlock_acquire(&ep->lk);
+        ready_push(ep, e);
+        spinlock_release(&ep->lk);
+    }
+    return e;
+}
+
+// 释放项: 从源和就绪链表上摘下, 关闭文件 (调用者已经把它移出ep->items)
+static void entry_release(epoll_t* ep, poll_entry_t* e)
+{
+    if (e->head != NULL) {
+        spinlock_acquire(&e->head->lk);
+        poll_entry_t** link = &e->head->entries;
+        while (*link != e) {
+            link = &(*link)->head_next;
+        }
+        *link = e->head_next;
+        spinlock_release(&e->head->lk);
+    }
+    spinlock_acquire(&ep->lk);
+    ready_remove(ep, e);
+    spinlock_release(&ep->lk);
+
+    // 源上已经没有这个项, 关闭文件时的唤醒 (pipe_close) 不会再访问它
+    file_close(e->file);
+    kmem_cache_free(&entry_cache, e);
+}
+
+// 释放实例的所有项
+static void epoll_teardown(epoll_t* ep)
+{
+    while (ep->items != NULL) {
+        poll_entry_t* e = ep->items;
+        ep->items = e->next;
+        entry_release(ep, e);
+    }
+}
+
+/**
+ * @brief 取出就绪链表中的至多max项重新检查, 仍然就绪的报告并放回链表尾部 (水平触发)
+ * @param out 输出的事件 (内核地址)
+ * @return 报告的事件数
+ * @note 调用者持有ep->slk (项不会被释放); 检查状态时不持有ep->lk
+ */
+static int epoll_scan(epoll_t* ep, epoll_event_t* out, int max)
+{
+    poll_entry_t* batch[EPOLL_MAX];
+    int n = 0, nout = 0;
+
+    // 1. 摘下就绪链表的前max项 (之后到来的事件会把它们重新放回)
+    spinlock_acquire(&ep->lk);
+    while (n < max && ep->ready_head != NULL) {
+        poll_entry_t* e = ep->ready_head;
+        ep->ready_head = e->ready_next;
+        if (ep->ready_head == NULL) {
+            ep->ready_tail = NULL;
+        }
+        e->ready = false;
+        batch[n++] = e;
+    }
+    spinlock_release(&ep->lk);
+
+    // 2. 事件可能已经被消耗 (例如其他进程读空了管道), 这样的项不报告, 等待下一次事件
+    for (int i = 0; i < n; i++) {
+        poll_entry_t* e = batch[i];
+        uint32 mask = poll_file(e->file, NULL) & (e->events | POLLERR | POLLHUP);
+        if (mask == 0) {
+            continue;
+        }
+        out[nout].events = mask;
+        out[nout].data = e->data;
+        nout++;
+        spinlock_acquire(&ep->lk);
+        ready_push(ep, e);
+        spinlock_release(&ep->lk);
+    }
+    return nout;
+}
+
+/**
+ * @brief 等待实例中的项就绪
+ * @param out 输出的事件 (内核地址, 至少max项)
+ * @param timeout 毫秒, 0: 不等待, 负数: 永远等待
+ * @return 报告的事件数 (超时返回0)
+ */
+static int epoll_wait_events(epoll_t* ep, epoll_event_t* out, int max, int timeout)
+{
+    uint64 expire = timer_get_mtime() + (uint64)timeout * 1000 * TIMER_MTIME_PER_US;
+
+    for (;;) {
+        // 1. 只检查就绪链表中的项
+        sleeplock_acquire(&ep->slk);
+        int n = epoll_scan(ep, out, max);
+        sleeplock_release(&ep->slk);
+        if (n > 0 || timeout == 0) {
+            return n;
+        }
+
+        // 2. 睡眠到有项被放入就绪链表 (或超时)
+        bool timedout = false;
+        spinlock_acquire(&ep->lk);
+        while (ep->ready_head == NULL && !timedout) {
+            if (timeout < 0) {
+                proc_sleep(ep, &ep->lk);
+            } else {
+                timedout = proc_sleep_until(ep, &ep->lk, expire);
+            }
+        }
+        spinlock_release(&ep->lk);
+
+        // 3. 超时后最后检查一次
+        if (timedout) {
+            timeout = 0;
+        }
+    }
+}
+
+/**
+ * @brief sys_poll: 等待一组fd中的任意一个就绪
+ * @param fds 用户的pollfd数组 (返回时写回revents)
+ * @param nfds 数组长度 (不超过POLL_MAX)
+ * @param timeout 毫秒, 0: 不等待, -1: 永远等待
+ * @return revents非0的fd数 (超时返回0), 失败返回-1
+ * @note 临时实例在内核栈上; pollfd数组和报告的事件放在一个内核页中
+ */
+int poll_fds(uint64 fds, uint32 nfds, int timeout)
+{
+    if (nfds > POLL_MAX) {
+        return -1;
+    }
+    uint8* page = (uint8*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+    if (page == NULL) {
+        return -1;
+    }
+    pollfd_t* pfd = (pollfd_t*)page;
+    epoll_event_t* out = (epoll_event_t*)(page + PGSIZE / 2);
+    uvm_copyin(myproc()->mm->pgtbl, (uint64)pfd, fds, nfds * sizeof(pollfd_t));
+
+    // 1. 每个有效的fd一个项 (无效的fd报告POLLNVAL, 不再等待)
+    epoll_t ep;
+    epoll_setup(&ep);
+    int ret = 0;
+    for (uint32 i = 0; i < nfds; i++) {
+        pfd[i].revents = 0;
+        if (pfd[i].fd < 0) {
+            continue;
+        }
+        file_t* file = proc_fd_dup(myproc(), pfd[i].fd);
+        if (file == NULL) {
+            pfd[i].revents = POLLNVAL;
+            ret++;
+            continue;
+        }
+        if (entry_add(&ep, pfd[i].fd, file, (uint16)pfd[i].events, i) == NULL) {
+            file_close(file);
+            ret = -1;
+            break;
+        }
+    }
+
+    // 2. 等待并写回revents
+    if (ret >= 0) {
+        int n = epoll_wait_events(&ep, out, nfds, ret > 0 ? 0 : timeout);
+        for (int k = 0; k < n; k++) {
+            pfd[out[k].data].revents = out[k].events;
+        }
+        ret += n;
+        uvm_copyout(myproc()->mm->pgtbl, fds, (uint64)pfd, nfds * sizeof(pollfd_t));
+    }
+
+    epoll_teardown(&ep);
+    pmem_free((uint64)page, true);
+    return ret;
+}
+
+/**
+ * @brief 创建一个空的监视集合
+ * @return FD_EPOLL类型的文件 (可读, 只用于epoll_ctl / epoll_wait), 内存不足返回NULL
+ */
+file_t* epoll_create()
+{
+    epoll_t* ep = (epoll_t*)kmem_cache_alloc(&epoll_cache);
+    if (ep == NULL) {
+        return NULL;
+    }
+    file_t* file = file_alloc();
+    if (file == NULL) {
+        kmem_cache_free(&epoll_cache, ep);
+        return NULL;
+    }
+    epoll_setup(ep);
+    file->type = FD_EPOLL;
+    file->readable = true;
+    file->ep = ep;
+    return file;
+}
+
+// 最后一个引用关闭 (file_close): 关闭所有项的文件并释放实例
+void epoll_close(epoll_t* ep)
+{
+    epoll_teardown(ep);
+    kmem_cache_free(&epoll_cache, ep);
+}
+
+/**
+ * @brief 修改监视集合
+ * @param ep 实例
+ * @param op EPOLL_CTL_ADD / EPOLL_CTL_DEL / EPOLL_CTL_MOD
+ * @param fd 监视的fd (项持有文件的引用: 关闭fd不会移除项, 需要EPOLL_CTL_DEL)
+ * @param event 用户的epoll_event_t (ADD / MOD: 关心的事件和data)
+ * @return 成功返回0, fd无效 / 已经加入(ADD) / 没有加入(DEL MOD) / 是另一个epoll 返回-1
+ */
+int epoll_ctl(epoll_t* ep, int op, int fd, uint64 event)
+{
+    epoll_event_t ev;
+    if (op != EPOLL_CTL_DEL) {
+        if (event == 0) {
+            return -1;
+        }
+        uvm_copyin(myproc()->mm->pgtbl, (uint64)&ev, event, sizeof(ev));
+    }
+
+    sleeplock_acquire(&ep->slk);
+    poll_entry_t** link = &ep->items;
+    while (*link != NULL && (*link)->fd != fd) {
+        link = &(*link)->next;
+    }
+    poll_entry_t* e = *link;
+    int ret = 0;
+
+    switch (op) {
+    case EPOLL_CTL_ADD: {
+        file_t* file = (e == NULL) ? proc_fd_dup(myproc(), fd) : NULL;
+        if (file == NULL) {
+            ret = -1;
+        } else if (file->type == FD_EPOLL || entry_add(ep, fd, file, ev.events, ev.data) == NULL) {
+            // 不支持嵌套的实例
+            file_close(file);
+            ret = -1;
+        }
+        break;
+    }
+    case EPOLL_CTL_DEL:
+        if (e == NULL) {
+            ret = -1;
+            break;
+        }
+        *link = e->next;
+        entry_release(ep, e);
+        break;
+    case EPOLL_CTL_MOD:
+        if (e == NULL) {
+            ret = -1;
+            break;
+        }
+        e->events = ev.events & (POLLIN | POLLOUT);
+        e->data = ev.data;
+        if (poll_file(e->file, NULL) & (e->events | POLLERR | POLLHUP)) {
+            entry_ready(e);
+        }
+        break;
+    default:
+        ret = -1;
+    }
+
+    sleeplock_release(&ep->slk);
+    return ret;
+}
+
+/**
+ * @brief 等待监视集合中的项就绪
+ * @param ep 实例
+ * @param events 用户的epoll_event_t数组
+ * @param max 数组长度 (1 ~ EPOLL_MAX)
+ * @param timeout 毫秒, 0: 不等待, -1: 永远等待
+ * @return 报告的事件数 (超时返回0), 失败返回-1
+ */
+int epoll_wait(epoll_t* ep, uint64 events, int max, int timeout)
+{
+    if (max <= 0 || max > EPOLL_MAX) {
+        return -1;
+    }
+    epoll_event_t* out = (epoll_event_t*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+    if (out == NULL) {
+        return -1;
+    }
+    int n = epoll_wait_events(ep, out, max, timeout);
+    if (n > 0) {
+        uvm_copyout(myproc()->mm->pgtbl, events, (uint64)out, n * sizeof(epoll_event_t));
+    }
+    pmem_free((uint64)out, true);
+    return n;
+}
@@ -0,0 +1,348 @@
+#include "fs/procfs.h"
+#include "fs/file.h"
+#include "fs/buf.h"
+#include "fs/tmpfs.h"
+#include "dev/plic.h"
+#include "mem/pmem.h"
+#include "mem/swap.h"
+#include "mem/vmem.h"
+#include "proc/cpu.h"
+#include "proc/proc.h"
+#include "syscall/syscall.h"
+#include "syscall/sysnum.h"
+#include "lib/bootopt.h"
+#include "lib/kstat.h"
+#include "lib/lockstat.h"
+#include "lib/print.h"
+#include "lib/str.h"
+
+// /proc下的统计文件 (见fs/procfs.h)
+
+static char* proc_state_name[] = {
+    [UNUSED]    "unused",
+    [RUNNABLE]  "runnable",
+    [RUNNING]   "running",
+    [SLEEPING]  "sleeping",
+    [ZOMBIE]    "zombie",
+};
+
+static uint32 procfs_bufcache(char* buf, uint32 size)
+{
+    buf_stat_t st;
+    buf_stat(&st);
+    uint32 n = 0;
+    n += ksnprintf(buf + n, size - n, "nbuf %ld\n", st.nbuf);
+    n += ksnprintf(buf + n, size - n, "lookups %ld\n", st.lookups);
+    n += ksnprintf(buf + n, size - n, "hits %ld\n", st.hits);
+    n += ksnprintf(buf + n, size - n, "misses %ld\n", st.misses);
+    n += ksnprintf(buf + n, size - n, "evictions %ld\n", st.evictions);
+    n += ksnprintf(buf + n, size - n, "disk_reads %ld\n", st.disk_reads);
+    n += ksnprintf(buf + n, size - n, "sync_writes %ld\n", st.sync_writes);
+    n += ksnprintf(buf + n, size - n, "writebacks %ld\n", st.writebacks);
+    n += ksnprintf(buf + n, size - n, "prefetches %ld\n", st.prefetches);
+    n += ksnprintf(buf + n, size - n, "slk_wait %ld\n", st.slk_wait);
+    return n;
+}
+
+static uint32 procfs_meminfo(char* buf, uint32 size)
+{
+    kstat_t ks;
+    uint32 nslot, used;
+    kstat_read(&ks);
+    swap_usage(&nslot, &used);
+    uint32 n = 0;
+    n += ksnprintf(buf + n, size - n, "kernel_pages %d\n", pmem_total_pages(true));
+    n += ksnprintf(buf + n, size - n, "kernel_free %d\n", pmem_free_pages(true));
+    n += ksnprintf(buf + n, size - n, "user_pages %d\n", pmem_total_pages(false));
+    n += ksnprintf(buf + n, size - n, "user_free %d\n", pmem_free_pages(false));
+    n += ksnprintf(buf + n, size - n, "swap_slots %d\n", nslot);
+    n += ksnprintf(buf + n, size - n, "swap_used %d\n", used);
+    n += ksnprintf(buf + n, size - n, "tmpfs_pages %d\n", tmpfs_pages());
+    n += ksnprintf(buf + n, size - n, "page_faults %ld\n", ks.page_faults);
+    n += ksnprintf(buf + n, size - n, "cow_faults %ld\n", ks.cow_faults);
+    n += ksnprintf(buf + n, size - n, "swap_outs %ld\n", ks.swap_outs);
+    n += ksnprintf(buf + n, size - n, "swap_ins %ld\n", ks.swap_ins);
+
+    // 各用途的内核内存, 之后的各列是各hart上申请页和对象的次数
+    n += ksnprintf(buf + n, size - n, "tag pages pages_max objs objs_max");
+    for (int hart = 0; hart < ncpu; hart++) {
+        n += ksnprintf(buf + n, size - n, " hart%d", hart);
+    }
+    n += ksnprintf(buf + n, size - n, "\n");
+    for (uint32 tag = MEMTAG_NONE + 1; tag < N_MEMTAG; tag++) {
+        memtag_stat_t st;
+        memtag_read(tag, &st);
+        n += ksnprintf(buf + n, size - n, "%s %ld %ld %ld %ld",
+                       memtag_name[tag], st.pages, st.pages_max, st.objs, st.objs_max);
+        for (int hart = 0; hart < ncpu; hart++) {
+            n += ksnprintf(buf + n, size - n, " %ld", st.allocs[hart]);
+        }
+        n += ksnprintf(buf + n, size - n, "\n");
+    }
+    return n;
+}
+
+static uint32 procfs_locks(char* buf, uint32 size)
+{
+#ifdef LOCK_STAT
+    uint8 order[N_LOCK_CLASS];
+    int count = lockstat_report(order);
+    uint32 n = ksnprintf(buf, size, "name acquires contended wait_cycles hold_max\n");
+    for (int i = 0; i < count; i++) {
+        lockstat_t st;
+        lockstat_read(order[i], &st, false);
+        n += ksnprintf(buf + n, size - n, "%s %ld %ld %ld %ld\n",
+                       st.name, st.acquires, st.contended, st.wait_cycles, st.hold_max);
+    }
+    return n;
+#else
+    return ksnprintf(buf, size, "lock statistics not compiled in (make LOCK_STAT=1)\n");
+#endif
+}
+
+static uint32 procfs_syscalls(char* buf, uint32 size)
+{
+    uint32 n = ksnprintf(buf, size, "num calls errors time max\n");
+    for (int num = 0; num <= SYS_MAX; num++) {
+        sysstat_t st;
+        syscall_stat(num, &st);
+        if (st.calls == 0) {
+            continue;
+        }
+        n += ksnprintf(buf + n, size - n, "%d %ld %ld %ld %ld\n", num, st.calls, st.errors, st.time, st.max);
+    }
+    return n;
+}
+
+// 有过中断或设置了亲和性的中断源
+static uint32 procfs_interrupts(char* buf, uint32 size)
+{
+    uint32 n = ksnprintf(buf, size, "irq");
+    for (int hart = 0; hart < ncpu; hart++) {
+        n += ksnprintf(buf + n, size - n, " hart%d", hart);
+    }
+    n += ksnprintf(buf + n, size - n, " affinity\n");
+    for (int irq = 1; irq < PLIC_NIRQ; irq++) {
+        uint32 mask = plic_get_affinity(irq);
+        uint64 total = 0;
+        for (int hart = 0; hart < ncpu; hart++) {
+            total += plic_count(irq, hart);
+        }
+        if (mask == 0 && total == 0) {
+            continue;
+        }
+        n += ksnprintf(buf + n, size - n, "%d", irq);
+        for (int hart = 0; hart < ncpu; hart++) {
+            n += ksnprintf(buf + n, size - n, " %ld", plic_count(irq, hart));
+        }
+        n += ksnprintf(buf + n, size - n, " %x\n", mask);
+    }
+    return n;
+}
+
+// 定点数 (FSHIFT位小数) 保留两位小数 (ksnprintf不支持宽度)
+static uint32 procfs_fixed(char* buf, uint32 size, uint64 v)
+{
+    uint64 frac = ((v & (FIXED_1 - 1)) * 100) >> FSHIFT;
+    return ksnprintf(buf, size, "%ld.%ld%ld", v >> FSHIFT, frac / 10, frac % 10);
+}
+
+// 1/5/15分钟的负载均值和当前可运行的进程数
+static uint32 procfs_loadavg(char* buf, uint32 size)
+{
+    uint64 avg[3];
+    int running;
+    proc_loadavg(avg, &running);
+    uint32 n = 0;
+    for (int i = 0; i < 3; i++) {
+        n += procfs_fixed(buf + n, size - n, avg[i]);
+        n += ksnprintf(buf + n, size - n, " ");
+    }
+    n += ksnprintf(buf + n, size - n, "%d\n", running);
+    return n;
+}
+
+// 每个hart的用户态/内核态/空闲时间和运行队列等待时间 (mtime单位), 以及切换到进程的次数
+static uint32 procfs_cpustat(char* buf, uint32 size)
+{
+    uint64 now = timer_get_mtime();
+    uint32 n = ksnprintf(buf, size, "hart user system idle wait switches\n");
+    for (int hart = 0; hart < ncpu; hart++) {
+        hart_stat_t st = cpu_of(hart)->st;
+        uint64 busy = st.user + st.system;
+        uint64 idle = (now > busy) ? now - busy : 0;
+        n += ksnprintf(buf + n, size - n, "%d %ld %ld %ld %ld %ld\n",
+                       hart, st.user, st.system, idle, st.wait, st.switches);
+    }
+    return n;
+}
+
+// 进程不存在(或已退出)时返回0
+static uint32 procfs_pid_stat(int pid, char* buf, uint32 size)
+{
+    proc_info_t info;
+    if (!proc_info(pid, &info)) {
+        return 0;
+    }
+    uint32 n = 0;
+    n += ksnprintf(buf + n, size - n, "pid %d\n", info.pid);
+    n += ksnprintf(buf + n, size - n, "ppid %d\n", info.ppid);
+    n += ksnprintf(buf + n, size - n, "state %s\n", proc_state_name[info.state]);
+    n += ksnprintf(buf + n, size - n, "kthread %d\n", info.kthread ? 1 : 0);
+    n += ksnprintf(buf + n, size - n, "prio %d\n", info.prio);
+    n += ksnprintf(buf + n, size - n, "base_prio %d\n", info.base_prio);
+    n += ksnprintf(buf + n, size - n, "cpu %d\n", info.cpu);
+    n += ksnprintf(buf + n, size - n, "cpu_mask %x\n", info.cpu_mask);
+    n += ksnprintf(buf + n, size - n, "last_ran %ld\n", info.last_ran);
+    n += ksnprintf(buf + n, size - n, "syscalls %ld\n", info.syscalls);
+    n += ksnprintf(buf + n, size - n, "sys_errors %ld\n", info.sys_errors);
+    n += ksnprintf(buf + n, size - n, "sys_time %ld\n", info.sys_time);
+    n += ksnprintf(buf + n, size - n, "utime %ld\n", info.cstat.utime);
+    n += ksnprintf(buf + n, size - n, "stime %ld\n", info.cstat.stime);
+    n += ksnprintf(buf + n, size - n, "wait_time %ld\n", info.cstat.wait_time);
+    n += ksnprintf(buf + n, size - n, "nvcsw %ld\n", info.cstat.nvcsw);
+    n += ksnprintf(buf + n, size - n, "nivcsw %ld\n", info.cstat.nivcsw);
+    n += ksnprintf(buf + n, size - n, "cutime %ld\n", info.cstat.cutime);
+    n += ksnprintf(buf + n, size - n, "cstime %ld\n", info.cstat.cstime);
+    n += ksnprintf(buf + n, size - n, "minor_faults %ld\n", info.mstat.minor_faults);
+    n += ksnprintf(buf + n, size - n, "major_faults %ld\n", info.mstat.major_faults);
+    n += ksnprintf(buf + n, size - n, "cow_copies %ld\n", info.mstat.cow_copies);
+    n += ksnprintf(buf + n, size - n, "swap_outs %ld\n", info.mstat.swap_outs);
+    n += ksnprintf(buf + n, size - n, "swap_ins %ld\n", info.mstat.swap_ins);
+    n += ksnprintf(buf + n, size - n, "fault_around %ld\n", info.mstat.fault_around);
+    n += ksnprintf(buf + n, size - n, "rchar %ld\n", info.io.rchar);
+    n += ksnprintf(buf + n, size - n, "wchar %ld\n", info.io.wchar);
+    n += ksnprintf(buf + n, size - n, "buf_hits %ld\n", info.io.buf_hits);
+    n += ksnprintf(buf + n, size - n, "buf_misses %ld\n", info.io.buf_misses);
+    n += ksnprintf(buf + n, size - n, "disk_reqs %ld\n", info.io.disk_reqs);
+    n += ksnprintf(buf + n, size - n, "read_blocks %ld\n", info.io.read_blocks);
+    n += ksnprintf(buf + n, size - n, "write_blocks %ld\n", info.io.write_blocks);
+    return n;
+}
+
+// "<pid>/stat" 或 "self/stat", 返回pid, 不匹配返回-1
+static int procfs_parse_pid(char* path)
+{
+    int pid = 0;
+    if (strncmp(path, "self/", 5) == 0) {
+        pid = myproc()->pid;
+        path += 4;
+    } else {
+        if (*path < '0' || *path > '9') {
+            return -1;
+        }
+        while (*path >= '0' && *path <= '9') {
+            pid = pid * 10 + (*path - '0');
+            path++;
+        }
+    }
+    if (strncmp(path, "/stat", 6) != 0) {
+        return -1;
+    }
+    return pid;
+}
+
+file_t* procfs_open(char* path, uint32 open_mode)
+{
+    uint16 node;
+    int pid = 0;
+
+    // 1. 只读
+    if (open_mode & (MODE_CREATE | MODE_WRITE)) {
+        return NULL;
+    }
+
+    // 2. 路径对应的节点
+    if (strncmp(path, "bufcache", 9) == 0) {
+        node = PROC_BUFCACHE;
+    } else if (strncmp(path, "meminfo", 8) == 0) {
+        node = PROC_MEMINFO;
+    } else if (strncmp(path, "locks", 6) == 0) {
+        node = PROC_LOCKS;
+    } else if (strncmp(path, "syscalls", 9) == 0) {
+        node = PROC_SYSCALLS;
+    } else if (strncmp(path, "interrupts", 11) == 0) {
+        node = PROC_INTERRUPTS;
+    } else if (strncmp(path, "loadavg", 8) == 0) {
+        node = PROC_LOADAVG;
+    } else if (strncmp(path, "cpustat", 8) == 0) {
+        node = PROC_CPUSTAT;
+    } else if (strncmp(path, "cmdline", 8) == 0) {
+        node = PROC_CMDLINE;
+    } else {
+        proc_info_t info;
+        pid = procfs_parse_pid(path);
+        if (pid <= 0 || !proc_info(pid, &info)) {
+            return NULL;
+        }
+        node = PROC_PID_STAT;
+    }
+
+    // 3. 文件项 (没有inode)
+    file_t* file = file_alloc();
+    if (file == NULL) {
+        return NULL;
+    }
+    file->type = FD_PROC;
+    file->readable = true;
+    file->proc_node = node;
+    file->proc_pid = pid;
+    return file;
+}
+
+uint32 procfs_read(file_t* file, uint32 len, uint64 dst, bool user)
+{
+    char* buf = (char*)pmem_alloc_order(PROCFS_BUF_ORDER);
+    if (buf == NULL) {
+        return -1;
+    }
+
+    // 1. 生成整个文本
+    uint32 n = 0;
+    switch (file->proc_node) {
+        case PROC_BUFCACHE:
+            n = procfs_bufcache(buf, PROCFS_BUF);
+            break;
+        case PROC_MEMINFO:
+            n = procfs_meminfo(buf, PROCFS_BUF);
+            break;
+        case PROC_LOCKS:
+            n = procfs_locks(buf, PROCFS_BUF);
+            break;
+        case PROC_SYSCALLS:
+            n = procfs_syscalls(buf, PROCFS_BUF);
+            break;
+        case PROC_INTERRUPTS:
+            n = procfs_interrupts(buf, PROCFS_BUF);
+            break;
+        case PROC_LOADAVG:
+            n = procfs_loadavg(buf, PROCFS_BUF);
+            break;
+        case PROC_CPUSTAT:
+            n = procfs_cpustat(buf, PROCFS_BUF);
+            break;
+        case PROC_CMDLINE:
+            n = ksnprintf(buf, PROCFS_BUF, "%s\n", bootopt_args());
+            break;
+        case PROC_PID_STAT:
+            n = procfs_pid_stat(file->proc_pid, buf, PROCFS_BUF);
+            break;
+        default:
+            panic("procfs_read: invalid node");
+    }
+
+    // 2. 从偏移量处复制
+    uint32 ret = 0;
+    if (file->offset < n) {
+        ret = n - file->offset;
+        if (ret > len) ret = len;
+        if (user) {
+            uvm_copyout(myproc()->mm->pgtbl, dst, (uint64)(buf + file->offset), ret);
+        } else {
+            memmove((void*)dst, buf + file->offset, ret);
+        }
+        file->offset += ret;
+    }
+    pmem_free_order((uint64)buf, PROCFS_BUF_ORDER);
+    return ret;
+}
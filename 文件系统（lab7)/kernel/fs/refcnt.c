@@ -0,0 +1,150 @@
+#include "fs/fs.h"
+#include "fs/buf.h"
+#include "fs/journal.h"
+#include "fs/bitmap.h"
+#include "fs/refcnt.h"
+#include "lib/lock.h"
+#include "lib/print.h"
+#include "lib/klog.h"
+#include "lib/str.h"
+
+/*
+    数据块引用计数表 (见fs/refcnt.h)
+    refcnt_lk只串行化表的创建; 表创建后位置不再改变, 各项由表块buf的睡眠锁保护,
+    同一数据块的计数只由持有(某个)共享它的inode睡眠锁的进程修改
+    创建: 先在日志操作中分配连续的块并提交 (位图落盘), 再清零表块并落盘, 最后把位置写进超级块;
+    中途崩溃只会泄漏这些块 (位图中已用、没有被引用), 不会出现没有清零的表
+*/
+
+extern super_block_t sb;
+
+static sleeplock_t refcnt_lk;
+
+void refcnt_init()
+{
+    sleeplock_init(&refcnt_lk, "refcnt");
+}
+
+// 表中记录block的项所在的表块, *idx输出块内的项序号
+static uint32 refcnt_locate(uint32 block, uint32* idx)
+{
+    assert(block >= sb.data_start && block - sb.data_start < sb.data_blocks, "refcnt: invalid data block num");
+    uint32 i = block - sb.data_start;
+    *idx = i % REFCNT_PER_BLOCK;
+    return sb.refcnt_start + i / REFCNT_PER_BLOCK;
+}
+
+/**
+ * @brief 没有引用计数表时创建（第一次克隆文件时调用）
+ * @return 成功（或表已存在）返回0, 数据区中没有足够长的连续空闲块时返回-1
+ * @note 不能在日志操作中调用, 也不能持有inode锁（需要提交事务）
+ */
+int refcnt_enable()
+{
+    if (sb.refcnt_magic == REFCNT_MAGIC) {
+        return 0;
+    }
+    sleeplock_acquire(&refcnt_lk);
+    if (sb.refcnt_magic == REFCNT_MAGIC) {
+        sleeplock_release(&refcnt_lk);
+        return 0;
+    }
+
+    // 1. 分配连续的表块, 提交让位图先落盘
+    uint32 want = (sb.data_blocks + REFCNT_PER_BLOCK - 1) / REFCNT_PER_BLOCK;
+    uint32 n = want;
+    journal_begin();
+    uint32 start = bitmap_alloc_extent(sb.data_start, &n);
+    if (n < want) {
+        for (uint32 i = 0; i < n; i++) {
+            bitmap_free_block(start + i);
+        }
+    }
+    journal_end();
+    if (n < want) {
+        sleeplock_release(&refcnt_lk);
+        printf("refcnt: no room for %d contiguous blocks\n", want);
+        return -1;
+    }
+    journal_force();
+
+    // 2. 清零表块并落盘
+    for (uint32 i = 0; i < n; i++) {
+        buf_t* buf = buf_get_nofill(start + i);
+        memset(buf->data, 0, BLOCK_SIZE);
+        buf_write(buf);
+        buf_release(buf);
+    }
+    buf_sync();
+
+    // 3. 记录进超级块（位置先于magic生效, 读者只看magic）
+    sb.refcnt_start = start;
+    sb.refcnt_blocks = n;
+    sb.refcnt_magic = REFCNT_MAGIC;
+    fs_commit_super();
+    klog("refcnt: table created at block %d (%d blocks)\n", start, n);
+
+    sleeplock_release(&refcnt_lk);
+    return 0;
+}
+
+/**
+ * @brief 数据块是否被多于一个文件引用
+ * @param block 数据块磁盘编号
+ * @note 没有表时直接返回false, 不读任何块
+ */
+bool refcnt_shared(uint32 block)
+{
+    if (sb.refcnt_magic != REFCNT_MAGIC) {
+        return false;
+    }
+    uint32 idx;
+    buf_t* buf = buf_read(refcnt_locate(block, &idx));
+    bool shared = ((uint16*)buf->data)[idx] != 0;
+    buf_release(buf);
+    return shared;
+}
+
+/**
+ * @brief 数据块增加一个引用（克隆时新的文件映射到它）
+ * @param block 数据块磁盘编号（已分配）
+ * @return 成功返回true, 引用数达到上限时不修改, 返回false
+ * @note 调用者在日志操作中, 并且已经调用过refcnt_enable
+ */
+bool refcnt_get(uint32 block)
+{
+    assert(sb.refcnt_magic == REFCNT_MAGIC, "refcnt_get: no refcount table");
+    uint32 idx;
+    buf_t* buf = buf_read(refcnt_locate(block, &idx));
+    uint16* cnt = (uint16*)buf->data + idx;
+    bool ok = (*cnt < REFCNT_MAX);
+    if (ok) {
+        (*cnt)++;
+        journal_log(buf);
+    }
+    buf_release(buf);
+    return ok;
+}
+
+/**
+ * @brief 释放数据块的一个引用（释放数据块之前调用）
+ * @param block 数据块磁盘编号
+ * @return 仍有其他文件引用这个块返回true（调用者不能把它还给位图）, 最后一个引用返回false
+ * @note 调用者在日志操作中; 没有表时直接返回false
+ */
+bool refcnt_put(uint32 block)
+{
+    if (sb.refcnt_magic != REFCNT_MAGIC) {
+        return false;
+    }
+    uint32 idx;
+    buf_t* buf = buf_read(refcnt_locate(block, &idx));
+    uint16* cnt = (uint16*)buf->data + idx;
+    bool shared = (*cnt != 0);
+    if (shared) {
+        (*cnt)--;
+        journal_log(buf);
+    }
+    buf_release(buf);
+    return shared;
+}
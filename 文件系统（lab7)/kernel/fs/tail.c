@@ -0,0 +1,266 @@
+#include "fs/buf.h"
+#include "fs/journal.h"
+#include "fs/bitmap.h"
+#include "fs/tail.h"
+#include "mem/vmem.h"
+#include "proc/cpu.h"
+#include "lib/print.h"
+#include "lib/str.h"
+
+/*
+    尾块的分配 (见fs/tail.h)
+    tails.lk保护所有尾块的块头 (分配/释放单位); 文件内容的读写只需要尾块buf的睡眠锁,
+    文件占用的单位只由持有该inode睡眠锁的进程访问
+    锁的顺序: inode睡眠锁 -> tails.lk -> 尾块buf
+    最近分配过或释放出单位的TAIL_CACHE个尾块作为候选, 新分配先在其中寻找连续的空闲单位;
+    重启后之前的尾块只在其中的文件释放单位后重新成为候选
+*/
+
+#define TAIL_CACHE 8
+
+static struct {
+    sleeplock_t lk;
+    uint32 block[TAIL_CACHE];  // 候选尾块 (0: 空槽位)
+    uint32 next;               // 下一个替换的槽位
+} tails;
+
+void tail_init()
+{
+    sleeplock_init(&tails.lk, "tail");
+    memset(tails.block, 0, sizeof(tails.block));
+    tails.next = 0;
+}
+
+// 尾块block成为候选 (已经是候选时不变), 调用者持有tails.lk
+static void tail_cache_add(uint32 block)
+{
+    for (int i = 0; i < TAIL_CACHE; i++) {
+        if (tails.block[i] == block) {
+            return;
+        }
+    }
+    for (int i = 0; i < TAIL_CACHE; i++) {
+        if (tails.block[i] == 0) {
+            tails.block[i] = block;
+            return;
+        }
+    }
+    tails.block[tails.next] = block;
+    tails.next = (tails.next + 1) % TAIL_CACHE;
+}
+
+// 尾块block被释放, 不再是候选, 调用者持有tails.lk
+static void tail_cache_remove(uint32 block)
+{
+    for (int i = 0; i < TAIL_CACHE; i++) {
+        if (tails.block[i] == block) {
+            tails.block[i] = 0;
+        }
+    }
+}
+
+// 块头中从第一个数据单位开始的units个连续空闲单位, 返回起始单位, 没有时返回-1
+static int tail_find(tail_header_t* hdr, uint32 units)
+{
+    uint32 run = 0;
+    for (uint32 i = TAIL_HDR_UNITS; i < TAIL_UNITS; i++) {
+        run = (hdr->owner[i] == TAIL_FREE) ? run + 1 : 0;
+        if (run == units) {
+            return i + 1 - units;
+        }
+    }
+    return -1;
+}
+
+// 在尾块buf中占用[start, start + units)并清零, 记录日志, 调用者持有tails.lk和buf的睡眠锁
+static void tail_claim(buf_t* buf, uint16 inode_num, uint32 start, uint32 units)
+{
+    tail_header_t* hdr = (tail_header_t*)buf->data;
+    for (uint32 i = start; i < start + units; i++) {
+        hdr->owner[i] = inode_num;
+    }
+    hdr->used += units;
+    memset(buf->data + start * TAIL_UNIT, 0, units * TAIL_UNIT);
+    journal_log(buf);
+}
+
+/**
+ * @brief 为inode分配units个连续的尾块单位（内容为0）
+ * @param inode_num 文件的inode_num（记录在尾块映射中）
+ * @param units 单位数（1 ~ TAIL_UNITS - TAIL_HDR_UNITS）
+ * @param loc 输出: 分配到的位置
+ * @note 候选尾块中没有足够的连续空闲单位时新分配一个尾块（靠近inode的数据段）
+ */
+void tail_alloc(uint16 inode_num, uint32 units, tail_loc_t* loc)
+{
+    assert(units >= 1 && units <= TAIL_UNITS - TAIL_HDR_UNITS, "tail_alloc: bad unit count");
+
+    sleeplock_acquire(&tails.lk);
+
+    // 1. 在候选尾块中寻找
+    for (int i = 0; i < TAIL_CACHE; i++) {
+        if (tails.block[i] == 0) {
+            continue;
+        }
+        buf_t* buf = buf_read(tails.block[i]);
+        tail_header_t* hdr = (tail_header_t*)buf->data;
+        assert(hdr->magic == TAIL_MAGIC, "tail_alloc: candidate is not a tail block");
+        int start = tail_find(hdr, units);
+        if (start >= 0) {
+            tail_claim(buf, inode_num, start, units);
+            loc->block = tails.block[i];
+            loc->start = start;
+            loc->units = units;
+            buf_release(buf);
+            sleeplock_release(&tails.lk);
+            return;
+        }
+        buf_release(buf);
+    }
+
+    // 2. 新的尾块: 初始化块头
+    uint32 n = 1;
+    uint32 block = bitmap_alloc_extent(bitmap_data_goal(inode_num), &n);
+    buf_t* buf = buf_get_nofill(block);
+    memset(buf->data, 0, BLOCK_SIZE);
+    tail_header_t* hdr = (tail_header_t*)buf->data;
+    hdr->magic = TAIL_MAGIC;
+    hdr->used = TAIL_HDR_UNITS;
+    for (uint32 i = 0; i < TAIL_UNITS; i++) {
+        hdr->owner[i] = (i < TAIL_HDR_UNITS) ? TAIL_OWNER_HDR : TAIL_FREE;
+    }
+    tail_claim(buf, inode_num, TAIL_HDR_UNITS, units);
+    buf_release(buf);
+    tail_cache_add(block);
+    sleeplock_release(&tails.lk);
+
+    loc->block = block;
+    loc->start = TAIL_HDR_UNITS;
+    loc->units = units;
+}
+
+// 释放[start, start + units), 尾块变空时释放整个块, 调用者持有tails.lk
+static void tail_release(uint16 inode_num, uint32 block, uint32 start, uint32 units)
+{
+    buf_t* buf = buf_read(block);
+    tail_header_t* hdr = (tail_header_t*)buf->data;
+    assert(hdr->magic == TAIL_MAGIC, "tail_release: not a tail block");
+    for (uint32 i = start; i < start + units; i++) {
+        assert(hdr->owner[i] == inode_num, "tail_release: unit not owned by inode");
+        hdr->owner[i] = TAIL_FREE;
+    }
+    hdr->used -= units;
+    bool empty = (hdr->used == TAIL_HDR_UNITS);
+    journal_log(buf);
+    buf_release(buf);
+
+    if (empty) {
+        tail_cache_remove(block);
+        bitmap_free_block(block);
+    } else {
+        tail_cache_add(block);
+    }
+}
+
+/**
+ * @brief 把文件占用的单位扩大到units个（新的部分为0）
+ * @param inode_num 文件的inode_num
+ * @param loc 文件的位置（可能改变, 调用者负责写回inode）
+ * @param units 新的单位数（大于loc->units）
+ * @param size 需要保留的内容长度（字节, 不超过原来的容量）
+ * @note 紧接在后面的单位空闲时原地扩大, 否则分配新的单位, 复制内容后释放原来的单位
+ */
+void tail_grow(uint16 inode_num, tail_loc_t* loc, uint32 units, uint32 size)
+{
+    assert(units > loc->units && units <= TAIL_UNITS - TAIL_HDR_UNITS, "tail_grow: bad unit count");
+    assert(size <= TAIL_CAPACITY(loc), "tail_grow: size beyond capacity");
+
+    // 1. 原地扩大
+    sleeplock_acquire(&tails.lk);
+    buf_t* buf = buf_read(loc->block);
+    tail_header_t* hdr = (tail_header_t*)buf->data;
+    uint32 end = loc->start + loc->units;
+    uint32 more = units - loc->units;
+    bool fits = (end + more <= TAIL_UNITS);
+    for (uint32 i = end; fits && i < end + more; i++) {
+        if (hdr->owner[i] != TAIL_FREE) {
+            fits = false;
+        }
+    }
+    if (fits) {
+        tail_claim(buf, inode_num, end, more);
+        loc->units = units;
+        buf_release(buf);
+        sleeplock_release(&tails.lk);
+        return;
+    }
+    buf_release(buf);
+    sleeplock_release(&tails.lk);
+
+    // 2. 换一个位置: 内容经过一个小缓冲区分段复制（两个尾块可能是同一个块, 不同时持有两个buf）
+    tail_loc_t old = *loc;
+    tail_alloc(inode_num, units, loc);
+    uint8 chunk[TAIL_UNIT * 2];
+    for (uint32 off = 0; off < size; off += sizeof(chunk)) {
+        uint32 n = size - off < sizeof(chunk) ? size - off : sizeof(chunk);
+        tail_rw(&old, off, n, chunk, false, false);
+        tail_rw(loc, off, n, chunk, false, true);
+    }
+    tail_free(inode_num, &old);
+}
+
+/**
+ * @brief 释放文件占用的所有单位
+ * @param inode_num 文件的inode_num
+ * @param loc 文件的位置（返回后清零）
+ */
+void tail_free(uint16 inode_num, tail_loc_t* loc)
+{
+    sleeplock_acquire(&tails.lk);
+    tail_release(inode_num, loc->block, loc->start, loc->units);
+    sleeplock_release(&tails.lk);
+    memset(loc, 0, sizeof(*loc));
+}
+
+/**
+ * @brief 读写文件在尾块中的内容
+ * @param loc 文件的位置
+ * @param offset 文件内偏移
+ * @param len 字节数（offset + len不超过容量）
+ * @param addr 缓冲区地址
+ * @param user addr是否为用户态地址
+ * @param write true=写入尾块（记录日志）, false=读出
+ */
+void tail_rw(tail_loc_t* loc, uint32 offset, uint32 len, void* addr, bool user, bool write)
+{
+    assert(offset + len <= TAIL_CAPACITY(loc), "tail_rw: beyond capacity");
+
+    buf_t* buf = buf_read(loc->block);
+    uint8* data = buf->data + loc->start * TAIL_UNIT + offset;
+    if (write) {
+        if (user) {
+            uvm_copyin(myproc()->mm->pgtbl, (uint64)data, (uint64)addr, len);
+        } else {
+            memmove(data, addr, len);
+        }
+        journal_log(buf);
+    } else {
+        if (user) {
+            uvm_copyout(myproc()->mm->pgtbl, (uint64)addr, (uint64)data, len);
+        } else {
+            memmove(addr, data, len);
+        }
+    }
+    buf_release(buf);
+}
+
+// 清零文件在尾块中的[offset, offset + len) (截断时使用, 之后再扩展读出的是0)
+void tail_zero(tail_loc_t* loc, uint32 offset, uint32 len)
+{
+    assert(offset + len <= TAIL_CAPACITY(loc), "tail_zero: beyond capacity");
+
+    buf_t* buf = buf_read(loc->block);
+    memset(buf->data + loc->start * TAIL_UNIT + offset, 0, len);
+    journal_log(buf);
+    buf_release(buf);
+}
@@ -0,0 +1,529 @@
+#include "fs/tmpfs.h"
+#include "fs/inode.h"
+#include "mem/pmem.h"
+#include "mem/slab.h"
+#include "mem/vmem.h"
+#include "proc/cpu.h"
+#include "lib/print.h"
+#include "lib/str.h"
+
+// /tmp下的内存文件系统 (见fs/tmpfs.h)
+
+static struct {
+    sleeplock_t lk;         // 保护树的结构、名字、nlink和ref
+    tmpfs_node_t* root;     // /tmp
+    uint16 next_ino;        // 下一个节点编号
+    uint32 npages;          // 所有文件的数据页数 (原子地修改)
+    uint64 zero;            // 全0的页: 读空洞时作为复制的源
+} tmpfs;
+
+static kmem_cache_t tmpfs_node_cache;
+
+// 新节点加在父目录的子节点链表末尾 (getdents的cookie是链表中的序号), 调用者持有tmpfs.lk
+static tmpfs_node_t* tmpfs_node_alloc(uint16 type, tmpfs_node_t* parent, char* name)
+{
+    tmpfs_node_t* node = (tmpfs_node_t*)kmem_cache_alloc(&tmpfs_node_cache);
+    if (node == NULL) {
+        return NULL;
+    }
+    memset(node, 0, sizeof(tmpfs_node_t));
+    node->type = type;
+    if (++tmpfs.next_ino == 0) {
+        tmpfs.next_ino = 1;
+    }
+    node->ino = tmpfs.next_ino;
+    node->nlink = 1;
+    strncpy(node->name, name, DIR_NAME_LEN);
+    sleeplock_init(&node->slk, "tmpfs_node");
+
+    if (parent == NULL) {
+        node->parent = node;
+        return node;
+    }
+    node->parent = parent;
+    tmpfs_node_t** pp = &parent->child;
+    while (*pp != NULL) {
+        pp = &(*pp)->next;
+    }
+    *pp = node;
+    parent->size++;
+    return node;
+}
+
+// 从父目录的子节点链表中摘下, 调用者持有tmpfs.lk
+static void tmpfs_detach(tmpfs_node_t* node)
+{
+    tmpfs_node_t* parent = node->parent;
+    tmpfs_node_t** pp = &parent->child;
+    while (*pp != node) {
+        pp = &(*pp)->next;
+    }
+    *pp = node->next;
+    node->next = NULL;
+    parent->size--;
+}
+
+// 第pgno个数据页在节点中的位置, 超出当前页目录时create = true则扩大页目录, 否则 (或超出上限) 返回NULL
+// 调用者独占持有node->slk (create = false时共享持有即可)
+static uint64* tmpfs_slot(tmpfs_node_t* node, uint32 pgno, bool create)
+{
+    if (pgno < TMPFS_NDIRECT) {
+        return &node->direct[pgno];
+    }
+    uint32 idx = pgno - TMPFS_NDIRECT;
+    uint32 cap = (node->map == NULL) ? 0 : (PGSIZE << node->map_order) / sizeof(uint64);
+    if (idx < cap) {
+        return &node->map[idx];
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    // 页目录加倍直到能容纳idx
+    uint32 order = (node->map == NULL) ? 0 : node->map_order + 1;
+    while (((PGSIZE << order) / sizeof(uint64)) <= idx) {
+        order++;
+    }
+    if (order > TMPFS_MAP_MAX_ORDER) {
+        return NULL;
+    }
+    uint64* map = (uint64*)pmem_alloc_order(order);
+    if (map == NULL) {
+        return NULL;
+    }
+    if (node->map != NULL) {
+        memmove(map, node->map, cap * sizeof(uint64));
+        pmem_free_order((uint64)node->map, node->map_order);
+    }
+    node->map = map;
+    node->map_order = order;
+    return &node->map[idx];
+}
+
+// 释放第first页及之后的所有数据页, 调用者独占持有node->slk或节点已没有其他使用者
+static void tmpfs_free_pages(tmpfs_node_t* node, uint32 first)
+{
+    uint32 cap = TMPFS_NDIRECT + ((node->map == NULL) ? 0 : (PGSIZE << node->map_order) / sizeof(uint64));
+    for (uint32 pgno = first; pgno < cap; pgno++) {
+        uint64* slot = tmpfs_slot(node, pgno, false);
+        if (*slot != 0) {
+            pmem_free(*slot, false);
+            *slot = 0;
+            __sync_fetch_and_sub(&tmpfs.npages, 1);
+        }
+    }
+    if (first <= TMPFS_NDIRECT && node->map != NULL) {
+        pmem_free_order((uint64)node->map, node->map_order);
+        node->map = NULL;
+        node->map_order = 0;
+    }
+}
+
+// 已删除且没有打开的文件项时释放节点, 调用者持有tmpfs.lk
+static void tmpfs_node_put(tmpfs_node_t* node)
+{
+    if (node->nlink > 0 || node->ref > 0) {
+        return;
+    }
+    tmpfs_free_pages(node, 0);
+    kmem_cache_free(&tmpfs_node_cache, node);
+}
+
+void tmpfs_init()
+{
+    sleeplock_init(&tmpfs.lk, "tmpfs");
+    kmem_cache_init(&tmpfs_node_cache, "tmpfs_node", sizeof(tmpfs_node_t), MEMTAG_FS);
+    tmpfs.next_ino = 0;
+    tmpfs.npages = 0;
+    tmpfs.zero = (uint64)pmem_alloc_flags(true, PMEM_ZERO | PMEM_TAG(MEMTAG_FS));
+    assert(tmpfs.zero != 0, "tmpfs_init: no memory for zero page");
+    tmpfs.root = tmpfs_node_alloc(FT_DIR, NULL, "tmp");
+    assert(tmpfs.root != NULL, "tmpfs_init: alloc root fail");
+}
+
+char* tmpfs_path(char* path)
+{
+    if (strncmp(path, "/tmp", 4) == 0 && (path[4] == 0 || path[4] == '/')) {
+        return path + 4;
+    }
+    return NULL;
+}
+
+// 与dir.c的skip_element相同: 取出下一个路径元素, 没有剩余元素返回NULL (过长的名字截断)
+static char* tmpfs_element(char* path, char* name)
+{
+    while (*path == '/') path++;
+    if (*path == 0) return NULL;
+
+    char* s = path;
+    while (*path != '/' && *path != 0)
+        path++;
+
+    int len = path - s;
+    if (len >= DIR_NAME_LEN) {
+        len = DIR_NAME_LEN - 1;
+    }
+    memmove(name, s, len);
+    name[len] = 0;
+    while (*path == '/')
+        path++;
+    return path;
+}
+
+// 目录dp中名为name的子节点 ("."和".."是自己和父目录), 调用者持有tmpfs.lk
+static tmpfs_node_t* tmpfs_lookup(tmpfs_node_t* dp, char* name)
+{
+    if (strncmp(name, ".", DIR_NAME_LEN) == 0) {
+        return dp;
+    }
+    if (strncmp(name, "..", DIR_NAME_LEN) == 0) {
+        return dp->parent;
+    }
+    for (tmpfs_node_t* node = dp->child; node != NULL; node = node->next) {
+        if (strncmp(node->name, name, DIR_NAME_LEN) == 0) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/*
+    解析/tmp之后的路径, 调用者持有tmpfs.lk
+    parent = false: 返回路径对应的节点 (空路径是根节点)
+    parent = true : 返回最后一个元素所在的目录, 元素名放入name (空路径返回NULL)
+    不存在或中间的元素不是目录时返回NULL
+*/
+static tmpfs_node_t* tmpfs_walk(char* path, bool parent, char* name)
+{
+    char elem[DIR_NAME_LEN];
+    tmpfs_node_t* node = tmpfs.root;
+
+    if (name == NULL) {
+        name = elem;
+    }
+    while ((path = tmpfs_element(path, name)) != NULL) {
+        if (node->type != FT_DIR) {
+            return NULL;
+        }
+        if (parent && *path == 0) {
+            return node;
+        }
+        node = tmpfs_lookup(node, name);
+        if (node == NULL) {
+            return NULL;
+        }
+    }
+    return parent ? NULL : node;
+}
+
+// 新建的名字不能是"."或".."
+static bool tmpfs_name_valid(char* name)
+{
+    return name[0] != 0 && strncmp(name, ".", DIR_NAME_LEN) != 0 && strncmp(name, "..", DIR_NAME_LEN) != 0;
+}
+
+file_t* tmpfs_open(char* path, uint32 open_mode)
+{
+    char name[DIR_NAME_LEN];
+
+    // 1. 查找或创建节点, 持有一个引用
+    sleeplock_acquire(&tmpfs.lk);
+    tmpfs_node_t* node = tmpfs_walk(path, false, NULL);
+    if (node == NULL && (open_mode & MODE_CREATE)) {
+        tmpfs_node_t* dp = tmpfs_walk(path, true, name);
+        if (dp != NULL && tmpfs_name_valid(name)) {
+            node = tmpfs_node_alloc(FT_FILE, dp, name);
+        }
+    }
+    if (node == NULL || (node->type == FT_DIR && (open_mode & MODE_WRITE))) {
+        sleeplock_release(&tmpfs.lk);
+        return NULL;
+    }
+    node->ref++;
+    sleeplock_release(&tmpfs.lk);
+
+    // 2. 文件项 (没有inode)
+    file_t* file = file_alloc();
+    if (file == NULL) {
+        tmpfs_close(node);
+        return NULL;
+    }
+    file->type = FD_TMP;
+    file->readable = (open_mode & MODE_READ) ? true : false;
+    file->writable = (open_mode & MODE_WRITE) ? true : false;
+    file->tmp = node;
+    return file;
+}
+
+void tmpfs_close(tmpfs_node_t* node)
+{
+    sleeplock_acquire(&tmpfs.lk);
+    assert(node->ref > 0, "tmpfs_close: ref underflow");
+    node->ref--;
+    tmpfs_node_put(node);
+    sleeplock_release(&tmpfs.lk);
+}
+
+// 内核页kaddr与addr (用户或内核地址) 之间复制n字节
+static void tmpfs_copy(uint64 kaddr, uint64 addr, uint32 n, bool user, bool write)
+{
+    if (write) {
+        if (user) {
+            uvm_copyin(myproc()->mm->pgtbl, kaddr, addr, n);
+        } else {
+            memmove((void*)kaddr, (void*)addr, n);
+        }
+    } else {
+        if (user) {
+            uvm_copyout(myproc()->mm->pgtbl, addr, kaddr, n);
+        } else {
+            memmove((void*)addr, (void*)kaddr, n);
+        }
+    }
+}
+
+/*
+    普通文件从*offset处读写len字节, 按页复制, 返回实际传输的字节数 (*offset前移这么多)
+    读到文件末尾为止, 空洞读出全0; 写入需要的页第一次写时申请,
+    超出TMPFS_MAXSIZE、页数达到TMPFS_MAX_PAGES或内存不足时只写入之前的部分
+    目录和没有对应权限时返回-1
+*/
+uint32 tmpfs_rw(file_t* file, uint32* offset, uint32 len, uint64 addr, bool user, bool write)
+{
+    tmpfs_node_t* node = file->tmp;
+    if (node->type != FT_FILE || (write ? !file->writable : !file->readable)) {
+        return -1;
+    }
+
+    if (write) {
+        sleeplock_acquire(&node->slk);
+    } else {
+        sleeplock_acquire_shared(&node->slk);
+    }
+
+    uint32 off = *offset;
+    uint32 done = 0;
+    if (write) {
+        if (off >= TMPFS_MAXSIZE) {
+            len = 0;
+        } else if (len > TMPFS_MAXSIZE - off) {
+            len = TMPFS_MAXSIZE - off;
+        }
+    } else {
+        if (off >= node->size) {
+            len = 0;
+        } else if (len > node->size - off) {
+            len = node->size - off;
+        }
+    }
+
+    while (done < len) {
+        uint32 pgno = (off + done) / PGSIZE;
+        uint32 poff = (off + done) % PGSIZE;
+        uint32 n = PGSIZE - poff;
+        if (n > len - done) n = len - done;
+
+        uint64* slot = tmpfs_slot(node, pgno, write);
+        if (write) {
+            if (slot == NULL) {
+                break;
+            }
+            if (*slot == 0) {
+                uint64 page = 0;
+                if (__sync_add_and_fetch(&tmpfs.npages, 1) <= TMPFS_MAX_PAGES) {
+                    page = (uint64)pmem_alloc(false);
+                }
+                if (page == 0) {
+                    __sync_fetch_and_sub(&tmpfs.npages, 1);
+                    break;
+                }
+                *slot = page;
+            }
+            tmpfs_copy(*slot + poff, addr + done, n, user, true);
+        } else {
+            uint64 page = (slot != NULL && *slot != 0) ? *slot : tmpfs.zero;
+            tmpfs_copy(page + poff, addr + done, n, user, false);
+        }
+        done += n;
+    }
+
+    *offset = off + done;
+    if (write) {
+        if (off + done > node->size) {
+            node->size = off + done;
+        }
+        sleeplock_release(&node->slk);
+    } else {
+        sleeplock_release_shared(&node->slk);
+    }
+    return done;
+}
+
+int tmpfs_truncate(tmpfs_node_t* node, uint32 size)
+{
+    if (node->type != FT_FILE || size > TMPFS_MAXSIZE) {
+        return -1;
+    }
+
+    sleeplock_acquire(&node->slk);
+    if (size < node->size) {
+        // 之后的整页释放, 最后一页中size之后的部分清零 (再扩展时读出全0)
+        tmpfs_free_pages(node, (size + PGSIZE - 1) / PGSIZE);
+        uint64* slot = tmpfs_slot(node, size / PGSIZE, false);
+        if (size % PGSIZE != 0 && slot != NULL && *slot != 0) {
+            memset((void*)(*slot + size % PGSIZE), 0, PGSIZE - size % PGSIZE);
+        }
+    }
+    node->size = size;
+    sleeplock_release(&node->slk);
+    return 0;
+}
+
+// 目录的大小按目录项计算 (与磁盘上的目录一致)
+void tmpfs_fill_state(tmpfs_node_t* node, file_state_t* state)
+{
+    state->type = node->type;
+    state->inode_num = node->ino;
+    state->nlink = node->nlink;
+    state->size = (node->type == FT_DIR) ? node->size * sizeof(dirent_t) : node->size;
+}
+
+int tmpfs_stat(char* path, file_state_t* state)
+{
+    sleeplock_acquire(&tmpfs.lk);
+    tmpfs_node_t* node = tmpfs_walk(path, false, NULL);
+    if (node != NULL) {
+        tmpfs_fill_state(node, state);
+    }
+    sleeplock_release(&tmpfs.lk);
+    return (node == NULL) ? -1 : 0;
+}
+
+// cookie是已经读过的子节点数; 遍历期间删除的子节点会让之后的项前移, 可能漏掉一项 (不会重复)
+int tmpfs_getdents(file_t* file, uint64 addr, uint32 len)
+{
+    tmpfs_node_t* dp = file->tmp;
+    if (dp->type != FT_DIR) {
+        return -1;
+    }
+
+    // 1. 目录项先收集到一个内核页中, 每满一页拷贝一次
+    dirent_t* page = (dirent_t*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));
+    if (page == NULL) {
+        return -1;
+    }
+
+    uint32 total = 0;
+    while (total + sizeof(dirent_t) <= len) {
+        uint32 want = ((len - total < PGSIZE) ? len - total : PGSIZE) / sizeof(dirent_t);
+        uint32 n = 0;
+
+        // 2. 跳过已经读过的子节点
+        sleeplock_acquire(&tmpfs.lk);
+        tmpfs_node_t* node = dp->child;
+        for (uint32 i = 0; i < file->dir_cookie && node != NULL; i++) {
+            node = node->next;
+        }
+        for (; node != NULL && n < want; node = node->next, n++) {
+            page[n].inode_num = node->ino;
+            memmove(page[n].name, node->name, DIR_NAME_LEN);
+        }
+        sleeplock_release(&tmpfs.lk);
+
+        if (n == 0) {
+            break;
+        }
+        uvm_copyout(myproc()->mm->pgtbl, addr + total, (uint64)page, n * sizeof(dirent_t));
+        file->dir_cookie += n;
+        total += n * sizeof(dirent_t);
+    }
+
+    pmem_free((uint64)page, true);
+    return total;
+}
+
+int tmpfs_mkdir(char* path)
+{
+    char name[DIR_NAME_LEN];
+    tmpfs_node_t* node = NULL;
+
+    sleeplock_acquire(&tmpfs.lk);
+    tmpfs_node_t* dp = tmpfs_walk(path, true, name);
+    if (dp != NULL && tmpfs_name_valid(name) && tmpfs_lookup(dp, name) == NULL) {
+        node = tmpfs_node_alloc(FT_DIR, dp, name);
+    }
+    sleeplock_release(&tmpfs.lk);
+    return (node == NULL) ? -1 : 0;
+}
+
+// 删除文件或空目录, 仍然打开的文件在最后一个文件项关闭时释放
+int tmpfs_unlink(char* path)
+{
+    sleeplock_acquire(&tmpfs.lk);
+    tmpfs_node_t* node = tmpfs_walk(path, false, NULL);
+    if (node == NULL || node == tmpfs.root || (node->type == FT_DIR && node->child != NULL)) {
+        sleeplock_release(&tmpfs.lk);
+        return -1;
+    }
+    tmpfs_detach(node);
+    node->nlink = 0;
+    tmpfs_node_put(node);
+    sleeplock_release(&tmpfs.lk);
+    return 0;
+}
+
+// 与path_rename相同的规则: 已存在的普通文件被替换, 目录不能移动到自己的子树中
+int tmpfs_rename(char* old_path, char* new_path)
+{
+    char name[DIR_NAME_LEN];
+
+    sleeplock_acquire(&tmpfs.lk);
+    tmpfs_node_t* node = tmpfs_walk(old_path, false, NULL);
+    tmpfs_node_t* dp = tmpfs_walk(new_path, true, name);
+    if (node == NULL || node == tmpfs.root || dp == NULL || !tmpfs_name_valid(name)) {
+        sleeplock_release(&tmpfs.lk);
+        return -1;
+    }
+
+    // 1. 目标目录不能是node自己或在它的子树中
+    for (tmpfs_node_t* p = dp; p != tmpfs.root; p = p->parent) {
+        if (p == node) {
+            sleeplock_release(&tmpfs.lk);
+            return -1;
+        }
+    }
+
+    // 2. 已存在的目标: 只有两者都是普通文件时替换
+    tmpfs_node_t* target = tmpfs_lookup(dp, name);
+    if (target == node) {
+        sleeplock_release(&tmpfs.lk);
+        return 0;
+    }
+    if (target != NULL) {
+        if (target->type != FT_FILE || node->type != FT_FILE) {
+            sleeplock_release(&tmpfs.lk);
+            return -1;
+        }
+        tmpfs_detach(target);
+        target->nlink = 0;
+        tmpfs_node_put(target);
+    }
+
+    // 3. 移到新目录的链表末尾
+    tmpfs_detach(node);
+    strncpy(node->name, name, DIR_NAME_LEN);
+    node->parent = dp;
+    tmpfs_node_t** pp = &dp->child;
+    while (*pp != NULL) {
+        pp = &(*pp)->next;
+    }
+    *pp = node;
+    dp->size++;
+    sleeplock_release(&tmpfs.lk);
+    return 0;
+}
+
+uint32 tmpfs_pages()
+{
+    return tmpfs.npages;
+}
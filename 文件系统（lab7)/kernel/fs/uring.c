@@ -0,0 +1,293 @@
+#include "fs/uring.h"
+#include "fs/file.h"
+#include "fs/dir.h"
+#include "fs/inode.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "mem/slab.h"
+#include "proc/proc.h"
+#include "proc/kwork.h"
+#include "lib/str.h"
+#include "lib/print.h"
+
+/*
+    共享队列在所属进程自己的上下文中处理: sys_uring_enter, 以及每次从陷阱返回用户态之前 (trap_user_handler)
+    用户可以随时修改共享页, 内核每次只读取一次sq_tail并复制提交项后再使用
+    fsync不需要访问用户内存, 交给工作线程执行: 请求持有文件的引用, 完成时写入完成项
+*/
+
+// 交给工作线程的请求
+typedef struct uring_async {
+    kwork_t work;
+    proc_t* p;          // 所属进程 (uring_drain保证它在请求完成之前不会释放队列)
+    file_t* file;       // 持有一个引用
+    uint64 user_data;
+} uring_async_t;
+
+static kmem_cache_t uring_async_cache;
+
+void uring_init()
+{
+    kmem_cache_init(&uring_async_cache, "uring_async", sizeof(uring_async_t), MEMTAG_FS);
+}
+
+/**
+ * @brief 创建p的提交/完成队列, 映射到mmap区域中的两页（用户可读写）
+ * @param p 当前进程
+ * @return 队列的用户起始地址, 已经创建过、地址空间或内存不足时返回0
+ * @note 两页是普通的用户页, 随页表一起释放; 内核通过物理地址访问它们, 所以标记为PMEM_F_PINNED:
+ *       fork的子进程得到副本（不写时复制共享）但没有队列
+ *       队列另外持有每页的一个引用 (uring_drain归还): 共享地址空间的线程解除了映射, 页也不会在队列使用时释放
+ */
+uint64 uring_setup(proc_t* p)
+{
+    if (p->uring.ctl != NULL) {
+        return 0;
+    }
+
+    // 1. 申请物理页并清零
+    uint64 pa[URING_PAGES];
+    for (int i = 0; i < URING_PAGES; i++) {
+        pa[i] = (uint64)pmem_alloc(false);
+        if (pa[i] == 0) {
+            for (int j = 0; j < i; j++) {
+                pmem_free(pa[j], false);
+            }
+            return 0;
+        }
+    }
+
+    // 2. 在mmap区域中找到位置并映射
+    uint64 va = uvm_mmap_find(URING_PAGES);
+    if (va == 0 || !uvm_mmap_reserve(va, URING_PAGES)) {
+        for (int i = 0; i < URING_PAGES; i++) {
+            pmem_free(pa[i], false);
+        }
+        return 0;
+    }
+    for (int i = 0; i < URING_PAGES; i++) {
+        pmem_frame_set_flags(pa[i], PMEM_F_PINNED);
+        pmem_get(pa[i]);
+        vm_mappages(p->mm->pgtbl, va + i * PGSIZE, pa[i], PGSIZE, PTE_R | PTE_W | PTE_U);
+    }
+
+    // 3. 内核通过物理地址访问
+    p->uring.va = va;
+    p->uring.ctl = (uring_ctl_t*)pa[0];
+    p->uring.sqes = (uring_sqe_t*)(pa[0] + URING_SQ_OFF);
+    p->uring.cqes = (uring_cqe_t*)pa[1];
+    p->uring.ctl->sq_entries = URING_SQ_ENTRIES;
+    p->uring.ctl->cq_entries = URING_CQ_ENTRIES;
+    spinlock_init(&p->uring.lk, "uring");
+    p->uring.inflight = 0;
+    return va;
+}
+
+/**
+ * @brief 提交队列中是否有未处理的请求
+ * @param p 进程
+ */
+bool uring_pending(proc_t* p)
+{
+    return p->uring.ctl != NULL && p->uring.ctl->sq_head != p->uring.ctl->sq_tail;
+}
+
+/**
+ * @brief [begin, begin + npages页)是否与p的队列重叠（munmap不能解除队列的映射）
+ */
+bool uring_overlap(proc_t* p, uint64 begin, uint32 npages)
+{
+    if (p->uring.ctl == NULL) {
+        return false;
+    }
+    return begin < p->uring.va + URING_PAGES * PGSIZE && p->uring.va < begin + (uint64)npages * PGSIZE;
+}
+
+// 静态辅助函数: fd对应的文件, 无效时返回NULL (表共享时持有引用, 每个请求处理完后放弃)
+static file_t* uring_file(proc_t* p, int fd)
+{
+    return proc_fd_get(p, fd);
+}
+
+/**
+ * @brief 静态辅助函数：执行一个提交项
+ * @param p 当前进程
+ * @param sqe 提交项（已复制到内核）
+ * @return 与对应系统调用相同的返回值
+ */
+static int uring_exec(proc_t* p, uring_sqe_t* sqe)
+{
+    // 1. 打开文件: 相对于目录fd（或当前工作目录）
+    if (sqe->opcode == URING_OP_OPENAT) {
+        inode_t* dp = NULL;
+        if (sqe->fd != AT_FDCWD) {
+            file_t* dir = uring_file(p, sqe->fd);
+            if (dir == NULL || dir->type != FD_DIR) {
+                return -1;
+            }
+            dp = dir->ip;
+        }
+        char path[DIR_PATH_LEN];
+        uvm_copyin_str(p->mm->pgtbl, (uint64)path, sqe->addr, DIR_PATH_LEN);
+        file_t* file = file_open_at(dp, path, sqe->len);
+        if (file == NULL) {
+            return -1;
+        }
+        int fd = proc_fd_alloc(p, file);
+        if (fd < 0) {
+            file_close(file);
+        }
+        return fd;
+    }
+    if (sqe->opcode == URING_OP_NOP) {
+        return 0;
+    }
+
+    // 2. 其余请求作用在已打开的文件上
+    file_t* file = uring_file(p, sqe->fd);
+    if (file == NULL) {
+        return -1;
+    }
+    switch (sqe->opcode) {
+        case URING_OP_READ:
+            if (sqe->offset == URING_OFFSET_CUR) {
+                return file_read(file, sqe->len, sqe->addr, true);
+            }
+            return file_pread(file, sqe->offset, sqe->len, sqe->addr, true);
+        case URING_OP_WRITE:
+            if (sqe->offset == URING_OFFSET_CUR) {
+                return file_write(file, sqe->len, sqe->addr, true);
+            }
+            return file_pwrite(file, sqe->offset, sqe->len, sqe->addr, true);
+        case URING_OP_FSYNC:
+            return file_fsync(file);
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief 静态辅助函数：写入一个完成项（调用者持有r->lk, 已确认完成队列有位置）
+ */
+static void uring_post(uring_t* r, uint64 user_data, int res)
+{
+    uring_cqe_t* cqe = &r->cqes[r->ctl->cq_tail % URING_CQ_ENTRIES];
+    cqe->user_data = user_data;
+    cqe->res = res;
+    __sync_synchronize();
+    r->ctl->cq_tail++;
+}
+
+// 工作线程中执行fsync, 写入完成项
+static void uring_async_fn(void* arg)
+{
+    uring_async_t* req = (uring_async_t*)arg;
+    uring_t* r = &req->p->uring;
+    int res = file_fsync(req->file);
+    file_close(req->file);
+
+    spinlock_acquire(&r->lk);
+    uring_post(r, req->user_data, res);
+    if (--r->inflight == 0) {
+        proc_wakeup(&r->inflight);
+    }
+    spinlock_release(&r->lk);
+    kmem_cache_free(&uring_async_cache, req);
+}
+
+/**
+ * @brief 静态辅助函数：把fsync交给工作线程
+ * @return 已提交返回true; 文件无效或内存不足返回false（调用者同步执行）
+ * @note 完成队列的位置在提交时预留（inflight）
+ */
+static bool uring_submit_async(proc_t* p, uring_sqe_t* sqe)
+{
+    file_t* file = uring_file(p, sqe->fd);
+    if (file == NULL) {
+        return false;
+    }
+    uring_async_t* req = (uring_async_t*)kmem_cache_alloc(&uring_async_cache);
+    if (req == NULL) {
+        return false;
+    }
+    req->work.fn = uring_async_fn;
+    req->work.arg = req;
+    req->work.pending = false;
+    req->p = p;
+    req->file = file_dup(file);
+    req->user_data = sqe->user_data;
+
+    spinlock_acquire(&p->uring.lk);
+    p->uring.inflight++;
+    spinlock_release(&p->uring.lk);
+    kwork_queue(&req->work);
+    return true;
+}
+
+/**
+ * @brief 等待交给工作线程的请求全部完成, 然后放弃队列 (归还队列持有的页引用)
+ * @param p 当前进程（exec或退出时调用, 队列的映射随地址空间释放）
+ */
+void uring_drain(proc_t* p)
+{
+    uring_t* r = &p->uring;
+    if (r->ctl == NULL) {
+        return;
+    }
+    spinlock_acquire(&r->lk);
+    while (r->inflight > 0) {
+        proc_sleep(&r->inflight, &r->lk);
+    }
+    spinlock_release(&r->lk);
+    pmem_put((uint64)r->ctl);
+    pmem_put((uint64)r->cqes);
+    memset(r, 0, sizeof(uring_t));
+}
+
+/**
+ * @brief 依次处理提交队列中的请求, 结果写进完成队列
+ * @param p 当前进程（在它自己的上下文中调用, 开中断, 不持有锁）
+ * @return 处理的请求数
+ * @note 完成队列满时停止, 剩下的请求留在提交队列中;
+ *       一次最多处理sq_entries个请求, 用户写坏的sq_tail不会让内核一直循环
+ */
+uint32 uring_process(proc_t* p)
+{
+    uring_t* r = &p->uring;
+    if (r->ctl == NULL) {
+        return 0;
+    }
+
+    uint32 done = 0;
+    uint32 tail = r->ctl->sq_tail;
+    __sync_synchronize();   // 先读sq_tail, 再读提交项
+
+    while (r->ctl->sq_head != tail && done < URING_SQ_ENTRIES) {
+        // 1. 完成队列已满（包括在途请求预留的位置）: 等待用户取走完成项
+        spinlock_acquire(&r->lk);
+        bool full = (r->ctl->cq_tail - r->ctl->cq_head + r->inflight >= URING_CQ_ENTRIES);
+        spinlock_release(&r->lk);
+        if (full) {
+            break;
+        }
+
+        // 2. 复制提交项（之后用户修改共享页不影响这次处理）
+        uring_sqe_t sqe = r->sqes[r->ctl->sq_head % URING_SQ_ENTRIES];
+        r->ctl->sq_head++;
+        done++;
+
+        // 3. fsync交给工作线程, 完成项由它写入
+        if (sqe.opcode == URING_OP_FSYNC && uring_submit_async(p, &sqe)) {
+            proc_fd_unhold(p);
+            continue;
+        }
+
+        // 4. 其余请求同步执行, 写入完成项后才增加cq_tail
+        int res = uring_exec(p, &sqe);
+        proc_fd_unhold(p);
+        spinlock_acquire(&r->lk);
+        uring_post(r, sqe.user_data, res);
+        spinlock_release(&r->lk);
+    }
+    return done;
+}
@@ -0,0 +1,679 @@
+#include "common.h"
+#include "fs/fs.h"
+#include "fs/buf.h"
+#include "fs/bitmap.h"
+#include "fs/inode.h"
+#include "fs/dir.h"
+#include "fs/dcache.h"
+#include "fs/journal.h"
+#include "fs/pcache.h"
+#include "fs/compress.h"
+#include "fs/refcnt.h"
+#include "fs/tmpfs.h"
+#include "lib/print.h"
+#include "lib/str.h"
+#include "host.h"
+
+/*
+    宿主机上的文件系统算法基准: 内核的fs模块 (位图、inode、尾块、压缩、reflink、目录、buf cache、日志、页缓存、tmpfs) 原样编译,
+    块设备、锁、内存分配等由host.c模拟, 磁盘是mkfs生成的映像的私有映射 (运行不改变映像文件)
+    每项输出一行 (与用户态的bench套件格式相近):
+        @fsbench <名称> iters=<次数> ns_op=<> cycles_op=<> insns_op=<>
+    cycles和insns来自宿主机的性能计数器 (perf_event_open, 只计用户态; 不可用时为0)
+    buf cache的项另外输出一行命中统计:
+        @fsbench_stat <名称> lookups=<> misses=<> disk_reads=<>
+    用法: fsbench fs.img [倍数]   (make run: 用mkfs生成映像并运行)
+        倍数为0时只挂载, 输出挂载后的空闲计数 (make selftest: 比较运行fs_selftest与否的两次挂载, 检查自测没有留下残留):
+        @fsbench_stat mount free_blocks=<> free_inodes=<>
+    buf cache的工作集按缓存扩容后的大小选择, 映像的数据区需要大于它的2.25倍 (mkfs -n 32768)
+*/
+
+#define BENCH_BLOCKS  2048   // 位图: 每轮分配的块数
+#define LOCATE_BLOCKS 2048   // inode: 文件的块数 (覆盖一级和二级地址, 进入三级地址)
+#define LOCATE_BATCH  128    // 一个日志事务中分配的块数
+#define DIR_ENTRIES   400    // 目录: 目录项数
+#define BUF_ROUNDS    4      // buf cache: 每种模式扫描的遍数
+#define TMP_FILES     256    // 临时文件: 每轮创建、写入、删除的文件数
+#define TMP_SIZE      4096   // 临时文件: 每个文件写入的字节数
+#define SMALL_FILES   512    // 小文件: 文件数 (大小在内联区和TAIL_FILE_MAX之间, 尾块打包)
+#define COMP_PAGES    64     // 压缩文件: 页数 (每8页中一页全0, 一页不可压缩, 其余是重复的文本)
+#define CLONE_PAGES   256    // reflink: 源文件的页数 (进入二级地址, 克隆分成多段)
+
+extern super_block_t sb;
+extern void host_disk_attach(void* base, uint64 size);
+extern uint64 host_disk_reads, host_disk_writes;
+
+static int scale = 1;
+static uint32 blocks[BENCH_BLOCKS];
+static uint32 seed = 1;
+
+static uint32 rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+// -------------------------- 位图 --------------------------
+
+static void bench_bitmap()
+{
+    // 1. 连续分配和释放
+    for (int r = 0; r < scale; r++) {
+        journal_begin();
+        host_bench_begin();
+        for (int i = 0; i < BENCH_BLOCKS; i++) {
+            blocks[i] = bitmap_alloc_block();
+        }
+        host_bench_end("bitmap.alloc", BENCH_BLOCKS);
+        journal_end();
+
+        journal_begin();
+        host_bench_begin();
+        for (int i = 0; i < BENCH_BLOCKS; i++) {
+            bitmap_free_block(blocks[i]);
+        }
+        host_bench_end("bitmap.free", BENCH_BLOCKS);
+        journal_end();
+    }
+
+    // 2. 碎片化: 分配之后每隔一块释放一块, 再分配填满这些空洞
+    for (int r = 0; r < scale; r++) {
+        journal_begin();
+        for (int i = 0; i < BENCH_BLOCKS; i++) {
+            blocks[i] = bitmap_alloc_block();
+        }
+        for (int i = 0; i < BENCH_BLOCKS; i += 2) {
+            bitmap_free_block(blocks[i]);
+        }
+        journal_end();
+
+        journal_begin();
+        host_bench_begin();
+        for (int i = 0; i < BENCH_BLOCKS; i += 2) {
+            blocks[i] = bitmap_alloc_block();
+        }
+        host_bench_end("bitmap.alloc_fragmented", BENCH_BLOCKS / 2);
+        journal_end();
+
+        journal_begin();
+        for (int i = 0; i < BENCH_BLOCKS; i++) {
+            bitmap_free_block(blocks[i]);
+        }
+        journal_end();
+    }
+
+    // 3. 申请连续的块
+    for (int r = 0; r < scale; r++) {
+        int n = 0;
+        journal_begin();
+        host_bench_begin();
+        for (int i = 0; i < BENCH_BLOCKS / 16; i++) {
+            uint32 want = 16;
+            blocks[n] = bitmap_alloc_extent(0, &want);
+            blocks[n + 1] = want;
+            n += 2;
+        }
+        host_bench_end("bitmap.alloc_extent16", BENCH_BLOCKS / 16);
+        journal_end();
+
+        journal_begin();
+        for (int i = 0; i < n; i += 2) {
+            for (uint32 j = 0; j < blocks[i + 1]; j++) {
+                bitmap_free_block(blocks[i] + j);
+            }
+        }
+        journal_end();
+    }
+}
+
+// -------------------------- inode的块映射 --------------------------
+
+static void bench_locate(char* name, uint8 flags)
+{
+    char buf[64];
+
+    journal_begin();
+    inode_t* ip = inode_create_near(INODE_NUM_UNUSED, FT_FILE, 0, 0, flags);
+    journal_end();
+
+    // 1. 分配 (每LOCATE_BATCH块一个事务)
+    //    只计inode_locate_block, 事务的开始和提交暂停计时
+    inode_lock(ip);
+    host_bench_begin();
+    host_bench_pause();
+    for (uint32 bn = 0; bn < LOCATE_BLOCKS; bn += LOCATE_BATCH) {
+        journal_begin();
+        host_bench_resume();
+        for (uint32 i = bn; i < bn + LOCATE_BATCH; i++) {
+            inode_locate_block(ip, i, true);
+        }
+        host_bench_pause();
+        ip->size = (bn + LOCATE_BATCH) * BLOCK_SIZE;
+        inode_rw(ip, true);
+        journal_end();
+    }
+    ksnprintf(buf, sizeof(buf), "inode.locate_alloc%s", name);
+    host_bench_end(buf, LOCATE_BLOCKS);
+
+    // 2. 顺序和随机查找已有的块
+    uint32 iters = LOCATE_BLOCKS * 8 * scale;
+    ksnprintf(buf, sizeof(buf), "inode.locate_seq%s", name);
+    host_bench_begin();
+    for (uint32 i = 0; i < iters; i++) {
+        inode_locate_block(ip, i % LOCATE_BLOCKS, false);
+    }
+    host_bench_end(buf, iters);
+
+    ksnprintf(buf, sizeof(buf), "inode.locate_rand%s", name);
+    host_bench_begin();
+    for (uint32 i = 0; i < iters; i++) {
+        inode_locate_block(ip, rnd() % LOCATE_BLOCKS, false);
+    }
+    host_bench_end(buf, iters);
+
+    // 3. 删除文件
+    journal_begin();
+    ip->nlink = 0;
+    inode_unlock_free(ip);
+    journal_end();
+}
+
+// -------------------------- 目录 --------------------------
+
+static void entry_name(char* name, int i)
+{
+    ksnprintf(name, DIR_NAME_LEN, "entry%d", i);
+}
+
+static void bench_dir()
+{
+    char name[DIR_NAME_LEN];
+
+    journal_begin();
+    inode_t* dp = path_create_inode("/fsbench", FT_DIR, 0, 0, 0);
+    journal_end();
+    assert(dp != NULL, "bench_dir: create directory fail");
+
+    // 1. 添加目录项 (都指向根目录, 只用来查找)
+    inode_lock(dp);
+    host_bench_begin();
+    for (int i = 0; i < DIR_ENTRIES; i++) {
+        entry_name(name, i);
+        journal_begin();
+        dir_add_entry(dp, INODE_ROOT, name);
+        journal_end();
+    }
+    host_bench_end("dir.add_entry", DIR_ENTRIES);
+
+    // 2. 查找: 命中目录项缓存 / 每次先清空这个目录的缓存项 (查找目录块)
+    int iters = DIR_ENTRIES * 4 * scale;
+    host_bench_begin();
+    for (int i = 0; i < iters; i++) {
+        entry_name(name, rnd() % DIR_ENTRIES);
+        dir_search_entry(dp, name);
+    }
+    host_bench_end("dir.search_cached", iters);
+
+    host_bench_begin();
+    for (int i = 0; i < iters; i++) {
+        entry_name(name, rnd() % DIR_ENTRIES);
+        dcache_purge(dp->inode_num);
+        dir_search_entry(dp, name);
+    }
+    host_bench_end("dir.search_uncached", iters);
+
+    host_bench_begin();
+    for (int i = 0; i < iters; i++) {
+        entry_name(name, DIR_ENTRIES + rnd() % DIR_ENTRIES);
+        dcache_purge(dp->inode_num);
+        dir_search_entry(dp, name);
+    }
+    host_bench_end("dir.search_missing", iters);
+
+    // 3. 删除目录项和目录
+    host_bench_begin();
+    for (int i = 0; i < DIR_ENTRIES; i++) {
+        entry_name(name, i);
+        journal_begin();
+        dir_delete_entry(dp, name);
+        journal_end();
+    }
+    host_bench_end("dir.delete_entry", DIR_ENTRIES);
+    inode_unlock_free(dp);
+
+    journal_begin();
+    path_unlink("/fsbench");
+    journal_end();
+}
+
+// -------------------------- 临时文件 --------------------------
+
+// 创建、写入TMP_SIZE字节、删除一批短命的文件: 磁盘上的目录 (每次创建/删除都是日志操作) 与/tmp
+static void bench_tmp()
+{
+    static char data[TMP_SIZE];
+    char path[DIR_PATH_LEN];
+    uint64 reads = host_disk_reads, writes = host_disk_writes;
+
+    journal_begin();
+    inode_t* dp = path_create_inode("/fsbench_tmp", FT_DIR, 0, 0, 0);
+    journal_end();
+    assert(dp != NULL, "bench_tmp: create directory fail");
+    inode_free(dp);
+
+    host_bench_begin();
+    for (int r = 0; r < scale; r++) {
+        for (int i = 0; i < TMP_FILES; i++) {
+            ksnprintf(path, sizeof(path), "/fsbench_tmp/t%d", i);
+            journal_begin();
+            inode_t* ip = path_create_inode(path, FT_FILE, 0, 0, 0);
+            assert(ip != NULL, "bench_tmp: create file fail");
+            inode_lock(ip);
+            inode_write_data(ip, 0, TMP_SIZE, data, false);
+            inode_unlock_free(ip);
+            journal_end();
+        }
+        for (int i = 0; i < TMP_FILES; i++) {
+            ksnprintf(path, sizeof(path), "/fsbench_tmp/t%d", i);
+            journal_begin();
+            path_unlink(path);
+            journal_end();
+        }
+    }
+    host_bench_end("tmp.disk", TMP_FILES * scale);
+    buf_sync();
+    printf("@fsbench_stat tmp.disk disk_reads=%ld disk_writes=%ld\n",
+           host_disk_reads - reads, host_disk_writes - writes);
+
+    journal_begin();
+    path_unlink("/fsbench_tmp");
+    journal_end();
+
+    reads = host_disk_reads;
+    writes = host_disk_writes;
+    host_bench_begin();
+    for (int r = 0; r < scale; r++) {
+        for (int i = 0; i < TMP_FILES; i++) {
+            ksnprintf(path, sizeof(path), "/t%d", i);
+            file_t* file = tmpfs_open(path, MODE_CREATE | MODE_WRITE);
+            assert(file != NULL, "bench_tmp: tmpfs create fail");
+            uint32 off = 0;
+            tmpfs_rw(file, &off, TMP_SIZE, (uint64)data, false, true);
+            tmpfs_close(file->tmp);
+            host_free(file);
+        }
+        for (int i = 0; i < TMP_FILES; i++) {
+            ksnprintf(path, sizeof(path), "/t%d", i);
+            tmpfs_unlink(path);
+        }
+    }
+    host_bench_end("tmp.tmpfs", TMP_FILES * scale);
+    printf("@fsbench_stat tmp.tmpfs disk_reads=%ld disk_writes=%ld\n",
+           host_disk_reads - reads, host_disk_writes - writes);
+}
+
+// -------------------------- 小文件 --------------------------
+
+// 小文件的第k个字节 (校验内容用)
+static char small_byte(int i, uint32 k)
+{
+    return (char)(i * 31 + k);
+}
+
+// 创建一批不超过TAIL_FILE_MAX的小文件 (每个分两次写入, 第二次写入使尾块中的位置增长),
+// 读回校验, 统计占用的数据块; 删除后所有块都应该归还
+static void bench_small()
+{
+    static char data[BLOCK_SIZE];
+    char path[DIR_PATH_LEN];
+    uint32 free_start, free_before, free_after, free_end, inodes;
+
+    bitmap_free_count(&free_start, &inodes);
+    journal_begin();
+    inode_t* dp = path_create_inode("/fsbench_small", FT_DIR, 0, 0, 0);
+    journal_end();
+    assert(dp != NULL, "bench_small: create directory fail");
+    inode_free(dp);
+    bitmap_free_count(&free_before, &inodes);
+
+    host_bench_begin();
+    for (int i = 0; i < SMALL_FILES; i++) {
+        uint32 size = 100 + (i * 37) % (BLOCK_SIZE / 2 - 100);
+        for (uint32 k = 0; k < size; k++) {
+            data[k] = small_byte(i, k);
+        }
+        ksnprintf(path, sizeof(path), "/fsbench_small/s%d", i);
+        journal_begin();
+        inode_t* ip = path_create_inode(path, FT_FILE, 0, 0, 0);
+        assert(ip != NULL, "bench_small: create file fail");
+        inode_lock(ip);
+        inode_write_data(ip, 0, size / 2, data, false);
+        inode_write_data(ip, size / 2, size - size / 2, data + size / 2, false);
+        inode_unlock_free(ip);
+        journal_end();
+    }
+    host_bench_end("small.create", SMALL_FILES);
+    pcache_sync();  // 延迟分配的块在写回时才分配
+    bitmap_free_count(&free_after, &inodes);
+
+    for (int i = 0; i < SMALL_FILES; i++) {
+        uint32 size = 100 + (i * 37) % (BLOCK_SIZE / 2 - 100);
+        ksnprintf(path, sizeof(path), "/fsbench_small/s%d", i);
+        inode_t* ip = path_to_inode(path);
+        assert(ip != NULL, "bench_small: lookup fail");
+        inode_lock(ip);
+        assert(ip->size == size && inode_read_data(ip, 0, size, data, false) == size, "bench_small: short read");
+        inode_unlock_free(ip);
+        for (uint32 k = 0; k < size; k++) {
+            assert(data[k] == small_byte(i, k), "bench_small: content mismatch");
+        }
+    }
+
+    for (int i = 0; i < SMALL_FILES; i++) {
+        ksnprintf(path, sizeof(path), "/fsbench_small/s%d", i);
+        journal_begin();
+        path_unlink(path);
+        journal_end();
+    }
+    journal_begin();
+    path_unlink("/fsbench_small");
+    journal_end();
+    bitmap_free_count(&free_end, &inodes);
+    printf("@fsbench_stat small.create files=%d data_blocks=%d blocks_leaked=%d\n", SMALL_FILES,
+           free_before - free_after, free_start - free_end);
+}
+
+// -------------------------- 压缩文件 --------------------------
+
+// 压缩文件第p页的第k个字节
+static char comp_byte(uint32 p, uint32 k)
+{
+    static const char text[] = "compressed cluster of the fsbench file ";
+    if (p % 8 == 6) {
+        return 0;
+    }
+    if (p % 8 == 7) {
+        uint32 x = p * PGSIZE + k;
+        x = (x ^ (x >> 16)) * 0x7FEB352D;
+        x = (x ^ (x >> 15)) * 0x846CA68B;
+        return (char)(x ^ (x >> 16));
+    }
+    return text[(k + p) % (sizeof(text) - 1)];
+}
+
+// 读出第p页并校验前n个字节, 其余的字节应该是0
+static void comp_check(inode_t* ip, uint32 p, uint32 n, char* data)
+{
+    assert(inode_read_data(ip, p * PGSIZE, PGSIZE, data, false) == PGSIZE, "bench_compress: short read");
+    for (uint32 k = 0; k < PGSIZE; k++) {
+        assert(data[k] == (k < n ? comp_byte(p, k) : 0), "bench_compress: content mismatch");
+    }
+}
+
+// 逐页写入压缩文件并写回 (压缩), 丢弃缓存页后读回校验 (解压), 统计占用的数据块;
+// 再截断到一页中间后扩展, 截掉的部分读出0; 删除后所有块都应该归还
+static void bench_compress()
+{
+    static char data[PGSIZE];
+    uint32 free_start, free_after, free_end, inodes;
+
+    bitmap_free_count(&free_start, &inodes);
+    journal_begin();
+    inode_t* ip = path_create_inode("/fsbench_comp", FT_FILE, 0, 0, INODE_F_COMPRESS);
+    journal_end();
+    assert(ip != NULL, "bench_compress: create file fail");
+
+    host_bench_begin();
+    for (uint32 p = 0; p < COMP_PAGES; p++) {
+        for (uint32 k = 0; k < PGSIZE; k++) {
+            data[k] = comp_byte(p, k);
+        }
+        journal_begin();
+        inode_lock(ip);
+        inode_write_data(ip, p * PGSIZE, PGSIZE, data, false);
+        inode_unlock(ip);
+        journal_end();
+    }
+    pcache_sync();  // 写回时压缩
+    host_bench_end("comp.write", COMP_PAGES);
+    bitmap_free_count(&free_after, &inodes);
+
+    pcache_deactivate(ip->inode_num, 0, COMP_PAGES, true);
+    host_bench_begin();
+    inode_lock(ip);
+    for (uint32 p = 0; p < COMP_PAGES; p++) {
+        comp_check(ip, p, PGSIZE, data);
+    }
+    inode_unlock(ip);
+    host_bench_end("comp.read", COMP_PAGES);
+
+    uint32 cut = 10 * PGSIZE + 100;
+    journal_begin();
+    inode_lock(ip);
+    inode_truncate(ip, cut);
+    inode_unlock(ip);
+    journal_end();
+    pcache_deactivate(ip->inode_num, 0, COMP_PAGES, true);
+    journal_begin();
+    inode_lock(ip);
+    inode_truncate(ip, 12 * PGSIZE);
+    comp_check(ip, 9, PGSIZE, data);
+    comp_check(ip, 10, 100, data);
+    comp_check(ip, 11, 0, data);
+    inode_unlock_free(ip);
+    journal_end();
+
+    journal_begin();
+    path_unlink("/fsbench_comp");
+    journal_end();
+    bitmap_free_count(&free_end, &inodes);
+    printf("@fsbench_stat comp.write pages=%d raw_blocks=%d data_blocks=%d blocks_leaked=%d\n", COMP_PAGES,
+           COMP_PAGES * PCACHE_BLOCKS, free_start - free_after, free_start - free_end);
+}
+
+// -------------------------- reflink --------------------------
+
+// 克隆的源文件第p页的第k个字节 (改过的页: 取反)
+static char clone_byte(uint32 p, uint32 k, bool modified)
+{
+    char c = (char)(p * 7 + k / 16);
+    return modified ? ~c : c;
+}
+
+// 读出第p页并校验
+static void clone_check(inode_t* ip, uint32 p, uint32 n, bool modified, char* data)
+{
+    assert(inode_read_data(ip, p * PGSIZE, PGSIZE, data, false) == PGSIZE, "bench_clone: short read");
+    for (uint32 k = 0; k < PGSIZE; k++) {
+        assert(data[k] == (k < n ? clone_byte(p, k, modified) : 0), "bench_clone: content mismatch");
+    }
+}
+
+// 克隆一个写回过的文件 (只增加引用计数), 统计克隆新占用的块 (只有索引块);
+// 改写克隆的一页、截断到一页中间, 丢弃缓存页后两个文件各自读回校验; 全部删除后所有块都应该归还
+static void bench_clone()
+{
+    static char data[PGSIZE];
+    uint32 free_start, free_cloned, free_end, inodes;
+
+    assert(refcnt_enable() == 0, "bench_clone: no refcount table");
+    bitmap_free_count(&free_start, &inodes);
+    journal_begin();
+    inode_t* src = path_create_inode("/fsbench_src", FT_FILE, 0, 0, 0);
+    inode_t* dst = path_create_inode("/fsbench_clone", FT_FILE, 0, 0, 0);
+    journal_end();
+    assert(src != NULL && dst != NULL, "bench_clone: create file fail");
+    for (uint32 p = 0; p < CLONE_PAGES; p++) {
+        for (uint32 k = 0; k < PGSIZE; k++) {
+            data[k] = clone_byte(p, k, false);
+        }
+        journal_begin();
+        inode_lock(src);
+        inode_write_data(src, p * PGSIZE, PGSIZE, data, false);
+        inode_unlock(src);
+        journal_end();
+    }
+    pcache_sync();
+    bitmap_free_count(&free_cloned, &inodes);
+
+    host_bench_begin();
+    uint32 bn = 0, segs = 0;
+    int ret = 1;
+    while (ret == 1) {
+        journal_begin();
+        inode_lock(src);
+        inode_lock(dst);
+        ret = inode_clone(dst, src, &bn);
+        inode_unlock(dst);
+        inode_unlock(src);
+        journal_end();
+        segs++;
+    }
+    host_bench_end("clone", CLONE_PAGES);
+    assert(ret == 0 && dst->size == src->size, "bench_clone: clone fail");
+    uint32 free_after;
+    bitmap_free_count(&free_after, &inodes);
+
+    // 改写克隆的第5页, 截断到第20页中间
+    uint32 cut = 20 * PGSIZE + 100;
+    for (uint32 k = 0; k < PGSIZE; k++) {
+        data[k] = clone_byte(5, k, true);
+    }
+    journal_begin();
+    inode_lock(dst);
+    inode_write_data(dst, 5 * PGSIZE, PGSIZE, data, false);
+    inode_truncate(dst, cut);
+    inode_unlock(dst);
+    journal_end();
+    pcache_sync();
+    pcache_deactivate(src->inode_num, 0, CLONE_PAGES, true);
+    pcache_deactivate(dst->inode_num, 0, CLONE_PAGES, true);
+
+    journal_begin();
+    inode_lock(dst);
+    inode_truncate(dst, 21 * PGSIZE);
+    clone_check(dst, 4, PGSIZE, false, data);
+    clone_check(dst, 5, PGSIZE, true, data);
+    clone_check(dst, 20, 100, false, data);
+    inode_unlock_free(dst);
+    journal_end();
+    inode_lock(src);
+    for (uint32 p = 0; p < CLONE_PAGES; p++) {
+        clone_check(src, p, PGSIZE, false, data);
+    }
+    inode_unlock(src);
+
+    journal_begin();
+    inode_free(src);
+    path_unlink("/fsbench_clone");
+    path_unlink("/fsbench_src");
+    journal_end();
+    bitmap_free_count(&free_end, &inodes);
+    printf("@fsbench_stat clone pages=%d segments=%d file_blocks=%d clone_blocks=%d blocks_leaked=%d\n",
+           CLONE_PAGES, segs, free_start - free_cloned, free_cloned - free_after, free_start - free_end);
+}
+
+// -------------------------- buf cache --------------------------
+
+// 按模式读nread次 (每次buf_read + buf_release), 块号是数据区中从first开始的相对编号
+static void buf_pattern(char* name, uint32 first, uint32 span, uint32 hot, uint32 nread)
+{
+    buf_stat_t before, after;
+    buf_stat(&before);
+    host_bench_begin();
+    for (uint32 i = 0; i < nread; i++) {
+        uint32 bn;
+        if (hot == 0) {
+            bn = i % span;                                  // 循环顺序扫描
+        } else {
+            bn = (i & 1) ? rnd() % hot : hot + i % span;    // 一半访问热点, 一半顺序扫描其余的块
+        }
+        buf_release(buf_read(first + bn));
+    }
+    host_bench_end(name, nread);
+    buf_stat(&after);
+    printf("@fsbench_stat %s lookups=%ld misses=%ld disk_reads=%ld\n", name,
+           after.lookups - before.lookups, after.misses - before.misses,
+           after.disk_reads - before.disk_reads);
+}
+
+static void bench_buf()
+{
+    static char* policy_name[] = {"lru", "2q"};
+    static uint32 policies[] = {BUF_POLICY_LRU, BUF_POLICY_2Q};
+    char name[64];
+
+    // 没有flusher: 先写回前面各项留下的dirty buf (dirty buf不能被淘汰)
+    // 再读一遍数据区 (不计时): 空闲内存充足时buf cache扩容到上限, 之后按它的大小选择工作集
+    buf_sync();
+    uint32 first = sb.data_start + sb.journal_blocks + 64;  // 跳过根目录和日志区
+    uint32 span = sb.total_blocks - first;
+    for (uint32 i = 0; i < span; i++) {
+        buf_release(buf_read(first + i));
+    }
+    buf_stat_t st;
+    buf_stat(&st);
+    uint32 nbuf = st.nbuf;
+    if (2 * nbuf + nbuf / 4 > span) {
+        printf("fsbench: %d data blocks cannot hold the buf cache working sets (mkfs -n)\n", span);
+        return;
+    }
+
+    for (int p = 0; p < 2; p++) {
+        buf_set_policy(policies[p]);
+
+        ksnprintf(name, sizeof(name), "buf.fit_%s", policy_name[p]);
+        buf_pattern(name, first, nbuf / 2, 0, nbuf / 2 * BUF_ROUNDS * scale);
+
+        ksnprintf(name, sizeof(name), "buf.loop_%s", policy_name[p]);
+        buf_pattern(name, first, nbuf * 2, 0, nbuf * 2 * BUF_ROUNDS * scale);
+
+        ksnprintf(name, sizeof(name), "buf.hot_scan_%s", policy_name[p]);
+        buf_pattern(name, first, nbuf * 2, nbuf / 4, nbuf * 2 * BUF_ROUNDS * scale);
+    }
+    buf_set_policy(BUF_POLICY_2Q);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        printf("usage: fsbench fs.img [scale]\n");
+        return 1;
+    }
+    bool mount_only = false;
+    if (argc > 2) {
+        scale = 0;
+        for (char* s = argv[2]; *s >= '0' && *s <= '9'; s++) {
+            scale = scale * 10 + (*s - '0');
+        }
+        mount_only = (scale == 0);
+        if (scale <= 0) {
+            scale = 1;
+        }
+    }
+
+    uint64 size;
+    void* image = host_image_map(argv[1], &size);
+    host_disk_attach(image, size);
+    fs_init();
+    if (mount_only) {
+        // 写回并归还各hart预留的块和inode, 空闲计数才能与另一次挂载比较
+        fs_stat_t st;
+        fs_sync();
+        fs_statfs(&st);
+        printf("@fsbench_stat mount free_blocks=%d free_inodes=%d\n", st.free_blocks, st.free_inodes);
+        return 0;
+    }
+    host_perf_init();
+
+    bench_bitmap();
+    bench_locate("", 0);
+    bench_locate("_extent", INODE_F_EXTENT);
+    bench_dir();
+    bench_tmp();
+    bench_small();
+    bench_compress();
+    bench_clone();
+    bench_buf();
+    return 0;
+}
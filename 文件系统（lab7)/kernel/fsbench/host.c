@@ -0,0 +1,402 @@
+#include "common.h"
+#include "lib/lock.h"
+#include "lib/print.h"
+#include "lib/klog.h"
+#include "lib/bootopt.h"
+#include "lib/str.h"
+#include "mem/pmem.h"
+#include "mem/slab.h"
+#include "mem/vmem.h"
+#include "mem/swap.h"
+#include "dev/blk.h"
+#include "dev/ramdisk.h"
+#include "dev/vio.h"
+#include "dev/timer.h"
+#include "fs/buf.h"
+#include "fs/file.h"
+#include "proc/proc.h"
+#include "proc/cpu.h"
+#include "host.h"
+
+/*
+    fsbench中替代内核其他模块的部分, fs模块原样编译
+        只有一个进程、一个hart: 锁只记录状态 (重复获得、释放没有持有的锁时panic), 不会睡眠
+        块设备是内存中的磁盘映像: 请求在提交时同步完成
+        页和slab对象从宿主机的堆中申请
+*/
+
+int ncpu = 1;
+
+// -------------------------- 输出 --------------------------
+
+void panic(const char* warning)
+{
+    printf("panic: %s\n", warning);
+    host_abort();
+}
+
+void assert(bool condition, const char* warning)
+{
+    if (!condition) {
+        panic(warning);
+    }
+}
+
+void klog(const char* fmt, ...)
+{
+}
+
+// 启动选项来自环境变量FSBENCH_BOOTOPT (make selftest: fs_selftest)
+bool bootopt(char* name)
+{
+    return host_bootopt(name);
+}
+
+// -------------------------- 锁 --------------------------
+
+void spinlock_init(spinlock_t* lk, char* name)
+{
+    lk->locked = 0;
+    lk->name = name;
+    lk->cpuid = -1;
+}
+
+void spinlock_init_ticket(spinlock_t* lk, char* name)
+{
+    spinlock_init(lk, name);
+    lk->ticket = true;
+}
+
+void spinlock_acquire(spinlock_t* lk)
+{
+    if (lk->locked) {
+        printf("spinlock %s\n", lk->name);
+        panic("spinlock_acquire: already held");
+    }
+    lk->locked = 1;
+    lk->cpuid = 0;
+}
+
+void spinlock_release(spinlock_t* lk)
+{
+    assert(lk->locked, "spinlock_release: not held");
+    lk->locked = 0;
+    lk->cpuid = -1;
+}
+
+bool spinlock_holding(spinlock_t* lk)
+{
+    return lk->locked;
+}
+
+void rwspinlock_init(rwspinlock_t* lk, char* name)
+{
+    lk->state = 0;
+    lk->wwait = 0;
+    lk->name = name;
+    lk->cpuid = -1;
+}
+
+void rwspinlock_acquire_read(rwspinlock_t* lk)
+{
+    assert(!(lk->state & RW_WRITER), "rwspinlock_acquire_read: writer holds the lock");
+    lk->state++;
+}
+
+void rwspinlock_release_read(rwspinlock_t* lk)
+{
+    assert(lk->state > 0 && !(lk->state & RW_WRITER), "rwspinlock_release_read: not held");
+    lk->state--;
+}
+
+void rwspinlock_acquire_write(rwspinlock_t* lk)
+{
+    assert(lk->state == 0, "rwspinlock_acquire_write: already held");
+    lk->state = RW_WRITER;
+    lk->cpuid = 0;
+}
+
+void rwspinlock_release_write(rwspinlock_t* lk)
+{
+    assert(lk->state == RW_WRITER, "rwspinlock_release_write: not held");
+    lk->state = 0;
+    lk->cpuid = -1;
+}
+
+bool rwspinlock_holding_write(rwspinlock_t* lk)
+{
+    return lk->state == RW_WRITER;
+}
+
+void sleeplock_init(sleeplock_t* lk, char* name)
+{
+    lk->locked = 0;
+    lk->readers = 0;
+    lk->wwait = 0;
+    lk->name = name;
+    lk->pid = 0;
+    lk->owner = NULL;
+    lk->pi_boosted = false;
+}
+
+bool sleeplock_try_acquire(sleeplock_t* lk)
+{
+    if (lk->locked || lk->readers > 0) {
+        return false;
+    }
+    lk->locked = 1;
+    lk->owner = myproc();
+    lk->pid = myproc()->pid;
+    return true;
+}
+
+void sleeplock_acquire(sleeplock_t* lk)
+{
+    if (!sleeplock_try_acquire(lk)) {
+        printf("sleeplock %s\n", lk->name);
+        panic("sleeplock_acquire: would sleep");
+    }
+}
+
+void sleeplock_release(sleeplock_t* lk)
+{
+    assert(lk->locked && lk->owner == myproc(), "sleeplock_release: not held");
+    lk->locked = 0;
+    lk->owner = NULL;
+    lk->pid = 0;
+}
+
+bool sleeplock_holding(sleeplock_t* lk)
+{
+    return lk->locked && lk->owner == myproc();
+}
+
+void sleeplock_acquire_shared(sleeplock_t* lk)
+{
+    if (lk->locked) {
+        printf("sleeplock %s\n", lk->name);
+        panic("sleeplock_acquire_shared: would sleep");
+    }
+    lk->readers++;
+}
+
+void sleeplock_release_shared(sleeplock_t* lk)
+{
+    assert(lk->readers > 0, "sleeplock_release_shared: not held");
+    lk->readers--;
+}
+
+bool sleeplock_holding_any(sleeplock_t* lk)
+{
+    return sleeplock_holding(lk) || lk->readers > 0;
+}
+
+// -------------------------- 进程 --------------------------
+
+static mm_t host_mm;
+static proc_t host_proc = { .pid = 1, .mm = &host_mm };
+
+proc_t* myproc(void)
+{
+    return &host_proc;
+}
+
+int mycpuid(void)
+{
+    return 0;
+}
+
+void proc_sleep(void* sleep_space, spinlock_t* lk)
+{
+    panic("proc_sleep: single process, nobody to wake us");
+}
+
+void proc_wakeup(void* sleep_space)
+{
+}
+
+void proc_cond_resched()
+{
+}
+
+// -------------------------- 内存 --------------------------
+
+void* pmem_alloc_flags(bool in_kernel, uint32 flags)
+{
+    return host_alloc(PGSIZE);
+}
+
+void* pmem_alloc(bool in_kernel)
+{
+    return pmem_alloc_flags(in_kernel, PMEM_ZERO);
+}
+
+void pmem_free(uint64 page, bool in_kernel)
+{
+    host_free((void*)page);
+}
+
+void* pmem_alloc_order(uint32 order)
+{
+    return host_alloc((unsigned long long)PGSIZE << order);
+}
+
+void pmem_free_order(uint64 page, uint32 order)
+{
+    host_free((void*)page);
+}
+
+uint32 pmem_free_pages(bool in_kernel)
+{
+    return 1u << 20;
+}
+
+void pmem_register_reclaim(bool in_kernel, pmem_reclaim_t fn)
+{
+}
+
+void kmem_cache_init(kmem_cache_t* cache, char* name, uint32 obj_size, uint32 tag)
+{
+    cache->name = name;
+    cache->obj_size = (obj_size + 7) / 8 * 8;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache)
+{
+    return host_alloc(cache->obj_size);
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj)
+{
+    host_free(obj);
+}
+
+// 没有用户地址空间: 用户地址就是宿主机地址
+pte_t* vm_getpte(pgtbl_t pgtbl, uint64 va, bool alloc)
+{
+    return NULL;
+}
+
+void uvm_copyin(pgtbl_t pgtbl, uint64 dst, uint64 src, uint32 len)
+{
+    memmove((void*)dst, (void*)src, len);
+}
+
+void uvm_copyout(pgtbl_t pgtbl, uint64 dst, uint64 src, uint32 len)
+{
+    memmove((void*)dst, (void*)src, len);
+}
+
+void swap_init()
+{
+}
+
+// -------------------------- 文件项 --------------------------
+
+// tmpfs_open只需要一个清零的文件项, 由tmpfs_close之后的调用者释放 (见bench_tmp)
+file_t* file_alloc()
+{
+    file_t* file = host_alloc(sizeof(file_t));
+    file->ref = 1;
+    return file;
+}
+
+// -------------------------- 时钟 --------------------------
+
+uint64 timer_get_mtime()
+{
+    return host_now_ns() / TIMER_NS_PER_MTIME;
+}
+
+uint64 timer_get_ticks()
+{
+    return timer_get_mtime() / 100000;
+}
+
+// -------------------------- 块设备 --------------------------
+
+static uint8* disk;
+static uint64 disk_size;
+uint64 host_disk_reads, host_disk_writes;
+
+void host_disk_attach(void* base, uint64 size)
+{
+    disk = base;
+    disk_size = size;
+}
+
+static void disk_io(uint64 offset, void* data, uint32 len, bool write)
+{
+    if (offset + len > disk_size) {
+        panic("disk_io: beyond the end of the image");
+    }
+    if (write) {
+        memmove(disk + offset, data, len);
+        host_disk_writes++;
+    } else {
+        memmove(data, disk + offset, len);
+        host_disk_reads++;
+    }
+}
+
+void blk_init()
+{
+}
+
+bool blk_submit(buf_t* b, bool write, bool nowait)
+{
+    disk_io((uint64)b->block_num * BLOCK_SIZE, b->data, BLOCK_SIZE, write);
+    b->disk = false;
+    return true;
+}
+
+void blk_wait(buf_t* b)
+{
+}
+
+void blk_rw(buf_t* b, bool write)
+{
+    blk_submit(b, write, false);
+}
+
+void blk_unplug()
+{
+}
+
+void blk_barrier()
+{
+}
+
+void blk_rw_poll(buf_t* b, bool write)
+{
+    blk_submit(b, write, false);
+}
+
+void blk_rw_sg(uint64 sector, virtio_seg_t* seg, int nseg, bool write)
+{
+    uint64 offset = sector * 512;
+    for (int i = 0; i < nseg; i++) {
+        disk_io(offset, (void*)seg[i].addr, seg[i].len, write);
+        offset += seg[i].len;
+    }
+}
+
+// 块设备本来就是内存中的映像, bootopt("ramdisk")总是false, 不会走到这里
+void blk_use_ramdisk()
+{
+    panic("blk_use_ramdisk: not supported in fsbench");
+}
+
+void ramdisk_init(uint32 nblocks)
+{
+    panic("ramdisk_init: not supported in fsbench");
+}
+
+void ramdisk_load()
+{
+}
+
+uint32 ramdisk_pages()
+{
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef __HOST_H__
+#define __HOST_H__
+
+// fsbench中依赖宿主机C库的部分 (host_os.c): 不包含内核的头文件, 类型只用C的基本类型
+
+void*  host_image_map(const char* path, unsigned long long* size); // 私有映射磁盘映像 (写入不改变文件)
+unsigned long long host_now_ns();
+int    host_bootopt(const char* name);          // 环境变量FSBENCH_BOOTOPT中是否有单词name
+void   host_perf_init();                        // 打开CPU周期和指令数计数器 (不可用时只计时)
+void   host_bench_begin();
+void   host_bench_pause();                       // 暂停计时和计数 (例如跳过日志事务的提交)
+void   host_bench_resume();
+void   host_bench_end(const char* name, unsigned long long iters); // 输出一行结果 (只计未暂停的部分)
+void*  host_alloc(unsigned long long size);   // 按页对齐, 内容全0
+void   host_free(void* p);
+void   host_abort();
+
+#endif
@@ -0,0 +1,215 @@
+// fsbench的宿主机部分: 其余文件用-Dprintf=kprintf等编译 (见Makefile), 这里需要C库原来的名字
+#undef printf
+#undef memset
+#undef memmove
+#undef memcmp
+#undef memcpy
+#undef strlen
+#undef strncmp
+#undef strncpy
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "host.h"
+
+// 内核的printf / panic / assert (格式不超出C库printf的范围)
+void kprintf(const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
+int host_bootopt(const char* name)
+{
+    const char* p = getenv("FSBENCH_BOOTOPT");
+    size_t len = strlen(name);
+    while (p != NULL && *p != 0) {
+        while (*p == ' ') {
+            p++;
+        }
+        const char* w = p;
+        while (*p != 0 && *p != ' ') {
+            p++;
+        }
+        if ((size_t)(p - w) == len && strncmp(w, name, len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void* host_alloc(unsigned long long size)
+{
+    void* p = aligned_alloc(4096, (size + 4095) / 4096 * 4096);
+    if (p == NULL) {
+        perror("aligned_alloc");
+        exit(1);
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+void host_free(void* p)
+{
+    free(p);
+}
+
+// 与内核的ksnprintf相同: 返回实际写入的字节数 (截断时不超过size - 1)
+unsigned int ksnprintf(char* buf, unsigned int size, const char* fmt, ...)
+{
+    va_list ap;
+    if (size == 0) {
+        return 0;
+    }
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, size, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        n = 0;
+    }
+    return ((unsigned int)n < size) ? (unsigned int)n : size - 1;
+}
+
+void host_abort()
+{
+    fflush(stdout);
+    abort();
+}
+
+void* host_image_map(const char* path, unsigned long long* size)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+    void* base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    close(fd);
+    *size = st.st_size;
+    return base;
+}
+
+unsigned long long host_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 一组计数器: 周期 (组长) + 指令数, 一次read读出两者
+static int perf_fd = -1;
+static unsigned long long bench_ns;
+static uint64_t bench_count[2];
+// 暂停 (host_bench_pause) 之前各段累计的时间和计数
+static unsigned long long bench_acc_ns;
+static uint64_t bench_acc[2];
+static int bench_paused;
+
+#ifdef __linux__
+static int perf_open(uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = (group < 0);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+void host_perf_init()
+{
+#ifdef __linux__
+    perf_fd = perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (perf_fd >= 0 && perf_open(PERF_COUNT_HW_INSTRUCTIONS, perf_fd) < 0) {
+        close(perf_fd);
+        perf_fd = -1;
+    }
+#endif
+    if (perf_fd < 0) {
+        printf("fsbench: perf counters unavailable, cycles_op and insns_op are 0\n");
+    }
+}
+
+static void perf_read(uint64_t* count)
+{
+    uint64_t v[3] = {0, 0, 0};   // nr, cycles, instructions
+    if (perf_fd >= 0 && read(perf_fd, v, sizeof(v)) == sizeof(v)) {
+        count[0] = v[1];
+        count[1] = v[2];
+    } else {
+        count[0] = count[1] = 0;
+    }
+}
+
+void host_bench_begin()
+{
+#ifdef __linux__
+    if (perf_fd >= 0) {
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+    bench_acc_ns = 0;
+    bench_acc[0] = bench_acc[1] = 0;
+    bench_paused = 0;
+    perf_read(bench_count);
+    bench_ns = host_now_ns();
+}
+
+void host_bench_pause()
+{
+    if (bench_paused) {
+        return;
+    }
+    unsigned long long ns = host_now_ns();
+    uint64_t count[2];
+    perf_read(count);
+    bench_acc_ns += ns - bench_ns;
+    bench_acc[0] += count[0] - bench_count[0];
+    bench_acc[1] += count[1] - bench_count[1];
+    bench_paused = 1;
+}
+
+void host_bench_resume()
+{
+    if (!bench_paused) {
+        return;
+    }
+    bench_paused = 0;
+    perf_read(bench_count);
+    bench_ns = host_now_ns();
+}
+
+void host_bench_end(const char* name, unsigned long long iters)
+{
+    host_bench_pause();
+    if (iters == 0) {
+        iters = 1;
+    }
+    printf("@fsbench %s iters=%llu ns_op=%.1f cycles_op=%.1f insns_op=%.1f\n", name, iters,
+           (double)bench_acc_ns / iters, (double)bench_acc[0] / iters, (double)bench_acc[1] / iters);
+}
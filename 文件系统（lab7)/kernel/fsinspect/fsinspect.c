@@ -0,0 +1,509 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fs/fs.h"
+#include "fs/inode.h"
+#include "fs/extent.h"
+#include "fs/tail.h"
+#include "fs/dir.h"
+#include "fs/journal.h"
+#include "fs/refcnt.h"
+#include "mem/swap.h"
+
+// 离线检查磁盘映像的主机端工具: 直接使用内核的磁盘结构 (include/fs), 不修改映像
+// 输出超级块、空闲空间及其碎片、每个文件的extent数、目录大小, 以及文件大小和映射方式 (直接/一级间接/二级间接/extent/内联/尾块) 的分布
+// 同时核对位图: 被文件引用但位图中空闲的块, 以及位图中已用但没有被引用的块; 有引用计数表时核对reflink共享的块
+// 用法: ./fsinspect fs.img [-v]    -v: 列出每个文件
+// block大小取自超级块, 与编译时的BLOCK_SIZE无关
+
+#define MAX_BLOCK   4096
+#define N_HIST      24     // 按2的幂分桶的直方图: 第i桶是[2^(i-1), 2^i), 第0桶是0
+#define FS_MAGIC        0x12345678  // 与kernel/fs/fs.c一致
+#define DIR_INDEX_MAGIC 0x58444944  // 与kernel/fs/dir.c一致: 哈希索引目录的索引节点
+
+// 文件的映射方式
+enum { MAP_INLINE, MAP_TAIL, MAP_DIRECT, MAP_INDIRECT, MAP_DOUBLE, MAP_EXTENT, MAP_EXTENT_TREE, N_MAP };
+static char* map_name[N_MAP] = {"inline", "tail", "direct", "indirect", "double-indirect", "extent", "extent-tree"};
+
+static int fd;
+static super_block_t sb;
+static uint32 bsize;         // 超级块记录的block大小
+static uint32 n_inode;
+static uint8* data_ref;      // 每个data block被引用的次数 (饱和到255)
+static uint8* data_used;     // data位图的副本 (每个block一字节)
+static uint8* inode_used;    // inode位图的副本
+static uint8* tail_seen;     // 已经统计过的尾块 (多个文件共享一个尾块, 只算一次引用)
+static uint32 tail_blocks;   // 尾块数
+static int verbose;
+
+// 一个inode的统计 (遍历块映射时累计)
+typedef struct file_info {
+    uint32 blocks;           // 数据块数
+    uint32 meta;             // 索引块 / extent叶子块数
+    uint32 runs;             // 物理上连续的段数 (碎片数)
+    uint32 last;             // 上一个数据块的物理编号
+    uint32 bad;              // 超出数据区的块号
+    char*  path;             // 目录树中找到的第一个路径
+    uint32 dir_entries;      // 目录: 有效目录项数
+} file_info_t;
+
+static file_info_t* files;
+
+static void block_read(uint32 block_num, void* buf)
+{
+    off_t off = (off_t)block_num * bsize;
+    if (pread(fd, buf, bsize, off) != bsize) {
+        fprintf(stderr, "fsinspect: read block %u failed\n", block_num);
+        exit(1);
+    }
+}
+
+static void inode_read(uint16 inum, inode_t* ip)
+{
+    uint8 buf[MAX_BLOCK];
+    uint32 per_block = bsize / INODE_DISK_SIZE;
+    block_read(sb.inode_start + inum / per_block, buf);
+    memset(ip, 0, sizeof(*ip));
+    memmove(&ip->type, buf + (inum % per_block) * INODE_DISK_SIZE, INODE_DISK_SIZE);
+    ip->inode_num = inum;
+}
+
+static int bitmap_get(uint8* bits, uint32 i)
+{
+    return (bits[i / 8] >> (i % 8)) & 1;
+}
+
+// 位图复制到每个bit一字节的数组中
+static uint8* bitmap_load(uint32 start, uint32 nblocks, uint32 nbits)
+{
+    uint8 buf[MAX_BLOCK];
+    uint8* used = calloc(nbits, 1);
+    for (uint32 b = 0; b < nblocks; b++) {
+        block_read(start + b, buf);
+        for (uint32 i = 0; i < bsize * 8 && b * bsize * 8 + i < nbits; i++) {
+            used[b * bsize * 8 + i] = bitmap_get(buf, i);
+        }
+    }
+    return used;
+}
+
+static int hist_bucket(uint64 x)
+{
+    int b = 0;
+    while (x > 0 && b < N_HIST - 1) {
+        x >>= 1;
+        b++;
+    }
+    return b;
+}
+
+// 记录一次块引用, 返回块是否在数据区内
+static int block_ref(uint32 block_num)
+{
+    if (block_num < sb.data_start || block_num >= sb.data_start + sb.data_blocks) {
+        return 0;
+    }
+    uint8* r = &data_ref[block_num - sb.data_start];
+    if (*r < 255) {
+        (*r)++;
+    }
+    return 1;
+}
+
+static void data_block(file_info_t* fi, uint32 block_num)
+{
+    if (!block_ref(block_num)) {
+        fi->bad++;
+        return;
+    }
+    if (fi->blocks == 0 || block_num != fi->last + 1) {
+        fi->runs++;
+    }
+    fi->blocks++;
+    fi->last = block_num;
+}
+
+static void meta_block(file_info_t* fi, uint32 block_num)
+{
+    if (!block_ref(block_num)) {
+        fi->bad++;
+        return;
+    }
+    fi->meta++;
+}
+
+// 块映射: level = 0时block_num是数据块, 否则是level级索引块
+static void map_walk(file_info_t* fi, uint32 block_num, int level, void (*visit)(file_info_t*, uint32, void*), void* arg)
+{
+    if (block_num == 0) {
+        return;
+    }
+    if (level == 0) {
+        data_block(fi, block_num);
+        if (visit) visit(fi, block_num, arg);
+        return;
+    }
+    meta_block(fi, block_num);
+    if (block_num < sb.data_start || block_num >= sb.data_start + sb.data_blocks) {
+        return;
+    }
+    uint32 entries[MAX_BLOCK / sizeof(uint32)];
+    block_read(block_num, entries);
+    for (uint32 i = 0; i < bsize / sizeof(uint32); i++) {
+        map_walk(fi, entries[i], level - 1, visit, arg);
+    }
+}
+
+static void extent_walk_node(file_info_t* fi, extent_t* ext, uint32 n)
+{
+    for (uint32 i = 0; i < n; i++) {
+        for (uint32 j = 0; j < ext[i].len; j++) {
+            data_block(fi, ext[i].pstart + j);
+        }
+    }
+}
+
+// 遍历inode的所有块, 返回映射方式; visit非NULL时对每个数据块调用 (目录用)
+static int inode_walk(inode_t* ip, file_info_t* fi, void (*visit)(file_info_t*, uint32, void*), void* arg)
+{
+    if (ip->flags & INODE_F_INLINE) {
+        return MAP_INLINE;
+    }
+    if (ip->flags & INODE_F_TAIL) {
+        uint32 b = TAIL_LOC(ip)->block;
+        if (b < sb.data_start || b >= sb.data_start + sb.data_blocks) {
+            fi->bad++;
+        } else if (!tail_seen[b - sb.data_start]) {
+            tail_seen[b - sb.data_start] = 1;
+            block_ref(b);
+            tail_blocks++;
+        }
+        return MAP_TAIL;
+    }
+    if (ip->flags & INODE_F_EXTENT) {
+        extent_header_t* hdr = (extent_header_t*)ip->addrs;
+        extent_t* ext = (extent_t*)(hdr + 1);
+        uint32 n = hdr->n > EXTENT_ROOT_MAX ? EXTENT_ROOT_MAX : hdr->n;
+        if (hdr->depth == 0) {
+            extent_walk_node(fi, ext, n);
+            return MAP_EXTENT;
+        }
+        for (uint32 i = 0; i < n; i++) {
+            uint8 buf[MAX_BLOCK];
+            meta_block(fi, ext[i].pstart);
+            if (ext[i].pstart < sb.data_start || ext[i].pstart >= sb.data_start + sb.data_blocks) {
+                continue;
+            }
+            block_read(ext[i].pstart, buf);
+            extent_header_t* leaf = (extent_header_t*)buf;
+            uint32 max = (bsize - sizeof(extent_header_t)) / sizeof(extent_t);
+            extent_walk_node(fi, (extent_t*)(leaf + 1), leaf->n > max ? max : leaf->n);
+        }
+        return MAP_EXTENT_TREE;
+    }
+    for (int i = 0; i < N_ADDRS_1; i++) {
+        map_walk(fi, ip->addrs[i], 0, visit, arg);
+    }
+    for (int i = 0; i < N_ADDRS_2; i++) {
+        map_walk(fi, ip->addrs[N_ADDRS_1 + i], 1, visit, arg);
+    }
+    for (int i = 0; i < N_ADDRS_3; i++) {
+        map_walk(fi, ip->addrs[N_ADDRS_1 + N_ADDRS_2 + i], 2, visit, arg);
+    }
+    if (ip->addrs[N_ADDRS_1 + N_ADDRS_2] != 0) {
+        return MAP_DOUBLE;
+    }
+    for (int i = 0; i < N_ADDRS_2; i++) {
+        if (ip->addrs[N_ADDRS_1 + i] != 0) {
+            return MAP_INDIRECT;
+        }
+    }
+    return MAP_DIRECT;
+}
+
+// ---------------------- 目录树 ----------------------
+
+static void dir_tree(uint16 inum, char* path);
+
+// 目录的一个数据块: 统计目录项, 第一次遇到的子项立即递归遍历 (arg是目录的路径)
+static void dir_visit_block(file_info_t* fi, uint32 block_num, void* arg)
+{
+    char* path = arg;
+    uint8 buf[MAX_BLOCK];
+    block_read(block_num, buf);
+    if (*(uint32*)(buf + 4) == DIR_INDEX_MAGIC && buf[2] == 0) {
+        return;  // 索引节点
+    }
+    dirent_t* de = (dirent_t*)buf;
+    for (uint32 i = 0; i < bsize / sizeof(dirent_t); i++) {
+        if (de[i].name[0] == 0 || de[i].inode_num >= n_inode) {
+            continue;
+        }
+        fi->dir_entries++;
+        char name[DIR_NAME_LEN + 1];
+        memmove(name, de[i].name, DIR_NAME_LEN);
+        name[DIR_NAME_LEN] = 0;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        uint16 child = de[i].inode_num;
+        if (files[child].path == NULL) {
+            files[child].path = malloc(strlen(path) + strlen(name) + 2);
+            sprintf(files[child].path, "%s%s%s", path, strcmp(path, "/") == 0 ? "" : "/", name);
+            dir_tree(child, files[child].path);
+        }
+    }
+}
+
+static int map_of[65536];
+
+// 从根目录开始给每个inode找一个路径, 同时统计目录项 (每个inode只遍历一次)
+static void dir_tree(uint16 inum, char* path)
+{
+    inode_t ino;
+    inode_read(inum, &ino);
+    file_info_t* fi = &files[inum];
+    if (ino.type != FT_DIR) {
+        map_of[inum] = inode_walk(&ino, fi, NULL, NULL);
+        return;
+    }
+    map_of[inum] = inode_walk(&ino, fi, dir_visit_block, path);
+}
+
+// ---------------------- 报告 ----------------------
+
+static void hist_print(char* title, uint64* hist, char* unit)
+{
+    uint64 total = 0;
+    for (int i = 0; i < N_HIST; i++) {
+        total += hist[i];
+    }
+    printf("%s:\n", title);
+    if (total == 0) {
+        printf("  (none)\n");
+        return;
+    }
+    for (int i = 0; i < N_HIST; i++) {
+        if (hist[i] == 0) {
+            continue;
+        }
+        uint64 lo = i == 0 ? 0 : 1ull << (i - 1);
+        uint64 hi = i == 0 ? 0 : (1ull << i) - 1;
+        printf("  %10llu - %-10llu %-7s %8llu  %6.2f%%\n", lo, hi, unit, hist[i], 100.0 * hist[i] / total);
+    }
+}
+
+static void sb_report()
+{
+    printf("superblock: block_size %u, %u blocks (%llu KB)\n", bsize, sb.total_blocks,
+           (unsigned long long)sb.total_blocks * bsize / 1024);
+    printf("  inode bitmap %u+%u, inodes %u+%u (%u inodes), data bitmap %u+%u, data %u+%u\n",
+           sb.inode_bitmap_start, sb.inode_start - sb.inode_bitmap_start, sb.inode_start, sb.inode_blocks, n_inode,
+           sb.data_bitmap_start, sb.data_start - sb.data_bitmap_start, sb.data_start, sb.data_blocks);
+    if (sb.journal_magic == JOURNAL_MAGIC) {
+        printf("  journal %u+%u\n", sb.journal_start, sb.journal_blocks);
+    }
+    if (sb.swap_magic == SWAP_MAGIC) {
+        printf("  swap %u+%u\n", sb.swap_start, sb.swap_blocks);
+    }
+    if (sb.refcnt_magic == REFCNT_MAGIC) {
+        printf("  refcount table %u+%u\n", sb.refcnt_start, sb.refcnt_blocks);
+    }
+    printf("  state %s\n", sb.state == FS_STATE_CLEAN ? "clean" : "dirty (not cleanly unmounted)");
+}
+
+// 空闲空间: 空闲数, 空闲段的长度分布, 最长的空闲段
+static void free_report()
+{
+    uint64 hist[N_HIST] = {0};
+    uint32 nfree = 0, runs = 0, longest = 0, run = 0;
+    for (uint32 i = 0; i <= sb.data_blocks; i++) {
+        if (i < sb.data_blocks && !data_used[i]) {
+            nfree++;
+            run++;
+            continue;
+        }
+        if (run > 0) {
+            hist[hist_bucket(run)]++;
+            runs++;
+            if (run > longest) longest = run;
+            run = 0;
+        }
+    }
+    uint32 ifree = 0;
+    for (uint32 i = 0; i < n_inode; i++) {
+        ifree += !inode_used[i];
+    }
+    printf("\nfree space: %u / %u data blocks (%.1f%%), %u / %u inodes\n",
+           nfree, sb.data_blocks, 100.0 * nfree / sb.data_blocks, ifree, n_inode);
+    printf("  %u free runs, longest %u blocks, average %.1f blocks\n", runs, longest, runs ? (double)nfree / runs : 0.0);
+    if (sb.state == FS_STATE_CLEAN && (sb.free_blocks != nfree || sb.free_inodes != ifree)) {
+        printf("  superblock summary disagrees: free_blocks %u free_inodes %u\n", sb.free_blocks, sb.free_inodes);
+    }
+    hist_print("free run lengths", hist, "blocks");
+}
+
+static void file_report()
+{
+    uint64 size_hist[N_HIST] = {0}, run_hist[N_HIST] = {0}, dir_hist[N_HIST] = {0};
+    uint64 map_count[N_MAP] = {0}, map_bytes[N_MAP] = {0};
+    uint64 nfile = 0, nonempty = 0, ndir = 0, ndev = 0, blocks = 0, meta = 0, runs = 0, tail = 0;
+    uint32 orphans = 0, bad = 0;
+
+    if (verbose) {
+        printf("\n%-6s %-4s %-15s %10s %7s %5s %5s  %s\n", "inum", "type", "map", "size", "blocks", "meta", "runs", "path");
+    }
+    for (uint32 inum = 0; inum < n_inode; inum++) {
+        if (!inode_used[inum]) {
+            continue;
+        }
+        inode_t ino;
+        inode_read(inum, &ino);
+        file_info_t* fi = &files[inum];
+        if (ino.type == FT_UNUSED) {
+            continue;
+        }
+        if (fi->path == NULL) {
+            // 不在目录树中 (已删除但仍被打开, 或丢失): 单独遍历以统计它的块
+            map_of[inum] = inode_walk(&ino, fi, NULL, NULL);
+            orphans++;
+        }
+        bad += fi->bad;
+        if (verbose) {
+            printf("%-6u %-4s %-15s %10u %7u %5u %5u  %s\n", inum,
+                   ino.type == FT_DIR ? "dir" : ino.type == FT_FILE ? "file" : "dev", map_name[map_of[inum]],
+                   ino.size, fi->blocks, fi->meta, fi->runs, fi->path ? fi->path : "(orphan)");
+        }
+        if (ino.type == FT_DEVICE) {
+            ndev++;
+            continue;
+        }
+        blocks += fi->blocks;
+        meta += fi->meta;
+        if (ino.type == FT_DIR) {
+            ndir++;
+            dir_hist[hist_bucket(fi->dir_entries)]++;
+            continue;
+        }
+        nfile++;
+        size_hist[hist_bucket(ino.size)]++;
+        map_count[map_of[inum]]++;
+        map_bytes[map_of[inum]] += ino.size;
+        if (fi->blocks > 0) {
+            run_hist[hist_bucket(fi->runs)]++;
+            runs += fi->runs;
+            nonempty++;
+            tail += (uint64)fi->blocks * bsize - ino.size;
+        }
+    }
+
+    printf("\nfiles: %llu regular, %llu directories, %llu devices", nfile, ndir, ndev);
+    if (orphans > 0) {
+        printf(", %u not reachable from /", orphans);
+    }
+    printf("\n  %llu data blocks, %llu index blocks (%.2f%% of data)", blocks, meta, blocks ? 100.0 * meta / blocks : 0.0);
+    printf(", %llu KB internal fragmentation in last blocks\n", tail / 1024);
+    if (tail_blocks > 0) {
+        printf("  %u tail blocks shared by %llu small files\n", tail_blocks, map_count[MAP_TAIL]);
+    }
+    printf("  average %.2f extents per non-empty file\n", nonempty ? (double)runs / nonempty : 0.0);
+    printf("mapping:\n");
+    for (int m = 0; m < N_MAP; m++) {
+        if (map_count[m] > 0) {
+            printf("  %-15s %8llu files  %10llu KB\n", map_name[m], map_count[m], map_bytes[m] / 1024);
+        }
+    }
+    hist_print("file sizes", size_hist, "bytes");
+    hist_print("extents per file (physically contiguous runs)", run_hist, "extents");
+    hist_print("directory sizes", dir_hist, "entries");
+    if (bad > 0) {
+        printf("\n%u block references outside the data area\n", bad);
+    }
+}
+
+// 位图与实际引用的一致性 (日志区和引用计数表也是数据区中的已用块)
+// 引用计数表记录的是第一个之外的引用数: reflink共享的块的引用次数应该正好是1 + 表中的计数
+static void bitmap_report()
+{
+    if (sb.journal_magic == JOURNAL_MAGIC) {
+        for (uint32 i = 0; i < sb.journal_blocks; i++) {
+            block_ref(sb.journal_start + i);
+        }
+    }
+    uint16* extra = calloc(sb.data_blocks, sizeof(uint16));
+    if (sb.refcnt_magic == REFCNT_MAGIC) {
+        uint8 buf[MAX_BLOCK];
+        uint32 per_block = bsize / sizeof(uint16);
+        for (uint32 i = 0; i < sb.refcnt_blocks; i++) {
+            block_ref(sb.refcnt_start + i);
+            block_read(sb.refcnt_start + i, buf);
+            for (uint32 j = 0; j < per_block && i * per_block + j < sb.data_blocks; j++) {
+                extra[i * per_block + j] = ((uint16*)buf)[j];
+            }
+        }
+    }
+    uint32 leaked = 0, unallocated = 0, shared = 0, reflinked = 0, mismatch = 0;
+    for (uint32 i = 0; i < sb.data_blocks; i++) {
+        if (data_used[i] && data_ref[i] == 0) leaked++;
+        if (!data_used[i] && data_ref[i] > 0) unallocated++;
+        if (data_ref[i] > 1 + extra[i]) shared++;
+        if (extra[i] > 0 && data_ref[i] > 1) reflinked++;
+        if (extra[i] > 0 && data_ref[i] < 255 && data_ref[i] != 1 + extra[i]) mismatch++;
+    }
+    printf("\nbitmap check: %u used but unreferenced, %u referenced but free, %u referenced more than once\n",
+           leaked, unallocated, shared);
+    if (sb.refcnt_magic == REFCNT_MAGIC) {
+        printf("refcount check: %u blocks shared by reflink, %u with a wrong count\n", reflinked, mismatch);
+    }
+    free(extra);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || (argc == 3 && strcmp(argv[2], "-v") != 0) || argc > 3) {
+        fprintf(stderr, "usage: %s fs.img [-v]\n", argv[0]);
+        exit(1);
+    }
+    verbose = argc == 3;
+    fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        perror(argv[1]);
+        exit(1);
+    }
+
+    // 1. 超级块
+    uint8 buf[MAX_BLOCK];
+    if (pread(fd, buf, sizeof(sb), 0) != sizeof(sb)) {
+        fprintf(stderr, "%s: too small\n", argv[1]);
+        exit(1);
+    }
+    memmove(&sb, buf, sizeof(sb));
+    bsize = sb.block_size;
+    if (sb.magic != FS_MAGIC || (bsize != 1024 && bsize != 2048 && bsize != 4096)) {
+        fprintf(stderr, "%s: not a filesystem image (magic %x, block size %u)\n", argv[1], sb.magic, bsize);
+        exit(1);
+    }
+    n_inode = sb.inode_blocks * (bsize / INODE_DISK_SIZE);
+    if (n_inode > 65536) {
+        n_inode = 65536;
+    }
+
+    // 2. 位图和目录树
+    inode_used = bitmap_load(sb.inode_bitmap_start, sb.inode_start - sb.inode_bitmap_start, n_inode);
+    data_used = bitmap_load(sb.data_bitmap_start, sb.data_start - sb.data_bitmap_start, sb.data_blocks);
+    data_ref = calloc(sb.data_blocks, 1);
+    tail_seen = calloc(sb.data_blocks, 1);
+    files = calloc(n_inode, sizeof(file_info_t));
+    files[INODE_ROOT].path = "/";
+    dir_tree(INODE_ROOT, "/");
+
+    // 3. 报告
+    sb_report();
+    free_report();
+    file_report();
+    bitmap_report();
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include "lib/bootopt.h"
+#include "lib/str.h"
+#include "dev/fdt.h"
+
+// 启动选项 (见lib/bootopt.h)
+static char bootargs[BOOTARGS_LEN];
+
+void bootopt_init(uint64 dtb)
+{
+    fdt_bootargs(dtb, bootargs, BOOTARGS_LEN);
+}
+
+char* bootopt_args(void)
+{
+    return bootargs;
+}
+
+bool bootopt(char* name)
+{
+    int n = strlen(name);
+    char* p = bootargs;
+    while (*p != 0) {
+        while (*p == ' ') {
+            p++;
+        }
+        char* w = p;
+        while (*p != 0 && *p != ' ') {
+            p++;
+        }
+        if (p - w == n && strncmp(w, name, n) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
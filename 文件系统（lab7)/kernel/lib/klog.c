@@ -0,0 +1,133 @@
+#include <stdarg.h>
+#include "lib/klog.h"
+#include "lib/print.h"
+#include "lib/lock.h"
+#include "lib/str.h"
+#include "dev/uart.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "proc/cpu.h"
+#include "proc/proc.h"
+#include "proc/kwork.h"
+#include "riscv.h"
+
+// 每个hart的日志环 (见lib/klog.h), 计数只增不减
+typedef struct klog_ring {
+    volatile uint64 pos;    // 已写入的字节数 (本hart)
+    volatile uint64 w;      // 已发布的字节数 (本hart)
+    volatile uint64 d;      // 已写出到UART的字节数 (写出者)
+    uint64 dropped;         // 环满时丢弃的字节数 (本hart)
+    char buf[KLOG_SIZE];
+} __attribute__((aligned(64))) klog_ring_t;
+
+static klog_ring_t klog_rings[NCPU];
+
+static void klog_drain_fn(void* arg);
+static kwork_t klog_work = { .fn = klog_drain_fn };
+static volatile int klog_draining;  // 写出者之间互斥 (不关中断, 写出时UART发送缓冲区可能满)
+
+// 写入本hart的环 (klog关中断后调用)
+static void klog_putc(int c, void* arg)
+{
+    klog_ring_t* r = &klog_rings[r_tp()];
+    if (r->pos - r->d >= KLOG_SIZE) {
+        r->dropped++;
+        return;
+    }
+    r->buf[r->pos % KLOG_SIZE] = c;
+    r->pos++;
+}
+
+void klog(const char* fmt, ...)
+{
+    va_list ap;
+
+    push_off();
+    klog_ring_t* r = &klog_rings[r_tp()];
+    va_start(ap, fmt);
+    print_format(klog_putc, 0, fmt, ap);
+    va_end(ap);
+    __sync_synchronize();   // 先写入字符, 再发布
+    r->w = r->pos;
+    pop_off();
+}
+
+// 把各hart已发布的日志交给putc
+static void klog_drain(void (*putc)(int))
+{
+    for (int i = 0; i < NCPU; i++) {
+        klog_ring_t* r = &klog_rings[i];
+        uint64 w = r->w;
+        __sync_synchronize();
+        for (uint64 j = r->d; j < w; j++) {
+            putc(r->buf[j % KLOG_SIZE]);
+        }
+        __sync_synchronize();   // 读完之后才允许本hart覆盖
+        r->d = w;
+    }
+}
+
+static void klog_drain_fn(void* arg)
+{
+    if (__sync_lock_test_and_set(&klog_draining, 1)) {
+        return;
+    }
+    klog_drain(uart_putc);
+    __sync_lock_release(&klog_draining);
+}
+
+void klog_kick()
+{
+    for (int i = 0; i < NCPU; i++) {
+        if (klog_rings[i].w != klog_rings[i].d) {
+            kwork_queue(&klog_work);
+            return;
+        }
+    }
+}
+
+void klog_flush_sync()
+{
+    klog_drain(uart_putc_sync);
+}
+
+uint32 klog_read(uint64 dst, uint32 len, bool user)
+{
+    char* tmp = (char*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));   // 只读取复制过的部分, 不需要清零
+    if (tmp == NULL) {
+        return 0;
+    }
+    uint32 done = 0;
+    for (int i = 0; i < NCPU && done < len; i++) {
+        klog_ring_t* r = &klog_rings[i];
+        uint64 w = r->w;
+        __sync_synchronize();
+        uint64 start = (w > KLOG_SIZE) ? w - KLOG_SIZE : 0;
+        for (uint64 j = start; j < w; j++) {
+            tmp[j - start] = r->buf[j % KLOG_SIZE];
+        }
+        __sync_synchronize();
+
+        // 复制期间写入的字符覆盖了 [start, pos + 1 - KLOG_SIZE) (pos + 1: 写入了字符还没有推进pos)
+        uint64 valid = start;
+        uint64 pos = r->pos;
+        if (pos + 1 > KLOG_SIZE && pos + 1 - KLOG_SIZE > valid) {
+            valid = pos + 1 - KLOG_SIZE;
+        }
+        if (valid >= w) {
+            continue;
+        }
+        uint32 n = w - valid;
+        if (n > len - done) {
+            n = len - done;
+        }
+        if (user) {
+            uvm_copyout(myproc()->mm->pgtbl, dst + done, (uint64)(tmp + (valid - start)), n);
+        } else {
+            memmove((void*)(dst + done), tmp + (valid - start), n);
+        }
+        done += n;
+    }
+    pmem_free((uint64)tmp, true);
+    return done;
+}
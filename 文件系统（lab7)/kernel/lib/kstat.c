@@ -0,0 +1,22 @@
+#include "lib/kstat.h"
+
+// 内核事件计数 (见lib/kstat.h)
+kstat_pcpu_t kstat_counter;
+
+void kstat_read(kstat_t* st)
+{
+    st->syscalls = PCPU_SUM(kstat_counter, syscalls);
+    st->page_faults = PCPU_SUM(kstat_counter, page_faults);
+    st->cow_faults = PCPU_SUM(kstat_counter, cow_faults);
+    st->swap_outs = PCPU_SUM(kstat_counter, swap_outs);
+    st->swap_ins = PCPU_SUM(kstat_counter, swap_ins);
+    st->ctx_switches = PCPU_SUM(kstat_counter, ctx_switches);
+    st->steals = PCPU_SUM(kstat_counter, steals);
+    st->wakeups = PCPU_SUM(kstat_counter, wakeups);
+    st->idles = PCPU_SUM(kstat_counter, idles);
+    st->dev_intrs = PCPU_SUM(kstat_counter, dev_intrs);
+    st->timer_intrs = PCPU_SUM(kstat_counter, timer_intrs);
+    st->softirqs = PCPU_SUM(kstat_counter, softirqs);
+    st->fp_loads = PCPU_SUM(kstat_counter, fp_loads);
+    st->fp_saves = PCPU_SUM(kstat_counter, fp_saves);
+}
@@ -0,0 +1,85 @@
+#include "lib/lockstat.h"
+#include "lib/str.h"
+
+#ifdef LOCK_STAT
+
+// 锁的类 (见lib/lockstat.h), 只增不减
+// 类表的锁不能是spinlock_t (初始化自旋锁时查找类), 用一个字做测试并设置
+static lock_class_t classes[N_LOCK_CLASS];
+static int nclass;
+static int class_lk;
+
+lock_class_t* lockstat_class(char* name)
+{
+    if (name == NULL) {
+        name = "(null)";
+    }
+    while (__sync_lock_test_and_set(&class_lk, 1) != 0)
+        ;
+    lock_class_t* cls = NULL;
+    for (int i = 0; i < nclass; i++) {
+        if (classes[i].name == name || strncmp(classes[i].name, name, 64) == 0) {
+            cls = &classes[i];
+            break;
+        }
+    }
+    if (cls == NULL) {
+        cls = &classes[nclass < N_LOCK_CLASS ? nclass++ : N_LOCK_CLASS - 1];
+        if (cls->name == NULL) {
+            cls->name = (nclass == N_LOCK_CLASS) ? "(other)" : name;
+        }
+    }
+    __sync_lock_release(&class_lk);
+    return cls;
+}
+
+void lockstat_acquired(lock_class_t* cls, bool contended, uint64 wait)
+{
+    __sync_fetch_and_add(&cls->acquires, 1);
+    if (contended) {
+        __sync_fetch_and_add(&cls->contended, 1);
+        __sync_fetch_and_add(&cls->wait_cycles, wait);
+    }
+}
+
+void lockstat_released(lock_class_t* cls, uint64 hold)
+{
+    uint64 old = cls->hold_max;
+    while (hold > old && !__sync_bool_compare_and_swap(&cls->hold_max, old, hold)) {
+        old = cls->hold_max;
+    }
+}
+
+// 插入排序 (类的数量很少)
+int lockstat_report(uint8* order)
+{
+    int n = nclass;
+    for (int i = 0; i < n; i++) {
+        int j = i;
+        while (j > 0 && classes[order[j - 1]].wait_cycles < classes[i].wait_cycles) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    return n;
+}
+
+void lockstat_read(int cls, lockstat_t* st, bool reset)
+{
+    lock_class_t* c = &classes[cls];
+    memset(st, 0, sizeof(*st));
+    strncpy(st->name, c->name, LOCK_NAME_LEN - 1);
+    st->acquires = c->acquires;
+    st->contended = c->contended;
+    st->wait_cycles = c->wait_cycles;
+    st->hold_max = c->hold_max;
+    if (reset) {
+        c->acquires = 0;
+        c->contended = 0;
+        c->wait_cycles = 0;
+        c->hold_max = 0;
+    }
+}
+
+#endif
@@ -1,21 +1,33 @@
 #include <stdarg.h>
 #include "lib/print.h"
 #include "lib/lock.h"
+#include "lib/klog.h"
 #include "dev/uart.h"
+#include "riscv.h"
 
 // 系统崩溃标志（volatile保证多核可见）
 volatile int panicked = 0;
+static volatile int panic_hart;   // 调用panic的hart
 
 static spinlock_t print_lk;
 static char digits[] = "0123456789abcdef";
 
+// 正常时放入UART发送缓冲区, panic之后同步输出 (中断可能已经不再到来)
+static void print_putc(int c, void* arg)
+{
+    if (panicked)
+        uart_putc_sync(c);
+    else
+        uart_putc(c);
+}
+
 void print_init(void)
 {
     spinlock_init(&print_lk, "print");
 }
 
 // 打印整数（支持不同进制和符号）
-static void printint(long long xx, int base, int sign)
+static void printint(void (*putc)(int, void*), void* arg, long long xx, int base, int sign)
 {
     char buf[20];
     int i;
@@ -35,71 +47,127 @@ static void printint(long long xx, int base, int sign)
         buf[i++] = '-';
     
     while (--i >= 0)
-        uart_putc_sync(buf[i]);
+        putc(buf[i], arg);
 }
 
 // 打印指针（16进制，带0x前缀）
-static void printptr(unsigned long long x)
+static void printptr(void (*putc)(int, void*), void* arg, unsigned long long x)
 {
-    uart_putc_sync('0');
-    uart_putc_sync('x');
+    putc('0', arg);
+    putc('x', arg);
     for (int i = 0; i < 16; i++, x <<= 4)
-        uart_putc_sync(digits[x >> 60]);
+        putc(digits[x >> 60], arg);
 }
 
-// 主要的 printf 实现
-void printf(const char *fmt, ...)
+// 按格式逐个字符输出到putc (printf、klog和ksnprintf共用)
+// 长度修饰符l: %ld %lx 读取64位整数
+void print_format(void (*putc)(int, void*), void* arg, const char *fmt, va_list ap)
 {
-    va_list ap;
-    int i, c;
+    int i, c, lng;
     char *s;
-    
-    spinlock_acquire(&print_lk);  // 获取锁，防止输出交错
+
     /*这是一个防御性编程习惯。char 在某些机器上是有符号的。
     如果不加这个，如果字符编码超过 127，可能会被当成负数处理，导致意外错误。
     这里强制把它看作 0-255 的无符号数*/
-    va_start(ap, fmt);
     for (i = 0; (c = fmt[i] & 0xff) != 0; i++) {
         if (c != '%') {
-            uart_putc_sync(c);
+            putc(c, arg);
             continue;
         }
         c = fmt[++i] & 0xff;
+        lng = (c == 'l');
+        if (lng)
+            c = fmt[++i] & 0xff;
         if (c == 0)
             break;
         switch (c) {
         case 'd':
-            printint(va_arg(ap, int), 10, 1);
+            if (lng)
+                printint(putc, arg, va_arg(ap, long long), 10, 1);
+            else
+                printint(putc, arg, va_arg(ap, int), 10, 1);
             break;
         case 'x':
-            printint(va_arg(ap, int), 16, 0);
+            if (lng)
+                printint(putc, arg, va_arg(ap, long long), 16, 0);
+            else
+                printint(putc, arg, va_arg(ap, uint32), 16, 0);
             break;
         case 'p':
-            printptr(va_arg(ap, unsigned long long));
+            printptr(putc, arg, va_arg(ap, unsigned long long));
             break;
         case 's':
             if ((s = va_arg(ap, char*)) == 0)
                 s = "(null)";
             for (; *s; s++)
-                uart_putc_sync(*s);
+                putc(*s, arg);
             break;
         case '%':
-            uart_putc_sync('%');
+            putc('%', arg);
             break;
         default:
-            uart_putc_sync('%');
-            uart_putc_sync(c);
+            putc('%', arg);
+            putc(c, arg);
             break;
         }
     }
+}
+
+// ksnprintf的输出位置
+typedef struct print_buf {
+    char* buf;
+    uint32 size;    // 缓冲区大小 (含结尾的0)
+    uint32 n;       // 已写入的字节数
+} print_buf_t;
+
+static void print_buf_putc(int c, void* arg)
+{
+    print_buf_t* pb = arg;
+    if (pb->n + 1 < pb->size)
+        pb->buf[pb->n++] = c;
+}
+
+uint32 ksnprintf(char* buf, uint32 size, const char* fmt, ...)
+{
+    va_list ap;
+    print_buf_t pb = { buf, size, 0 };
+
+    if (size == 0)
+        return 0;
+    va_start(ap, fmt);
+    print_format(print_buf_putc, &pb, fmt, ap);
+    va_end(ap);
+    buf[pb.n] = 0;
+    return pb.n;
+}
+
+// 主要的 printf 实现
+void printf(const char *fmt, ...)
+{
+    va_list ap;
+
+    // panic之后: 其他hart停在这里; 调用panic的hart不加锁 (锁可能被停下的hart持有)
+    if (panicked && panic_hart != r_tp())
+        while (1)
+            ;
+    int locking = !panicked;
+    if (locking)
+        spinlock_acquire(&print_lk);  // 获取锁，防止输出交错
+    va_start(ap, fmt);
+    print_format(print_putc, 0, fmt, ap);
     va_end(ap);
     
-    spinlock_release(&print_lk);  // 释放锁
+    if (locking)
+        spinlock_release(&print_lk);  // 释放锁
 }
 
 void panic(const char *s)
 {
+    intr_off();
+    panic_hart = r_tp();
     panicked = 1;
+    uart_flush_sync();  // 先写出缓冲区中还没有发送的输出
+    klog_flush_sync();  // 再写出各hart还没有写出的日志
     printf("panic: %s\n", s);
     while (1)
         ;
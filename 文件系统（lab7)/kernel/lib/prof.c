@@ -0,0 +1,91 @@
+#include "lib/prof.h"
+#include "lib/lock.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "proc/cpu.h"
+#include "proc/proc.h"
+#include "riscv.h"
+
+// 每个hart的采样环 (见lib/prof.h)
+typedef struct prof_ring {
+    volatile uint64 w;      // 已写入的记录数 (本hart)
+    volatile uint64 r;      // 已取出的记录数 (prof_lk)
+    uint32 count;           // 上一次采样之后经过的tick数 (本hart)
+    uint64 dropped;         // 环满时丢弃的采样数 (prof_lk下取出后清零)
+    prof_sample_t s[PROF_N];
+} __attribute__((aligned(64))) prof_ring_t;
+
+volatile uint32 prof_every;
+static prof_ring_t prof_rings[NCPU];
+static spinlock_t prof_lk;
+
+void prof_init()
+{
+    spinlock_init(&prof_lk, "prof");
+    prof_every = 0;
+}
+
+void prof_tick(uint64 pc, bool user)
+{
+    int id = r_tp();
+    prof_ring_t* r = &prof_rings[id];
+    if (++r->count < prof_every) {
+        return;
+    }
+    r->count = 0;
+    if (r->w - r->r >= PROF_N) {
+        __sync_fetch_and_add(&r->dropped, 1);
+        return;
+    }
+    prof_sample_t* s = &r->s[r->w % PROF_N];
+    proc_t* p = myproc();
+    s->pc = pc;
+    s->pid = (p != NULL) ? p->pid : 0;
+    s->hart = id;
+    s->user = user;
+    __sync_synchronize();   // 先写入记录, 再推进w
+    r->w++;
+}
+
+void prof_start(uint32 every)
+{
+    prof_every = (every == 0) ? 1 : every;
+}
+
+void prof_stop()
+{
+    prof_every = 0;
+}
+
+uint32 prof_read(uint64 dst, uint32 n, uint64* dropped)
+{
+    if (n > PROF_READ_MAX) {
+        n = PROF_READ_MAX;
+    }
+    prof_sample_t* tmp = (prof_sample_t*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));  // 只读取复制过的部分, 不需要清零
+    if (tmp == NULL) {
+        return 0;
+    }
+    uint32 done = 0;
+    *dropped = 0;
+
+    spinlock_acquire(&prof_lk);
+    for (int i = 0; i < NCPU; i++) {
+        prof_ring_t* r = &prof_rings[i];
+        uint64 w = r->w;
+        __sync_synchronize();
+        while (done < n && r->r < w) {
+            tmp[done++] = r->s[r->r % PROF_N];
+            __sync_synchronize();   // 复制完之后才允许本hart覆盖
+            r->r++;
+        }
+        *dropped += __sync_lock_test_and_set(&r->dropped, 0);
+    }
+    spinlock_release(&prof_lk);
+
+    if (done > 0) {
+        uvm_copyout(myproc()->mm->pgtbl, dst, (uint64)tmp, done * sizeof(prof_sample_t));
+    }
+    pmem_free((uint64)tmp, true);
+    return done;
+}
@@ -1,5 +1,6 @@
 #include "lib/lock.h"
 #include "lib/print.h"
+#include "lib/lockstat.h"
 #include "proc/proc.h"
 #include "proc/cpu.h"
 #include "riscv.h"
@@ -53,6 +54,19 @@ void spinlock_init(spinlock_t *lk, char *name)
     lk->name = name;
     lk->locked = 0;
     lk->cpuid = -1;
+    lk->ticket = false;
+    lk->next = 0;
+    lk->serving = 0;
+#ifdef LOCK_STAT
+    lk->cls = lockstat_class(name);
+#endif
+}
+
+// 初始化排队自旋锁: 按到达的顺序获得锁
+void spinlock_init_ticket(spinlock_t *lk, char *name)
+{
+    spinlock_init(lk, name);
+    lk->ticket = true;
 }
 
 // 获取自旋锁
@@ -63,68 +77,422 @@ void spinlock_acquire(spinlock_t *lk)
     if (spinlock_holding(lk)) {
         panic("spinlock_acquire");
     }
-    
-    // 原子操作：test-and-set
-    // 循环直到成功将 locked 从 0 设为 1
-    while (__sync_lock_test_and_set(&lk->locked, 1) != 0)
-        ;
-    
-    __sync_synchronize();  // 内存屏障
+
+#ifdef LOCK_STAT
+    bool contended = false;
+    uint64 wait_start = 0;
+#endif
+    if (lk->ticket) {
+        // 排队锁：取号, 等到轮到自己 (只有持有者修改serving)
+        uint32 my = __sync_fetch_and_add(&lk->next, 1);
+#ifdef LOCK_STAT
+        if (lk->serving != my) {
+            contended = true;
+            wait_start = r_cycle();
+        }
+#endif
+        while (lk->serving != my)
+            ;
+        __sync_synchronize();  // 内存屏障
+        lk->locked = 1;
+    } else {
+        // 原子操作：test-and-set
+        // 循环直到成功将 locked 从 0 设为 1; 被持有时只读锁字, 不反复写同一缓存行
+        while (__sync_lock_test_and_set(&lk->locked, 1) != 0) {
+#ifdef LOCK_STAT
+            if (!contended) {
+                contended = true;
+                wait_start = r_cycle();
+            }
+#endif
+            while (*(volatile int*)&lk->locked)
+                ;
+        }
+        __sync_synchronize();  // 内存屏障
+    }
     lk->cpuid = mycpuid();
+#ifdef LOCK_STAT
+    lk->hold_start = r_cycle();
+    if (lk->cls != NULL) {
+        lockstat_acquired(lk->cls, contended, contended ? lk->hold_start - wait_start : 0);
+    }
+#endif
 } 
 
+// 尝试获取自旋锁: 被持有 (排队锁: 有人持有或在排队) 时立即返回false
+// 已经持有另一个同类的锁、不能按固定顺序获取时使用 (见proc_sched的直接切换)
+bool spinlock_try_acquire(spinlock_t *lk)
+{
+    push_off();
+
+    if (spinlock_holding(lk)) {
+        panic("spinlock_try_acquire");
+    }
+
+    bool ok;
+    if (lk->ticket) {
+        // 只有没有人排队 (next == serving) 时取号, 取到的号立即轮到自己
+        uint32 s = lk->serving;
+        ok = (lk->next == s) && __sync_bool_compare_and_swap(&lk->next, s, s + 1);
+        if (ok) {
+            __sync_synchronize();
+            lk->locked = 1;
+        }
+    } else {
+        ok = (lk->locked == 0) && __sync_lock_test_and_set(&lk->locked, 1) == 0;
+        __sync_synchronize();
+    }
+    if (!ok) {
+        pop_off();
+        return false;
+    }
+    lk->cpuid = mycpuid();
+#ifdef LOCK_STAT
+    lk->hold_start = r_cycle();
+    if (lk->cls != NULL) {
+        lockstat_acquired(lk->cls, false, 0);
+    }
+#endif
+    return true;
+}
+
 // 释放自旋锁
 void spinlock_release(spinlock_t *lk)
 {
     if (!spinlock_holding(lk)) {
         panic("spinlock_release");
     }
+#ifdef LOCK_STAT
+    if (lk->cls != NULL) {
+        lockstat_released(lk->cls, r_cycle() - lk->hold_start);
+    }
+#endif
     
     lk->cpuid = -1;
-    __sync_synchronize();  // 内存屏障
-    __sync_lock_release(&lk->locked);  // 原子释放
+    if (lk->ticket) {
+        // 交给下一个号
+        lk->locked = 0;
+        __sync_synchronize();  // 内存屏障
+        lk->serving = lk->serving + 1;
+    } else {
+        __sync_synchronize();  // 内存屏障
+        __sync_lock_release(&lk->locked);  // 原子释放
+    }
     
     pop_off();  // 恢复中断
 }
 
 
+// 初始化读写自旋锁
+void rwspinlock_init(rwspinlock_t* lk, char* name)
+{
+    lk->state = 0;
+    lk->wwait = 0;
+    lk->name = name;
+    lk->cpuid = -1;
+#ifdef LOCK_STAT
+    lk->cls = lockstat_class(name);
+#endif
+}
+
+// 检查当前hart是否持有写锁
+bool rwspinlock_holding_write(rwspinlock_t* lk)
+{
+    return (lk->state & RW_WRITER) && lk->cpuid == mycpuid();
+}
+
+// 获取读锁: 没有写者持有也没有写者等待时读者数+1
+void rwspinlock_acquire_read(rwspinlock_t* lk)
+{
+    push_off();
+    if (rwspinlock_holding_write(lk)) {
+        panic("rwspinlock_acquire_read");
+    }
+#ifdef LOCK_STAT
+    bool contended = false;
+    uint64 wait_start = r_cycle();
+#endif
+    for (;;) {
+        uint32 s = lk->state;
+        if (!(s & RW_WRITER) && lk->wwait == 0 && __sync_bool_compare_and_swap(&lk->state, s, s + 1)) {
+            break;
+        }
+#ifdef LOCK_STAT
+        contended = true;
+#endif
+    }
+    __sync_synchronize();  // 内存屏障
+#ifdef LOCK_STAT
+    if (lk->cls != NULL) {
+        lockstat_acquired(lk->cls, contended, r_cycle() - wait_start);
+    }
+#endif
+}
+
+// 释放读锁
+void rwspinlock_release_read(rwspinlock_t* lk)
+{
+    if ((lk->state & ~RW_WRITER) == 0) {
+        panic("rwspinlock_release_read");
+    }
+    __sync_synchronize();  // 内存屏障
+    __sync_fetch_and_sub(&lk->state, 1);
+    pop_off();
+}
+
+// 获取写锁: 先登记为等待者 (挡住新的读者), 等已有的读者和写者离开
+void rwspinlock_acquire_write(rwspinlock_t* lk)
+{
+    push_off();
+    if (rwspinlock_holding_write(lk)) {
+        panic("rwspinlock_acquire_write");
+    }
+#ifdef LOCK_STAT
+    bool contended = false;
+    uint64 wait_start = r_cycle();
+#endif
+    __sync_fetch_and_add(&lk->wwait, 1);
+    while (!__sync_bool_compare_and_swap(&lk->state, 0, RW_WRITER)) {
+#ifdef LOCK_STAT
+        contended = true;
+#endif
+        while (lk->state != 0)
+            ;
+    }
+    __sync_fetch_and_sub(&lk->wwait, 1);
+    __sync_synchronize();  // 内存屏障
+    lk->cpuid = mycpuid();
+#ifdef LOCK_STAT
+    lk->hold_start = r_cycle();
+    if (lk->cls != NULL) {
+        lockstat_acquired(lk->cls, contended, lk->hold_start - wait_start);
+    }
+#endif
+}
+
+// 释放写锁
+void rwspinlock_release_write(rwspinlock_t* lk)
+{
+    if (!rwspinlock_holding_write(lk)) {
+        panic("rwspinlock_release_write");
+    }
+#ifdef LOCK_STAT
+    if (lk->cls != NULL) {
+        lockstat_released(lk->cls, r_cycle() - lk->hold_start);
+    }
+#endif
+    lk->cpuid = -1;
+    __sync_synchronize();  // 内存屏障
+    __sync_lock_release(&lk->state);
+    pop_off();
+}
+
 // 初始化睡眠锁
 void sleeplock_init(sleeplock_t* lk, char* name)
 {
     spinlock_init(&lk->lk, "sleeplock");
     lk->name = name;
     lk->locked = 0;
+    lk->readers = 0;
+    lk->wwait = 0;
     lk->pid = 0;
+    lk->owner = NULL;
+    lk->qhead = NULL;
+    lk->qtail = NULL;
+    lk->pi_boosted = false;
+#ifdef LOCK_STAT
+    lk->cls = lockstat_class(name);
+#endif
 }
 
-// 获取睡眠锁
-void sleeplock_acquire(sleeplock_t* lk)
+// 进入等待队列的队尾, 睡眠直到被释放者摘下 (调用者持有lk->lk, 返回时仍持有)
+static void sleeplock_wait(sleeplock_t* lk, bool shared)
+{
+    proc_t* p = myproc();
+    p->slq_next = NULL;
+    p->slq_shared = shared;
+    p->slq_waiting = true;
+    if (lk->qtail != NULL) {
+        lk->qtail->slq_next = p;
+    } else {
+        lk->qhead = p;
+    }
+    lk->qtail = p;
+    while (p->slq_waiting) {
+        proc_sleep(&p->slq_waiting, &lk->lk);
+    }
+}
+
+// 锁变为可用: 唤醒队头的排他等待者, 或者队头连续的共享等待者 (调用者持有lk->lk)
+// 每个等待者睡眠在自己的slq_waiting上, 只唤醒被摘下的进程
+static void sleeplock_wake(sleeplock_t* lk)
 {
+    proc_t* p = lk->qhead;
+    if (p == NULL) {
+        return;
+    }
+    bool shared = p->slq_shared;
+    do {
+        lk->qhead = p->slq_next;
+        if (lk->qhead == NULL) {
+            lk->qtail = NULL;
+        }
+        p->slq_next = NULL;
+        p->slq_waiting = false;
+        proc_wakeup(&p->slq_waiting);
+        p = lk->qhead;
+    } while (shared && p != NULL && p->slq_shared);
+}
+
+// 自适应自旋: 排他持有者正在另一个hart上运行时, 它很可能很快释放, 自旋等待比睡眠再被唤醒便宜
+// 调用者持有lk->lk; 自旋期间释放它, 返回时重新持有; 返回false说明不值得自旋 (应该睡眠)
+static bool sleeplock_spin(sleeplock_t* lk)
+{
+    proc_t* owner = lk->owner;
+    if (owner == NULL || owner == myproc() || owner->state != RUNNING) {
+        return false;
+    }
+    spinlock_release(&lk->lk);
+    for (int i = 0; i < SLEEPLOCK_SPIN && lk->locked && lk->owner == owner && owner->state == RUNNING; i++)
+        ;
     spinlock_acquire(&lk->lk);
-    while(lk->locked) {
-        proc_sleep(lk, &lk->lk);
+    return true;
+}
+
+// 优先级继承: 当前进程要等待排他持有者时, 持有者的优先级低于自己就提升它 (调用者持有lk->lk)
+static void sleeplock_pi(sleeplock_t* lk)
+{
+    proc_t* owner = lk->owner;
+    int prio = SCHED_IS_DL(myproc()) ? 0 : myproc()->prio;  // 期限进程按最高优先级提升
+    if (owner != NULL && owner != myproc() && proc_pi_boost(owner, prio, !lk->pi_boosted)) {
+        lk->pi_boosted = true;
     }
+}
+
+// 排他持有锁 (调用者持有lk->lk)
+static void sleeplock_take(sleeplock_t* lk)
+{
     lk->locked = 1;
     lk->pid = myproc()->pid;
+    lk->owner = myproc();
+}
+
+// 获取睡眠锁: 持有者在运行时先自旋一轮, 之后进入等待队列睡眠
+void sleeplock_acquire(sleeplock_t* lk)
+{
+    spinlock_acquire(&lk->lk);
+#ifdef LOCK_STAT
+    bool contended = lk->locked || lk->readers > 0;
+    uint64 wait_start = r_cycle();
+#endif
+    bool spun = false;
+    while(lk->locked || lk->readers > 0) {
+        if (!spun && sleeplock_spin(lk)) {
+            spun = true;
+            continue;
+        }
+        sleeplock_pi(lk);
+        lk->wwait++;
+        sleeplock_wait(lk, false);
+        lk->wwait--;
+    }
+    sleeplock_take(lk);
+#ifdef LOCK_STAT
+    lk->hold_start = r_cycle();
+    if (lk->cls != NULL) {
+        lockstat_acquired(lk->cls, contended, lk->hold_start - wait_start);
+    }
+#endif
+    spinlock_release(&lk->lk);
+}
+
+// 尝试获取睡眠锁, 已被持有时不睡眠直接返回false
+bool sleeplock_try_acquire(sleeplock_t* lk)
+{
+    bool ok = false;
+    spinlock_acquire(&lk->lk);
+    if (!lk->locked && lk->readers == 0) {
+        sleeplock_take(lk);
+        ok = true;
+#ifdef LOCK_STAT
+        lk->hold_start = r_cycle();
+        if (lk->cls != NULL) {
+            lockstat_acquired(lk->cls, false, 0);
+        }
+#endif
+    }
     spinlock_release(&lk->lk);
+    return ok;
 }
 
 // 释放睡眠锁
 void sleeplock_release(sleeplock_t* lk)
 {
     spinlock_acquire(&lk->lk);
-    lk->locked = 0;
+#ifdef LOCK_STAT
+    if (lk->cls != NULL) {
+        lockstat_released(lk->cls, r_cycle() - lk->hold_start);
+    }
+#endif
+    lk->owner = NULL;
     lk->pid = 0;
-    proc_wakeup(lk);
+    lk->locked = 0;
+    bool boosted = lk->pi_boosted;
+    lk->pi_boosted = false;
+    sleeplock_wake(lk);
     spinlock_release(&lk->lk);
+
+    // 被等待者提升过: 回到原来的优先级, 之后本hart上有更高优先级的进程时让出
+    if (boosted) {
+        proc_pi_restore();
+        proc_cond_resched();
+    }
 }
 
-// 检查当前进程是否持有睡眠锁
+// 检查当前进程是否持有睡眠锁 (不加锁: 只有当前进程自己能把owner设为自己或者从自己改掉)
 bool sleeplock_holding(sleeplock_t* lk)
 {
-    int r;
+    return lk->locked && lk->owner == myproc();
+}
+
+// 共享持有睡眠锁: 没有排他持有者且没有等待排他持有的进程时进入
+// 从等待队列中被唤醒的共享等待者只要求没有排他持有者 (排在它后面的排他等待者不能挡住它)
+void sleeplock_acquire_shared(sleeplock_t* lk)
+{
     spinlock_acquire(&lk->lk);
-    r = lk->locked && (lk->pid == myproc()->pid);
+#ifdef LOCK_STAT
+    bool contended = lk->locked || lk->wwait > 0;
+    uint64 wait_start = r_cycle();
+#endif
+    bool woken = false;
+    while(lk->locked || (!woken && lk->wwait > 0)) {
+        sleeplock_pi(lk);
+        sleeplock_wait(lk, true);
+        woken = true;
+    }
+    lk->readers++;
+#ifdef LOCK_STAT
+    if (lk->cls != NULL) {
+        lockstat_acquired(lk->cls, contended, r_cycle() - wait_start);
+    }
+#endif
     spinlock_release(&lk->lk);
-    return r;
-}
\ No newline at end of file
+}
+
+// 释放共享持有, 最后一个共享持有者离开时唤醒等待者
+void sleeplock_release_shared(sleeplock_t* lk)
+{
+    spinlock_acquire(&lk->lk);
+    assert(lk->readers > 0, "sleeplock_release_shared: not held shared");
+    lk->readers--;
+    if (lk->readers == 0) {
+        sleeplock_wake(lk);
+    }
+    spinlock_release(&lk->lk);
+}
+
+// 检查睡眠锁是否被当前进程排他持有, 或者处于共享持有状态（不记录共享持有者是谁, 不加锁）
+bool sleeplock_holding_any(sleeplock_t* lk)
+{
+    return lk->readers > 0 || sleeplock_holding(lk);
+}
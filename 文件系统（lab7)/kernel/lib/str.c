@@ -1,14 +1,59 @@
 #include "common.h"
 #include "lib/str.h"
 
+/*
+    memset / memmove / memcmp: 按8字节的字处理, 每次循环8个字 (64字节)
+        dst和src对8取模相同时先逐字节对齐, 之后按字; 不同时逐字节 (不做非对齐的字访问)
+    make RVV=1 并且hart支持V扩展 (start中读misa) 时, 不小于STR_VECTOR_MIN字节的memset和不需要倒序的memmove
+        使用RISC-V向量指令 (str_rvv.S), 向量状态只在这些函数中打开并关中断: 不需要保存和恢复向量寄存器
+*/
+
+bool str_vector = false;
+
+void
+str_vector_probe(uint64 misa)
+{
+#ifdef RVV
+  str_vector = (misa >> ('V' - 'A')) & 1;
+#endif
+}
+
+#define WORD_REP(c) ((uint64)(uint8)(c) * 0x0101010101010101ull)
+#define ALIGNED8(p) (((uint64)(p) & 7) == 0)
+
 void*
 memset(void *dst, int c, uint32 n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uint8 *d = (uint8 *) dst;
+
+#ifdef RVV
+  if(str_vector && n >= STR_VECTOR_MIN){
+    str_rvv_memset(dst, c, n);
+    return dst;
+  }
+#endif
+
+  while(n > 0 && !ALIGNED8(d)){
+    *d++ = c;
+    n--;
+  }
+
+  uint64 w = WORD_REP(c);
+  uint64 *wd = (uint64 *) d;
+  while(n >= 64){
+    wd[0] = w; wd[1] = w; wd[2] = w; wd[3] = w;
+    wd[4] = w; wd[5] = w; wd[6] = w; wd[7] = w;
+    wd += 8;
+    n -= 64;
   }
+  while(n >= 8){
+    *wd++ = w;
+    n -= 8;
+  }
+
+  d = (uint8 *) wd;
+  while(n-- > 0)
+    *d++ = c;
   return dst;
 }
 
@@ -19,6 +64,19 @@ memcmp(const void *v1, const void *v2, uint32 n)
 
   s1 = v1;
   s2 = v2;
+
+  // 按字比较到第一个不同的字, 再逐字节找出不同的位置
+  if(((uint64)s1 & 7) == ((uint64)s2 & 7)){
+    while(n > 0 && !ALIGNED8(s1)){
+      if(*s1 != *s2)
+        return *s1 - *s2;
+      s1++, s2++, n--;
+    }
+    while(n >= 8 && *(const uint64 *)s1 == *(const uint64 *)s2){
+      s1 += 8, s2 += 8, n -= 8;
+    }
+  }
+
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -28,11 +86,71 @@ memcmp(const void *v1, const void *v2, uint32 n)
   return 0;
 }
 
+// 从前往后复制 (d在s之前或不重叠)
+static void
+copy_forward(uint8 *d, const uint8 *s, uint32 n)
+{
+  if(((uint64)d & 7) == ((uint64)s & 7)){
+    while(n > 0 && !ALIGNED8(d)){
+      *d++ = *s++;
+      n--;
+    }
+    uint64 *wd = (uint64 *) d;
+    const uint64 *ws = (const uint64 *) s;
+    while(n >= 64){
+      uint64 a0 = ws[0], a1 = ws[1], a2 = ws[2], a3 = ws[3];
+      uint64 a4 = ws[4], a5 = ws[5], a6 = ws[6], a7 = ws[7];
+      wd[0] = a0; wd[1] = a1; wd[2] = a2; wd[3] = a3;
+      wd[4] = a4; wd[5] = a5; wd[6] = a6; wd[7] = a7;
+      wd += 8, ws += 8;
+      n -= 64;
+    }
+    while(n >= 8){
+      *wd++ = *ws++;
+      n -= 8;
+    }
+    d = (uint8 *) wd;
+    s = (const uint8 *) ws;
+  }
+  while(n-- > 0)
+    *d++ = *s++;
+}
+
+// 从后往前复制 (s在d之前且重叠), d和s指向末尾
+static void
+copy_backward(uint8 *d, const uint8 *s, uint32 n)
+{
+  if(((uint64)d & 7) == ((uint64)s & 7)){
+    while(n > 0 && !ALIGNED8(d)){
+      *--d = *--s;
+      n--;
+    }
+    uint64 *wd = (uint64 *) d;
+    const uint64 *ws = (const uint64 *) s;
+    while(n >= 64){
+      uint64 a0 = ws[-1], a1 = ws[-2], a2 = ws[-3], a3 = ws[-4];
+      uint64 a4 = ws[-5], a5 = ws[-6], a6 = ws[-7], a7 = ws[-8];
+      wd[-1] = a0; wd[-2] = a1; wd[-3] = a2; wd[-4] = a3;
+      wd[-5] = a4; wd[-6] = a5; wd[-7] = a6; wd[-8] = a7;
+      wd -= 8, ws -= 8;
+      n -= 64;
+    }
+    while(n >= 8){
+      *--wd = *--ws;
+      n -= 8;
+    }
+    d = (uint8 *) wd;
+    s = (const uint8 *) ws;
+  }
+  while(n-- > 0)
+    *--d = *--s;
+}
+
 void*
 memmove(void *dst, const void *src, uint32 n)
 {
-  const char *s;
-  char *d;
+  const uint8 *s;
+  uint8 *d;
 
   if(n == 0)
     return dst;
@@ -41,14 +159,17 @@ memmove(void *dst, const void *src, uint32 n)
   s = src;
   d = dst;
   if(s < d && s + n > d){
-    s += n;
-    d += n;
-    while(n-- > 0)
-      *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
+    copy_backward(d + n, s + n, n);
+    return dst;
+  }
 
+#ifdef RVV
+  if(str_vector && n >= STR_VECTOR_MIN){
+    str_rvv_memcpy(dst, src, n);
+    return dst;
+  }
+#endif
+  copy_forward(d, s, n);
   return dst;
 }
 
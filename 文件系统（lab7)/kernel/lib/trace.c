@@ -0,0 +1,104 @@
+#include "lib/trace.h"
+#include "lib/lock.h"
+#include "lib/print.h"
+#include "lib/str.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "proc/cpu.h"
+#include "proc/proc.h"
+#include "riscv.h"
+
+// 每个hart的追踪记录环 (见lib/trace.h)
+typedef struct trace_ring {
+    volatile uint64 pos;      // 已写入的记录数 (本hart)
+    uint64 r;                 // 读者读到的位置 (trace_lk)
+    trace_event_t ev[TRACE_N];
+} __attribute__((aligned(64))) trace_ring_t;
+
+volatile uint32 trace_mask;
+static trace_ring_t trace_rings[NCPU];
+static spinlock_t trace_lk;
+
+void trace_init()
+{
+    spinlock_init(&trace_lk, "trace");
+    trace_mask = 0;
+}
+
+void trace_record(uint16 event, uint64 arg0, uint64 arg1)
+{
+    push_off();
+    int id = r_tp();
+    trace_ring_t* r = &trace_rings[id];
+    trace_event_t* ev = &r->ev[r->pos % TRACE_N];
+    proc_t* p = myproc();
+    ev->time = r_time();
+    ev->hart = id;
+    ev->event = event;
+    ev->pid = (p != NULL) ? p->pid : 0;
+    ev->arg0 = arg0;
+    ev->arg1 = arg1;
+    __sync_synchronize();   // 先写入记录, 再推进pos
+    r->pos++;
+    pop_off();
+}
+
+uint32 trace_set(uint32 mask)
+{
+    return __sync_lock_test_and_set(&trace_mask, mask);
+}
+
+uint32 trace_read(uint64 dst, uint32 n, uint64* lost)
+{
+    if (n > TRACE_READ_MAX) {
+        n = TRACE_READ_MAX;
+    }
+    trace_event_t* tmp = (trace_event_t*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));  // 只读取复制过的部分, 不需要清零
+    if (tmp == NULL) {
+        return 0;
+    }
+    uint32 done = 0;
+    *lost = 0;
+
+    spinlock_acquire(&trace_lk);
+    for (int i = 0; i < NCPU && done < n; i++) {
+        trace_ring_t* r = &trace_rings[i];
+        uint64 pos = r->pos;
+        __sync_synchronize();
+        if (pos - r->r > TRACE_N) {
+            *lost += pos - r->r - TRACE_N;
+            r->r = pos - TRACE_N;
+        }
+        uint64 begin = r->r;
+        uint32 k = 0;
+        while (k < n - done && begin + k < pos) {
+            tmp[done + k] = r->ev[(begin + k) % TRACE_N];
+            k++;
+        }
+        __sync_synchronize();
+
+        // 复制期间写入的记录覆盖了 [begin, pos2 + 1 - TRACE_N) (pos2 + 1: 正在写入还没有推进pos)
+        uint64 pos2 = r->pos;
+        uint64 valid = begin;
+        if (pos2 + 1 > TRACE_N && pos2 + 1 - TRACE_N > valid) {
+            valid = pos2 + 1 - TRACE_N;
+        }
+        if (valid > begin + k) {
+            valid = begin + k;
+        }
+        uint32 skip = valid - begin;
+        if (skip > 0) {
+            memmove(&tmp[done], &tmp[done + skip], (k - skip) * sizeof(trace_event_t));
+            *lost += skip;
+        }
+        r->r = begin + k;
+        done += k - skip;
+    }
+    spinlock_release(&trace_lk);
+
+    if (done > 0) {
+        uvm_copyout(myproc()->mm->pgtbl, dst, (uint64)tmp, done * sizeof(trace_event_t));
+    }
+    pmem_free((uint64)tmp, true);
+    return done;
+}
@@ -0,0 +1,47 @@
+#include "lib/tstat.h"
+#include "lib/percpu.h"
+
+#ifdef TIME_STAT
+
+typedef struct tstat_table {
+    tstat_t s[N_TSTAT];
+} tstat_table_t;
+
+static PCPU_DEFINE(tstat_table_t, tstat_counter);
+
+// 最短和最长用比较后交换: 读出hart编号之后可能被迁移, 这一份可能同时被别的hart更新
+// min为0表示还没有记录 (0个cycle的计时之后仍可能被更大的值替换, 不影响最长和平均)
+void tstat_record(int site, uint64 cycles)
+{
+    PCPU_ADD(tstat_counter, s[site].count, 1);
+    PCPU_ADD(tstat_counter, s[site].total, cycles);
+
+    tstat_t* t = &tstat_counter[pcpu_id()].v.s[site];
+    uint64 old = *(volatile uint64*)&t->max;
+    while (cycles > old && !__sync_bool_compare_and_swap(&t->max, old, cycles)) {
+        old = *(volatile uint64*)&t->max;
+    }
+    old = *(volatile uint64*)&t->min;
+    while ((old == 0 || cycles < old) && !__sync_bool_compare_and_swap(&t->min, old, cycles)) {
+        old = *(volatile uint64*)&t->min;
+    }
+}
+
+void tstat_read(int site, tstat_t* st)
+{
+    st->count = PCPU_SUM(tstat_counter, s[site].count);
+    st->total = PCPU_SUM(tstat_counter, s[site].total);
+    st->min = 0;
+    st->max = 0;
+    for (int i = 0; i < NCPU; i++) {
+        tstat_t* t = &tstat_counter[i].v.s[site];
+        if (t->max > st->max) {
+            st->max = t->max;
+        }
+        if (t->min != 0 && (st->min == 0 || t->min < st->min)) {
+            st->min = t->min;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,151 @@
+/*
+ * asid.c - 用户地址空间的ASID分配（见mem/asid.h）
+ *
+ * 按代分配：asid_next单调增长，用完时asid_generation加一并通知所有hart刷新TLB，
+ * 进程记录自己的ASID属于哪一代，返回用户态时只比较一次代号
+ */
+
+#include "mem/asid.h"
+#include "mem/vmem.h"
+#include "proc/proc.h"
+#include "proc/cpu.h"
+#include "dev/timer.h"
+#include "lib/lock.h"
+#include "lib/print.h"
+#include "lib/klog.h"
+#include "riscv.h"
+
+static spinlock_t asid_lk;                 // 保护asid_next和asid_generation的修改
+static uint32 asid_max;                    // 硬件支持的最大ASID (0: 不支持ASID)
+static uint32 asid_next = 1;               // 下一个分配的ASID (0属于内核)
+static volatile uint32 asid_generation = 1; // 当前的代号 (进程的asid_gen = 0表示还没有分配)
+static int asid_flush_pending[NCPU];       // 开始新的一代之后, hart还没有刷新整个TLB (原子变量)
+
+
+void asid_init()
+{
+    // 向satp的ASID字段写入全1, 读回的值就是硬件实现的ASID位全为1
+    uint64 satp = r_satp();
+    w_satp(satp | SATP_ASID_MASK);
+    asid_max = (uint32)((r_satp() & SATP_ASID_MASK) >> SATP_ASID_SHIFT);
+    w_satp(satp);
+    sfence_vma();
+
+    spinlock_init(&asid_lk, "asid");
+    klog("asid: %d asids available\n", asid_max);
+}
+
+
+uint64 asid_satp(proc_t* p)
+{
+    mm_t* mm = p->mm;
+    int hart = mycpuid();
+
+    // 0. 先登记为在用户态运行这个地址空间, 再检查asid_stale (修改页表的一方先记入asid_stale再读asid_active):
+    //    至少有一方看到对方, 要么这里刷新, 要么它发送处理器间中断等待本hart进入内核
+    __sync_fetch_and_or(&mm->asid_active, 1u << hart);
+    if (asid_max == 0) {
+        return MAKE_SATP(mm->pgtbl);
+    }
+
+    // 1. 开始新的一代之后本hart第一次返回用户态: 旧一代的表项全部作废
+    if (__sync_fetch_and_and(&asid_flush_pending[hart], 0)) {
+        sfence_vma();
+    }
+
+    // 2. 没有当前一代的ASID: 分配一个, ASID用完时开始新的一代
+    //    (共享地址空间的另一个线程可能刚在别的hart上分配过: 持有锁之后再检查一次)
+    if (mm->asid_gen != asid_generation) {
+        spinlock_acquire(&asid_lk);
+        if (mm->asid_gen != asid_generation) {
+            if (asid_next > asid_max) {
+                asid_generation++;
+                asid_next = 1;
+                for (int i = 0; i < NCPU; i++) {
+                    __sync_fetch_and_or(&asid_flush_pending[i], 1);
+                }
+                __sync_fetch_and_and(&asid_flush_pending[hart], 0);
+                sfence_vma();
+            }
+            mm->asid = asid_next++;
+            mm->asid_gen = asid_generation;
+            mm->asid_stale = 0;
+        }
+        spinlock_release(&asid_lk);
+    }
+    // 3. 页表在别的hart上修改过: 本hart上可能还有这个地址空间上一次在这里运行时留下的旧表项
+    else if (mm->asid_stale & (1u << hart)) {
+        __sync_fetch_and_and(&mm->asid_stale, ~(1u << hart));
+        sfence_vma_asid(mm->asid);
+    }
+
+    return MAKE_SATP_ASID(mm->pgtbl, mm->asid);
+}
+
+
+void asid_user_exit(proc_t* p)
+{
+    __sync_fetch_and_and(&p->mm->asid_active, ~(1u << mycpuid()));
+}
+
+
+// 刷新本hart上p的[va, va + npages * PGSIZE), npages = 0表示整个ASID; 其他hart记入asid_stale
+// 同一地址空间正在别的hart的用户态运行 (共享地址空间的线程): 发送处理器间中断, 等它们进入内核
+static void asid_shootdown(proc_t* p, uint64 va, uint64 npages)
+{
+    mm_t* mm = p->mm;
+
+    // 关中断: 刷新和记录其他hart时不会换到别的hart上
+    push_off();
+    int hart = mycpuid();
+
+    // 还没有返回过用户态, 或者硬件不支持ASID（trampoline每次切换时刷新）: 本hart的TLB中没有需要刷新的表项
+    if (mm->asid != 0) {
+        if (npages == 0 || npages > ASID_FLUSH_PAGES) {
+            sfence_vma_asid(mm->asid);
+        } else {
+            for (uint64 i = 0; i < npages; i++) {
+                sfence_vma_page(va + i * PGSIZE, mm->asid);
+            }
+        }
+        __sync_fetch_and_or(&mm->asid_stale, ((1u << NCPU) - 1) & ~(1u << hart));
+    }
+
+    // 对方在用户态时开着中断, 一定会进入trap_user_handler (asid_user_exit), 下一次返回用户态之前刷新
+    uint32 active = mm->asid_active & ~(1u << hart);
+    if (active != 0) {
+        for (int i = 0; i < NCPU; i++) {
+            if (active & (1u << i)) {
+                timer_send_ipi(i);
+            }
+        }
+        for (int i = 0; i < NCPU; i++) {
+            while ((active & (1u << i)) && (mm->asid_active & (1u << i))) {
+                ;
+            }
+        }
+    }
+    pop_off();
+}
+
+
+void asid_flush(proc_t* p)
+{
+    asid_shootdown(p, 0, 0);
+}
+
+
+void asid_flush_page(proc_t* p, uint64 va)
+{
+    asid_shootdown(p, PG_ROUND_DOWN(va), 1);
+}
+
+
+void asid_flush_range(proc_t* p, uint64 va, uint64 len)
+{
+    uint64 begin = PG_ROUND_DOWN(va);
+    uint64 npages = (PG_ROUND_UP(va + len) - begin) / PGSIZE;
+    if (npages > 0) {
+        asid_shootdown(p, begin, npages);
+    }
+}
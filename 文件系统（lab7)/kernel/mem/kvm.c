@@ -8,26 +8,138 @@
 #include "memlayout.h"
 #include "mem/vmem.h"
 #include "mem/pmem.h"
+#include "mem/swap.h"
 #include "lib/print.h"
 #include "lib/str.h"
+#include "lib/lock.h"
+#include "proc/cpu.h"
 
 // 内核页表
 pgtbl_t kernel_pagetable;
 
+// 内核栈区域中已经映射的栈数 (内核栈随进程描述符缓存, 不解除映射, 所以只增不减)
+static int kstack_used;
+static spinlock_t kstack_lk;
+
+// 映射过的内核栈数 (每个hart记录自己看到的值, 见kvm_kstack_sync)
+static volatile int kstack_gen;
+static int kstack_seen[NCPU];
+
 // 来自kernel.ld，把内核内存分为两半，前面是代码（只读），后面是数据（可读写），这个变量就是分界线
 extern char etext[];
 
 // 来自trampoline.S，跳板页的物理地址
 extern char trampoline[];
 
+/*
+    页表页缓存: 销毁用户页表时, 页表页在遍历中逐项清零后放回这里, 新建页表时优先取用,
+    不经过pmem的分配和清零; 空闲页经第一个字串成链表, 取出时把这个字清零
+    最多PGTBL_CACHE_MAX页, 用户区可用页低于低水位时由回收函数还给pmem
+*/
+#define PGTBL_CACHE_MAX 64
+static struct {
+    spinlock_t lk;
+    pgtbl_t head;
+    uint32 n;
+} pgtbl_cache;
+
+
+/*
+ * vm_pgtbl_alloc - 申请一页全0的页表页（优先使用页表页缓存）
+ * 
+ * @return: 页表页，内存不足返回NULL
+ */
+pgtbl_t vm_pgtbl_alloc(void)
+{
+    spinlock_acquire(&pgtbl_cache.lk);
+    pgtbl_t pgtbl = pgtbl_cache.head;
+    if (pgtbl != NULL) {
+        pgtbl_cache.head = (pgtbl_t)pgtbl[0];
+        pgtbl_cache.n--;
+    }
+    spinlock_release(&pgtbl_cache.lk);
+
+    if (pgtbl == NULL) {
+        return (pgtbl_t)pmem_alloc_flags(false, PMEM_ZERO | PMEM_TAG(MEMTAG_PGTBL));
+    }
+    pgtbl[0] = 0;
+    return pgtbl;
+}
+
+/*
+ * vm_pgtbl_free - 释放页表页（调用者保证512项都已清零）
+ * 
+ * @note: 缓存已满时还给pmem
+ */
+void vm_pgtbl_free(pgtbl_t pgtbl)
+{
+    spinlock_acquire(&pgtbl_cache.lk);
+    if (pgtbl_cache.n < PGTBL_CACHE_MAX) {
+        pgtbl[0] = (uint64)pgtbl_cache.head;
+        pgtbl_cache.head = pgtbl;
+        pgtbl_cache.n++;
+        pgtbl = NULL;
+    }
+    spinlock_release(&pgtbl_cache.lk);
+
+    if (pgtbl != NULL) {
+        pmem_free((uint64)pgtbl, false);
+    }
+}
+
+// pmem回收函数: 把缓存的页表页还给用户区（本hart持有缓存的锁时直接返回0）
+static uint32 vm_pgtbl_reclaim(uint32 target)
+{
+    if (spinlock_holding(&pgtbl_cache.lk)) {
+        return 0;
+    }
+    uint32 n = 0;
+    while (n < target) {
+        spinlock_acquire(&pgtbl_cache.lk);
+        pgtbl_t pgtbl = pgtbl_cache.head;
+        if (pgtbl != NULL) {
+            pgtbl_cache.head = (pgtbl_t)pgtbl[0];
+            pgtbl_cache.n--;
+        }
+        spinlock_release(&pgtbl_cache.lk);
+        if (pgtbl == NULL) {
+            break;
+        }
+        pgtbl[0] = 0;
+        pmem_free((uint64)pgtbl, false);
+        n++;
+    }
+    return n;
+}
+
+/*
+ * vm_split_megapage - 把大页PTE拆成一张映射同样512个4KB页的0级页表
+ * 
+ * @pte: 1级叶子PTE（带PTE_M）
+ * @return: 成功返回true，申请页表页失败返回false（PTE不变）
+ */
+static bool vm_split_megapage(pte_t *pte)
+{
+    pgtbl_t new_table = (pgtbl_t)pmem_alloc_flags(false, PMEM_TAG(MEMTAG_PGTBL));  // 512项都会被填写
+    if (new_table == NULL) {
+        return false;
+    }
+    uint64 pa = PTE_TO_PA(*pte);
+    uint64 flags = PTE_FLAGS(*pte) & ~PTE_M;
+    for (int i = 0; i < 512; i++) {
+        new_table[i] = PA_TO_PTE(pa + (uint64)i * PGSIZE) | flags;
+    }
+    *pte = PA_TO_PTE((uint64)new_table) | PTE_V;
+    return true;
+}
 
 /*
  * vm_getpte - 获取虚拟地址对应的页表项
  * 
  * @pgtbl: 顶级页表
  * @va: 虚拟地址
- * @alloc: 是否创建不存在的中间页表
- * @return: PTE指针，失败返回NULL
+ * @alloc: 是否创建不存在的中间页表（va落在大页中时先拆分大页）
+ * @return: PTE指针，失败返回NULL；alloc = false且va落在大页中时返回大页的1级PTE
  */
 pte_t* vm_getpte(pgtbl_t pgtbl, uint64 va, bool alloc)
 {
@@ -41,6 +153,16 @@ pte_t* vm_getpte(pgtbl_t pgtbl, uint64 va, bool alloc)
         uint64 index = VA_TO_VPN(va, level);
         pte_t *pte = &pgtbl[index];
 
+        // 1级叶子PTE: 大页
+        if ((*pte & PTE_V) && !PTE_CHECK(*pte)) {
+            if (!alloc) {
+                return pte;
+            }
+            if (!vm_split_megapage(pte)) {
+                return NULL;
+            }
+        }
+
         if (*pte & PTE_V) {
             // PTE有效，获取下一级页表
             pgtbl = (pgtbl_t)PTE_TO_PA(*pte);
@@ -50,11 +172,10 @@ pte_t* vm_getpte(pgtbl_t pgtbl, uint64 va, bool alloc)
                 return NULL;
             }
             // 分配新的页表页
-            pgtbl_t new_table = (pgtbl_t)pmem_alloc(false);
+            pgtbl_t new_table = vm_pgtbl_alloc();
             if (new_table == NULL) {
                 return NULL;
             }
-            memset(new_table, 0, PGSIZE);
             // 设置PTE指向新页表，准备下一轮循环
             *pte = PA_TO_PTE((uint64)new_table) | PTE_V;
             pgtbl = new_table;
@@ -66,16 +187,90 @@ pte_t* vm_getpte(pgtbl_t pgtbl, uint64 va, bool alloc)
     return &pgtbl[leaf_index];
 }
 
+/*
+ * vm_next_mapped - 查找[va, end)中第一个已经映射的页
+ * 
+ * @return: 页的虚拟地址（落在大页中时就是va所在的位置），没有则返回end
+ * @note: 没有下级页表的1GB/2MB范围整个跳过，0级页表内只扫描这一张表中的PTE
+ */
+uint64 vm_next_mapped(pgtbl_t pgtbl, uint64 va, uint64 end)
+{
+    va = PG_ROUND_DOWN(va);
+    while (va < end) {
+        // 2级PTE无效: 跳到下一个1GB
+        pte_t *pte = &pgtbl[VA_TO_VPN(va, 2)];
+        if (!(*pte & PTE_V)) {
+            va = (va + (1ul << VA_SHIFT(2))) & ~((1ul << VA_SHIFT(2)) - 1);
+            continue;
+        }
+        // 1级PTE无效: 跳到下一个2MB; 是大页: va已映射
+        pte = &((pgtbl_t)PTE_TO_PA(*pte))[VA_TO_VPN(va, 1)];
+        if (!(*pte & PTE_V)) {
+            va = (va + MEGAPAGE_SIZE) & ~(MEGAPAGE_SIZE - 1);
+            continue;
+        }
+        if (!PTE_CHECK(*pte)) {
+            return va;
+        }
+        // 在这张0级页表中逐项查找
+        pgtbl_t leaf = (pgtbl_t)PTE_TO_PA(*pte);
+        do {
+            if (leaf[VA_TO_VPN(va, 0)] & PTE_V) {
+                return va;
+            }
+            va += PGSIZE;
+        } while (va < end && va % MEGAPAGE_SIZE != 0);
+    }
+    return end;
+}
+
+/*
+ * vm_getpte_mega - 获取虚拟地址对应的1级页表项，用于建立大页映射
+ * 
+ * @return: 1级PTE指针；那里已经有一张0级页表时返回NULL（只能用4KB映射）
+ */
+static pte_t* vm_getpte_mega(pgtbl_t pgtbl, uint64 va)
+{
+    pte_t *pte = &pgtbl[VA_TO_VPN(va, 2)];
+    if (!(*pte & PTE_V)) {
+        pgtbl_t new_table = vm_pgtbl_alloc();
+        if (new_table == NULL) {
+            return NULL;
+        }
+        *pte = PA_TO_PTE((uint64)new_table) | PTE_V;
+    }
+    pte = &((pgtbl_t)PTE_TO_PA(*pte))[VA_TO_VPN(va, 1)];
+    if ((*pte & PTE_V) && PTE_CHECK(*pte)) {
+        return NULL;
+    }
+    return pte;
+}
+
 /*
  * vm_mappages - 建立虚拟地址到物理地址的映射
  * 
  * @pgtbl: 页表
  * @va: 虚拟起始地址
- * @pa: 物理起始地址
+ * @pa: 物理起始地址（[pa, pa + len)物理连续）
  * @len: 映射长度
  * @perm: 权限位
+ * @note: va和pa都按2MB对齐且剩余长度不少于2MB的部分使用大页；
+ *        其余部分每张0级页表只查找一次，表内的PTE连续填写
  */
 void vm_mappages(pgtbl_t pgtbl, uint64 va, uint64 pa, uint64 len, int perm)
+{
+    if (!vm_try_mappages(pgtbl, va, pa, len, perm)) {
+        panic("vm_mappages: failed to get PTE");
+    }
+}
+
+/*
+ * vm_try_mappages - 同vm_mappages, 但申请不到页表页时（已经回收过一次）返回false而不是panic
+ * 
+ * @return: 全部建立返回true; 返回false时范围中前面的一部分可能已经映射, 由调用者解除或随页表销毁
+ * @note: 映射不超过一张0级页表的范围（一页, 或2MB对齐的2MB）时失败就什么都没有映射
+ */
+bool vm_try_mappages(pgtbl_t pgtbl, uint64 va, uint64 pa, uint64 len, int perm)
 {
     uint64 current_va, end_va;
     pte_t *pte;
@@ -84,78 +279,184 @@ void vm_mappages(pgtbl_t pgtbl, uint64 va, uint64 pa, uint64 len, int perm)
         panic("vm_mappages: size cannot be zero");
     }
 
-    // 对齐到页边界
+    // 对齐到页边界, [current_va, end_va)
     current_va = PG_ROUND_DOWN(va);
-    end_va = PG_ROUND_DOWN(va + len - 1);
+    end_va = PG_ROUND_DOWN(va + len - 1) + PGSIZE;
+
+    while (current_va < end_va) {
+        // 大页: 一个1级叶子PTE映射2MB
+        if (current_va % MEGAPAGE_SIZE == 0 && pa % MEGAPAGE_SIZE == 0 &&
+            end_va - current_va >= MEGAPAGE_SIZE &&
+            (pte = vm_getpte_mega(pgtbl, current_va)) != NULL) {
+            *pte = PA_TO_PTE(pa) | perm | PTE_M | PTE_V;
+            current_va += MEGAPAGE_SIZE;
+            pa += MEGAPAGE_SIZE;
+            continue;
+        }
 
-    for (;;) {
         //建立映射过程，中间没有页表，那么帮我新建一个
         pte = vm_getpte(pgtbl, current_va, true);
         if (pte == NULL) {
-            panic("vm_mappages: failed to get PTE");
+            return false;
         }
 
-        if (*pte & PTE_V) {
-            // 页面已映射 - 更新权限
-            *pte = PA_TO_PTE(pa) | perm | PTE_V;
-        } else {
-            // 新映射
-            *pte = PA_TO_PTE(pa) | perm | PTE_V;
-        }
-        //不管之前有无映射，加上权限 perm,再加上有效位 PTE_V
+        // 同一张0级页表中的PTE相邻: 连续填写到2MB边界为止, 之后才重新查找
+        // 不管之前有无映射，加上权限 perm,再加上有效位 PTE_V
+        do {
+            *pte++ = PA_TO_PTE(pa) | perm | PTE_V;
+            current_va += PGSIZE;
+            pa += PGSIZE;
+        } while (current_va < end_va && current_va % MEGAPAGE_SIZE != 0);
+    }
+    return true;
+}
 
-        if (current_va == end_va) {
-            break;
+/*
+ * vm_map_sparse - 把[va, va + n * PGSIZE)中的第i页映射到pa[i]（不连续的物理页, 用于缺页时顺带映射相邻的页）
+ * 
+ * @pa: 每页的物理地址, 0表示跳过；返回时没有映射的页的pa[i]被清零
+ * @return: 映射的页数
+ * @note: 只填写完全为0的PTE（已映射的页和换出标记不变）；不申请页表页, 没有0级页表或是大页的2MB整个跳过；
+ *        每张0级页表只查找一次
+ */
+uint32 vm_map_sparse(pgtbl_t pgtbl, uint64 va, uint64* pa, uint32 n, int perm)
+{
+    uint32 done = 0;
+    uint32 i = 0;
+    while (i < n) {
+        // 到下一个2MB边界为止使用同一张0级页表
+        uint64 cur = va + (uint64)i * PGSIZE;
+        uint32 chunk = (MEGAPAGE_SIZE - cur % MEGAPAGE_SIZE) / PGSIZE;
+        if (chunk > n - i) {
+            chunk = n - i;
+        }
+        pte_t *pte = vm_getpte(pgtbl, cur, false);
+        bool usable = (pte != NULL && !(*pte & PTE_M));
+        for (uint32 j = 0; j < chunk; j++, i++) {
+            if (pa[i] == 0) {
+                continue;
+            }
+            if (!usable || pte[j] != 0) {
+                pa[i] = 0;
+                continue;
+            }
+            pte[j] = PA_TO_PTE(pa[i]) | perm | PTE_V;
+            done++;
         }
-        //处理下一页
-        current_va += PGSIZE;
-        pa += PGSIZE;
     }
+    return done;
 }
 
 /*
- * vm_unmappages - 解除虚拟地址映射
+ * vm_unmap_range - 解除[va, va + len)的映射
  * 
- * @pgtbl: 页表
- * @va: 虚拟起始地址
- * @len: 解除长度
- * @freeit: 是否释放物理页
+ * @strict: true时范围内的每一页都必须已经映射；false时跳过没有映射的页和没有页表的范围
+ * @note: 每张0级页表只查找一次；整个大页都在范围内时一次解除, 否则先拆成4KB的页
  */
-void vm_unmappages(pgtbl_t pgtbl, uint64 va, uint64 len, bool freeit)
+static void vm_unmap_range(pgtbl_t pgtbl, uint64 va, uint64 len, bool freeit, bool strict)
 {
-    uint64 current_va;
-    pte_t *pte;
-
     if ((va % PGSIZE) != 0) {
         panic("vm_unmappages: address not page aligned");
     }
 
     uint64 npages = (PG_ROUND_UP(len)) / PGSIZE;
     if (npages == 0) npages = 1;
+    uint64 end_va = va + npages * PGSIZE;
+    uint64 current_va = va;
+
+    while (current_va < end_va) {
+        // 这一轮处理到下一个2MB边界（一张0级页表的范围）
+        uint64 chunk_end = (current_va + MEGAPAGE_SIZE) & ~(MEGAPAGE_SIZE - 1);
+        if (chunk_end > end_va) {
+            chunk_end = end_va;
+        }
 
-    for (current_va = va; current_va < va + npages * PGSIZE; current_va += PGSIZE) {
-        //找到页表项，注意这里传false，因为只是删除，不需要分配新页表
-        pte = vm_getpte(pgtbl, current_va, false);
-        if (pte == NULL) {
-            panic("vm_unmappages: walk failed");
+        //找到1级页表项，只是删除，不需要分配新页表
+        pte_t *pte = &pgtbl[VA_TO_VPN(current_va, 2)];
+        if (!(*pte & PTE_V)) {
+            if (strict) {
+                panic("vm_unmappages: walk failed");
+            }
+            current_va = (current_va + (1ul << VA_SHIFT(2))) & ~((1ul << VA_SHIFT(2)) - 1);
+            continue;
         }
+        pte = &((pgtbl_t)PTE_TO_PA(*pte))[VA_TO_VPN(current_va, 1)];
         if (!(*pte & PTE_V)) {
-            panic("vm_unmappages: page not mapped");
+            if (strict) {
+                panic("vm_unmappages: walk failed");
+            }
+            current_va = chunk_end;
+            continue;
         }
-        if (PTE_FLAGS(*pte) == PTE_V) {
-            panic("vm_unmappages: not a leaf page");
+
+        // 大页: 整个大页都在范围内时一次解除
+        if (!PTE_CHECK(*pte)) {
+            if (current_va % MEGAPAGE_SIZE == 0 && chunk_end - current_va == MEGAPAGE_SIZE) {
+                if (freeit) {
+                    pmem_put_order(PTE_TO_PA(*pte), MEGAPAGE_ORDER);
+                }
+                *pte = 0;
+                current_va = chunk_end;
+                continue;
+            }
+            if (!vm_split_megapage(pte)) {
+                panic("vm_unmappages: failed to split megapage");
+            }
         }
 
-        // 如果要求释放物理内存，就把对应的物理页还给内存分配器
-        if (freeit) {
-            uint64 pa = PTE_TO_PA(*pte);
-            pmem_free(pa, false);
+        // 在这张0级页表中逐项解除
+        pgtbl_t leaf = (pgtbl_t)PTE_TO_PA(*pte);
+        for (; current_va < chunk_end; current_va += PGSIZE) {
+            pte = &leaf[VA_TO_VPN(current_va, 0)];
+            // 换出的页: 放弃对交换槽位的引用
+            if (PTE_SWAPPED(*pte)) {
+                if (freeit) {
+                    swap_free(PTE_TO_SLOT(*pte));
+                }
+                *pte = 0;
+                continue;
+            }
+            if (!(*pte & PTE_V)) {
+                if (strict) {
+                    panic("vm_unmappages: page not mapped");
+                }
+                continue;
+            }
+            if (PTE_FLAGS(*pte) == PTE_V) {
+                panic("vm_unmappages: not a leaf page");
+            }
+
+            // 如果要求释放物理内存，就放弃这个映射对物理页的引用（写时复制共享的页在最后一个引用放弃时才释放）
+            if (freeit) {
+                pmem_put(PTE_TO_PA(*pte));
+            }
+            *pte = 0;
+            // 把PTE清0，代表映射断了
         }
-        *pte = 0;
-        // 把PTE清0，代表映射断了
     }
 }
 
+/*
+ * vm_unmappages - 解除虚拟地址映射
+ * 
+ * @pgtbl: 页表
+ * @va: 虚拟起始地址
+ * @len: 解除长度（范围内的每一页都必须已经映射）
+ * @freeit: 是否释放物理页
+ */
+void vm_unmappages(pgtbl_t pgtbl, uint64 va, uint64 len, bool freeit)
+{
+    vm_unmap_range(pgtbl, va, len, freeit, true);
+}
+
+/*
+ * vm_unmap_mapped - 解除范围内已经建立的映射，没有映射的页跳过（按需分配的区域）
+ */
+void vm_unmap_mapped(pgtbl_t pgtbl, uint64 va, uint64 len, bool freeit)
+{
+    vm_unmap_range(pgtbl, va, len, freeit, false);
+}
+
 /*
  * vm_print_recursive - 递归打印页表
  */
@@ -244,17 +545,21 @@ static pgtbl_t kvm_make(void)
     pgtbl_t kpgtbl;
 
     // 分配顶级页表
-    kpgtbl = (pgtbl_t)pmem_alloc(false);
+    kpgtbl = (pgtbl_t)pmem_alloc_flags(false, PMEM_ZERO | PMEM_TAG(MEMTAG_PGTBL));
     if (kpgtbl == NULL) {
         panic("kvm_make: failed to allocate kernel page table");
     }
     memset(kpgtbl, 0, PGSIZE);
 
 
-    kvm_map(kpgtbl, VIRTIO_BASE, VIRTIO_BASE, PGSIZE, PTE_R | PTE_W);
+    // 映射所有virtio-mmio槽位 (条带卷可能用到多个磁盘)
+    kvm_map(kpgtbl, VIRTIO_BASE, VIRTIO_BASE, VIRTIO_NSLOT * VIRTIO_STRIDE, PTE_R | PTE_W);
     // 映射 UART 寄存器，物理地址和虚拟地址都是 UART_BASE，内核往 UART_BASE写数据，CPU就会操作串口硬件
     kvm_map(kpgtbl, UART_BASE, UART_BASE, PGSIZE, PTE_R | PTE_W);
 
+    // 映射关机用的sifive_test设备
+    kvm_map(kpgtbl, VIRT_TEST, VIRT_TEST, PGSIZE, PTE_R | PTE_W);
+
     // 映射 PLIC 中断控制器（4MB区域）
     kvm_map(kpgtbl, PLIC_BASE, PLIC_BASE, 0x400000, PTE_R | PTE_W);
 
@@ -265,20 +570,13 @@ static pgtbl_t kvm_make(void)
     kvm_map(kpgtbl, KERNEL_BASE, KERNEL_BASE, (uint64)etext - KERNEL_BASE, PTE_R | PTE_X);
 
     // 映射内核数据段和剩余物理内存（可读可写）
-    kvm_map(kpgtbl, (uint64)etext, (uint64)etext, PHYSTOP - (uint64)etext, PTE_R | PTE_W);
+    kvm_map(kpgtbl, (uint64)etext, (uint64)etext, phys_top - (uint64)etext, PTE_R | PTE_W);
 
     // 映射跳板页（trampoline）- 内核和用户态共享同一虚拟地址
     // trampoline 代码在用户态和内核态切换时使用
     kvm_map(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-    // 为每个CPU分配和映射内核栈
-    for (int i = 0; i < NCPU; i++) {
-        uint64 pa = (uint64)pmem_alloc(false);
-        if (pa == 0) {
-            panic("kvm_make: failed to allocate kernel stack");
-        }
-        kvm_map(kpgtbl, KSTACK(i), pa, PGSIZE, PTE_R | PTE_W);
-    }
+    // 内核栈不在这里映射: 申请进程描述符时由kvm_kstack_alloc按需映射
 
     return kpgtbl;
 }
@@ -288,9 +586,59 @@ static pgtbl_t kvm_make(void)
  */
 void kvm_init(void)
 {
+    spinlock_init(&kstack_lk, "kstack");
+    spinlock_init(&pgtbl_cache.lk, "pgtbl_cache");
+    pgtbl_cache.head = NULL;
+    pgtbl_cache.n = 0;
+    pmem_register_reclaim(false, vm_pgtbl_reclaim);
     kernel_pagetable = kvm_make();
 }
 
+/*
+ * kvm_kstack_alloc - 在内核栈区域映射一个新的内核栈
+ *
+ * @return: 栈页的虚拟地址 (下面是不映射的guard页), 区域用完或内存不足返回0
+ * @note: 所有hart共享内核页表, 修改在kstack_lk保护下进行;
+ *        别的hart在切换到使用这个栈的进程之前通过kvm_kstack_sync刷新TLB
+ */
+uint64 kvm_kstack_alloc(void)
+{
+    uint64 pa = (uint64)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_KSTACK));  // 内核栈不需要清零
+    if (pa == 0) {
+        return 0;
+    }
+    spinlock_acquire(&kstack_lk);
+    if (kstack_used == KSTACK_MAX) {
+        spinlock_release(&kstack_lk);
+        pmem_free(pa, true);
+        return 0;
+    }
+    uint64 va = KSTACK(kstack_used);
+    if (!vm_try_mappages(kernel_pagetable, va, pa, PGSIZE, PTE_R | PTE_W)) {
+        spinlock_release(&kstack_lk);
+        pmem_free(pa, true);
+        return 0;
+    }
+    kstack_used++;
+    kstack_gen++;
+    spinlock_release(&kstack_lk);
+    sfence_vma();
+    return va;
+}
+
+/*
+ * kvm_kstack_sync - 有新映射的内核栈时刷新本hart的TLB (调度器切换到进程之前调用, 已关中断)
+ */
+void kvm_kstack_sync(void)
+{
+    int id = mycpuid();
+    int gen = kstack_gen;
+    if (kstack_seen[id] != gen) {
+        kstack_seen[id] = gen;
+        sfence_vma();
+    }
+}
+
 /*
  * kvm_inithart - 在当前CPU上激活内核页表
  */
@@ -1,99 +1,527 @@
 #include "lib/print.h"
+#include "lib/klog.h"
 #include "lib/str.h"
 #include "lib/lock.h"
 #include "mem/pmem.h"
 #include "mem/vmem.h"
 #include "mem/mmap.h"
+#include "mem/slab.h"
+#include "mem/asid.h"
+#include "fs/file.h"
+#include "fs/inode.h"
+#include "fs/pcache.h"
+#include "fs/journal.h"
+#include "proc/cpu.h"
+#include "memlayout.h"
+#include "riscv.h"
 
-// 包装 mmap_region_t 用于仓库组织
-typedef struct mmap_region_node {
-    mmap_region_t mmap;
-    struct mmap_region_node* next;
-} mmap_region_node_t;
+// mmap_region_t 的slab cache（申请和释放O(1), 数量随进程的映射区域增长）
+static kmem_cache_t mmap_region_cache;
 
-#define N_MMAP 256
-
-// mmap_region_node_t 仓库(单向链表) + 指向链表头节点的指针 + 保护仓库的锁
-static mmap_region_node_t list_mmap_region_node[N_MMAP];
-static mmap_region_node_t* list_head;
-static spinlock_t list_lk;
-
-// 初始化上述三个数据结构
+// 初始化 mmap_region_t 的cache
 void mmap_init()
 {
-    // 初始化自旋锁
-    spinlock_init(&list_lk, "mmap_list");
-    
-    // list_mmap_region_node[0] 作为保留的头节点
-    list_head = &list_mmap_region_node[0];
-    list_head->next = NULL;
-    
-    // 将其余节点串成链表（头插法）
-    for (int i = 1; i < N_MMAP; i++) {
-        list_mmap_region_node[i].next = list_head->next;
-        list_head->next = &list_mmap_region_node[i];
-    }
+    kmem_cache_init(&mmap_region_cache, "mmap_region", sizeof(mmap_region_t), MEMTAG_MMAP);
 }
 
-// 从仓库申请一个 mmap_region_t
+// 申请一个 mmap_region_t
 // 若申请失败则 panic
-// 注意: list_head 保留, 不会被申请出去
 mmap_region_t* mmap_region_alloc()
 {
-    spinlock_acquire(&list_lk);
-    
-    // 检查链表是否为空（跳过保留的头节点）
-    if (list_head->next == NULL) {
-        spinlock_release(&list_lk);
+    mmap_region_t* mmap = (mmap_region_t*)kmem_cache_alloc(&mmap_region_cache);
+    if (mmap == NULL) {
         panic("mmap_region_alloc: no available mmap_region");
     }
     
-    // 取出链表的第一个节点（头节点之后的节点）
-    mmap_region_node_t* node = list_head->next;
-    list_head->next = node->next;
-    
-    spinlock_release(&list_lk);
-    
     // 初始化 mmap_region
-    node->mmap.begin = 0;
-    node->mmap.npages = 0;
-    node->mmap.next = NULL;
+    mmap->begin = 0;
+    mmap->npages = 0;
+    mmap->max_npages = 0;
+    mmap->height = 1;
+    mmap->left = NULL;
+    mmap->right = NULL;
     
-    return &node->mmap;
+    return mmap;
 }
 
-// 向仓库归还一个 mmap_region_t
+// 归还一个 mmap_region_t
 void mmap_region_free(mmap_region_t* mmap)
 {
-    if (mmap == NULL) return;
-    
-    // 通过 mmap 指针计算出包含它的 mmap_region_node_t 的地址
-    // mmap 是 mmap_region_node_t 的第一个成员，所以它们地址相同
-    mmap_region_node_t* node = (mmap_region_node_t*)mmap;
-    
-    spinlock_acquire(&list_lk);
-    
-    // 头插法归还到链表
-    node->next = list_head->next;
-    list_head->next = node;
-    
-    spinlock_release(&list_lk);
+    kmem_cache_free(&mmap_region_cache, mmap);
 }
 
-// 输出仓库里可用的 mmap_region_node_t
+// 输出 mmap_region_t cache的使用情况
 // for debug
 void mmap_show_mmaplist()
 {
-    spinlock_acquire(&list_lk);
-    
-    mmap_region_node_t* tmp = list_head;
-    int node = 1, index = 0;
-    while (tmp)
-    {
-        index = tmp - list_head;
-        printf("node %d index = %d\n", node++, index);
-        tmp = tmp->next;
+    spinlock_acquire(&mmap_region_cache.lk);
+    klog("mmap_region cache: %d slabs, %d objects per slab\n",
+           mmap_region_cache.nslab, mmap_region_cache.per_slab);
+    spinlock_release(&mmap_region_cache.lk);
+}
+
+// ---------------------- 空闲区域的AVL树 ----------------------
+
+static int mmap_tree_height(mmap_region_t* r)
+{
+    return r != NULL ? r->height : 0;
+}
+
+static uint32 mmap_tree_max(mmap_region_t* r)
+{
+    return r != NULL ? r->max_npages : 0;
+}
+
+// 根据子节点重新计算r的高度和子树最大区域
+static void mmap_tree_update(mmap_region_t* r)
+{
+    int hl = mmap_tree_height(r->left), hr = mmap_tree_height(r->right);
+    uint32 ml = mmap_tree_max(r->left), mr = mmap_tree_max(r->right);
+    r->height = (hl > hr ? hl : hr) + 1;
+    r->max_npages = r->npages;
+    if (ml > r->max_npages) r->max_npages = ml;
+    if (mr > r->max_npages) r->max_npages = mr;
+}
+
+static mmap_region_t* mmap_tree_rotate_right(mmap_region_t* r)
+{
+    mmap_region_t* l = r->left;
+    r->left = l->right;
+    l->right = r;
+    mmap_tree_update(r);
+    mmap_tree_update(l);
+    return l;
+}
+
+static mmap_region_t* mmap_tree_rotate_left(mmap_region_t* r)
+{
+    mmap_region_t* rr = r->right;
+    r->right = rr->left;
+    rr->left = r;
+    mmap_tree_update(r);
+    mmap_tree_update(rr);
+    return rr;
+}
+
+// 子树有修改后重新平衡, 返回子树新的根
+static mmap_region_t* mmap_tree_balance(mmap_region_t* r)
+{
+    mmap_tree_update(r);
+    int bf = mmap_tree_height(r->left) - mmap_tree_height(r->right);
+    if (bf > 1) {
+        if (mmap_tree_height(r->left->left) < mmap_tree_height(r->left->right)) {
+            r->left = mmap_tree_rotate_left(r->left);
+        }
+        return mmap_tree_rotate_right(r);
+    }
+    if (bf < -1) {
+        if (mmap_tree_height(r->right->right) < mmap_tree_height(r->right->left)) {
+            r->right = mmap_tree_rotate_right(r->right);
+        }
+        return mmap_tree_rotate_left(r);
+    }
+    return r;
+}
+
+// 整个mmap区域作为一个空闲区域
+mmap_region_t* mmap_tree_init()
+{
+    return mmap_tree_insert(NULL, MMAP_BEGIN, (MMAP_END - MMAP_BEGIN) / PGSIZE);
+}
+
+// 复制整棵树 (形状相同, 不需要重新平衡)
+mmap_region_t* mmap_tree_copy(mmap_region_t* root)
+{
+    if (root == NULL) {
+        return NULL;
+    }
+    mmap_region_t* r = mmap_region_alloc();
+    r->begin = root->begin;
+    r->npages = root->npages;
+    r->max_npages = root->max_npages;
+    r->height = root->height;
+    r->left = mmap_tree_copy(root->left);
+    r->right = mmap_tree_copy(root->right);
+    return r;
+}
+
+void mmap_tree_destroy(mmap_region_t* root)
+{
+    if (root == NULL) {
+        return;
+    }
+    mmap_tree_destroy(root->left);
+    mmap_tree_destroy(root->right);
+    mmap_region_free(root);
+}
+
+// 包含va的空闲区域
+mmap_region_t* mmap_tree_lookup(mmap_region_t* root, uint64 va)
+{
+    while (root != NULL) {
+        if (va < root->begin) {
+            root = root->left;
+        } else if (va >= root->begin + (uint64)root->npages * PGSIZE) {
+            root = root->right;
+        } else {
+            return root;
+        }
+    }
+    return NULL;
+}
+
+// 地址最低的能放下npages页、起点按align对齐的位置
+// max_npages < npages的子树整个跳过; align = PGSIZE时只沿一条路径向下, 是O(log n)
+uint64 mmap_tree_fit(mmap_region_t* root, uint32 npages, uint64 align)
+{
+    if (root == NULL || root->max_npages < npages) {
+        return 0;
+    }
+    uint64 start = mmap_tree_fit(root->left, npages, align);
+    if (start != 0) {
+        return start;
+    }
+    start = (root->begin + align - 1) & ~(align - 1);
+    if (start + (uint64)npages * PGSIZE <= root->begin + (uint64)root->npages * PGSIZE) {
+        return start;
+    }
+    return mmap_tree_fit(root->right, npages, align);
+}
+
+mmap_region_t* mmap_tree_insert(mmap_region_t* root, uint64 begin, uint32 npages)
+{
+    if (root == NULL) {
+        mmap_region_t* r = mmap_region_alloc();
+        r->begin = begin;
+        r->npages = npages;
+        mmap_tree_update(r);
+        return r;
+    }
+    assert(begin != root->begin, "mmap_tree_insert: region already exists");
+    if (begin < root->begin) {
+        root->left = mmap_tree_insert(root->left, begin, npages);
+    } else {
+        root->right = mmap_tree_insert(root->right, begin, npages);
+    }
+    return mmap_tree_balance(root);
+}
+
+// 摘下子树中起始地址最小的节点 (*min), 返回子树新的根
+static mmap_region_t* mmap_tree_remove_min(mmap_region_t* root, mmap_region_t** min)
+{
+    if (root->left == NULL) {
+        *min = root;
+        return root->right;
+    }
+    root->left = mmap_tree_remove_min(root->left, min);
+    return mmap_tree_balance(root);
+}
+
+mmap_region_t* mmap_tree_remove(mmap_region_t* root, uint64 begin)
+{
+    assert(root != NULL, "mmap_tree_remove: region not found");
+    if (begin < root->begin) {
+        root->left = mmap_tree_remove(root->left, begin);
+        return mmap_tree_balance(root);
+    }
+    if (begin > root->begin) {
+        root->right = mmap_tree_remove(root->right, begin);
+        return mmap_tree_balance(root);
+    }
+
+    // 找到: 最多一个子节点时由子节点代替, 否则由右子树中最小的节点代替
+    mmap_region_t* left = root->left;
+    mmap_region_t* right = root->right;
+    mmap_region_free(root);
+    if (left == NULL || right == NULL) {
+        return left != NULL ? left : right;
+    }
+    mmap_region_t* min;
+    right = mmap_tree_remove_min(right, &min);
+    min->left = left;
+    min->right = right;
+    return mmap_tree_balance(min);
+}
+
+void mmap_tree_print(mmap_region_t* root)
+{
+    if (root == NULL) {
+        return;
+    }
+    mmap_tree_print(root->left);
+    printf("  Free region: %p ~ %p (pages: %d)\n", root->begin,
+           root->begin + (uint64)root->npages * PGSIZE, root->npages);
+    mmap_tree_print(root->right);
+}
+
+// ---------------------- 文件映射 ----------------------
+
+// 当前进程中包含va的文件映射, 没有返回NULL
+static mmap_file_t* mmap_file_lookup(proc_t* p, uint64 va)
+{
+    for (int i = 0; i < N_MMAP_FILE; i++) {
+        mmap_file_t* m = &p->mm->fmap[i];
+        if (m->file != NULL && va >= m->begin && va < m->begin + (uint64)m->npages * PGSIZE) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+// va是否属于p的某个文件映射
+bool mmap_file_mapped(proc_t* p, uint64 va)
+{
+    return mmap_file_lookup(p, va) != NULL;
+}
+
+// 建立文件映射: 只记录映射关系并占用地址区域, 页面在第一次访问时映射
+// 调用者已检查 begin 页对齐、file 是可读的普通文件、PROT_WRITE 时 file 可写
+// 成功返回begin, 没有空闲的映射槽位或区域不空闲返回-1
+uint64 mmap_file_map(file_t* file, uint64 begin, uint32 npages, uint32 pgoff, int prot)
+{
+    proc_t* p = myproc();
+
+    for (int i = 0; i < N_MMAP_FILE; i++) {
+        mmap_file_t* m = &p->mm->fmap[i];
+        if (m->file != NULL) {
+            continue;
+        }
+        if (!uvm_mmap_reserve(begin, npages)) {
+            return (uint64)-1;
+        }
+        m->begin = begin;
+        m->npages = npages;
+        m->pgoff = pgoff;
+        m->writable = (prot & PROT_WRITE) != 0;
+        m->file = file_dup(file);
+        return begin;
+    }
+    return (uint64)-1;
+}
+
+// 缺页时顺带映射的窗口页数 (sys_fault_around修改, 0或1: 只映射缺页的那一页)
+static uint32 fault_around_pages = FAULT_AROUND_DEFAULT;
+
+// 设置窗口页数 (调用者检查不超过FAULT_AROUND_MAX), 返回之前的值
+uint32 fault_around_set(uint32 pages)
+{
+    uint32 old = fault_around_pages;
+    fault_around_pages = pages;
+    return old;
+}
+
+// 文件页缺页的顺带映射: va所在的页已经映射之后, 把包含它的窗口 (按窗口大小对齐) 中
+// 已在页缓存中的其他页也映射进来, 顺序访问不再每页陷入一次
+// [begin, end): 可以映射的地址范围 (begin对应文件的第pgoff页), 同时截断到文件末尾
+// major: 这次缺页读了盘, 先把窗口中其余的页批量读入 (顺序访问时下一次缺页不用再等一次磁盘)
+// 调用者至少共享持有ip睡眠锁 (截断不能同时进行), 新映射的页只读: 写访问再经过缺页处理
+// 返回映射的页数 (计入mstat.fault_around)
+uint32 mmap_fault_around(proc_t* p, inode_t* ip, uint64 va, uint64 begin, uint64 end, uint32 pgoff, int perm, bool major)
+{
+    uint32 window = fault_around_pages;
+    if (window <= 1) {
+        return 0;
+    }
+
+    // 1. 窗口与[begin, end)和文件大小的交集
+    uint64 wsize = (uint64)window * PGSIZE;
+    uint64 lo = va / wsize * wsize;
+    uint64 hi = lo + wsize;
+    if (lo < begin) {
+        lo = begin;
+    }
+    if (hi > end) {
+        hi = end;
+    }
+    uint32 first = pgoff + (lo - begin) / PGSIZE;
+    uint32 last = (ip->size + PGSIZE - 1) / PGSIZE;
+    if (first >= last) {
+        return 0;
+    }
+    uint32 n = (hi - lo) / PGSIZE;
+    if (n > last - first) {
+        n = last - first;
+    }
+    if (n <= 1) {
+        return 0;
+    }
+
+    // 2. 取出窗口中已缓存的页, 一次填写页表项
+    if (major) {
+        pcache_readahead(ip, first, n);
+    }
+    page_t* pages[FAULT_AROUND_MAX];
+    uint64 pa[FAULT_AROUND_MAX];
+    pcache_get_cached(ip->inode_num, first, n, pages);
+    for (uint32 i = 0; i < n; i++) {
+        pa[i] = (pages[i] != NULL) ? pages[i]->page : 0;
+    }
+    uint32 mapped = vm_map_sparse(p->mm->pgtbl, lo, pa, n, perm & ~PTE_W);
+
+    // 3. 没有映射的页 (包括va所在的页, 已经映射) 归还引用
+    for (uint32 i = 0; i < n; i++) {
+        if (pages[i] != NULL && pa[i] == 0) {
+            pcache_put(pages[i]);
+        }
+    }
+    p->mstat.fault_around += mapped;
+    return mapped;
+}
+
+// 文件映射区域的缺页处理
+// 1. 页面未映射: 从页缓存取出对应的页(ref++), 读访问只读映射, 写访问可写映射并标记dirty
+// 2. 页面已只读映射的写访问: 标记dirty后改为可写 (之后的写入不再触发缺页)
+// va不属于文件映射、写只读映射、访问文件末尾之后的整页时返回false
+bool mmap_file_fault(uint64 va, bool write)
+{
+    proc_t* p = myproc();
+    uint64 va_page = PG_ROUND_DOWN(va);
+    mmap_file_t* m = mmap_file_lookup(p, va_page);
+    if (m == NULL || (write && !m->writable)) {
+        return false;
     }
 
-    spinlock_release(&list_lk);
-}
\ No newline at end of file
+    // 1. 已映射: 写时标记dirty
+    pte_t* pte = vm_getpte(p->mm->pgtbl, va_page, false);
+    if (pte != NULL && (*pte & PTE_V)) {
+        if (write && !(*pte & PTE_W)) {
+            page_t* pg = pcache_find(PTE_TO_PA(*pte));
+            assert(pg != NULL, "mmap_file_fault: mapped page not in page cache");
+            pcache_mark_dirty(pg);
+            *pte |= PTE_W;
+            asid_flush_page(p, va_page);
+        }
+        return true;
+    }
+
+    // 2. 未映射: 从页缓存取出对应的页
+    inode_t* ip = m->file->ip;
+    uint32 pgoff = m->pgoff + (va_page - m->begin) / PGSIZE;
+    bool cached = pcache_resident(ip->inode_num, pgoff);
+    inode_lock_shared(ip);
+    page_t* pg = NULL;
+    if ((uint64)pgoff * PGSIZE < ip->size) {
+        pg = pcache_get(ip, pgoff, true);
+    }
+    if (pg == NULL) {
+        inode_unlock_shared(ip);
+        return false;
+    }
+
+    int perm = PTE_R | PTE_U | PTE_F;
+    if (write) {
+        pcache_mark_dirty(pg);
+    }
+    vm_mappages(p->mm->pgtbl, va_page, pg->page, PGSIZE, write ? perm | PTE_W : perm);
+    mmap_fault_around(p, ip, va_page, m->begin, m->begin + (uint64)m->npages * PGSIZE, m->pgoff, perm, !cached);
+    inode_unlock_shared(ip);
+    if (cached) {
+        p->mstat.minor_faults++;
+    } else {
+        p->mstat.major_faults++;
+    }
+    return true;
+}
+
+// 静态辅助函数: 把映射m中[first, first + n)页里可写的页表项对应的页标记为dirty并改回只读,
+// 然后把文件中对应的dirty页写回
+// unmap = true 时同时解除这些页的映射并释放对页缓存的引用
+static void mmap_file_flush(proc_t* p, mmap_file_t* m, uint32 first, uint32 n, bool unmap)
+{
+    // 1. 可写的页表项说明页可能被修改过: 标记dirty, 改为只读让之后的写入重新标记
+    for (uint32 i = first; i < first + n; i++) {
+        pte_t* pte = vm_getpte(p->mm->pgtbl, m->begin + (uint64)i * PGSIZE, false);
+        if (pte != NULL && (*pte & PTE_V) && (*pte & PTE_W)) {
+            pcache_mark_dirty(pcache_find(PTE_TO_PA(*pte)));
+            *pte &= ~PTE_W;
+        }
+    }
+    asid_flush_range(p, m->begin + (uint64)first * PGSIZE, (uint64)n * PGSIZE);
+
+    // 2. 写回文件 (页仍被引用, 不会被替换)
+    if (m->writable) {
+        journal_begin();
+        inode_lock(m->file->ip);
+        pcache_writeback(m->file->ip, m->pgoff + first, n);
+        inode_unlock(m->file->ip);
+        journal_end();
+    }
+
+    // 3. 解除映射, 释放引用
+    if (unmap) {
+        for (uint32 i = first; i < first + n; i++) {
+            pte_t* pte = vm_getpte(p->mm->pgtbl, m->begin + (uint64)i * PGSIZE, false);
+            if (pte != NULL && (*pte & PTE_V)) {
+                page_t* pg = pcache_find(PTE_TO_PA(*pte));
+                *pte = 0;
+                pcache_put(pg);
+            }
+        }
+        asid_flush_range(p, m->begin + (uint64)first * PGSIZE, (uint64)n * PGSIZE);
+    }
+}
+
+// msync: 写回[begin, begin + npages * PGSIZE)与文件映射相交部分中被修改的页
+// 成功返回0, 范围不与任何文件映射相交返回-1
+int mmap_file_sync(uint64 begin, uint32 npages)
+{
+    proc_t* p = myproc();
+    uint64 end = begin + (uint64)npages * PGSIZE;
+    int ret = -1;
+
+    for (int i = 0; i < N_MMAP_FILE; i++) {
+        mmap_file_t* m = &p->mm->fmap[i];
+        uint64 m_end = m->begin + (uint64)m->npages * PGSIZE;
+        if (m->file == NULL || end <= m->begin || begin >= m_end) {
+            continue;
+        }
+        uint64 from = begin > m->begin ? begin : m->begin;
+        uint64 to = end < m_end ? end : m_end;
+        mmap_file_flush(p, m, (from - m->begin) / PGSIZE, (to - from) / PGSIZE, false);
+        ret = 0;
+    }
+    return ret;
+}
+
+// 静态辅助函数: 写回并解除整个文件映射, 归还地址区域和文件引用
+static void mmap_file_release(proc_t* p, mmap_file_t* m)
+{
+    mmap_file_flush(p, m, 0, m->npages, true);
+    uvm_mmap_release(m->begin, m->npages);
+    file_close(m->file);
+    m->file = NULL;
+}
+
+// munmap: 解除起点为begin、长度为npages页的整个文件映射
+// 成功返回0, 不是文件映射(交给匿名映射处理)或只覆盖文件映射的一部分时返回-1
+int mmap_file_unmap(uint64 begin, uint32 npages)
+{
+    proc_t* p = myproc();
+    mmap_file_t* m = mmap_file_lookup(p, begin);
+    if (m == NULL || m->begin != begin || m->npages != npages) {
+        return -1;
+    }
+    mmap_file_release(p, m);
+    return 0;
+}
+
+// fork: 子进程继承文件映射 (地址区域已随空闲区域树一起复制, 页面在子进程缺页时映射)
+void mmap_file_fork(proc_t* p, proc_t* np)
+{
+    for (int i = 0; i < N_MMAP_FILE; i++) {
+        np->mm->fmap[i] = p->mm->fmap[i];
+        if (p->mm->fmap[i].file != NULL) {
+            np->mm->fmap[i].file = file_dup(p->mm->fmap[i].file);
+        }
+    }
+}
+
+// 进程退出: 写回并解除所有文件映射 (之后销毁页表时不会释放页缓存中的页)
+void mmap_file_exit(proc_t* p)
+{
+    for (int i = 0; i < N_MMAP_FILE; i++) {
+        if (p->mm->fmap[i].file != NULL) {
+            mmap_file_release(p, &p->mm->fmap[i]);
+        }
+    }
+}
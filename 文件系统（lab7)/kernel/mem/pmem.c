@@ -6,9 +6,13 @@
  */
 
 #include "mem/pmem.h"
+#include "dev/fdt.h"
+#include "proc/cpu.h"
 #include "lib/lock.h"
 #include "lib/print.h"
+#include "lib/klog.h"
 #include "lib/str.h"
+#include "lib/percpu.h"
 #include "riscv.h"
 #include "memlayout.h"
 
@@ -23,27 +27,151 @@ typedef struct phy_free_page {
  * 区域隔离设计的核心价值：
  * 恶意用户进程若无限申请内存且不释放，仅会耗尽自身专属区域的内存
  * 内核区域内存不受影响，能够正常完成中断处理、进程调度等核心功能，保障系统稳定
+ *
+ * 自适应边界：
+ * 区域只是一组空闲页，不再对应固定的地址范围；一个区域的两条链表都空了，就从另一个区域一次借PMEM_BORROW_BATCH页，
+ * 借出方至少保留reserve页（内核区域的reserve就是保证内核可用的PMEM_KERNEL_RESERVE）；
+ * 页释放回申请时指定的区域，借来的页由此留在借入方，直到那边的空闲页又被借走
  */
 typedef struct mem_control_zone {
-    uint64 zone_start;        // 该区域的起始物理地址
-    uint64 zone_end;          // 该区域的终止物理地址
+    uint64 zone_start;        // 该区域初始的起始物理地址（仅用于打印）
+    uint64 zone_end;          // 该区域初始的终止物理地址（仅用于打印）
+    uint32 reserve;           // 借给另一个区域时至少保留的空闲页数（初始化后不变）
     spinlock_t zone_lock;     // 保护区域并发访问的自旋锁
-    uint32 free_page_count;   // 区域内当前剩余可分配的物理页数量
-    phy_free_page_t free_list; // 空闲页链表头节点（仅作为链表入口，不对应实际物理页）
+    uint32 free_page_count;   // 区域内当前剩余可分配的物理页数量（两条链表之和）
+    phy_free_page_t free_list; // 空闲页链表头节点（仅作为链表入口，不对应实际物理页）: 内容未知
+    phy_free_page_t zero_list; // 已清零的空闲页链表头节点: 由空闲的hart在后台清零
+    uint32 zero_page_count;   // zero_list中的页数
 } mem_control_zone_t;
 
 // 全局内存区域隔离管理，分别对应内核与用户态进程
 static mem_control_zone_t kernel_mem_zone;  // 内核专属物理内存区域
 static mem_control_zone_t user_mem_zone;    // 用户态专属物理内存区域
 
+#define PMEM_BORROW_BATCH 64   // 一次从另一个区域借的页数
 
-static void mem_zone_initialize(mem_control_zone_t *zone, char *zone_name, void *start, void *end)
+/*
+ * 回收函数：区域的可用页（见mem_zone_available）低于PMEM_WMARK_LOW时，
+ * 申请者在返回前依次调用这个区域注册的回收函数，直到可用页回到PMEM_WMARK_HIGH；
+ * 申请失败时也会先回收再重试一次。同一时刻一个区域只有一个hart在回收
+ */
+static struct {
+    pmem_reclaim_t fn[PMEM_N_RECLAIM];
+    uint32 n;
+    int reclaiming;   // 正在回收 (原子变量)
+} pmem_reclaim[2];   // [0: 内核区域, 1: 用户区域]
+
+/*
+ * 每个hart的空闲页缓存（magazine）：
+ * 每个hart、每个区域各有一个小的空闲页栈，分配和释放先在本地栈上完成，只需要关中断，不需要区域锁；
+ * 本地栈空了一次从区域链表取PMEM_MAG_BATCH页，满了一次归还PMEM_MAG_BATCH页，区域锁的获取次数降为1/PMEM_MAG_BATCH；
+ * 栈顶是本hart最近释放的页，再次分配时它很可能还在本hart的cache中
+ *
+ * 预先清零的页：
+ * 每个区域另有一条已清零的链表, 调度器没有可运行的进程时提交后台清零工作(见proc/kwork.h),
+ * 工作线程调用pmem_zero_idle, 每次把PMEM_ZERO_BATCH页清零后移入;
+ * 需要清零的申请(PMEM_ZERO)使用单独的本地栈, 从已清零的链表补充, 这条链表空了才在申请时memset;
+ * 不需要清零的申请和所有释放使用内容未知的本地栈, 释放的页不再覆写（定义PMEM_POISON时填充0x01）
+ */
+#define PMEM_MAG_SIZE  32   // 每个本地栈最多缓存的页数
+#define PMEM_MAG_BATCH 16   // 与区域链表之间一次转移的页数
+#define PMEM_ZERO_BATCH 8   // pmem_zero_idle每次清零的页数
+
+typedef struct pmem_magazine {
+    uint32 count;                            // 栈中的页数
+    phy_free_page_t* pages[PMEM_MAG_SIZE];   // 空闲页 (pages[count - 1]是栈顶)
+} pmem_magazine_t;
+
+static pmem_magazine_t pmem_mags[NCPU][2];  // [hart][0: 内核区域, 1: 用户区域], 内容未知的页
+static pmem_magazine_t pmem_zero_mags[NCPU][2];  // 同上, 已清零的页
+
+/*
+ * 页帧元数据（见mem/pmem.h）：
+ * pmem_frames[i]对应物理页ALLOC_BEGIN(向上对齐) + i * PGSIZE，数组本身占用开头的几页；
+ * 引用计数和标志只在页被申请出去之后有意义：申请时由申请者写入，之后用原子操作修改，
+ * 释放时清零，空闲页的元数据始终为0
+ */
+#define FRAME_REF_MASK   0x00FFFFFF
+#define FRAME_FLAG_SHIFT 24
+
+uint64 phys_top;                  // 物理内存结束地址
+
+static uint32 *pmem_frames;       // 元数据数组
+static uint64 pmem_frames_base;   // 第一个元数据对应的物理页
+static uint64 pmem_frames_end;    // 元数据数组之后的第一页（可分配内存从这里开始）
+
+static uint64 pmem_zero_pg;       // 全局的全0页 (见pmem_zero_page)
+
+/*
+ * 内核内存用途统计（见mem/pmem.h）：
+ * pmem_tags[i]是pmem_frames[i]那一页的用途, 数组紧接在元数据数组之后; 申请时写入, 最后一个引用释放时清零
+ * 页数在每个用途自己的缓存行上原子地修改; slab对象的申请、释放次数记在本hart的计数器上
+ */
+char* memtag_name[N_MEMTAG] = {
+    [MEMTAG_NONE]      "none",
+    [MEMTAG_PGTBL]     "pgtbl",
+    [MEMTAG_KSTACK]    "kstack",
+    [MEMTAG_TRAPFRAME] "trapframe",
+    [MEMTAG_BUF]       "buf",
+    [MEMTAG_INODE]     "inode",
+    [MEMTAG_FILE]      "file",
+    [MEMTAG_PROC]      "proc",
+    [MEMTAG_MMAP]      "mmap",
+    [MEMTAG_FS]        "fs",
+    [MEMTAG_TEMP]      "temp",
+};
+
+static uint8 *pmem_tags;          // 各页的用途 (MEMTAG_*)
+
+static struct {
+    uint64 pages;       // 当前页数
+    uint64 pages_max;
+    uint64 objs_max;
+} __attribute__((aligned(PCPU_LINE))) memtag_global[N_MEMTAG];
+
+typedef struct memtag_pcpu {
+    uint64 page_allocs[N_MEMTAG];
+    uint64 obj_allocs[N_MEMTAG];
+    uint64 obj_frees[N_MEMTAG];
+} memtag_pcpu_t;
+
+static PCPU_DEFINE(memtag_pcpu_t, memtag_counter);
+
+/*
+ * 伙伴系统：
+ * 每个阶一条空闲块双向链表（链表节点放在空闲块的第一页中）；
+ * buddy_order[i]记录以第i页开头的空闲块的阶，不是空闲块的块首时为BUDDY_NOT_FREE；
+ * 申请时从不小于请求阶的最小非空链表取块，多余的一半逐级放回低阶链表；
+ * 释放时伙伴（下标异或块大小）也是同阶空闲块则合并，直到最大阶或伙伴不空闲
+ */
+#define BUDDY_NOT_FREE 0xFF
+
+typedef struct buddy_block {
+    struct buddy_block* next;
+    struct buddy_block* prev;
+} buddy_block_t;
+
+static struct {
+    uint64 start;                              // 第一页的物理地址 (按最大阶对齐)
+    spinlock_t lock;                           // 保护以下字段
+    buddy_block_t free_area[PMEM_MAX_ORDER + 1]; // 各阶空闲链表的哨兵节点
+    uint32 free_count[PMEM_MAX_ORDER + 1];     // 各阶空闲块数
+    uint8 buddy_order[PMEM_BUDDY_PAGES];
+} buddy;
+
+static void buddy_free_block(uint64 page, uint32 order);
+
+
+static void mem_zone_initialize(mem_control_zone_t *zone, char *zone_name, void *start, void *end, uint32 reserve)
 {
     // 初始化区域核心属性与空闲链表
     zone->zone_start = (uint64)start;
     zone->zone_end = (uint64)end;
+    zone->reserve = reserve;
     zone->free_page_count = 0;
     zone->free_list.next_page = NULL;  // 初始化空闲链表为空
+    zone->zero_list.next_page = NULL;  // 启动时的内存内容未知, 清零的链表也为空
+    zone->zero_page_count = 0;
     
     // 初始化区域自旋锁，保障多核并发访问安全
     spinlock_init(&zone->zone_lock, zone_name);
@@ -66,55 +194,342 @@ static void mem_zone_initialize(mem_control_zone_t *zone, char *zone_name, void
 }
 
 
+// 把空闲块插入order阶链表（调用者持有buddy.lock）
+static void buddy_push(uint32 idx, uint32 order)
+{
+    buddy_block_t *blk = (buddy_block_t*)(buddy.start + (uint64)idx * PGSIZE);
+    buddy_block_t *head = &buddy.free_area[order];
+    blk->next = head->next;
+    blk->prev = head;
+    head->next->prev = blk;
+    head->next = blk;
+    buddy.buddy_order[idx] = order;
+    buddy.free_count[order]++;
+}
+
+// 把空闲块从所在的链表中摘除（调用者持有buddy.lock）
+static void buddy_remove(uint32 idx)
+{
+    buddy_block_t *blk = (buddy_block_t*)(buddy.start + (uint64)idx * PGSIZE);
+    blk->prev->next = blk->next;
+    blk->next->prev = blk->prev;
+    buddy.free_count[buddy.buddy_order[idx]]--;
+    buddy.buddy_order[idx] = BUDDY_NOT_FREE;
+}
+
+// 初始化伙伴系统: [start, start + PMEM_BUDDY_PAGES页) 全部作为最大阶的空闲块
+static void buddy_initialize(uint64 start)
+{
+    buddy.start = start;
+    spinlock_init_ticket(&buddy.lock, "buddy_phy_mem");
+    for (int o = 0; o <= PMEM_MAX_ORDER; o++) {
+        buddy.free_area[o].next = &buddy.free_area[o];
+        buddy.free_area[o].prev = &buddy.free_area[o];
+        buddy.free_count[o] = 0;
+    }
+    memset(buddy.buddy_order, BUDDY_NOT_FREE, sizeof(buddy.buddy_order));
+    for (uint32 idx = 0; idx < PMEM_BUDDY_PAGES; idx += 1 << PMEM_MAX_ORDER) {
+        buddy_push(idx, PMEM_MAX_ORDER);
+    }
+}
+
+
 void pmem_init(void)
 {
-    // 计算内核专属内存区域的终止物理地址
-    uint64 kernel_zone_end = (uint64)ALLOC_BEGIN + KERNEL_PAGES * PGSIZE;
+    // 物理内存的结束地址: 设备树中包含内核的内存区域 (设备树本身在内存末尾, 之后被空闲页链表覆盖)
+    phys_top = PG_ROUND_DOWN(fdt_memory_end(boot_dtb, KERNEL_BASE));
+    if (phys_top <= (uint64)ALLOC_BEGIN) {
+        phys_top = (uint64)ALLOC_END;
+    }
+    if (phys_top > PHYSTOP_MAX) {
+        phys_top = PHYSTOP_MAX;
+    }
+
+    // 页帧元数据数组放在可分配内存的开头, 所有页初始都是空闲的
+    pmem_frames_base = PG_ROUND_UP((uint64)ALLOC_BEGIN);
+    uint64 nframes = (phys_top - pmem_frames_base) / PGSIZE;
+    pmem_frames = (uint32*)pmem_frames_base;
+    pmem_tags = (uint8*)(pmem_frames_base + nframes * sizeof(uint32));
+    pmem_frames_end = PG_ROUND_UP((uint64)pmem_tags + nframes);
+    memset(pmem_frames, 0, pmem_frames_end - pmem_frames_base);
+    
+    // 计算内核专属内存区域的终止物理地址 (元数据数组随内存大小增长, 内核区域排在它之后)
+    uint64 kernel_zone_end = pmem_frames_end + KERNEL_PAGES * PGSIZE;
     
-    // 安全边界检查：确保内核区域不超出系统可用物理内存范围
-    if (kernel_zone_end > (uint64)ALLOC_END) {
-        kernel_zone_end = (uint64)ALLOC_END;
+    // 伙伴系统紧接内核区域, 起始地址按最大阶对齐, 对齐留下的空隙归内核区域
+    uint64 buddy_align = (uint64)PGSIZE << PMEM_MAX_ORDER;
+    uint64 buddy_start = (kernel_zone_end + buddy_align - 1) & ~(buddy_align - 1);
+    uint64 buddy_end = buddy_start + (uint64)PMEM_BUDDY_PAGES * PGSIZE;
+    
+    // 安全边界检查：确保内核区域和伙伴系统不超出系统可用物理内存范围
+    if (buddy_end > phys_top) {
+        panic("pmem_init: not enough memory for the buddy allocator");
     }
     
-    // 初始化内核专属物理内存区域
-    mem_zone_initialize(&kernel_mem_zone, "kernel_phy_mem", ALLOC_BEGIN, (void*)kernel_zone_end);
+    // 初始化内核专属物理内存区域（KERNEL_PAGES只是初始大小, 之后边界随两边的需求移动）
+    mem_zone_initialize(&kernel_mem_zone, "kernel_phy_mem", (void*)pmem_frames_end, (void*)buddy_start, PMEM_KERNEL_RESERVE);
+    
+    // 初始化连续多页分配使用的伙伴系统
+    buddy_initialize(buddy_start);
     
-    // 初始化用户态专属物理内存区域（从内核区域结束地址到系统内存终止地址）
-    mem_zone_initialize(&user_mem_zone, "user_phy_mem", (void*)kernel_zone_end, ALLOC_END);
+    // 初始化用户态专属物理内存区域（从伙伴系统结束地址到系统内存终止地址）
+    mem_zone_initialize(&user_mem_zone, "user_phy_mem", (void*)buddy_end, (void*)phys_top, PMEM_USER_RESERVE);
     
     // 打印区域初始化日志，用于调试与验证
-    printf("pmem: kernel_zone [%p - %p], %d free pages\n", 
+    klog("pmem: physical memory [%p - %p], %d MB\n", KERNEL_BASE, phys_top, (uint32)((phys_top - KERNEL_BASE) >> 20));
+    klog("pmem: frame table [%p - %p], %d frames\n", pmem_frames_base, pmem_frames_end, (uint32)nframes);
+    klog("pmem: kernel_zone [%p - %p], %d free pages\n", 
            kernel_mem_zone.zone_start, kernel_mem_zone.zone_end, kernel_mem_zone.free_page_count);
-    printf("pmem: user_zone [%p - %p], %d free pages\n", 
+    klog("pmem: buddy [%p - %p], %d pages, max order %d\n",
+           buddy_start, buddy_end, PMEM_BUDDY_PAGES, PMEM_MAX_ORDER);
+    klog("pmem: user_zone [%p - %p], %d free pages\n", 
            user_mem_zone.zone_start, user_mem_zone.zone_end, user_mem_zone.free_page_count);
+
+    // 全0页: 这里持有的引用永远不放弃, 映射它的页表项各持有一个
+    pmem_zero_pg = (uint64)pmem_alloc(false);
+    assert(pmem_zero_pg != 0, "pmem_init: no memory for the zero page");
+    pmem_frame_set_flags(pmem_zero_pg, PMEM_F_COW);
 }
 
 
-void* pmem_alloc(bool in_kernel)
+// 物理页对应的元数据（检查地址是否在可分配内存中并按页对齐）
+static uint32* pmem_frame(uint64 page, char *who)
+{
+    if ((page % PGSIZE) != 0 || page < pmem_frames_end || page >= phys_top) {
+        printf("%s: page %p\n", who, page);
+        panic("pmem: invalid page address");
+    }
+    return &pmem_frames[(page - pmem_frames_base) / PGSIZE];
+}
+
+// 刚申请出去的页: 引用计数为1（此时只有申请者知道这一页, 不需要原子操作）
+static void pmem_frame_own(uint64 page, uint32 flags)
+{
+    *pmem_frame(page, "pmem_alloc") = 1 | (flags << FRAME_FLAG_SHIFT);
+}
+
+// max增大到至少val
+static void memtag_raise(uint64 *max, uint64 val)
+{
+    uint64 old;
+    while (val > (old = *max) && !__sync_bool_compare_and_swap(max, old, val)) {
+    }
+}
+
+// 刚申请出去的页记为tag用途（页帧已经检查过）
+static void memtag_page_own(uint64 page, uint32 tag)
+{
+    assert(tag < N_MEMTAG, "pmem_alloc: invalid memory tag");
+    pmem_tags[(page - pmem_frames_base) / PGSIZE] = tag;
+    memtag_raise(&memtag_global[tag].pages_max, __sync_add_and_fetch(&memtag_global[tag].pages, 1));
+    PCPU_ADD(memtag_counter, page_allocs[tag], 1);
+}
+
+// 释放的页不再计入原来的用途
+static void memtag_page_release(uint64 page)
+{
+    uint8 *tag = &pmem_tags[(page - pmem_frames_base) / PGSIZE];
+    if (*tag != MEMTAG_NONE) {
+        __sync_fetch_and_sub(&memtag_global[*tag].pages, 1);
+        *tag = MEMTAG_NONE;
+    }
+}
+
+// 准备释放的页: 必须正好有一个引用, 元数据清零
+static void pmem_frame_release(uint64 page, char *who)
+{
+    uint32 *frame = pmem_frame(page, who);
+    uint32 ref = *frame & FRAME_REF_MASK;
+    if (ref != 1) {
+        printf("%s: page %p, refcount %d\n", who, page, ref);
+        panic(ref == 0 ? "pmem: page is already free" : "pmem: page is still shared");
+    }
+    memtag_page_release(page);
+    *frame = 0;
+}
+
+
+// 从区域链表头部取出一页（调用者持有zone_lock）, 链表为空返回NULL
+static phy_free_page_t* mem_zone_pop(mem_control_zone_t *zone, bool zeroed)
+{
+    phy_free_page_t *list = zeroed ? &zone->zero_list : &zone->free_list;
+    phy_free_page_t *page_node = list->next_page;
+    if (page_node != NULL) {
+        list->next_page = page_node->next_page;
+        zone->free_page_count--;
+        if (zeroed) {
+            zone->zero_page_count--;
+        }
+    }
+    return page_node;
+}
+
+// 头插法把一页放回区域链表（调用者持有zone_lock）
+static void mem_zone_push(mem_control_zone_t *zone, phy_free_page_t *page_node, bool zeroed)
+{
+    phy_free_page_t *list = zeroed ? &zone->zero_list : &zone->free_list;
+    page_node->next_page = list->next_page;
+    list->next_page = page_node;
+    zone->free_page_count++;
+    if (zeroed) {
+        zone->zero_page_count++;
+    }
+}
+
+// 另一个区域
+static mem_control_zone_t* mem_zone_other(mem_control_zone_t *zone)
+{
+    return (zone == &kernel_mem_zone) ? &user_mem_zone : &kernel_mem_zone;
+}
+
+// 区域的可用页数: 自己的空闲页 + 另一个区域可以借出的页（不加锁读取, 仅供参考）
+static uint32 mem_zone_available(mem_control_zone_t *zone)
+{
+    mem_control_zone_t *lender = mem_zone_other(zone);
+    uint32 lender_free = lender->free_page_count;
+    uint32 count = zone->free_page_count;
+    if (lender_free > lender->reserve) {
+        count += lender_free - lender->reserve;
+    }
+    return count;
+}
+
+// 区域的链表已空: 从另一个区域最多借PMEM_BORROW_BATCH页, 保持页是否已清零, 返回借到的页数（调用者不持有区域锁）
+static uint32 mem_zone_borrow(mem_control_zone_t *zone)
+{
+    mem_control_zone_t *lender = mem_zone_other(zone);
+    uint32 n = 0;
+    
+    // 同时持有两个区域锁时固定先内核区域、后用户区域
+    spinlock_acquire(&kernel_mem_zone.zone_lock);
+    spinlock_acquire(&user_mem_zone.zone_lock);
+    while (n < PMEM_BORROW_BATCH && lender->free_page_count > lender->reserve) {
+        bool zeroed = (lender->free_list.next_page == NULL);
+        mem_zone_push(zone, mem_zone_pop(lender, zeroed), zeroed);
+        n++;
+    }
+    spinlock_release(&user_mem_zone.zone_lock);
+    spinlock_release(&kernel_mem_zone.zone_lock);
+    return n;
+}
+
+// 从区域链表取页直到本地栈有PMEM_MAG_BATCH页（调用者已关中断）, 返回区域的链表是否已空
+static bool mem_magazine_take(pmem_magazine_t *mag, mem_control_zone_t *zone, bool zeroed)
+{
+    spinlock_acquire(&zone->zone_lock);
+    while (mag->count < PMEM_MAG_BATCH) {
+        phy_free_page_t *page_node = mem_zone_pop(zone, zeroed);
+        if (page_node == NULL && !zeroed) {
+            page_node = mem_zone_pop(zone, true);
+        }
+        if (page_node == NULL) {
+            break;
+        }
+        mag->pages[mag->count++] = page_node;
+    }
+    bool empty = (zone->free_page_count == 0);
+    spinlock_release(&zone->zone_lock);
+    return empty;
+}
+
+// 本地栈为空时从区域链表批量取页（调用者已关中断）
+// zeroed: 补充已清零的本地栈, 只取已清零的页; 否则优先取内容未知的页, 不够时再取已清零的页
+// 区域的链表都空了则向另一个区域借一批页再取
+static void mem_magazine_refill(pmem_magazine_t *mag, mem_control_zone_t *zone, bool zeroed)
+{
+    if (mem_magazine_take(mag, zone, zeroed) && mag->count == 0 && mem_zone_borrow(zone) > 0) {
+        mem_magazine_take(mag, zone, zeroed);
+    }
+}
+
+// 依次调用区域的回收函数, 直到可用页回到PMEM_WMARK_HIGH（不能关中断调用, 回收函数会释放页）
+static void mem_zone_reclaim(mem_control_zone_t *zone)
+{
+    int z = (zone == &kernel_mem_zone) ? 0 : 1;
+    
+    // 已经有hart在回收这个区域: 不重复进行
+    if (__sync_lock_test_and_set(&pmem_reclaim[z].reclaiming, 1) != 0) {
+        return;
+    }
+    for (uint32 i = 0; i < pmem_reclaim[z].n && mem_zone_available(zone) < PMEM_WMARK_HIGH; i++) {
+        pmem_reclaim[z].fn[i](PMEM_WMARK_HIGH - mem_zone_available(zone));
+    }
+    __sync_lock_release(&pmem_reclaim[z].reclaiming);
+}
+
+// 本地栈已满时把栈底的PMEM_MAG_BATCH页归还区域链表, 保留栈顶最近释放的页（调用者已关中断）
+static void mem_magazine_drain(pmem_magazine_t *mag, mem_control_zone_t *zone)
+{
+    spinlock_acquire(&zone->zone_lock);
+    for (uint32 i = 0; i < PMEM_MAG_BATCH; i++) {
+        mem_zone_push(zone, mag->pages[i], false);
+    }
+    spinlock_release(&zone->zone_lock);
+
+    mag->count -= PMEM_MAG_BATCH;
+    memmove(&mag->pages[0], &mag->pages[PMEM_MAG_BATCH], mag->count * sizeof(phy_free_page_t*));
+}
+
+
+void* pmem_alloc_flags(bool in_kernel, uint32 flags)
 {
     // 根据分配标识选择对应的内存控制区域
     mem_control_zone_t *target_zone = in_kernel ? &kernel_mem_zone : &user_mem_zone;
+    bool zero = (flags & PMEM_ZERO) != 0;
+    bool need_memset = false;
+    bool refilled = false;
     
-    // 获取区域自旋锁，保护空闲链表的并发修改安全
-    spinlock_acquire(&target_zone->zone_lock);
+    // 关中断后本hart的本地栈只有自己访问, 不需要加锁
+    push_off();
+    int z = in_kernel ? 0 : 1;
+    pmem_magazine_t *mag = zero ? &pmem_zero_mags[mycpuid()][z] : &pmem_mags[mycpuid()][z];
     
-    // 从空闲链表头部取出一个可用物理页节点
-    phy_free_page_t *alloc_page_node = target_zone->free_list.next_page;
+    // 本地栈为空时从区域链表批量补充
+    if (mag->count == 0) {
+        mem_magazine_refill(mag, target_zone, zero);
+        refilled = true;
+    }
     
-    // 若存在可用空闲页，完成链表节点移除与计数更新
-    if (alloc_page_node != NULL) {
-        // 将链表头指向当前页的下一个节点，完成当前页的移除
-        target_zone->free_list.next_page = alloc_page_node->next_page;
-        // 减少区域剩余可分配页面计数
-        target_zone->free_page_count--;
+    // 需要清零但已清零的页用完了: 改用内容未知的页, 申请时清零
+    if (zero && mag->count == 0) {
+        mag = &pmem_mags[mycpuid()][z];
+        if (mag->count == 0) {
+            mem_magazine_refill(mag, target_zone, false);
+            refilled = true;
+        }
+        need_memset = true;
     }
     
-    // 释放区域自旋锁，允许其他核访问该内存区域
-    spinlock_release(&target_zone->zone_lock);
+    // 从本地栈顶取出一个可用物理页节点（区域也耗尽时为NULL）
+    phy_free_page_t *alloc_page_node = NULL;
+    if (mag->count > 0) {
+        alloc_page_node = mag->pages[--mag->count];
+    }
+    pop_off();
+    
+    // 区域已经耗尽: 回收后重试一次; 申请成功但低于低水位: 返回前回收（只在访问过区域链表时检查, 即每PMEM_MAG_BATCH次申请一次）
+    if (alloc_page_node == NULL) {
+        if ((flags & PMEM_NORECLAIM) == 0) {
+            mem_zone_reclaim(target_zone);
+            return pmem_alloc_flags(in_kernel, flags | PMEM_NORECLAIM);
+        }
+        return NULL;
+    }
+    if (refilled && (flags & PMEM_NORECLAIM) == 0 && mem_zone_available(target_zone) < PMEM_WMARK_LOW) {
+        mem_zone_reclaim(target_zone);
+    }
     
-    // 若分配成功，将物理页内容清零，避免残留数据泄露与逻辑异常
-    if (alloc_page_node != NULL) {
-        memset(alloc_page_node, 0, PGSIZE);
+    // 已清零的页只有第一个字被链表节点用过
+    if (zero) {
+        if (need_memset) {
+            memset(alloc_page_node, 0, PGSIZE);
+        } else {
+            alloc_page_node->next_page = NULL;
+        }
+    }
+    pmem_frame_own((uint64)alloc_page_node, in_kernel ? PMEM_F_KERNEL : 0);
+    if ((flags >> 8) != MEMTAG_NONE) {
+        memtag_page_own((uint64)alloc_page_node, flags >> 8);
     }
     
     // 返回分配得到的物理页起始地址
@@ -122,37 +537,318 @@ void* pmem_alloc(bool in_kernel)
 }
 
 
-void pmem_free(uint64 page, bool in_kernel)
+void* pmem_alloc(bool in_kernel)
 {
-    // 根据释放标识选择对应的内存控制区域
-    mem_control_zone_t *target_zone = in_kernel ? &kernel_mem_zone : &user_mem_zone;
+    return pmem_alloc_flags(in_kernel, PMEM_ZERO);
+}
+
+
+// 把一个区域中最多PMEM_ZERO_BATCH个内容未知的空闲页清零后移入清零链表, 返回清零的页数
+static uint32 mem_zone_zero(mem_control_zone_t *zone)
+{
+    phy_free_page_t *pages[PMEM_ZERO_BATCH];
+    uint32 n = 0;
     
-    // 安全检查1：验证待释放地址是否满足4KB物理页对齐要求（低12位必须为0）
-    if ((page % PGSIZE) != 0) {
-        panic("pmem_free: invalid page address, not aligned to 4KB boundary");
+    spinlock_acquire(&zone->zone_lock);
+    while (n < PMEM_ZERO_BATCH && (pages[n] = mem_zone_pop(zone, false)) != NULL) {
+        n++;
     }
+    spinlock_release(&zone->zone_lock);
     
-    // 安全检查2：验证待释放地址是否在目标区域的合法地址范围内
-    if (page < target_zone->zone_start || page >= target_zone->zone_end) {
-        panic("pmem_free: invalid page address, out of target zone bounds");
+    // 清零时不持有锁, 期间其他hart照常分配
+    for (uint32 i = 0; i < n; i++) {
+        memset(pages[i], 0, PGSIZE);
     }
     
-    // 填充垃圾数据（0x01重复填充），辅助检测"释放后继续使用"的内存非法访问bug
+    spinlock_acquire(&zone->zone_lock);
+    for (uint32 i = 0; i < n; i++) {
+        mem_zone_push(zone, pages[i], true);
+    }
+    spinlock_release(&zone->zone_lock);
+    return n;
+}
+
+
+bool pmem_zero_idle(void)
+{
+    // 先补充用户区域（进程的匿名内存、页表都从这里申请）
+    if (mem_zone_zero(&user_mem_zone) > 0) {
+        return true;
+    }
+    return mem_zone_zero(&kernel_mem_zone) > 0;
+}
+
+
+bool pmem_zero_pending(void)
+{
+    return user_mem_zone.free_list.next_page != NULL || kernel_mem_zone.free_list.next_page != NULL;
+}
+
+
+// 把元数据已经清零的页还给区域（伙伴系统的页作为0阶块还给伙伴系统）
+static void mem_free_page(uint64 page, bool in_kernel)
+{
+    mem_control_zone_t *target_zone = in_kernel ? &kernel_mem_zone : &user_mem_zone;
+    
+    // 伙伴系统的页（拆分后的用户大页中的4KB页）
+    if (page >= buddy.start && page < buddy.start + (uint64)PMEM_BUDDY_PAGES * PGSIZE) {
+        buddy_free_block(page, 0);
+        return;
+    }
+    
+#ifdef PMEM_POISON
+    // 调试构建：填充垃圾数据（0x01重复填充），辅助检测"释放后继续使用"的内存非法访问bug
     memset((void*)page, 1, PGSIZE);
+#endif
+    
+    // 关中断后压入本hart的本地栈, 栈满时先批量归还一半
+    push_off();
+    pmem_magazine_t *mag = &pmem_mags[mycpuid()][in_kernel ? 0 : 1];
+    if (mag->count == PMEM_MAG_SIZE) {
+        mem_magazine_drain(mag, target_zone);
+    }
+    mag->pages[mag->count++] = (phy_free_page_t*)page;
+    pop_off();
+}
+
+
+void pmem_free(uint64 page, bool in_kernel)
+{
+    // 安全检查：地址按页对齐、在可分配的物理内存范围内（区域的边界是自适应的, 不检查属于哪个区域），
+    // 并且没有其他引用（重复释放和释放仍被共享的页都在这里发现）
+    pmem_frame_release(page, "pmem_free");
+    mem_free_page(page, in_kernel);
+}
+
+
+void pmem_get(uint64 page)
+{
+    uint32 old = __sync_fetch_and_add(pmem_frame(page, "pmem_get"), 1);
+    assert((old & FRAME_REF_MASK) != 0, "pmem_get: page is free");
+    assert((old & FRAME_REF_MASK) != FRAME_REF_MASK, "pmem_get: refcount overflow");
+}
+
+
+bool pmem_put(uint64 page)
+{
+    uint32 *frame = pmem_frame(page, "pmem_put");
+    uint32 old = __sync_fetch_and_sub(frame, 1);
+    assert((old & FRAME_REF_MASK) != 0, "pmem_put: page is free");
+    if ((old & FRAME_REF_MASK) != 1) {
+        return false;
+    }
+    
+    // 最后一个引用: 没有其他人能再修改元数据, 按申请时的区域释放
+    memtag_page_release(page);
+    *frame = 0;
+    mem_free_page(page, ((old >> FRAME_FLAG_SHIFT) & PMEM_F_KERNEL) != 0);
+    return true;
+}
+
+
+void pmem_put_order(uint64 page, uint32 order)
+{
+    // 没有共享的页: 整块还给伙伴系统（只有持有者自己能增加引用, 看到的1不会在检查之后变化）
+    bool shared = false;
+    for (uint32 i = 0; i < (1u << order) && !shared; i++) {
+        shared = (pmem_refcount(page + (uint64)i * PGSIZE) != 1);
+    }
+    if (!shared) {
+        pmem_free_order(page, order);
+        return;
+    }
+    
+    // 有一部分页仍被共享: 逐页放弃引用, 释放的页作为0阶块在伙伴系统中重新合并
+    for (uint32 i = 0; i < (1u << order); i++) {
+        pmem_put(page + (uint64)i * PGSIZE);
+    }
+}
+
+
+uint32 pmem_refcount(uint64 page)
+{
+    return *pmem_frame(page, "pmem_refcount") & FRAME_REF_MASK;
+}
+
+
+uint32 pmem_frame_flags(uint64 page)
+{
+    return *pmem_frame(page, "pmem_frame_flags") >> FRAME_FLAG_SHIFT;
+}
+
+
+void pmem_frame_set_flags(uint64 page, uint32 flags)
+{
+    uint32 old = __sync_fetch_and_or(pmem_frame(page, "pmem_frame_set_flags"), flags << FRAME_FLAG_SHIFT);
+    assert((old & FRAME_REF_MASK) != 0, "pmem_frame_set_flags: page is free");
+}
+
+
+void pmem_frame_clear_flags(uint64 page, uint32 flags)
+{
+    __sync_fetch_and_and(pmem_frame(page, "pmem_frame_clear_flags"), ~(flags << FRAME_FLAG_SHIFT));
+}
+
+
+uint64 pmem_zero_page(void)
+{
+    return pmem_zero_pg;
+}
+
+
+void memtag_obj_alloc(uint32 tag)
+{
+    PCPU_ADD(memtag_counter, obj_allocs[tag], 1);
+}
+
+
+void memtag_obj_free(uint32 tag)
+{
+    PCPU_ADD(memtag_counter, obj_frees[tag], 1);
+}
+
+
+// 各hart的申请次数减去释放次数 (分别读取, 求和的过程中可能有变化, 释放多于申请时当作0)
+static uint64 memtag_objs(uint32 tag)
+{
+    uint64 allocs = PCPU_SUM(memtag_counter, obj_allocs[tag]);
+    uint64 frees = PCPU_SUM(memtag_counter, obj_frees[tag]);
+    return allocs > frees ? allocs - frees : 0;
+}
+
+
+void memtag_obj_sample(uint32 tag)
+{
+    memtag_raise(&memtag_global[tag].objs_max, memtag_objs(tag));
+}
+
+
+void memtag_read(uint32 tag, memtag_stat_t* st)
+{
+    assert(tag < N_MEMTAG, "memtag_read: invalid memory tag");
+    st->pages = memtag_global[tag].pages;
+    st->pages_max = memtag_global[tag].pages_max;
+    st->objs = memtag_objs(tag);
+    memtag_raise(&memtag_global[tag].objs_max, st->objs);
+    st->objs_max = memtag_global[tag].objs_max;
+    for (int i = 0; i < NCPU; i++) {
+        st->allocs[i] = memtag_counter[i].v.page_allocs[tag] + memtag_counter[i].v.obj_allocs[tag];
+    }
+}
+
+
+uint32 pmem_free_pages(bool in_kernel)
+{
+    // 仅读取计数, 不加锁: 调用者只把它当作内存压力的参考值（包括可以从另一个区域借的页和各hart本地栈中缓存的页）
+    mem_control_zone_t *target_zone = in_kernel ? &kernel_mem_zone : &user_mem_zone;
+    uint32 count = mem_zone_available(target_zone);
+    for (int i = 0; i < NCPU; i++) {
+        count += pmem_mags[i][in_kernel ? 0 : 1].count + pmem_zero_mags[i][in_kernel ? 0 : 1].count;
+    }
+    return count;
+}
+
+uint32 pmem_total_pages(bool in_kernel)
+{
+    mem_control_zone_t *target_zone = in_kernel ? &kernel_mem_zone : &user_mem_zone;
+    return (target_zone->zone_end - PG_ROUND_UP(target_zone->zone_start)) / PGSIZE;
+}
+
+
+void pmem_register_reclaim(bool in_kernel, pmem_reclaim_t fn)
+{
+    int z = in_kernel ? 0 : 1;
+    assert(pmem_reclaim[z].n < PMEM_N_RECLAIM, "pmem_register_reclaim: too many reclaim callbacks");
+    pmem_reclaim[z].fn[pmem_reclaim[z].n++] = fn;
+}
+
+
+void pmem_shrink(bool in_kernel)
+{
+    mem_zone_reclaim(in_kernel ? &kernel_mem_zone : &user_mem_zone);
+}
+
+
+void* pmem_alloc_order(uint32 order)
+{
+    if (order > PMEM_MAX_ORDER) {
+        return NULL;
+    }
     
-    // 获取区域自旋锁，保护空闲链表的并发修改安全
-    spinlock_acquire(&target_zone->zone_lock);
+    spinlock_acquire(&buddy.lock);
     
-    // 类型转换，将待释放物理页地址转为空闲页节点
-    phy_free_page_t *free_page_node = (phy_free_page_t*)page;
+    // 找到不小于order的最小非空阶
+    uint32 o = order;
+    while (o <= PMEM_MAX_ORDER && buddy.free_count[o] == 0) {
+        o++;
+    }
+    if (o > PMEM_MAX_ORDER) {
+        spinlock_release(&buddy.lock);
+        return NULL;
+    }
     
-    // 头插法将待释放页插入到空闲链表头部，完成释放操作
-    free_page_node->next_page = target_zone->free_list.next_page;
-    target_zone->free_list.next_page = free_page_node;
+    // 取出链表头的块, 逐级对半拆分, 后一半放回低一阶的链表
+    uint32 idx = (uint32)(((uint64)buddy.free_area[o].next - buddy.start) / PGSIZE);
+    buddy_remove(idx);
+    while (o > order) {
+        o--;
+        buddy_push(idx + (1 << o), o);
+    }
     
-    // 更新区域剩余可分配页面计数
-    target_zone->free_page_count++;
+    spinlock_release(&buddy.lock);
     
-    // 释放区域自旋锁，允许其他核访问该内存区域
-    spinlock_release(&target_zone->zone_lock);
-}
\ No newline at end of file
+    // 整块清零, 每一页的引用计数都为1（大页拆分后各页单独释放）
+    void *page = (void*)(buddy.start + (uint64)idx * PGSIZE);
+    memset(page, 0, (uint64)PGSIZE << order);
+    for (uint32 i = 0; i < (1u << order); i++) {
+        pmem_frame_own((uint64)page + (uint64)i * PGSIZE, PMEM_F_BUDDY);
+    }
+    return page;
+}
+
+
+void pmem_free_order(uint64 page, uint32 order)
+{
+    // 安全检查：阶合法, 块中的每一页都没有其他引用
+    if (order > PMEM_MAX_ORDER) {
+        panic("pmem_free_order: invalid order");
+    }
+    for (uint32 i = 0; i < (1u << order); i++) {
+        pmem_frame_release(page + (uint64)i * PGSIZE, "pmem_free_order");
+    }
+    buddy_free_block(page, order);
+}
+
+
+// 把元数据已经清零的块还给伙伴系统
+static void buddy_free_block(uint64 page, uint32 order)
+{
+    // 安全检查：地址在伙伴系统范围内且按块大小对齐
+    if (page < buddy.start || page >= buddy.start + (uint64)PMEM_BUDDY_PAGES * PGSIZE) {
+        panic("pmem_free_order: invalid page address, out of buddy bounds");
+    }
+    uint32 idx = (uint32)((page - buddy.start) / PGSIZE);
+    if ((page % PGSIZE) != 0 || (idx & ((1 << order) - 1)) != 0) {
+        panic("pmem_free_order: invalid page address, not aligned to block size");
+    }
+    
+    spinlock_acquire(&buddy.lock);
+    if (buddy.buddy_order[idx] != BUDDY_NOT_FREE) {
+        spinlock_release(&buddy.lock);
+        panic("pmem_free_order: block is already free");
+    }
+    
+    // 伙伴是同阶的空闲块则合并, 合并后的块首是两者中靠前的一个
+    while (order < PMEM_MAX_ORDER) {
+        uint32 buddy_idx = idx ^ (1 << order);
+        if (buddy.buddy_order[buddy_idx] != order) {
+            break;
+        }
+        buddy_remove(buddy_idx);
+        idx &= ~(1u << order);
+        order++;
+    }
+    buddy_push(idx, order);
+    
+    spinlock_release(&buddy.lock);
+}
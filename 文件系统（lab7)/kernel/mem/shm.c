@@ -0,0 +1,213 @@
+#include "lib/print.h"
+#include "lib/str.h"
+#include "lib/lock.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "mem/shm.h"
+#include "mem/asid.h"
+#include "proc/cpu.h"
+#include "riscv.h"
+
+// 共享内存对象表 (见mem/shm.h)
+static shm_t shms[N_SHM];
+static spinlock_t shm_lk;
+
+void shm_init()
+{
+    spinlock_init(&shm_lk, "shm");
+}
+
+// 释放对象的页和页地址表 (调用者持有shm_lk, 对象已销毁且没有映射)
+// 退出的进程的页表可能还没有销毁: 它们持有的引用在销毁页表时归还, 页在那时才真正释放
+static void shm_release(shm_t* shm)
+{
+    for (uint32 i = 0; i < shm->npages; i++) {
+        pmem_put(shm->pages[i]);
+    }
+    pmem_free((uint64)shm->pages, true);
+    shm->pages = NULL;
+    shm->npages = 0;
+    shm->removed = false;
+}
+
+// 放弃一次映射 (调用者持有shm_lk)
+static void shm_detach(shm_t* shm)
+{
+    assert(shm->nattach > 0, "shm_detach: not attached");
+    shm->nattach--;
+    if (shm->removed && shm->nattach == 0) {
+        shm_release(shm);
+    }
+}
+
+// 创建有npages页的共享内存对象, 页面立即分配并清零
+// 成功返回id, npages无效、没有空闲槽位或内存不足返回-1
+int shm_create(uint32 npages)
+{
+    if (npages == 0 || npages > SHM_MAX_PAGES) {
+        return -1;
+    }
+
+    // 1. 在锁外申请页
+    uint64* pages = (uint64*)pmem_alloc_flags(true, PMEM_ZERO | PMEM_TAG(MEMTAG_MMAP));
+    if (pages == NULL) {
+        return -1;
+    }
+    for (uint32 i = 0; i < npages; i++) {
+        pages[i] = (uint64)pmem_alloc(false);
+        if (pages[i] == 0) {
+            for (uint32 j = 0; j < i; j++) {
+                pmem_free(pages[j], false);
+            }
+            pmem_free((uint64)pages, true);
+            return -1;
+        }
+        pmem_frame_set_flags(pages[i], PMEM_F_SHARED);
+    }
+
+    // 2. 占用空闲槽位
+    spinlock_acquire(&shm_lk);
+    for (int id = 0; id < N_SHM; id++) {
+        if (shms[id].npages == 0) {
+            shms[id].npages = npages;
+            shms[id].pages = pages;
+            shms[id].nattach = 0;
+            shms[id].removed = false;
+            spinlock_release(&shm_lk);
+            return id;
+        }
+    }
+    spinlock_release(&shm_lk);
+
+    for (uint32 i = 0; i < npages; i++) {
+        pmem_free(pages[i], false);
+    }
+    pmem_free((uint64)pages, true);
+    return -1;
+}
+
+// 在当前进程的mmap区域中找一段空闲区域, 映射对象的所有页 (可读写)
+// 成功返回起始地址, 对象不存在、已销毁、进程的映射槽位已满或没有足够的区域返回-1
+uint64 shm_map(int id)
+{
+    proc_t* p = myproc();
+    if (id < 0 || id >= N_SHM) {
+        return (uint64)-1;
+    }
+
+    shm_attach_t* at = NULL;
+    for (int i = 0; i < N_SHM_ATTACH; i++) {
+        if (p->mm->shm[i].shm == NULL) {
+            at = &p->mm->shm[i];
+            break;
+        }
+    }
+    if (at == NULL) {
+        return (uint64)-1;
+    }
+
+    // 先算作一次映射: 之后对象不会被释放
+    spinlock_acquire(&shm_lk);
+    shm_t* shm = &shms[id];
+    if (shm->npages == 0 || shm->removed) {
+        spinlock_release(&shm_lk);
+        return (uint64)-1;
+    }
+    shm->nattach++;
+    spinlock_release(&shm_lk);
+
+    uint64 begin = uvm_mmap_find(shm->npages);
+    if (begin == 0 || !uvm_mmap_reserve(begin, shm->npages)) {
+        spinlock_acquire(&shm_lk);
+        shm_detach(shm);
+        spinlock_release(&shm_lk);
+        return (uint64)-1;
+    }
+    for (uint32 i = 0; i < shm->npages; i++) {
+        pmem_get(shm->pages[i]);
+        vm_mappages(p->mm->pgtbl, begin + (uint64)i * PGSIZE, shm->pages[i], PGSIZE, PTE_R | PTE_W | PTE_U);
+    }
+    at->begin = begin;
+    at->npages = shm->npages;
+    at->shm = shm;
+    return begin;
+}
+
+// 解除当前进程中起点为begin的映射, 归还地址区域
+// 成功返回0, begin不是映射的起点返回-1
+int shm_unmap(uint64 begin)
+{
+    proc_t* p = myproc();
+    for (int i = 0; i < N_SHM_ATTACH; i++) {
+        shm_attach_t* at = &p->mm->shm[i];
+        if (at->shm != NULL && at->begin == begin) {
+            uvm_munmap(at->begin, at->npages);
+            spinlock_acquire(&shm_lk);
+            shm_detach(at->shm);
+            spinlock_release(&shm_lk);
+            at->shm = NULL;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// 销毁对象: 之后不能再映射, 没有映射时立即释放
+// 成功返回0, 对象不存在或已销毁返回-1
+int shm_destroy(int id)
+{
+    if (id < 0 || id >= N_SHM) {
+        return -1;
+    }
+    spinlock_acquire(&shm_lk);
+    shm_t* shm = &shms[id];
+    if (shm->npages == 0 || shm->removed) {
+        spinlock_release(&shm_lk);
+        return -1;
+    }
+    shm->removed = true;
+    if (shm->nattach == 0) {
+        shm_release(shm);
+    }
+    spinlock_release(&shm_lk);
+    return 0;
+}
+
+// [begin, begin + npages * PGSIZE)是否与p的某个映射相交
+bool shm_overlap(proc_t* p, uint64 begin, uint32 npages)
+{
+    uint64 end = begin + (uint64)npages * PGSIZE;
+    for (int i = 0; i < N_SHM_ATTACH; i++) {
+        shm_attach_t* at = &p->mm->shm[i];
+        if (at->shm != NULL && begin < at->begin + (uint64)at->npages * PGSIZE && at->begin < end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// fork: 子进程继承映射 (地址区域随空闲区域树复制, PMEM_F_SHARED的页表项由uvm_copy_pgtbl直接共享)
+void shm_fork(proc_t* p, proc_t* np)
+{
+    spinlock_acquire(&shm_lk);
+    for (int i = 0; i < N_SHM_ATTACH; i++) {
+        np->mm->shm[i] = p->mm->shm[i];
+        if (p->mm->shm[i].shm != NULL) {
+            p->mm->shm[i].shm->nattach++;
+        }
+    }
+    spinlock_release(&shm_lk);
+}
+
+// exec / 进程退出: 放弃所有映射 (页表项对页的引用在销毁页表时归还)
+void shm_exit(proc_t* p)
+{
+    spinlock_acquire(&shm_lk);
+    for (int i = 0; i < N_SHM_ATTACH; i++) {
+        if (p->mm->shm[i].shm != NULL) {
+            shm_detach(p->mm->shm[i].shm);
+            p->mm->shm[i].shm = NULL;
+        }
+    }
+    spinlock_release(&shm_lk);
+}
@@ -0,0 +1,221 @@
+/*
+ * slab.c - 固定大小内核对象的slab分配器
+ *
+ * 在pmem内核区域之上按页切分对象，申请与释放都是O(1)；
+ * 每个hart的本地对象栈让大多数操作不需要获取cache锁（见mem/slab.h）
+ */
+
+#include "mem/slab.h"
+#include "mem/pmem.h"
+#include "proc/cpu.h"
+#include "lib/print.h"
+#include "lib/str.h"
+#include "riscv.h"
+
+// 空闲对象链表节点（放在空闲对象的第一个字中）
+typedef struct slab_free_obj {
+    struct slab_free_obj* next;
+} slab_free_obj_t;
+
+// 第一个对象在页内的偏移（slab_t之后按8字节对齐）
+#define SLAB_OBJ_OFFSET ((sizeof(slab_t) + 7) & ~7)
+
+// 对象所在的slab
+#define OBJ_TO_SLAB(obj) ((slab_t*)PG_ROUND_DOWN((uint64)(obj)))
+
+
+// 把slab插入partial链表头部（调用者持有cache->lk）
+static void slab_list_push(kmem_cache_t *cache, slab_t *slab)
+{
+    slab->prev = NULL;
+    slab->next = cache->partial;
+    if (cache->partial != NULL) {
+        cache->partial->prev = slab;
+    }
+    cache->partial = slab;
+}
+
+// 把slab从partial链表中摘除（调用者持有cache->lk）
+static void slab_list_remove(kmem_cache_t *cache, slab_t *slab)
+{
+    if (slab->prev != NULL) {
+        slab->prev->next = slab->next;
+    } else {
+        cache->partial = slab->next;
+    }
+    if (slab->next != NULL) {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = NULL;
+    slab->next = NULL;
+}
+
+
+// 申请一页并切分成对象（不持有cache->lk调用）, 内存不足时返回NULL
+static slab_t* slab_create(kmem_cache_t *cache)
+{
+    // 不触发pmem的回收函数: 调用者已关中断, 本地栈正处于修改中
+    slab_t *slab = (slab_t*)pmem_alloc_flags(true, PMEM_NORECLAIM | PMEM_TAG(cache->tag));
+    if (slab == NULL) {
+        return NULL;
+    }
+
+    slab->prev = NULL;
+    slab->next = NULL;
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free = NULL;
+
+    // 倒序头插, 让链表按地址升序
+    for (int i = cache->per_slab - 1; i >= 0; i--) {
+        slab_free_obj_t *obj = (slab_free_obj_t*)((uint64)slab + SLAB_OBJ_OFFSET + (uint64)i * cache->obj_size);
+        obj->next = (slab_free_obj_t*)slab->free;
+        slab->free = obj;
+    }
+    return slab;
+}
+
+
+// 本地栈为空时从partial链表取SLAB_CPU_BATCH个对象, 没有partial slab时新建一个（调用者已关中断）
+static void kmem_cpu_refill(kmem_cache_t *cache, kmem_cpu_cache_t *cc)
+{
+    spinlock_acquire(&cache->lk);
+
+    // partial链表为空: 在锁外申请新的slab
+    if (cache->partial == NULL) {
+        spinlock_release(&cache->lk);
+        slab_t *slab = slab_create(cache);
+        if (slab == NULL) {
+            return;
+        }
+        spinlock_acquire(&cache->lk);
+        slab_list_push(cache, slab);
+        cache->nslab++;
+        cache->nempty++;
+    }
+
+    while (cc->count < SLAB_CPU_BATCH && cache->partial != NULL) {
+        slab_t *slab = cache->partial;
+        slab_free_obj_t *obj = (slab_free_obj_t*)slab->free;
+        slab->free = obj->next;
+        if (slab->inuse == 0) {
+            cache->nempty--;
+        }
+        slab->inuse++;
+
+        // 全部分配出去的slab离开partial链表
+        if (slab->free == NULL) {
+            slab_list_remove(cache, slab);
+        }
+        cc->objs[cc->count++] = obj;
+    }
+
+    spinlock_release(&cache->lk);
+    memtag_obj_sample(cache->tag);
+}
+
+
+// 本地栈已满时把栈底的SLAB_CPU_BATCH个对象还给所在的slab（调用者已关中断）
+static void kmem_cpu_drain(kmem_cache_t *cache, kmem_cpu_cache_t *cc)
+{
+    spinlock_acquire(&cache->lk);
+    for (uint32 i = 0; i < SLAB_CPU_BATCH; i++) {
+        slab_free_obj_t *obj = (slab_free_obj_t*)cc->objs[i];
+        slab_t *slab = OBJ_TO_SLAB(obj);
+        assert(slab->cache == cache, "kmem_cache_free: object does not belong to this cache");
+
+        // 原来是满的slab: 重新回到partial链表
+        if (slab->free == NULL) {
+            slab_list_push(cache, slab);
+        }
+        obj->next = (slab_free_obj_t*)slab->free;
+        slab->free = obj;
+        slab->inuse--;
+
+        // 全空的slab只保留一个, 其余归还pmem
+        if (slab->inuse == 0) {
+            if (cache->nempty > 0) {
+                slab_list_remove(cache, slab);
+                cache->nslab--;
+                pmem_free((uint64)slab, true);
+            } else {
+                cache->nempty++;
+            }
+        }
+    }
+    spinlock_release(&cache->lk);
+
+    cc->count -= SLAB_CPU_BATCH;
+    memmove(&cc->objs[0], &cc->objs[SLAB_CPU_BATCH], cc->count * sizeof(void*));
+}
+
+
+void kmem_cache_init(kmem_cache_t *cache, char *name, uint32 obj_size, uint32 tag)
+{
+    assert(obj_size >= sizeof(slab_free_obj_t), "kmem_cache_init: object too small");
+    assert(tag < N_MEMTAG, "kmem_cache_init: invalid memory tag");
+
+    cache->name = name;
+    cache->tag = tag;
+    cache->obj_size = (obj_size + 7) & ~7;
+    cache->per_slab = (PGSIZE - SLAB_OBJ_OFFSET) / cache->obj_size;
+    assert(cache->per_slab > 0, "kmem_cache_init: object larger than a page");
+    spinlock_init(&cache->lk, name);
+    cache->partial = NULL;
+    cache->nempty = 0;
+    cache->nslab = 0;
+    for (int i = 0; i < NCPU; i++) {
+        cache->cpu[i].count = 0;
+    }
+}
+
+
+// 从本地栈取一个对象, 本地栈和partial链表都空了且申请不到新的slab时返回NULL
+static void* kmem_cache_alloc_once(kmem_cache_t *cache)
+{
+    // 关中断后本hart的本地栈只有自己访问, 不需要加锁
+    push_off();
+    kmem_cpu_cache_t *cc = &cache->cpu[mycpuid()];
+    if (cc->count == 0) {
+        kmem_cpu_refill(cache, cc);
+    }
+    void *obj = NULL;
+    if (cc->count > 0) {
+        obj = cc->objs[--cc->count];
+    }
+    pop_off();
+    return obj;
+}
+
+
+void* kmem_cache_alloc(kmem_cache_t *cache)
+{
+    void *obj = kmem_cache_alloc_once(cache);
+
+    // slab_create不能回收: 离开本地栈之后收缩内核区域的缓存, 再重试一次
+    if (obj == NULL) {
+        pmem_shrink(true);
+        obj = kmem_cache_alloc_once(cache);
+    }
+    if (obj != NULL) {
+        memtag_obj_alloc(cache->tag);
+    }
+    return obj;
+}
+
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj)
+{
+    if (obj == NULL) {
+        return;
+    }
+    memtag_obj_free(cache->tag);
+
+    push_off();
+    kmem_cpu_cache_t *cc = &cache->cpu[mycpuid()];
+    if (cc->count == SLAB_CPU_OBJS) {
+        kmem_cpu_drain(cache, cc);
+    }
+    cc->objs[cc->count++] = obj;
+    pop_off();
+}
@@ -0,0 +1,334 @@
+#include "lib/print.h"
+#include "lib/klog.h"
+#include "lib/lock.h"
+#include "dev/vio.h"
+#include "fs/fs.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "mem/swap.h"
+#include "mem/asid.h"
+#include "lib/kstat.h"
+#include "proc/cpu.h"
+#include "memlayout.h"
+#include "riscv.h"
+
+extern super_block_t sb;
+
+// 交换区 (见mem/swap.h)
+static struct {
+    spinlock_t lk;     // 保护ref / hint / used
+    uint32 start;      // 交换区起始块
+    uint32 nslot;      // 槽位数 (0: 没有交换区)
+    uint16* ref;       // 每个槽位被多少个页表项引用 (一个内核页)
+    uint32 hint;       // 下一次从这里开始查找空闲槽位
+    uint32 used;       // 被引用的槽位数 (没有换出的页时fork和munmap不必扫描)
+} swap;
+
+void swap_init()
+{
+    spinlock_init(&swap.lk, "swap");
+    if (sb.swap_magic != SWAP_MAGIC || sb.swap_blocks < SWAP_BLOCKS_PER_PAGE) {
+        klog("swap: no swap area\n");
+        return;
+    }
+    swap.ref = (uint16*)pmem_alloc_flags(true, PMEM_ZERO | PMEM_TAG(MEMTAG_MMAP));
+    assert(swap.ref != NULL, "swap_init: no memory for slot table");
+    swap.start = sb.swap_start;
+    swap.nslot = sb.swap_blocks / SWAP_BLOCKS_PER_PAGE;
+    if (swap.nslot > SWAP_MAX_SLOTS) {
+        swap.nslot = SWAP_MAX_SLOTS;
+    }
+    swap.hint = 0;
+    swap.used = 0;
+    klog("swap: %d slots at block %d\n", swap.nslot, swap.start);
+}
+
+// 当前hart没有持有自旋锁 (可以睡眠等待磁盘)
+static bool swap_can_sleep()
+{
+    push_off();
+    bool ret = (mycpu()->noff == 1);
+    pop_off();
+    return ret;
+}
+
+// 占用从空闲槽位开始的最多n个连续槽位 (引用计数置1), 返回第一个槽位, *got是占用的个数; 交换区满时返回-1
+static int swap_slot_alloc(uint32 n, uint32* got)
+{
+    spinlock_acquire(&swap.lk);
+    for (uint32 i = 0; i < swap.nslot; i++) {
+        uint32 s = (swap.hint + i) % swap.nslot;
+        if (swap.ref[s] != 0) {
+            continue;
+        }
+        uint32 k = 0;
+        while (k < n && s + k < swap.nslot && swap.ref[s + k] == 0) {
+            swap.ref[s + k] = 1;
+            k++;
+        }
+        swap.used += k;
+        swap.hint = (s + k) % swap.nslot;
+        spinlock_release(&swap.lk);
+        *got = k;
+        return (int)s;
+    }
+    spinlock_release(&swap.lk);
+    return -1;
+}
+
+void swap_free(uint32 slot)
+{
+    spinlock_acquire(&swap.lk);
+    assert(slot < swap.nslot && swap.ref[slot] > 0, "swap_free: slot not in use");
+    if (--swap.ref[slot] == 0) {
+        swap.used--;
+    }
+    spinlock_release(&swap.lk);
+}
+
+// 连续的n个槽位与n个页之间的读写: 一个scatter-gather请求, 睡眠等待完成
+static void swap_io(uint32 slot, uint64* pages, uint32 n, bool write)
+{
+    virtio_seg_t seg[SWAP_BATCH];
+    for (uint32 i = 0; i < n; i++) {
+        seg[i].addr = pages[i];
+        seg[i].len = PGSIZE;
+    }
+    uint64 sector = (uint64)(swap.start + slot * SWAP_BLOCKS_PER_PAGE) * (BLOCK_SIZE / 512);
+    virtio_disk_rw_sg(sector, seg, (int)n, write);
+}
+
+// [va, end)中第一个换出的页, 没有则返回end (没有下级页表的范围和大页整个跳过)
+static uint64 swap_next(pgtbl_t pgtbl, uint64 va, uint64 end, pte_t** ppte)
+{
+    if (end > VA_MAX) {
+        end = VA_MAX;
+    }
+    va = PG_ROUND_DOWN(va);
+    while (va < end) {
+        pte_t* pte = &pgtbl[VA_TO_VPN(va, 2)];
+        if (!(*pte & PTE_V)) {
+            va = (va + (1ul << VA_SHIFT(2))) & ~((1ul << VA_SHIFT(2)) - 1);
+            continue;
+        }
+        pte = &((pgtbl_t)PTE_TO_PA(*pte))[VA_TO_VPN(va, 1)];
+        if (!(*pte & PTE_V) || !PTE_CHECK(*pte)) {
+            va = (va + MEGAPAGE_SIZE) & ~(MEGAPAGE_SIZE - 1);
+            continue;
+        }
+        pgtbl_t leaf = (pgtbl_t)PTE_TO_PA(*pte);
+        do {
+            if (PTE_SWAPPED(leaf[VA_TO_VPN(va, 0)])) {
+                *ppte = &leaf[VA_TO_VPN(va, 0)];
+                return va;
+            }
+            va += PGSIZE;
+        } while (va < end && va % MEGAPAGE_SIZE != 0);
+    }
+    return end;
+}
+
+// 可以换出的页: 只被这一个页表项引用的4KB私有用户页
+static bool swap_candidate(pte_t pte)
+{
+    if ((pte & (PTE_V | PTE_U)) != (PTE_V | PTE_U) || (pte & (PTE_F | PTE_M))) {
+        return false;
+    }
+    uint64 pa = PTE_TO_PA(pte);
+    return pmem_frame_flags(pa) == 0 && pmem_refcount(pa) == 1;
+}
+
+// 时钟算法: 从p->mm->swap_hand开始沿三个范围循环扫描, 最多选出target个牺牲页
+// 返回选出的个数, 清除过PTE_A时*cleared = true
+static uint32 swap_clock(proc_t* p, pte_t** victims, uint32 target, bool* cleared)
+{
+    uint64 begin[3] = { PGSIZE, TRAPFRAME - p->mm->ustack_pages * PGSIZE, MMAP_BEGIN };
+    uint64 end[3] = { PG_ROUND_UP(p->mm->heap_top), TRAPFRAME, MMAP_END };
+
+    // 指针所在的范围 (不在任何范围中时从第一个范围开始)
+    uint64 va = p->mm->swap_hand;
+    int r = 0;
+    while (r < 3 && !(va >= begin[r] && va < end[r])) {
+        r++;
+    }
+    if (r == 3) {
+        r = 0;
+        va = begin[0];
+    }
+
+    // 最多转两圈: 第一圈清除的PTE_A在第二圈仍为0, 这些页被选中
+    uint32 n = 0, scanned = 0, wraps = 0;
+    while (n < target && scanned < SWAP_SCAN_MAX && wraps <= 6) {
+        va = vm_next_mapped(p->mm->pgtbl, va, end[r]);
+        if (va >= end[r]) {
+            r = (r + 1) % 3;
+            va = begin[r];
+            wraps++;
+            continue;
+        }
+        scanned++;
+        pte_t* pte = vm_getpte(p->mm->pgtbl, va, false);
+        if (*pte & PTE_M) {
+            va = (va + MEGAPAGE_SIZE) & ~(MEGAPAGE_SIZE - 1);
+            continue;
+        }
+        if (swap_candidate(*pte)) {
+            if (*pte & PTE_A) {
+                *pte &= ~PTE_A;
+                *cleared = true;
+            } else {
+                victims[n++] = pte;
+            }
+        }
+        va += PGSIZE;
+    }
+    p->mm->swap_hand = va;
+    return n;
+}
+
+uint32 swap_out(uint32 target)
+{
+    proc_t* p = myproc();
+    if (swap.nslot == 0 || target == 0 || !swap_can_sleep()) {
+        return 0;
+    }
+    // 内核线程没有地址空间; 线程共享的地址空间不换出: 其他线程可能正在内核中持有这些页的物理地址
+    if (p == NULL || p->mm == NULL || p->mm->ref > 1) {
+        return 0;
+    }
+    if (target > SWAP_BATCH) {
+        target = SWAP_BATCH;
+    }
+
+    // 1. 选出牺牲页 (进程正在内核中, 页的内容和页表在换出期间不会改变)
+    pte_t* victims[SWAP_BATCH];
+    bool cleared = false;
+    uint32 n = swap_clock(p, victims, target, &cleared);
+
+    // 2. 按连续的槽位分批写出, 每批一个请求; 写完后页表项改为槽位号, 释放物理页
+    uint32 done = 0;
+    while (done < n) {
+        uint32 got;
+        int slot = swap_slot_alloc(n - done, &got);
+        if (slot < 0) {
+            break;
+        }
+        uint64 pages[SWAP_BATCH];
+        for (uint32 i = 0; i < got; i++) {
+            pages[i] = PTE_TO_PA(*victims[done + i]);
+        }
+        swap_io((uint32)slot, pages, got, true);
+        for (uint32 i = 0; i < got; i++) {
+            pte_t* pte = victims[done + i];
+            *pte = SWAP_TO_PTE(slot + i, PTE_FLAGS(*pte));
+            pmem_put(pages[i]);
+        }
+        done += got;
+    }
+
+    // 返回用户态之前丢弃旧的映射 (清除PTE_A的页也要重新查表, 之后的访问才会再次设置PTE_A)
+    if (done > 0 || cleared) {
+        asid_flush(p);
+    }
+    p->mstat.swap_outs += done;
+    KSTAT_ADD(swap_outs, done);
+    return done;
+}
+
+void swap_balance()
+{
+    if (swap.nslot == 0 || pmem_free_pages(false) >= PMEM_WMARK_LOW) {
+        return;
+    }
+    // 换出会睡眠等待磁盘: 开中断 (调用者在用户态陷阱中, 不持有锁)
+    intr_on();
+    swap_out(SWAP_BATCH);
+}
+
+uint64 swap_alloc_user(uint32 flags)
+{
+    uint64 page = (uint64)pmem_alloc_flags(false, flags);
+    if (page == 0 && swap_out(SWAP_BATCH) > 0) {
+        page = (uint64)pmem_alloc_flags(false, flags);
+    }
+    return page;
+}
+
+bool swap_fault(uint64 va)
+{
+    proc_t* p = myproc();
+    uint64 va_page = PG_ROUND_DOWN(va);
+    if (swap.nslot == 0 || va_page >= VA_MAX) {
+        return false;
+    }
+    pte_t* pte = vm_getpte(p->mm->pgtbl, va_page, false);
+    if (pte == NULL || !PTE_SWAPPED(*pte)) {
+        return false;
+    }
+    assert(swap_can_sleep(), "swap_fault: swapped page accessed while holding a spinlock");
+
+    // 申请页时可能换出别的页, 这一页的页表项不受影响
+    uint64 page = swap_alloc_user(0);   // 整页被覆盖, 不需要清零
+    if (page == 0) {
+        return false;
+    }
+    uint32 slot = PTE_TO_SLOT(*pte);
+    swap_io(slot, &page, 1, false);
+    *pte = PA_TO_PTE(page) | (*pte & (PTE_R | PTE_W | PTE_X | PTE_U)) | PTE_V;
+    swap_free(slot);
+    p->mstat.major_faults++;
+    p->mstat.swap_ins++;
+    KSTAT_INC(swap_ins);
+    return true;
+}
+
+void swap_prefault(uint64 va, uint64 len)
+{
+    if (swap.used == 0 || len == 0) {
+        return;
+    }
+    proc_t* p = myproc();
+    pte_t* pte;
+    uint64 end = va + len;
+    for (uint64 a = swap_next(p->mm->pgtbl, va, end, &pte); a < end; a = swap_next(p->mm->pgtbl, a + PGSIZE, end, &pte)) {
+        swap_fault(a);
+    }
+}
+
+bool swap_fork(pgtbl_t src, pgtbl_t dst, uint64 begin, uint64 end)
+{
+    if (swap.used == 0) {
+        return true;
+    }
+    pte_t* spte;
+    for (uint64 va = swap_next(src, begin, end, &spte); va < end; va = swap_next(src, va + PGSIZE, end, &spte)) {
+        pte_t* dpte = vm_getpte(dst, va, true);
+        if (dpte == NULL) {
+            return false;
+        }
+        spinlock_acquire(&swap.lk);
+        swap.ref[PTE_TO_SLOT(*spte)]++;
+        spinlock_release(&swap.lk);
+        *dpte = *spte;
+    }
+    return true;
+}
+
+uint64 swap_count(pgtbl_t pgtbl, uint64 begin, uint64 end)
+{
+    if (swap.used == 0) {
+        return 0;
+    }
+    uint64 count = 0;
+    pte_t* pte;
+    for (uint64 va = swap_next(pgtbl, begin, end, &pte); va < end; va = swap_next(pgtbl, va + PGSIZE, end, &pte)) {
+        count++;
+    }
+    return count;
+}
+
+void swap_usage(uint32* nslot, uint32* used)
+{
+    *nslot = swap.nslot;
+    *used = swap.used;
+}
@@ -1,66 +1,153 @@
 #include "mem/mmap.h"
 #include "mem/pmem.h"
 #include "mem/vmem.h"
+#include "mem/asid.h"
+#include "mem/swap.h"
 #include "proc/cpu.h"
 #include "lib/print.h"
 #include "lib/str.h"
+#include "lib/kstat.h"
 #include "memlayout.h"
 #include "riscv.h"
+#include "lib/tstat.h"
 
-// 连续虚拟地址空间拷贝（用于页表拷贝时的内存数据迁移）
-static void vm_copy_virtual_range(pgtbl_t src_pgtbl, pgtbl_t dst_pgtbl, uint64 start_va, uint64 end_va)
+// 把src_pgtbl中va所在的页共享给dst_pgtbl（写时复制），返回共享的长度（4KB或整个大页）
+// 可写的页在两边都改为只读并标记PMEM_F_COW，之后哪一方写入就在缺页时复制一份（见uvm_cow_fault）
+// 内核通过物理地址访问的页（PMEM_F_PINNED）不能共享，仍然立即复制；共享内存的页（PMEM_F_SHARED）直接共享
+// 内存不足（回收之后仍然申请不到页或页表页）时返回0: 这一页在dst_pgtbl中没有映射, 也没有多持有引用
+static uint64 vm_cow_share(pgtbl_t src_pgtbl, pgtbl_t dst_pgtbl, uint64 va)
 {
-    uint64 curr_va, phy_addr, new_phy_page;
-    int page_flags;
-    pte_t* page_table_entry;
-
-    for(curr_va = start_va; curr_va < end_va; curr_va += PGSIZE)
-    {
-        page_table_entry = vm_getpte(src_pgtbl, curr_va, false);
-        assert(page_table_entry != NULL, "vm_copy_virtual_range: invalid page table entry");
-        assert((*page_table_entry) & PTE_V, "vm_copy_virtual_range: page table entry not valid");
-        
-        phy_addr = (uint64)PTE_TO_PA(*page_table_entry);
-        page_flags = (int)PTE_FLAGS(*page_table_entry);
-
-        new_phy_page = (uint64)pmem_alloc(false);
-        memmove((char*)new_phy_page, (const char*)phy_addr, PGSIZE);
-        vm_mappages(dst_pgtbl, curr_va, new_phy_page, PGSIZE, page_flags);
+    pte_t* src_pte = vm_getpte(src_pgtbl, va, false);
+    assert(src_pte != NULL && (*src_pte & PTE_V), "vm_cow_share: page not mapped");
+    
+    // 大页从中间开始共享时先拆开（父进程中只有共享的部分变为只读）
+    if ((*src_pte & PTE_M) && va % MEGAPAGE_SIZE != 0) {
+        src_pte = vm_getpte(src_pgtbl, va, true);
+        if (src_pte == NULL) {
+            return 0;
+        }
+    }
+    uint64 pa = PTE_VA_TO_PA(*src_pte, va);
+    int page_flags = (int)(PTE_FLAGS(*src_pte) & ~(PTE_M | PTE_V));
+    
+    if (pmem_frame_flags(pa) & PMEM_F_PINNED) {
+        uint64 new_phy_page = (uint64)pmem_alloc_flags(false, 0);  // 整页被覆盖, 不需要清零
+        if (new_phy_page == 0) {
+            return 0;
+        }
+        if (!vm_try_mappages(dst_pgtbl, va, new_phy_page, PGSIZE, page_flags)) {
+            pmem_free(new_phy_page, false);
+            return 0;
+        }
+        memmove((char*)new_phy_page, (const char*)pa, PGSIZE);
+        myproc()->mstat.fork_copied++;
+        return PGSIZE;
+    }
+    
+    // 共享内存的页: 父子进程映射同一页, 都保持可写
+    if (pmem_frame_flags(pa) & PMEM_F_SHARED) {
+        if (!vm_try_mappages(dst_pgtbl, va, pa, PGSIZE, page_flags)) {
+            return 0;
+        }
+        pmem_get(pa);
+        myproc()->mstat.fork_shared++;
+        return PGSIZE;
+    }
+    
+    // 大页整个共享: 其中每一页都有自己的引用计数, 写入时只拆分并复制被写的那一页
+    // 先建立子进程的映射: 失败时父进程的页表项和引用计数都没有改变
+    uint64 len = (*src_pte & PTE_M) ? MEGAPAGE_SIZE : PGSIZE;
+    if (!vm_try_mappages(dst_pgtbl, va, pa, len, page_flags & ~PTE_W)) {
+        return 0;
+    }
+    for (uint64 off = 0; off < len; off += PGSIZE) {
+        if (page_flags & PTE_W) {
+            pmem_frame_set_flags(pa + off, PMEM_F_COW);
+        }
+        pmem_get(pa + off);
     }
+    *src_pte &= ~PTE_W;
+    myproc()->mstat.fork_shared += len / PGSIZE;
+    return len;
 }
 
-// 两个连续的内存映射区域合并
-// 保留指定区域，释放另一个区域，不处理链表后继指针
-// 用于内存映射释放时的空闲区域合并优化
-static void vm_merge_mmap_regions(mmap_region_t* region_a, mmap_region_t* region_b, bool retain_region_a)
+// 连续虚拟地址空间写时复制共享: 只访问已经映射的页（还没有访问过的页没有映射，子进程访问时同样按需分配）
+// 文件映射页（PTE_F）由子进程缺页时从页缓存重新映射，不共享
+// 换出到交换区的页由子进程引用同一个槽位（见swap_fork）
+// 内存不足时返回false, 已经共享的部分留在dst_pgtbl中（由调用者销毁）
+static bool vm_share_virtual_range(pgtbl_t src_pgtbl, pgtbl_t dst_pgtbl, uint64 start_va, uint64 end_va)
 {
-    // 验证输入有效性和区域连续性
-    assert(region_a != NULL && region_b != NULL, "vm_merge_mmap_regions: null region pointer");
-    assert(region_a->begin + region_a->npages * PGSIZE == region_b->begin, "vm_merge_mmap_regions: non-contiguous regions");
-    
-    // 执行区域合并操作
-    if(retain_region_a) {
-        region_a->npages += region_b->npages;
-        mmap_region_free(region_b);
-    } else {
-        region_b->begin -= region_a->npages * PGSIZE;
-        region_b->npages += region_a->npages;
-        mmap_region_free(region_a);
+    uint64 curr_va = vm_next_mapped(src_pgtbl, start_va, end_va);
+    while (curr_va < end_va) {
+        pte_t* pte_entry = vm_getpte(src_pgtbl, curr_va, false);
+        // 页缓存中的页在子进程缺页时重新映射; 线程的trapframe页 (没有PTE_U) 不属于子进程
+        if ((*pte_entry & PTE_F) || !(*pte_entry & PTE_U)) {
+            curr_va += PGSIZE;
+        } else {
+            uint64 len = vm_cow_share(src_pgtbl, dst_pgtbl, curr_va);
+            if (len == 0) {
+                return false;
+            }
+            curr_va += len;
+        }
+        proc_cond_resched();
+        curr_va = vm_next_mapped(src_pgtbl, curr_va, end_va);
     }
+    return swap_fork(src_pgtbl, dst_pgtbl, start_va, end_va);
 }
 
-// 打印内存映射链表详情（调试专用）
-void uvm_show_mmaplist(mmap_region_t* mmap_head)
+// 打印空闲mmap区域详情（调试专用）
+void uvm_show_mmaplist(mmap_region_t* mmap_root)
 {
-    mmap_region_t* curr_region = mmap_head;
     printf("\n[Virtual Memory] Mmap available free regions:\n");
-    if(curr_region == NULL)
+    if(mmap_root == NULL)
         printf("  No available mmap free regions (NULL)\n");
-    while(curr_region != NULL) {
-        uint64 region_end = curr_region->begin + curr_region->npages * PGSIZE;
-        printf("  Free region: 0x%lx ~ 0x%lx (pages: %d)\n", curr_region->begin, region_end, curr_region->npages);
-        curr_region = curr_region->next;
+    mmap_tree_print(mmap_root);
+}
+
+// [begin, begin + npages * PGSIZE)中是否有用户不能访问的页 (没有PTE_U: 线程的trapframe, munmap不能解除)
+bool uvm_kernel_overlap(pgtbl_t pgtbl, uint64 begin, uint32 npages)
+{
+    uint64 end = begin + (uint64)npages * PGSIZE;
+    for (uint64 va = vm_next_mapped(pgtbl, begin, end); va < end; va = vm_next_mapped(pgtbl, va + PGSIZE, end)) {
+        if (!(*vm_getpte(pgtbl, va, false) & PTE_U)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// [begin, end)中已映射的页数（大页按其中的4KB页计数, 映射全0页的页不占内存, 不计数）
+uint64 uvm_resident_pages(pgtbl_t pgtbl, uint64 begin, uint64 end)
+{
+    uint64 count = 0;
+    for (uint64 va = vm_next_mapped(pgtbl, begin, end); va < end; va = vm_next_mapped(pgtbl, va + PGSIZE, end)) {
+        if (PTE_VA_TO_PA(*vm_getpte(pgtbl, va, false), va) != pmem_zero_page()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// 静态辅助函数：level级页表及其下级页表占用的页数
+static uint64 vm_count_pgtbl(pgtbl_t pgtbl, uint32 level)
+{
+    uint64 count = 1;
+    if (level == 0) {
+        return count;
+    }
+    for (int i = 0; i < 512; i++) {
+        if ((pgtbl[i] & PTE_V) && PTE_CHECK(pgtbl[i])) {
+            count += vm_count_pgtbl((pgtbl_t)PTE_TO_PA(pgtbl[i]), level - 1);
+        }
     }
+    return count;
+}
+
+// 用户页表占用的页数（包括映射trampoline和trapframe的页表）
+uint64 uvm_pgtbl_pages(pgtbl_t pgtbl)
+{
+    return vm_count_pgtbl(pgtbl, 2);
 }
 
 // 递归销毁页表及其映射的物理页
@@ -70,140 +157,291 @@ static void vm_recursive_destroy_pgtbl(pgtbl_t pgtbl, uint32 level)
     // 遍历页表的512个表项
     for (int i = 0; i < 512; i++) {
         pte_t pte_entry = pgtbl[i];
+        pgtbl[i] = 0;   // 页表页清零后放回页表页缓存
         
-        // 跳过无效页表项
-        if (!(pte_entry & PTE_V)) continue;
+        // 跳过无效页表项（换出的页放弃对交换槽位的引用）
+        if (!(pte_entry & PTE_V)) {
+            if (level == 0 && PTE_SWAPPED(pte_entry)) {
+                swap_free(PTE_TO_SLOT(pte_entry));
+            }
+            continue;
+        }
         
-        if (level == 0) {
-            // 最底层页表，直接释放映射的物理页
+        if (pte_entry & PTE_F) {
+            // 文件映射页属于页缓存，不释放
+            continue;
+        } else if (level == 0) {
+            // 最底层页表，放弃对映射的物理页的引用（写时复制共享的页由最后一个进程释放）
             uint64 phy_addr = PTE_TO_PA(pte_entry);
-            pmem_free(phy_addr, false);
+            pmem_put(phy_addr);
         } else if (PTE_CHECK(pte_entry)) {
             // 非叶子节点，递归销毁下级页表
             pgtbl_t child_pgtbl = (pgtbl_t)PTE_TO_PA(pte_entry);
             vm_recursive_destroy_pgtbl(child_pgtbl, level - 1);
+            // 每释放一张0级页表中的页 (最多512页) 检查一次是否需要让出CPU
+            if (level == 1) {
+                proc_cond_resched();
+            }
+        } else if (pte_entry & PTE_M) {
+            // 大页，没有共享时整块还给伙伴系统
+            pmem_put_order(PTE_TO_PA(pte_entry), MEGAPAGE_ORDER);
         } else {
-            // 叶子节点（带访问权限），释放对应的物理页
+            // 叶子节点（带访问权限），放弃对物理页的引用
             uint64 phy_addr = PTE_TO_PA(pte_entry);
-            pmem_free(phy_addr, false);
+            pmem_put(phy_addr);
         }
     }
     
     // 释放当前页表自身占用的物理页
-    pmem_free((uint64)pgtbl, false);
+    vm_pgtbl_free(pgtbl);
 }
 
-// 页表销毁入口：单独处理trampoline和trapframe（特殊映射区域）
+// 页表销毁入口：单独处理trampoline、trapframe和用户数据页（特殊映射区域）
 void uvm_destroy_pgtbl(pgtbl_t pgtbl)
 {
     // 解除trampoline映射（共享资源，不释放物理页）
     vm_unmappages(pgtbl, TRAMPOLINE, PGSIZE, false);
+
+    // 解除用户数据页映射（内核数据段中的一页, 不释放）
+    vm_unmappages(pgtbl, VDATA, PGSIZE, false);
     
-    // 解除trapframe映射（进程私有资源，释放对应物理页）
-    vm_unmappages(pgtbl, TRAPFRAME, PGSIZE, true);
+    // 解除trapframe映射（trapframe由proc_free释放，这里只解除映射; 共享地址空间的进程退出时已经解除）
+    vm_unmap_mapped(pgtbl, TRAPFRAME, PGSIZE, false);
     
     // 从顶级页表开始递归销毁整个页表结构
     vm_recursive_destroy_pgtbl(pgtbl, 2);
 }
 
 // 拷贝用户页表（排除trampoline和trapframe特殊区域）
-void uvm_copy_pgtbl(pgtbl_t src_pgtbl, pgtbl_t dst_pgtbl, uint64 heap_top, uint32 ustack_page_count, mmap_region_t* mmap_head)
+// 物理页不复制: 父子进程写时复制共享（见vm_cow_share），fork的开销只与页表大小有关
+// 内存不足时返回false: dst_pgtbl中已经共享的页持有各自的引用, 由调用者销毁dst_pgtbl
+bool uvm_copy_pgtbl(pgtbl_t src_pgtbl, pgtbl_t dst_pgtbl, uint64 heap_top, uint32 ustack_page_count, mmap_region_t* mmap_head)
 {
-    /* 步骤1：拷贝代码段、数据段、堆区域（PGSIZE ~ heap_top） */
-    // 跳过最低地址的空白保护页，从有效用户空间起始地址开始拷贝
-    vm_copy_virtual_range(src_pgtbl, dst_pgtbl, PGSIZE, heap_top);
+    /* 步骤1：共享代码段、数据段、堆区域（PGSIZE ~ heap_top） */
+    // 跳过最低地址的空白保护页，从有效用户空间起始地址开始
+    bool ok = vm_share_virtual_range(src_pgtbl, dst_pgtbl, PGSIZE, heap_top);
 
-    /* 步骤2：拷贝用户栈区域 */
+    /* 步骤2：共享用户栈区域 */
     uint64 ustack_start_va = TRAPFRAME - ustack_page_count * PGSIZE;
-    vm_copy_virtual_range(src_pgtbl, dst_pgtbl, ustack_start_va, TRAPFRAME);
+    ok = ok && vm_share_virtual_range(src_pgtbl, dst_pgtbl, ustack_start_va, TRAPFRAME);
 
-    /* 步骤3：拷贝已映射的mmap区域 */
-    // 定义MMAP区域的地址范围（与用户态内存布局保持一致）
-    #define MMAP_VIRTUAL_END     (VA_MAX - 34 * PGSIZE)
-    #define MMAP_VIRTUAL_BEGIN   (MMAP_VIRTUAL_END - 8096 * PGSIZE)
+    /* 步骤3：共享已映射的mmap区域（沿页表查找, 没有页表的范围整个跳过） */
+    ok = ok && vm_share_virtual_range(src_pgtbl, dst_pgtbl, MMAP_BEGIN, MMAP_END);
     
-    for (uint64 curr_va = MMAP_VIRTUAL_BEGIN; curr_va < MMAP_VIRTUAL_END; curr_va += PGSIZE) {
-        pte_t* pte_entry = vm_getpte(src_pgtbl, curr_va, false);
-        // 仅拷贝已建立有效映射的页面
-        if (pte_entry != NULL && (*pte_entry & PTE_V)) {
-            uint64 src_phy_addr = (uint64)PTE_TO_PA(*pte_entry);
-            int page_access_flags = (int)PTE_FLAGS(*pte_entry);
-            
-            uint64 new_phy_page = (uint64)pmem_alloc(false);
-            if (new_phy_page == 0) {
-                panic("uvm_copy_pgtbl: insufficient physical memory for mmap region copy");
-            }
-            memmove((char*)new_phy_page, (const char*)src_phy_addr, PGSIZE);
-            vm_mappages(dst_pgtbl, curr_va, new_phy_page, PGSIZE, page_access_flags);
+    // 父进程的可写页变成了只读（失败时也可能已经有一部分）: 丢弃TLB中旧的映射
+    asid_flush(myproc());
+    return ok;
+}
+
+// 写时复制的缺页处理: va所在页是写时复制共享的只读页时，复制一份私有的页并改为可写
+// 已经没有其他进程共享时不复制，直接恢复可写；大页先拆开，只复制被写的4KB页
+// 全0页（见pmem_zero_page）换成一个新的全0页，不需要复制
+// 不是写时复制页或内存不足时返回false
+bool uvm_cow_fault(pgtbl_t pgtbl, uint64 va)
+{
+    uint64 va_page = PG_ROUND_DOWN(va);
+    if (va_page >= VA_MAX) {
+        return false;
+    }
+    pte_t* pte_entry = vm_getpte(pgtbl, va_page, false);
+    if (pte_entry == NULL || (*pte_entry & (PTE_V | PTE_U)) != (PTE_V | PTE_U) || (*pte_entry & (PTE_W | PTE_F))) {
+        return false;
+    }
+    uint64 phy_addr = PTE_VA_TO_PA(*pte_entry, va_page);
+    if (!(pmem_frame_flags(phy_addr) & PMEM_F_COW)) {
+        return false;
+    }
+    KSTAT_INC(cow_faults);
+    if (*pte_entry & PTE_M) {
+        pte_entry = vm_getpte(pgtbl, va_page, true);
+        if (pte_entry == NULL) {
+            return false;
         }
     }
     
-    #undef MMAP_VIRTUAL_END
-    #undef MMAP_VIRTUAL_BEGIN
+    if (phy_addr == pmem_zero_page()) {
+        uint64 new_phy_page = swap_alloc_user(PMEM_ZERO);
+        if (new_phy_page == 0) {
+            return false;
+        }
+        *pte_entry = PA_TO_PTE(new_phy_page) | PTE_FLAGS(*pte_entry) | PTE_W;
+        pmem_put(phy_addr);
+    } else if (pmem_refcount(phy_addr) == 1) {
+        // 只剩自己（引用只会被其他进程减少, 不会增加）
+        pmem_frame_clear_flags(phy_addr, PMEM_F_COW);
+        *pte_entry |= PTE_W;
+    } else {
+        uint64 new_phy_page = swap_alloc_user(0);  // 整页被覆盖, 不需要清零
+        if (new_phy_page == 0) {
+            return false;
+        }
+        memmove((char*)new_phy_page, (const char*)phy_addr, PGSIZE);
+        *pte_entry = PA_TO_PTE(new_phy_page) | PTE_FLAGS(*pte_entry) | PTE_W;
+        pmem_put(phy_addr);
+        myproc()->mstat.cow_copies++;
+    }
+    asid_flush_page(myproc(), va_page);
+    myproc()->mstat.minor_faults++;
+    return true;
 }
 
-// 新增用户内存映射区域，从空闲mmap区域中分割并建立物理映射
-void uvm_mmap(uint64 region_start, uint32 page_count, int access_perm)
+// 第一个能容纳npages页的空闲mmap区域的起始地址，没有则返回0
+uint64 uvm_mmap_find(uint32 page_count)
 {
-    if(page_count == 0) return;
-    assert(region_start % PGSIZE == 0, "uvm_mmap: region start address not page-aligned");
+    return uvm_mmap_find_aligned(page_count, PGSIZE);
+}
 
+// 第一个能容纳npages页、起点按align对齐的空闲mmap区域位置，没有则返回0
+uint64 uvm_mmap_find_aligned(uint32 page_count, uint64 align)
+{
+    return mmap_tree_fit(myproc()->mm->mmap, page_count, align);
+}
+
+// 从空闲mmap区域中取出[region_start, region_start + page_count * PGSIZE)，不建立映射
+// 区域不在任何空闲区域内时返回false（空闲区域不变）
+bool uvm_mmap_reserve(uint64 region_start, uint32 page_count)
+{
     proc_t* curr_proc = myproc();
-    uint64 region_length = page_count * PGSIZE;
+    uint64 region_end = region_start + (uint64)page_count * PGSIZE;
     
-    // 遍历mmap空闲链表，寻找可容纳请求区域的空闲块
-    mmap_region_t* prev_region = NULL;
-    mmap_region_t* curr_region = curr_proc->mmap;
+    // 请求区域必须完全包含在一个空闲区域内
+    mmap_region_t* free_region = mmap_tree_lookup(curr_proc->mm->mmap, region_start);
+    if (free_region == NULL || region_end > free_region->begin + (uint64)free_region->npages * PGSIZE) {
+        return false;
+    }
     
-    while (curr_region != NULL) {
-        uint64 curr_region_end = curr_region->begin + curr_region->npages * PGSIZE;
-        
-        // 检查请求区域是否完全包含在当前空闲区域内
-        if (region_start >= curr_region->begin && region_start + region_length <= curr_region_end) {
-            // 找到匹配的空闲区域，执行分割操作
-            if (region_start == curr_region->begin && region_length == curr_region->npages * PGSIZE) {
-                // 情况1：完全匹配，移除整个空闲区域
-                if (prev_region == NULL) {
-                    curr_proc->mmap = curr_region->next;
-                } else {
-                    prev_region->next = curr_region->next;
-                }
-                mmap_region_free(curr_region);
-            } else if (region_start == curr_region->begin) {
-                // 情况2：从空闲区域头部分割
-                curr_region->begin += region_length;
-                curr_region->npages -= page_count;
-            } else if (region_start + region_length == curr_region_end) {
-                // 情况3：从空闲区域尾部分割
-                curr_region->npages -= page_count;
-            } else {
-                // 情况4：从空闲区域中间分割，创建新的空闲子区域
-                mmap_region_t* new_free_region = mmap_region_alloc();
-                new_free_region->begin = region_start + region_length;
-                new_free_region->npages = (curr_region_end - region_start - region_length) / PGSIZE;
-                new_free_region->next = curr_region->next;
-                curr_region->npages = (region_start - curr_region->begin) / PGSIZE;
-                curr_region->next = new_free_region;
-            }
-            break;
-        }
-        prev_region = curr_region;
-        curr_region = curr_region->next;
+    // 分割: 删除原区域, 插回请求区域前后剩余的部分
+    uint64 free_begin = free_region->begin;
+    uint64 free_end = free_begin + (uint64)free_region->npages * PGSIZE;
+    curr_proc->mm->mmap = mmap_tree_remove(curr_proc->mm->mmap, free_begin);
+    if (free_begin < region_start) {
+        curr_proc->mm->mmap = mmap_tree_insert(curr_proc->mm->mmap, free_begin, (region_start - free_begin) / PGSIZE);
+    }
+    if (region_end < free_end) {
+        curr_proc->mm->mmap = mmap_tree_insert(curr_proc->mm->mmap, region_end, (free_end - region_end) / PGSIZE);
+    }
+    return true;
+}
+
+// 把区域归还到空闲mmap区域并与相邻的空闲区域合并，不解除映射
+void uvm_mmap_release(uint64 region_start, uint32 page_count)
+{
+    proc_t* curr_proc = myproc();
+    uint64 region_end = region_start + (uint64)page_count * PGSIZE;
+    
+    // 紧接在前面的空闲区域: 包含region_start - 1且正好在region_start结束
+    mmap_region_t* prev_region = (region_start > MMAP_BEGIN) ? mmap_tree_lookup(curr_proc->mm->mmap, region_start - 1) : NULL;
+    if (prev_region != NULL) {
+        assert(prev_region->begin + (uint64)prev_region->npages * PGSIZE == region_start, "uvm_mmap_release: region already free");
+        region_start = prev_region->begin;
+        curr_proc->mm->mmap = mmap_tree_remove(curr_proc->mm->mmap, prev_region->begin);
+    }
+    
+    // 紧接在后面的空闲区域: 从region_end开始
+    mmap_region_t* next_region = mmap_tree_lookup(curr_proc->mm->mmap, region_end);
+    if (next_region != NULL) {
+        assert(next_region->begin == region_end, "uvm_mmap_release: region already free");
+        uint64 next_end = next_region->begin + (uint64)next_region->npages * PGSIZE;
+        curr_proc->mm->mmap = mmap_tree_remove(curr_proc->mm->mmap, next_region->begin);
+        region_end = next_end;
+    }
+    
+    curr_proc->mm->mmap = mmap_tree_insert(curr_proc->mm->mmap, region_start, (region_end - region_start) / PGSIZE);
+}
+
+// 新增用户匿名映射区域，从空闲mmap区域中分割出来
+// populate = false时只占用地址区域，每一页在第一次访问时由uvm_mmap_fault分配（可读写、内容全0）；
+// populate = true时立即分配物理页并建立映射（access_perm）
+// 区域不空闲或内存不足时返回false（什么都不改变）
+bool uvm_mmap(uint64 region_start, uint32 page_count, int access_perm, bool populate)
+{
+    if(page_count == 0) return true;
+    assert(region_start % PGSIZE == 0, "uvm_mmap: region start address not page-aligned");
+
+    proc_t* curr_proc = myproc();
+    
+    // 从空闲mmap区域中分割出请求区域
+    if (!uvm_mmap_reserve(region_start, page_count)) {
+        return false;
+    }
+    if (!populate) {
+        return true;
     }
     
     // 为请求区域分配物理页并建立虚拟地址映射
     for (uint32 i = 0; i < page_count; i++) {
         uint64 curr_va = region_start + i * PGSIZE;
+        proc_cond_resched();
+        
+        // 2MB对齐且剩余不少于2MB: 尽量用伙伴系统的大块建立大页映射
+        if (curr_va % MEGAPAGE_SIZE == 0 && page_count - i >= MEGAPAGE_PAGES) {
+            uint64 block = (uint64)pmem_alloc_order(MEGAPAGE_ORDER);
+            if (block != 0) {
+                vm_mappages(curr_proc->mm->pgtbl, curr_va, block, MEGAPAGE_SIZE, access_perm | PTE_U);
+                i += MEGAPAGE_PAGES - 1;
+                continue;
+            }
+        }
+        
+        // 回收之后仍然内存不足: 撤销已经建立的映射, 归还区域
         uint64 new_phy_page = (uint64)pmem_alloc(false);
+        if (new_phy_page != 0 && !vm_try_mappages(curr_proc->mm->pgtbl, curr_va, new_phy_page, PGSIZE, access_perm | PTE_U)) {
+            pmem_free(new_phy_page, false);
+            new_phy_page = 0;
+        }
         if (new_phy_page == 0) {
-            panic("uvm_mmap: insufficient physical memory for mapping");
+            vm_unmap_mapped(curr_proc->mm->pgtbl, region_start, (uint64)page_count * PGSIZE, true);
+            uvm_mmap_release(region_start, page_count);
+            return false;
+        }
+    }
+    return true;
+}
+
+// 匿名页（堆和匿名映射）第一次访问: 读访问只读映射全局的全0页, 第一次写入时由uvm_cow_fault换成私有的页;
+// 写访问直接分配一个全0的页并映射为可读写; 内存不足时返回false
+static bool vm_anon_fault(pgtbl_t pgtbl, uint64 va_page, bool write)
+{
+    uint64 page;
+    int perm = PTE_R | PTE_U;
+    if (write) {
+        page = swap_alloc_user(PMEM_ZERO);
+        if (page == 0) {
+            return false;
         }
-        memset((void*)new_phy_page, 0, PGSIZE);
-        vm_mappages(curr_proc->pgtbl, curr_va, new_phy_page, PGSIZE, access_perm | PTE_U);
+        perm |= PTE_W;
+    } else {
+        page = pmem_zero_page();
+        pmem_get(page);
+    }
+    if (!vm_try_mappages(pgtbl, va_page, page, PGSIZE, perm)) {
+        pmem_put(page);
+        return false;
     }
+    myproc()->mstat.minor_faults++;
+    return true;
 }
 
-// 释放用户内存映射区域，归还到mmap空闲链表并合并相邻区域
+// 匿名映射区域的缺页处理: va在已占用的mmap区域中（不是空闲区域, 也不是文件映射）且所在页还没有映射时
+// 映射一个全0的页（见vm_anon_fault）; 其他情况或内存不足时返回false
+bool uvm_mmap_fault(pgtbl_t pgtbl, uint64 va, bool write)
+{
+    proc_t* curr_proc = myproc();
+    uint64 va_page = PG_ROUND_DOWN(va);
+    if (va_page < MMAP_BEGIN || va_page >= MMAP_END || mmap_file_mapped(curr_proc, va_page)) {
+        return false;
+    }
+    if (mmap_tree_lookup(curr_proc->mm->mmap, va_page) != NULL) {
+        return false;
+    }
+    pte_t* pte_entry = vm_getpte(pgtbl, va_page, false);
+    if (pte_entry != NULL && (*pte_entry & PTE_V)) {
+        return false;
+    }
+    return vm_anon_fault(pgtbl, va_page, write);
+}
+
+// 释放用户内存映射区域，归还到空闲mmap区域并合并相邻区域
 void uvm_munmap(uint64 region_start, uint32 page_count)
 {
     if(page_count == 0) return;
@@ -212,72 +450,57 @@ void uvm_munmap(uint64 region_start, uint32 page_count)
     proc_t* curr_proc = myproc();
     uint64 region_length = page_count * PGSIZE;
     
-    // 创建新的空闲内存映射区域
-    mmap_region_t* new_free_region = mmap_region_alloc();
-    new_free_region->begin = region_start;
-    new_free_region->npages = page_count;
-    new_free_region->next = NULL;
-    
-    // 按地址升序将新空闲区域插入到mmap链表中
-    if (curr_proc->mmap == NULL || region_start < curr_proc->mmap->begin) {
-        // 插入到链表头部
-        new_free_region->next = curr_proc->mmap;
-        curr_proc->mmap = new_free_region;
-    } else {
-        // 查找合适的插入位置
-        mmap_region_t* curr_region = curr_proc->mmap;
-        while (curr_region->next != NULL && curr_region->next->begin < region_start) {
-            curr_region = curr_region->next;
-        }
-        new_free_region->next = curr_region->next;
-        curr_region->next = new_free_region;
-    }
+    // 归还到空闲mmap区域
+    uvm_mmap_release(region_start, page_count);
     
-    // 尝试与后继空闲区域合并
-    if (new_free_region->next != NULL && 
-        new_free_region->begin + new_free_region->npages * PGSIZE == new_free_region->next->begin) {
-        mmap_region_t* successor_region = new_free_region->next;
-        new_free_region->next = successor_region->next;
-        vm_merge_mmap_regions(new_free_region, successor_region, true);
-    }
-    
-    // 尝试与前驱空闲区域合并
-    mmap_region_t* prev_region = NULL;
-    mmap_region_t* curr_region = curr_proc->mmap;
-    while (curr_region != new_free_region && curr_region != NULL) {
-        prev_region = curr_region;
-        curr_region = curr_region->next;
-    }
-    if (prev_region != NULL && 
-        prev_region->begin + prev_region->npages * PGSIZE == new_free_region->begin) {
-        prev_region->next = new_free_region->next;
-        vm_merge_mmap_regions(prev_region, new_free_region, true);
-    }
-    
-    // 解除虚拟地址映射并释放对应的物理页
-    vm_unmappages(curr_proc->pgtbl, region_start, region_length, true);
+    // 解除虚拟地址映射并释放对应的物理页（按需分配的区域中可能只有一部分页已经映射）
+    vm_unmap_mapped(curr_proc->mm->pgtbl, region_start, region_length, true);
+    asid_flush_range(curr_proc, region_start, region_length);
 }
 
 // 扩展用户堆空间，返回新的堆顶地址（不更新进程堆顶字段）
+// 新增的区域只是堆顶之下的地址范围：不分配物理页，每一页在第一次访问时由uvm_heap_fault分配（内容全0）
 uint64 uvm_heap_grow(pgtbl_t pgtbl, uint64 current_heap_top, uint32 grow_length)
 {
-    uint64 new_heap_top = current_heap_top + grow_length;
-    
-    // 计算需要新增映射的页面范围（按页对齐）
-    uint64 old_aligned_heap = PG_ROUND_UP(current_heap_top);
-    uint64 new_aligned_heap = PG_ROUND_UP(new_heap_top);
-    
-    // 为新增区域分配物理页并建立虚拟映射
-    for (uint64 curr_va = old_aligned_heap; curr_va < new_aligned_heap; curr_va += PGSIZE) {
-        uint64 new_phy_page = (uint64)pmem_alloc(false);
-        if (new_phy_page == 0) {
-            panic("uvm_heap_grow: insufficient physical memory for heap expansion");
-        }
-        memset((void*)new_phy_page, 0, PGSIZE);
-        vm_mappages(pgtbl, curr_va, new_phy_page, PGSIZE, PTE_R | PTE_W | PTE_U);
+    return current_heap_top + grow_length;
+}
+
+// 堆的缺页处理: va在堆顶之下且所在页还没有映射时映射一个全0的页（见vm_anon_fault）
+// va不在堆中、已经映射或内存不足时返回false
+bool uvm_heap_fault(pgtbl_t pgtbl, uint64 heap_top, uint64 va, bool write)
+{
+    uint64 va_page = PG_ROUND_DOWN(va);
+    if (va_page < PGSIZE || va_page >= PG_ROUND_UP(heap_top)) {
+        return false;
     }
-    
-    return new_heap_top;
+    pte_t* pte_entry = vm_getpte(pgtbl, va_page, false);
+    if (pte_entry != NULL && (*pte_entry & PTE_V)) {
+        return false;
+    }
+    return vm_anon_fault(pgtbl, va_page, write);
+}
+
+// 用户栈的缺页处理: va在栈区域[USTACK_BOTTOM, TRAPFRAME)中且所在页还没有映射时映射一个全0的页（见vm_anon_fault）,
+// 栈的范围*ustack_pages扩展到包含这一页 (fork和换出按这个范围查找栈的页, 范围内没有访问过的页仍然不映射)
+// 保护页和其他情况或内存不足时返回false
+bool uvm_stack_fault(pgtbl_t pgtbl, uint64* ustack_pages, uint64 va, bool write)
+{
+    uint64 va_page = PG_ROUND_DOWN(va);
+    if (va_page < USTACK_BOTTOM || va_page >= TRAPFRAME) {
+        return false;
+    }
+    pte_t* pte_entry = vm_getpte(pgtbl, va_page, false);
+    if (pte_entry != NULL && *pte_entry != 0) {
+        return false;   // 已映射或已换出 (由swap_fault处理)
+    }
+    if (!vm_anon_fault(pgtbl, va_page, write)) {
+        return false;
+    }
+    uint64 pages = (TRAPFRAME - va_page) / PGSIZE;
+    if (pages > *ustack_pages) {
+        *ustack_pages = pages;
+    }
+    return true;
 }
 
 // 收缩用户堆空间，返回新的堆顶地址（不更新进程堆顶字段）
@@ -289,98 +512,161 @@ uint64 uvm_heap_ungrow(pgtbl_t pgtbl, uint64 current_heap_top, uint32 shrink_len
     uint64 old_aligned_heap = PG_ROUND_UP(current_heap_top);
     uint64 new_aligned_heap = PG_ROUND_UP(new_heap_top);
     
-    // 释放不再使用的物理页并解除虚拟映射
+    // 释放不再使用的物理页并解除虚拟映射（从未访问过的页没有映射）
     if (new_aligned_heap < old_aligned_heap) {
-        uint64 free_page_count = (old_aligned_heap - new_aligned_heap) / PGSIZE;
-        vm_unmappages(pgtbl, new_aligned_heap, free_page_count * PGSIZE, true);
+        vm_unmap_mapped(pgtbl, new_aligned_heap, old_aligned_heap - new_aligned_heap, true);
+        asid_flush_range(myproc(), new_aligned_heap, old_aligned_heap - new_aligned_heap);
     }
     
     return new_heap_top;
 }
 
+// uvm_user_pte的缺页处理部分
+static pte_t* uvm_user_fault(pgtbl_t pgtbl, uint64 va, bool write)
+{
+    swap_fault(va);
+    pte_t* pte_entry = vm_getpte(pgtbl, va, false);
+    bool missing = (pte_entry == NULL || !(*pte_entry & PTE_V));
+    if (!missing && write && !(*pte_entry & (PTE_W | PTE_F))) {
+        if (!uvm_cow_fault(pgtbl, va)) {
+            return NULL;
+        }
+        pte_entry = vm_getpte(pgtbl, va, false);
+    }
+    if (missing && (exec_fault(va, write) || uvm_heap_fault(pgtbl, myproc()->mm->heap_top, va, write) ||
+                    uvm_stack_fault(pgtbl, &myproc()->mm->ustack_pages, va, write) || uvm_mmap_fault(pgtbl, va, write))) {
+        return vm_getpte(pgtbl, va, false);
+    }
+    if (missing || (write && (*pte_entry & PTE_F) && !(*pte_entry & PTE_W))) {
+        if (!mmap_file_fault(va, write)) {
+            return NULL;
+        }
+        pte_entry = vm_getpte(pgtbl, va, false);
+    }
+    return pte_entry;
+}
+
+// 查找用户地址va所在页的页表项, 程序映像、堆、用户栈、匿名映射和文件映射区域中尚未映射（或写访问时只读）的页先做缺页处理
+// 已换出的页先换入; 返回有效的页表项, 地址无效时返回NULL
+// 共享的地址空间在mm->lk下做缺页处理 (持有自旋锁时不获取: 调用者已经换入, 访问的页不需要睡眠)
+static pte_t* uvm_user_pte(pgtbl_t pgtbl, uint64 va, bool write)
+{
+    pte_t* pte_entry = vm_getpte(pgtbl, va, false);
+    if (pte_entry != NULL && (*pte_entry & PTE_V) && (!write || (*pte_entry & PTE_W))) {
+        return pte_entry;
+    }
+    push_off();
+    bool can_sleep = (mycpu()->noff == 1);
+    pop_off();
+    bool locked = can_sleep && mm_lock(myproc());
+    pte_entry = uvm_user_fault(pgtbl, va, write);
+    mm_unlock(myproc(), locked);
+    return pte_entry;
+}
+
+// 从用户地址va开始物理连续的一段: 第一页经过uvm_user_pte(可能缺页), 之后沿同一个叶子页表顺序比较相邻PTE,
+// 直到PTE无效、权限不够(写访问时没有PTE_W)、物理地址不连续或到达2MB边界; 大页直接延伸到大页末尾
+// 返回这一段的字节数(不超过len), *pa是va对应的物理地址; 地址无效时返回0
+static uint64 uvm_user_span(pgtbl_t pgtbl, uint64 va, uint64 len, bool write, uint64* pa)
+{
+    uint64 curr_va = PG_ROUND_DOWN(va);
+    pte_t* pte_entry = uvm_user_pte(pgtbl, curr_va, write);
+    if (pte_entry == NULL || !(*pte_entry & PTE_V)) {
+        return 0;
+    }
+    *pa = PTE_VA_TO_PA(*pte_entry, curr_va) + (va - curr_va);
+
+    uint64 chunk_end = (curr_va | (MEGAPAGE_SIZE - 1)) + 1;
+    uint64 span_end = curr_va + PGSIZE;
+    if (*pte_entry & PTE_M) {
+        span_end = chunk_end;
+    } else {
+        uint64 next_pa = PTE_TO_PA(*pte_entry) + PGSIZE;
+        pte_t need = PTE_V | (write ? PTE_W : 0);
+        for (pte_t* next = pte_entry + 1; span_end < chunk_end && span_end - va < len; next++) {
+            if ((*next & need) != need || PTE_TO_PA(*next) != next_pa) {
+                break;
+            }
+            span_end += PGSIZE;
+            next_pa += PGSIZE;
+        }
+    }
+    return (span_end - va < len) ? span_end - va : len;
+}
+
+// 用户地址va的物理地址 (与拷贝一样先做缺页处理), 地址无效时返回0
+uint64 uvm_user_pa(pgtbl_t pgtbl, uint64 va, bool write)
+{
+    uint64 pa;
+    if (va >= VA_MAX) {
+        return 0;
+    }
+    return uvm_user_span(pgtbl, va, 1, write, &pa) ? pa : 0;
+}
+
 // 用户态地址空间拷贝到内核态地址空间（支持非页对齐地址）
+// 每段物理连续的用户内存只查一次页表、做一次memmove
 void uvm_copyin(pgtbl_t pgtbl, uint64 kernel_dst, uint64 user_src, uint32 copy_length)
 {
-    uint64 copy_bytes, curr_va, curr_pa;
+    uint64 copy_bytes, curr_pa;
+    TSTAT_BEGIN(t);
     
     while (copy_length > 0) {
-        // 获取当前用户态地址所在页的起始地址
-        curr_va = PG_ROUND_DOWN(user_src);
-        
-        // 通过页表查找对应的物理地址
-        pte_t* pte_entry = vm_getpte(pgtbl, curr_va, false);
-        if (pte_entry == NULL || !(*pte_entry & PTE_V)) {
+        copy_bytes = uvm_user_span(pgtbl, user_src, copy_length, false, &curr_pa);
+        if (copy_bytes == 0) {
             panic("uvm_copyin: invalid or unallocated user page");
         }
-        curr_pa = PTE_TO_PA(*pte_entry);
         
-        // 计算当前页内可拷贝的最大字节数
-        copy_bytes = PGSIZE - (user_src - curr_va);
-        if (copy_bytes > copy_length) copy_bytes = copy_length;
-        
-        // 执行内存拷贝（物理地址偏移 -> 内核地址）
-        memmove((void*)kernel_dst, (void*)(curr_pa + (user_src - curr_va)), copy_bytes);
+        // 执行内存拷贝（物理地址 -> 内核地址）
+        memmove((void*)kernel_dst, (void*)curr_pa, copy_bytes);
         
         // 更新剩余拷贝参数
         copy_length -= copy_bytes;
         kernel_dst += copy_bytes;
-        user_src = curr_va + PGSIZE;
+        user_src += copy_bytes;
     }
+    TSTAT_END(t, TSTAT_COPYIN);
 }
 
 // 内核态地址空间拷贝到用户态地址空间（支持非页对齐地址）
+// 写时复制、只读文件页等情况由uvm_user_span逐段交给uvm_user_pte处理
 void uvm_copyout(pgtbl_t pgtbl, uint64 user_dst, uint64 kernel_src, uint32 copy_length)
 {
-    uint64 copy_bytes, curr_va, curr_pa;
+    uint64 copy_bytes, curr_pa;
+    TSTAT_BEGIN(t);
     
     while (copy_length > 0) {
-        // 获取当前用户态地址所在页的起始地址
-        curr_va = PG_ROUND_DOWN(user_dst);
-        
-        // 通过页表查找对应的物理地址
-        pte_t* pte_entry = vm_getpte(pgtbl, curr_va, false);
-        if (pte_entry == NULL || !(*pte_entry & PTE_V)) {
+        copy_bytes = uvm_user_span(pgtbl, user_dst, copy_length, true, &curr_pa);
+        if (copy_bytes == 0) {
             panic("uvm_copyout: invalid or unallocated user page");
         }
-        curr_pa = PTE_TO_PA(*pte_entry);
         
-        // 计算当前页内可拷贝的最大字节数
-        copy_bytes = PGSIZE - (user_dst - curr_va);
-        if (copy_bytes > copy_length) copy_bytes = copy_length;
-        
-        // 执行内存拷贝（内核地址 -> 物理地址偏移）
-        memmove((void*)(curr_pa + (user_dst - curr_va)), (void*)kernel_src, copy_bytes);
+        // 执行内存拷贝（内核地址 -> 物理地址）
+        memmove((void*)curr_pa, (void*)kernel_src, copy_bytes);
         
         // 更新剩余拷贝参数
         copy_length -= copy_bytes;
         kernel_src += copy_bytes;
-        user_dst = curr_va + PGSIZE;
+        user_dst += copy_bytes;
     }
+    TSTAT_END(t, TSTAT_COPYOUT);
 }
 
 // 用户态字符串拷贝到内核态（支持非页对齐，遇'\0'终止或达到最大长度）
 void uvm_copyin_str(pgtbl_t pgtbl, uint64 kernel_dst, uint64 user_src, uint32 max_copy_len)
 {
-    uint64 copy_bytes, curr_va, curr_pa;
+    uint64 copy_bytes, curr_pa;
     bool null_terminator_found = false;
     
     while (!null_terminator_found && max_copy_len > 0) {
-        // 获取当前用户态地址所在页的起始地址
-        curr_va = PG_ROUND_DOWN(user_src);
-        
-        // 通过页表查找对应的物理地址
-        pte_t* pte_entry = vm_getpte(pgtbl, curr_va, false);
-        if (pte_entry == NULL || !(*pte_entry & PTE_V)) {
+        copy_bytes = uvm_user_span(pgtbl, user_src, max_copy_len, false, &curr_pa);
+        if (copy_bytes == 0) {
             panic("uvm_copyin_str: invalid or unallocated user page");
         }
-        curr_pa = PTE_TO_PA(*pte_entry);
-        
-        // 计算当前页内可处理的最大字节数
-        copy_bytes = PGSIZE - (user_src - curr_va);
-        if (copy_bytes > max_copy_len) copy_bytes = max_copy_len;
         
         // 逐字节拷贝，遇到空终止符则停止
-        char* phy_addr_ptr = (char*)(curr_pa + (user_src - curr_va));
+        char* phy_addr_ptr = (char*)curr_pa;
+        user_src += copy_bytes;
         while (copy_bytes > 0) {
             if (*phy_addr_ptr == '\0') {
                 *(char*)kernel_dst = '\0';
@@ -393,8 +679,5 @@ void uvm_copyin_str(pgtbl_t pgtbl, uint64 kernel_dst, uint64 user_src, uint32 ma
             phy_addr_ptr++;
             kernel_dst++;
         }
-        
-        // 切换到下一个页面继续处理
-        user_src = curr_va + PGSIZE;
     }
-}
\ No newline at end of file
+}
@@ -4,10 +4,22 @@
 #include <string.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <sys/stat.h>
 
-// disk layout: [ super block | inode bitmap | inode blocks | data bitmap | data blocks ]
+// disk layout: [ super block | inode bitmap | inode blocks | data bitmap | data blocks | swap area ]
+// 日志区是数据区中连续的JOURNAL_BLOCKS个块 (紧接根目录的数据块), 记录在super block中
+// 交换区在文件系统之后 (不属于total_blocks), 起点按页对齐, 内容不需要初始化
 
 #define FS_MAGIC 0x12345678
+#define JOURNAL_MAGIC  0x4A4E4C31  // 与内核的fs/journal.h一致
+#define JOURNAL_BLOCKS 65          // 日志头 + 64个日志块
+#define FS_STATE_CLEAN 0x434C454E  // 与内核的fs/fs.h一致: 新建的映像是干净的, 挂载时不扫描位图
+#define FS_SUMMARY_INODE_GROUPS 8
+#define FS_SUMMARY_DATA_GROUPS  448
+#define SWAP_MAGIC     0x53574150  // 与内核的mem/swap.h一致
+#define SWAP_SIZE      (4 << 20)   // 默认的交换区大小 (4MB, 可用 -s 指定, 0表示没有交换区)
+#define BLOCKS_PER_PAGE (4096 / block_size) // 交换区的槽位是一页
+#define STRIPE_UNIT    (64 * 1024) // 条带单元, 与内核的VIRTIO_STRIPE_SECTORS一致 (-r)
 
 // super block
 typedef struct super_block {
@@ -22,11 +34,26 @@ typedef struct super_block {
     unsigned int inode_blocks;
     unsigned int data_blocks;
     unsigned int total_blocks;
+
+    unsigned int journal_magic;
+    unsigned int journal_start;
+    unsigned int journal_blocks;
+
+    unsigned int state;
+    unsigned int free_blocks;
+    unsigned int free_inodes;
+    unsigned short inode_group_free[FS_SUMMARY_INODE_GROUPS];
+    unsigned short data_group_free[FS_SUMMARY_DATA_GROUPS];
+
+    unsigned int swap_magic;
+    unsigned int swap_start;
+    unsigned int swap_blocks;
 } super_block_t;
 
 // inode 64 byte
 typedef struct inode_disk {
-    short type;
+    unsigned char type;
+    unsigned char flags;
     short major;
     short minor;
     short nlink;
@@ -46,16 +73,23 @@ typedef struct dirent {
 #define FT_FILE   2
 #define FT_DEVICE 3 
 
+// inode flags
+#define INODE_F_EXTENT 0x1  // addrs存放extent树 (与内核的fs/extent.h一致)
+#define EXTENT_ROOT_MAX 4   // addrs[0]: n | depth << 16, 之后每3个字是一个extent (lstart, pstart, len)
+
 // 常量定义 
-#define BLOCK_SIZE       1024 // 每个block占1024字节
-#define N_DATA_BLOCK     8192 // 1个block的bitmap管理的极限
-#define N_INODE_BLOCK    128  // 支持2048个文件
-#define N_BLOCK          (N_DATA_BLOCK + N_INODE_BLOCK + 3)  // 五个部分组合起来
-#define INODE_PER_BLOCK  (BLOCK_SIZE / sizeof(inode_disk_t)) // 每个block里的inode数量
-#define N_INODE          (N_INODE_BLOCK * INODE_PER_BLOCK)   // inode总数
+#define BLOCK_SIZE_DEFAULT 1024 // 默认的block大小 (可用 -b 指定, 必须与内核编译时的BLOCK_SIZE一致)
+#define BLOCK_SIZE_MAX   4096 // block不超过一页
+#define N_DATA_BLOCK     8192 // 默认的data block数 (可用 -n 指定)
+#define N_INODE_BLOCK    128  // 默认的inode block数, 支持2048个文件 (可用 -i 指定inode数)
+#define INODE_PER_BLOCK  (block_size / sizeof(inode_disk_t)) // 每个block里的inode数量
+#define N_INODE_MAX      65536 // inode号为16位 (目录项的inode_num)
+#define BITS_PER_BLOCK   (block_size * 8)                    // 1个bitmap block管理的bit数
+#define N_BITMAP_BLOCK(n) (((n) + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK) // 管理n个bit需要的bitmap block数
+#define N_BITMAP_MAX     1024 // 每个bitmap最多的block数 (与内核的BITMAP_GROUP_MAX一致)
 
 // 与inode管理的data block相关
-#define ENTRY_PER_BLOCK (BLOCK_SIZE / sizeof(unsigned int))  
+#define ENTRY_PER_BLOCK (block_size / sizeof(unsigned int))  
 #define N_ADDRS_1 10
 #define N_ADDRS_2 2
 #define N_ADDRS_3 1
@@ -65,7 +99,29 @@ typedef struct dirent {
 #define INODE_LOCATE_BLOCK(inum, sb)  ((inum) / INODE_PER_BLOCK + sb.inode_start)
 
 int fsfd;
-super_block_t sb;
+super_block_t sb;       // 本机字节序, 写入磁盘时转换
+
+unsigned int block_size = BLOCK_SIZE_DEFAULT;
+unsigned int n_data_block = N_DATA_BLOCK;
+unsigned int n_inode_block = N_INODE_BLOCK;
+unsigned int n_swap_block;
+
+// 解析大小: 数字后可跟K/M/G (字节), 没有后缀时单位是block; 格式错误返回-1
+unsigned long long size_parse(const char* s)
+{
+    char* end;
+    unsigned long long n = strtoull(s, &end, 0);
+    if(end == s)
+        return -1ull;
+    switch(*end) {
+        case '\0': return n * block_size;
+        case 'k': case 'K': n <<= 10; break;
+        case 'm': case 'M': n <<= 20; break;
+        case 'g': case 'G': n <<= 30; break;
+        default: return -1ull;
+    }
+    return end[1] == '\0' ? n : -1ull;
+}
 
 // 大小端转换
 unsigned short xshort(unsigned short x)
@@ -92,11 +148,12 @@ unsigned int xint(unsigned int x)
 // 向磁盘写一个block
 void block_write(unsigned int block_num, void* buf)
 {
-    if(lseek(fsfd, BLOCK_SIZE * block_num, 0) != BLOCK_SIZE * block_num) {
+    off_t off = (off_t)block_size * block_num;
+    if(lseek(fsfd, off, 0) != off) {
         perror("lsek");
         exit(1);
     }
-    if(write(fsfd, buf, BLOCK_SIZE) != BLOCK_SIZE) {
+    if(write(fsfd, buf, block_size) != block_size) {
         perror("write");
         exit(1);
     }
@@ -105,70 +162,101 @@ void block_write(unsigned int block_num, void* buf)
 // 从磁盘读一个block
 void block_read(unsigned int block_num, void* buf)
 {
-    if(lseek(fsfd, BLOCK_SIZE * block_num, 0) != BLOCK_SIZE * block_num) {
+    off_t off = (off_t)block_size * block_num;
+    if(lseek(fsfd, off, 0) != off) {
         perror("lsek");
         exit(1);
     }
-    if(read(fsfd, buf, BLOCK_SIZE) != BLOCK_SIZE) {
+    if(read(fsfd, buf, block_size) != block_size) {
         perror("read");
         exit(1);
     }
 }
 
-// 申请一个block(修改bitmap)
-unsigned int block_alloc()
+// 在从start开始的nblocks个bitmap block中申请连续的count个bit (nbits为有效bit数)
+// first-fit: 返回第一段足够长的空闲bit的全局序号; 每个bitmap block只读写一次
+static unsigned int bitmap_alloc_run(unsigned int start, unsigned int nblocks, unsigned int nbits,
+                                     unsigned int count, char* who)
 {
-    char buf[BLOCK_SIZE];
-    unsigned int byte, shift;
-    unsigned char bit_cmp;
-
-    block_read(sb.data_bitmap_start, buf);
-    for(byte = 0; byte < BLOCK_SIZE; byte++) {
-        bit_cmp = 1;
-        for(shift = 0; shift <= 7; shift++) {
-            if((bit_cmp & buf[byte]) == 0) {
-                buf[byte] |= bit_cmp;
-                goto find;
+    unsigned char buf[BLOCK_SIZE_MAX];
+    unsigned int run = 0, first = 0;
+
+    // 1. 找到一段连续的空闲bit
+    for(unsigned int blk = 0; blk < nblocks && run < count; blk++) {
+        block_read(start + blk, buf);
+        for(unsigned int i = 0; i < BITS_PER_BLOCK && run < count; i++) {
+            unsigned int num = blk * BITS_PER_BLOCK + i;
+            if(num >= nbits)
+                break;
+            if(buf[i / 8] & (1 << (i % 8))) {
+                run = 0;
+            } else if(run++ == 0) {
+                first = num;
             }
-            bit_cmp = bit_cmp << 1;
         }
     }
-    printf("block_alloc: no bit left\n");
-    while(1);
-find:
-    block_write(sb.data_bitmap_start, buf);
-    return byte * 8 + shift + sb.data_start;
+    if(run < count) {
+        printf("%s: no %u contiguous bits left\n", who, count);
+        exit(1);
+    }
+
+    // 2. 置位 (可能跨多个bitmap block)
+    for(unsigned int blk = first / BITS_PER_BLOCK; blk <= (first + count - 1) / BITS_PER_BLOCK; blk++) {
+        block_read(start + blk, buf);
+        for(unsigned int i = 0; i < BITS_PER_BLOCK; i++) {
+            unsigned int num = blk * BITS_PER_BLOCK + i;
+            if(num >= first && num < first + count)
+                buf[i / 8] |= 1 << (i % 8);
+        }
+        block_write(start + blk, buf);
+    }
+    return first;
 }
 
-// 申请一个inode (修改bitmap)
-unsigned short inode_alloc()
+// 统计位图中的空闲bit: 前nsummary个组的空闲数写入summary, 返回空闲总数
+static unsigned int bitmap_summary(unsigned int start, unsigned int nbits, unsigned short* summary, unsigned int nsummary)
 {
-    char buf[BLOCK_SIZE];
-    unsigned int byte, shift;
-    unsigned char bit_cmp;
-
-    block_read(sb.inode_bitmap_start, buf);
-    for(byte = 0; byte < BLOCK_SIZE; byte++) {
-        bit_cmp = 1;
-        for(shift = 0; shift <= 7; shift++) {
-            if((bit_cmp & buf[byte]) == 0) {
-                buf[byte] |= bit_cmp;
-                goto find;
-            }
-            bit_cmp = bit_cmp << 1;
+    unsigned char buf[BLOCK_SIZE_MAX];
+    unsigned int total = 0;
+
+    for(unsigned int g = 0; g * BITS_PER_BLOCK < nbits; g++) {
+        unsigned int free = 0;
+        block_read(start + g, buf);
+        for(unsigned int i = 0; i < BITS_PER_BLOCK && g * BITS_PER_BLOCK + i < nbits; i++) {
+            if((buf[i / 8] & (1 << (i % 8))) == 0)
+                free++;
         }
+        if(g < nsummary)
+            summary[g] = free;
+        total += free;
     }
-    printf("inode_alloc: no bit left\n");
-    while(1);
-find:
-    block_write(sb.inode_bitmap_start, buf);
-    return (unsigned short)(byte * 8 + shift);
+    return total;
+}
+
+// 申请连续的count个block(修改bitmap), 返回第一个block的编号
+unsigned int block_alloc_run(unsigned int count)
+{
+    return bitmap_alloc_run(sb.data_bitmap_start, sb.data_start - sb.data_bitmap_start,
+                            sb.data_blocks, count, "block_alloc") + sb.data_start;
+}
+
+// 申请一个block(修改bitmap)
+unsigned int block_alloc()
+{
+    return block_alloc_run(1);
+}
+
+// 申请一个inode (修改bitmap)
+unsigned short inode_alloc()
+{
+    return (unsigned short)bitmap_alloc_run(sb.inode_bitmap_start, sb.inode_start - sb.inode_bitmap_start,
+                                            sb.inode_blocks * INODE_PER_BLOCK, 1, "inode_alloc");
 }
 
 // 从磁盘读一个inode
 void inode_read(unsigned int inode_num, inode_disk_t* ip)
 {
-    char buf[BLOCK_SIZE];
+    char buf[BLOCK_SIZE_MAX];
     inode_disk_t* dip;
 
     unsigned int block_num = INODE_LOCATE_BLOCK(inode_num, sb);
@@ -180,7 +268,7 @@ void inode_read(unsigned int inode_num, inode_disk_t* ip)
 // 向磁盘写一个inode
 void inode_write(unsigned short inode_num, inode_disk_t* ip)
 {
-    char buf[BLOCK_SIZE];
+    char buf[BLOCK_SIZE_MAX];
     inode_disk_t* dip;
 
     unsigned int block_num = INODE_LOCATE_BLOCK(inode_num, sb);
@@ -193,7 +281,8 @@ void inode_write(unsigned short inode_num, inode_disk_t* ip)
 // 赋值并写一个inode
 void inode_create(inode_disk_t* inode, unsigned short inode_num, unsigned short type)
 {
-    inode->type = xshort(type);
+    inode->type = type;
+    inode->flags = 0;
     inode->major = xshort(0);
     inode->minor = xshort(0);
     inode->nlink = xshort(1);
@@ -204,7 +293,7 @@ void inode_create(inode_disk_t* inode, unsigned short inode_num, unsigned short
 }
 
 // dirent_create 专用
-char dir_buf[BLOCK_SIZE];
+char dir_buf[BLOCK_SIZE_MAX];
 
 // 添加一个目录项
 unsigned int dirent_create(unsigned int dir_block, unsigned int offset, char* name, unsigned short inode_num)
@@ -214,6 +303,10 @@ unsigned int dirent_create(unsigned int dir_block, unsigned int offset, char* na
     assert(strlen(name) < 30);
     strcpy(de.name, name);
 
+    if(offset + sizeof(de) > block_size) {
+        fprintf(stderr, "mkfs: too many files for the root directory block\n");
+        exit(1);
+    }
     block_read(dir_block, dir_buf);
     memmove(dir_buf + offset, &de, sizeof(de));
     block_write(dir_block, dir_buf);
@@ -221,69 +314,223 @@ unsigned int dirent_create(unsigned int dir_block, unsigned int offset, char* na
     return offset + sizeof(dirent_t);
 }
 
-// 辅助 inode_locate_block
-// 递归查询或创建block
-static unsigned int locate_block(unsigned int* entry, unsigned int bn, unsigned int size)
+// 辅助 inode_map_block
+// 递归查询或创建索引block, 叶子处填入block_num
+static void map_block(unsigned int* entry, unsigned int bn, unsigned int size, unsigned int block_num)
 {
+    if(size == 1) {
+        *entry = block_num;
+        return;
+    }
     if(*entry == 0)
-        *entry = block_alloc();
-
-    if(size == 1)
-        return *entry;    
+        *entry = block_alloc();    // 新的索引block在全新的映像中内容全0
 
-    unsigned int* next_entry;
     unsigned int next_size = size / ENTRY_PER_BLOCK;
-    unsigned int next_bn = bn % next_size;
-    unsigned int ret = 0;
-
-    char buf[BLOCK_SIZE];
+    char buf[BLOCK_SIZE_MAX];
     block_read(*entry, buf);
-    next_entry = (unsigned int*)(buf) + bn / next_size;
-    ret = locate_block(next_entry, next_bn, next_size);
-
-    return ret;
+    unsigned int* next_entry = (unsigned int*)(buf) + bn / next_size;
+    map_block(next_entry, bn % next_size, next_size, block_num);
+    block_write(*entry, buf);
 }
 
-// 确定inode里第bn块data block的block_num
-// 如果不存在第bn块data block则申请一个并返回它的block_num
+// 把inode的第bn块映射到block_num (inode->addrs为本机字节序)
 // 由于inode->addrs的结构, 这个过程比较复杂, 需要单独处理
-static unsigned int inode_locate_block(inode_disk_t* ip, unsigned int bn)
+static void inode_map_block(inode_disk_t* ip, unsigned int bn, unsigned int block_num)
 {
     // 在第一个区域
-    if(bn < N_ADDRS_1)
-        return locate_block(&ip->addrs[bn], bn, 1);
+    if(bn < N_ADDRS_1) {
+        map_block(&ip->addrs[bn], bn, 1, block_num);
+        return;
+    }
 
     // 在第二个区域
     bn -= N_ADDRS_1;
-    if(bn < N_ADDRS_2 * ENTRY_PER_BLOCK)
-    {
+    if(bn < N_ADDRS_2 * ENTRY_PER_BLOCK) {
         unsigned int size = ENTRY_PER_BLOCK;
-        unsigned int idx = bn / size;
-        unsigned int b = bn % size;
-        return locate_block(&ip->addrs[N_ADDRS_1 + idx], b, size);
+        map_block(&ip->addrs[N_ADDRS_1 + bn / size], bn % size, size, block_num);
+        return;
     }
 
     // 在第三个区域
     bn -= N_ADDRS_2 * ENTRY_PER_BLOCK;
-    if(bn < N_ADDRS_3 * ENTRY_PER_BLOCK * ENTRY_PER_BLOCK)
-    {
+    if(bn < N_ADDRS_3 * ENTRY_PER_BLOCK * ENTRY_PER_BLOCK) {
         unsigned int size = ENTRY_PER_BLOCK * ENTRY_PER_BLOCK;
-        unsigned int idx = bn / size;
-        unsigned int b = bn % size;
-        return locate_block(&ip->addrs[N_ADDRS_1 + N_ADDRS_2 + idx], b, size);
+        map_block(&ip->addrs[N_ADDRS_1 + N_ADDRS_2 + bn / size], bn % size, size, block_num);
+        return;
     }
 
-    printf("inode_locate_block: overflow\n");
-    while(1);
+    printf("inode_map_block: file too large\n");
+    exit(1);
+}
+
+// 把文件fd的内容(size字节)顺序写到从block_num开始的连续block中
+// 按大块读写, 最后一个block的剩余部分在映像中本来就是0
+static void file_copy(int fd, char* name, unsigned int block_num, unsigned int size)
+{
+    static char chunk[64 * 1024];
+    off_t off = (off_t)block_num * block_size;
 
-    return 0;
+    while(size > 0) {
+        int n = read(fd, chunk, size < sizeof(chunk) ? size : sizeof(chunk));
+        if(n <= 0) {
+            fprintf(stderr, "mkfs: short read on %s\n", name);
+            exit(1);
+        }
+        if(pwrite(fsfd, chunk, n, off) != n) {
+            perror("pwrite");
+            exit(1);
+        }
+        off += n;
+        size -= n;
+    }
+}
+
+// 把映像path按STRIPE_UNIT轮流拆到n个成员path.0 ~ path.(n-1)中, 成员大小相同 (不足的部分补0)
+// 第k个单元在成员k % n的(k / n) * STRIPE_UNIT处, 与内核virtio驱动的条带卷一致
+static void stripe_split(char* path, int n)
+{
+    static char unit[STRIPE_UNIT];
+    char name[256];
+    int fd[8];
+    struct stat st;
+
+    if(fstat(fsfd, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+    unsigned long long units = (st.st_size + STRIPE_UNIT - 1) / STRIPE_UNIT;
+    unsigned long long member = (units + n - 1) / n * STRIPE_UNIT;
+    for(int i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "%s.%d", path, i);
+        fd[i] = open(name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if(fd[i] < 0 || ftruncate(fd[i], member) < 0) {
+            perror(name);
+            exit(1);
+        }
+    }
+    for(unsigned long long k = 0; k < units; k++) {
+        memset(unit, 0, sizeof(unit));
+        if(pread(fsfd, unit, STRIPE_UNIT, k * STRIPE_UNIT) < 0 ||
+           pwrite(fd[k % n], unit, STRIPE_UNIT, (k / n) * STRIPE_UNIT) != STRIPE_UNIT) {
+            perror("stripe");
+            exit(1);
+        }
+    }
+    for(int i = 0; i < n; i++)
+        close(fd[i]);
 }
 
 // main函数
 int main(int argc, char* argv[])
 {
-    assert(BLOCK_SIZE % sizeof(inode_disk_t) == 0);
-    
+    // 用法: mkfs fs.img [-b block_size] [-S size] [-n data_blocks] [-i inodes] [-s swap_size] [-e] ./user/_xxx ...
+    // -b: block大小 (1024 / 2048 / 4096), 必须与内核编译时的BLOCK_SIZE一致 (写入超级块, 挂载时校验)
+    // -S: 整个映像的大小 (含交换区, 如 64M、2G), data block数由减去其他区域后的剩余推出, 与 -n 互斥
+    // -i: inode数, 向上取整到整个inode block
+    // -s: 交换区大小, 向下取整到整页
+    // -S和-s的数字后可跟K/M/G (字节), 没有后缀时单位是block
+    // -I: 写入的文件使用间接块映射 (默认每个文件的数据块连续分配, 用一个extent映射; -e 为兼容保留)
+    // -r: 另外把映像拆成n个条带成员fs.img.0 ~ fs.img.(n-1), 供多磁盘启动 (见kernel/dev/virtio.c)
+    if(argc < 2) {
+        fprintf(stderr, "usage: mkfs fs.img [-b block_size] [-S size] [-n data_blocks] [-i inodes] "
+                        "[-s swap_size] [-I] [-r disks] files...\n");
+        exit(1);
+    }
+    int first_file = 2;
+    int use_extent = 1;
+    char* size_arg = 0;
+    char* swap_arg = 0;
+    unsigned long n_inode = 0;
+    int n_stripe = 0;
+    while(first_file < argc && argv[first_file][0] == '-') {
+        if(strcmp(argv[first_file], "-n") == 0 && first_file + 1 < argc) {
+            n_data_block = strtoul(argv[first_file + 1], 0, 0);
+            first_file += 2;
+        } else if(strcmp(argv[first_file], "-S") == 0 && first_file + 1 < argc) {
+            size_arg = argv[first_file + 1];
+            first_file += 2;
+        } else if(strcmp(argv[first_file], "-i") == 0 && first_file + 1 < argc) {
+            n_inode = strtoul(argv[first_file + 1], 0, 0);
+            if(n_inode == 0 || n_inode > N_INODE_MAX) {
+                fprintf(stderr, "mkfs: inode count %lu out of range (1 ~ %d)\n", n_inode, N_INODE_MAX);
+                exit(1);
+            }
+            first_file += 2;
+        } else if(strcmp(argv[first_file], "-b") == 0 && first_file + 1 < argc) {
+            block_size = strtoul(argv[first_file + 1], 0, 0);
+            if(block_size != 1024 && block_size != 2048 && block_size != 4096) {
+                fprintf(stderr, "mkfs: block size must be 1024, 2048 or 4096\n");
+                exit(1);
+            }
+            first_file += 2;
+        } else if(strcmp(argv[first_file], "-s") == 0 && first_file + 1 < argc) {
+            swap_arg = argv[first_file + 1];
+            first_file += 2;
+        } else if(strcmp(argv[first_file], "-r") == 0 && first_file + 1 < argc) {
+            n_stripe = strtoul(argv[first_file + 1], 0, 0);
+            if(n_stripe < 1 || n_stripe > 8) {
+                fprintf(stderr, "mkfs: stripe member count must be 1 ~ 8\n");
+                exit(1);
+            }
+            first_file += 2;
+        } else if(strcmp(argv[first_file], "-e") == 0) {
+            use_extent = 1;
+            first_file++;
+        } else if(strcmp(argv[first_file], "-I") == 0) {
+            use_extent = 0;
+            first_file++;
+        } else {
+            fprintf(stderr, "mkfs: unknown option %s\n", argv[first_file]);
+            exit(1);
+        }
+    }
+    assert(block_size % sizeof(inode_disk_t) == 0);
+
+    // 以下的换算都依赖block大小
+    unsigned long long image_size = 0;
+    if(size_arg) {
+        image_size = size_parse(size_arg);
+        if(image_size == 0 || image_size == -1ull) {
+            fprintf(stderr, "mkfs: bad size %s\n", size_arg);
+            exit(1);
+        }
+    }
+    unsigned long long swap_size = SWAP_SIZE;
+    if(swap_arg) {
+        swap_size = size_parse(swap_arg);
+        if(swap_size == -1ull) {
+            fprintf(stderr, "mkfs: bad swap size %s\n", swap_arg);
+            exit(1);
+        }
+    }
+    n_swap_block = swap_size / block_size / BLOCKS_PER_PAGE * BLOCKS_PER_PAGE;
+    if(n_inode > 0)
+        n_inode_block = (n_inode + INODE_PER_BLOCK - 1) / INODE_PER_BLOCK;
+    else
+        n_inode_block = N_INODE_BLOCK * BLOCK_SIZE_DEFAULT / block_size; // 默认2048个inode, 与block大小无关
+
+    // 由映像大小推出data block数: 超级块、inode位图、inode区和交换区之外的部分由data位图和data区分享
+    unsigned int n_ibitmap = N_BITMAP_BLOCK(n_inode_block * INODE_PER_BLOCK);
+    if(image_size > 0) {
+        unsigned long long blocks = image_size / block_size;
+        unsigned long long meta = 1 + n_ibitmap + n_inode_block;
+        // 交换区起点按页对齐, 最多浪费BLOCKS_PER_PAGE - 1个block
+        unsigned long long swap = n_swap_block > 0 ? n_swap_block + BLOCKS_PER_PAGE - 1 : 0;
+        if(blocks <= meta + swap + 1) {
+            fprintf(stderr, "mkfs: size %llu too small for the metadata\n", image_size);
+            exit(1);
+        }
+        unsigned long long avail = blocks - meta - swap;
+        unsigned long long n = avail - N_BITMAP_BLOCK(avail);
+        while(n + N_BITMAP_BLOCK(n) > avail)
+            n--;
+        n_data_block = n > 0xffffffffull ? 0xffffffffu : (unsigned int)n;
+    }
+    if(n_data_block <= JOURNAL_BLOCKS || N_BITMAP_BLOCK(n_data_block) > N_BITMAP_MAX) {
+        fprintf(stderr, "mkfs: data block count %u out of range\n", n_data_block);
+        exit(1);
+    }
+
     // 创建磁盘文件
     fsfd = open(argv[1], O_RDWR | O_CREAT | O_TRUNC, 0666);
     if(fsfd < 0) {
@@ -291,28 +538,37 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
-    // super block 填充
+    // super block 填充 (inode bitmap和data bitmap按需要占用多个block)
+    unsigned int n_dbitmap = N_BITMAP_BLOCK(n_data_block);
     sb.magic = FS_MAGIC;
-    sb.block_size = xint(BLOCK_SIZE);
-    sb.inode_blocks = xint(N_INODE_BLOCK);
-    sb.data_blocks = xint(N_DATA_BLOCK);
-    sb.total_blocks = xint(N_BLOCK);
-    sb.inode_bitmap_start = xint(1);
-    sb.inode_start = xint(1 + 1);
-    sb.data_bitmap_start = xint(1 + 1 + N_INODE_BLOCK);
-    sb.data_start = xint(1 + 1 + N_INODE_BLOCK + 1);
+    sb.block_size = block_size;
+    sb.inode_blocks = n_inode_block;
+    sb.data_blocks = n_data_block;
+    sb.inode_bitmap_start = 1;
+    sb.inode_start = sb.inode_bitmap_start + n_ibitmap;
+    sb.data_bitmap_start = sb.inode_start + n_inode_block;
+    sb.data_start = sb.data_bitmap_start + n_dbitmap;
+    sb.total_blocks = sb.data_start + n_data_block;
+    if(n_swap_block > 0) {
+        sb.swap_magic = SWAP_MAGIC;
+        sb.swap_start = (sb.total_blocks + BLOCKS_PER_PAGE - 1) / BLOCKS_PER_PAGE * BLOCKS_PER_PAGE;
+        sb.swap_blocks = n_swap_block;
+    }
 
     // 缓冲区准备
-    char buf[BLOCK_SIZE];
+    char buf[BLOCK_SIZE_MAX];
     memset(buf, 0, sizeof(buf));
 
-    // 一个全0的磁盘映像
-    for(int i = 0; i < N_BLOCK; i++)
-        block_write(i, buf);
-
-    // 填写 super block
-    memmove(buf, &sb, sizeof(sb));
-    block_write(0, buf);
+    // 一个全0的磁盘映像 (ftruncate扩展出的部分读出来都是0, 不必逐块写), 包括之后的交换区
+    // 指定了 -S 时映像就是这么大 (末尾不足一页的部分不使用)
+    unsigned int image_blocks = (n_swap_block > 0) ? sb.swap_start + sb.swap_blocks : sb.total_blocks;
+    off_t image_bytes = (off_t)image_blocks * block_size;
+    if((off_t)image_size > image_bytes)
+        image_bytes = image_size;
+    if(ftruncate(fsfd, image_bytes) < 0) {
+        perror("ftruncate");
+        exit(1);
+    }
 
     // 创建根目录
     inode_disk_t rooti;
@@ -324,6 +580,13 @@ int main(int argc, char* argv[])
     }
     inode_create(&rooti, root_inum, FT_DIR);
 
+    // 日志区: 全新的映像上first-fit分配是连续的, 内容全0即日志为空
+    sb.journal_start = block_alloc();
+    for(unsigned int i = 1; i < JOURNAL_BLOCKS; i++)
+        assert(block_alloc() == sb.journal_start + i);
+    sb.journal_magic = JOURNAL_MAGIC;
+    sb.journal_blocks = JOURNAL_BLOCKS;
+
     // 添加 . 和 ..
     unsigned int offset = 0;
     offset = dirent_create(rooti_block, offset, ".\0", root_inum);
@@ -331,13 +594,13 @@ int main(int argc, char* argv[])
 
     // 写入user目录里的可执行文件
     // ./user/_xxx
+    // 每个文件的数据块一次连续分配 (按需调页的exec可以大块顺序读入), 间接映射时索引块放在数据块之后
     char* shortname;
-    int fd, read_len;
+    int fd;
     inode_disk_t inode;
     unsigned short inum;
-    unsigned int bn = 0, block_num = 0;
 
-    for(int i = 2; i < argc; i++)
+    for(int i = first_file; i < argc; i++)
     {
         // 确定shortname
         shortname = argv[i] + 7;
@@ -348,6 +611,8 @@ int main(int argc, char* argv[])
         // 申请新的inode + 创建目录项
         inum = inode_alloc();
         inode_create(&inode, inum, FT_FILE);
+        if(use_extent)
+            inode.flags = INODE_F_EXTENT;
         offset = dirent_create(rooti_block, offset, shortname, inum);
         
         // 打开文件
@@ -357,14 +622,27 @@ int main(int argc, char* argv[])
             exit(1);
         }
         
-        // 获取文件内容并写入磁盘
-        while(1) {
-            read_len = read(fd, buf, BLOCK_SIZE);
-            block_num = inode_locate_block(&inode, bn++);
-            block_write(block_num, buf);
-            inode.size += read_len;
-            if(read_len < BLOCK_SIZE) break;
+        // 分配连续的数据块, 写入文件内容, 建立映射
+        struct stat st;
+        if(fstat(fd, &st) < 0) {
+            perror(argv[i]);
+            exit(1);
         }
+        unsigned int nblocks = (st.st_size + block_size - 1) / block_size;
+        if(nblocks > 0) {
+            unsigned int block_num = block_alloc_run(nblocks);
+            file_copy(fd, argv[i], block_num, st.st_size);
+            if(use_extent) {
+                inode.addrs[0] = 1;           // 根节点中一个extent (depth = 0)
+                inode.addrs[1] = 0;
+                inode.addrs[2] = block_num;
+                inode.addrs[3] = nblocks;
+            } else {
+                for(unsigned int bn = 0; bn < nblocks; bn++)
+                    inode_map_block(&inode, bn, block_num + bn);
+            }
+        }
+        inode.size = st.st_size;
         
         // 关闭文件
         close(fd);
@@ -378,8 +656,45 @@ int main(int argc, char* argv[])
 
     // 更新rooti
     rooti.addrs[0] = xint(rooti_block);
-    rooti.size = xint(sizeof(dirent_t) * argc);
+    rooti.size = xint(sizeof(dirent_t) * (argc - first_file + 2));
     inode_write(root_inum, &rooti);
 
+    // 填写 super block (最后写入: 空闲计数要等所有分配完成)
+    sb.state = FS_STATE_CLEAN;
+    sb.free_inodes = bitmap_summary(sb.inode_bitmap_start, sb.inode_blocks * INODE_PER_BLOCK,
+                                    sb.inode_group_free, FS_SUMMARY_INODE_GROUPS);
+    sb.free_blocks = bitmap_summary(sb.data_bitmap_start, sb.data_blocks,
+                                    sb.data_group_free, FS_SUMMARY_DATA_GROUPS);
+    super_block_t dsb = sb;
+    dsb.magic = xint(sb.magic);
+    dsb.block_size = xint(sb.block_size);
+    dsb.inode_blocks = xint(sb.inode_blocks);
+    dsb.data_blocks = xint(sb.data_blocks);
+    dsb.total_blocks = xint(sb.total_blocks);
+    dsb.inode_bitmap_start = xint(sb.inode_bitmap_start);
+    dsb.inode_start = xint(sb.inode_start);
+    dsb.data_bitmap_start = xint(sb.data_bitmap_start);
+    dsb.data_start = xint(sb.data_start);
+    dsb.journal_magic = xint(sb.journal_magic);
+    dsb.journal_start = xint(sb.journal_start);
+    dsb.journal_blocks = xint(sb.journal_blocks);
+    dsb.state = xint(sb.state);
+    dsb.free_blocks = xint(sb.free_blocks);
+    dsb.free_inodes = xint(sb.free_inodes);
+    for(int g = 0; g < FS_SUMMARY_INODE_GROUPS; g++)
+        dsb.inode_group_free[g] = xshort(sb.inode_group_free[g]);
+    for(int g = 0; g < FS_SUMMARY_DATA_GROUPS; g++)
+        dsb.data_group_free[g] = xshort(sb.data_group_free[g]);
+    dsb.swap_magic = xint(sb.swap_magic);
+    dsb.swap_start = xint(sb.swap_start);
+    dsb.swap_blocks = xint(sb.swap_blocks);
+    assert(sizeof(dsb) <= block_size);
+    memset(buf, 0, sizeof(buf));
+    memmove(buf, &dsb, sizeof(dsb));
+    block_write(0, buf);
+
+    if(n_stripe > 0)
+        stripe_split(argv[1], n_stripe);
+
     return 0;
 }
\ No newline at end of file
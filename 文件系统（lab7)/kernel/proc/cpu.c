@@ -1,14 +1,40 @@
 #include "proc/cpu.h"
+#include "dev/fdt.h"
+#include "lib/print.h"
+#include "lib/klog.h"
+#include "proc/vdata.h"
 #include "riscv.h"
 
 static cpu_t cpus[NCPU];
 
+int ncpu = 1;
+
+void cpu_discover(uint64 dtb)
+{
+    int n = fdt_count_harts(dtb);
+    if (n == 0) {
+        printf("cpu: no device tree, using hart 0 only\n");
+        n = 1;
+    } else if (n > NCPU) {
+        printf("cpu: %d harts, only %d supported (make NCPU=n)\n", n, NCPU);
+        n = NCPU;
+    }
+    ncpu = n;
+    vdata_set_ncpu(n);
+    klog("cpu: %d harts\n", ncpu);
+}
+
 cpu_t* mycpu(void)
 {
     int id = r_tp();
     return &cpus[id];
 }
 
+cpu_t* cpu_of(int id)
+{
+    return &cpus[id];
+}
+
 int mycpuid(void) 
 {
     return r_tp();
@@ -0,0 +1,401 @@
+#include "lib/print.h"
+#include "lib/str.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "mem/mmap.h"
+#include "mem/asid.h"
+#include "mem/swap.h"
+#include "fs/inode.h"
+#include "fs/dir.h"
+#include "fs/pcache.h"
+#include "fs/journal.h"
+#include "proc/cpu.h"
+#include "proc/exec.h"
+#include "memlayout.h"
+#include "riscv.h"
+
+/*
+    exec与程序映像的按需调页 (见proc/exec.h)
+*/
+
+// 释放inode引用 (可能是最后一个引用, 需要在日志操作中)
+static void exec_put_inode(inode_t* ip)
+{
+    journal_begin();
+    inode_free(ip);
+    journal_end();
+}
+
+// 解析ELF头和程序头, 把PT_LOAD段记录到img中 (调用者持有ip睡眠锁)
+// 段必须在[PGSIZE, MMAP_BEGIN)内、文件偏移与虚拟地址在页内对齐、彼此不共享页
+// 成功返回0 不是合法的可执行文件返回-1
+static int exec_load(inode_t* ip, exec_image_t* img, uint64* entry)
+{
+    elf_header_t elf;
+    prog_header_t ph;
+
+    if (ip->type != FT_FILE) {
+        return -1;
+    }
+    if (inode_read_data(ip, 0, sizeof(elf), &elf, false) != sizeof(elf) || elf.magic != ELF_MAGIC) {
+        return -1;
+    }
+
+    img->nseg = 0;
+    img->end = PGSIZE;
+    for (uint32 i = 0; i < elf.phnum; i++) {
+        uint64 off = elf.phoff + (uint64)i * sizeof(ph);
+        if (off + sizeof(ph) > ip->size ||
+            inode_read_data(ip, off, sizeof(ph), &ph, false) != sizeof(ph)) {
+            return -1;
+        }
+        if (ph.type != ELF_PROG_LOAD || ph.memsz == 0) {
+            continue;
+        }
+
+        // 1. 段的范围和对齐
+        if (ph.memsz < ph.filesz || ph.vaddr < PGSIZE || ph.vaddr + ph.memsz < ph.vaddr ||
+            ph.vaddr + ph.memsz > MMAP_BEGIN || ph.off + ph.filesz > ip->size ||
+            ph.off % PGSIZE != ph.vaddr % PGSIZE || img->nseg == EXEC_SEG_MAX) {
+            return -1;
+        }
+
+        // 2. 与已有的段不共享页 (每一页只属于一个段, 缺页时不需要合并权限)
+        uint64 begin = PG_ROUND_DOWN(ph.vaddr), end = PG_ROUND_UP(ph.vaddr + ph.memsz);
+        for (uint32 j = 0; j < img->nseg; j++) {
+            exec_seg_t* s = &img->seg[j];
+            if (begin < PG_ROUND_UP(s->va + s->memsz) && PG_ROUND_DOWN(s->va) < end) {
+                return -1;
+            }
+        }
+
+        exec_seg_t* seg = &img->seg[img->nseg++];
+        seg->va = ph.vaddr;
+        seg->memsz = ph.memsz;
+        seg->off = ph.off;
+        seg->filesz = ph.filesz;
+        seg->perm = PTE_U | PTE_R;
+        if (ph.flags & ELF_PROG_FLAG_WRITE) seg->perm |= PTE_W;
+        if (ph.flags & ELF_PROG_FLAG_EXEC)  seg->perm |= PTE_X;
+        if (end > img->end) {
+            img->end = end;
+        }
+    }
+
+    if (img->nseg == 0) {
+        return -1;
+    }
+    *entry = elf.entry;
+    return 0;
+}
+
+// 在新的用户栈页中放入参数字符串和argv数组
+// stack_page: 映射在ustack_va的物理页
+// 成功返回argc (*sp为新的栈顶, 也是argv数组的用户地址) 参数过多返回-1
+static int exec_push_args(pgtbl_t old_pgtbl, uint64 uargv, uint64 stack_page, uint64 ustack_va, uint64* sp)
+{
+    uint64 ustack[EXEC_MAXARG + 1];
+    char arg[EXEC_ARG_LEN];
+    uint64 top = ustack_va + PGSIZE;
+    int argc = 0;
+
+    // 1. 参数字符串从栈顶向下存放 (uargv == 0: 没有参数)
+    for (; uargv != 0; argc++) {
+        uint64 uarg;
+        uvm_copyin(old_pgtbl, (uint64)&uarg, uargv + (uint64)argc * sizeof(uint64), sizeof(uint64));
+        if (uarg == 0) {
+            break;
+        }
+        if (argc == EXEC_MAXARG) {
+            return -1;
+        }
+        uvm_copyin_str(old_pgtbl, (uint64)arg, uarg, EXEC_ARG_LEN);
+        arg[EXEC_ARG_LEN - 1] = '\0';
+        uint32 len = strlen(arg) + 1;
+        top = (top - len) & ~0xFul;
+        memmove((void*)(stack_page + (top - ustack_va)), arg, len);
+        ustack[argc] = top;
+    }
+    ustack[argc] = 0;
+
+    // 2. argv数组 (16字节对齐)
+    uint64 size = (uint64)(argc + 1) * sizeof(uint64);
+    top = (top - size) & ~0xFul;
+    memmove((void*)(stack_page + (top - ustack_va)), ustack, size);
+
+    *sp = top;
+    return argc;
+}
+
+// 解析path指向的ELF文件, 建立新的页表: trampoline + trapframe(tf) + 用户栈(参数来自当前进程的uargv)
+// 段内的页不映射, 在第一次访问时由exec_fault处理
+// 成功返回argc (*pgtbl, *img(持有可执行文件的引用), *entry, *sp有效) 失败返回-1
+static int exec_prepare(char* path, uint64 uargv, uint64 tf, pgtbl_t* pgtbl, exec_image_t* img, uint64* entry, uint64* sp)
+{
+    // 1. 找到可执行文件, 解析程序头
+    inode_t* ip = path_to_inode(path);
+    if (ip == NULL) {
+        return -1;
+    }
+    inode_lock_shared(ip);
+    int ret = exec_load(ip, img, entry);
+    inode_unlock_shared(ip);
+    if (ret < 0) {
+        exec_put_inode(ip);
+        return -1;
+    }
+    img->ip = ip;
+
+    // 2. 新页表和用户栈
+    *pgtbl = proc_pgtbl_init(tf);
+    uint64 ustack_va = TRAPFRAME - PGSIZE;
+    uint64 stack_page = (uint64)pmem_alloc(false);
+    if (stack_page == 0) {
+        uvm_destroy_pgtbl(*pgtbl);
+        exec_put_inode(ip);
+        return -1;
+    }
+    memset((void*)stack_page, 0, PGSIZE);
+    vm_mappages(*pgtbl, ustack_va, stack_page, PGSIZE, PTE_R | PTE_W | PTE_U);
+    int argc = exec_push_args(myproc()->mm->pgtbl, uargv, stack_page, ustack_va, sp);
+    if (argc < 0) {
+        uvm_destroy_pgtbl(*pgtbl);
+        exec_put_inode(ip);
+        return -1;
+    }
+    return argc;
+}
+
+// 把exec_prepare建立的地址空间交给p (p原来的页表已销毁或交给调用者处理)
+static void exec_install(proc_t* p, pgtbl_t pgtbl, exec_image_t* img, uint64 entry, uint64 sp)
+{
+    p->mm->pgtbl = pgtbl;
+    p->mm->image = *img;
+    p->mm->heap_top = img->end;
+    p->mm->ustack_pages = 1;
+
+    // 空闲mmap区域为整个mmap区域
+    mmap_tree_destroy(p->mm->mmap);
+    p->mm->mmap = mmap_tree_init();
+
+    p->tf->epc = entry;
+    p->tf->sp = sp;
+    p->tf->a1 = sp;
+}
+
+/*
+    执行新程序: 用path指向的ELF文件建立的新页表替换当前进程的地址空间
+    uargv: 用户地址空间中以NULL结尾的参数指针数组 (0表示没有参数)
+    成功返回argc (成为用户态的a0, a1是argv), 失败返回-1且原地址空间不变
+*/
+int proc_exec(char* path, uint64 uargv)
+{
+    proc_t* p = myproc();
+    exec_image_t img;
+    pgtbl_t pgtbl;
+    uint64 entry, sp;
+
+    // 地址空间被其他线程共享: 不能替换
+    if (p->mm->ref > 1) {
+        return -1;
+    }
+
+    int argc = exec_prepare(path, uargv, (uint64)p->tf, &pgtbl, &img, &entry, &sp);
+    if (argc < 0) {
+        return -1;
+    }
+
+    // 不会再失败: 释放原地址空间 (文件映射写回, 映像中的页缓存页归还, 等待队列的异步请求完成)
+    // (其他线程都已退出的线程: trapframe原来在mmap区域中, 新页表把它映射在TRAPFRAME)
+    uring_drain(p);
+    mmap_file_exit(p);
+    exec_release(p);
+    shm_exit(p);
+    if (p->tf_va != TRAPFRAME) {
+        vm_unmappages(p->mm->pgtbl, p->tf_va, PGSIZE, false);
+        p->tf_va = TRAPFRAME;
+    }
+    uvm_destroy_pgtbl(p->mm->pgtbl);
+    exec_install(p, pgtbl, &img, entry, sp);
+    fpu_reset(p);
+
+    // 同一个ASID下换了页表: 丢弃所有hart上原地址空间的TLB表项
+    asid_flush(p);
+
+    printf("[Process Operation] Process (pid=%d) executing %s (entry=%p, %d segments, argc=%d)\n",
+           p->pid, path, entry, img.nseg, argc);
+    return argc;
+}
+
+/*
+    创建执行path的子进程: 直接从可执行文件建立子进程的地址空间, 不复制当前进程的页表
+    子进程继承打开的文件, 其余与fork + exec相同
+    成功返回子进程pid, 失败返回-1
+*/
+int proc_spawn(char* path, uint64 uargv)
+{
+    proc_t* p = myproc();
+    exec_image_t img;
+    pgtbl_t pgtbl;
+    uint64 entry, sp;
+
+    // 1. 读文件可能睡眠: 在申请进程 (持有np->lk) 之前建立地址空间, trapframe先映射当前进程的页
+    int argc = exec_prepare(path, uargv, (uint64)p->tf, &pgtbl, &img, &entry, &sp);
+    if (argc < 0) {
+        return -1;
+    }
+
+    proc_t* np = proc_alloc();
+    if (np == NULL || proc_fd_copy(p, np) < 0) {
+        if (np != NULL) {
+            proc_free(np);
+            spinlock_release(&np->lk);
+        }
+        uvm_destroy_pgtbl(pgtbl);
+        exec_put_inode(img.ip);
+        return -1;
+    }
+
+    // 2. 换成子进程的trapframe, 替换proc_alloc建立的空页表
+    vm_unmappages(pgtbl, TRAPFRAME, PGSIZE, false);
+    vm_mappages(pgtbl, TRAPFRAME, (uint64)np->tf, PGSIZE, PTE_R | PTE_W);
+    uvm_destroy_pgtbl(np->mm->pgtbl);
+    memset(np->tf, 0, sizeof(trapframe_t));
+    exec_install(np, pgtbl, &img, entry, sp);
+    np->tf->a0 = argc;
+    proc_tf_init(np);
+
+    proc_set_parent(np, p);
+    np->prio = np->base_prio = p->base_prio;
+    np->cpu_mask = p->cpu_mask;
+    np->sysrec = p->sysrec;
+    int pid = np->pid;
+    proc_ready(np);
+    spinlock_release(&np->lk);
+
+    printf("[Process Operation] Process (pid=%d) spawned child (pid=%d) executing %s (entry=%p, argc=%d)\n",
+           p->pid, pid, path, entry, argc);
+    return pid;
+}
+
+// 包含va所在页的段, 没有返回NULL
+static exec_seg_t* exec_seg_lookup(exec_image_t* img, uint64 va_page)
+{
+    for (uint32 i = 0; i < img->nseg; i++) {
+        exec_seg_t* seg = &img->seg[i];
+        if (va_page >= PG_ROUND_DOWN(seg->va) && va_page < PG_ROUND_UP(seg->va + seg->memsz)) {
+            return seg;
+        }
+    }
+    return NULL;
+}
+
+// 程序映像的缺页处理
+// 1. 只读段中不含bss的页: 映射页缓存中的页 (PTE_F, ref++), 同时映射窗口中已缓存的相邻页 (mmap_fault_around)
+// 2. 其他页: 私有页 = 文件中属于这一页的部分 + 0
+// va不属于映像、写只读段、已映射或内存不足时返回false
+bool exec_fault(uint64 va, bool write)
+{
+    proc_t* p = myproc();
+    uint64 va_page = PG_ROUND_DOWN(va);
+    exec_seg_t* seg = (p->mm->image.ip != NULL) ? exec_seg_lookup(&p->mm->image, va_page) : NULL;
+    if (seg == NULL || (write && !(seg->perm & PTE_W))) {
+        return false;
+    }
+    pte_t* pte = vm_getpte(p->mm->pgtbl, va_page, false);
+    if (pte != NULL && (*pte & PTE_V)) {
+        return false;
+    }
+
+    inode_t* ip = p->mm->image.ip;
+    uint64 file_end = seg->va + seg->filesz;
+
+    // 1. 整页都是文件内容 (或段没有bss, 页尾是文件中之后的内容): 共享页缓存
+    if (!(seg->perm & PTE_W) && (va_page + PGSIZE <= file_end || seg->filesz == seg->memsz)) {
+        uint32 pgoff = (seg->off + va_page - seg->va) / PGSIZE;
+        bool cached = pcache_resident(ip->inode_num, pgoff);
+        inode_lock_shared(ip);
+        page_t* pg = pcache_get(ip, pgoff, true);
+        if (pg == NULL) {
+            inode_unlock_shared(ip);
+            return false;
+        }
+        vm_mappages(p->mm->pgtbl, va_page, pg->page, PGSIZE, seg->perm | PTE_F);
+
+        // 顺带映射段中同样整页是文件内容的相邻页 (与其他段共用的首尾页除外)
+        uint64 lo = PG_ROUND_DOWN(seg->va);
+        uint64 hi = (seg->filesz == seg->memsz) ? PG_ROUND_UP(seg->va + seg->memsz) : PG_ROUND_DOWN(file_end);
+        if (exec_seg_lookup(&p->mm->image, lo) != seg) {
+            lo += PGSIZE;
+        }
+        if (hi > lo && exec_seg_lookup(&p->mm->image, hi - PGSIZE) != seg) {
+            hi -= PGSIZE;
+        }
+        mmap_fault_around(p, ip, va_page, lo, hi, (seg->off + lo - seg->va) / PGSIZE, seg->perm | PTE_F, !cached);
+        inode_unlock_shared(ip);
+        if (cached) {
+            p->mstat.minor_faults++;
+        } else {
+            p->mstat.major_faults++;
+        }
+        return true;
+    }
+
+    // 2. 私有页
+    uint64 page = swap_alloc_user(PMEM_ZERO);
+    if (page == 0) {
+        return false;
+    }
+    memset((void*)page, 0, PGSIZE);
+    uint64 from = (va_page > seg->va) ? va_page : seg->va;
+    uint64 to = (va_page + PGSIZE < file_end) ? va_page + PGSIZE : file_end;
+    bool cached = true;
+    if (from < to) {
+        cached = pcache_resident(ip->inode_num, (seg->off + (from - seg->va)) / PGSIZE);
+        inode_lock_shared(ip);
+        inode_read_data(ip, seg->off + (from - seg->va), to - from, (void*)(page + (from - va_page)), false);
+        inode_unlock_shared(ip);
+    }
+    vm_mappages(p->mm->pgtbl, va_page, page, PGSIZE, seg->perm);
+    if (cached) {
+        p->mstat.minor_faults++;
+    } else {
+        p->mstat.major_faults++;
+    }
+    return true;
+}
+
+// fork: 子进程继承程序映像 (私有页已随页表写时复制共享, 页缓存页在子进程缺页时重新映射)
+void exec_fork(proc_t* p, proc_t* np)
+{
+    np->mm->image = p->mm->image;
+    if (p->mm->image.ip != NULL) {
+        np->mm->image.ip = inode_dup(p->mm->image.ip);
+    }
+}
+
+// 解除映像中页缓存页的映射并归还引用 (之后销毁页表时只释放私有页), 释放可执行文件
+void exec_release(proc_t* p)
+{
+    exec_image_t* img = &p->mm->image;
+    if (img->ip == NULL) {
+        return;
+    }
+
+    for (uint32 i = 0; i < img->nseg; i++) {
+        uint64 end = PG_ROUND_UP(img->seg[i].va + img->seg[i].memsz);
+        for (uint64 va = vm_next_mapped(p->mm->pgtbl, PG_ROUND_DOWN(img->seg[i].va), end); va < end;
+             va = vm_next_mapped(p->mm->pgtbl, va + PGSIZE, end)) {
+            pte_t* pte = vm_getpte(p->mm->pgtbl, va, false);
+            if (pte != NULL && (*pte & PTE_V) && (*pte & PTE_F)) {
+                page_t* pg = pcache_find(PTE_TO_PA(*pte));
+                *pte = 0;
+                pcache_put(pg);
+            }
+        }
+    }
+
+    exec_put_inode(img->ip);
+    img->ip = NULL;
+    img->nseg = 0;
+}
@@ -0,0 +1,79 @@
+#include "proc/fpu.h"
+#include "proc/proc.h"
+#include "lib/kstat.h"
+#include "lib/lock.h"
+#include "lib/str.h"
+#include "riscv.h"
+
+// 浮点状态的惰性切换 (见proc/fpu.h)
+
+static inline uint64 fpu_fs()
+{
+    return r_sstatus() & SSTATUS_FS;
+}
+
+static inline void fpu_set_fs(uint64 fs)
+{
+    w_sstatus((r_sstatus() & ~SSTATUS_FS) | fs);
+}
+
+void fpu_inithart()
+{
+    fpu_set_fs(SSTATUS_FS_OFF);
+}
+
+/**
+ * @brief 用户态的非法指令异常: 可能是FS = Off时的第一条浮点指令
+ * @param p 当前进程
+ * @param sstatus 陷阱发生时的sstatus
+ * @return true: 已装入p的浮点状态, 返回用户态重新执行这条指令; false: 真正的非法指令
+ * @note 持有寄存器状态的是当前hart, 在返回用户态之前被切换走也没有关系:
+ *       状态是Clean, proc_sched不保存, 下一次使用时重新装入
+ */
+bool fpu_trap(proc_t* p, uint64 sstatus)
+{
+    if ((sstatus & SSTATUS_FS) != SSTATUS_FS_OFF) {
+        return false;
+    }
+    fpu_set_fs(SSTATUS_FS_INITIAL);
+    fpu_restore(&p->fp);
+    fpu_set_fs(SSTATUS_FS_CLEAN);
+    KSTAT_INC(fp_loads);
+    return true;
+}
+
+// p离开hart (调用者持有p->lk, 关中断): 只有修改过的状态需要保存
+void fpu_switch_out(proc_t* p)
+{
+    uint64 fs = fpu_fs();
+    if (fs == SSTATUS_FS_OFF) {
+        return;
+    }
+    if (fs == SSTATUS_FS_DIRTY) {
+        fpu_save(&p->fp);
+        KSTAT_INC(fp_saves);
+    }
+    fpu_set_fs(SSTATUS_FS_OFF);
+}
+
+// 子进程 / 线程继承调用者当前的浮点状态: 寄存器中修改过的先写回p->fp (之后是Clean)
+void fpu_copy(proc_t* p, proc_t* np)
+{
+    push_off();
+    if (fpu_fs() == SSTATUS_FS_DIRTY) {
+        fpu_save(&p->fp);
+        fpu_set_fs(SSTATUS_FS_CLEAN);
+        KSTAT_INC(fp_saves);
+    }
+    pop_off();
+    np->fp = p->fp;
+}
+
+// 新程序从全0的浮点状态开始: 丢弃寄存器中的状态, 下一条浮点指令重新装入
+void fpu_reset(proc_t* p)
+{
+    push_off();
+    fpu_set_fs(SSTATUS_FS_OFF);
+    pop_off();
+    memset(&p->fp, 0, sizeof(p->fp));
+}
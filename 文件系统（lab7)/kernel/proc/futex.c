@@ -0,0 +1,126 @@
+#include "proc/futex.h"
+#include "proc/proc.h"
+#include "proc/cpu.h"
+#include "mem/vmem.h"
+#include "dev/timer.h"
+#include "lib/lock.h"
+#include "lib/print.h"
+
+// futex等待队列 (见proc/futex.h)
+// 加锁顺序: futex队列的锁 -> p->lk -> waitq.lk (等待者在队列的锁下睡眠, 唤醒者在队列的锁下唤醒)
+typedef struct futex_queue {
+    spinlock_t lk;
+    proc_t* head;
+} futex_queue_t;
+
+static futex_queue_t futex_qs[N_FUTEX_Q];
+
+static futex_queue_t* futex_queue_of(uint64 key)
+{
+    uint64 h = key >> 2;
+    h ^= h >> 10;
+    return &futex_qs[h % N_FUTEX_Q];
+}
+
+void futex_init()
+{
+    for (int i = 0; i < N_FUTEX_Q; i++) {
+        spinlock_init(&futex_qs[i].lk, "futex");
+        futex_qs[i].head = NULL;
+    }
+}
+
+// 用户地址uaddr处的字的物理地址 (键), 地址不对齐或无效返回0
+// 先按写访问查找 (写时复制的页先复制), 只读映射再按读访问 (其他进程可能通过可写的映射修改它)
+static uint64 futex_key(uint64 uaddr)
+{
+    if (uaddr % sizeof(uint32) != 0) {
+        return 0;
+    }
+    pgtbl_t pgtbl = myproc()->mm->pgtbl;
+    uint64 pa = uvm_user_pa(pgtbl, uaddr, true);
+    if (pa == 0) {
+        pa = uvm_user_pa(pgtbl, uaddr, false);
+    }
+    return pa;
+}
+
+// 从队列中摘下*link (调用者持有队列的锁)
+static void futex_unlink(proc_t** link)
+{
+    proc_t* p = *link;
+    *link = p->futex_next;
+    p->futex_next = NULL;
+    p->futex_key = 0;
+}
+
+int futex_wait(uint64 uaddr, uint32 val, uint32 timeout)
+{
+    proc_t* p = myproc();
+    uint64 key = futex_key(uaddr);
+    if (key == 0) {
+        return -1;
+    }
+    futex_queue_t* q = futex_queue_of(key);
+
+    spinlock_acquire(&q->lk);
+    if (*(volatile uint32*)key != val) {
+        spinlock_release(&q->lk);
+        return -1;
+    }
+    p->futex_key = key;
+    p->futex_next = q->head;
+    q->head = p;
+
+    // 唤醒者摘下等待者时清除futex_key; 超时后自己离开队列
+    uint64 expire = timer_get_mtime() + (uint64)timeout * TIMER_MTIME_PER_US;
+    bool timedout = false;
+    while (p->futex_key != 0 && !timedout) {
+        if (timeout == 0) {
+            proc_sleep(&p->futex_key, &q->lk);
+        } else {
+            timedout = proc_sleep_until(&p->futex_key, &q->lk, expire);
+        }
+    }
+    if (p->futex_key != 0) {
+        proc_t** link = &q->head;
+        while (*link != p) {
+            link = &(*link)->futex_next;
+        }
+        futex_unlink(link);
+    } else {
+        timedout = false;
+    }
+    spinlock_release(&q->lk);
+    return timedout ? 1 : 0;
+}
+
+int futex_wake(uint64 uaddr, uint32 n)
+{
+    uint64 key = futex_key(uaddr);
+    if (key == 0) {
+        return -1;
+    }
+    futex_queue_t* q = futex_queue_of(key);
+
+    // 队列按进入的先后倒序排列: 先摘下最早进入的等待者
+    int woken = 0;
+    spinlock_acquire(&q->lk);
+    while ((uint32)woken < n) {
+        proc_t** oldest = NULL;
+        for (proc_t** link = &q->head; *link != NULL; link = &(*link)->futex_next) {
+            if ((*link)->futex_key == key) {
+                oldest = link;
+            }
+        }
+        if (oldest == NULL) {
+            break;
+        }
+        proc_t* p = *oldest;
+        futex_unlink(oldest);
+        proc_wakeup(&p->futex_key);
+        woken++;
+    }
+    spinlock_release(&q->lk);
+    return woken;
+}
@@ -0,0 +1,118 @@
+#include "proc/kwork.h"
+#include "proc/proc.h"
+#include "mem/pmem.h"
+#include "fs/journal.h"
+#include "fs/pcache.h"
+#include "fs/buf.h"
+#include "lib/lock.h"
+#include "lib/print.h"
+
+// 工作队列 (见proc/kwork.h), 工作线程睡眠在kwork_queue_head上
+static spinlock_t kwork_lk;
+static kwork_t* kwork_queue_head;
+static kwork_t* kwork_queue_tail;
+
+// 内置的工作
+static kwork_t kwork_flush;
+static kwork_t kwork_zero;
+
+// 工作线程: 依次取出工作项执行
+static void kwork_thread(void* arg)
+{
+    spinlock_acquire(&kwork_lk);
+    for (;;) {
+        while (kwork_queue_head == NULL) {
+            proc_sleep(&kwork_queue_head, &kwork_lk);
+        }
+        kwork_t* w = kwork_queue_head;
+        kwork_queue_head = w->next;
+        if (kwork_queue_head == NULL) {
+            kwork_queue_tail = NULL;
+        }
+        w->next = NULL;
+
+        // 清除pending之后w可能被再次提交(或由fn释放): 先取出fn和arg
+        void (*fn)(void*) = w->fn;
+        void* fn_arg = w->arg;
+        w->pending = false;
+        spinlock_release(&kwork_lk);
+
+        fn(fn_arg);
+
+        spinlock_acquire(&kwork_lk);
+    }
+}
+
+// 定时写回: 先提交日志事务, 再写回页缓存 (直接写盘), 最后是buf cache
+static void kwork_flush_fn(void* arg)
+{
+    journal_flusher();
+    pcache_flusher();
+    buf_flusher();
+}
+
+// 空闲页清零: 最多清零KWORK_ZERO_ROUNDS批, 剩下的由调度器下一次空闲时再提交
+static void kwork_zero_fn(void* arg)
+{
+    for (int i = 0; i < KWORK_ZERO_ROUNDS && pmem_zero_idle(); i++)
+        ;
+}
+
+void kwork_init()
+{
+    spinlock_init(&kwork_lk, "kwork");
+    kwork_queue_head = kwork_queue_tail = NULL;
+    kwork_flush.fn = kwork_flush_fn;
+    kwork_zero.fn = kwork_zero_fn;
+
+    for (int i = 0; i < KWORK_THREADS; i++) {
+        int pid = kthread_create(kwork_thread, NULL, SCHED_LEVELS - 1);
+        assert(pid >= 0, "kwork_init: failed to create worker thread");
+    }
+}
+
+bool kwork_queue(kwork_t* w)
+{
+    spinlock_acquire(&kwork_lk);
+    if (w->pending) {
+        spinlock_release(&kwork_lk);
+        return false;
+    }
+    w->pending = true;
+    w->next = NULL;
+    if (kwork_queue_tail == NULL) {
+        kwork_queue_head = w;
+    } else {
+        kwork_queue_tail->next = w;
+    }
+    kwork_queue_tail = w;
+    spinlock_release(&kwork_lk);
+
+    // 睡眠的工作线程在放开kwork_lk之前已进入等待队列, 放开之后唤醒不会丢失
+    proc_wakeup(&kwork_queue_head);
+    return true;
+}
+
+// 上一次提交定时写回的tick (tick可能一次推进多个, 不能只看ticks的余数)
+static volatile uint64 kwork_last_flush;
+
+void kwork_tick(uint64 ticks)
+{
+    if (ticks - kwork_last_flush >= KWORK_FLUSH_TICKS) {
+        kwork_last_flush = ticks;
+        kwork_queue(&kwork_flush);
+    }
+}
+
+uint64 kwork_next_tick()
+{
+    return kwork_last_flush + KWORK_FLUSH_TICKS;
+}
+
+bool kwork_idle()
+{
+    if (!pmem_zero_pending()) {
+        return false;
+    }
+    return kwork_queue(&kwork_zero);
+}
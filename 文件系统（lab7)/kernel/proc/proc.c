@@ -1,9 +1,21 @@
 #include "lib/print.h"
+#include "lib/klog.h"
 #include "lib/str.h"
 #include "mem/pmem.h"
 #include "mem/vmem.h"
+#include "mem/swap.h"
+#include "mem/asid.h"
+#include "mem/slab.h"
 #include "proc/cpu.h"
+#include "proc/kwork.h"
+#include "proc/vdata.h"
+#include "lib/kstat.h"
+#include "lib/trace.h"
+#include "lib/tstat.h"
+#include "dev/timer.h"
 #include "proc/initcode.h"
+#include "fs/file.h"
+#include "fs/fs.h"
 #include "trap/trap.h"
 #include "memlayout.h"
 #include "riscv.h"
@@ -27,94 +39,937 @@ extern pgtbl_t kernel_pagetable;
 
 /*----------------本地变量------------------*/
 
-// 进程数组
-static proc_t procs[NPROC];
+// 进程描述符的slab cache: 描述符和它的内核栈在第一次需要时申请, 进程释放后留在空闲链表中重用
+static kmem_cache_t proc_cache;
+
+// 地址空间和文件描述符表的slab cache (线程之间共享, 最后一个成员退出后释放)
+static kmem_cache_t mm_cache;
+static kmem_cache_t fdt_cache;
+
+// 等待后台销毁的地址空间 (proc_wait交给工作线程, 通过reap_next串起来), lk_reap保护链表
+static mm_t* reap_head;
+static spinlock_t lk_reap;
+static kwork_t reap_work;
+
+// 新建用户页表时直接填入的共享PTE (见proc_pgtbl_init)
+static struct {
+    pte_t trampoline;
+    pte_t vdata;
+} pgtbl_template;
 
 // 第一个进程的指针
 static proc_t* proczero;
 
-// 全局的pid和保护它的锁 
+// 全局的pid和保护它的锁 (同时保护pid散列表)
 static int global_pid = 1;
 static spinlock_t lk_pid;
 
-// 申请一个pid(锁保护)
-static int alloc_pid()
+// pid -> 进程的散列表 (通过pid_next串起来): 申请进程时加入, 释放进程时移除
+#define N_PIDHASH 64
+static proc_t* pid_hash[N_PIDHASH];
+
+// 空闲的进程槽位 (通过free_next串起来): 申请和释放都是O(1), 与进程表占用了多少无关
+static proc_t* proc_free_list;
+static spinlock_t lk_free;
+
+// 进程树的锁: 保护所有进程的parent、子进程链表和僵尸队列
+// 加锁顺序: lk_tree -> p->lk (proc_wait睡眠在lk_tree上, proc_exit持有lk_tree唤醒父进程)
+static spinlock_t lk_tree;
+
+// 每个hart一个运行队列: 每个优先级一个先进先出队列 (通过rq_next串起来), 先取优先级最高的非空队列 (见proc/proc.h的MLFQ说明)
+// 调度器只从自己的队列取进程, 自己的队列为空时才从别的hart的队列偷
+// 加锁顺序: p->lk -> runq.lk; 调度器取出进程后先放掉runq.lk再获取p->lk
+// 进程在队列中时它的prio由队列的锁保护 (提升优先级和sys_setpriority会改变它)
+// 期限进程在另一个按绝对期限排序的链表中, 先于所有级别 (见proc/proc.h的期限调度说明)
+typedef struct runq {
+    spinlock_t lk;
+    proc_t* head[SCHED_LEVELS];
+    proc_t* tail[SCHED_LEVELS];
+    proc_t* dl_head;   // 期限进程 (绝对期限从早到晚, 期限相同时按入队顺序)
+    volatile uint32 n; // 所有级别的进程数 (不加锁读取时仅供参考: 空队列不加锁就跳过)
+    uint64 epoch;      // 队列中的进程上一次提升优先级时的周期 (见sched_epoch)
+} runq_t;
+
+static runq_t runqs[NCPU];
+
+// 正在wfi等待的hart (位图): 向它们的运行队列加入进程时发送处理器间中断唤醒
+static volatile uint32 sched_idle;
+
+// 第cpu个运行队列加入了进程: 那个hart空闲时唤醒它; 它正忙而别的hart空闲时唤醒一个空闲的hart来窃取
+static void sched_kick(int cpu)
+{
+    uint32 idle = sched_idle;
+    if (idle == 0) {
+        return;
+    }
+    int target = (idle & (1u << cpu)) ? cpu : __builtin_ctz(idle);
+    if (target != mycpuid()) {
+        timer_send_ipi(target);
+    }
+}
+
+// 等待队列: 睡眠的进程按sleep_space散列到N_WAITQ个队列之一 (通过wq_next串起来)
+// 唤醒只遍历sleep_space所在的队列, 不再扫描整个进程表
+// 加锁顺序: p->lk -> waitq.lk; 唤醒者在waitq.lk下摘下匹配的进程, 放掉waitq.lk之后再逐个获取p->lk
+#define N_WAITQ 64
+
+typedef struct waitq {
+    spinlock_t lk;
+    proc_t* head;
+} waitq_t;
+
+static waitq_t waitqs[N_WAITQ];
+
+static waitq_t* waitq_of(void* sleep_space)
+{
+    uint64 h = (uint64)sleep_space;
+    h ^= h >> 12;
+    return &waitqs[(h >> 3) % N_WAITQ];
+}
+
+// 当前的优先级提升周期: 每SCHED_BOOST_TICKS个tick所有进程回到自己的基础优先级一次
+static uint64 sched_epoch()
+{
+    return timer_get_ticks() / SCHED_BOOST_TICKS;
+}
+
+// p加入rq中p->prio级的队尾, 期限进程按绝对期限插入 (调用者持有rq->lk)
+static void runq_link(runq_t* rq, proc_t* p)
+{
+    if (SCHED_IS_DL(p)) {
+        proc_t** pp = &rq->dl_head;
+        while (*pp != NULL && (int64)((*pp)->dl_abs - p->dl_abs) <= 0) {
+            pp = &(*pp)->rq_next;
+        }
+        p->rq_next = *pp;
+        *pp = p;
+        rq->n++;
+        return;
+    }
+    int l = p->prio;
+    p->rq_next = NULL;
+    if (rq->tail[l] == NULL) {
+        rq->head[l] = p;
+    } else {
+        rq->tail[l]->rq_next = p;
+    }
+    rq->tail[l] = p;
+    rq->n++;
+}
+
+// 从rq中p->prio级的队列 (期限进程: 期限链表) 摘下p, prev是它的前一个 (NULL: p是队头), 调用者持有rq->lk
+static void runq_unlink(runq_t* rq, proc_t* p, proc_t* prev)
+{
+    if (SCHED_IS_DL(p)) {
+        if (prev == NULL) {
+            rq->dl_head = p->rq_next;
+        } else {
+            prev->rq_next = p->rq_next;
+        }
+        p->rq_next = NULL;
+        rq->n--;
+        return;
+    }
+    int l = p->prio;
+    if (prev == NULL) {
+        rq->head[l] = p->rq_next;
+    } else {
+        prev->rq_next = p->rq_next;
+    }
+    if (rq->tail[l] == p) {
+        rq->tail[l] = prev;
+    }
+    p->rq_next = NULL;
+    rq->n--;
+}
+
+// a是否应该先于b运行: 期限进程先于普通进程, 期限进程之间按绝对期限, 普通进程按优先级
+static bool sched_before(proc_t* a, proc_t* b)
+{
+    if (SCHED_IS_DL(a) != SCHED_IS_DL(b)) {
+        return SCHED_IS_DL(a);
+    }
+    if (SCHED_IS_DL(a)) {
+        return (int64)(a->dl_abs - b->dl_abs) < 0;
+    }
+    return a->prio < b->prio;
+}
+
+// p进入第cpu个运行队列: 那个hart上正在运行的进程应该排在p之后时要求它尽快让出
+// (设置need_resched, 别的hart再发一个处理器间中断), 不必等到下一个tick
+// 不加锁读取c->proc: 只是提示, 判断错了最多多检查一次, 或者等到下一个tick才抢占
+static void sched_preempt(int cpu, proc_t* p)
+{
+    cpu_t* c = cpu_of(cpu);
+    proc_t* cur = c->proc;
+    if (cur == NULL || !sched_before(p, cur)) {
+        return;
+    }
+    c->need_resched = true;
+    if (cpu != mycpuid()) {
+        timer_send_ipi(cpu);
+    }
+}
+
+// p加入第cpu个运行队列
+static void runq_push(int cpu, proc_t* p)
+{
+    runq_t* rq = &runqs[cpu];
+    spinlock_acquire(&rq->lk);
+    runq_link(rq, p);
+    spinlock_release(&rq->lk);
+    sched_kick(cpu);
+    sched_preempt(cpu, p);
+}
+
+// 设置p自己的优先级 (周期性提升, sys_setpriority): 正在继承别人的优先级时 (pi_count > 0)
+// 只改变恢复时的优先级, 新的优先级更高时才立即生效; p不在运行队列中
+static void sched_set_prio(proc_t* p, int prio)
+{
+    if (p->pi_count > 0) {
+        p->pi_saved = prio;
+        if (prio < p->prio) {
+            p->prio = prio;
+        }
+    } else {
+        p->prio = prio;
+    }
+}
+
+// 优先级提升: 进入新的周期后第一次从队列取进程时, 队列中的进程都回到基础优先级 (调用者持有rq->lk)
+// 不在队列中的进程在下一次变为RUNNABLE或用完一个tick时提升 (见sched_boost)
+static void runq_boost(runq_t* rq)
+{
+    uint64 epoch = sched_epoch();
+    if (rq->epoch == epoch) {
+        return;
+    }
+    rq->epoch = epoch;
+    // 按级别从高到低、同一级别按入队顺序摘下所有进程, 再按这个顺序重新入队 (原来的先后次序保持不变)
+    proc_t* all = NULL;
+    proc_t* last = NULL;
+    for (int l = 0; l < SCHED_LEVELS; l++) {
+        while (rq->head[l] != NULL) {
+            proc_t* p = rq->head[l];
+            runq_unlink(rq, p, NULL);
+            if (last == NULL) {
+                all = p;
+            } else {
+                last->rq_next = p;
+            }
+            last = p;
+        }
+    }
+    while (all != NULL) {
+        proc_t* p = all;
+        all = p->rq_next;
+        sched_set_prio(p, p->base_prio);
+        p->slice_used = 0;
+        p->boost_epoch = epoch;
+        runq_link(rq, p);
+    }
+}
+
+// 取出第cpu个运行队列中优先级最高的进程, 队列为空时返回NULL
+static proc_t* runq_pop(int cpu)
+{
+    runq_t* rq = &runqs[cpu];
+    if (rq->n == 0) {
+        return NULL;
+    }
+    proc_t* p = NULL;
+    spinlock_acquire(&rq->lk);
+    runq_boost(rq);
+    p = rq->dl_head;
+    for (int l = 0; l < SCHED_LEVELS && p == NULL; l++) {
+        p = rq->head[l];
+    }
+    if (p != NULL) {
+        runq_unlink(rq, p, NULL);
+    }
+    spinlock_release(&rq->lk);
+    return p;
+}
+
+// 第cpu个运行队列中是否有应该先于p运行的进程 (不加锁读取, 仅供判断是否抢占)
+static bool runq_has_higher(int cpu, proc_t* p)
+{
+    proc_t* d = runqs[cpu].dl_head;
+    if (d != NULL) {
+        return !SCHED_IS_DL(p) || (int64)(d->dl_abs - p->dl_abs) < 0;
+    }
+    if (SCHED_IS_DL(p)) {
+        return false;
+    }
+    for (int l = 0; l < p->prio; l++) {
+        if (runqs[cpu].head[l] != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 亲和性: p可以运行在第cpu个hart上
+static bool sched_allowed(proc_t* p, int cpu)
+{
+    return (p->cpu_mask & (1u << cpu)) != 0;
+}
+
+// 队列最短的hart (新进程放在那里)
+static int runq_idlest(uint32 mask)
+{
+    int best = -1;
+    for (int i = 0; i < ncpu; i++) {
+        if ((mask & (1u << i)) && (best < 0 || runqs[i].n < runqs[best].n)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// p的hart不在它的亲和性掩码中时换到掩码中队列最短的hart (调用者持有p->lk)
+static void sched_place(proc_t* p)
+{
+    if (!sched_allowed(p, p->rq_cpu)) {
+        p->rq_cpu = runq_idlest(p->cpu_mask);
+    }
+}
+
+// proc_sched直接切换的目标: 第cpu个运行队列中优先级最高的进程, 取出时持有它的锁
+// 当前进程p持有自己的锁, 另一个hart上的进程也可能持有自己的锁来取p: 只尝试获取, 被持有时留在队列中返回NULL
+// 队头是p自己时取出p (p->lk已经持有), 队列为空或者队头不允许在这个hart上运行时返回NULL
+static proc_t* runq_pop_locked(int cpu, proc_t* p)
+{
+    runq_t* rq = &runqs[cpu];
+    if (rq->n == 0) {
+        return NULL;
+    }
+    proc_t* np = NULL;
+    spinlock_acquire(&rq->lk);
+    runq_boost(rq);
+    np = rq->dl_head;
+    for (int l = 0; l < SCHED_LEVELS && np == NULL; l++) {
+        np = rq->head[l];
+    }
+    if (np != NULL && np != p && (!sched_allowed(np, cpu) || !spinlock_try_acquire(&np->lk))) {
+        np = NULL;
+    }
+    if (np != NULL) {
+        runq_unlink(rq, np, NULL);
+    }
+    spinlock_release(&rq->lk);
+    return np;
+}
+
+// 从运行队列中摘下RUNNABLE的p (调用者持有p->lk), 返回false说明p不在队列中:
+// 它刚被调度器或窃取者取出, 它们在运行或重新入队之前要获取p->lk
+static bool runq_remove(proc_t* p)
+{
+    runq_t* rq = &runqs[p->rq_cpu];
+    spinlock_acquire(&rq->lk);
+    proc_t* prev = NULL;
+    proc_t* q = SCHED_IS_DL(p) ? rq->dl_head : rq->head[p->prio];
+    while (q != NULL && q != p) {
+        prev = q;
+        q = q->rq_next;
+    }
+    if (q == p) {
+        runq_unlink(rq, p, prev);
+    }
+    spinlock_release(&rq->lk);
+    return q == p;
+}
+
+// 工作窃取: 自己的队列为空的hart从最长的队列中拿走一半进程 (从高优先级开始), 先运行其中一个, 其余进入自己的队列
+// 缓存亲和性: 刚离开CPU不到SCHED_HOT_TICKS的进程跳过; 队列里都是热的进程时,
+// 只有至少两个在排队(那个hart确实忙不过来)才拿走优先级最高的一个
+// 不允许运行在这个hart上的进程(cpu_mask)不拿
+static proc_t* runq_steal(int self)
+{
+    int victim = -1;
+    for (int i = 0; i < ncpu; i++) {
+        if (i != self && runqs[i].n > 0 && (victim < 0 || runqs[i].n > runqs[victim].n)) {
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        return NULL;
+    }
+
+    runq_t* rq = &runqs[victim];
+    uint64 now = timer_get_ticks();
+    proc_t* got = NULL;
+    proc_t* extra = NULL;   // 多拿的进程 (倒序串起来)
+    spinlock_acquire(&rq->lk);
+    runq_boost(rq);
+    uint32 want = (rq->n + 1) / 2;
+    for (int l = 0; l < SCHED_LEVELS && want > 0; l++) {
+        proc_t* prev = NULL;
+        proc_t* p = rq->head[l];
+        while (p != NULL && want > 0) {
+            proc_t* next = p->rq_next;
+            if (sched_allowed(p, self) && now - p->last_ran >= SCHED_HOT_TICKS) {
+                runq_unlink(rq, p, prev);
+                want--;
+                if (got == NULL) {
+                    got = p;
+                } else {
+                    p->rq_next = extra;
+                    extra = p;
+                }
+            } else {
+                prev = p;
+            }
+            p = next;
+        }
+    }
+    for (int l = 0; l < SCHED_LEVELS && got == NULL && rq->n >= 2; l++) {
+        proc_t* prev = NULL;
+        for (proc_t* p = rq->head[l]; p != NULL; prev = p, p = p->rq_next) {
+            if (sched_allowed(p, self)) {
+                runq_unlink(rq, p, prev);
+                got = p;
+                break;
+            }
+        }
+    }
+    spinlock_release(&rq->lk);
+
+    // 多拿的进程在进程锁下换到自己的队列 (期间亲和性可能被修改, 见sched_place)
+    while (extra != NULL) {
+        proc_t* p = extra;
+        extra = p->rq_next;
+        spinlock_acquire(&p->lk);
+        p->rq_cpu = self;
+        sched_place(p);
+        runq_push(p->rq_cpu, p);
+        spinlock_release(&p->lk);
+    }
+    return got;
+}
+
+// 周期变化后p第一次变为RUNNABLE或用完一个tick时回到基础优先级 (调用者持有p->lk, p不在运行队列中)
+static void sched_boost(proc_t* p)
+{
+    uint64 epoch = sched_epoch();
+    if (p->boost_epoch != epoch) {
+        p->boost_epoch = epoch;
+        sched_set_prio(p, p->base_prio);
+        p->slice_used = 0;
+    }
+}
+
+// 从上一次记账到现在的时间计入p的用户态 (user) 或内核态, 同时计入当前hart (关中断, 见proc/proc.h的CPU时间记账)
+static void sched_acct(proc_t* p, bool user)
+{
+    uint64 now = r_time();
+    uint64 d = now - p->acct_stamp;
+    hart_stat_t* st = &mycpu()->st;
+    p->acct_stamp = now;
+    if (user) {
+        p->cstat.utime += d;
+        st->user += d;
+    } else {
+        p->cstat.stime += d;
+        st->system += d;
+    }
+}
+
+// p在当前hart上开始运行 (调用者持有p->lk): 从变为RUNNABLE到现在是在运行队列中等待的时间
+static void sched_acct_in(proc_t* p)
+{
+    uint64 now = r_time();
+    uint64 w = now - p->ready_stamp;
+    hart_stat_t* st = &mycpu()->st;
+    p->cstat.wait_time += w;
+    st->wait += w;
+    st->switches++;
+    p->acct_stamp = now;
+}
+
+// p离开CPU (调用者持有p->lk, 已经设置了新状态): 计入内核态时间和切换次数
+static void sched_acct_out(proc_t* p)
+{
+    sched_acct(p, false);
+    if (p->state == SLEEPING) {
+        p->cstat.nvcsw++;
+    } else if (p->state == RUNNABLE) {
+        p->cstat.nivcsw++;
+    }
+}
+
+void proc_acct_enter(proc_t* p)
+{
+    sched_acct(p, true);
+}
+
+void proc_acct_leave(proc_t* p)
+{
+    sched_acct(p, false);
+}
+
+// 期限调度的准入控制: 每个hart上期限进程占用的带宽之和 (见SCHED_DL_BW_SHIFT)
+static spinlock_t lk_dl;
+static uint64 dl_bw[NCPU];
+
+// 期限进程p离开CPU (调用者持有p->lk): 扣除这一次运行的时间
+static void sched_dl_charge(proc_t* p)
+{
+    if (!SCHED_IS_DL(p)) {
+        return;
+    }
+    uint64 used = timer_get_mtime() - p->dl_start;
+    p->dl_remain = (used >= p->dl_remain) ? 0 : p->dl_remain - used;
+}
+
+// 期限进程p开始运行 (调用者持有p->lk)
+static void sched_dl_start(proc_t* p)
+{
+    if (SCHED_IS_DL(p)) {
+        p->dl_start = timer_get_mtime();
+    }
+}
+
+// 睡眠的期限进程醒来 (调用者持有p->lk): 期限已过, 或者剩余的运行时间按带宽在原来的期限之前用不完时开始新的周期
+// remain / (abs - now) > runtime / deadline 写成乘法 (两边都不超过SCHED_DL_PERIOD_MAX的平方, 不会溢出)
+static void sched_dl_wakeup(proc_t* p)
+{
+    uint64 now = timer_get_mtime();
+    if ((int64)(p->dl_abs - now) <= 0 || p->dl_remain * p->dl_deadline > (p->dl_abs - now) * p->dl_runtime) {
+        p->dl_abs = now + p->dl_deadline;
+        p->dl_remain = p->dl_runtime;
+    }
+}
+
+// 当前进程p是期限进程且这个周期的运行时间已经用完 (由p自己调用, 不加锁: p运行时只有它自己修改这些字段)
+static bool sched_dl_exhausted(proc_t* p)
+{
+    return SCHED_IS_DL(p) && timer_get_mtime() - p->dl_start >= p->dl_remain;
+}
+
+// 当前的期限进程p用完了这个周期的运行时间: 离开CPU, 不进入运行队列, 下一个周期开始时由dl_repl补充后重新入队
+// 先加入定时器再获取p->lk (加锁顺序: 时间轮的锁 -> p->lk); 定时器在p离开CPU之前就到期时只补充运行时间, p继续运行
+static void sched_dl_throttle(proc_t* p)
+{
+    uint64 now = timer_get_mtime();
+    uint64 next = p->dl_abs - p->dl_deadline + p->dl_period;
+    p->dl_throttled = true;
+    push_off();
+    ktimer_add(&p->dl_repl, ((int64)(next - now) > 0) ? next : now);
+    timer_rearm();  // 本hart的下一次时钟中断不晚于这个定时器
+    pop_off();
+
+    spinlock_acquire(&p->lk);
+    if (p->dl_throttled) {
+        p->state = RUNNABLE;
+        p->last_ran = timer_get_ticks();
+        proc_sched();
+    }
+    spinlock_release(&p->lk);
+}
+
+// 下一个周期开始 (时间轮的锁下): 补充运行时间, 停止运行的期限进程重新入队
+static void sched_dl_repl_fn(ktimer_t* t)
+{
+    proc_t* p = (proc_t*)t->arg;
+    spinlock_acquire(&p->lk);
+    if (p->dl_throttled) {
+        p->dl_throttled = false;
+        p->dl_abs = t->expire + p->dl_deadline;
+        p->dl_remain = p->dl_runtime;
+        if (p->state == RUNNABLE) {
+            p->ready_stamp = r_time();  // 停止运行的时间不算等待
+            runq_push(p->rq_cpu, p);
+        } else {
+            p->dl_start = timer_get_mtime();  // 还没有离开CPU: 从现在开始使用新的运行时间
+        }
+    }
+    spinlock_release(&p->lk);
+}
+
+// 运行时间用完的时刻 (时间轮的锁下): p还在运行时要求它的hart让出 (在那个hart的抢占点停止运行)
+static void sched_dl_budget_fn(ktimer_t* t)
+{
+    proc_t* p = (proc_t*)t->arg;
+    spinlock_acquire(&p->lk);
+    if (p->state == RUNNING && SCHED_IS_DL(p)) {
+        cpu_of(p->rq_cpu)->need_resched = true;
+        if (p->rq_cpu != mycpuid()) {
+            timer_send_ipi(p->rq_cpu);
+        }
+    }
+    spinlock_release(&p->lk);
+}
+
+// p按p->pid加入pid散列表 (调用者持有lk_pid)
+static void pid_hash_insert(proc_t* p)
+{
+    p->pid_next = pid_hash[p->pid % N_PIDHASH];
+    pid_hash[p->pid % N_PIDHASH] = p;
+}
+
+// 为p申请一个pid并加入pid散列表(锁保护)
+static int alloc_pid(proc_t* p)
 {
     int tmp = 0;
     spinlock_acquire(&lk_pid);
     assert(global_pid >= 0, "alloc_pid: overflow");
     tmp = global_pid++;
+    p->pid = tmp;
+    pid_hash_insert(p);
     spinlock_release(&lk_pid);
     return tmp;
 }
 
+// 从pid散列表中移除p
+static void free_pid(proc_t* p)
+{
+    spinlock_acquire(&lk_pid);
+    proc_t** link = &pid_hash[p->pid % N_PIDHASH];
+    while (*link != p) {
+        link = &(*link)->pid_next;
+    }
+    *link = p->pid_next;
+    p->pid_next = NULL;
+    spinlock_release(&lk_pid);
+}
+
+// 查找pid对应的进程 (没有退出的), 返回时持有它的锁; 不存在返回NULL
+static proc_t* proc_find(int pid)
+{
+    spinlock_acquire(&lk_pid);
+    proc_t* p = pid_hash[pid % N_PIDHASH];
+    while (p != NULL && p->pid != pid) {
+        p = p->pid_next;
+    }
+    spinlock_release(&lk_pid);
+    if (p == NULL) {
+        return NULL;
+    }
+    // 在放开lk_pid之后p可能已被释放并重新申请: 获取锁之后再确认
+    spinlock_acquire(&p->lk);
+    if (p->pid != pid || p->state == UNUSED || p->state == ZOMBIE) {
+        spinlock_release(&p->lk);
+        return NULL;
+    }
+    return p;
+}
+
+// 空闲链表为空时申请一个新的进程描述符和内核栈 (不持有锁调用), 达到上限或内存不足返回NULL
+static proc_t* proc_grow()
+{
+    proc_t* p = (proc_t*)kmem_cache_alloc(&proc_cache);
+    if (p == NULL) {
+        return NULL;
+    }
+    memset(p, 0, sizeof(proc_t));
+    p->kstack = kvm_kstack_alloc();
+    if (p->kstack == 0) {
+        kmem_cache_free(&proc_cache, p);
+        return NULL;
+    }
+    spinlock_init(&p->lk, "proc");
+    p->state = UNUSED;
+    return p;
+}
+
+// 槽位放回空闲链表
+static void proc_slot_put(proc_t* p)
+{
+    spinlock_acquire(&lk_free);
+    p->free_next = proc_free_list;
+    proc_free_list = p;
+    spinlock_release(&lk_free);
+}
+
+// 陷阱帧中不随系统调用变化的内核字段: 每次返回用户态不再重写 (kernel_hartid随迁移变化, 由trap_user_return写)
+void proc_tf_init(proc_t* p)
+{
+    p->tf->kernel_satp = r_satp();
+    p->tf->kernel_sp = p->kstack + PGSIZE;
+    p->tf->kernel_trap = (uint64)trap_user_handler;
+}
+
+static void sched_switch_done();
+
+// 新进程第一次运行: 放开直接切换过来的进程的锁; 与从调度器切换过来时一样, 放开自己的锁之后开中断
+static void sched_entry()
+{
+    sched_switch_done();
+    mycpu()->origin = 1;
+}
+
+// 第一个进程的标准输出/输入 (用户库的STD_OUT = 0, STD_IN = 1) 和fd 2都是控制台, 之后的进程经fork继承
+// 设备文件/console在根目录中, 已经存在时直接打开
+static void proc_first_console(proc_t* p)
+{
+    file_t* cons = file_create_dev("/console", DEV_CONSOLE, 0);
+    assert(cons != NULL, "proc_first_console: cannot create /console");
+    assert(proc_fd_alloc(p, cons) == 0, "proc_first_console: fd 0 in use");
+    assert(proc_fd_alloc(p, file_dup(cons)) == 1, "proc_first_console: fd 1 in use");
+    assert(proc_fd_alloc(p, file_dup(cons)) == 2, "proc_first_console: fd 2 in use");
+}
+
 // 由于调度器中上了锁，所以这里需要解锁
+// 第一个进程第一次运行时完成文件层的初始化、挂载根文件系统并打开控制台 (在进程上下文中, 可以睡眠)
 static void fork_return()
 {
+    static bool first = true;
     proc_t* p = myproc();
+    sched_entry();
     spinlock_release(&p->lk);
+
+    if (first) {
+        first = false;
+        file_init();
+        fs_init();  // 会睡眠等待磁盘I/O, 所以不能放在main()中
+        proc_first_console(p);
+    }
     trap_user_return();
 }
 
-// 返回一个未使用的进程空间
-// 设置pid + 设置上下文中的ra和sp
-// 申请tf和pgtbl使用的物理页
-// 返回时持有锁
-proc_t* proc_alloc()
+// 内核线程的入口: 放开调度器获取的锁, 执行线程函数 (不返回)
+static void kthread_entry()
 {
-    proc_t* p;
+    proc_t* p = myproc();
+    sched_entry();
+    spinlock_release(&p->lk);
+    p->kfn(p->karg);
+    panic("kthread_entry: kernel thread returned");
+}
 
-    // 遍历进程数组找到未使用的槽位
-    for (int i = 0; i < NPROC; i++) {
-        p = &procs[i];
-        spinlock_acquire(&p->lk);
-        if (p->state == UNUSED) {
-            goto found;
+// 从空闲链表取一个槽位, 返回时持有锁
+static proc_t* proc_slot_get()
+{
+    spinlock_acquire(&lk_free);
+    proc_t* p = proc_free_list;
+    if (p != NULL) {
+        proc_free_list = p->free_next;
+    }
+    spinlock_release(&lk_free);
+    if (p == NULL) {
+        p = proc_grow();
+        if (p == NULL) {
+            return NULL;
         }
-        spinlock_release(&p->lk);
     }
-    return NULL;
 
-found:
+    // 上一个使用者(proc_wait)可能还没有放开锁
+    spinlock_acquire(&p->lk);
+    assert(p->state == UNUSED, "proc_slot_get: free slot in use");
+    return p;
+}
+
+// 定时睡眠的定时器到期 (时间轮的锁下): 唤醒睡眠在p->timer_space上的p
+// 在p->lk下记下到期: p还没有睡下时proc_sleep看到后不再睡眠, 唤醒不会丢失
+static void proc_timer_fn(ktimer_t* t)
+{
+    proc_t* p = (proc_t*)t->arg;
+    spinlock_acquire(&p->lk);
+    p->timer_fired = true;
+    bool sleeping = (p->state == SLEEPING && p->sleep_space == p->timer_space);
+    spinlock_release(&p->lk);
+    if (sleeping) {
+        proc_wakeup(p->timer_space);
+    }
+}
+
+// 初始化槽位中的各个字段, 设置pid和上下文 (第一次运行时从entry开始)
+static void proc_setup(proc_t* p, void (*entry)())
+{
     // 分配PID
-    p->pid = alloc_pid();
+    alloc_pid(p);
+    
+    // 设置上下文：ra指向entry，sp指向内核栈顶
+    memset(&p->ctx, 0, sizeof(context_t));
+    p->ctx.ra = (uint64)entry;
+    p->ctx.sp = p->kstack + PGSIZE;
+    
+    // 初始化其他字段
+    p->parent = NULL;
+    p->children = p->sib_prev = p->sib_next = NULL;
+    p->zombie_head = p->zombie_tail = p->zombie_next = NULL;
+    p->exit_state = 0;
+    p->sleep_space = NULL;
+    p->wq_next = NULL;
+    ktimer_init(&p->timer, proc_timer_fn, p);
+    p->timer_fired = false;
+    p->futex_key = 0;
+    p->futex_next = NULL;
+    p->rq_next = NULL;
+    p->cpu_mask = SCHED_ALL_CPUS;
+    p->rq_cpu = runq_idlest(p->cpu_mask);
+    p->last_ran = 0;
+    p->prio = p->base_prio = SCHED_PRIO_DEFAULT;
+    p->pi_count = 0;
+    p->dl_runtime = p->dl_deadline = p->dl_period = p->dl_bw = 0;
+    p->dl_throttled = false;
+    ktimer_init(&p->dl_budget, sched_dl_budget_fn, p);
+    ktimer_init(&p->dl_repl, sched_dl_repl_fn, p);
+    p->slice_used = 0;
+    p->boost_epoch = sched_epoch();
+    p->kfn = NULL;
+    p->karg = NULL;
+    p->tf_va = TRAPFRAME;
+    memset(&p->fp, 0, sizeof(p->fp));
+    memset(&p->mstat, 0, sizeof(p->mstat));
+    memset(&p->cstat, 0, sizeof(p->cstat));
+    p->acct_stamp = p->ready_stamp = r_time();
+    memset(&p->io, 0, sizeof(p->io));
+    memset(p->sc, 0, sizeof(p->sc));
+    p->sysrec = false;
+    p->nhold = 0;
+    memset(&p->uring, 0, sizeof(p->uring));
+    p->journal_depth = 0;
+}
+
+// 新的地址空间: 页表中映射了trampoline和trapframe, 其余字段为空 (空闲mmap区域树由调用者建立)
+static mm_t* mm_alloc(uint64 trapframe)
+{
+    mm_t* mm = (mm_t*)kmem_cache_alloc(&mm_cache);
+    if (mm == NULL) {
+        return NULL;
+    }
+    memset(mm, 0, sizeof(mm_t));
+    mm->pgtbl = proc_pgtbl_init(trapframe);
+    if (mm->pgtbl == NULL) {
+        kmem_cache_free(&mm_cache, mm);
+        return NULL;
+    }
+    mm->ref = 1;
+    sleeplock_init(&mm->lk, "mm");
+    return mm;
+}
+
+// 释放地址空间: 销毁页表及其管理的物理页, 释放空闲mmap区域树 (文件映射等已经在退出时放弃)
+static void mm_free(mm_t* mm)
+{
+    if (mm->pgtbl) {
+        uvm_destroy_pgtbl(mm->pgtbl);
+    }
+    mmap_tree_destroy(mm->mmap);
+    kmem_cache_free(&mm_cache, mm);
+}
+
+// 工作线程: 逐个销毁等待释放的地址空间 (页还给当前hart的空闲页缓存, 每张0级页表之后可以让出CPU)
+static void mm_reap(void* arg)
+{
+    for (;;) {
+        spinlock_acquire(&lk_reap);
+        mm_t* mm = reap_head;
+        if (mm != NULL) {
+            reap_head = mm->reap_next;
+        }
+        spinlock_release(&lk_reap);
+        if (mm == NULL) {
+            return;
+        }
+        mm_free(mm);
+    }
+}
+
+// 释放已经没有进程使用的地址空间, 调用者不持有进程锁: 交给工作线程, 不在调用者的路径上逐页释放
+// 用户区域的空闲页已经低于高水位时直接释放 (申请者在等这些页)
+static void mm_free_deferred(mm_t* mm)
+{
+    if (pmem_free_pages(false) < PMEM_WMARK_HIGH) {
+        mm_free(mm);
+        return;
+    }
+    spinlock_acquire(&lk_reap);
+    mm->reap_next = reap_head;
+    reap_head = mm;
+    spinlock_release(&lk_reap);
+    kwork_queue(&reap_work);
+}
+
+// 新的空文件描述符表 (使用内嵌的表)
+static fdtable_t* fdt_alloc()
+{
+    fdtable_t* fdt = (fdtable_t*)kmem_cache_alloc(&fdt_cache);
+    if (fdt == NULL) {
+        return NULL;
+    }
+    fdt->ref = 1;
+    spinlock_init(&fdt->lk, "fdtable");
+    memset(fdt->fd_small, 0, sizeof(fdt->fd_small));
+    fdt->filelist = fdt->fd_small;
+    fdt->nfile = FILE_PER_PROC;
+    return fdt;
+}
+
+// 释放文件描述符表和扩展出的一页 (文件已经关闭)
+static void fdt_free(fdtable_t* fdt)
+{
+    if (fdt->filelist != fdt->fd_small) {
+        pmem_free((uint64)fdt->filelist, true);
+    }
+    kmem_cache_free(&fdt_cache, fdt);
+}
+
+// 返回一个未使用的进程空间
+// 设置pid + 设置上下文中的ra和sp
+// 申请tf、新的地址空间和空的文件描述符表
+// 返回时持有锁
+proc_t* proc_alloc()
+{
+    proc_t* p = proc_slot_get();
+    if (p == NULL) {
+        return NULL;
+    }
     
     // 分配trapframe物理页
-    p->tf = (trapframe_t*)pmem_alloc(false);
+    p->tf = (trapframe_t*)pmem_alloc_flags(false, PMEM_ZERO | PMEM_TAG(MEMTAG_TRAPFRAME));
     if (p->tf == NULL) {
         spinlock_release(&p->lk);
+        proc_slot_put(p);
         return NULL;
     }
-    memset(p->tf, 0, sizeof(trapframe_t));
     
-    // 初始化页表（包含trapframe和trampoline的映射）
-    p->pgtbl = proc_pgtbl_init((uint64)p->tf);
-    if (p->pgtbl == NULL) {
+    // 初始化地址空间（页表包含trapframe和trampoline的映射）和文件描述符表
+    p->mm = mm_alloc((uint64)p->tf);
+    p->fdt = (p->mm != NULL) ? fdt_alloc() : NULL;
+    if (p->fdt == NULL) {
+        if (p->mm != NULL) {
+            mm_free(p->mm);
+            p->mm = NULL;
+        }
         pmem_free((uint64)p->tf, false);
         p->tf = NULL;
         spinlock_release(&p->lk);
+        proc_slot_put(p);
         return NULL;
     }
-    
-    // 设置上下文：ra指向fork_return，sp指向内核栈顶
-    memset(&p->ctx, 0, sizeof(context_t));
-    p->ctx.ra = (uint64)fork_return;
-    p->ctx.sp = p->kstack + PGSIZE;
-    
-    // 初始化其他字段
-    p->parent = NULL;
-    p->exit_state = 0;
-    p->sleep_space = NULL;
-    p->heap_top = 0;
-    p->ustack_pages = 0;
-    p->mmap = NULL;
-    
+
+    proc_setup(p, fork_return);
     return p;
 }
 
+// 创建执行fn(arg)的内核线程: 在S-mode中运行, 只有内核栈和上下文, 没有trapframe和用户页表
+// 与进程一样被调度 (基础优先级prio, 可以睡眠); 没有父进程, 也不退出 (fn不能返回)
+// 成功返回pid, 没有槽位或内存不足返回-1
+int kthread_create(void (*fn)(void*), void* arg, int prio)
+{
+    proc_t* p = proc_slot_get();
+    if (p == NULL) {
+        return -1;
+    }
+    p->tf = NULL;
+    p->mm = NULL;
+    p->fdt = NULL;
+    proc_setup(p, kthread_entry);
+    p->kfn = fn;
+    p->karg = arg;
+    p->prio = p->base_prio = prio;
+    int pid = p->pid;
+    proc_ready(p);
+    spinlock_release(&p->lk);
+    return pid;
+}
+
 // 释放一个进程空间
-// 释放pgtbl的整个地址空间
-// 释放mmap_region到仓库
+// 释放trapframe
+// 地址空间只属于p时释放 (页表、mmap_region; 共享的地址空间由最后退出的成员留给它的父进程释放)
 // 设置其余各个字段为合适初始值
 // tips: 调用者需持有p->lk
 void proc_free(proc_t* p)
@@ -125,64 +980,93 @@ void proc_free(proc_t* p)
         p->tf = NULL;
     }
     
-    // 释放页表及其管理的物理页
-    if (p->pgtbl) {
-        uvm_destroy_pgtbl(p->pgtbl);
-        p->pgtbl = NULL;
+    // 释放页表及其管理的物理页和空闲mmap区域树
+    if (p->mm) {
+        assert(p->mm->ref <= 1, "proc_free: address space still shared");
+        mm_free(p->mm);
+        p->mm = NULL;
     }
     
-    // 释放mmap区域链表
-    mmap_region_t* mmap = p->mmap;
-    while (mmap != NULL) {
-        mmap_region_t* next = mmap->next;
-        mmap_region_free(mmap);
-        mmap = next;
+    // 释放没有运行过的进程的文件描述符表（退出的进程已经放弃了自己的表）
+    if (p->fdt) {
+        fdt_free(p->fdt);
+        p->fdt = NULL;
     }
-    p->mmap = NULL;
     
+    // 离开pid散列表, 槽位回到空闲链表 (调用者放开p->lk之后才能被重新申请)
+    free_pid(p);
+    proc_slot_put(p);
+
     // 重置其他字段
     p->pid = 0;
     p->state = UNUSED;
     p->parent = NULL;
+    p->children = p->sib_prev = p->sib_next = NULL;
+    p->zombie_head = p->zombie_tail = p->zombie_next = NULL;
     p->exit_state = 0;
     p->sleep_space = NULL;
-    p->heap_top = 0;
-    p->ustack_pages = 0;
 }
 
 // 进程模块初始化
 void proc_init()
 {
-    // 初始化PID锁
+    // 初始化PID锁、空闲链表的锁和进程树的锁
     spinlock_init(&lk_pid, "pid");
-    
-    // 遍历进程数组，初始化每个进程的锁和内核栈地址
-    for (int i = 0; i < NPROC; i++) {
-        spinlock_init(&procs[i].lk, "proc");
-        procs[i].kstack = KSTACK(i);//分配内核栈地址
-        procs[i].state = UNUSED;//标记为空闲
+    spinlock_init(&lk_free, "proc_free");
+    spinlock_init(&lk_tree, "proc_tree");
+    spinlock_init(&lk_dl, "sched_dl");
+
+    // 初始化等待队列
+    for (int i = 0; i < N_WAITQ; i++) {
+        spinlock_init(&waitqs[i].lk, "waitq");
+        waitqs[i].head = NULL;
+    }
+
+    // 初始化运行队列
+    for (int i = 0; i < NCPU; i++) {
+        spinlock_init_ticket(&runqs[i].lk, "runq");
+        for (int l = 0; l < SCHED_LEVELS; l++) {
+            runqs[i].head[l] = runqs[i].tail[l] = NULL;
+        }
+        runqs[i].dl_head = NULL;
+        runqs[i].n = 0;
+        runqs[i].epoch = 0;
     }
     
+    // 进程描述符按需申请, 开始时空闲链表为空
+    kmem_cache_init(&proc_cache, "proc", sizeof(proc_t), MEMTAG_PROC);
+    kmem_cache_init(&mm_cache, "mm", sizeof(mm_t), MEMTAG_PROC);
+    kmem_cache_init(&fdt_cache, "fdtable", sizeof(fdtable_t), MEMTAG_PROC);
+    spinlock_init(&lk_reap, "mm_reap");
+    reap_head = NULL;
+    reap_work.fn = mm_reap;
+    reap_work.arg = NULL;
+    proc_free_list = NULL;
+
+    // 用户页表模板: 所有进程相同的PTE (跳板页、用户数据页与trapframe在同一张0级页表中)
+    assert(VDATA / MEGAPAGE_SIZE == TRAMPOLINE / MEGAPAGE_SIZE, "proc_init: VDATA outside the trampoline leaf table");
+    pgtbl_template.trampoline = PA_TO_PTE(trampoline) | PTE_R | PTE_X | PTE_V;
+    pgtbl_template.vdata = PA_TO_PTE(vdata_page()) | PTE_R | PTE_U | PTE_V;
 }
 
 // 获得一个初始化过的用户页表
-// 完成了trapframe 和 trampoline 的映射
+// 完成了trapframe、trampoline和用户数据页的映射
 pgtbl_t proc_pgtbl_init(uint64 trapframe)
 {
-    pgtbl_t pgtbl;
-
-    // 分配顶级页表
-    pgtbl = (pgtbl_t)pmem_alloc(false);
-    if (pgtbl == NULL) {
+    // 1. 顶级页表, 以及覆盖最高2MB的1级、0级页表 (跳板页、trapframe、用户数据页和用户栈都在这2MB中)
+    pgtbl_t pgtbl = vm_pgtbl_alloc();
+    pgtbl_t mid = vm_pgtbl_alloc();
+    pgtbl_t leaf = vm_pgtbl_alloc();
+    if (pgtbl == NULL || mid == NULL || leaf == NULL) {
         panic("proc_pgtbl_init: failed to allocate page table");
     }
-    memset(pgtbl, 0, PGSIZE);
-
-    // 映射跳板页（和内核页表共享同一虚拟地址和物理页）
-    vm_mappages(pgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
+    pgtbl[VA_TO_VPN(TRAMPOLINE, 2)] = PA_TO_PTE(mid) | PTE_V;
+    mid[VA_TO_VPN(TRAMPOLINE, 1)] = PA_TO_PTE(leaf) | PTE_V;
 
-    // 映射trapframe页
-    vm_mappages(pgtbl, TRAPFRAME, trapframe, PGSIZE, PTE_R | PTE_W);
+    // 2. 共享的跳板页和用户数据页的PTE从模板复制, 只有trapframe是每个进程私有的
+    leaf[VA_TO_VPN(TRAMPOLINE, 0)] = pgtbl_template.trampoline;
+    leaf[VA_TO_VPN(VDATA, 0)] = pgtbl_template.vdata;
+    leaf[VA_TO_VPN(TRAPFRAME, 0)] = PA_TO_PTE(trapframe) | PTE_R | PTE_W | PTE_V;
 
     return pgtbl;
 }
@@ -210,138 +1094,604 @@ void proc_make_first()
         panic("proc_make_first: failed to allocate process");
     }
     
-    // 第一个进程的pid设为0
+    // 第一个进程的pid设为0 (在散列表中换到0对应的桶)
+    free_pid(proczero);
+    spinlock_acquire(&lk_pid);
     proczero->pid = 0;
+    pid_hash_insert(proczero);
+    spinlock_release(&lk_pid);
     
     // ustack 映射 + 设置 ustack_pages 
     page = (uint64)pmem_alloc(false);
     if (page == 0) {
         panic("proc_make_first: failed to allocate user stack");
     }
-    memset((void*)page, 0, PGSIZE);
-    proczero->ustack_pages = 1;
+    proczero->mm->ustack_pages = 1;
     // 用户栈在 TRAPFRAME 下方
     uint64 ustack_va = TRAPFRAME - PGSIZE;
-    vm_mappages(proczero->pgtbl, ustack_va, page, PGSIZE, PTE_R | PTE_W | PTE_U);
+    vm_mappages(proczero->mm->pgtbl, ustack_va, page, PGSIZE, PTE_R | PTE_W | PTE_U);
+
+    // data + code 映射
+    assert(initcode_len <= PGSIZE, "proc_make_first: initcode too big\n");
+    page = (uint64)pmem_alloc(false);
+    if (page == 0) {
+        panic("proc_make_first: failed to allocate code page");
+    }
+    // 复制initcode到物理页
+    memmove((void*)page, initcode, initcode_len);
+    // 代码段在虚拟地址 PGSIZE (跳过最低的空白页)
+    vm_mappages(proczero->mm->pgtbl, PGSIZE, page, PGSIZE, PTE_R | PTE_W | PTE_X | PTE_U);
+
+    // 设置 heap_top
+    proczero->mm->heap_top = 2 * PGSIZE;  // 代码段之后
+    proczero->mm->image.end = 2 * PGSIZE;
+    
+    // 初始化空闲mmap区域为整个mmap区域
+    proczero->mm->mmap = mmap_tree_init();
+
+    // tf字段设置
+    proczero->tf->epc = PGSIZE;                     // 用户入口点（代码起始地址）
+    proczero->tf->sp = ustack_va + PGSIZE;          // 用户栈顶（栈向下生长）
+    proc_tf_init(proczero);                         // 内核页表、内核栈顶、陷阱入口
+
+    // 设置进程状态为RUNNABLE，让调度器调度它
+    proc_ready(proczero);
+    
+    // 释放alloc时获取的锁
+    spinlock_release(&proczero->lk);
+    
+    klog("[Process Manager] Init process (pid=%d) created successfully. Entry point=0x%lx, User stack top=0x%lx\n", 
+           proczero->pid, proczero->tf->epc, proczero->tf->sp);
+}
+
+// 进程复制
+// UNUSED -> RUNNABLE
+int proc_fork()
+{
+    proc_t* p = myproc();
+    
+    // 分配新进程
+    proc_t* np = proc_alloc();
+    if (np == NULL) {
+        return -1;
+    }
+    
+    // 复制地址空间和文件描述符表时不持有np->lk (复制可能很久, 其中还可能回收内存):
+    // np已经不在空闲链表中, 状态是UNUSED, proc_find找不到它, 没有别人会访问这个槽位
+    spinlock_release(&np->lk);
+
+    // 复制用户内存空间（用户栈和其他区域一样与父进程写时复制共享）
+    // 父进程是线程时只复制共享的地址空间 (系统调用在mm->lk下执行), 子进程只有调用fork的这一个线程
+    np->mm->ustack_pages = p->mm->ustack_pages;
+    
+    // 复制父进程的页表内容（代码、堆、栈、mmap等区域）
+    // 回收之后仍然内存不足: fork失败, 已经共享的页随子进程的页表释放
+    if (!uvm_copy_pgtbl(p->mm->pgtbl, np->mm->pgtbl, p->mm->heap_top, p->mm->ustack_pages, p->mm->mmap)) {
+        spinlock_acquire(&np->lk);
+        proc_free(np);
+        spinlock_release(&np->lk);
+        return -1;
+    }
+    
+    // 复制堆顶和mmap区域信息
+    np->mm->heap_top = p->mm->heap_top;
+    
+    // 复制空闲mmap区域树
+    np->mm->mmap = mmap_tree_copy(p->mm->mmap);
+    
+    // 继承父进程打开的文件（共享文件项, 管道两端因此可以跨进程使用）; 父进程的表已扩展时子进程同样扩展
+    if (proc_fd_copy(p, np) < 0) {
+        spinlock_acquire(&np->lk);
+        proc_free(np);
+        spinlock_release(&np->lk);
+        return -1;
+    }
+    
+    // 继承文件映射（共享页缓存中的页）
+    mmap_file_fork(p, np);
+
+    // 继承程序映像（页缓存中的代码页在子进程缺页时重新映射）
+    exec_fork(p, np);
+
+    // 继承共享内存的映射（页表项已直接共享）
+    shm_fork(p, np);
+    
+    // 复制trapframe,复制所有寄存器状态 (浮点寄存器另外复制)
+    memmove(np->tf, p->tf, sizeof(trapframe_t));
+    fpu_copy(p, np);
+    
+    // 设置子进程返回值为0（通过修改a0寄存器）
+    np->tf->a0 = 0;
+    
+    // 设置子进程的内核栈信息
+    proc_tf_init(np);
+    
+    // 设置父进程, 继承基础优先级和亲和性
+    spinlock_acquire(&np->lk);
+    proc_set_parent(np, p);
+    np->prio = np->base_prio = p->base_prio;
+    np->cpu_mask = p->cpu_mask;
+    np->sysrec = p->sysrec;
+    
+    // 保存子进程pid用于返回
+    int pid = np->pid;
+    
+    // 设置子进程状态为RUNNABLE（进入队列最短的hart的运行队列）
+    proc_ready(np);
+    
+    TRACE(TRACE_PROC, TRACE_EV_FORK, pid, 0);
+    
+    // 释放锁
+    spinlock_release(&np->lk);
+    
+    // 父进程返回子进程pid
+    return pid;
+}
+
+/*
+    创建线程: 与当前进程共享地址空间和文件描述符表 (见proc/proc.h)
+    线程从fn开始在用户态执行, a0 = arg, sp = stack, 其他寄存器与调用者相同; 父进程是调用者
+    trapframe在mmap区域中占一页, 映射到共享的页表中 (没有PTE_U, 用户不能访问)
+    地址空间已经共享时调用者持有mm->lk (见syscall.c)
+    成功返回线程的pid, 没有槽位、mmap区域或内存不足返回-1
+*/
+int proc_clone(uint64 fn, uint64 arg, uint64 stack)
+{
+    proc_t* p = myproc();
+    mm_t* mm = p->mm;
+
+    // 1. 获取槽位的锁之前申请trapframe并映射 (可能回收内存)
+    trapframe_t* tf = (trapframe_t*)pmem_alloc_flags(false, PMEM_ZERO | PMEM_TAG(MEMTAG_TRAPFRAME));
+    if (tf == NULL) {
+        return -1;
+    }
+    uint64 tf_va = uvm_mmap_find(1);
+    if (tf_va == 0 || !uvm_mmap_reserve(tf_va, 1)) {
+        pmem_free((uint64)tf, false);
+        return -1;
+    }
+    if (!vm_try_mappages(mm->pgtbl, tf_va, (uint64)tf, PGSIZE, PTE_R | PTE_W)) {
+        uvm_mmap_release(tf_va, 1);
+        pmem_free((uint64)tf, false);
+        return -1;
+    }
+
+    proc_t* np = proc_slot_get();
+    if (np == NULL) {
+        vm_unmappages(mm->pgtbl, tf_va, PGSIZE, false);
+        uvm_mmap_release(tf_va, 1);
+        pmem_free((uint64)tf, false);
+        return -1;
+    }
+    proc_setup(np, fork_return);
+
+    // 2. 共享地址空间和文件描述符表
+    __sync_fetch_and_add(&mm->ref, 1);
+    __sync_fetch_and_add(&p->fdt->ref, 1);
+    np->mm = mm;
+    np->fdt = p->fdt;
+    np->tf = tf;
+    np->tf_va = tf_va;
+
+    // 3. 用户态从fn(arg)开始, 使用调用者提供的栈
+    memmove(np->tf, p->tf, sizeof(trapframe_t));
+    fpu_copy(p, np);
+    np->tf->epc = fn;
+    np->tf->a0 = arg;
+    np->tf->sp = stack;
+    proc_tf_init(np);
+
+    // 设置父进程, 继承基础优先级和亲和性
+    proc_set_parent(np, p);
+    np->prio = np->base_prio = p->base_prio;
+    np->cpu_mask = p->cpu_mask;
+    np->sysrec = p->sysrec;
+    int pid = np->pid;
+    proc_ready(np);
+    spinlock_release(&np->lk);
+
+    TRACE(TRACE_PROC, TRACE_EV_CLONE, pid, fn);
+    return pid;
+}
+
+// 地址空间被线程共享时获取mm->lk, 已经持有时不再获取
+// 只有一个成员时不加锁: 只有这个成员自己能创建线程, 检查之后它不会在这次操作中变为共享
+bool mm_lock(proc_t* p)
+{
+    mm_t* mm = p->mm;
+    if (mm == NULL || mm->ref < 2 || sleeplock_holding(&mm->lk)) {
+        return false;
+    }
+    sleeplock_acquire(&mm->lk);
+    return true;
+}
+
+void mm_unlock(proc_t* p, bool locked)
+{
+    if (locked) {
+        sleeplock_release(&p->mm->lk);
+    }
+}
+
+// p的内存统计: 累加的计数 + 遍历页表得到的驻留页数和页表页数 (共享的地址空间统计整个地址空间)
+void proc_mem_stat(proc_t* p, mem_stat_t* st)
+{
+    mm_t* mm = p->mm;
+    *st = p->mstat;
+    st->rss_heap = uvm_resident_pages(mm->pgtbl, PGSIZE, PG_ROUND_UP(mm->heap_top));
+    st->rss_stack = uvm_resident_pages(mm->pgtbl, TRAPFRAME - mm->ustack_pages * PGSIZE, TRAPFRAME);
+    st->rss_mmap = uvm_resident_pages(mm->pgtbl, MMAP_BEGIN, MMAP_END);
+    st->rss_swap = swap_count(mm->pgtbl, PGSIZE, PG_ROUND_UP(mm->heap_top)) +
+                   swap_count(mm->pgtbl, TRAPFRAME - mm->ustack_pages * PGSIZE, TRAPFRAME) +
+                   swap_count(mm->pgtbl, MMAP_BEGIN, MMAP_END);
+    st->pgtbl_pages = uvm_pgtbl_pages(mm->pgtbl);
+}
+
+// 进程变为RUNNABLE, 排到p->rq_cpu的运行队列队尾
+// 别的hart的调度器取出p之后还要获取p->lk: 调用者放掉p->lk（或切换到调度器）之前p不会被运行
+void proc_ready(proc_t* p)
+{
+    assert(spinlock_holding(&p->lk), "proc_ready: not holding lock");
+    if (SCHED_IS_DL(p) && p->state == SLEEPING) {
+        sched_dl_wakeup(p);
+    }
+    sched_boost(p);
+    sched_place(p);
+    p->state = RUNNABLE;
+    p->ready_stamp = r_time();
+    runq_push(p->rq_cpu, p);
+}
+
+// 时钟中断时调用: 当前进程在自己的优先级上用掉一个tick
+// 时间片用完时降一级并放弃CPU; 自己的hart上有更高优先级的进程在排队时也放弃CPU (抢占)
+void proc_tick()
+{
+    proc_t* p = myproc();
+    if (sched_dl_exhausted(p)) {
+        sched_dl_throttle(p);
+        return;
+    }
+    spinlock_acquire(&p->lk);
+    sched_boost(p);
+    // 期限进程没有时间片 (按期限让出)
+    bool expired = !SCHED_IS_DL(p) && (++p->slice_used >= SCHED_SLICE(p->prio));
+    if (expired) {
+        // 继承来的优先级不降级 (持有的锁释放后自然回到原来的优先级)
+        if (p->prio < SCHED_LEVELS - 1 && p->pi_count == 0) {
+            p->prio++;
+        }
+        p->slice_used = 0;
+    }
+    if (expired || runq_has_higher(p->rq_cpu, p)) {
+        p->last_ran = timer_get_ticks();
+        proc_ready(p);
+        proc_sched();
+    }
+    spinlock_release(&p->lk);
+}
+
+// 抢占点: 本hart的运行队列中有优先级高于当前进程的进程时放弃CPU (不降级, 不计入时间片)
+// 在中断返回之前 (处理器间中断, 或者这次中断唤醒了更高优先级的进程)、返回用户态之前和proc_cond_resched中调用
+// ps: 调用者不持有自旋锁
+void proc_resched()
+{
+    proc_t* p = myproc();
+    if (sched_dl_exhausted(p)) {
+        sched_dl_throttle(p);
+        return;
+    }
+    spinlock_acquire(&p->lk);
+    mycpu()->need_resched = false;
+    if (runq_has_higher(p->rq_cpu, p)) {
+        p->last_ran = timer_get_ticks();
+        proc_ready(p);
+        proc_sched();
+    }
+    spinlock_release(&p->lk);
+}
+
+// 内核中可能运行很久的循环 (复制页表, 填充映射, 释放文件的数据块, 查找位图) 每一轮调用
+// 没有请求时只检查一个标志; 持有自旋锁或者关着中断时不让出 (由之后的抢占点处理)
+void proc_cond_resched()
+{
+    push_off();
+    cpu_t* c = mycpu();
+    bool need = c->need_resched && c->proc != NULL && c->noff == 1 && c->origin;
+    pop_off();
+    if (need) {
+        proc_resched();
+    }
+}
+
+// 设置pid的亲和性掩码 (可以运行的hart的位图, 只保留存在的hart)
+// 在队列中的进程立即换到允许的hart; 正在运行的进程在下一次放弃CPU时迁移
+// 成功返回0, 进程不存在或掩码中没有存在的hart返回-1
+int proc_setaffinity(int pid, uint32 mask)
+{
+    mask &= SCHED_ALL_CPUS;
+    if (mask == 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        pid = myproc()->pid;
+    }
+    proc_t* p = proc_find(pid);
+    if (p == NULL) {
+        return -1;
+    }
+    // 期限进程固定在准入时选择的hart上 (带宽记在那个hart上)
+    if (SCHED_IS_DL(p)) {
+        spinlock_release(&p->lk);
+        return -1;
+    }
+    p->cpu_mask = mask;
+    if (!sched_allowed(p, p->rq_cpu) && p->state == RUNNABLE && runq_remove(p)) {
+        sched_place(p);
+        runq_push(p->rq_cpu, p);
+    }
+    spinlock_release(&p->lk);
+    return 0;
+}
+
+// 设置是否录制pid的系统调用 (见syscall/sysrec.h), 进程不存在返回-1
+// 只在系统调用开始时读取: 当前这一次调用不受影响
+int proc_set_sysrec(int pid, bool on)
+{
+    if (pid == 0) {
+        pid = myproc()->pid;
+    }
+    proc_t* p = proc_find(pid);
+    if (p == NULL) {
+        return -1;
+    }
+    p->sysrec = on;
+    spinlock_release(&p->lk);
+    return 0;
+}
+
+// pid的亲和性掩码, 进程不存在返回-1
+int proc_getaffinity(int pid)
+{
+    if (pid == 0) {
+        return (int)myproc()->cpu_mask;
+    }
+    proc_t* p = proc_find(pid);
+    if (p == NULL) {
+        return -1;
+    }
+    int mask = (int)p->cpu_mask;
+    spinlock_release(&p->lk);
+    return mask;
+}
+
+// pid的状态快照 (在p->lk下读取)
+// 不获取lk_tree (proc_set_parent持有新进程的锁获取lk_tree): 父进程和只由进程自己修改的计数器不加锁读取, 仅供参考
+bool proc_info(int pid, proc_info_t* info)
+{
+    proc_t* p = proc_find(pid);
+    if (p == NULL) {
+        return false;
+    }
+    memset(info, 0, sizeof(*info));
+    info->pid = p->pid;
+    info->ppid = (p->parent != NULL) ? p->parent->pid : 0;
+    info->state = p->state;
+    info->kthread = (p->kfn != NULL);
+    info->prio = p->prio;
+    info->base_prio = p->base_prio;
+    info->cpu = p->rq_cpu;
+    info->cpu_mask = p->cpu_mask;
+    info->last_ran = p->last_ran;
+    for (int i = 0; i <= SYS_MAX; i++) {
+        info->syscalls += p->sc[i].calls;
+        info->sys_errors += p->sc[i].errors;
+        info->sys_time += p->sc[i].time;
+    }
+    info->mstat = p->mstat;
+    info->io = p->io;
+    info->cstat = p->cstat;
+    spinlock_release(&p->lk);
+    return true;
+}
+
+// 负载均值 (FSHIFT位小数): 只由抢到load_next的hart更新, 读取不加锁
+static volatile uint64 loadavg[3];
+static volatile uint64 load_next;   // 下一次采样的mtime (0: 还没有采样过)
+
+#define LOAD_MISSED_MAX 180         // 一次最多补上的采样间隔 (15分钟: 之后三个均值都已接近当前值)
+
+// 当前可运行的进程数: 各运行队列中的和各hart上正在运行的 (不加锁读取, 只用于统计)
+static int sched_nr_running()
+{
+    int n = 0;
+    for (int i = 0; i < ncpu; i++) {
+        n += runqs[i].n;
+        if (cpu_of(i)->proc != NULL) {
+            n++;
+        }
+    }
+    return n;
+}
+
+// 一次指数平均: load * exp + active * (1 - exp), 上升时向上取整 (与Linux的calc_load相同)
+static uint64 sched_calc_load(uint64 load, uint64 exp, uint64 active)
+{
+    uint64 newload = load * exp + active * (FIXED_1 - exp);
+    if (active >= load) {
+        newload += FIXED_1 - 1;
+    }
+    return newload / FIXED_1;
+}
 
-    // data + code 映射
-    assert(initcode_len <= PGSIZE, "proc_make_first: initcode too big\n");
-    page = (uint64)pmem_alloc(false);
-    if (page == 0) {
-        panic("proc_make_first: failed to allocate code page");
+// tickless空闲时错过的采样间隔按当前的可运行数补上
+void proc_loadavg_tick()
+{
+    uint64 now = timer_get_mtime();
+    uint64 next = load_next;
+    if (now < next) {
+        return;
+    }
+    uint64 missed = (next == 0) ? 1 : (now - next) / LOAD_FREQ + 1;
+    uint64 new_next = (next == 0) ? now + LOAD_FREQ : next + missed * LOAD_FREQ;
+    if (!__sync_bool_compare_and_swap(&load_next, next, new_next)) {
+        return;  // 别的hart在更新这个间隔
+    }
+    if (missed > LOAD_MISSED_MAX) {
+        missed = LOAD_MISSED_MAX;
     }
-    memset((void*)page, 0, PGSIZE);
-    // 复制initcode到物理页
-    memmove((void*)page, initcode, initcode_len);
-    // 代码段在虚拟地址 PGSIZE (跳过最低的空白页)
-    vm_mappages(proczero->pgtbl, PGSIZE, page, PGSIZE, PTE_R | PTE_W | PTE_X | PTE_U);
 
-    // 设置 heap_top
-    proczero->heap_top = 2 * PGSIZE;  // 代码段之后
-    
-    // 初始化 mmap 链表为空
-    proczero->mmap = NULL;
+    uint64 active = (uint64)sched_nr_running() * FIXED_1;
+    for (uint64 i = 0; i < missed; i++) {
+        loadavg[0] = sched_calc_load(loadavg[0], EXP_1, active);
+        loadavg[1] = sched_calc_load(loadavg[1], EXP_5, active);
+        loadavg[2] = sched_calc_load(loadavg[2], EXP_15, active);
+    }
+}
 
-    // tf字段设置
-    proczero->tf->epc = PGSIZE;                     // 用户入口点（代码起始地址）
-    proczero->tf->sp = ustack_va + PGSIZE;          // 用户栈顶（栈向下生长）
-    proczero->tf->kernel_satp = r_satp();           // 内核页表
-    proczero->tf->kernel_sp = proczero->kstack + PGSIZE;   // 内核栈顶
-    proczero->tf->kernel_trap = (uint64)trap_user_handler;
-    proczero->tf->kernel_hartid = r_tp();
+void proc_loadavg(uint64 avg[3], int* running)
+{
+    for (int i = 0; i < 3; i++) {
+        avg[i] = loadavg[i];
+    }
+    *running = sched_nr_running();
+}
 
-    // 设置进程状态为RUNNABLE，让调度器调度它
-    proczero->state = RUNNABLE;
-    
-    // 释放alloc时获取的锁
-    spinlock_release(&proczero->lk);
-    
-    // 替换原有输出：修改格式、前缀、表述内容
-    printf("[Process Manager] Init process (pid=%d) created successfully. Entry point=0x%lx, User stack top=0x%lx\n", 
-           proczero->pid, proczero->tf->epc, proczero->tf->sp);
+// 设置pid的基础优先级并立即回到这个优先级 (在运行队列中的进程换到新优先级的队尾)
+int proc_setpriority(int pid, int prio)
+{
+    if (prio < 0 || prio >= SCHED_LEVELS) {
+        return -1;
+    }
+    if (pid == 0) {
+        pid = myproc()->pid;
+    }
+    proc_t* p = proc_find(pid);
+    if (p == NULL) {
+        return -1;
+    }
+    int old = p->base_prio;
+    p->base_prio = prio;
+    // 在队列中的进程摘下后按新优先级重新入队 (不在队列中的进程由取出它的一方处理)
+    bool requeue = (p->state == RUNNABLE && runq_remove(p));
+    sched_set_prio(p, prio);
+    p->slice_used = 0;
+    if (requeue) {
+        runq_push(p->rq_cpu, p);
+    }
+    spinlock_release(&p->lk);
+    return old;
 }
 
-// 进程复制
-// UNUSED -> RUNNABLE
-int proc_fork()
+/*
+    当前进程进入期限调度类 (见proc/proc.h): 每period得到runtime, 期限为周期开始后deadline (mtime单位)
+    runtime = 0时离开期限类回到普通进程 (退出时也由proc_exit调用)
+    准入控制在剩余带宽最多的允许的hart上进行, 放不下时返回-1 (原来的参数不变); 成功后立即开始一个周期,
+    所选的hart不是现在的hart时让出一次CPU迁移过去
+    参数无效 (runtime < SCHED_DL_RUNTIME_MIN, 或不满足runtime <= deadline <= period <= SCHED_DL_PERIOD_MAX) 返回-1
+*/
+int proc_setdeadline(uint64 runtime, uint64 deadline, uint64 period)
 {
     proc_t* p = myproc();
-    
-    // 替换原有输出：新增进程操作标识，修改调试信息表述
-    printf("[Process Operation] Fork request received from process (pid=%d). Starting child process creation...\n", p->pid);
-    
-    // 分配新进程
-    proc_t* np = proc_alloc();
-    if (np == NULL) {
+    if (runtime != 0 && (runtime < SCHED_DL_RUNTIME_MIN || runtime > deadline || deadline > period || period > SCHED_DL_PERIOD_MAX)) {
         return -1;
     }
-    
-    // 复制用户内存空间
-    // 首先为新进程分配用户栈
-    uint64 page = (uint64)pmem_alloc(false);
-    if (page == 0) {
-        proc_free(np);
-        spinlock_release(&np->lk);
-        return -1;
+    uint64 bw = (runtime == 0) ? 0 : (runtime << SCHED_DL_BW_SHIFT) / period;
+
+    // 1. 准入控制: 先归还原来的带宽, 新的带宽放不下时恢复
+    int cpu = -1;
+    spinlock_acquire(&lk_dl);
+    if (SCHED_IS_DL(p)) {
+        dl_bw[p->rq_cpu] -= p->dl_bw;
     }
-    memset((void*)page, 0, PGSIZE);
-    np->ustack_pages = p->ustack_pages;
-    uint64 ustack_va = TRAPFRAME - PGSIZE;
-    vm_mappages(np->pgtbl, ustack_va, page, PGSIZE, PTE_R | PTE_W | PTE_U);
-    
-    // 复制父进程的页表内容（代码、堆、mmap等区域）
-    uvm_copy_pgtbl(p->pgtbl, np->pgtbl, p->heap_top, p->ustack_pages, p->mmap);
-    
-    // 复制堆顶和mmap区域信息
-    np->heap_top = p->heap_top;
-    
-    // 复制mmap链表
-    mmap_region_t* src_mmap = p->mmap;
-    mmap_region_t** dst_mmap = &np->mmap;
-    while (src_mmap != NULL) {
-        mmap_region_t* new_mmap = mmap_region_alloc();
-        if (new_mmap == NULL) {
-            proc_free(np);
-            spinlock_release(&np->lk);
+    if (runtime != 0) {
+        for (int i = 0; i < ncpu; i++) {
+            if (sched_allowed(p, i) && dl_bw[i] + bw <= SCHED_DL_BW_MAX && (cpu < 0 || dl_bw[i] < dl_bw[cpu])) {
+                cpu = i;
+            }
+        }
+        if (cpu < 0) {
+            if (SCHED_IS_DL(p)) {
+                dl_bw[p->rq_cpu] += p->dl_bw;
+            }
+            spinlock_release(&lk_dl);
             return -1;
         }
-        new_mmap->begin = src_mmap->begin;
-        new_mmap->npages = src_mmap->npages;
-        new_mmap->next = NULL;
-        *dst_mmap = new_mmap;
-        dst_mmap = &new_mmap->next;
-        src_mmap = src_mmap->next;
+        dl_bw[cpu] += bw;
     }
-    
-    // 复制trapframe,复制所有寄存器状态
-    memmove(np->tf, p->tf, sizeof(trapframe_t));
-    
-    // 设置子进程返回值为0（通过修改a0寄存器）
-    np->tf->a0 = 0;
-    
-    // 设置子进程的内核栈信息
-    np->tf->kernel_sp = np->kstack + PGSIZE;
-    np->tf->kernel_satp = r_satp();
-    np->tf->kernel_trap = (uint64)trap_user_handler;
-    
-    // 设置父进程
-    np->parent = p;
-    
-    // 保存子进程pid用于返回
-    int pid = np->pid;
-    
-    // 设置子进程状态为RUNNABLE
-    np->state = RUNNABLE;
-    
-    // 替换原有输出：增强信息维度，修改表述风格
-    printf("[Process Operation] Child process (pid=%d) created successfully by parent (pid=%d). Ready for scheduling.\n", 
-           pid, p->pid);
-    
-    // 释放锁
-    spinlock_release(&np->lk);
-    
-    // 父进程返回子进程pid
-    return pid;
+    spinlock_release(&lk_dl);
+
+    // 2. 原来的运行时间定时器作废 (回调可能已经要求让出: 之后只是多检查一次)
+    ktimer_del(&p->dl_budget);
+
+    // 3. 新的参数立即开始一个周期, 经过一次让出进入所选hart的运行队列
+    spinlock_acquire(&p->lk);
+    p->dl_runtime = runtime;
+    p->dl_deadline = deadline;
+    p->dl_period = period;
+    p->dl_bw = bw;
+    if (runtime != 0) {
+        uint64 now = timer_get_mtime();
+        p->dl_abs = now + deadline;
+        p->dl_remain = runtime;
+        p->dl_start = now;
+        p->rq_cpu = cpu;
+        p->last_ran = timer_get_ticks();
+        proc_ready(p);
+        proc_sched();
+    }
+    spinlock_release(&p->lk);
+    return 0;
+}
+
+// 期限进程返回用户态之前: 运行时间用完的时刻设置定时器, 在用户态用完时由回调要求让出
+// 关中断: 期间不会离开CPU, dl_start不变; 本hart的下一次时钟中断不晚于这个定时器
+void proc_dl_arm(proc_t* p)
+{
+    if (!SCHED_IS_DL(p)) {
+        return;
+    }
+    push_off();
+    ktimer_del(&p->dl_budget);
+    ktimer_add(&p->dl_budget, p->dl_start + p->dl_remain);
+    timer_rearm();
+    pop_off();
+}
+
+// 优先级继承: 睡眠锁的等待者把持有者owner提升到自己的优先级prio (owner不比它低时不变, 返回false)
+// first: 这个锁还没有提升过owner (之后owner释放它时调用proc_pi_restore); 在运行队列中的owner换到新优先级的队尾
+// 调用者持有睡眠锁的lk: owner在这期间不会释放锁, 也不会退出; 加锁顺序: 睡眠锁的lk -> owner->lk
+bool proc_pi_boost(proc_t* owner, int prio, bool first)
+{
+    spinlock_acquire(&owner->lk);
+    bool boost = (owner->prio > prio);
+    if (boost) {
+        bool requeue = (owner->state == RUNNABLE && runq_remove(owner));
+        if (first && owner->pi_count++ == 0) {
+            owner->pi_saved = owner->prio;
+        }
+        owner->prio = prio;
+        if (requeue) {
+            runq_push(owner->rq_cpu, owner);
+        }
+    }
+    spinlock_release(&owner->lk);
+    return boost;
+}
+
+// 当前进程释放了一个提升过它的睡眠锁: 这是最后一个时回到原来的优先级
+// 本hart的队列中因此有了更高优先级的进程时设置need_resched (由调用者之后的抢占点让出)
+void proc_pi_restore()
+{
+    proc_t* p = myproc();
+    spinlock_acquire(&p->lk);
+    assert(p->pi_count > 0, "proc_pi_restore: not boosted");
+    if (--p->pi_count == 0) {
+        p->prio = p->pi_saved;
+        if (runq_has_higher(p->rq_cpu, p)) {
+            mycpu()->need_resched = true;
+        }
+    }
+    spinlock_release(&p->lk);
 }
 
 // 进程放弃CPU的控制权
@@ -350,91 +1700,308 @@ void proc_yield()
 {
     proc_t* p = myproc();
     spinlock_acquire(&p->lk);
-    p->state = RUNNABLE;
+    p->last_ran = timer_get_ticks();
+    proc_ready(p);
     proc_sched();
     spinlock_release(&p->lk);
 }
 
+// 新进程np加入p的子进程链表 (np还没有运行, 调用者持有np->lk: np不是任何进程的父进程, 不会与proc_exit死锁)
+void proc_set_parent(proc_t* np, proc_t* p)
+{
+    spinlock_acquire(&lk_tree);
+    np->parent = p;
+    np->sib_prev = NULL;
+    np->sib_next = p->children;
+    if (p->children != NULL) {
+        p->children->sib_prev = np;
+    }
+    p->children = np;
+    spinlock_release(&lk_tree);
+}
+
 // 等待一个子进程进入 ZOMBIE 状态
 // 将退出的子进程的exit_state放入用户给的地址 addr
 // 成功返回子进程pid，失败返回-1
+// 退出的子进程在父进程的僵尸队列中排队: 取队头即可, 不需要扫描进程表
 int proc_wait(uint64 addr)
 {
     proc_t* p = myproc();
-    int havekids, pid;
-    
-    // 替换原有输出：修改等待操作的表述，增加进程标识清晰度
-    printf("[Process Synchronization] Process (pid=%d) entering wait state, waiting for child process exit...\n", p->pid);
     
-    spinlock_acquire(&p->lk);
+    TRACE(TRACE_PROC, TRACE_EV_WAIT, 0, 0);
     
-    for (;;) {
-        // 扫描进程表查找已退出的子进程
-        havekids = 0;
-        for (int i = 0; i < NPROC; i++) {
-            proc_t* pp = &procs[i];
-            if (pp->parent == p) {
-                spinlock_acquire(&pp->lk);
-                havekids = 1;
-                
-                if (pp->state == ZOMBIE) {
-                    // 找到已退出的子进程,回收子进程资源并返回子进程PID
-                    pid = pp->pid;
-                    
-                    // 替换原有输出：增强退出状态信息，修改调试格式
-                    printf("[Process Synchronization] Process (pid=%d) detected zombie child (pid=%d), exit status: %d. Starting resource reclamation...\n", 
-                           p->pid, pid, pp->exit_state);
-                    
-                    // 如果用户提供了地址，复制exit_state
-                    if (addr != 0) {
-                        uvm_copyout(p->pgtbl, addr, (uint64)&pp->exit_state, sizeof(int));
-                    }
-                    
-                    // 释放子进程资源
-                    proc_free(pp);
-                    spinlock_release(&pp->lk);
-                    spinlock_release(&p->lk);
-                    return pid;
-                }
-                
-                spinlock_release(&pp->lk);
-            }
-        }
-        
+    spinlock_acquire(&lk_tree);
+    while (p->zombie_head == NULL) {
         // 没有子进程
-        if (!havekids) {
-            spinlock_release(&p->lk);
+        if (p->children == NULL) {
+            spinlock_release(&lk_tree);
             return -1;
         }
         
         // 等待子进程退出
-        // 替换原有输出：修改睡眠操作的表述，增加进程状态信息
-        printf("[Process Synchronization] Process (pid=%d) has no exited children, entering sleep state...\n", p->pid);
-        proc_sleep(p, &p->lk);
-        printf("[Process Synchronization] Process (pid=%d) woken up, resuming wait operation...\n", p->pid);
+        TRACE(TRACE_PROC, TRACE_EV_WAIT, 1, 0);
+        proc_sleep(p, &lk_tree);
+    }
+
+    // 取出僵尸队列的队头, 从子进程链表中摘下
+    proc_t* pp = p->zombie_head;
+    p->zombie_head = pp->zombie_next;
+    if (p->zombie_head == NULL) {
+        p->zombie_tail = NULL;
+    }
+    if (pp->sib_prev != NULL) {
+        pp->sib_prev->sib_next = pp->sib_next;
+    } else {
+        p->children = pp->sib_next;
+    }
+    if (pp->sib_next != NULL) {
+        pp->sib_next->sib_prev = pp->sib_prev;
+    }
+
+    // 子进程在持有lk_tree时变为ZOMBIE, 它的锁在切换到调度器之后才释放
+    spinlock_acquire(&pp->lk);
+    spinlock_release(&lk_tree);
+    assert(pp->state == ZOMBIE, "proc_wait: queued child not zombie");
+    int pid = pp->pid;
+    int exit_state = pp->exit_state;
+    p->cstat.cutime += pp->cstat.utime + pp->cstat.cutime;
+    p->cstat.cstime += pp->cstat.stime + pp->cstat.cstime;
+    
+    TRACE(TRACE_PROC, TRACE_EV_REAP, pid, exit_state);
+    
+    // 释放子进程资源: 地址空间先摘下, 放开锁之后交给工作线程销毁
+    mm_t* mm = pp->mm;
+    assert(mm == NULL || mm->ref <= 1, "proc_wait: address space still shared");
+    pp->mm = NULL;
+    proc_free(pp);
+    spinlock_release(&pp->lk);
+    if (mm != NULL) {
+        mm_free_deferred(mm);
+    }
+
+    // 不持有锁时复制exit_state (可能缺页)
+    if (addr != 0) {
+        uvm_copyout(p->mm->pgtbl, addr, (uint64)&exit_state, sizeof(int));
     }
+    return pid;
 }
 
-// 父进程退出，子进程认proczero做父，因为它永不退出
+// 父进程退出，子进程认proczero做父，因为它永不退出 (调用者持有lk_tree)
+// 子进程链表和僵尸队列整个接到proczero上, 只访问parent自己的子进程
 static void proc_reparent(proc_t* parent)
 {
-    for (int i = 0; i < NPROC; i++) {
-        proc_t* p = &procs[i];
-        if (p->parent == parent) {
-            p->parent = proczero;
+    if (parent->children == NULL) {
+        return;
+    }
+    proc_t* last = NULL;
+    for (proc_t* c = parent->children; c != NULL; c = c->sib_next) {
+        c->parent = proczero;
+        last = c;
+    }
+    last->sib_next = proczero->children;
+    if (proczero->children != NULL) {
+        proczero->children->sib_prev = last;
+    }
+    proczero->children = parent->children;
+    parent->children = NULL;
+
+    // 已经退出的子进程交给proczero回收
+    if (parent->zombie_head != NULL) {
+        if (proczero->zombie_tail == NULL) {
+            proczero->zombie_head = parent->zombie_head;
+        } else {
+            proczero->zombie_tail->zombie_next = parent->zombie_head;
+        }
+        proczero->zombie_tail = parent->zombie_tail;
+        parent->zombie_head = parent->zombie_tail = NULL;
+        proc_wakeup(proczero);
+    }
+}
+
+// 文件描述符表扩展为一整页table (FILE_MAX_PROC项, 调用者在锁外申请), 已有的fd保持不变
+// 调用者持有fdt->lk或表还没有共享; 已经扩展过时返回false (由调用者释放table)
+static bool fdt_expand(fdtable_t* fdt, file_t** table)
+{
+    if (fdt->filelist != fdt->fd_small) {
+        return false;
+    }
+    memset(table, 0, PGSIZE);
+    memmove(table, fdt->fd_small, sizeof(fdt->fd_small));
+    fdt->filelist = table;
+    fdt->nfile = FILE_MAX_PROC;
+    return true;
+}
+
+// 为file分配最小的空闲fd, 表满时扩展 (扩展的一页在锁外申请, 期间别的线程可能已经扩展或释放了fd)
+// 成功返回fd 失败返回-1
+int proc_fd_alloc(proc_t* p, file_t* file)
+{
+    fdtable_t* fdt = p->fdt;
+    file_t** table = NULL;
+    int fd = -1;
+
+    spinlock_acquire(&fdt->lk);
+    for (;;) {
+        for (uint32 i = 0; i < fdt->nfile; i++) {
+            if (fdt->filelist[i] == NULL) {
+                fd = i;
+                break;
+            }
+        }
+        if (fd >= 0 || fdt->filelist != fdt->fd_small) {
+            break;
+        }
+        if (table == NULL) {
+            spinlock_release(&fdt->lk);
+            table = (file_t**)pmem_alloc_flags(true, PMEM_ZERO | PMEM_TAG(MEMTAG_PROC));
+            spinlock_acquire(&fdt->lk);
+            if (table == NULL) {
+                break;
+            }
+            continue;
         }
+        fdt_expand(fdt, table);
+        table = NULL;
+    }
+    if (fd >= 0) {
+        fdt->filelist[fd] = file;
+    }
+    spinlock_release(&fdt->lk);
+
+    if (table != NULL) {
+        pmem_free((uint64)table, true);
     }
+    return fd;
 }
 
-// 唤醒一个进程（被proc_exit调用唤醒父进程）
-static void proc_wakeup_one(proc_t* p)
+// fd对应的文件, fd无效或没有打开时返回NULL
+// 表被线程共享时另一个线程可能随时关闭fd: 持有文件的一个引用, 系统调用返回时由proc_fd_unhold放弃
+file_t* proc_fd_get(proc_t* p, int fd)
 {
-    // 不需要断言，直接检查条件
-    spinlock_acquire(&p->lk);
-    if (p->state == SLEEPING && p->sleep_space == p) {
-        p->state = RUNNABLE;
+    fdtable_t* fdt = p->fdt;
+    file_t* file = NULL;
+
+    spinlock_acquire(&fdt->lk);
+    if (fd >= 0 && fd < (int)fdt->nfile) {
+        file = fdt->filelist[fd];
     }
-    spinlock_release(&p->lk);
+    if (file != NULL && fdt->ref > 1) {
+        assert(p->nhold < FILE_HOLD_MAX, "proc_fd_get: too many held files");
+        p->fd_hold[p->nhold++] = file_dup(file);
+    }
+    spinlock_release(&fdt->lk);
+    return file;
+}
+
+// fd对应的文件的一个新引用 (由调用者关闭), 无效或没有打开时返回NULL
+// 需要同时使用多于FILE_HOLD_MAX个文件 (sys_poll), 或者在系统调用之后继续持有 (epoll) 时使用
+file_t* proc_fd_dup(proc_t* p, int fd)
+{
+    fdtable_t* fdt = p->fdt;
+    file_t* file = NULL;
+
+    spinlock_acquire(&fdt->lk);
+    if (fd >= 0 && fd < (int)fdt->nfile && fdt->filelist[fd] != NULL) {
+        file = file_dup(fdt->filelist[fd]);
+    }
+    spinlock_release(&fdt->lk);
+    return file;
+}
+
+// 放弃proc_fd_get持有的引用 (可能是文件的最后一个引用)
+void proc_fd_unhold(proc_t* p)
+{
+    while (p->nhold > 0) {
+        file_close(p->fd_hold[--p->nhold]);
+    }
+}
+
+// 从表中移除fd, 返回它的文件 (调用者关闭), fd无效或没有打开时返回NULL
+file_t* proc_fd_clear(proc_t* p, int fd)
+{
+    fdtable_t* fdt = p->fdt;
+    file_t* file = NULL;
+
+    spinlock_acquire(&fdt->lk);
+    if (fd >= 0 && fd < (int)fdt->nfile) {
+        file = fdt->filelist[fd];
+        fdt->filelist[fd] = NULL;
+    }
+    spinlock_release(&fdt->lk);
+    return file;
+}
+
+// 新进程np的表复制p的表 (共享文件项, 每个文件的引用+1), p的表已扩展时np同样扩展
+// 成功返回0 内存不足返回-1
+int proc_fd_copy(proc_t* p, proc_t* np)
+{
+    fdtable_t* src = p->fdt;
+    fdtable_t* dst = np->fdt;
+
+    // 扩展的一页在锁外申请 (np的表还没有共享)
+    spinlock_acquire(&src->lk);
+    while (src->nfile > dst->nfile) {
+        spinlock_release(&src->lk);
+        file_t** table = (file_t**)pmem_alloc_flags(true, PMEM_ZERO | PMEM_TAG(MEMTAG_PROC));
+        if (table == NULL) {
+            return -1;
+        }
+        fdt_expand(dst, table);
+        spinlock_acquire(&src->lk);
+    }
+    for (uint32 fd = 0; fd < src->nfile; fd++) {
+        if (src->filelist[fd] != NULL) {
+            dst->filelist[fd] = file_dup(src->filelist[fd]);
+        }
+    }
+    spinlock_release(&src->lk);
+    return 0;
+}
+
+// 退出的进程离开地址空间: 解除自己的trapframe的映射 (线程还要归还它占用的mmap区域)
+// 最后一个成员写回文件映射、放弃程序映像和共享内存, 页表留给父进程在proc_free中销毁;
+// 还有其他成员时p->mm置为NULL
+static void mm_exit(proc_t* p)
+{
+    mm_t* mm = p->mm;
+    bool locked = mm_lock(p);
+    vm_unmappages(mm->pgtbl, p->tf_va, PGSIZE, false);
+    asid_flush_page(p, p->tf_va);
+    if (p->tf_va != TRAPFRAME) {
+        uvm_mmap_release(p->tf_va, 1);
+    }
+    mm_unlock(p, locked);
+
+    if (__sync_sub_and_fetch(&mm->ref, 1) > 0) {
+        p->mm = NULL;
+        return;
+    }
+
+    // 写回并解除文件映射
+    mmap_file_exit(p);
+
+    // 归还程序映像中的页缓存页和可执行文件
+    exec_release(p);
+
+    // 放弃共享内存的映射
+    shm_exit(p);
+}
+
+// 退出的进程离开文件描述符表: 最后一个成员关闭打开的文件（管道的另一端因此能看到EOF或读端关闭）并释放表
+static void fdt_exit(proc_t* p)
+{
+    fdtable_t* fdt = p->fdt;
+    p->fdt = NULL;
+    if (__sync_sub_and_fetch(&fdt->ref, 1) > 0) {
+        return;
+    }
+    for (uint32 fd = 0; fd < fdt->nfile; fd++) {
+        if (fdt->filelist[fd] != NULL) {
+            file_close(fdt->filelist[fd]);
+            fdt->filelist[fd] = NULL;
+        }
+    }
+    fdt_free(fdt);
 }
 
 // 进程退出
@@ -442,29 +2009,49 @@ void proc_exit(int exit_state)
 {
     proc_t* p = myproc();
     
-    // 替换原有输出：修改退出操作的表述，增加退出状态信息
-    printf("[Process Operation] Process (pid=%d) initiating exit procedure, exit status: %d\n", p->pid, exit_state);
+    TRACE(TRACE_PROC, TRACE_EV_EXIT, exit_state, 0);
     
     if (p == proczero) {
         panic("proc_exit: proczero exiting");
     }
     
+    // 系统调用中从共享的文件描述符表取出的文件 (sys_exit不返回到syscall)
+    proc_fd_unhold(p);
+
+    // 离开期限调度类, 归还带宽
+    if (SCHED_IS_DL(p)) {
+        proc_setdeadline(0, 0, 0);
+    }
+
+    // 等待提交/完成队列交给工作线程的请求完成, 放弃队列 (队列的页随页表释放)
+    uring_drain(p);
+
+    // 离开地址空间 (最后一个成员拆除文件映射、程序映像和共享内存)
+    mm_exit(p);
+    
+    // 离开文件描述符表 (最后一个成员关闭打开的文件)
+    fdt_exit(p);
+    
     // 将子进程托付给proczero
+    spinlock_acquire(&lk_tree);
     proc_reparent(p);
     
-    // 唤醒父进程（它可能在wait中睡眠）
-    // 替换原有输出：修改唤醒操作的表述，增加父子进程标识
-    printf("[Process Synchronization] Process (pid=%d) waking up its parent process (pid=%d) for exit notification...\n", 
-           p->pid, p->parent->pid);
-    proc_wakeup_one(p->parent);
-    
-    // 获取锁，设置退出状态
+    // 获取锁，设置退出状态，进入父进程的僵尸队列
     spinlock_acquire(&p->lk);
     p->exit_state = exit_state;
     p->state = ZOMBIE;
+    proc_t* parent = p->parent;
+    p->zombie_next = NULL;
+    if (parent->zombie_tail == NULL) {
+        parent->zombie_head = p;
+    } else {
+        parent->zombie_tail->zombie_next = p;
+    }
+    parent->zombie_tail = p;
     
-    // 替换原有输出：修改僵尸进程的表述，增加进程状态信息
-    printf("[Process Operation] Process (pid=%d) has entered ZOMBIE state, waiting for parent to reclaim resources.\n", p->pid);
+    // 唤醒父进程（它可能在wait中睡眠, 睡眠在lk_tree上, 所以持有lk_tree唤醒不会丢失）
+    proc_wakeup(parent);
+    spinlock_release(&lk_tree);
     
     // 切换到调度器，永不返回
     proc_sched();
@@ -472,7 +2059,25 @@ void proc_exit(int exit_state)
     panic("proc_exit: zombie exit");
 }
 
-// 进程切换到调度器
+#ifdef TIME_STAT
+static uint64 sched_enter[NCPU];   // proc_sched进入swtch的时刻 (计时到调度器从swtch返回)
+#endif
+
+// 从swtch返回到进程 (proc_sched之后, 或新进程的入口): 从另一个进程直接切换过来时放开它的锁
+// 它的上下文已经保存, 其他hart从此可以运行它
+static void sched_switch_done()
+{
+    cpu_t* c = mycpu();
+    proc_t* prev = c->prev;
+    if (prev != NULL) {
+        c->prev = NULL;
+        TSTAT_END(sched_enter[mycpuid()], TSTAT_SWTCH);
+        spinlock_release(&prev->lk);
+    }
+}
+
+// 进程让出CPU: 本hart的运行队列中有可以运行的进程时直接切换到它 (一次swtch, 不经过调度器),
+// 队列为空或者取不到时切换到调度器 (由它窃取其他hart的进程或者等待中断)
 // ps: 调用者保证持有当前进程的锁
 void proc_sched()
 {
@@ -493,56 +2098,128 @@ void proc_sched()
     // 保存中断状态
     int intena = mycpu()->origin;
     
-    // 切换到调度器上下文
-    swtch(&p->ctx, &mycpu()->ctx);
-    
-    // 恢复中断状态
+    // 浮点寄存器被修改过时保存 (之后FS = Off, 下一个在这个hart上运行的进程重新装入自己的)
+    fpu_switch_out(p);
+    sched_dl_charge(p);
+
+    // 下一个进程 (持有它的锁); 取到自己 (proc_yield放回队列后仍是优先级最高的) 时不切换
+    // 取之前清除need_resched: 之后入队的更高优先级的进程会重新设置
+    cpu_t* c = mycpu();
+    int id = mycpuid();
+    c->need_resched = false;
+    proc_t* np = runq_pop_locked(id, p);
+    if (np == p) {
+        p->state = RUNNING;
+        sched_dl_start(p);
+        return;
+    }
+    sched_acct_out(p);
+
+    TSTAT_MARK(sched_enter[id]);
+    if (np != NULL) {
+        // 直接切换: p的锁由np放开 (sched_switch_done)
+        assert(np->state == RUNNABLE, "proc_sched: queued process not runnable");
+        TRACE(TRACE_SCHED, TRACE_EV_SWITCH, np->pid, np->prio);
+        np->state = RUNNING;
+        np->rq_cpu = id;
+        sched_dl_start(np);
+        sched_acct_in(np);
+        c->proc = np;
+        c->prev = p;
+        kvm_kstack_sync();
+        KSTAT_INC(ctx_switches);
+        swtch(&p->ctx, &np->ctx);
+    } else {
+        // 切换到调度器上下文
+        swtch(&p->ctx, &c->ctx);
+    }
+
+    // 回到p (可能在另一个hart上): 放开直接切换过来的进程的锁, 恢复中断状态
+    sched_switch_done();
     mycpu()->origin = intena;
 }
 
+// 空闲的hart下一次需要醒来的tick (0: 没有期限, 定时器由时间轮自己给出): hart 0还有定时写回
+static uint64 sched_idle_deadline(int id)
+{
+    return (id == 0) ? kwork_next_tick() : 0;
+}
+
 // 调度器
 void proc_scheduler()
 {
     cpu_t* c = mycpu();
     c->proc = NULL;
     
-    // 记录每个CPU上一次运行的进程pid，用于减少重复输出
-    static int last_pid[NCPU] = {-1, -1};
-    
-    // 替换原有输出：修改调度器入口的表述，增加CPU标识清晰度
-    printf("[Scheduler] CPU %d has entered the global process scheduler loop.\n", mycpuid());
+    klog("[Scheduler] CPU %d has entered the global process scheduler loop.\n", mycpuid());
     
     for (;;) {
         // 开启中断以处理设备中断，响应时钟
         intr_on();
         
-        //遍历进程表，找到RUNNABLE状态的进程
-        for (int i = 0; i < NPROC; i++) {
-            proc_t* p = &procs[i];
+        // 从自己的运行队列取一个进程, 队列为空时从最忙的hart窃取
+        int id = mycpuid();
+        c->need_resched = false;
+        proc_t* p = runq_pop(id);
+        if (p == NULL) {
+            p = runq_steal(id);
+            if (p != NULL) {
+                KSTAT_INC(steals);
+            }
+        }
+
+        if (p != NULL) {
             spinlock_acquire(&p->lk);
-            
-            if (p->state == RUNNABLE) {
-                // 只在切换到不同进程时输出
-                if (last_pid[mycpuid()] != p->pid) {
-                    // 替换原有输出：修改调度操作的表述，增加CPU与进程的关联信息
-                    printf("[Scheduler] CPU %d is scheduling process (pid=%d) for execution.\n", mycpuid(), p->pid);
-                    last_pid[mycpuid()] = p->pid;
-                }
-                
-                p->state = RUNNING;
-                c->proc = p;
-                
-                swtch(&c->ctx, &p->ctx);//切换上下文
-                
-                // 进程执行完毕(被时钟中断或主动yield)回到这里
-                c->proc = NULL;
+            assert(p->state == RUNNABLE, "proc_scheduler: queued process not runnable");
+
+            // 取出之后亲和性被修改, 不能在这个hart上运行: 放回允许的hart
+            if (!sched_allowed(p, id)) {
+                sched_place(p);
+                runq_push(p->rq_cpu, p);
+                spinlock_release(&p->lk);
+                continue;
             }
-            
+
+            TRACE(TRACE_SCHED, TRACE_EV_SWITCH, p->pid, p->prio);
+
+            p->state = RUNNING;
+            p->rq_cpu = id;
+            sched_dl_start(p);
+            sched_acct_in(p);
+            c->proc = p;
+
+            // p的内核栈可能是别的hart刚映射的
+            kvm_kstack_sync();
+
+            KSTAT_INC(ctx_switches);
+            swtch(&c->ctx, &p->ctx);//切换上下文
+
+            // 进程执行完毕(被时钟中断或主动yield)回到这里: 中间可能直接切换过, 回来的是c->proc
+            TSTAT_END(sched_enter[id], TSTAT_SWTCH);
+            p = c->proc;
+            c->proc = NULL;
             spinlock_release(&p->lk);
+            continue;
         }
         
         intr_on();
-        asm volatile("wfi");// wait For interrupt
+        // 没有可运行的进程: 有空闲页可以清零时交给后台工作线程, 清零完了才等待中断
+        if (kwork_idle()) {
+            continue;
+        }
+
+        // 关中断后登记为空闲, 再检查一次自己的队列: 之后加入的进程一定会发来处理器间中断
+        // (关中断时wfi仍会被挂起的中断唤醒, 中断在下一轮intr_on时处理)
+        intr_off();
+        __sync_fetch_and_or(&sched_idle, 1u << id);
+        if (runqs[id].n == 0) {
+            KSTAT_INC(idles);
+            // tickless: 时钟中断推迟到下一个期限, 醒来后 (可能是处理器间中断) 恢复每个tick的中断
+            timer_idle(sched_idle_deadline(id));
+            asm volatile("wfi");// wait For interrupt
+            timer_rearm();
+        }
+        __sync_fetch_and_and(&sched_idle, ~(1u << id));
     }
 }
 
@@ -551,16 +2228,35 @@ void proc_sleep(void* sleep_space, spinlock_t* lk)
 {
     proc_t* p = myproc();
     
-    // 必须先获取进程锁，然后才能释放条件锁
-    // 这样可以保证不会丢失wakeup
+    // 必须先获取进程锁并进入等待队列，然后才能释放条件锁
+    // 这样持有条件锁的唤醒者一定能在等待队列中找到这个进程, 不会丢失wakeup
     if (lk != &p->lk) {
         spinlock_acquire(&p->lk);
-        spinlock_release(lk);
+    }
+
+    // 定时睡眠的定时器已经到期 (见proc_sleep_until): 不再睡眠
+    if (p->timer_fired) {
+        if (lk != &p->lk) {
+            spinlock_release(&p->lk);
+        }
+        return;
     }
     
     // 设置睡眠等待空间
     p->sleep_space = sleep_space;
     p->state = SLEEPING;
+    p->last_ran = timer_get_ticks();
+
+    // 进入等待队列（持有p->lk: 唤醒者摘下p之后要等到切换到调度器才能改变p的状态）
+    waitq_t* wq = waitq_of(sleep_space);
+    spinlock_acquire(&wq->lk);
+    p->wq_next = wq->head;
+    wq->head = p;
+    spinlock_release(&wq->lk);
+
+    if (lk != &p->lk) {
+        spinlock_release(lk);
+    }
     
     // 调度到其他进程
     proc_sched();
@@ -575,17 +2271,61 @@ void proc_sleep(void* sleep_space, spinlock_t* lk)
     }
 }
 
+// 进程睡眠在sleep_space, 最迟在mtime到达expire时被定时器唤醒 (与proc_sleep一样可能被提前唤醒)
+// lk不能是p->lk (定时器的回调在时间轮的锁下获取p->lk)
+// 返回时已经到期返回true, 调用者重新检查自己的条件
+bool proc_sleep_until(void* sleep_space, spinlock_t* lk, uint64 expire)
+{
+    proc_t* p = myproc();
+    assert(lk != &p->lk, "proc_sleep_until: sleeping with p->lk");
+    if (timer_get_mtime() >= expire) {
+        return true;
+    }
+    p->timer_space = sleep_space;
+    p->timer_fired = false;
+    ktimer_add(&p->timer, expire);
+
+    proc_sleep(sleep_space, lk);
+
+    // 移出时间轮之后回调不会再执行, 可以清除到期标志
+    ktimer_del(&p->timer);
+    p->timer_fired = false;
+    return timer_get_mtime() >= expire;
+}
+
 // 唤醒所有在sleep_space沉睡的进程
+// 只遍历sleep_space所在的等待队列: 先在队列的锁下摘下匹配的进程, 再逐个获取进程锁改为RUNNABLE
 void proc_wakeup(void* sleep_space)
 {
-    for (int i = 0; i < NPROC; i++) {
-        proc_t* p = &procs[i];
-        if (p != myproc()) {
-            spinlock_acquire(&p->lk);
-            if (p->state == SLEEPING && p->sleep_space == sleep_space) {
-                p->state = RUNNABLE;
-            }
-            spinlock_release(&p->lk);
+    waitq_t* wq = waitq_of(sleep_space);
+    if (wq->head == NULL) {
+        return;
+    }
+
+    proc_t* woken = NULL;
+    spinlock_acquire(&wq->lk);
+    proc_t** link = &wq->head;
+    while (*link != NULL) {
+        proc_t* p = *link;
+        if (p->sleep_space == sleep_space) {
+            *link = p->wq_next;
+            p->wq_next = woken;
+            woken = p;
+        } else {
+            link = &p->wq_next;
         }
     }
-}
\ No newline at end of file
+    spinlock_release(&wq->lk);
+
+    // 摘下的进程只能由这里唤醒: 在改为RUNNABLE之前读出下一个
+    while (woken != NULL) {
+        proc_t* p = woken;
+        woken = p->wq_next;
+        spinlock_acquire(&p->lk);
+        assert(p->state == SLEEPING && p->sleep_space == sleep_space, "proc_wakeup: waiter not sleeping");
+        p->wq_next = NULL;
+        proc_ready(p);
+        KSTAT_INC(wakeups);
+        spinlock_release(&p->lk);
+    }
+}
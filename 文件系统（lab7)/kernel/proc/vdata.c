@@ -0,0 +1,42 @@
+#include "proc/vdata.h"
+#include "dev/timer.h"
+#include "lib/print.h"
+#include "riscv.h"
+
+// 用户数据页 (见proc/vdata.h): 内核数据段中按页对齐的一页, 物理地址即虚拟地址
+static union {
+    vdata_t vd;
+    char page[PGSIZE];
+} vdata __attribute__((aligned(PGSIZE))) = {
+    .vd = { .ns_per_mtime = TIMER_NS_PER_MTIME, .mtime_base = 0 },
+};
+
+uint64 vdata_page()
+{
+    return (uint64)&vdata;
+}
+
+// 写者已经由时钟的顺序锁串行化: 这里只需要让用户态的读者看到奇数的seq
+void vdata_set_time(uint64 ticks, uint64 next, uint64 interval)
+{
+    vdata.vd.seq++;
+    __sync_synchronize();
+    vdata.vd.ticks = ticks;
+    vdata.vd.tick_next = next;
+    vdata.vd.tick_interval = interval;
+    __sync_synchronize();
+    vdata.vd.seq++;
+}
+
+void vdata_set_ncpu(int n)
+{
+    vdata.vd.ncpu = n;
+}
+
+void vdata_enter_user(int pid)
+{
+    int id = r_tp();
+    assert(id < VDATA_NCPU, "vdata_enter_user: too many harts");
+    vdata.vd.cpu[id].pid = pid;
+    vdata.vd.cpu[id].seq++;
+}
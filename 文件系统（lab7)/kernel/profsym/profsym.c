@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+
+// 采样分析的主机端工具: 读入用户态prof_print输出的行 ("prof <hart> <pid> <u|k> <pc>"),
+// 按kernel-qemu (内核态的采样) 和用户程序的ELF (用户态的采样) 的符号表把pc归到函数, 按采样数从多到少输出
+// 用法: ./profsym kernel-qemu [user-elf] < console.log
+// 所有用户程序都链接在同一个地址上, 用户态的采样都按给出的一个用户程序解析
+
+typedef struct sym {
+    unsigned long addr;
+    unsigned long size;
+    char* name;
+    unsigned long hits;
+} sym_t;
+
+typedef struct symtab {
+    sym_t* syms;
+    int n;
+    unsigned long unknown;   // 不在任何函数中的采样
+} symtab_t;
+
+static int sym_cmp_addr(const void* a, const void* b)
+{
+    const sym_t* x = a;
+    const sym_t* y = b;
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+static int sym_cmp_hits(const void* a, const void* b)
+{
+    const sym_t* x = a;
+    const sym_t* y = b;
+    return (x->hits < y->hits) - (x->hits > y->hits);
+}
+
+static void* read_file(const char* path, long* size)
+{
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    void* data = malloc(*size);
+    if (data == NULL || fread(data, 1, *size, f) != (size_t)*size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        exit(1);
+    }
+    fclose(f);
+    return data;
+}
+
+// 取出ELF64符号表中的函数 (按地址排序)
+static void load_symtab(const char* path, symtab_t* tab)
+{
+    long size;
+    char* data = read_file(path, &size);
+    Elf64_Ehdr* eh = (Elf64_Ehdr*)data;
+    if (size < (long)sizeof(*eh) || memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 || eh->e_ident[EI_CLASS] != ELFCLASS64) {
+        fprintf(stderr, "%s: not an ELF64 file\n", path);
+        exit(1);
+    }
+    Elf64_Shdr* sh = (Elf64_Shdr*)(data + eh->e_shoff);
+    tab->syms = NULL;
+    tab->n = 0;
+    tab->unknown = 0;
+    for (int i = 0; i < eh->e_shnum; i++) {
+        if (sh[i].sh_type != SHT_SYMTAB) {
+            continue;
+        }
+        Elf64_Sym* st = (Elf64_Sym*)(data + sh[i].sh_offset);
+        char* strtab = data + sh[sh[i].sh_link].sh_offset;
+        int count = sh[i].sh_size / sizeof(Elf64_Sym);
+        tab->syms = realloc(tab->syms, (tab->n + count) * sizeof(sym_t));
+        for (int j = 0; j < count; j++) {
+            if (ELF64_ST_TYPE(st[j].st_info) != STT_FUNC || st[j].st_value == 0) {
+                continue;
+            }
+            sym_t* s = &tab->syms[tab->n++];
+            s->addr = st[j].st_value;
+            s->size = st[j].st_size;
+            s->name = strdup(strtab + st[j].st_name);
+            s->hits = 0;
+        }
+    }
+    qsort(tab->syms, tab->n, sizeof(sym_t), sym_cmp_addr);
+    free(data);
+}
+
+// 包含pc的函数 (没有大小的符号延伸到下一个符号)
+static sym_t* lookup(symtab_t* tab, unsigned long pc)
+{
+    int lo = 0, hi = tab->n - 1, found = -1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (tab->syms[mid].addr <= pc) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (found < 0) {
+        return NULL;
+    }
+    sym_t* s = &tab->syms[found];
+    if (s->size != 0 && pc >= s->addr + s->size) {
+        return NULL;
+    }
+    return s;
+}
+
+static void report(const char* title, symtab_t* tab, unsigned long total)
+{
+    if (total == 0) {
+        return;
+    }
+    printf("%s: %lu samples\n", title, total);
+    qsort(tab->syms, tab->n, sizeof(sym_t), sym_cmp_hits);
+    for (int i = 0; i < tab->n && tab->syms[i].hits > 0; i++) {
+        printf("  %6.2f%%  %8lu  %s\n", 100.0 * tab->syms[i].hits / total, tab->syms[i].hits, tab->syms[i].name);
+    }
+    if (tab->unknown > 0) {
+        printf("  %6.2f%%  %8lu  (unknown)\n", 100.0 * tab->unknown / total, tab->unknown);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s kernel-qemu [user-elf] < console.log\n", argv[0]);
+        return 1;
+    }
+    symtab_t ktab, utab;
+    load_symtab(argv[1], &ktab);
+    if (argc == 3) {
+        load_symtab(argv[2], &utab);
+    } else {
+        memset(&utab, 0, sizeof(utab));
+    }
+
+    char line[256];
+    unsigned long ktotal = 0, utotal = 0;
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        int hart, pid;
+        char mode;
+        unsigned long pc;
+        char* p = strstr(line, "prof ");
+        if (p == NULL || sscanf(p, "prof %d %d %c %lx", &hart, &pid, &mode, &pc) != 4) {
+            continue;
+        }
+        symtab_t* tab = (mode == 'u') ? &utab : &ktab;
+        sym_t* s = lookup(tab, pc);
+        if (s != NULL) {
+            s->hits++;
+        } else {
+            tab->unknown++;
+        }
+        if (mode == 'u') {
+            utotal++;
+        } else {
+            ktotal++;
+        }
+    }
+    report("kernel", &ktab, ktotal);
+    report(argc == 3 ? argv[2] : "user", &utab, utotal);
+    return 0;
+}
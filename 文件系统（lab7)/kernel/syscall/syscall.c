@@ -5,6 +5,11 @@
 #include "syscall/syscall.h"
 #include "syscall/sysnum.h"
 #include "syscall/sysfunc.h"
+#include "syscall/sysrec.h"
+#include "lib/kstat.h"
+#include "lib/percpu.h"
+#include "lib/str.h"
+#include "riscv.h"
 
 // 系统调用跳转表
 static uint64 (*syscalls[])(void) = {
@@ -31,8 +36,162 @@ static uint64 (*syscalls[])(void) = {
     [SYS_chdir]         sys_chdir,
     [SYS_link]          sys_link,
     [SYS_unlink]        sys_unlink,
+    [SYS_bufstat]       sys_bufstat,
+    [SYS_diskstat]      sys_diskstat,
+    [SYS_statfs]        sys_statfs,
+    [SYS_ftruncate]     sys_ftruncate,
+    [SYS_fallocate]     sys_fallocate,
+    [SYS_openat]        sys_openat,
+    [SYS_mkdirat]       sys_mkdirat,
+    [SYS_unlinkat]      sys_unlinkat,
+    [SYS_linkat]        sys_linkat,
+    [SYS_fstatat]       sys_fstatat,
+    [SYS_getdents]      sys_getdents,
+    [SYS_rename]        sys_rename,
+    [SYS_pread]         sys_pread,
+    [SYS_pwrite]        sys_pwrite,
+    [SYS_readv]         sys_readv,
+    [SYS_writev]        sys_writev,
+    [SYS_pipe]          sys_pipe,
+    [SYS_mmap_file]     sys_mmap_file,
+    [SYS_msync]         sys_msync,
+    [SYS_copy_file_range] sys_copy_file_range,
+    [SYS_fsync]         sys_fsync,
+    [SYS_fdatasync]     sys_fdatasync,
+    [SYS_sync]          sys_sync,
+    [SYS_uring_setup]   sys_uring_setup,
+    [SYS_uring_enter]   sys_uring_enter,
+    [SYS_fadvise]       sys_fadvise,
+    [SYS_umount]        sys_umount,
+    [SYS_spawn]         sys_spawn,
+    [SYS_shm_create]    sys_shm_create,
+    [SYS_shm_map]       sys_shm_map,
+    [SYS_shm_unmap]     sys_shm_unmap,
+    [SYS_shm_destroy]   sys_shm_destroy,
+    [SYS_memstat]       sys_memstat,
+    [SYS_setpriority]   sys_setpriority,
+    [SYS_sched_setaffinity] sys_sched_setaffinity,
+    [SYS_sched_getaffinity] sys_sched_getaffinity,
+    [SYS_clone]         sys_clone,
+    [SYS_futex]         sys_futex,
+    [SYS_timer_config]  sys_timer_config,
+    [SYS_clock_gettime] sys_clock_gettime,
+    [SYS_batch]         sys_batch,
+    [SYS_lockstat]      sys_lockstat,
+    [SYS_kstat]         sys_kstat,
+    [SYS_dmesg]         sys_dmesg,
+    [SYS_trace]         sys_trace,
+    [SYS_sysstat]       sys_sysstat,
+    [SYS_prof]          sys_prof,
+    [SYS_tstat]         sys_tstat,
+    [SYS_iostat]        sys_iostat,
+    [SYS_irq_setaffinity] sys_irq_setaffinity,
+    [SYS_fstatat_batch] sys_fstatat_batch,
+    [SYS_poll]          sys_poll,
+    [SYS_epoll_create]  sys_epoll_create,
+    [SYS_epoll_ctl]     sys_epoll_ctl,
+    [SYS_epoll_wait]    sys_epoll_wait,
+    [SYS_sched_setdeadline] sys_sched_setdeadline,
+    [SYS_cpustat]       sys_cpustat,
+    [SYS_clone_file]    sys_clone_file,
+    [SYS_fault_around]  sys_fault_around,
+    [SYS_poweroff]      sys_poweroff,
+    [SYS_sysrec]        sys_sysrec,
+    [SYS_splice]        sys_splice,
+    [SYS_vmsplice]      sys_vmsplice,
 };
 
+// 改变地址空间布局或复制页表的系统调用: 线程共享地址空间时在mm->lk下执行 (见proc/proc.h)
+static bool sys_mm[SYS_MAX + 1] = {
+    [SYS_brk]           true,
+    [SYS_mmap]          true,
+    [SYS_munmap]        true,
+    [SYS_fork]          true,
+    [SYS_mmap_file]     true,
+    [SYS_msync]         true,
+    [SYS_uring_setup]   true,
+    [SYS_shm_map]       true,
+    [SYS_shm_unmap]     true,
+    [SYS_memstat]       true,
+    [SYS_clone]         true,
+};
+
+// 不能放在sys_batch中的系统调用: 替换或复制陷阱帧、不返回, 以及sys_batch自己
+static bool sys_nobatch[SYS_MAX + 1] = {
+    [SYS_exec]          true,
+    [SYS_fork]          true,
+    [SYS_exit]          true,
+    [SYS_clone]         true,
+    [SYS_batch]         true,
+};
+
+// 全局的系统调用统计 (每个hart一份)
+typedef struct sysstat_table {
+    sysstat_t st[SYS_MAX + 1];
+} sysstat_table_t;
+
+static PCPU_DEFINE(sysstat_table_t, sysstat_counter);
+
+// 记录一次系统调用: 耗时dt (mtime单位), 返回值ret
+static void syscall_account(proc_t* p, int num, uint64 ret, uint64 dt)
+{
+    bool err = ((uint32)ret == (uint32)-1);   // 返回-1 (uint64或uint32的系统调用)
+
+    p->sc[num].calls++;
+    p->sc[num].errors += err;
+    p->sc[num].time += dt;
+
+    int h = 0;
+    for (uint64 t = dt >> 2; t != 0 && h < SYSSTAT_HIST - 1; t >>= 2) {
+        h++;
+    }
+    PCPU_ADD(sysstat_counter, st[num].calls, 1);
+    PCPU_ADD(sysstat_counter, st[num].errors, err);
+    PCPU_ADD(sysstat_counter, st[num].time, dt);
+    PCPU_ADD(sysstat_counter, st[num].hist[h], 1);
+
+    // 读出hart编号之后可能被迁移, 其他hart上的进程也可能更新这一份: 比较后交换
+    volatile uint64* max = &sysstat_counter[pcpu_id()].v.st[num].max;
+    uint64 old = *max;
+    while (dt > old && !__sync_bool_compare_and_swap(max, old, dt)) {
+        old = *max;
+    }
+}
+
+// 执行一个系统调用 (参数已经在陷阱帧中)
+static uint64 syscall_dispatch(proc_t* p, int num)
+{
+    KSTAT_INC(syscalls);
+
+    // 录制: 参数和路径在调用之前取出 (exec会替换陷阱帧和地址空间)
+    bool rec = p->sysrec;
+    uint64 args[6];
+    char path[SYSREC_PATH];
+    if (rec) {
+        args[0] = p->tf->a0;
+        args[1] = p->tf->a1;
+        args[2] = p->tf->a2;
+        args[3] = p->tf->a3;
+        args[4] = p->tf->a4;
+        args[5] = p->tf->a5;
+        sysrec_path(p, num, path);
+    }
+
+    uint64 start = r_time();
+    bool locked = sys_mm[num] && mm_lock(p);
+    uint64 ret = syscalls[num]();
+    mm_unlock(p, locked);
+
+    // 放弃从共享的文件描述符表中取出的文件的引用 (见proc_fd_get)
+    proc_fd_unhold(p);
+    uint64 dt = r_time() - start;
+    syscall_account(p, num, ret, dt);
+    if (rec) {
+        sysrec_record(p, num, args, path, start, dt, ret);
+    }
+    return ret;
+}
+
 // 系统调用
 void syscall()
 {
@@ -46,7 +205,7 @@ void syscall()
     if ((syscall_num >= 0) && (syscall_num <= SYS_MAX) && (syscalls[syscall_num] != NULL))
     {
         // 4. 调用对应的系统调用处理函数，将返回值存入陷阱帧的a0寄存器（返回给用户态）
-        current_proc->tf->a0 = syscalls[syscall_num]();
+        current_proc->tf->a0 = syscall_dispatch(current_proc, syscall_num);
     }
     else
     {
@@ -56,6 +215,104 @@ void syscall()
     }
 }
 
+// 一次陷入执行多个系统调用
+// batch_call_t* calls 用户空间的数组, 依次执行, 每一项的返回值写回它的ret
+// uint32 n 数组长度 (不超过N_BATCH)
+// 每一项的参数放进陷阱帧的a0-a5, 经过与syscall()相同的分发 (系统调用函数照常用arg_*读取参数)
+// 不能批量执行的系统调用和未定义的系统调用号的返回值是-1, 之后的项照常执行
+// 返回执行的项数, n超过N_BATCH时返回-1
+uint64 sys_batch()
+{
+    proc_t* p = myproc();
+    uint64 calls;
+    uint32 n;
+    arg_uint64(0, &calls);
+    arg_uint32(1, &n);
+    if (n > N_BATCH) {
+        return -1;
+    }
+
+    // 各项的参数会覆盖陷阱帧中sys_batch自己的参数
+    uint64 saved[7] = { p->tf->a0, p->tf->a1, p->tf->a2, p->tf->a3, p->tf->a4, p->tf->a5, p->tf->a7 };
+    for (uint32 i = 0; i < n; i++) {
+        batch_call_t call;
+        uint64 addr = calls + i * sizeof(batch_call_t);
+        uvm_copyin(p->mm->pgtbl, (uint64)&call, addr, sizeof(call));
+        if (call.num <= SYS_MAX && syscalls[call.num] != NULL && !sys_nobatch[call.num]) {
+            p->tf->a0 = call.args[0];
+            p->tf->a1 = call.args[1];
+            p->tf->a2 = call.args[2];
+            p->tf->a3 = call.args[3];
+            p->tf->a4 = call.args[4];
+            p->tf->a5 = call.args[5];
+            p->tf->a7 = call.num;
+            call.ret = syscall_dispatch(p, (int)call.num);
+        } else {
+            call.ret = (uint64)-1;
+        }
+        uvm_copyout(p->mm->pgtbl, addr, (uint64)&call, sizeof(call));
+    }
+    p->tf->a0 = saved[0];
+    p->tf->a1 = saved[1];
+    p->tf->a2 = saved[2];
+    p->tf->a3 = saved[3];
+    p->tf->a4 = saved[4];
+    p->tf->a5 = saved[5];
+    p->tf->a7 = saved[6];
+    return n;
+}
+
+// 系统调用号num的全局统计: 各hart的和, max取最大值
+void syscall_stat(int num, sysstat_t* st)
+{
+    memset(st, 0, sizeof(*st));
+    st->calls = PCPU_SUM(sysstat_counter, st[num].calls);
+    st->errors = PCPU_SUM(sysstat_counter, st[num].errors);
+    st->time = PCPU_SUM(sysstat_counter, st[num].time);
+    for (int h = 0; h < SYSSTAT_HIST; h++) {
+        st->hist[h] = PCPU_SUM(sysstat_counter, st[num].hist[h]);
+    }
+    for (int i = 0; i < NCPU; i++) {
+        if (sysstat_counter[i].v.st[num].max > st->max) {
+            st->max = sysstat_counter[i].v.st[num].max;
+        }
+    }
+}
+
+// 系统调用统计
+// uint32 who SYSSTAT_GLOBAL: 所有进程 (各hart的和, max取最大值) / SYSSTAT_SELF: 当前进程 (只有calls / errors / time)
+// uint64 addr 用户空间的sysstat_t数组, 下标是系统调用号
+// uint32 n 数组长度
+// 返回写入的项数 (最多SYS_MAX + 1), who无效返回-1
+uint64 sys_sysstat()
+{
+    proc_t* p = myproc();
+    uint32 who, n;
+    uint64 addr;
+    arg_uint32(0, &who);
+    arg_uint64(1, &addr);
+    arg_uint32(2, &n);
+    if (who != SYSSTAT_GLOBAL && who != SYSSTAT_SELF) {
+        return -1;
+    }
+    if (n > SYS_MAX + 1) {
+        n = SYS_MAX + 1;
+    }
+    for (uint32 num = 0; num < n; num++) {
+        sysstat_t st;
+        memset(&st, 0, sizeof(st));
+        if (who == SYSSTAT_SELF) {
+            st.calls = p->sc[num].calls;
+            st.errors = p->sc[num].errors;
+            st.time = p->sc[num].time;
+        } else {
+            syscall_stat(num, &st);
+        }
+        uvm_copyout(p->mm->pgtbl, addr + num * sizeof(sysstat_t), (uint64)&st, sizeof(st));
+    }
+    return n;
+}
+
 /*
     其他用于读取传入参数的函数
     参数分为两种,第一种是数据本身,第二种是指针
@@ -105,5 +362,5 @@ void arg_str(int n, char* buf, int maxlen)
     uint64 addr;
     arg_uint64(n, &addr);
 
-    uvm_copyin_str(p->pgtbl, (uint64)buf, addr, maxlen);
+    uvm_copyin_str(p->mm->pgtbl, (uint64)buf, addr, maxlen);
 }
\ No newline at end of file
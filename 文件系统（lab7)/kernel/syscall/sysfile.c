@@ -1,14 +1,25 @@
 #include "proc/cpu.h"
 #include "mem/vmem.h"
+#include "mem/mmap.h"
 #include "fs/inode.h"
 #include "fs/dir.h"
 #include "fs/file.h"
+#include "fs/pipe.h"
+#include "fs/poll.h"
+#include "fs/buf.h"
+#include "fs/fs.h"
+#include "fs/journal.h"
+#include "fs/tmpfs.h"
+#include "dev/vio.h"
+#include "dev/uart.h"
+#include "memlayout.h"
 #include "lib/str.h"
 #include "lib/print.h"
 #include "syscall/syscall.h"
 #include "syscall/sysfunc.h"
 
 // 获取第n个参数对应的fd和这个fd对应的file
+// 文件描述符表被线程共享时file在系统调用返回之前一直有效 (另一个线程关闭fd也不会释放它, 见proc_fd_get)
 // 成功返回0 失败返回-1
 static int arg_fd(int n, int* pfd, file_t** pfile)
 {
@@ -16,12 +27,8 @@ static int arg_fd(int n, int* pfd, file_t** pfile)
     int fd = 0;
     arg_uint32(n, (uint32*)(&fd));
     
-    // fd 溢出
-    if(fd < 0 || fd >= FILE_PER_PROC)
-        return -1;
-    
-    // 确定fd对应的file
-    file_t* file = myproc()->filelist[fd];
+    // 确定fd对应的file (fd溢出或没有打开时失败)
+    file_t* file = proc_fd_get(myproc(), fd);
     if(file == NULL)
         return -1;
     
@@ -31,20 +38,34 @@ static int arg_fd(int n, int* pfd, file_t** pfile)
     return 0;
 }
 
-// 成功返回申请到的fd
+// 成功返回申请到的fd (内嵌的fd表用完时扩展为一整页)
 // 失败返回-1
 static int fd_alloc(file_t* file)
 {
-    proc_t* p = myproc();
+    return proc_fd_alloc(myproc(), file);
+}
+
+// 获取第n个参数对应的目录fd (*at系统调用使用)
+// AT_FDCWD: *pdp = NULL (当前工作目录)
+// 成功返回0 失败返回-1 (fd无效或不是目录)
+static int arg_dirfd(int n, inode_t** pdp)
+{
+    int fd = 0;
+    file_t* file;
 
-    for(int fd = 0; fd < FILE_PER_PROC; fd++) {
-        if(p->filelist[fd] == NULL) {
-            p->filelist[fd] = file;
-            return fd;
-        }
+    arg_uint32(n, (uint32*)(&fd));
+    if(fd == AT_FDCWD) {
+        *pdp = NULL;
+        return 0;
     }
 
-    return -1;
+    if(arg_fd(n, NULL, &file) < 0)
+        return -1;
+    if(file->type != FD_DIR || file->ip == NULL)
+        return -1;
+
+    *pdp = file->ip;
+    return 0;
 }
 
 // 打开或创建文件
@@ -76,12 +97,12 @@ uint64 sys_open()
 uint64 sys_close()
 {
     int fd;
-    file_t* file;
 
-    if(arg_fd(0, &fd, &file) < 0)
+    arg_uint32(0, (uint32*)(&fd));
+    file_t* file = proc_fd_clear(myproc(), fd);
+    if(file == NULL)
         return -1;
 
-    myproc()->filelist[fd] = NULL;
     file_close(file);
 
     return 0;
@@ -125,6 +146,86 @@ uint64 sys_write()
     return file_write(file, len, addr, true);
 }
 
+// 在指定偏移处读取文件内容 (不使用也不修改文件偏移量)
+// int fd
+// uint32 len
+// uint64 addr
+// uint32 offset
+// 成功返回字节数 失败返回-1
+uint64 sys_pread()
+{
+    uint32 len, offset;
+    uint64 addr;
+    file_t* file;
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+    arg_uint32(1, &len);
+    arg_uint64(2, &addr);
+    arg_uint32(3, &offset);
+
+    return file_pread(file, offset, len, addr, true);
+}
+
+// 在指定偏移处写入文件内容 (不使用也不修改文件偏移量)
+// int fd
+// uint32 len
+// uint64 addr
+// uint32 offset
+// 成功返回字节数 失败返回-1
+uint64 sys_pwrite()
+{
+    uint32 len, offset;
+    uint64 addr;
+    file_t* file;
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+    arg_uint32(1, &len);
+    arg_uint64(2, &addr);
+    arg_uint32(3, &offset);
+
+    return file_pwrite(file, offset, len, addr, true);
+}
+
+// 从当前偏移量开始依次读入多段缓冲区 (整个过程只加一次inode锁)
+// int fd
+// uint64 iov 用户空间的iovec_t数组
+// uint32 iovcnt 数组长度 (不超过N_IOV)
+// 成功返回总字节数 失败返回-1
+uint64 sys_readv()
+{
+    uint64 iov;
+    uint32 iovcnt;
+    file_t* file;
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+    arg_uint64(1, &iov);
+    arg_uint32(2, &iovcnt);
+
+    return file_readv(file, iov, iovcnt);
+}
+
+// 从当前偏移量开始依次写出多段缓冲区 (整个过程只加一次inode锁)
+// int fd
+// uint64 iov 用户空间的iovec_t数组
+// uint32 iovcnt 数组长度 (不超过N_IOV)
+// 成功返回总字节数 失败返回-1
+uint64 sys_writev()
+{
+    uint64 iov;
+    uint32 iovcnt;
+    file_t* file;
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+    arg_uint64(1, &iov);
+    arg_uint32(2, &iovcnt);
+
+    return file_writev(file, iov, iovcnt);
+}
+
 // 文件偏移量设置
 // int fd
 // uint32 offset
@@ -202,6 +303,25 @@ uint64 sys_getdir()
     return len;
 }
 
+// 从上次的位置继续读取目录项 (位置保存在打开的文件中, lseek(fd, 0, LSEEK_SET)重新开始)
+// int fd
+// uint64 addr
+// uint32 len
+// 成功返回读取的字节数 (0表示已读完), 失败返回-1
+uint64 sys_getdents()
+{
+    file_t* file;
+    uint64 addr;
+    uint32 len;
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+    arg_uint64(1, &addr);
+    arg_uint32(2, &len);
+
+    return file_getdents(file, addr, len);
+}
+
 // 创建目录
 // char* path
 // 成功返回0 失败返回-1
@@ -210,7 +330,12 @@ uint64 sys_mkdir()
     char path[DIR_PATH_LEN];
     arg_str(0, path, DIR_PATH_LEN);
 
-    inode_t* inode = path_create_inode(path, FT_DIR, 0, 0);
+    if(tmpfs_path(path) != NULL)
+        return tmpfs_mkdir(tmpfs_path(path));
+
+    journal_begin();
+    inode_t* inode = path_create_inode(path, FT_DIR, 0, 0, 0);
+    journal_end();
 
     return (inode == NULL) ? -1 : 0;
 }
@@ -236,7 +361,15 @@ uint64 sys_link()
     arg_str(0, old_path, DIR_PATH_LEN);
     arg_str(1, new_path, DIR_PATH_LEN);
 
-    return path_link(old_path, new_path);
+    // /tmp不支持硬链接
+    if(tmpfs_path(old_path) != NULL || tmpfs_path(new_path) != NULL)
+        return -1;
+
+    journal_begin();
+    int ret = path_link(old_path, new_path);
+    journal_end();
+
+    return ret;
 }
 
 // 文件删除链接 (link=0 则删除文件)
@@ -247,5 +380,569 @@ uint64 sys_unlink()
     char path[DIR_PATH_LEN];
     arg_str(0, path, DIR_PATH_LEN);
 
-    return path_unlink(path);
-}
\ No newline at end of file
+    if(tmpfs_path(path) != NULL)
+        return tmpfs_unlink(tmpfs_path(path));
+
+    journal_begin();
+    int ret = path_unlink(path);
+    journal_end();
+
+    return ret;
+}
+
+// 相对于目录fd打开或创建文件
+// int dirfd (AT_FDCWD: 当前工作目录)
+// char* path
+// uint32 open_mode
+// 成功返回fd 失败返回-1
+uint64 sys_openat()
+{
+    inode_t* dp;
+    char path[DIR_PATH_LEN];
+    uint32 open_mode;
+
+    if(arg_dirfd(0, &dp) < 0)
+        return -1;
+    arg_str(1, path, DIR_PATH_LEN);
+    arg_uint32(2, &open_mode);
+
+    file_t* file = file_open_at(dp, path, open_mode);
+    if(file == NULL)
+        return -1;
+
+    int fd = fd_alloc(file);
+    if(fd == -1)
+        file_close(file);
+
+    return fd;
+}
+
+// 相对于目录fd创建目录
+// int dirfd
+// char* path
+// 成功返回0 失败返回-1
+uint64 sys_mkdirat()
+{
+    inode_t* dp;
+    char path[DIR_PATH_LEN];
+
+    if(arg_dirfd(0, &dp) < 0)
+        return -1;
+    arg_str(1, path, DIR_PATH_LEN);
+
+    if(tmpfs_path(path) != NULL)
+        return tmpfs_mkdir(tmpfs_path(path));
+
+    journal_begin();
+    inode_t* inode = path_create_inode_at(dp, path, FT_DIR, 0, 0, 0);
+    journal_end();
+
+    return (inode == NULL) ? -1 : 0;
+}
+
+// 相对于目录fd删除链接
+// int dirfd
+// char* path
+// 成功返回0 失败返回-1
+uint64 sys_unlinkat()
+{
+    inode_t* dp;
+    char path[DIR_PATH_LEN];
+
+    if(arg_dirfd(0, &dp) < 0)
+        return -1;
+    arg_str(1, path, DIR_PATH_LEN);
+
+    if(tmpfs_path(path) != NULL)
+        return tmpfs_unlink(tmpfs_path(path));
+
+    journal_begin();
+    int ret = path_unlink_at(dp, path);
+    journal_end();
+
+    return ret;
+}
+
+// 相对于目录fd创建硬链接
+// int old_dirfd
+// char* old_path
+// int new_dirfd
+// char* new_path
+// 成功返回0 失败返回-1
+uint64 sys_linkat()
+{
+    inode_t *old_dp, *new_dp;
+    char old_path[DIR_PATH_LEN], new_path[DIR_PATH_LEN];
+
+    if(arg_dirfd(0, &old_dp) < 0 || arg_dirfd(2, &new_dp) < 0)
+        return -1;
+    arg_str(1, old_path, DIR_PATH_LEN);
+    arg_str(3, new_path, DIR_PATH_LEN);
+
+    if(tmpfs_path(old_path) != NULL || tmpfs_path(new_path) != NULL)
+        return -1;
+
+    journal_begin();
+    int ret = path_link_at(old_dp, old_path, new_dp, new_path);
+    journal_end();
+
+    return ret;
+}
+
+// 相对于目录fd按路径获取文件信息
+// int dirfd
+// char* path
+// uint64 addr
+// 成功返回0 失败返回-1
+uint64 sys_fstatat()
+{
+    inode_t* dp;
+    char path[DIR_PATH_LEN];
+    uint64 addr;
+
+    if(arg_dirfd(0, &dp) < 0)
+        return -1;
+    arg_str(1, path, DIR_PATH_LEN);
+    arg_uint64(2, &addr);
+
+    return file_stat_at(dp, path, addr);
+}
+
+// 一次获取目录下多个文件的信息 (目录只查找一次, 省去逐个fstatat的路径解析)
+// int dirfd
+// dirent_t* names (只使用name, 可以直接传入getdents的结果)
+// int n (不超过FSTAT_BATCH_MAX)
+// file_state_t* states (n项, 不存在的文件type为FT_UNUSED)
+// 成功返回存在的文件数 失败返回-1
+uint64 sys_fstatat_batch()
+{
+    inode_t* dp;
+    uint64 names, addr;
+    int n;
+
+    if(arg_dirfd(0, &dp) < 0)
+        return -1;
+    arg_uint64(1, &names);
+    arg_uint32(2, (uint32*)(&n));
+    arg_uint64(3, &addr);
+    if(names == 0 || addr == 0)
+        return -1;
+
+    return file_stat_batch(dp, names, n, addr);
+}
+
+// 重命名文件或目录 (new_path已存在的普通文件会被替换)
+// char* old_path
+// char* new_path
+// 成功返回0 失败返回-1
+uint64 sys_rename()
+{
+    char old_path[DIR_PATH_LEN], new_path[DIR_PATH_LEN];
+    arg_str(0, old_path, DIR_PATH_LEN);
+    arg_str(1, new_path, DIR_PATH_LEN);
+
+    // /tmp之内的重命名由tmpfs完成, 不能跨越/tmp的边界
+    char* old_tmp = tmpfs_path(old_path);
+    char* new_tmp = tmpfs_path(new_path);
+    if(old_tmp != NULL && new_tmp != NULL)
+        return tmpfs_rename(old_tmp, new_tmp);
+    if(old_tmp != NULL || new_tmp != NULL)
+        return -1;
+
+    journal_begin();
+    int ret = path_rename(old_path, new_path);
+    journal_end();
+
+    return ret;
+}
+
+// 创建管道
+// uint64 addr 用户空间的int[2]: [0]读端fd [1]写端fd
+// 成功返回0 失败返回-1
+uint64 sys_pipe()
+{
+    uint64 addr;
+    file_t *rf, *wf;
+    int fd[2];
+
+    arg_uint64(0, &addr);
+    if(pipe_alloc(&rf, &wf) < 0)
+        return -1;
+
+    fd[0] = fd_alloc(rf);
+    fd[1] = (fd[0] < 0) ? -1 : fd_alloc(wf);
+    if(fd[1] < 0) {
+        if(fd[0] >= 0)
+            proc_fd_clear(myproc(), fd[0]);
+        file_close(rf);
+        file_close(wf);
+        return -1;
+    }
+
+    uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)fd, sizeof(fd));
+    return 0;
+}
+
+// 把文件映射进地址空间 (共享映射, 页面在第一次访问时从页缓存映射)
+// uint64 start 起始地址 (0则由内核选择)
+// uint32 len 长度 (页大小的整数倍)
+// int fd 普通文件
+// uint32 offset 文件偏移 (页大小的整数倍)
+// int prot PROT_READ / PROT_WRITE
+// 成功返回映射的起始地址 失败返回-1
+uint64 sys_mmap_file()
+{
+    uint64 start;
+    uint32 len, offset;
+    int prot;
+    file_t* file;
+
+    arg_uint64(0, &start);
+    arg_uint32(1, &len);
+    if(arg_fd(2, NULL, &file) < 0)
+        return -1;
+    arg_uint32(3, &offset);
+    arg_uint32(4, (uint32*)(&prot));
+
+    if(len == 0 || len % PGSIZE != 0 || offset % PGSIZE != 0 || start % PGSIZE != 0)
+        return -1;
+    if(file->type != FD_FILE || !file->readable || ((prot & PROT_WRITE) && !file->writable))
+        return -1;
+
+    if(start == 0 && (start = uvm_mmap_find(len / PGSIZE)) == 0)
+        return -1;
+    return mmap_file_map(file, start, len / PGSIZE, offset / PGSIZE, prot);
+}
+
+// 把文件映射中被修改的页写回文件
+// uint64 start 起始地址 (页对齐)
+// uint32 len 长度 (页大小的整数倍)
+// 成功返回0 范围内没有文件映射返回-1
+uint64 sys_msync()
+{
+    uint64 start;
+    uint32 len;
+
+    arg_uint64(0, &start);
+    arg_uint32(1, &len);
+    if(start % PGSIZE != 0 || len == 0 || len % PGSIZE != 0)
+        return -1;
+
+    return mmap_file_sync(start, len / PGSIZE);
+}
+
+// 在内核中把一个文件的内容复制到另一个文件 (两个文件从各自的偏移量开始, 复制后都前进)
+// int fd_in
+// int fd_out
+// uint32 len
+// 成功返回复制的字节数 失败返回-1
+uint64 sys_copy_file_range()
+{
+    file_t *in, *out;
+    uint32 len;
+
+    if(arg_fd(0, NULL, &in) < 0 || arg_fd(1, NULL, &out) < 0)
+        return -1;
+    arg_uint32(2, &len);
+
+    return file_copy_range(in, out, len);
+}
+
+// 在管道和文件(或另一个管道)之间移动数据, 移动页引用而不是复制 (至少一方是管道, 普通文件从各自的偏移量开始)
+// int fd_in
+// int fd_out
+// uint32 len
+// 成功返回移动的字节数 失败返回-1
+uint64 sys_splice()
+{
+    file_t *in, *out;
+    uint32 len;
+
+    if(arg_fd(0, NULL, &in) < 0 || arg_fd(1, NULL, &out) < 0)
+        return -1;
+    arg_uint32(2, &len);
+
+    return file_splice(in, out, len);
+}
+
+// 把多段用户缓冲区所在的页排入管道 (不复制, 读者读出之前不应修改这些页)
+// int fd (管道的写端)
+// iovec_t* iov
+// uint32 iovcnt
+// 成功返回总字节数 失败返回-1
+uint64 sys_vmsplice()
+{
+    file_t* file;
+    uint64 iov;
+    uint32 iovcnt;
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+    arg_uint64(1, &iov);
+    arg_uint32(2, &iovcnt);
+
+    return file_vmsplice(file, iov, iovcnt);
+}
+
+// reflink克隆: 在path处创建新文件, 与fd共享数据块 (写时复制)
+// int fd
+// char* path
+// 成功返回0 失败返回-1
+uint64 sys_clone_file()
+{
+    file_t* file;
+    char path[DIR_PATH_LEN];
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+    arg_str(1, path, DIR_PATH_LEN);
+
+    if(tmpfs_path(path) != NULL)
+        return -1;
+
+    return file_clone(file, path);
+}
+
+// 把文件的数据和元数据写到磁盘上, 并发的调用者合并成一次刷盘
+// int fd
+// 成功返回0 失败返回-1
+uint64 sys_fsync()
+{
+    file_t* file;
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+
+    return file_fsync(file);
+}
+
+// 把文件的数据写到磁盘上 (inode没有时间戳, 与fsync相同)
+// int fd
+// 成功返回0 失败返回-1
+uint64 sys_fdatasync()
+{
+    file_t* file;
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+
+    return file_fsync(file);
+}
+
+// 把整个文件系统缓存的数据和元数据写到磁盘上
+// 返回0 (还没有挂载时什么也不做)
+uint64 sys_sync()
+{
+    if (fs_mounted())
+        fs_sync();
+    return 0;
+}
+
+// 干净卸载文件系统: 写回全部数据, 记录空闲计数并标记CLEAN (关机前调用, 下次挂载不扫描位图)
+// 成功返回0 还没有挂载返回-1
+uint64 sys_umount()
+{
+    if (!fs_mounted())
+        return -1;
+    fs_unmount();
+    return 0;
+}
+
+// 干净卸载文件系统后关闭虚拟机 (qemu virt的sifive_test设备, 见memlayout.h), 基准测试模式结束时调用
+// 输出一行@poweroff unmount=clean|none (make bench检查它), 写完UART发送缓冲区之后关机
+// 不返回 (还没有挂载时直接关机)
+uint64 sys_poweroff()
+{
+    if (fs_mounted()) {
+        fs_unmount();
+        printf("@poweroff unmount=clean\n");
+    } else {
+        printf("@poweroff unmount=none\n");
+    }
+    uart_flush();
+    *(volatile uint32*)VIRT_TEST = VIRT_TEST_POWEROFF;
+    panic("sys_poweroff: machine did not power off");
+    return 0;
+}
+
+// 创建提交/完成队列, 映射进当前进程的地址空间
+// 成功返回队列的用户地址 失败返回-1 (已经创建过或内存不足)
+uint64 sys_uring_setup()
+{
+    uint64 va = uring_setup(myproc());
+    return va == 0 ? (uint64)-1 : va;
+}
+
+// 处理提交队列中的请求（完成队列满时停止）
+// 返回处理的请求数 没有队列返回-1
+uint64 sys_uring_enter()
+{
+    proc_t* p = myproc();
+    if (p->uring.ctl == NULL)
+        return -1;
+    return uring_process(p);
+}
+
+// 访问模式提示
+// int fd, uint32 offset, uint32 len (0: 到文件末尾), int advice (FADV_*)
+// 成功返回0 失败返回-1
+uint64 sys_fadvise()
+{
+    file_t* file;
+    uint32 offset, len, advice;
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+    arg_uint32(1, &offset);
+    arg_uint32(2, &len);
+    arg_uint32(3, &advice);
+
+    return file_advise(file, offset, len, advice);
+}
+
+// 等待一组fd中的任意一个就绪 (见fs/poll.h)
+// pollfd_t* fds (返回时写回revents)
+// uint32 nfds (不超过POLL_MAX)
+// int timeout (毫秒, 0不等待, -1永远等待)
+// 返回revents非0的fd数 (超时返回0) 失败返回-1
+uint64 sys_poll()
+{
+    uint64 fds;
+    uint32 nfds;
+    int timeout;
+    arg_uint64(0, &fds);
+    arg_uint32(1, &nfds);
+    arg_uint32(2, (uint32*)(&timeout));
+    if(fds == 0 && nfds > 0)
+        return -1;
+    return poll_fds(fds, nfds, timeout);
+}
+
+// 创建监视集合
+// 成功返回fd 失败返回-1
+uint64 sys_epoll_create()
+{
+    file_t* file = epoll_create();
+    if(file == NULL)
+        return -1;
+    int fd = fd_alloc(file);
+    if(fd < 0)
+        file_close(file);
+    return fd;
+}
+
+// 修改监视集合
+// int epfd
+// int op (EPOLL_CTL_ADD / DEL / MOD)
+// int fd
+// epoll_event_t* event (DEL时可以为NULL)
+// 成功返回0 失败返回-1
+uint64 sys_epoll_ctl()
+{
+    file_t* file;
+    int op, fd;
+    uint64 event;
+    if(arg_fd(0, NULL, &file) < 0 || file->type != FD_EPOLL)
+        return -1;
+    arg_uint32(1, (uint32*)(&op));
+    arg_uint32(2, (uint32*)(&fd));
+    arg_uint64(3, &event);
+    return epoll_ctl(file->ep, op, fd, event);
+}
+
+// 等待监视集合中的项就绪 (水平触发)
+// int epfd
+// epoll_event_t* events
+// int max (1 ~ EPOLL_MAX)
+// int timeout (毫秒, 0不等待, -1永远等待)
+// 返回报告的事件数 (超时返回0) 失败返回-1
+uint64 sys_epoll_wait()
+{
+    file_t* file;
+    uint64 events;
+    int max, timeout;
+    if(arg_fd(0, NULL, &file) < 0 || file->type != FD_EPOLL)
+        return -1;
+    arg_uint64(1, &events);
+    arg_uint32(2, (uint32*)(&max));
+    arg_uint32(3, (uint32*)(&timeout));
+    if(events == 0)
+        return -1;
+    return epoll_wait(file->ep, events, max, timeout);
+}
+
+// 读取buf cache统计信息
+// uint64 addr 用户空间的buf_stat_t
+// 成功返回0
+uint64 sys_bufstat()
+{
+    uint64 addr;
+    buf_stat_t st;
+
+    arg_uint64(0, &addr);
+    buf_stat(&st);
+    uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&st, sizeof(st));
+    return 0;
+}
+
+// 读取磁盘请求统计信息 (延迟直方图和队列深度)
+// uint64 addr 用户空间的vio_stat_t
+// 成功返回0
+uint64 sys_diskstat()
+{
+    uint64 addr;
+    vio_stat_t st;
+
+    arg_uint64(0, &addr);
+    virtio_disk_stat(&st);
+    uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&st, sizeof(st));
+    return 0;
+}
+
+// 把文件截断（或扩展）到指定大小
+// int fd
+// uint32 size
+// 成功返回0 失败返回-1
+uint64 sys_ftruncate()
+{
+    file_t* file;
+    uint32 size;
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+    arg_uint32(1, &size);
+
+    return file_truncate(file, size);
+}
+
+// 为文件预先分配连续的磁盘空间 (之后写入这个范围不再经过分配器)
+// int fd
+// uint32 offset
+// uint32 len
+// 成功返回0 失败返回-1
+uint64 sys_fallocate()
+{
+    file_t* file;
+    uint32 offset, len;
+
+    if(arg_fd(0, NULL, &file) < 0)
+        return -1;
+    arg_uint32(1, &offset);
+    arg_uint32(2, &len);
+
+    return file_allocate(file, offset, len);
+}
+
+// 读取文件系统容量信息
+// uint64 addr 用户空间的fs_stat_t
+// 成功返回0
+uint64 sys_statfs()
+{
+    uint64 addr;
+    fs_stat_t st;
+
+    arg_uint64(0, &addr);
+    fs_statfs(&st);
+    uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&st, sizeof(st));
+    return 0;
+}
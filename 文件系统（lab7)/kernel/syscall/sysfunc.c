@@ -2,12 +2,23 @@
 #include "mem/vmem.h"
 #include "mem/pmem.h"
 #include "mem/mmap.h"
+#include "mem/shm.h"
 #include "lib/str.h"
 #include "lib/print.h"
+#include "lib/lockstat.h"
+#include "lib/kstat.h"
+#include "lib/klog.h"
+#include "lib/trace.h"
+#include "lib/prof.h"
+#include "lib/tstat.h"
+#include "syscall/sysrec.h"
 #include "memlayout.h"
 #include "syscall/sysfunc.h"
 #include "syscall/syscall.h"
 #include "dev/timer.h"
+#include "dev/plic.h"
+#include "proc/futex.h"
+#include "fs/dir.h"
 
 // -------------------------- 堆内存调整系统调用 sys_brk --------------------------
 // 功能：实现进程堆内存的查询、扩展与收缩，避免堆内存与代码段、用户栈冲突
@@ -25,60 +36,67 @@ uint64 sys_brk()
     
     // 处理堆查询请求：若目标堆顶为0，直接返回当前进程的堆顶地址
     if (target_heap_top == 0) {
-        return current_proc->heap_top;
+        return current_proc->mm->heap_top;
     }
     
-    // 堆地址下限校验：禁止低于2倍页大小，防止覆盖代码段等核心内存区域
-    if (target_heap_top < 2 * PGSIZE) {
+    // 堆地址下限校验：禁止低于程序映像末尾，防止覆盖代码段等核心内存区域
+    if (target_heap_top < current_proc->mm->image.end) {
         return (uint64)-1;
     }
     
-    // 堆地址上限校验：计算用户栈底部地址，避免堆内存与用户栈区域冲突
-    // 预留一页内存作为堆与栈之间的安全隔离带
-    uint64 user_stack_bottom = TRAPFRAME - current_proc->ustack_pages * PGSIZE - PGSIZE;
+    // 堆地址上限校验：不能进入为用户栈保留的区域 (栈按需向下增长到USTACK_BOTTOM)
+    // 保留区域下方的保护页作为堆与栈之间的安全隔离带
+    uint64 user_stack_bottom = USTACK_BOTTOM - USTACK_GUARD * PGSIZE;
     if (target_heap_top > user_stack_bottom) {
         return (uint64)-1;
     }
     
+    // 堆的页在第一次访问时才分配: 堆顶不能进入mmap区域, 否则缺页时无法区分堆和mmap映射
+    if (target_heap_top > MMAP_BEGIN) {
+        return (uint64)-1;
+    }
+    
     // 保存进程当前的堆顶地址，用于判断后续堆操作类型
-    uint64 original_heap_top = current_proc->heap_top;
+    uint64 original_heap_top = current_proc->mm->heap_top;
     
     // 处理堆扩展操作：目标堆顶大于当前堆顶，需要分配额外内存空间
     if (target_heap_top > original_heap_top) {
         // 计算需要扩展的内存字节长度
         uint32 heap_grow_length = target_heap_top - original_heap_top;
         // 调用用户堆扩展函数，更新进程堆顶地址
-        current_proc->heap_top = uvm_heap_grow(current_proc->pgtbl, original_heap_top, heap_grow_length);
+        current_proc->mm->heap_top = uvm_heap_grow(current_proc->mm->pgtbl, original_heap_top, heap_grow_length);
     } 
     // 处理堆收缩操作：目标堆顶小于当前堆顶，需要释放多余的内存空间
     else if (target_heap_top < original_heap_top) {
         // 计算需要收缩的内存字节长度
         uint32 heap_shrink_length = original_heap_top - target_heap_top;
         // 调用用户堆收缩函数，更新进程堆顶地址
-        current_proc->heap_top = uvm_heap_ungrow(current_proc->pgtbl, original_heap_top, heap_shrink_length);
+        current_proc->mm->heap_top = uvm_heap_ungrow(current_proc->mm->pgtbl, original_heap_top, heap_shrink_length);
     }
     // 若目标堆顶与当前堆顶相等，无需执行任何内存操作，直接保留原堆顶地址
     
     // 返回调整后的进程堆顶地址，标识堆操作执行结果
-    return current_proc->heap_top;
+    return current_proc->mm->heap_top;
 }
 
 // -------------------------- 内存区域映射系统调用 sys_mmap --------------------------
-// 功能：为当前进程分配连续用户内存并建立页表映射，支持自动分配和手动指定地址两种模式
+// 功能：为当前进程分配连续用户内存，支持自动分配和手动指定地址两种模式
+//       默认只占用地址区域，每一页在第一次访问时分配；MAP_POPULATE时立即分配并建立页表映射
 // 参数：uint64 start - 映射起始地址（传入0时由内核自动查找空闲区域）
 //       uint32 len   - 映射内存长度（必须为页大小的整数倍且大于0）
+//       uint32 flags - MAP_POPULATE 或 0
 // 返回值：执行成功返回映射区域起始地址，执行失败返回(uint64)-1
 uint64 sys_mmap()
 {
-    // 获取当前运行的进程控制块，基于该进程执行内存映射操作
-    proc_t* current_proc = myproc();
     // 定义变量存储映射起始地址和映射长度
     uint64 map_start_addr;
     uint32 map_total_length;
+    uint32 map_flags;
     
-    // 提取用户态传递的两个参数：映射起始地址（64位）、映射长度（32位）
+    // 提取用户态传递的三个参数：映射起始地址（64位）、映射长度（32位）、标志
     arg_uint64(0, &map_start_addr);
     arg_uint32(1, &map_total_length);
+    arg_uint32(2, &map_flags);
     
     // 映射长度合法性校验：长度不能为0，且必须满足页对齐要求
     if (map_total_length == 0 || map_total_length % PGSIZE != 0) {
@@ -90,18 +108,15 @@ uint64 sys_mmap()
     
     // 处理内核自动分配映射地址模式：用户传入起始地址为0
     if (map_start_addr == 0) {
-        // 遍历当前进程的mmap区域链表，查找满足大小要求的空闲内存区域
-        mmap_region_t* current_region = current_proc->mmap;
-        while (current_region != NULL) {
-            // 找到空闲页数大于等于所需页数的区域，确定映射起始地址
-            if (current_region->npages >= map_page_count) {
-                map_start_addr = current_region->begin;
-                break;
-            }
-            // 遍历下一个mmap区域节点
-            current_region = current_region->next;
+        // 在当前进程的空闲mmap区域树中查找满足大小要求的第一个空闲区域
+        // 不小于2MB的映射优先放在2MB对齐的位置, 以便使用大页
+        if (map_page_count >= MEGAPAGE_PAGES) {
+            map_start_addr = uvm_mmap_find_aligned(map_page_count, MEGAPAGE_SIZE);
+        }
+        if (map_start_addr == 0) {
+            map_start_addr = uvm_mmap_find(map_page_count);
         }
-        // 遍历结束后未找到合适空闲区域，返回失败标识
+        // 未找到合适空闲区域，返回失败标识
         if (map_start_addr == 0) {
             return (uint64)-1;
         }
@@ -114,8 +129,10 @@ uint64 sys_mmap()
         }
     }
     
-    // 调用用户内存映射函数，建立页表映射（权限设置为可读、可写）
-    uvm_mmap(map_start_addr, map_page_count, PTE_R | PTE_W);
+    // 调用用户内存映射函数（权限设置为可读、可写），区域已被占用时失败
+    if (!uvm_mmap(map_start_addr, map_page_count, PTE_R | PTE_W, (map_flags & MAP_POPULATE) != 0)) {
+        return (uint64)-1;
+    }
     
     // 返回映射区域的起始地址，标识内存映射操作成功
     return map_start_addr;
@@ -144,6 +161,26 @@ uint64 sys_munmap()
     // 计算需要解除映射的内存页数
     uint32 unmap_page_count = unmap_total_length / PGSIZE;
     
+    // 提交/完成队列的页面在进程退出前不能解除映射
+    if (uring_overlap(myproc(), unmap_start_addr, unmap_page_count)) {
+        return (uint64)-1;
+    }
+    
+    // 共享内存的映射只能用sys_shm_unmap整个解除
+    if (shm_overlap(myproc(), unmap_start_addr, unmap_page_count)) {
+        return (uint64)-1;
+    }
+    
+    // 线程的trapframe页在线程退出时才解除映射
+    if (uvm_kernel_overlap(myproc()->mm->pgtbl, unmap_start_addr, unmap_page_count)) {
+        return (uint64)-1;
+    }
+    
+    // 文件映射：写回被修改的页后解除映射（页面属于页缓存，不释放）
+    if (mmap_file_unmap(unmap_start_addr, unmap_page_count) == 0) {
+        return 0;
+    }
+    
     // 调用用户内存解除映射函数，释放对应的页表项和物理内存
     uvm_munmap(unmap_start_addr, unmap_page_count);
     
@@ -219,17 +256,19 @@ uint64 sys_sleep()
     uint32 sleep_total_ticks;
     // 提取用户态传递的第0个32位参数，即睡眠时长滴答数
     arg_uint32(0, &sleep_total_ticks);
+    if (sleep_total_ticks == 0) {
+        return 0;
+    }
+
+    // 到期时刻: 从现在起第sleep_total_ticks个tick开始的mtime
+    uint64 expire = timer_tick_mtime(timer_get_ticks() + sleep_total_ticks);
     
-    // 获取系统定时器自旋锁，保护滴答数的并发访问安全
+    // 获取系统定时器自旋锁作为睡眠的条件锁
     spinlock_acquire(&sys_timer.lk);
-    // 记录睡眠开始时的定时器滴答数，作为计时基准
-    uint64 sleep_start_ticks = sys_timer.ticks;
     
-    // 循环判断是否达到指定睡眠时长，未达到则让进程进入睡眠状态放弃CPU
-    while (sys_timer.ticks - sleep_start_ticks < sleep_total_ticks) {
-        // 调用进程睡眠核心函数，将进程加入睡眠队列等待唤醒
-        proc_sleep(&sys_timer.ticks, &sys_timer.lk);
-    }
+    // 睡眠在自己的定时器上: 只在到期时被时间轮唤醒 (不再每个tick唤醒所有睡眠者)
+    while (!proc_sleep_until(&myproc()->timer, &sys_timer.lk, expire))
+        ;
     
     // 睡眠时长到达，释放系统定时器自旋锁
     spinlock_release(&sys_timer.lk);
@@ -238,6 +277,445 @@ uint64 sys_sleep()
 }
 
 
-uint64 sys_exec(){
+// -------------------------- 程序执行系统调用 sys_exec --------------------------
+// 功能：用path指向的ELF可执行文件替换当前进程的地址空间，段内的页在第一次访问时从页缓存映射
+// 参数：char* path - 可执行文件路径；char** argv - 以NULL结尾的参数数组（可以为NULL）
+// 返回值：成功返回argc（即新程序main的第一个参数，a1为argv），失败返回(uint64)-1且原程序继续执行
+uint64 sys_exec()
+{
+    char path[DIR_PATH_LEN];
+    uint64 uargv;
+
+    arg_str(0, path, DIR_PATH_LEN);
+    arg_uint64(1, &uargv);
+    return proc_exec(path, uargv);
+}
+
+// -------------------------- 子进程创建并执行系统调用 sys_spawn --------------------------
+// 功能：创建执行path的子进程，直接从可执行文件建立子进程的地址空间（不像fork那样复制父进程的页表）
+// 参数：char* path - 可执行文件路径；char** argv - 以NULL结尾的参数数组（可以为NULL）
+// 返回值：成功返回子进程PID，失败返回(uint64)-1
+uint64 sys_spawn()
+{
+    char path[DIR_PATH_LEN];
+    uint64 uargv;
+
+    arg_str(0, path, DIR_PATH_LEN);
+    arg_uint64(1, &uargv);
+    return proc_spawn(path, uargv);
+}
+
+// -------------------------- 共享内存系统调用 sys_shm_* --------------------------
+// 功能：创建 / 映射 / 解除映射 / 销毁共享内存对象（同一组物理页映射进多个进程, 见mem/shm.h）
+
+// 参数：uint32 npages - 对象的页数
+// 返回值：成功返回对象id，失败返回(uint64)-1
+uint64 sys_shm_create()
+{
+    uint32 npages;
+    arg_uint32(0, &npages);
+    return shm_create(npages);
+}
+
+// 参数：uint32 id - 对象id
+// 返回值：成功返回映射的起始地址（位于mmap区域），失败返回(uint64)-1
+uint64 sys_shm_map()
+{
+    uint32 id;
+    arg_uint32(0, &id);
+    return shm_map((int)id);
+}
+
+// 参数：uint64 addr - sys_shm_map返回的起始地址
+// 返回值：成功返回0，失败返回(uint64)-1
+uint64 sys_shm_unmap()
+{
+    uint64 addr;
+    arg_uint64(0, &addr);
+    return shm_unmap(addr);
+}
+
+// 参数：uint32 id - 对象id（已有的映射仍然有效，最后一个映射解除后释放）
+// 返回值：成功返回0，失败返回(uint64)-1
+uint64 sys_shm_destroy()
+{
+    uint32 id;
+    arg_uint32(0, &id);
+    return shm_destroy((int)id);
+}
+
+// 读取当前进程的内存统计 (驻留页数、页表页数和缺页计数)
+// 参数：uint64 addr - 用户空间的mem_stat_t
+// 返回值：0
+uint64 sys_memstat()
+{
+    uint64 addr;
+    mem_stat_t st;
+
+    arg_uint64(0, &addr);
+    proc_mem_stat(myproc(), &st);
+    uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&st, sizeof(st));
+    return 0;
+}
+
+// 读取进程的I/O统计 (逻辑读写字节数、buf cache命中和磁盘请求, 见proc/proc.h)
+// 参数：uint32 pid - 进程 (0: 当前进程), uint64 addr - 用户空间的io_stat_t
+// 返回值：成功返回0，进程不存在返回-1
+uint64 sys_iostat()
+{
+    uint32 pid;
+    uint64 addr;
+    proc_info_t info;
+
+    arg_uint32(0, &pid);
+    arg_uint64(1, &addr);
+    if (pid == 0) {
+        pid = myproc()->pid;
+    }
+    if (!proc_info((int)pid, &info)) {
+        return -1;
+    }
+    uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&info.io, sizeof(info.io));
+    return 0;
+}
+
+// 读取进程的CPU时间统计 (用户态/内核态/等待时间和切换次数, 见proc/proc.h)
+// 参数：uint32 pid - 进程 (0: 当前进程), uint64 addr - 用户空间的cpu_stat_t
+// 返回值：成功返回0，进程不存在返回-1
+uint64 sys_cpustat()
+{
+    uint32 pid;
+    uint64 addr;
+    proc_info_t info;
+
+    arg_uint32(0, &pid);
+    arg_uint64(1, &addr);
+    if (pid == 0) {
+        pid = myproc()->pid;
+    }
+    if (!proc_info((int)pid, &info)) {
+        return -1;
+    }
+    uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&info.cstat, sizeof(info.cstat));
+    return 0;
+}
+
+// 锁竞争统计 (make LOCK_STAT=1, 见lib/lockstat.h)
+// 参数：uint64 addr - 用户空间的lockstat_t数组, uint32 n - 数组长度, int reset - 读取之后清零
+// 返回值：写入的项数 (按等待的cycle数降序的前n个类)，没有编译锁统计返回-1
+uint64 sys_lockstat()
+{
+#ifdef LOCK_STAT
+    uint64 addr;
+    uint32 n, reset;
+    uint8 order[N_LOCK_CLASS];
+
+    arg_uint64(0, &addr);
+    arg_uint32(1, &n);
+    arg_uint32(2, &reset);
+    uint32 count = lockstat_report(order);
+    if (n > count) {
+        n = count;
+    }
+    // 清零时没有报告的类也清零
+    for (uint32 i = 0; i < count && (i < n || reset); i++) {
+        lockstat_t st;
+        lockstat_read(order[i], &st, reset != 0);
+        if (i < n) {
+            uvm_copyout(myproc()->mm->pgtbl, addr + i * sizeof(lockstat_t), (uint64)&st, sizeof(st));
+        }
+    }
+    return n;
+#else
     return -1;
-}
\ No newline at end of file
+#endif
+}
+
+// 热路径计时 (make TIME_STAT=1, 见lib/tstat.h)
+// 参数：uint64 addr - 用户空间的tstat_t数组 (下标是计时点), uint32 n - 数组长度
+// 返回值：写入的项数, 没有热路径计时返回-1
+uint64 sys_tstat()
+{
+#ifdef TIME_STAT
+    uint64 addr;
+    uint32 n;
+
+    arg_uint64(0, &addr);
+    arg_uint32(1, &n);
+    if (n > N_TSTAT) {
+        n = N_TSTAT;
+    }
+    for (uint32 i = 0; i < n; i++) {
+        tstat_t st;
+        tstat_read(i, &st);
+        uvm_copyout(myproc()->mm->pgtbl, addr + i * sizeof(tstat_t), (uint64)&st, sizeof(st));
+    }
+    return n;
+#else
+    return -1;
+#endif
+}
+
+// 读取内核事件计数 (所有hart的和, 见lib/kstat.h)
+// 参数：uint64 addr - 用户空间的kstat_t
+// 返回值：成功返回0
+uint64 sys_kstat()
+{
+    uint64 addr;
+    kstat_t st;
+
+    arg_uint64(0, &addr);
+    kstat_read(&st);
+    uvm_copyout(myproc()->mm->pgtbl, addr, (uint64)&st, sizeof(st));
+    return 0;
+}
+
+// 读取内核日志 (各hart保留的最近部分, 见lib/klog.h)
+// 参数：uint64 addr - 用户缓冲区, uint32 len - 缓冲区大小
+// 返回值：复制的字节数
+uint64 sys_dmesg()
+{
+    uint64 addr;
+    uint32 len;
+
+    arg_uint64(0, &addr);
+    arg_uint32(1, &len);
+    return klog_read(addr, len, true);
+}
+
+// 追踪点 (见lib/trace.h)
+// 参数：int op - 0: 设置打开的类别 / 1: 取出记录
+//       op = 0: uint64 arg - 类别的位图
+//       op = 1: uint64 arg - 用户空间的trace_event_t数组, uint32 n - 数组长度, uint64 lost_addr - 写入被覆盖的记录数 (0: 不需要)
+// 返回值：op = 0返回原来的类别, op = 1返回取出的条数, op无效返回-1
+uint64 sys_trace()
+{
+    uint32 op, n;
+    uint64 arg, lost_addr;
+
+    arg_uint32(0, &op);
+    arg_uint64(1, &arg);
+    arg_uint32(2, &n);
+    arg_uint64(3, &lost_addr);
+    if (op == 0) {
+        return trace_set((uint32)arg);
+    }
+    if (op != 1) {
+        return -1;
+    }
+    uint64 lost;
+    uint32 ret = trace_read(arg, n, &lost);
+    if (lost_addr != 0) {
+        uvm_copyout(myproc()->mm->pgtbl, lost_addr, (uint64)&lost, sizeof(lost));
+    }
+    return ret;
+}
+
+// 系统调用录制 (见syscall/sysrec.h)
+// 参数：int op - SYSREC_START / SYSREC_STOP / SYSREC_READ
+//       SYSREC_START / SYSREC_STOP: uint64 arg - pid (0: 当前进程)
+//       SYSREC_READ: uint64 arg - 用户空间的sysrec_t数组, uint32 n - 数组长度, uint64 lost_addr - 写入丢弃的记录数 (0: 不需要)
+// 返回值：SYSREC_READ返回取出的条数, 其余返回0, 进程不存在、申请不到缓冲区或op无效返回-1
+uint64 sys_sysrec()
+{
+    uint32 op, n;
+    uint64 arg, lost_addr;
+
+    arg_uint32(0, &op);
+    arg_uint64(1, &arg);
+    arg_uint32(2, &n);
+    arg_uint64(3, &lost_addr);
+    if (op == SYSREC_START) {
+        return sysrec_start((int)arg);
+    }
+    if (op == SYSREC_STOP) {
+        return sysrec_stop((int)arg);
+    }
+    if (op != SYSREC_READ) {
+        return -1;
+    }
+    uint64 lost;
+    uint32 ret = sysrec_read(arg, n, &lost);
+    if (lost_addr != 0) {
+        uvm_copyout(myproc()->mm->pgtbl, lost_addr, (uint64)&lost, sizeof(lost));
+    }
+    return ret;
+}
+
+// 采样分析 (见lib/prof.h)
+// 参数：int op - PROF_START / PROF_STOP / PROF_READ
+//       PROF_START: uint64 arg - 每隔几个tick采样一次
+//       PROF_READ: uint64 arg - 用户空间的prof_sample_t数组, uint32 n - 数组长度, uint64 dropped_addr - 写入丢弃的采样数 (0: 不需要)
+// 返回值：PROF_READ返回取出的条数, 其余返回0, op无效返回-1
+uint64 sys_prof()
+{
+    uint32 op, n;
+    uint64 arg, dropped_addr;
+
+    arg_uint32(0, &op);
+    arg_uint64(1, &arg);
+    arg_uint32(2, &n);
+    arg_uint64(3, &dropped_addr);
+    switch (op) {
+    case PROF_START:
+        prof_start((uint32)arg);
+        return 0;
+    case PROF_STOP:
+        prof_stop();
+        return 0;
+    case PROF_READ:
+        break;
+    default:
+        return -1;
+    }
+    uint64 dropped;
+    uint32 ret = prof_read(arg, n, &dropped);
+    if (dropped_addr != 0) {
+        uvm_copyout(myproc()->mm->pgtbl, dropped_addr, (uint64)&dropped, sizeof(dropped));
+    }
+    return ret;
+}
+
+// 设置进程的基础优先级 (0最高, 见proc/proc.h的多级反馈队列说明)
+// 参数：int pid - 进程号 (0: 当前进程), int prio - 优先级 [0, SCHED_LEVELS)
+// 返回值：原来的基础优先级，进程不存在或优先级无效返回-1
+uint64 sys_setpriority()
+{
+    uint32 pid, prio;
+
+    arg_uint32(0, &pid);
+    arg_uint32(1, &prio);
+    return proc_setpriority((int)pid, (int)prio);
+}
+
+// 设置进程可以运行的hart (位图, 第i位对应hart i)
+// 参数：int pid - 进程号 (0: 当前进程), uint32 mask - 亲和性掩码
+// 返回值：成功返回0，进程不存在或掩码中没有存在的hart返回-1
+uint64 sys_sched_setaffinity()
+{
+    uint32 pid, mask;
+
+    arg_uint32(0, &pid);
+    arg_uint32(1, &mask);
+    return proc_setaffinity((int)pid, mask);
+}
+
+// 读取进程的亲和性掩码
+// 参数：int pid - 进程号 (0: 当前进程)
+// 返回值：亲和性掩码，进程不存在返回-1
+uint64 sys_sched_getaffinity()
+{
+    uint32 pid;
+
+    arg_uint32(0, &pid);
+    return proc_getaffinity((int)pid);
+}
+
+// 当前进程进入期限调度类 (见proc/proc.h的期限调度说明)
+// 参数：uint32 runtime_us, deadline_us, period_us - 每个周期的运行时间、相对期限和周期 (微秒, runtime_us = 0: 离开)
+// 返回值：成功返回0，参数无效或准入控制失败返回-1
+uint64 sys_sched_setdeadline()
+{
+    uint32 runtime, deadline, period;
+
+    arg_uint32(0, &runtime);
+    arg_uint32(1, &deadline);
+    arg_uint32(2, &period);
+    return proc_setdeadline((uint64)runtime * TIMER_MTIME_PER_US, (uint64)deadline * TIMER_MTIME_PER_US,
+                            (uint64)period * TIMER_MTIME_PER_US);
+}
+
+// 设置接收外部设备中断的hart (位图, 见dev/plic.h)
+// 参数：int irq - 中断源 (UART 10, virtio磁盘 1), uint32 mask - 亲和性掩码
+// 返回值：成功返回0，中断源无效或掩码中没有存在的hart返回-1
+uint64 sys_irq_setaffinity()
+{
+    uint32 irq, mask;
+
+    arg_uint32(0, &irq);
+    arg_uint32(1, &mask);
+    return plic_set_affinity((int)irq, mask);
+}
+
+// 创建与当前进程共享地址空间和文件描述符表的线程 (见proc/proc.h)
+// 参数：uint64 fn - 线程的入口, uint64 arg - 入口的参数(a0), uint64 stack - 线程的用户栈顶(sp)
+// 返回值：成功返回线程的pid，栈顶不对齐、没有槽位或内存不足返回-1
+uint64 sys_clone()
+{
+    uint64 fn, arg, stack;
+
+    arg_uint64(0, &fn);
+    arg_uint64(1, &arg);
+    arg_uint64(2, &stack);
+    if (stack % 16 != 0) {
+        return (uint64)-1;
+    }
+    return proc_clone(fn, arg, stack);
+}
+
+// 设置时钟中断的周期和tickless模式 (见dev/timer.h)
+// 参数：uint32 period_us - tick的周期(微秒, 0: 不变), int tickless - 1启用 0关闭 (<0: 不变)
+// 返回值：当前的周期(微秒)，周期超出范围返回-1
+uint64 sys_timer_config()
+{
+    uint32 period_us;
+    int tickless;
+
+    arg_uint32(0, &period_us);
+    arg_uint32(1, (uint32*)&tickless);
+    uint64 interval = (uint64)period_us * TIMER_MTIME_PER_US;
+    if (period_us != 0 && (interval < TIMER_INTERVAL_MIN || interval > TIMER_INTERVAL_MAX)) {
+        return (uint64)-1;
+    }
+    return timer_config(interval, tickless) / TIMER_MTIME_PER_US;
+}
+
+// 设置缺页时顺带映射的窗口页数 (见mem/mmap.h, 文件映射和程序映像的只读页)
+// 参数：uint32 pages - 窗口页数 (0或1: 只映射缺页的那一页)
+// 返回值：之前的窗口页数，超过FAULT_AROUND_MAX返回-1
+uint64 sys_fault_around()
+{
+    uint32 pages;
+
+    arg_uint32(0, &pages);
+    if (pages > FAULT_AROUND_MAX) {
+        return (uint64)-1;
+    }
+    return fault_around_set(pages);
+}
+
+// 读取高精度时钟 (不受tick周期限制, 可以测量短于一个tick的操作)
+// 参数：int clock - CLOCK_MONOTONIC: 启动以来的时间
+// 返回值：纳秒数 (由CLINT mtime换算, 精度100ns)，clock无效返回-1
+uint64 sys_clock_gettime()
+{
+    uint32 clock;
+
+    arg_uint32(0, &clock);
+    if (clock != CLOCK_MONOTONIC) {
+        return (uint64)-1;
+    }
+    return timer_get_ns();
+}
+
+// 用户态锁的睡眠与唤醒 (见proc/futex.h), 不在mm->lk下执行: 等待期间其他线程要能修改地址空间
+// 参数：uint32* uaddr - 锁字(4字节对齐), int op - FUTEX_WAIT / FUTEX_WAKE,
+//       uint32 val - WAIT: 期望的值, WAKE: 最多唤醒的进程数, uint32 timeout - WAIT的超时微秒数 (0: 不超时)
+// 返回值：WAIT被唤醒返回0、超时返回1; WAKE返回唤醒的进程数; 值不等、地址无效或op无效返回-1
+uint64 sys_futex()
+{
+    uint64 uaddr;
+    uint32 op, val, timeout;
+
+    arg_uint64(0, &uaddr);
+    arg_uint32(1, &op);
+    arg_uint32(2, &val);
+    arg_uint32(3, &timeout);
+    if (op == FUTEX_WAIT) {
+        return futex_wait(uaddr, val, timeout);
+    }
+    if (op == FUTEX_WAKE) {
+        return futex_wake(uaddr, val);
+    }
+    return (uint64)-1;
+}
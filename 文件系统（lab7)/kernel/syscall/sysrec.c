@@ -0,0 +1,142 @@
+#include "syscall/sysrec.h"
+#include "syscall/sysnum.h"
+#include "syscall/syscall.h"
+#include "dev/timer.h"
+#include "mem/pmem.h"
+#include "mem/vmem.h"
+#include "proc/cpu.h"
+#include "proc/proc.h"
+#include "lib/lock.h"
+#include "lib/str.h"
+#include "riscv.h"
+
+// 系统调用录制 (见syscall/sysrec.h)
+
+static struct {
+    spinlock_t lk;
+    sysrec_t* buf;     // SYSREC_N条 (第一次开始录制时申请)
+    uint64 head;       // 下一条取出的记录
+    uint64 tail;       // 下一条写入的记录 (tail - head <= SYSREC_N)
+    uint64 lost;       // 缓冲区满时丢弃的记录数 (读出时清零)
+} sysrec;
+
+// 参数是路径的系统调用: 路径参数的序号 + 1
+static uint8 sysrec_path_arg[SYS_MAX + 1] = {
+    [SYS_exec]          1,
+    [SYS_spawn]         1,
+    [SYS_open]          1,
+    [SYS_mkdir]         1,
+    [SYS_chdir]         1,
+    [SYS_link]          1,
+    [SYS_unlink]        1,
+    [SYS_rename]        1,
+    [SYS_openat]        2,
+    [SYS_mkdirat]       2,
+    [SYS_unlinkat]      2,
+    [SYS_linkat]        2,
+    [SYS_fstatat]       2,
+    [SYS_clone_file]    2,
+};
+
+void sysrec_init()
+{
+    spinlock_init(&sysrec.lk, "sysrec");
+    sysrec.buf = NULL;
+    sysrec.head = sysrec.tail = sysrec.lost = 0;
+}
+
+void sysrec_path(proc_t* p, int num, char* path)
+{
+    path[0] = 0;
+    if (sysrec_path_arg[num] != 0) {
+        uint64 addr;
+        arg_uint64(sysrec_path_arg[num] - 1, &addr);
+        uvm_copyin_str(p->mm->pgtbl, (uint64)path, addr, SYSREC_PATH - 1);
+        path[SYSREC_PATH - 1] = 0;
+    }
+}
+
+void sysrec_record(proc_t* p, int num, uint64* args, char* path, uint64 start, uint64 dt, uint64 ret)
+{
+    if (num == SYS_sysrec) {
+        return;
+    }
+    uint64 dur = dt * 1000 / TIMER_MTIME_PER_US;
+
+    spinlock_acquire(&sysrec.lk);
+    if (sysrec.tail - sysrec.head == SYSREC_N) {
+        sysrec.lost++;
+        spinlock_release(&sysrec.lk);
+        return;
+    }
+    sysrec_t* r = &sysrec.buf[sysrec.tail % SYSREC_N];
+    r->time = start * 1000 / TIMER_MTIME_PER_US;
+    r->dur = (dur > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32)dur;
+    r->num = num;
+    r->hart = r_tp();
+    r->pid = p->pid;
+    r->pad = 0;
+    memmove(r->args, args, sizeof(r->args));
+    r->ret = ret;
+    memmove(r->path, path, SYSREC_PATH);
+    sysrec.tail++;
+    spinlock_release(&sysrec.lk);
+}
+
+int sysrec_start(int pid)
+{
+    // 第一次录制时申请缓冲区 (在锁外申请, 同时开始的另一方申请到的还回去)
+    if (sysrec.buf == NULL) {
+        sysrec_t* buf = (sysrec_t*)pmem_alloc_order(SYSREC_ORDER);
+        if (buf == NULL) {
+            return -1;
+        }
+        spinlock_acquire(&sysrec.lk);
+        if (sysrec.buf == NULL) {
+            sysrec.buf = buf;
+            buf = NULL;
+        }
+        spinlock_release(&sysrec.lk);
+        if (buf != NULL) {
+            pmem_free_order((uint64)buf, SYSREC_ORDER);
+        }
+    }
+    return proc_set_sysrec(pid, true);
+}
+
+int sysrec_stop(int pid)
+{
+    return proc_set_sysrec(pid, false);
+}
+
+uint32 sysrec_read(uint64 dst, uint32 n, uint64* lost)
+{
+    if (n > SYSREC_READ_MAX) {
+        n = SYSREC_READ_MAX;
+    }
+    *lost = 0;
+    if (sysrec.buf == NULL || n == 0) {
+        return 0;
+    }
+    sysrec_t* tmp = (sysrec_t*)pmem_alloc_flags(true, PMEM_TAG(MEMTAG_TEMP));  // 只读取复制过的部分, 不需要清零
+    if (tmp == NULL) {
+        return 0;
+    }
+
+    // 在锁内复制到临时页, 在锁外复制给用户 (可能缺页)
+    spinlock_acquire(&sysrec.lk);
+    uint32 done = 0;
+    while (done < n && sysrec.head < sysrec.tail) {
+        tmp[done++] = sysrec.buf[sysrec.head % SYSREC_N];
+        sysrec.head++;
+    }
+    *lost = sysrec.lost;
+    sysrec.lost = 0;
+    spinlock_release(&sysrec.lk);
+
+    if (done > 0) {
+        uvm_copyout(myproc()->mm->pgtbl, dst, (uint64)tmp, done * sizeof(sysrec_t));
+    }
+    pmem_free((uint64)tmp, true);
+    return done;
+}
@@ -0,0 +1,50 @@
+#include "trap/softirq.h"
+#include "proc/cpu.h"
+#include "lib/kstat.h"
+#include "lib/print.h"
+#include "riscv.h"
+
+// 软中断 (见trap/softirq.h): 处理函数表在设备初始化时填写, 之后只读
+static void (*softirq_fn[N_SOFTIRQ])(void);
+
+void softirq_register(int nr, void (*fn)(void))
+{
+    assert(nr >= 0 && nr < N_SOFTIRQ, "softirq_register: invalid softirq");
+    softirq_fn[nr] = fn;
+}
+
+void softirq_raise(int nr)
+{
+    assert(intr_get() == 0, "softirq_raise: interrupt enabled");
+    mycpu()->softirq_pending |= (1u << nr);
+}
+
+bool softirq_active()
+{
+    return mycpu()->in_softirq;
+}
+
+// 取出待处理的掩码后开中断执行, 执行期间嵌套的中断触发的软中断在下一轮处理
+// 返回时仍是关中断 (外层陷阱之后恢复sstatus)
+void softirq_run()
+{
+    cpu_t* c = mycpu();
+    assert(intr_get() == 0 && c->noff == 0, "softirq_run: interrupt enabled or spinlock held");
+    if (c->in_softirq) {
+        return;
+    }
+    c->in_softirq = true;
+    while (c->softirq_pending != 0) {
+        uint32 pending = c->softirq_pending;
+        c->softirq_pending = 0;
+        intr_on();
+        for (int nr = 0; nr < N_SOFTIRQ; nr++) {
+            if ((pending & (1u << nr)) && softirq_fn[nr] != NULL) {
+                KSTAT_INC(softirqs);
+                softirq_fn[nr]();
+            }
+        }
+        intr_off();
+    }
+    c->in_softirq = false;
+}
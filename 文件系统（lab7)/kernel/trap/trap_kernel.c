@@ -2,9 +2,15 @@
 #include "dev/timer.h"
 #include "dev/uart.h"
 #include "dev/plic.h"
+#include "dev/vio.h"
 #include "trap/trap.h"
+#include "trap/softirq.h"
 #include "proc/proc.h"
 #include "proc/cpu.h"
+#include "proc/kwork.h"
+#include "lib/kstat.h"
+#include "lib/klog.h"
+#include "lib/prof.h"
 #include "memlayout.h"
 #include "riscv.h"
 
@@ -69,16 +75,22 @@ void trap_kernel_inithart()
 }
 
 // -------------------------- 外部外设中断处理函数 --------------------------
-// 功能：处理基于PLIC的外部外设中断，目前支持UART中断，其他中断做容错处理
+// 功能：处理基于PLIC的外部外设中断，支持UART和virtio磁盘中断 (由哪些hart处理见dev/plic.h)，其他中断做容错处理
 void external_interrupt_handler()
 {
     // 从PLIC控制器中获取当前待处理的中断请求号
     int current_irq = plic_claim();
+    if (current_irq != 0) {
+        KSTAT_INC(dev_intrs);
+    }
 
     // 分类型处理外部中断
     if (current_irq == UART_IRQ) {
         // 处理UART外设中断（串口数据收发等逻辑）
         uart_intr();
+    } else if (current_irq >= VIRTIO_IRQ && current_irq < VIRTIO_IRQ + VIRTIO_NSLOT) {
+        // 处理virtio磁盘中断（回收该设备各队列完成的请求并唤醒等待者）
+        virtio_disk_intr(current_irq - VIRTIO_IRQ);
     } else if (current_irq != 0) {
         // 处理未知外部中断，仅打印1条核心错误日志（减少输出条数，改变原格式）
         printf("Unknown external interrupt: irq=%d\n", current_irq);
@@ -92,19 +104,44 @@ void external_interrupt_handler()
 }
 
 // -------------------------- 时钟中断处理函数 --------------------------
-// 功能：处理基于CLINT的系统时钟中断，更新全局时钟并清除软件中断标志
-void timer_interrupt_handler()
+// 功能：处理基于CLINT的系统时钟中断，补上经过的tick、推进时间轮，设置本hart的下一次中断并清除软件中断标志
+// 返回值：true表示本hart经过了一个tick；false表示只是处理器间中断或定时器到期（不计入时间片）
+bool timer_interrupt_handler()
 {
-    // 仅让CPU 0负责更新全局系统时钟滴答数
-    // 避免多个CPU核心同时更新时钟导致数据竞争，保证计时准确性
-    if (mycpuid() == 0) {
-        timer_update();
-    }
-
     // 清除SIP寄存器中的SSIP软件中断标志位（对应bit 1，值为2）
     // 若不清除该标志，CPU会认为中断仍未处理完成，引发无限中断循环
+    // 先清除再取tick标志: 之后到来的时钟中断会再次设置SSIP, 不会丢失
     uint64 current_sip = r_sip();
     w_sip(current_sip & ~2);
+
+    if (!timer_tick_pending()) {
+        return false;
+    }
+    KSTAT_INC(timer_intrs);
+
+    // 任何hart都可以推进全局时钟 (tickless时hart 0可能在空闲): 按mtime补上错过的tick
+    // 推进了tick的hart执行每个tick的工作 (时钟在锁下推进, 同一个tick只有一个hart推进)
+    if (timer_update() > 0) {
+        kwork_tick(timer_get_ticks());
+        proc_loadavg_tick();
+        klog_kick();
+    }
+
+    // 唤醒到期的定时睡眠
+    ktimer_run();
+
+    // 下一个tick的边界或最早的定时器 (空闲的hart回到调度器后在tickless模式下重新推迟)
+    timer_rearm();
+
+    // 中断可能来自一个定时器而不是tick的边界: 本hart看到的tick变了才计入时间片
+    static uint64 hart_ticks[NCPU];
+    int id = mycpuid();
+    uint64 now = timer_get_ticks();
+    if (now == hart_ticks[id]) {
+        return false;
+    }
+    hart_ticks[id] = now;
+    return true;
 }
 
 // -------------------------- 内核态陷阱处理核心逻辑 --------------------------
@@ -133,21 +170,33 @@ void trap_kernel_handler()
         switch (trap_type) {
             // 情况1：S-mode软件中断（由M-mode定时器中断触发）
             case 1:
-                timer_interrupt_handler();
-                // 若当前有运行中的进程，触发进程调度切换
-                proc_t* running_proc = myproc();
-                if (running_proc != NULL && running_proc->state == RUNNING) {
-                    proc_yield();
+                // 若发生了tick且当前有运行中的进程，计入它的时间片（用完时触发进程调度切换）
+                // 只是处理器间中断时没有别的事要做; 打断了软中断下半部时不切换, 留到外层陷阱的抢占点
+                if (timer_interrupt_handler()) {
+                    PROF_TICK(trap_sepc, false);
+                    proc_t* running_proc = myproc();
+                    if (running_proc != NULL && running_proc->state == RUNNING) {
+                        if (softirq_active()) {
+                            mycpu()->need_resched = true;
+                        } else {
+                            proc_tick();
+                        }
+                    }
                 }
                 break;
 
             // 情况2：S-mode定时器中断
             case 5:
-                timer_interrupt_handler();
-                // 若当前有运行中的进程，触发进程调度切换
-                proc_t* curr_running_proc = myproc();
-                if (curr_running_proc != NULL && curr_running_proc->state == RUNNING) {
-                    proc_yield();
+                if (timer_interrupt_handler()) {
+                    PROF_TICK(trap_sepc, false);
+                    proc_t* curr_running_proc = myproc();
+                    if (curr_running_proc != NULL && curr_running_proc->state == RUNNING) {
+                        if (softirq_active()) {
+                            mycpu()->need_resched = true;
+                        } else {
+                            proc_tick();
+                        }
+                    }
                 }
                 break;
 
@@ -173,7 +222,22 @@ void trap_kernel_handler()
         panic("trap_kernel_handler: Encountered unexpected exception");
     }
 
+    // 设备中断的下半部: 开中断处理完成的请求和收到的字符 (嵌套在下半部中的陷阱直接返回, 由外层处理)
+    if (trap_is_interrupt) {
+        softirq_run();
+    }
+
+    // 运行队列中来了优先级更高的进程 (处理器间中断, 或者这次中断唤醒了它): 不等下一个tick, 现在让出CPU
+    // 中断打断的代码开着中断, 不持有自旋锁; 打断了软中断下半部时不切换 (见trap/softirq.h)
+    if (trap_is_interrupt && mycpu()->need_resched && !softirq_active()) {
+        proc_t* p = myproc();
+        if (p != NULL && p->state == RUNNING) {
+            proc_resched();
+        }
+    }
+
     // 恢复陷阱发生前的寄存器状态，确保陷阱返回后程序正常执行
+    // FS位保留现在的值: 中间让出过CPU时浮点状态已经保存并关闭 (见proc/fpu.h), 不能恢复成陷阱时的状态
     w_sepc(trap_sepc);
-    w_sstatus(trap_sstatus);
+    w_sstatus((trap_sstatus & ~SSTATUS_FS) | (r_sstatus() & SSTATUS_FS));
 }
\ No newline at end of file
@@ -1,9 +1,18 @@
 #include "lib/print.h"
 #include "trap/trap.h"
+#include "trap/softirq.h"
 #include "proc/cpu.h"
 #include "proc/proc.h"
 #include "mem/vmem.h"
+#include "mem/mmap.h"
+#include "mem/asid.h"
+#include "mem/swap.h"
 #include "syscall/syscall.h"
+#include "fs/uring.h"
+#include "proc/vdata.h"
+#include "proc/fpu.h"
+#include "lib/kstat.h"
+#include "lib/prof.h"
 #include "memlayout.h"
 #include "riscv.h"
 
@@ -19,17 +28,75 @@ extern char kernel_vector[];   // 内核态自身陷阱/中断的核心处理流
 extern char* interrupt_info[16]; // 中断类型对应的详细错误信息描述表
 extern char* exception_info[16]; // 异常类型对应的详细错误信息描述表
 
+// -------------------------- 用户态缺页处理 --------------------------
+// 换出的页换入, 写时复制共享的页在写入时复制, 程序映像、堆、用户栈、匿名映射和文件映射区域的页面在第一次访问时映射
+// 返回false说明地址无效
+static bool trap_user_fault(proc_t* p, uint64 va, int type)
+{
+    bool write = (type == 15);
+    KSTAT_INC(page_faults);
+    bool locked = mm_lock(p);
+    bool ok = swap_fault(va) ||
+              (write && uvm_cow_fault(p->mm->pgtbl, va)) ||
+              exec_fault(va, write) ||
+              // 堆、栈、匿名映射和文件映射的页不可执行
+              (type != 12 && (uvm_heap_fault(p->mm->pgtbl, p->mm->heap_top, va, write) ||
+                              uvm_stack_fault(p->mm->pgtbl, &p->mm->ustack_pages, va, write) ||
+                              uvm_mmap_fault(p->mm->pgtbl, va, write) ||
+                              mmap_file_fault(va, write)));
+    mm_unlock(p, locked);
+    return ok;
+}
+
+// 返回用户态之前处理提交队列中的请求（系统调用、时钟中断都会经过这里, 用户只需轮询完成队列）, 然后返回用户态
+static void trap_user_finish(proc_t* p)
+{
+    if (uring_pending(p)) {
+        intr_on();
+        uring_process(p);
+    }
+    // 系统调用或中断期间有更高优先级的进程进入了本hart的队列
+    if (mycpu()->need_resched) {
+        proc_resched();
+    }
+    proc_dl_arm(p);
+    trap_user_return();
+}
+
+// -------------------------- 系统调用的快速路径 --------------------------
+// 来自U-mode的ecall (scause = 8) 不经过中断/异常的分类, 也不读取sstatus和stval:
+// 内核陷阱入口 → 退出用户地址空间 → 执行系统调用 → 返回
+static void trap_user_syscall(proc_t* p)
+{
+    w_stvec((uint64)kernel_vector);
+    asid_user_exit(p);
+
+    // epc偏移4字节，指向用户态下一条指令
+    p->tf->epc = r_sepc() + 4;
+    intr_on();
+    syscall();
+    trap_user_finish(p);
+}
+
 // -------------------------- 用户态陷阱处理核心逻辑 --------------------------
 // 功能：在user_vector汇编入口中被调用，处理所有来自U-mode用户态的陷阱/中断
 // 流程：保存用户现场 → 区分中断/异常处理 → 触发对应逻辑 → 准备返回用户态
 void trap_user_handler()
 {
+    uint64 user_trap_scause = r_scause();    // 记录引发用户态陷阱的具体原因标识
+    proc_t* current_user_proc = myproc();    // 获取当前触发陷阱的用户进程控制块
+    proc_acct_enter(current_user_proc);      // 到现在为止是用户态时间
+
+    // 0. 系统调用 (最常见的陷阱) 走快速路径
+    if (user_trap_scause == 8) {
+        trap_user_syscall(current_user_proc);
+        return;
+    }
+
     // 1. 读取陷阱发生时的核心寄存器，完整保存用户态现场信息
     uint64 user_trap_sepc = r_sepc();        // 记录陷阱发生时用户态的程序计数器（PC值）
     uint64 user_trap_sstatus = r_sstatus();  // 记录陷阱发生时的特权模式与中断使能状态
-    uint64 user_trap_scause = r_scause();    // 记录引发用户态陷阱的具体原因标识
     uint64 user_trap_stval = r_stval();      // 记录陷阱相关的附加辅助信息（随陷阱类型变化）
-    proc_t* current_user_proc = myproc();    // 获取当前触发陷阱的用户进程控制块
 
     // 2. 断言校验：确保当前陷阱确实来自U-mode用户态，防止非法模式陷阱
     assert((user_trap_sstatus & SSTATUS_SPP) == 0, "trap_user_handler: Trap is not originated from U-mode");
@@ -38,6 +105,9 @@ void trap_user_handler()
     // 防止在处理用户态陷阱期间，内核自身发生嵌套陷阱导致逻辑混乱
     w_stvec((uint64)kernel_vector);
 
+    // 本hart不再在用户态运行这个地址空间 (修改共享页表的线程不再等待本hart, 见mem/asid.h)
+    asid_user_exit(current_user_proc);
+
     // 4. 保存用户态程序计数器到进程陷阱帧，为后续返回用户态做准备
     current_user_proc->tf->epc = user_trap_sepc;
 
@@ -51,19 +121,27 @@ void trap_user_handler()
         switch (user_trap_type) {
             // 情况1：S-mode软件中断（对应用户态时钟中断通知）
             case 1:
-                timer_interrupt_handler();  // 调用时钟中断核心处理函数，更新全局时钟
-                proc_yield();               // 时钟中断触发进程调度，放弃CPU使用权
+                // 调用时钟中断核心处理函数，更新全局时钟 (只是处理器间中断时没有别的事要做)
+                if (timer_interrupt_handler()) {
+                    PROF_TICK(user_trap_sepc, true);
+                    swap_balance();         // 进程在用户态被打断, 不持有任何用户页: 内存紧张时换出自己的冷页
+                    proc_tick();            // 时间片用完或有更高优先级的进程时放弃CPU使用权
+                }
                 break;
 
             // 情况2：S-mode定时器中断（用户态进程计时中断）
             case 5:
-                timer_interrupt_handler();  // 调用时钟中断核心处理函数，更新全局时钟
-                proc_yield();               // 定时器中断触发进程调度，进行进程切换
+                if (timer_interrupt_handler()) {
+                    PROF_TICK(user_trap_sepc, true);
+                    swap_balance();
+                    proc_tick();            // 时间片用完或有更高优先级的进程时进行进程切换
+                }
                 break;
 
             // 情况3：S-mode外部外设中断（如UART串口中断）
             case 9:
                 external_interrupt_handler();  // 调用外部中断核心处理函数，处理外设请求
+                softirq_run();                 // 下半部: 开中断处理完成的请求和收到的字符
                 break;
 
             // 情况4：未知用户态中断类型，报错并终止内核运行
@@ -92,7 +170,30 @@ void trap_user_handler()
                 syscall();
                 break;
 
-            // 情况2：未知用户态异常类型，报错并终止内核运行
+            // 情况2：U-mode取指/读/写缺页（换出的页换入, 写时复制共享的页在写入时复制, 程序映像、堆、匿名映射和文件映射区域的页面在第一次访问时映射）
+            case 12:
+            case 13:
+            case 15:
+                // 缺页处理可能读文件（睡眠等待磁盘），需要开中断; 共享的地址空间在mm->lk下处理
+                intr_on();
+                if (trap_user_fault(current_user_proc, user_trap_stval, user_trap_type)) {
+                    break;
+                }
+                printf("User page fault outside file mappings: %s (trap_type=%d)\n",
+                       exception_info[user_trap_type], user_trap_type);
+                printf("Exception details: scause=%p, sepc=%p, stval=%p\n",
+                       user_trap_scause, user_trap_sepc, user_trap_stval);
+                panic("trap_user_handler: Encountered unexpected user page fault");
+                break;
+
+            // 情况3：非法指令 (FS = Off时的第一条浮点指令: 装入进程的浮点状态后重新执行)
+            case 2:
+                if (fpu_trap(current_user_proc, user_trap_sstatus)) {
+                    break;
+                }
+                // 真正的非法指令: 与未知异常相同处理
+
+            // 情况4：未知用户态异常类型，报错并终止内核运行
             default:
                 // 合并日志信息，仅输出2条核心内容（改变原输出格式，降低查重）
                 printf("Unknown user-mode exception: %s (trap_type=%d)\n", 
@@ -104,8 +205,8 @@ void trap_user_handler()
         }
     }
 
-    // 7. 陷阱处理完成，调用返回函数，切换回用户态继续执行
-    trap_user_return();
+    // 7. 陷阱处理完成，处理提交队列之后切换回用户态继续执行
+    trap_user_finish(current_user_proc);
 }
 
 // -------------------------- 内核态返回用户态核心逻辑 --------------------------
@@ -118,18 +219,20 @@ void trap_user_return()
 
     // 2. 关闭内核中断，防止切换过程中被中断干扰，保证切换原子性
     intr_off();
+    proc_acct_leave(target_user_proc);  // 从陷入 (或开始运行) 到现在是内核态时间
 
     // 3. 配置用户态陷阱入口：将stvec指向trampoline中的user_vector
     // 计算user_vector在用户地址空间中的绝对地址（跳板代码固定映射在TRAMPOLINE）
     uint64 user_trampoline_vector = TRAMPOLINE + (user_vector - trampoline);
     w_stvec(user_trampoline_vector);
 
-    // 4. 填充进程陷阱帧的内核相关字段，为下次用户态进入内核态做准备
-    target_user_proc->tf->kernel_satp = r_satp();                // 保存当前内核页表的satp值
-    target_user_proc->tf->kernel_sp = target_user_proc->kstack + PGSIZE;  // 保存内核栈顶地址
-    target_user_proc->tf->kernel_trap = (uint64)trap_user_handler;  // 保存用户态陷阱处理入口
+    // 4. 陷阱帧中内核页表、内核栈和陷阱入口在创建进程时已经设置 (proc_tf_init), 只有hart会随迁移变化
     target_user_proc->tf->kernel_hartid = r_tp();                // 保存当前CPU核心ID
 
+    // 用户数据页: 记录从这个hart返回用户态的进程, 用户的tp寄存器是hartid (见proc/vdata.h)
+    vdata_enter_user(target_user_proc->pid);
+    target_user_proc->tf->tp = r_tp();
+
     // 5. 配置sstatus寄存器：准备返回用户态的特权模式与中断状态
     uint64 return_sstatus = r_sstatus();
     return_sstatus &= ~SSTATUS_SPP;   // 清除SPP位，标识sret返回后进入U-mode用户态
@@ -139,16 +242,13 @@ void trap_user_return()
     // 6. 配置sepc寄存器：恢复用户态陷阱发生前的程序计数器
     w_sepc(target_user_proc->tf->epc);
 
-    // 7. 计算用户页表的satp值，用于切换到用户地址空间
-    uint64 user_satp = MAKE_SATP(target_user_proc->pgtbl);
+    // 7. 计算用户页表的satp值（带进程的ASID，切换时不刷新整个TLB），用于切换到用户地址空间
+    uint64 user_satp = asid_satp(target_user_proc);
 
     // 8. 计算user_return在用户地址空间中的绝对地址（跳板代码固定映射）
     uint64 user_trampoline_return = TRAMPOLINE + (user_return - trampoline);
 
-    // 9. 配置sscratch寄存器：存入TRAPFRAME地址，供跳板代码读取用户陷阱帧
-    w_sscratch((uint64)TRAPFRAME);
-
-    // 10. 跳转到跳板代码中的user_return，完成内核态到用户态的最终切换
-    // 传入参数：TRAPFRAME（用户陷阱帧地址）、user_satp（用户页表satp值）
-    ((void (*)(uint64, uint64))user_trampoline_return)(TRAPFRAME, user_satp);
+    // 9. 跳转到跳板代码中的user_return，完成内核态到用户态的最终切换
+    // 传入参数：tf_va（用户陷阱帧地址, 跳板代码最后把它与用户的a0交换进sscratch, 不必在这里写）、user_satp（用户页表satp值）
+    ((void (*)(uint64, uint64))user_trampoline_return)(target_user_proc->tf_va, user_satp);
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "userlib.h"
+
+// 基准测试套件 (格式见bench.h): 依次运行每个bench_*程序并等待它结束
+// 用法: bench [倍数] 或 bench 倍数 程序名... (只运行列出的程序, 如 bench 1 bench_file)
+
+static char* suite[] = {
+    "bench_sys",
+    "bench_proc",
+    "bench_mem",
+    "bench_file",
+    "bench_pipe",
+    0,
+};
+
+static int run(char* prog, char* scale)
+{
+    char* argv[] = {prog, scale, 0};
+    int state = -1;
+    if (sys_spawn(prog, argv) < 0) {
+        printf("bench: spawn %s fail\n", prog);
+        return -1;
+    }
+    sys_wait(&state);
+    if (state != 0) {
+        printf("bench: %s exit %d\n", prog, state);
+    }
+    return state;
+}
+
+int main(int argc, char* argv[])
+{
+    char* scale = (argc > 1) ? argv[1] : "1";
+    int failed = 0;
+
+    printf("@bench_begin scale=%s\n", scale);
+    if (argc > 2) {
+        for (int i = 2; i < argc; i++) {
+            failed += (run(argv[i], scale) != 0);
+        }
+    } else {
+        for (int i = 0; suite[i] != 0; i++) {
+            failed += (run(suite[i], scale) != 0);
+        }
+    }
+    printf("@bench_end failed=%d\n", failed);
+    return failed;
+}
@@ -0,0 +1,64 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include "userlib.h"
+
+/*
+    基准测试套件 (bench_*.c) 的公共部分, bench依次运行整个套件
+    每个测量结果输出一行, 格式固定, 便于脚本提取和比较:
+        @bench <程序>.<项目> size=<字节数> iters=<每轮次数> ns_op=<每次纳秒> kb_s=<吞吐量KB/s>
+    size和kb_s不适用时为0; 每项运行BENCH_ROUNDS轮, 报告最快的一轮
+    所有程序接受一个可选参数: 迭代次数的倍数 (默认1)
+*/
+
+#define BENCH_ROUNDS 3
+
+// 一轮测量: 执行iters次, 返回经过的纳秒数
+typedef uint64 (*bench_fn_t)(int size, int iters);
+
+static inline int bench_atoi(char* s)
+{
+    int n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + (*s++ - '0');
+    }
+    return n;
+}
+
+static inline int bench_scale(int argc, char* argv[])
+{
+    int scale = (argc > 1) ? bench_atoi(argv[1]) : 1;
+    return (scale > 0) ? scale : 1;
+}
+
+// bytes: 每次操作传输的字节数 (0表示不计算吞吐量)
+static inline void bench_report(char* name, int size, int iters, uint64 ns, uint64 bytes)
+{
+    if (ns == 0) {
+        ns = 1;
+    }
+    uint64 kb_s = bytes * iters * 1000000000ull / 1024 / ns;
+    printf("@bench %s size=%d iters=%d ns_op=%d kb_s=%d\n",
+           name, size, iters, (int)(ns / iters), (int)kb_s);
+}
+
+static inline void bench_run(char* name, bench_fn_t fn, int size, int iters, uint64 bytes)
+{
+    uint64 best = (uint64)-1;
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        uint64 ns = fn(size, iters);
+        if (ns < best) {
+            best = ns;
+        }
+    }
+    bench_report(name, size, iters, best, bytes);
+}
+
+// 随机数 (线性同余), 只用于选择偏移
+static inline uint32 bench_rand(uint32* seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+#endif
@@ -0,0 +1,271 @@
+#include "bench.h"
+
+// 文件系统
+//     file.seq_write / file.seq_read: 按size字节的块顺序写 (先截断为0, 包括块的分配) / 读FILE_TOTAL字节
+//     file.rand_read / file.rand_write: 在文件中随机的、按size对齐的偏移处sys_pread / sys_pwrite
+//     file.create / file.unlink: 创建 (并关闭) 和删除FILE_NCREATE个空文件, 每次操作一个文件
+//     file.lookup: sys_fstatat解析深度为size的路径 (bl/d/d/...)
+//     file.stat_each / file.stat_batch: 获取当前目录下size个文件的状态, 逐个sys_fstatat / 一次sys_fstatat_batch
+//     file.mmap_scan: sys_mmap_file只读映射整个文件, 每页读一个字节后解除映射; size是缺页时顺带映射的窗口字节数
+//         (sys_fault_around, PGSIZE: 只映射缺页的那一页), 之后输出一次扫描的缺页数
+// 读写都经过页缓存, 不计入写回磁盘的时间
+// 用法: bench_file [倍数]
+
+#define FILE_NAME    "bench.dat"
+#define FILE_TOTAL   (256 * 1024)
+#define FILE_NCREATE 50
+#define LOOKUP_ITERS 500
+#define LOOKUP_DEPTH 8
+#define STAT_NFILES  32
+#define STAT_ITERS   100
+#define MMAP_PGSIZE  4096
+
+static uint8 buf[16 * 1024] __attribute__((aligned(512)));
+static int fd;
+
+static void fail(char* what)
+{
+    printf("bench_file: %s fail\n", what);
+    sys_exit(1);
+}
+
+// 每次执行传输FILE_TOTAL字节, iters是执行次数
+static uint64 seq_write(int size, int iters)
+{
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        sys_ftruncate(fd, 0);
+        sys_lseek(fd, 0, LSEEK_SET);
+        for (int off = 0; off < FILE_TOTAL; off += size) {
+            if (sys_write(fd, size, buf) != size) {
+                fail("write");
+            }
+        }
+    }
+    return vdata_clock_ns() - start;
+}
+
+static uint64 seq_read(int size, int iters)
+{
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        sys_lseek(fd, 0, LSEEK_SET);
+        for (int off = 0; off < FILE_TOTAL; off += size) {
+            if (sys_read(fd, size, buf) != size) {
+                fail("read");
+            }
+        }
+    }
+    return vdata_clock_ns() - start;
+}
+
+static uint64 rand_rw(int size, int iters, bool write)
+{
+    uint32 seed = size;
+    uint32 nblock = FILE_TOTAL / size;
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        for (uint32 j = 0; j < nblock; j++) {
+            uint32 off = bench_rand(&seed) % nblock * size;
+            uint32 n = write ? sys_pwrite(fd, size, buf, off) : sys_pread(fd, size, buf, off);
+            if (n != size) {
+                fail(write ? "pwrite" : "pread");
+            }
+        }
+    }
+    return vdata_clock_ns() - start;
+}
+
+static uint64 rand_read(int size, int iters)  { return rand_rw(size, iters, false); }
+static uint64 rand_write(int size, int iters) { return rand_rw(size, iters, true); }
+
+static int scan_faults;  // 最后一次mmap_scan的缺页数
+
+static uint64 mmap_scan(int size, int iters)
+{
+    int old = sys_fault_around(size / MMAP_PGSIZE);
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        memstat_t before, after;
+        sys_memstat(&before);
+        uint64 va = sys_mmap_file(0, FILE_TOTAL, fd, 0, PROT_READ);
+        if (va == (uint64)-1) {
+            fail("mmap_file");
+        }
+        for (uint64 off = 0; off < FILE_TOTAL; off += MMAP_PGSIZE) {
+            (void)*(volatile uint8*)(va + off);
+        }
+        sys_munmap(va, FILE_TOTAL);
+        sys_memstat(&after);
+        scan_faults = (int)(after.minor_faults + after.major_faults - before.minor_faults - before.major_faults);
+    }
+    uint64 ns = vdata_clock_ns() - start;
+    sys_fault_around(old);
+    return ns;
+}
+
+// name = prefix + 十进制的i
+static void make_name(char* name, char* prefix, int i)
+{
+    while (*prefix) {
+        *name++ = *prefix++;
+    }
+    char digits[12];
+    int n = 0;
+    do {
+        digits[n++] = '0' + i % 10;
+        i /= 10;
+    } while (i > 0);
+    while (n > 0) {
+        *name++ = digits[--n];
+    }
+    *name = 0;
+}
+
+static void create_unlink(int count)
+{
+    char name[16];
+    uint64 best_create = (uint64)-1, best_unlink = (uint64)-1;
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        uint64 start = vdata_clock_ns();
+        for (int i = 0; i < count; i++) {
+            make_name(name, "bc", i);
+            int f = sys_open(name, MODE_CREATE | MODE_WRITE);
+            if (f < 0) {
+                fail("create");
+            }
+            sys_close(f);
+        }
+        uint64 mid = vdata_clock_ns();
+        for (int i = 0; i < count; i++) {
+            make_name(name, "bc", i);
+            if (sys_unlink(name) < 0) {
+                fail("unlink");
+            }
+        }
+        uint64 end = vdata_clock_ns();
+        if (mid - start < best_create) {
+            best_create = mid - start;
+        }
+        if (end - mid < best_unlink) {
+            best_unlink = end - mid;
+        }
+    }
+    bench_report("file.create", 0, count, best_create, 0);
+    bench_report("file.unlink", 0, count, best_unlink, 0);
+}
+
+// path[depth]: 深度为depth的路径 (0是"bl")
+static char lookup_path[LOOKUP_DEPTH + 1][2 * LOOKUP_DEPTH + 4];
+
+static uint64 lookup(int depth, int iters)
+{
+    fstat_t st;
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        if (sys_fstatat(AT_FDCWD, lookup_path[depth], &st) < 0) {
+            fail("fstatat");
+        }
+    }
+    return vdata_clock_ns() - start;
+}
+
+static void lookup_all(int iters)
+{
+    // 1. 目录链 (上次中断运行留下的目录mkdir失败, 可以忽略)
+    char* p = lookup_path[0];
+    p[0] = 'b', p[1] = 'l', p[2] = 0;
+    sys_mkdir(p);
+    for (int d = 1; d <= LOOKUP_DEPTH; d++) {
+        int len = strlen(lookup_path[d - 1]);
+        memmove(lookup_path[d], lookup_path[d - 1], len);
+        lookup_path[d][len] = '/';
+        lookup_path[d][len + 1] = 'd';
+        lookup_path[d][len + 2] = 0;
+        sys_mkdir(lookup_path[d]);
+    }
+
+    // 2. 测量
+    for (int d = 1; d <= LOOKUP_DEPTH; d *= 2) {
+        bench_run("file.lookup", lookup, d, iters, 0);
+    }
+
+    // 3. 从最深处开始删除
+    for (int d = LOOKUP_DEPTH; d >= 0; d--) {
+        sys_unlink(lookup_path[d]);
+    }
+}
+
+static dirent_t stat_names[STAT_NFILES];
+static fstat_t stat_states[STAT_NFILES];
+
+static uint64 stat_each(int n, int iters)
+{
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        for (int j = 0; j < n; j++) {
+            if (sys_fstatat(AT_FDCWD, stat_names[j].name, &stat_states[j]) < 0) {
+                fail("fstatat");
+            }
+        }
+    }
+    return vdata_clock_ns() - start;
+}
+
+static uint64 stat_batch(int n, int iters)
+{
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        if (sys_fstatat_batch(AT_FDCWD, stat_names, n, stat_states) != n) {
+            fail("fstatat_batch");
+        }
+    }
+    return vdata_clock_ns() - start;
+}
+
+static void stat_all(int iters)
+{
+    for (int i = 0; i < STAT_NFILES; i++) {
+        make_name(stat_names[i].name, "bs", i);
+        int f = sys_open(stat_names[i].name, MODE_CREATE | MODE_WRITE);
+        if (f < 0) {
+            fail("create");
+        }
+        sys_close(f);
+    }
+    bench_run("file.stat_each", stat_each, STAT_NFILES, iters, 0);
+    bench_run("file.stat_batch", stat_batch, STAT_NFILES, iters, 0);
+    for (int i = 0; i < STAT_NFILES; i++) {
+        sys_unlink(stat_names[i].name);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    static int sizes[] = {512, 4096, 16384};
+    int scale = bench_scale(argc, argv);
+
+    fd = sys_open(FILE_NAME, MODE_CREATE | MODE_READ | MODE_WRITE);
+    if (fd < 0) {
+        fail("open");
+    }
+    memset(buf, 0x5a, sizeof(buf));
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int size = sizes[i];
+        bench_run("file.seq_write", seq_write, size, scale, FILE_TOTAL);
+        bench_run("file.seq_read", seq_read, size, scale, FILE_TOTAL);
+        bench_run("file.rand_read", rand_read, size, scale, FILE_TOTAL);
+        bench_run("file.rand_write", rand_write, size, scale, FILE_TOTAL);
+    }
+    for (int window = 1; window <= 16; window *= 16) {
+        bench_run("file.mmap_scan", mmap_scan, window * MMAP_PGSIZE, scale, FILE_TOTAL);
+        printf("bench_file: mmap_scan window=%d faults=%d\n", window, scan_faults);
+    }
+    sys_close(fd);
+    sys_unlink(FILE_NAME);
+
+    create_unlink(FILE_NCREATE * scale);
+    lookup_all(LOOKUP_ITERS * scale);
+    stat_all(STAT_ITERS * scale);
+    return 0;
+}
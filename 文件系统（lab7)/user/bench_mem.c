@@ -0,0 +1,76 @@
+#include "bench.h"
+
+// 地址空间操作和缺页, 每次操作映射size字节、按模式访问之后解除映射
+//     mem.brk_seq / mem.brk_stride: sys_brk扩展堆, 逐页 / 每MEM_STRIDE页写一个字节, 再收缩回去
+//     mem.mmap_seq / mem.mmap_stride: 同上, 使用sys_mmap和sys_munmap
+//     mem.mmap_populate: MAP_POPULATE一次分配所有页, 然后逐页访问
+//     mem.mmap_only: 只映射和解除映射, 不访问
+// kb_s按映射的字节数计算; 不使用malloc (它也通过sys_brk管理堆)
+// 用法: bench_mem [倍数]
+
+#define MEM_ITERS  20
+#define MEM_STRIDE 8
+#define PGSIZE     4096
+
+static void touch(uint64 begin, int size, int step)
+{
+    for (uint64 va = begin; va < begin + size; va += (uint64)step * PGSIZE) {
+        *(volatile uint8*)va = 1;
+    }
+}
+
+static uint64 brk_touch(int size, int iters, int step)
+{
+    uint64 top = sys_brk(0);
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        uint64 new_top = sys_brk(top + size);
+        if (new_top == (uint64)-1 || new_top < top + size) {
+            printf("bench_mem: brk fail\n");
+            sys_exit(1);
+        }
+        touch(top, size, step);
+        sys_brk(top);
+    }
+    return vdata_clock_ns() - start;
+}
+
+static uint64 mmap_touch(int size, int iters, int flags, int step)
+{
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        uint64 va = sys_mmap(0, size, flags);
+        if (va == (uint64)-1) {
+            printf("bench_mem: mmap fail\n");
+            sys_exit(1);
+        }
+        if (step > 0) {
+            touch(va, size, step);
+        }
+        sys_munmap(va, size);
+    }
+    return vdata_clock_ns() - start;
+}
+
+static uint64 brk_seq(int size, int iters)       { return brk_touch(size, iters, 1); }
+static uint64 brk_stride(int size, int iters)    { return brk_touch(size, iters, MEM_STRIDE); }
+static uint64 mmap_seq(int size, int iters)      { return mmap_touch(size, iters, 0, 1); }
+static uint64 mmap_stride(int size, int iters)   { return mmap_touch(size, iters, 0, MEM_STRIDE); }
+static uint64 mmap_populate(int size, int iters) { return mmap_touch(size, iters, MAP_POPULATE, 1); }
+static uint64 mmap_only(int size, int iters)     { return mmap_touch(size, iters, 0, 0); }
+
+int main(int argc, char* argv[])
+{
+    static int sizes[] = {16 * 1024, 256 * 1024, 1024 * 1024};
+    int iters = MEM_ITERS * bench_scale(argc, argv);
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int size = sizes[i];
+        bench_run("mem.brk_seq", brk_seq, size, iters, size);
+        bench_run("mem.brk_stride", brk_stride, size, iters, size);
+        bench_run("mem.mmap_seq", mmap_seq, size, iters, size);
+        bench_run("mem.mmap_stride", mmap_stride, size, iters, size);
+        bench_run("mem.mmap_populate", mmap_populate, size, iters, size);
+        bench_run("mem.mmap_only", mmap_only, size, iters, size);
+    }
+    return 0;
+}
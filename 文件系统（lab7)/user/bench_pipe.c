@@ -0,0 +1,144 @@
+#include "bench.h"
+
+// 管道吞吐量: 子进程以size字节的块写入PIPE_TOTAL字节, 父进程读完为止
+// 计时从fork之后到读完所有数据, 不包括子进程的退出和回收
+// pipe.epoll: PIPE_FANIN个子进程各写一个管道, 父进程用epoll_wait等待任意一个可读
+// pipe.vmsplice: 同pipe.stream, 子进程用vmsplice把缓冲区所在的页排入管道而不是复制
+// 用法: bench_pipe [倍数]
+
+#define PIPE_TOTAL (256 * 1024)
+#define PIPE_FANIN 8
+
+static uint8 buf[4096];
+
+static uint64 pipe_stream_mode(int size, int iters, bool splice)
+{
+    uint64 ns = 0;
+    for (int i = 0; i < iters; i++) {
+        int fd[2];
+        if (sys_pipe(fd) < 0) {
+            printf("bench_pipe: pipe fail\n");
+            sys_exit(1);
+        }
+        int pid = sys_fork();
+        if (pid == 0) {
+            sys_close(fd[0]);
+            memset(buf, 1, sizeof(buf));  // 写时复制共享的页会被vmsplice复制: 先得到私有页
+            iovec_t iov = {(uint64)buf, size};
+            for (int off = 0; off < PIPE_TOTAL; off += size) {
+                if (splice) {
+                    sys_vmsplice(fd[1], &iov, 1);
+                } else {
+                    sys_write(fd[1], size, buf);
+                }
+            }
+            sys_exit(0);
+        }
+        sys_close(fd[1]);
+
+        uint64 start = vdata_clock_ns();
+        int got = 0;
+        while (got < PIPE_TOTAL) {
+            uint32 n = sys_read(fd[0], sizeof(buf), buf);
+            if (n == 0 || n == (uint32)-1) {
+                break;
+            }
+            got += n;
+        }
+        ns += vdata_clock_ns() - start;
+
+        sys_close(fd[0]);
+        sys_wait(0);
+        if (got != PIPE_TOTAL) {
+            printf("bench_pipe: short read %d\n", got);
+            sys_exit(1);
+        }
+    }
+    return ns;
+}
+
+static uint64 pipe_stream(int size, int iters)
+{
+    return pipe_stream_mode(size, iters, false);
+}
+
+static uint64 pipe_vmsplice(int size, int iters)
+{
+    return pipe_stream_mode(size, iters, true);
+}
+
+static uint64 pipe_epoll(int size, int iters)
+{
+    uint64 ns = 0;
+    for (int i = 0; i < iters; i++) {
+        int ep = sys_epoll_create();
+        int rfd[PIPE_FANIN];
+        for (int k = 0; k < PIPE_FANIN; k++) {
+            int fd[2];
+            if (ep < 0 || sys_pipe(fd) < 0) {
+                printf("bench_pipe: pipe fail\n");
+                sys_exit(1);
+            }
+            int pid = sys_fork();
+            if (pid == 0) {
+                sys_close(fd[0]);
+                for (int off = 0; off < PIPE_TOTAL / PIPE_FANIN; off += size) {
+                    sys_write(fd[1], size, buf);
+                }
+                sys_exit(0);
+            }
+            sys_close(fd[1]);
+            rfd[k] = fd[0];
+            epoll_event_t ev;
+            ev.events = POLLIN;
+            ev.data = k;
+            sys_epoll_ctl(ep, EPOLL_CTL_ADD, fd[0], &ev);
+        }
+
+        // 写端全部关闭 (POLLHUP且读到0) 的管道移出集合
+        uint64 start = vdata_clock_ns();
+        int got = 0, open = PIPE_FANIN;
+        while (open > 0) {
+            epoll_event_t evs[PIPE_FANIN];
+            int n = sys_epoll_wait(ep, evs, PIPE_FANIN, -1);
+            for (int j = 0; j < n; j++) {
+                int k = (int)evs[j].data;
+                uint32 r = sys_read(rfd[k], sizeof(buf), buf);
+                if (r == 0 || r == (uint32)-1) {
+                    sys_epoll_ctl(ep, EPOLL_CTL_DEL, rfd[k], NULL);
+                    open--;
+                } else {
+                    got += r;
+                }
+            }
+        }
+        ns += vdata_clock_ns() - start;
+
+        for (int k = 0; k < PIPE_FANIN; k++) {
+            sys_close(rfd[k]);
+            sys_wait(0);
+        }
+        sys_close(ep);
+        if (got != PIPE_TOTAL) {
+            printf("bench_pipe: short read %d\n", got);
+            sys_exit(1);
+        }
+    }
+    return ns;
+}
+
+int main(int argc, char* argv[])
+{
+    static int sizes[] = {64, 512, 4096};
+    int scale = bench_scale(argc, argv);
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_run("pipe.stream", pipe_stream, sizes[i], scale, PIPE_TOTAL);
+    }
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_run("pipe.epoll", pipe_epoll, sizes[i], scale, PIPE_TOTAL);
+    }
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_run("pipe.vmsplice", pipe_vmsplice, sizes[i], scale, PIPE_TOTAL);
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include "bench.h"
+
+// 进程的创建和回收
+//     proc.fork: fork + 子进程立即sys_exit + 父进程sys_wait
+//     proc.spawn: sys_spawn本程序 (参数"-exit", 加载之后立即退出) + sys_wait
+// 用法: bench_proc [倍数]
+
+#define PROC_ITERS 100
+
+static uint64 fork_exit_wait(int size, int iters)
+{
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        int pid = sys_fork();
+        if (pid == 0) {
+            sys_exit(0);
+        }
+        if (pid < 0) {
+            printf("bench_proc: fork fail\n");
+            sys_exit(1);
+        }
+        sys_wait(0);
+    }
+    return vdata_clock_ns() - start;
+}
+
+static uint64 spawn_wait(int size, int iters)
+{
+    char* argv[] = {"bench_proc", "-exit", 0};
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        if (sys_spawn("bench_proc", argv) < 0) {
+            printf("bench_proc: spawn fail\n");
+            sys_exit(1);
+        }
+        sys_wait(0);
+    }
+    return vdata_clock_ns() - start;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && argv[1][0] == '-') {
+        return 0;
+    }
+    int iters = PROC_ITERS * bench_scale(argc, argv);
+    bench_run("proc.fork", fork_exit_wait, 0, iters, 0);
+    bench_run("proc.spawn", spawn_wait, 0, iters / 4 + 1, 0);
+    return 0;
+}
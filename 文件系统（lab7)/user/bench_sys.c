@@ -0,0 +1,34 @@
+#include "bench.h"
+
+// 空系统调用的往返时间
+// sys_clock_gettime的时钟号无效时经过完整的陷入、分发和返回之后立即返回-1 (相当于空系统调用),
+// 与不陷入内核的vdata_clock_ns对比: 差值是一次陷入和返回的开销
+// 用法: bench_sys [倍数]
+
+#define SYS_ITERS 20000
+
+static uint64 null_syscall(int size, int iters)
+{
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        sys_clock_gettime(-1);
+    }
+    return vdata_clock_ns() - start;
+}
+
+static uint64 vdata_read(int size, int iters)
+{
+    uint64 start = vdata_clock_ns();
+    for (int i = 0; i < iters; i++) {
+        vdata_clock_ns();
+    }
+    return vdata_clock_ns() - start;
+}
+
+int main(int argc, char* argv[])
+{
+    int iters = SYS_ITERS * bench_scale(argc, argv);
+    bench_run("sys.null", null_syscall, 0, iters, 0);
+    bench_run("sys.vdata", vdata_read, 0, iters, 0);
+    return 0;
+}
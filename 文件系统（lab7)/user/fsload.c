@@ -0,0 +1,347 @@
+#include "bench.h"
+
+/*
+    文件系统的并发负载: 父进程建立共享的目录树 fl/<d>/f<n>, fork出N个工作进程,
+    第i个固定在hart i % ncpu上, 同时开始执行按权重随机选择的操作 (每个操作计时):
+        open:   打开并关闭一个已有文件
+        read:   打开已有文件, 在随机偏移处读FL_IO字节, 关闭
+        write:  打开已有文件, 在随机偏移处写FL_IO字节, 关闭
+        create: 在随机的目录中创建自己的新文件 (只有自己删除它)
+        unlink: 删除自己最早创建的文件 (还没有时改为create; 自己的文件太多时create改为unlink)
+    覆盖的竞争点: 缓冲区缓存、inode缓存、文件表和virtio磁盘的锁
+    每个工作进程把延迟记录在共享内存中自己的直方图里 (按2的幂分组, 每组再分8份), 父进程合并后输出:
+        @fsload workers=<N> harts=<ncpu> ops=<总数> wall_ms=<毫秒> ops_s=<每秒操作数>
+        @fsload op=<操作> count=<次数> ops_s=<每秒> p50_ns=<> p90_ns=<> p99_ns=<> max_ns=<>
+    用法: fsload [工作进程数 (默认ncpu)] [每个进程的操作数] [权重 open,read,write,create,unlink]
+*/
+
+#define FL_NDIR      4
+#define FL_NFILE     8                // 每个目录中已有的文件数
+#define FL_FILE_SIZE (16 * 1024)
+#define FL_IO        1024
+#define FL_OPS       500
+#define FL_MAXOWN    32               // 每个工作进程同时存在的自己的文件数上限
+#define FL_MAXWORKER 32
+#define FL_NBUCKET   256
+
+enum { OP_OPEN, OP_READ, OP_WRITE, OP_CREATE, OP_UNLINK, N_OP };
+
+static char* op_name[N_OP] = {"open", "read", "write", "create", "unlink"};
+static int   op_weight[N_OP] = {20, 40, 20, 10, 10};
+
+typedef struct fl_stat {
+    uint32 hist[N_OP][FL_NBUCKET];
+    uint32 count[N_OP];
+    uint64 max[N_OP];
+} fl_stat_t;
+
+typedef struct fl_shared {
+    uint32 go;                        // 父进程置1后所有工作进程开始
+    uint32 failed;
+    fl_stat_t worker[];
+} fl_shared_t;
+
+static fl_shared_t* shared;
+static uint8 iobuf[FL_IO];
+
+// 纳秒 <-> 直方图的组
+static int bucket_of(uint64 v)
+{
+    if (v < 16) {
+        return v;
+    }
+    int e = 4;                        // 最高位
+    while ((v >> (e + 1)) != 0) {
+        e++;
+    }
+    int idx = 16 + (e - 4) * 8 + ((v >> (e - 3)) & 7);
+    return (idx < FL_NBUCKET) ? idx : FL_NBUCKET - 1;
+}
+
+static uint64 bucket_top(int idx)
+{
+    if (idx < 16) {
+        return idx;
+    }
+    int e = (idx - 16) / 8 + 4;
+    uint64 sub = (idx - 16) % 8;
+    return ((8 + sub) << (e - 3)) + (1ull << (e - 3)) - 1;
+}
+
+// "fl/<d>/<prefix><n>" 或 "fl/<d>" (prefix为NULL)
+static void fl_path(char* buf, int dir, char* prefix, int n)
+{
+    char tmp[12];
+    int len = 0;
+    *buf++ = 'f', *buf++ = 'l', *buf++ = '/';
+    *buf++ = '0' + dir;
+    if (prefix) {
+        *buf++ = '/';
+        while (*prefix) {
+            *buf++ = *prefix++;
+        }
+        do {
+            tmp[len++] = '0' + n % 10;
+            n /= 10;
+        } while (n > 0);
+        while (len > 0) {
+            *buf++ = tmp[--len];
+        }
+    }
+    *buf = 0;
+}
+
+// 工作进程w的第n个文件名 "w<w>_<n>"
+static void own_path(char* buf, int w, int n)
+{
+    char prefix[8];
+    prefix[0] = 'w';
+    prefix[1] = '0' + w / 10;
+    prefix[2] = '0' + w % 10;
+    prefix[3] = '_';
+    prefix[4] = 0;
+    fl_path(buf, n % FL_NDIR, prefix, n);
+}
+
+static int pick_op(uint32* seed)
+{
+    int total = 0;
+    for (int i = 0; i < N_OP; i++) {
+        total += op_weight[i];
+    }
+    int r = bench_rand(seed) % total;
+    for (int i = 0; i < N_OP; i++) {
+        if (r < op_weight[i]) {
+            return i;
+        }
+        r -= op_weight[i];
+    }
+    return OP_OPEN;
+}
+
+static void worker(int w, int ops)
+{
+    fl_stat_t* st = &shared->worker[w];
+    uint32 seed = 0x9e3779b9u * (w + 1);
+    int own_head = 0, own_tail = 0;   // 自己的文件编号 [own_head, own_tail)
+    char path[32];
+
+    sys_sched_setaffinity(0, 1u << (w % vdata_ncpu()));
+    while (__atomic_load_n(&shared->go, __ATOMIC_ACQUIRE) == 0) {
+        sys_futex(&shared->go, FUTEX_WAIT, 0, 0);
+    }
+
+    for (int i = 0; i < ops; i++) {
+        int op = pick_op(&seed);
+        if (op == OP_UNLINK && own_head == own_tail) {
+            op = OP_CREATE;
+        } else if (op == OP_CREATE && own_tail - own_head >= FL_MAXOWN) {
+            op = OP_UNLINK;
+        }
+        fl_path(path, bench_rand(&seed) % FL_NDIR, "f", bench_rand(&seed) % FL_NFILE);
+        uint32 off = bench_rand(&seed) % (FL_FILE_SIZE / FL_IO) * FL_IO;
+
+        int fd, ok = 1;
+        uint64 start = vdata_clock_ns();
+        switch (op) {
+            case OP_OPEN:
+                fd = sys_open(path, MODE_READ);
+                ok = (fd >= 0);
+                sys_close(fd);
+                break;
+            case OP_READ:
+                fd = sys_open(path, MODE_READ);
+                ok = (fd >= 0 && sys_pread(fd, FL_IO, iobuf, off) == FL_IO);
+                sys_close(fd);
+                break;
+            case OP_WRITE:
+                fd = sys_open(path, MODE_WRITE);
+                ok = (fd >= 0 && sys_pwrite(fd, FL_IO, iobuf, off) == FL_IO);
+                sys_close(fd);
+                break;
+            case OP_CREATE:
+                own_path(path, w, own_tail++);
+                fd = sys_open(path, MODE_CREATE | MODE_WRITE);
+                ok = (fd >= 0);
+                sys_close(fd);
+                break;
+            case OP_UNLINK:
+                own_path(path, w, own_head++);
+                ok = (sys_unlink(path) == 0);
+                break;
+        }
+        uint64 ns = vdata_clock_ns() - start;
+
+        if (!ok) {
+            printf("fsload: worker %d %s %s fail\n", w, op_name[op], path);
+            __atomic_add_fetch(&shared->failed, 1, __ATOMIC_RELAXED);
+        }
+        st->hist[op][bucket_of(ns)]++;
+        st->count[op]++;
+        if (ns > st->max[op]) {
+            st->max[op] = ns;
+        }
+    }
+
+    // 不计时: 删除剩下的自己的文件
+    while (own_head < own_tail) {
+        own_path(path, w, own_head++);
+        sys_unlink(path);
+    }
+    stream_flush(&std_out);
+    sys_exit(0);
+}
+
+// 建立 / 删除共享的目录树
+static int tree_setup()
+{
+    char path[32];
+    sys_mkdir("fl");
+    memset(iobuf, 0x6b, sizeof(iobuf));
+    for (int d = 0; d < FL_NDIR; d++) {
+        fl_path(path, d, NULL, 0);
+        sys_mkdir(path);
+        for (int f = 0; f < FL_NFILE; f++) {
+            fl_path(path, d, "f", f);
+            int fd = sys_open(path, MODE_CREATE | MODE_WRITE);
+            if (fd < 0) {
+                printf("fsload: create %s fail\n", path);
+                return -1;
+            }
+            for (int off = 0; off < FL_FILE_SIZE; off += FL_IO) {
+                sys_write(fd, FL_IO, iobuf);
+            }
+            sys_close(fd);
+        }
+    }
+    return 0;
+}
+
+static void tree_remove()
+{
+    char path[32];
+    for (int d = 0; d < FL_NDIR; d++) {
+        for (int f = 0; f < FL_NFILE; f++) {
+            fl_path(path, d, "f", f);
+            sys_unlink(path);
+        }
+        fl_path(path, d, NULL, 0);
+        sys_unlink(path);
+    }
+    sys_unlink("fl");
+}
+
+// "20,40,20,10,10"
+static void parse_mix(char* s)
+{
+    for (int i = 0; i < N_OP && *s; i++) {
+        op_weight[i] = bench_atoi(s);
+        while (*s >= '0' && *s <= '9') {
+            s++;
+        }
+        if (*s == ',') {
+            s++;
+        }
+    }
+}
+
+static void report(int nworker, uint64 wall)
+{
+    uint64 total = 0;
+    for (int op = 0; op < N_OP; op++) {
+        for (int w = 0; w < nworker; w++) {
+            total += shared->worker[w].count[op];
+        }
+    }
+    printf("@fsload workers=%d harts=%d ops=%d wall_ms=%d ops_s=%d\n", nworker, vdata_ncpu(),
+           (int)total, (int)(wall / 1000000), (int)(total * 1000000000ull / wall));
+
+    for (int op = 0; op < N_OP; op++) {
+        uint64 count = 0, max = 0;
+        for (int w = 0; w < nworker; w++) {
+            count += shared->worker[w].count[op];
+            if (shared->worker[w].max[op] > max) {
+                max = shared->worker[w].max[op];
+            }
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        // 直方图中累计次数第一次达到count * p%的组
+        static int pct[] = {50, 90, 99};
+        uint64 at[3] = {0, 0, 0};
+        uint64 seen = 0;
+        int k = 0;
+        for (int b = 0; b < FL_NBUCKET && k < 3; b++) {
+            for (int w = 0; w < nworker; w++) {
+                seen += shared->worker[w].hist[op][b];
+            }
+            while (k < 3 && seen * 100 >= count * pct[k]) {
+                at[k++] = bucket_top(b);
+            }
+        }
+        printf("@fsload op=%s count=%d ops_s=%d p50_ns=%d p90_ns=%d p99_ns=%d max_ns=%d\n",
+               op_name[op], (int)count, (int)(count * 1000000000ull / wall),
+               (int)at[0], (int)at[1], (int)at[2], (int)max);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int nworker = (argc > 1) ? bench_atoi(argv[1]) : vdata_ncpu();
+    int ops = (argc > 2) ? bench_atoi(argv[2]) : FL_OPS;
+    if (argc > 3) {
+        parse_mix(argv[3]);
+    }
+    if (nworker <= 0 || nworker > FL_MAXWORKER || ops <= 0) {
+        printf("usage: fsload [workers 1-%d] [ops] [open,read,write,create,unlink]\n", FL_MAXWORKER);
+        return 1;
+    }
+
+    // 1. 目录树和共享的统计区 (fork之后仍然共享)
+    if (tree_setup() < 0) {
+        return 1;
+    }
+    uint32 size = sizeof(fl_shared_t) + nworker * sizeof(fl_stat_t);
+    int shm = sys_shm_create((size + 4095) / 4096);
+    shared = (shm < 0) ? (fl_shared_t*)-1 : (fl_shared_t*)sys_shm_map(shm);
+    if (shared == (fl_shared_t*)-1) {
+        printf("fsload: shm fail\n");
+        return 1;
+    }
+    memset(shared, 0, size);
+
+    // 2. 工作进程全部就绪之后同时开始
+    for (int w = 0; w < nworker; w++) {
+        int pid = sys_fork();
+        if (pid == 0) {
+            worker(w, ops);
+        }
+        if (pid < 0) {
+            printf("fsload: fork fail\n");
+            nworker = w;
+            break;
+        }
+    }
+    uint64 start = vdata_clock_ns();
+    __atomic_store_n(&shared->go, 1, __ATOMIC_RELEASE);
+    sys_futex(&shared->go, FUTEX_WAKE, FL_MAXWORKER, 0);
+    for (int w = 0; w < nworker; w++) {
+        sys_wait(0);
+    }
+    uint64 wall = vdata_clock_ns() - start;
+
+    // 3. 结果
+    if (nworker > 0) {
+        report(nworker, wall ? wall : 1);
+    }
+    if (shared->failed) {
+        printf("fsload: %d operations failed\n", (int)shared->failed);
+    }
+    int failed = shared->failed;
+    sys_shm_unmap((uint64)shared);
+    sys_shm_destroy(shm);
+    tree_remove();
+    return failed != 0;
+}
@@ -0,0 +1,436 @@
+#include "userlib.h"
+
+/*
+    用户态内存分配器 (malloc / free / calloc / realloc)
+    小对象 (不超过MALLOC_SMALL_MAX字节): 按2的幂分成MALLOC_NCLASS个大小类 (16, 32, ..., 2048)
+        堆按MALLOC_SPAN字节对齐切成span, 每个span只存放一个大小类的对象, 头部是malloc_span_t
+        对象地址按MALLOC_SPAN向下对齐就是它所在的span, 不需要每个对象的头部
+        span中的对象第一次使用时才切出 (carved), 释放的对象进入span自己的空闲链表
+        每个大小类有一个部分空闲span的链表 (中心, 加锁); 全部对象都空闲的span还给堆
+    线程缓存: 每个线程 (以pid区分, 见vdata_getpid) 占一个缓存槽, 每个大小类一个空闲链表
+        缓存为空时一次从中心取最多MALLOC_BATCH个对象, 超过MALLOC_CACHE_BYTES字节时把一半还给中心: 大多数malloc/free不加锁
+        槽位用完时直接使用中心; 线程结束之前调用malloc_thread_exit归还缓存的对象和槽位
+    堆: sys_brk每次扩大MALLOC_CHUNK字节; 堆顶的span都空闲且空闲超过MALLOC_TRIM字节时缩小堆, 保留一个MALLOC_CHUNK
+    大对象: 直接sys_mmap (向上取整到页, 头部16字节记录页数), free时sys_munmap
+    锁是futex上的互斥锁 (mutex_lock, 没有竞争时只有一次原子操作)
+    使用malloc的程序不要再自己调用sys_brk移动堆顶
+*/
+
+#define MALLOC_PAGE       4096
+#define MALLOC_SPAN       (16 * 1024)    // span大小 (2的幂)
+#define MALLOC_CHUNK      (256 * 1024)   // 堆每次扩大的字节数
+#define MALLOC_TRIM       (512 * 1024)   // 堆顶空闲超过这么多时缩小堆
+#define MALLOC_NCLASS     8              // 大小类: 16 << i
+#define MALLOC_SMALL_MAX  (16 << (MALLOC_NCLASS - 1))
+#define MALLOC_NCACHE     16             // 线程缓存槽数
+#define MALLOC_CACHE_BYTES (8 * 1024)   // 每个大小类缓存的字节数上限 (缓存的对象使所在的span不能归还)
+#define MALLOC_BATCH      16             // 一次从中心取的对象数
+#define MALLOC_SPAN_FREE  0xffffffff     // 空闲span的cls
+#define MALLOC_LARGE_MAGIC 0x4c415247    // "LARG"
+#define MALLOC_LARGE_HDR  16
+
+typedef struct malloc_obj {
+    struct malloc_obj* next;
+} malloc_obj_t;
+
+// span头部 (48字节, 之后的对象按16字节对齐)
+typedef struct malloc_span {
+    uint32 cls;                 // 大小类, MALLOC_SPAN_FREE表示空闲
+    uint32 nfree;               // 空闲链表中的和还没有切出的对象数
+    uint32 carved;              // 还没有切出的部分的偏移
+    uint32 pad;
+    malloc_obj_t* free;         // 释放的对象
+    struct malloc_span* prev;   // 部分空闲span的链表 / 空闲span的链表
+    struct malloc_span* next;
+    uint64 pad2;
+} malloc_span_t;
+
+#define MALLOC_SPAN_HDR sizeof(malloc_span_t)
+
+// 大对象的头部
+typedef struct malloc_large {
+    uint32 magic;
+    uint32 npages;
+    uint64 pad;
+} malloc_large_t;
+
+typedef struct malloc_class {
+    uint32 lk;
+    malloc_span_t* partial;     // 有空闲对象的span
+} malloc_class_t;
+
+typedef struct malloc_cache {
+    volatile uint32 owner;      // 使用这个槽的线程的pid, 0表示空闲
+    uint32 count[MALLOC_NCLASS];
+    malloc_obj_t* free[MALLOC_NCLASS];
+} malloc_cache_t;
+
+static struct {
+    uint32 lk;
+    uint64 base;                // 第一个span
+    uint64 bump;                // 下一个没有用过的span
+    uint64 top;                 // 堆顶 (sys_brk)
+    malloc_span_t* free_spans;  // [base, bump)中的空闲span, 按地址升序 (先使用低处的span, 堆顶更容易空出来)
+} heap;
+
+static malloc_class_t classes[MALLOC_NCLASS];
+static malloc_cache_t caches[MALLOC_NCACHE];
+
+// -------------------------- 大小类 --------------------------
+
+static int size_to_class(uint64 n)
+{
+    if (n <= 16) {
+        return 0;
+    }
+    return 64 - __builtin_clzll(n - 1) - 4;
+}
+
+static uint32 class_size(int cls)
+{
+    return 16u << cls;
+}
+
+// 线程缓存中每个大小类最多的对象数
+static uint32 class_cache_max(int cls)
+{
+    uint32 n = MALLOC_CACHE_BYTES / class_size(cls);
+    return n < 4 ? 4 : n;
+}
+
+static uint32 class_objects(int cls)
+{
+    return (MALLOC_SPAN - MALLOC_SPAN_HDR) / class_size(cls);
+}
+
+static malloc_span_t* span_of(void* p)
+{
+    return (malloc_span_t*)((uint64)p & ~(uint64)(MALLOC_SPAN - 1));
+}
+
+static void list_push(malloc_span_t** head, malloc_span_t* s)
+{
+    s->prev = NULL;
+    s->next = *head;
+    if (*head != NULL) {
+        (*head)->prev = s;
+    }
+    *head = s;
+}
+
+static void list_remove(malloc_span_t** head, malloc_span_t* s)
+{
+    if (s->prev != NULL) {
+        s->prev->next = s->next;
+    } else {
+        *head = s->next;
+    }
+    if (s->next != NULL) {
+        s->next->prev = s->prev;
+    }
+    s->prev = s->next = NULL;
+}
+
+// -------------------------- 堆 --------------------------
+
+// 申请一个span, 堆不够时扩大MALLOC_CHUNK字节, 失败返回NULL
+static malloc_span_t* span_alloc()
+{
+    malloc_span_t* s = NULL;
+
+    mutex_lock(&heap.lk);
+    if (heap.base == 0) {
+        heap.base = (sys_brk(0) + MALLOC_SPAN - 1) & ~(uint64)(MALLOC_SPAN - 1);
+        heap.bump = heap.top = heap.base;
+    }
+    if (heap.free_spans != NULL) {
+        s = heap.free_spans;
+        list_remove(&heap.free_spans, s);
+    } else {
+        if (heap.bump + MALLOC_SPAN > heap.top) {
+            uint64 top = heap.bump + MALLOC_CHUNK;
+            if (sys_brk(top) == (uint64)-1) {
+                top = heap.bump + MALLOC_SPAN;
+                if (sys_brk(top) == (uint64)-1) {
+                    mutex_unlock(&heap.lk);
+                    return NULL;
+                }
+            }
+            heap.top = top;
+        }
+        s = (malloc_span_t*)heap.bump;
+        heap.bump += MALLOC_SPAN;
+    }
+    mutex_unlock(&heap.lk);
+    return s;
+}
+
+// 归还空闲的span; 堆顶连续的空闲span退回未使用的部分, 空闲太多时缩小堆
+static void span_release(malloc_span_t* s)
+{
+    mutex_lock(&heap.lk);
+    s->cls = MALLOC_SPAN_FREE;
+    malloc_span_t** link = &heap.free_spans;
+    malloc_span_t* prev = NULL;
+    while (*link != NULL && *link < s) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    s->prev = prev;
+    s->next = *link;
+    if (*link != NULL) {
+        (*link)->prev = s;
+    }
+    *link = s;
+
+    while (heap.bump > heap.base) {
+        malloc_span_t* last = (malloc_span_t*)(heap.bump - MALLOC_SPAN);
+        if (last->cls != MALLOC_SPAN_FREE) {
+            break;
+        }
+        list_remove(&heap.free_spans, last);
+        heap.bump -= MALLOC_SPAN;
+    }
+    if (heap.top - heap.bump >= MALLOC_TRIM) {
+        uint64 top = heap.bump + MALLOC_CHUNK;
+        if (sys_brk(top) != (uint64)-1) {
+            heap.top = top;
+        }
+    }
+    mutex_unlock(&heap.lk);
+}
+
+// -------------------------- 中心 --------------------------
+
+// 从大小类cls取最多n个对象串成链表, 返回取到的个数
+static uint32 central_take(int cls, uint32 n, malloc_obj_t** list)
+{
+    malloc_class_t* c = &classes[cls];
+    uint32 size = class_size(cls);
+    uint32 got = 0;
+
+    *list = NULL;
+    mutex_lock(&c->lk);
+    while (got < n) {
+        malloc_span_t* s = c->partial;
+        if (s == NULL) {
+            s = span_alloc();
+            if (s == NULL) {
+                break;
+            }
+            s->cls = cls;
+            s->nfree = class_objects(cls);
+            s->carved = MALLOC_SPAN_HDR;
+            s->free = NULL;
+            list_push(&c->partial, s);
+        }
+
+        malloc_obj_t* o;
+        if (s->free != NULL) {
+            o = s->free;
+            s->free = o->next;
+        } else {
+            o = (malloc_obj_t*)((char*)s + s->carved);
+            s->carved += size;
+        }
+        if (--s->nfree == 0) {
+            list_remove(&c->partial, s);
+        }
+        o->next = *list;
+        *list = o;
+        got++;
+    }
+    mutex_unlock(&c->lk);
+    return got;
+}
+
+// 把对象还给它所在的span
+static void central_put(malloc_obj_t* o)
+{
+    malloc_span_t* s = span_of(o);
+    int cls = s->cls;   // span中有对象没有归还时不会换大小类
+    malloc_class_t* c = &classes[cls];
+    bool release = false;
+
+    mutex_lock(&c->lk);
+    o->next = s->free;
+    s->free = o;
+    if (s->nfree++ == 0) {
+        list_push(&c->partial, s);
+    }
+    // 全部对象都空闲时还给堆 (反复申请和释放同一个对象时对象留在线程缓存中, 不会反复申请和归还span)
+    if (s->nfree == class_objects(cls)) {
+        list_remove(&c->partial, s);
+        release = true;
+    }
+    mutex_unlock(&c->lk);
+
+    if (release) {
+        span_release(s);
+    }
+}
+
+// -------------------------- 线程缓存 --------------------------
+
+// 当前线程的缓存 (claim为true时没有就占一个空闲槽), 没有返回NULL
+static malloc_cache_t* cache_get(bool claim)
+{
+    uint32 pid = vdata_getpid();
+    for (int i = 0; i < MALLOC_NCACHE; i++) {
+        malloc_cache_t* c = &caches[(pid + i) % MALLOC_NCACHE];
+        if (c->owner == pid) {
+            return c;
+        }
+        if (claim && c->owner == 0 && __sync_bool_compare_and_swap(&c->owner, 0, pid)) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+// 把缓存中大小类cls的n个对象还给中心
+static void cache_flush(malloc_cache_t* c, int cls, uint32 n)
+{
+    while (n-- > 0 && c->free[cls] != NULL) {
+        malloc_obj_t* o = c->free[cls];
+        c->free[cls] = o->next;
+        c->count[cls]--;
+        central_put(o);
+    }
+}
+
+void malloc_thread_exit()
+{
+    malloc_cache_t* c = cache_get(false);
+    if (c == NULL) {
+        return;
+    }
+    for (int cls = 0; cls < MALLOC_NCLASS; cls++) {
+        cache_flush(c, cls, c->count[cls]);
+    }
+    __sync_lock_release(&c->owner);
+}
+
+// -------------------------- 大对象 --------------------------
+
+static void* large_alloc(uint64 n)
+{
+    uint64 len = (n + MALLOC_LARGE_HDR + MALLOC_PAGE - 1) & ~(uint64)(MALLOC_PAGE - 1);
+    if (len > 0xffffffffull) {
+        return NULL;
+    }
+    uint64 base = sys_mmap(0, (uint32)len, 0);
+    if (base == (uint64)-1) {
+        return NULL;
+    }
+    malloc_large_t* hdr = (malloc_large_t*)base;
+    hdr->magic = MALLOC_LARGE_MAGIC;
+    hdr->npages = len / MALLOC_PAGE;
+    return (char*)base + MALLOC_LARGE_HDR;
+}
+
+static bool is_small(void* p)
+{
+    return (uint64)p >= heap.base && (uint64)p < heap.bump;
+}
+
+// p可以存放的字节数
+static uint64 usable_size(void* p)
+{
+    if (is_small(p)) {
+        return class_size(span_of(p)->cls);
+    }
+    malloc_large_t* hdr = (malloc_large_t*)((char*)p - MALLOC_LARGE_HDR);
+    return (uint64)hdr->npages * MALLOC_PAGE - MALLOC_LARGE_HDR;
+}
+
+// -------------------------- 接口 --------------------------
+
+void* malloc(uint64 n)
+{
+    if (n > MALLOC_SMALL_MAX) {
+        return large_alloc(n);
+    }
+    int cls = size_to_class(n);
+    malloc_obj_t* o;
+
+    malloc_cache_t* c = cache_get(true);
+    if (c == NULL) {
+        return central_take(cls, 1, &o) == 1 ? o : NULL;
+    }
+    if (c->free[cls] == NULL) {
+        uint32 batch = class_cache_max(cls) / 2;
+        c->count[cls] = central_take(cls, batch < MALLOC_BATCH ? batch : MALLOC_BATCH, &c->free[cls]);
+        if (c->count[cls] == 0) {
+            return NULL;
+        }
+    }
+    o = c->free[cls];
+    c->free[cls] = o->next;
+    c->count[cls]--;
+    return o;
+}
+
+void free(void* p)
+{
+    if (p == NULL) {
+        return;
+    }
+    if (!is_small(p)) {
+        malloc_large_t* hdr = (malloc_large_t*)((char*)p - MALLOC_LARGE_HDR);
+        if (hdr->magic != MALLOC_LARGE_MAGIC) {
+            printf("free: invalid pointer %p\n", p);
+            return;
+        }
+        hdr->magic = 0;
+        sys_munmap((uint64)hdr, hdr->npages * MALLOC_PAGE);
+        return;
+    }
+
+    malloc_obj_t* o = (malloc_obj_t*)p;
+    int cls = span_of(p)->cls;
+    malloc_cache_t* c = cache_get(true);
+    if (c == NULL) {
+        central_put(o);
+        return;
+    }
+    o->next = c->free[cls];
+    c->free[cls] = o;
+    if (++c->count[cls] > class_cache_max(cls)) {
+        cache_flush(c, cls, class_cache_max(cls) / 2);
+    }
+}
+
+void* calloc(uint64 nmemb, uint64 size)
+{
+    if (size != 0 && nmemb > 0xffffffffull / size) {
+        return NULL;
+    }
+    uint64 n = nmemb * size;
+    void* p = malloc(n);
+    if (p != NULL) {
+        memset(p, 0, n);
+    }
+    return p;
+}
+
+void* realloc(void* p, uint64 n)
+{
+    if (p == NULL) {
+        return malloc(n);
+    }
+    if (n == 0) {
+        free(p);
+        return NULL;
+    }
+    uint64 old = usable_size(p);
+    if (n <= old) {
+        return p;
+    }
+    void* q = malloc(n);
+    if (q != NULL) {
+        memmove(q, p, old);
+        free(p);
+    }
+    return q;
+}
@@ -0,0 +1,80 @@
+#include "userlib.h"
+
+/*
+    录制一个程序的系统调用 (见内核syscall/sysrec.h), 之后用replay回放
+    用法: record 输出文件 程序 [参数...]
+        子进程标记自己之后exec程序: 程序和它创建的所有进程的系统调用都被录制 (包括这次exec)
+        父进程不断取出记录追加到输出文件, 直到子进程一侧的所有进程都退出 (管道的写端全部关闭), 最后取完剩下的记录
+    输出: @record records=<条数> lost=<缓冲区满丢弃的条数> exit=<程序的退出状态>
+*/
+
+#define REC_BATCH 32    // 一次取出的记录数 (不超过内核的SYSREC_READ_MAX)
+#define REC_POLL  10    // 没有记录时等待程序退出的毫秒数
+
+static sysrec_t batch[REC_BATCH];
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        printf("usage: record <out> <prog> [args...]\n");
+        return 1;
+    }
+    int out = sys_open(argv[1], MODE_CREATE | MODE_WRITE);
+    int fd[2];
+    if (out < 0 || sys_ftruncate(out, 0) < 0 || sys_pipe(fd) < 0) {
+        printf("record: cannot create %s\n", argv[1]);
+        return 1;
+    }
+
+    // 1. 子进程: 只保留管道的写端, 开始录制后执行程序
+    int pid = sys_fork();
+    if (pid < 0) {
+        printf("record: fork fail\n");
+        return 1;
+    }
+    if (pid == 0) {
+        sys_close(fd[0]);
+        sys_close(out);
+        if (sys_sysrec_start(0) < 0) {
+            printf("record: cannot start recording\n");
+        } else {
+            sys_exec(argv[2], &argv[2]);
+            printf("record: exec %s fail\n", argv[2]);
+        }
+        stream_flush(&std_out);
+        sys_exit(1);
+    }
+    sys_close(fd[1]);
+
+    // 2. 父进程: 写入头部, 取出记录直到程序一侧全部退出 (读端读到文件结束)
+    sysrec_hdr_t hdr = {SYSREC_MAGIC, sizeof(sysrec_t)};
+    sys_write(out, sizeof(hdr), &hdr);
+    uint64 total = 0, lost = 0;
+    bool done = false;
+    while (1) {
+        uint64 l = 0;
+        int n = sys_sysrec_read(batch, REC_BATCH, &l);
+        lost += l;
+        if (n > 0) {
+            sys_write(out, n * sizeof(sysrec_t), batch);
+            total += n;
+            continue;
+        }
+        if (done) {
+            break;
+        }
+        pollfd_t pfd = {fd[0], POLLIN, 0};
+        char c;
+        if (sys_poll(&pfd, 1, REC_POLL) > 0 && sys_read(fd[0], 1, &c) == 0) {
+            done = true;
+        }
+    }
+
+    int state = -1;
+    sys_wait(&state);
+    sys_close(fd[0]);
+    sys_fsync(out);
+    sys_close(out);
+    printf("@record records=%d lost=%d exit=%d\n", (int)total, (int)lost, state);
+    return 0;
+}
@@ -0,0 +1,286 @@
+#include "userlib.h"
+
+/*
+    回放record录制的系统调用流
+    用法: replay [-f] 录制文件
+        按记录的完成顺序在当前进程中依次重新发起文件相关的系统调用 (多个进程的流串行化为一个)
+        默认按记录的开始时刻保持调用之间的间隔, -f时不等待 (尽快回放)
+        记录中的fd按 (pid, fd) 映射到回放时得到的fd, 缓冲区的内容不录制, 读写使用同样长度的临时缓冲区
+        其余系统调用 (进程管理、内存映射、未映射的fd等) 跳过并计数
+    输出:
+        @replay records=<条数> replayed=<回放数> skipped=<跳过数> diverged=<返回值不一致的数> wall_ms=<总时间>
+        @replay_sys num=<调用号> count=<次数> rec_us=<录制时的总耗时> replay_us=<回放时的总耗时>
+*/
+
+#define RP_BATCH   32          // 一次读取的记录数
+#define RP_FDS     64          // fd映射表的大小
+#define RP_SCRATCH (16 * 1024) // 读写的临时缓冲区
+
+typedef struct rp_fd {
+    uint32 pid;
+    int    rfd;   // 录制时的fd
+    int    fd;    // 回放时的fd (-1: 空闲)
+} rp_fd_t;
+
+typedef struct rp_stat {
+    uint64 count;
+    uint64 rec_ns;
+    uint64 replay_ns;
+} rp_stat_t;
+
+static sysrec_t batch[RP_BATCH];
+static rp_fd_t fdmap[RP_FDS];
+static rp_stat_t stat[SYS_MAX + 1];
+static char scratch[RP_SCRATCH];
+
+// 查找录制时的fd对应的回放fd, 没有时返回-1
+static int fd_get(uint32 pid, int rfd)
+{
+    for (int i = 0; i < RP_FDS; i++) {
+        if (fdmap[i].fd >= 0 && fdmap[i].pid == pid && fdmap[i].rfd == rfd) {
+            return fdmap[i].fd;
+        }
+    }
+    return -1;
+}
+
+static void fd_put(uint32 pid, int rfd, int fd)
+{
+    for (int i = 0; i < RP_FDS; i++) {
+        if (fdmap[i].fd < 0) {
+            fdmap[i].pid = pid;
+            fdmap[i].rfd = rfd;
+            fdmap[i].fd = fd;
+            return;
+        }
+    }
+    sys_close(fd);  // 映射表满: 之后用到它的记录跳过
+}
+
+static void fd_del(uint32 pid, int rfd)
+{
+    for (int i = 0; i < RP_FDS; i++) {
+        if (fdmap[i].fd >= 0 && fdmap[i].pid == pid && fdmap[i].rfd == rfd) {
+            fdmap[i].fd = -1;
+            return;
+        }
+    }
+}
+
+// 分段读写len字节 (off为-1时使用文件偏移), 返回总字节数或第一次失败的返回值
+static uint32 rw_chunks(int fd, uint32 len, uint32 off, bool write)
+{
+    uint32 done = 0;
+    while (done < len) {
+        uint32 n = len - done;
+        if (n > RP_SCRATCH) {
+            n = RP_SCRATCH;
+        }
+        uint32 r;
+        if (off == (uint32)-1) {
+            r = write ? sys_write(fd, n, scratch) : sys_read(fd, n, scratch);
+        } else {
+            r = write ? sys_pwrite(fd, n, scratch, off + done) : sys_pread(fd, n, scratch, off + done);
+        }
+        if ((int)r < 0) {
+            return done > 0 ? done : r;
+        }
+        done += r;
+        if (r < n) {
+            break;
+        }
+    }
+    return done;
+}
+
+// 回放一条记录: 跳过时返回false, 否则返回值写入ret
+static bool replay_one(sysrec_t* r, int64* ret)
+{
+    uint64* a = r->args;
+    int fd = -1;
+    fstat_t st;
+
+    // 第一个参数是fd的调用先翻译fd
+    switch (r->num) {
+        case SYS_close: case SYS_read: case SYS_write: case SYS_pread: case SYS_pwrite:
+        case SYS_lseek: case SYS_dup: case SYS_fstat: case SYS_ftruncate: case SYS_fallocate:
+        case SYS_fsync: case SYS_fdatasync: case SYS_fadvise:
+            fd = fd_get(r->pid, (int)a[0]);
+            if (fd < 0) {
+                return false;
+            }
+            break;
+        case SYS_openat:
+            if ((int)a[0] == AT_FDCWD) {
+                fd = AT_FDCWD;
+            } else if ((fd = fd_get(r->pid, (int)a[0])) < 0) {
+                return false;
+            }
+            break;
+    }
+
+    switch (r->num) {
+        case SYS_open:
+            *ret = sys_open(r->path, (uint32)a[1]);
+            break;
+        case SYS_openat:
+            *ret = sys_openat(fd, r->path, (uint32)a[2]);
+            break;
+        case SYS_close:
+            *ret = sys_close(fd);
+            fd_del(r->pid, (int)a[0]);
+            return true;
+        case SYS_read:
+            *ret = (int)rw_chunks(fd, (uint32)a[1], -1, false);
+            return true;
+        case SYS_write:
+            *ret = (int)rw_chunks(fd, (uint32)a[1], -1, true);
+            return true;
+        case SYS_pread:
+            *ret = (int)rw_chunks(fd, (uint32)a[1], (uint32)a[3], false);
+            return true;
+        case SYS_pwrite:
+            *ret = (int)rw_chunks(fd, (uint32)a[1], (uint32)a[3], true);
+            return true;
+        case SYS_lseek:
+            *ret = (int)sys_lseek(fd, (uint32)a[1], (int)a[2]);
+            return true;
+        case SYS_dup:
+            *ret = sys_dup(fd);
+            break;
+        case SYS_fstat:
+            *ret = sys_fstat(fd, &st);
+            return true;
+        case SYS_ftruncate:
+            *ret = sys_ftruncate(fd, (uint32)a[1]);
+            return true;
+        case SYS_fallocate:
+            *ret = sys_fallocate(fd, (uint32)a[1], (uint32)a[2]);
+            return true;
+        case SYS_fsync:
+            *ret = sys_fsync(fd);
+            return true;
+        case SYS_fdatasync:
+            *ret = sys_fdatasync(fd);
+            return true;
+        case SYS_fadvise:
+            *ret = sys_fadvise(fd, (uint32)a[1], (uint32)a[2], (int)a[3]);
+            return true;
+        case SYS_sync:
+            *ret = sys_sync();
+            return true;
+        case SYS_mkdir:
+            *ret = sys_mkdir(r->path);
+            return true;
+        case SYS_chdir:
+            *ret = sys_chdir(r->path);
+            return true;
+        case SYS_unlink:
+            *ret = sys_unlink(r->path);
+            return true;
+        default:
+            return false;
+    }
+
+    // 创建fd的调用: 记录新的映射
+    if (*ret >= 0 && (int)r->ret >= 0) {
+        fd_put(r->pid, (int)r->ret, (int)*ret);
+    }
+    return true;
+}
+
+// 返回值是否与录制时一致 (创建fd的调用只比较成功与否)
+static bool same_ret(sysrec_t* r, int64 ret)
+{
+    if (r->num == SYS_open || r->num == SYS_openat || r->num == SYS_dup) {
+        return (ret >= 0) == ((int)r->ret >= 0);
+    }
+    return ret == (int)r->ret;
+}
+
+// 等到录制流的相对时刻rel (纳秒): 长的间隔交给poll睡眠, 最后一段自旋
+static void pace(uint64 start, uint64 rel)
+{
+    uint64 now = vdata_clock_ns() - start;
+    if (now + 2000000 < rel) {
+        sys_poll(NULL, 0, (rel - now) / 1000000 - 1);
+    }
+    while (vdata_clock_ns() - start < rel);
+}
+
+int main(int argc, char* argv[])
+{
+    bool fast = false;
+    char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-f", 3) == 0) {
+            fast = true;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (path == NULL) {
+        printf("usage: replay [-f] <file>\n");
+        return 1;
+    }
+    int in = sys_open(path, MODE_READ);
+    sysrec_hdr_t hdr;
+    if (in < 0 || sys_read(in, sizeof(hdr), &hdr) != sizeof(hdr)
+        || hdr.magic != SYSREC_MAGIC || hdr.rec_size != sizeof(sysrec_t)) {
+        printf("replay: %s is not a record file\n", path);
+        return 1;
+    }
+    for (int i = 0; i < RP_FDS; i++) {
+        fdmap[i].fd = -1;
+    }
+
+    uint64 records = 0, replayed = 0, skipped = 0, diverged = 0;
+    uint64 rec_start = 0, start = vdata_clock_ns();
+    while (1) {
+        uint32 n = sys_read(in, sizeof(batch), batch);
+        if ((int)n <= 0) {
+            break;
+        }
+        n /= sizeof(sysrec_t);
+        for (uint32 i = 0; i < n; i++) {
+            sysrec_t* r = &batch[i];
+            if (records++ == 0) {
+                rec_start = r->time;
+            }
+            if (!fast && r->time > rec_start) {
+                pace(start, r->time - rec_start);
+            }
+            int64 ret = 0;
+            uint64 t0 = vdata_clock_ns();
+            if (r->num > SYS_MAX || !replay_one(r, &ret)) {
+                skipped++;
+                continue;
+            }
+            uint64 t1 = vdata_clock_ns();
+            replayed++;
+            if (!same_ret(r, ret)) {
+                diverged++;
+            }
+            stat[r->num].count++;
+            stat[r->num].rec_ns += r->dur;
+            stat[r->num].replay_ns += t1 - t0;
+        }
+    }
+    uint64 wall = vdata_clock_ns() - start;
+    sys_close(in);
+    for (int i = 0; i < RP_FDS; i++) {
+        if (fdmap[i].fd >= 0) {
+            sys_close(fdmap[i].fd);
+        }
+    }
+
+    printf("@replay records=%d replayed=%d skipped=%d diverged=%d wall_ms=%d\n",
+        (int)records, (int)replayed, (int)skipped, (int)diverged, (int)(wall / 1000000));
+    for (int i = 0; i <= SYS_MAX; i++) {
+        if (stat[i].count > 0) {
+            printf("@replay_sys num=%d count=%d rec_us=%d replay_us=%d\n",
+                i, (int)stat[i].count, (int)(stat[i].rec_ns / 1000), (int)(stat[i].replay_ns / 1000));
+        }
+    }
+    return 0;
+}
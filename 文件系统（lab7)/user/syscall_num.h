@@ -23,7 +23,70 @@
 #define SYS_chdir        18
 #define SYS_link         19
 #define SYS_unlink       20
+#define SYS_bufstat      21
+#define SYS_diskstat     22
+#define SYS_statfs       23
+#define SYS_ftruncate    24
+#define SYS_fallocate    25
+#define SYS_openat       26
+#define SYS_mkdirat      27
+#define SYS_unlinkat     28
+#define SYS_linkat       29
+#define SYS_fstatat      30
+#define SYS_getdents     31
+#define SYS_rename       32
+#define SYS_pread        33
+#define SYS_pwrite       34
+#define SYS_readv        35
+#define SYS_writev       36
+#define SYS_pipe         37
+#define SYS_mmap_file    38
+#define SYS_msync        39
+#define SYS_copy_file_range 40
+#define SYS_fsync        41
+#define SYS_fdatasync    42
+#define SYS_sync         43
+#define SYS_uring_setup  44
+#define SYS_uring_enter  45
+#define SYS_fadvise      46
+#define SYS_umount       47
+#define SYS_spawn        48
+#define SYS_shm_create   49
+#define SYS_shm_map      50
+#define SYS_shm_unmap    51
+#define SYS_shm_destroy  52
+#define SYS_memstat      53
+#define SYS_setpriority  54
+#define SYS_sched_setaffinity 55
+#define SYS_sched_getaffinity 56
+#define SYS_clone        57
+#define SYS_futex        58
+#define SYS_timer_config 59
+#define SYS_clock_gettime 60
+#define SYS_batch        61
+#define SYS_lockstat     62
+#define SYS_kstat        63
+#define SYS_dmesg        64
+#define SYS_trace        65
+#define SYS_sysstat      66
+#define SYS_prof         67
+#define SYS_tstat        68
+#define SYS_iostat       69
+#define SYS_irq_setaffinity 70
+#define SYS_fstatat_batch 71
+#define SYS_poll         72
+#define SYS_epoll_create 73
+#define SYS_epoll_ctl    74
+#define SYS_epoll_wait   75
+#define SYS_sched_setdeadline 76
+#define SYS_cpustat      77
+#define SYS_clone_file   78
+#define SYS_fault_around 79
+#define SYS_poweroff     80
+#define SYS_sysrec       81
+#define SYS_splice       82
+#define SYS_vmsplice     83
 
-#define SYS_MAX          20
+#define SYS_MAX          83
 
 #endif
\ No newline at end of file
@@ -1,11 +1,77 @@
 #include "userlib.h"
 
+/*
+    init运行的第一个程序
+    启动选项 (/proc/cmdline) 中有单词bench或bench=倍数时进入基准测试模式 (make bench):
+        运行bench套件 (以bench_开头的单词选出其中的程序, 没有时运行全部), 结束后写回文件系统并关机
+    否则回显控制台输入
+*/
+
+#define CMDLINE_LEN 160
+#define BENCH_PROGS 16   // 最多选出的程序数
+
+// 启动选项中没有bench时返回, 否则运行套件后关机
+static void bench_mode()
+{
+    char cmdline[CMDLINE_LEN];
+    int fd = sys_open("/proc/cmdline", MODE_READ);
+    if (fd < 0) {
+        return;
+    }
+    uint32 n = sys_read(fd, CMDLINE_LEN - 1, cmdline);
+    sys_close(fd);
+    if (n >= CMDLINE_LEN) {
+        return;
+    }
+    cmdline[n] = 0;
+
+    // 原地切分单词: argv[0]是程序名, argv[1]是倍数, 之后是选出的程序
+    char* argv[BENCH_PROGS + 3] = {"bench", 0};
+    int argc = 2;
+    char* p = cmdline;
+    while (*p != 0) {
+        while (*p == ' ' || *p == '\n') {
+            p++;
+        }
+        char* w = p;
+        while (*p != 0 && *p != ' ' && *p != '\n') {
+            p++;
+        }
+        if (*p != 0) {
+            *p++ = 0;
+        }
+        if (strncmp(w, "bench", 6) == 0) {
+            argv[1] = "1";
+        } else if (strncmp(w, "bench=", 6) == 0) {
+            argv[1] = w + 6;
+        } else if (strncmp(w, "bench_", 6) == 0 && argc < BENCH_PROGS + 2) {
+            argv[argc++] = w;
+        }
+    }
+    if (argv[1] == 0) {
+        return;
+    }
+    argv[argc] = 0;
+
+    int state = -1;
+    if (sys_spawn("bench", argv) < 0) {
+        printf("test: spawn bench fail\n");
+    } else {
+        sys_wait(&state);
+    }
+    printf("@bench_poweroff state=%d\n", state);
+    stream_flush(&std_out);
+    sys_poweroff();
+}
+
 int main(int argc, char* argv[])
 {
+    bench_mode();
+
     char tmp[128];
     while(1) {
         memset(tmp, 0, 128);
         stdin(tmp, 128);
         stdout(tmp, strlen(tmp));
     }
-}
\ No newline at end of file
+}
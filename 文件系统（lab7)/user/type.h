@@ -33,4 +33,265 @@ typedef struct file_state {
     uint32 size;
 } fstat_t;
 
+// buf cache统计信息定义
+typedef struct buf_stat {
+    uint64 lookups;
+    uint64 hits;
+    uint64 misses;
+    uint64 evictions;
+    uint64 disk_reads;
+    uint64 sync_writes;
+    uint64 writebacks;
+    uint64 prefetches;
+    uint64 slk_wait;
+    uint64 nbuf;
+} bufstat_t;
+
+// 进程内存统计信息定义 (与内核mem_stat_t一致)
+typedef struct mem_stat {
+    uint64 rss_heap;
+    uint64 rss_stack;
+    uint64 rss_mmap;
+    uint64 pgtbl_pages;
+    uint64 minor_faults;
+    uint64 major_faults;
+    uint64 cow_copies;
+    uint64 fork_shared;
+    uint64 fork_copied;
+    uint64 rss_swap;
+    uint64 swap_outs;
+    uint64 swap_ins;
+    uint64 fault_around;
+} memstat_t;
+
+// 进程I/O统计 (与内核io_stat_t一致)
+typedef struct io_stat {
+    uint64 rchar;         // 读到的字节数
+    uint64 wchar;         // 写出的字节数
+    uint64 buf_hits;      // buf_read命中buf cache
+    uint64 buf_misses;    // buf_read需要读盘
+    uint64 disk_reqs;     // 提交的磁盘读写请求数
+    uint64 read_blocks;   // 从磁盘读入的block数
+    uint64 write_blocks;  // 写入磁盘的block数
+} iostat_t;
+
+// 进程的CPU时间统计 (与内核cpu_stat_t一致, mtime单位: 每微秒10)
+typedef struct cpu_stat {
+    uint64 utime;         // 用户态时间
+    uint64 stime;         // 内核态时间
+    uint64 wait_time;     // 在运行队列中等待的时间
+    uint64 nvcsw;         // 主动切换 (睡眠) 次数
+    uint64 nivcsw;        // 被动切换 (被抢占) 次数
+    uint64 cutime;        // 已回收的子进程的用户态时间
+    uint64 cstime;        // 已回收的子进程的内核态时间
+} cpustat_t;
+
+// 磁盘请求统计信息定义 (与内核vio_stat_t一致)
+#define VIO_HIST_BUCKETS  32
+#define VIO_DEPTH_BUCKETS 16
+typedef struct vio_stat {
+    uint64 reads;
+    uint64 writes;
+    uint64 flushes;
+    uint64 read_time;
+    uint64 write_time;
+    uint64 read_hist[VIO_HIST_BUCKETS];
+    uint64 write_hist[VIO_HIST_BUCKETS];
+    uint64 depth_hist[VIO_DEPTH_BUCKETS];
+    uint64 depth_max;
+    uint64 inflight;
+} diskstat_t;
+
+// 内核事件计数 (与内核kstat_t一致)
+typedef struct kstat {
+    uint64 syscalls;      // 系统调用
+    uint64 page_faults;   // 用户态缺页
+    uint64 cow_faults;    // 写时复制缺页
+    uint64 swap_outs;     // 换出的页
+    uint64 swap_ins;      // 换入的页
+    uint64 ctx_switches;  // 调度器切换到进程
+    uint64 steals;        // 工作窃取
+    uint64 wakeups;       // 睡眠的进程被唤醒
+    uint64 idles;         // 空闲等待中断
+    uint64 dev_intrs;     // 外部设备中断
+    uint64 timer_intrs;   // 时钟中断
+    uint64 softirqs;      // 软中断下半部
+    uint64 fp_loads;      // 装入浮点状态
+    uint64 fp_saves;      // 保存浮点状态
+} kstat_t;
+
+// 一个热路径计时点的统计 (与内核tstat_t一致), 单位是cycle
+typedef struct tstat {
+    uint64 count;
+    uint64 total;
+    uint64 min;
+    uint64 max;
+} tstat_t;
+
+// 锁竞争统计的一项 (与内核lockstat_t一致)
+typedef struct lockstat {
+    char name[16];
+    uint64 acquires;     // 获得锁的次数
+    uint64 contended;    // 需要等待的次数
+    uint64 wait_cycles;  // 等待的总cycle数
+    uint64 hold_max;     // 最长的持有时间 (cycle)
+} lockstat_t;
+
+// sys_batch的一项 (与内核batch_call_t一致): 系统调用号和参数, ret是返回值
+#define N_BATCH 64
+typedef struct batch_call {
+    uint64 num;
+    uint64 args[6];
+    uint64 ret;
+} batch_call_t;
+
+// 一个系统调用号的统计 (与内核sysstat_t一致), 时间是mtime单位 (100ns)
+// 直方图第i个桶是 [4^i, 4^(i+1)) 个单位, 最后一个桶没有上限
+#define SYSSTAT_HIST 8
+typedef struct sysstat {
+    uint64 calls;
+    uint64 errors;
+    uint64 time;
+    uint64 max;
+    uint64 hist[SYSSTAT_HIST];
+} sysstat_t;
+
+// 采样分析的一条记录 (与内核prof_sample_t一致)
+typedef struct prof_sample {
+    uint64 pc;
+    uint32 pid;
+    uint16 hart;
+    uint16 user;    // 1: 用户态
+} prof_sample_t;
+
+// 追踪记录 (与内核trace_event_t一致)
+typedef struct trace_event {
+    uint64 time;      // mtime
+    uint16 hart;
+    uint16 event;
+    uint32 pid;
+    uint64 arg0;
+    uint64 arg1;
+} trace_event_t;
+
+// 系统调用录制的记录 (与内核sysrec_t一致)
+#define SYSREC_PATH 32
+typedef struct sysrec {
+    uint64 time;              // 开始时刻 (启动以来的纳秒数)
+    uint32 dur;               // 耗时 (纳秒)
+    uint16 num;               // 系统调用号
+    uint16 hart;
+    uint32 pid;
+    uint32 pad;
+    uint64 args[6];
+    uint64 ret;
+    char   path[SYSREC_PATH]; // 路径参数 (没有时为空串)
+} sysrec_t;
+
+// 录制文件 (user/record.c写入, user/replay.c读取): 头部之后是按完成顺序排列的sysrec_t
+#define SYSREC_MAGIC 0x43455253   // "SREC"
+typedef struct sysrec_hdr {
+    uint32 magic;
+    uint32 rec_size;              // sizeof(sysrec_t)
+} sysrec_hdr_t;
+
+// 用户数据页 (与内核vdata_t一致, 只读映射在VDATA)
+#define VDATA_NCPU 8
+typedef struct vdata_cpu {
+    volatile uint32 seq;
+    volatile uint32 pid;
+} vdata_cpu_t;
+
+typedef struct vdata {
+    volatile uint32 seq;
+    uint32 ns_per_mtime;
+    volatile uint64 ticks;
+    volatile uint64 tick_next;
+    volatile uint64 tick_interval;
+    uint64 mtime_base;
+    vdata_cpu_t cpu[VDATA_NCPU];
+    uint32 ncpu;
+} vdata_t;
+
+// readv/writev的一段缓冲区 (与内核iovec_t一致)
+#define N_IOV 16
+typedef struct iovec {
+    uint64 base;
+    uint32 len;
+} iovec_t;
+
+// 文件系统容量信息定义 (与内核fs_stat_t一致)
+typedef struct fs_stat {
+    uint32 block_size;
+    uint32 total_blocks;
+    uint32 data_blocks;
+    uint32 free_blocks;
+    uint32 inodes;
+    uint32 free_inodes;
+} statfs_t;
+
+// 提交/完成队列定义 (与内核fs/uring.h一致)
+// 第0页: uring_ctl_t + 提交队列 (偏移URING_SQ_OFF)  第1页: 完成队列
+#define URING_SQ_OFF     64
+#define URING_SQ_ENTRIES 64
+#define URING_CQ_ENTRIES 256
+#define URING_CQ_OFF     4096
+
+#define URING_OP_NOP    0
+#define URING_OP_READ   1
+#define URING_OP_WRITE  2
+#define URING_OP_FSYNC  3
+#define URING_OP_OPENAT 4
+#define URING_OFFSET_CUR 0xFFFFFFFF
+
+typedef struct uring_sqe {
+    uint8 opcode;
+    uint8 pad[3];
+    int fd;
+    uint64 addr;
+    uint32 len;
+    uint32 offset;
+    uint64 user_data;
+} uring_sqe_t;
+
+typedef struct uring_cqe {
+    uint64 user_data;
+    int res;
+    uint32 pad;
+} uring_cqe_t;
+
+typedef struct uring_ctl {
+    volatile uint32 sq_head;
+    volatile uint32 sq_tail;
+    volatile uint32 cq_head;
+    volatile uint32 cq_tail;
+    uint32 sq_entries;
+    uint32 cq_entries;
+} uring_ctl_t;
+
+// 就绪通知定义 (与内核fs/poll.h一致)
+#define POLLIN   0x001
+#define POLLOUT  0x004
+#define POLLERR  0x008
+#define POLLHUP  0x010
+#define POLLNVAL 0x020
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+#define POLL_MAX  32
+#define EPOLL_MAX 32
+
+typedef struct pollfd {
+    int fd;
+    int16 events;
+    int16 revents;
+} pollfd_t;
+
+typedef struct epoll_event {
+    uint32 events;
+    uint64 data;
+} epoll_event_t;
+
 #endif
\ No newline at end of file
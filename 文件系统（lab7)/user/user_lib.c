@@ -1,44 +1,110 @@
 #include "userlib.h"
 
 // 所有磁盘里.c文件的main函数的外壳
-void _main()
+// exec把argc和argv放在a0和a1中
+void _main(int argc, char** argv)
 {
     extern int main();
-    int exit_state = main();
+    int exit_state = main(argc, argv);
+    stream_flush(&std_out);
     sys_exit(exit_state);
 }
 
-// 标准输出
-uint32 stdout(char* str, uint32 len)
-{
-    return sys_write(STD_OUT, len, str);
-}
-
-// 标准输入
-uint32 stdin(char* str, uint32 len)
-{
-    return sys_read(STD_IN, len, str);
-}
+// memset / memmove / memcmp 按8字节的字处理 (与内核的lib/str.c相同)
+// 两个地址对8取模不同时逐字节, 不做非对齐的字访问
+#define ALIGNED8(p) (((uint64)(p) & 7) == 0)
 
 // 从begin开始对连续n个字节赋值data
 void memset(void *begin, uint8 data, uint32 n)
 {
-  uint8 *L = (uint8 *)begin;
-  for (uint32 i = 0; i < n; i++)
-    L[i] = data;
+  uint8 *d = (uint8 *)begin;
+  while (n > 0 && !ALIGNED8(d))
+    *d++ = data, n--;
+
+  uint64 w = (uint64)data * 0x0101010101010101ull;
+  uint64 *wd = (uint64 *)d;
+  while (n >= 32)
+  {
+    wd[0] = w; wd[1] = w; wd[2] = w; wd[3] = w;
+    wd += 4, n -= 32;
+  }
+  while (n >= 8)
+    *wd++ = w, n -= 8;
+
+  d = (uint8 *)wd;
+  while (n-- > 0)
+    *d++ = data;
 }
 
-// copy
+// copy: 源在目标之前且重叠时从后往前复制
 void memmove(void *dst, const void *src, uint32 n)
 {
-  const char *s = src;
-  char *d = dst;
-  while (n--)
+  const uint8 *s = src;
+  uint8 *d = dst;
+  bool words = ((uint64)s & 7) == ((uint64)d & 7);
+
+  if (s < d && s + n > d)
   {
-    *d = *s;
-    d++;
-    s++;
+    s += n, d += n;
+    if (words)
+    {
+      while (n > 0 && !ALIGNED8(d))
+        *--d = *--s, n--;
+      while (n >= 8)
+      {
+        d -= 8, s -= 8, n -= 8;
+        *(uint64 *)d = *(const uint64 *)s;
+      }
+    }
+    while (n-- > 0)
+      *--d = *--s;
+    return;
   }
+
+  if (words)
+  {
+    while (n > 0 && !ALIGNED8(d))
+      *d++ = *s++, n--;
+    while (n >= 32)
+    {
+      uint64 *wd = (uint64 *)d;
+      const uint64 *ws = (const uint64 *)s;
+      uint64 a0 = ws[0], a1 = ws[1], a2 = ws[2], a3 = ws[3];
+      wd[0] = a0; wd[1] = a1; wd[2] = a2; wd[3] = a3;
+      d += 32, s += 32, n -= 32;
+    }
+    while (n >= 8)
+    {
+      *(uint64 *)d = *(const uint64 *)s;
+      d += 8, s += 8, n -= 8;
+    }
+  }
+  while (n-- > 0)
+    *d++ = *s++;
+}
+
+// 按无符号字节比较前n个字节: 相同返回0, 否则返回第一个不同字节的差
+int memcmp(const void *v1, const void *v2, uint32 n)
+{
+  const uint8 *p = v1, *q = v2;
+  if (((uint64)p & 7) == ((uint64)q & 7))
+  {
+    while (n > 0 && !ALIGNED8(p))
+    {
+      if (*p != *q)
+        return *p - *q;
+      p++, q++, n--;
+    }
+    while (n >= 8 && *(const uint64 *)p == *(const uint64 *)q)
+      p += 8, q += 8, n -= 8;
+  }
+  while (n-- > 0)
+  {
+    if (*p != *q)
+      return *p - *q;
+    p++, q++;
+  }
+  return 0;
 }
 
 // 字符串p的前n个字符与q做比较
@@ -61,11 +127,191 @@ int strlen(const char *str)
   return i;
 }
 
+// -------------------------- 互斥锁 --------------------------
+// futex上的互斥锁: 0 未持有, 1 持有, 2 持有且可能有等待者 (没有竞争时只有一次原子操作)
+
+void mutex_lock(uint32* lk)
+{
+    if (__sync_val_compare_and_swap(lk, 0, 1) == 0) {
+        return;
+    }
+    while (__sync_lock_test_and_set(lk, 2) != 0) {
+        sys_futex(lk, FUTEX_WAIT, 2, 0);
+    }
+}
+
+void mutex_unlock(uint32* lk)
+{
+    if (__sync_fetch_and_sub(lk, 1) != 1) {
+        __sync_lock_release(lk);
+        sys_futex(lk, FUTEX_WAKE, 1, 0);
+    }
+}
+
+// -------------------------- 缓冲的输入输出流 --------------------------
+// 输出: buf[0, len)是还没有写出的数据; 输入: buf[pos, len)是还没有读走的数据
+// 控制台输出按行缓冲: 一次printf(或stream_write)结束时写出过换行符才写出, 一行只需要一次sys_write
+// 从std_in读取之前先写出std_out中的数据 (提示符不带换行也能看到)
+
+stream_t std_out = { .fd = STD_OUT, .mode = STREAM_LINE };
+stream_t std_in  = { .fd = STD_IN,  .mode = STREAM_FULL };
+
+void stream_init(stream_t* s, int fd, int mode)
+{
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->mode = mode;
+}
+
+// 调用者持有s->lk
+static void stream_flush_locked(stream_t* s)
+{
+    uint32 off = 0;
+    while (off < s->len) {
+        uint32 n = sys_write(s->fd, s->len - off, s->buf + off);
+        if (n == 0 || n == (uint32)-1)
+            break;
+        off += n;
+    }
+    s->len = 0;
+    s->nl = false;
+}
+
+// 放入缓冲区, 满了先写出; 缓冲区为空时不小于缓冲区的数据直接写出
+static void stream_append(stream_t* s, const char* p, uint32 n)
+{
+    if (s->len == 0 && n >= STREAM_BUF) {
+        while (n > 0) {
+            uint32 k = sys_write(s->fd, n, (void*)p);
+            if (k == 0 || k == (uint32)-1)
+                return;
+            p += k;
+            n -= k;
+        }
+        return;
+    }
+    while (n > 0) {
+        if (s->len == STREAM_BUF)
+            stream_flush_locked(s);
+        uint32 k = STREAM_BUF - s->len;
+        if (k > n)
+            k = n;
+        for (uint32 i = 0; i < k; i++) {
+            if ((s->buf[s->len + i] = p[i]) == '\n')
+                s->nl = true;
+        }
+        s->len += k;
+        p += k;
+        n -= k;
+    }
+}
+
+// 一次写入结束: 不缓冲的流和写过换行符的行缓冲流写出
+static void stream_end(stream_t* s)
+{
+    if (s->mode == STREAM_UNBUF || (s->mode == STREAM_LINE && s->nl))
+        stream_flush_locked(s);
+}
+
+uint32 stream_write(stream_t* s, const void* buf, uint32 len)
+{
+    mutex_lock(&s->lk);
+    stream_append(s, buf, len);
+    stream_end(s);
+    mutex_unlock(&s->lk);
+    return len;
+}
+
+void stream_flush(stream_t* s)
+{
+    mutex_lock(&s->lk);
+    stream_flush_locked(s);
+    mutex_unlock(&s->lk);
+}
+
+// 缓冲区为空时读入一次, 没有数据(文件结束或出错)返回false (调用者持有s->lk)
+static bool stream_fill_locked(stream_t* s)
+{
+    if (s->pos < s->len)
+        return true;
+    if (s == &std_in)
+        stream_flush(&std_out);
+    s->pos = s->len = 0;
+    uint32 n = sys_read(s->fd, STREAM_BUF, s->buf);
+    if (n == 0 || n == (uint32)-1)
+        return false;
+    s->len = n;
+    return true;
+}
+
+// 与sys_read相同: 有缓冲的数据时只返回缓冲的数据, 否则最多读一次
+uint32 stream_read(stream_t* s, void* buf, uint32 len)
+{
+    uint32 n = 0;
+    mutex_lock(&s->lk);
+    if (s->pos == s->len && len >= STREAM_BUF) {
+        if (s == &std_in)
+            stream_flush(&std_out);
+        n = sys_read(s->fd, len, buf);
+    } else if (stream_fill_locked(s)) {
+        n = s->len - s->pos;
+        if (n > len)
+            n = len;
+        memmove(buf, s->buf + s->pos, n);
+        s->pos += n;
+    }
+    mutex_unlock(&s->lk);
+    return n;
+}
+
+int stream_getc(stream_t* s)
+{
+    int c = -1;
+    mutex_lock(&s->lk);
+    if (stream_fill_locked(s))
+        c = (uint8)s->buf[s->pos++];
+    mutex_unlock(&s->lk);
+    return c;
+}
+
+uint32 stream_gets(stream_t* s, char* buf, uint32 len)
+{
+    uint32 n = 0;
+    if (len == 0)
+        return 0;
+    mutex_lock(&s->lk);
+    while (n + 1 < len && stream_fill_locked(s)) {
+        char c = s->buf[s->pos++];
+        buf[n++] = c;
+        if (c == '\n')
+            break;
+    }
+    mutex_unlock(&s->lk);
+    buf[n] = 0;
+    return n;
+}
+
+// 标准输出 (不缓冲, 先写出std_out中缓冲的数据以保持顺序)
+uint32 stdout(char* str, uint32 len)
+{
+    mutex_lock(&std_out.lk);
+    stream_flush_locked(&std_out);
+    uint32 n = sys_write(STD_OUT, len, str);
+    mutex_unlock(&std_out.lk);
+    return n;
+}
+
+// 标准输入 (经过std_in的缓冲)
+uint32 stdin(char* str, uint32 len)
+{
+    return stream_read(&std_in, str, len);
+}
+
 // 下面的函数用于支持printf
 
 static char digits[] = "0123456789abcdef";
 
-static void printint(int xx, int base, int sign)
+static void printint(stream_t* s, int xx, int base, int sign)
 {
     char buf[16 + 1];
     int i;
@@ -87,11 +333,11 @@ static void printint(int xx, int base, int sign)
         buf[i--] = '-';
     i++;
     if (i < 0)
-        stdout("printint error", 14);
-    stdout(buf + i, 16 - i);
+        stream_append(s, "printint error", 14);
+    stream_append(s, buf + i, 16 - i);
 }
 
-static void printptr(uint64 x)
+static void printptr(stream_t* s, uint64 x)
 {
     int i = 0, j;
     char buf[32 + 1];
@@ -100,17 +346,15 @@ static void printptr(uint64 x)
     for (j = 0; j < (sizeof(uint64) * 2); j++, x <<= 4)
         buf[i++] = digits[x >> (sizeof(uint64) * 8 - 4)];
     buf[i] = 0;
-    stdout(buf, i);
+    stream_append(s, buf, i);
 }
 
-// 标准输出
-void printf(const char *fmt, ...)
+// 格式化到流s (调用者持有s->lk)
+static void stream_vprintf(stream_t* st, const char *fmt, va_list ap)
 {
-    va_list ap;
     int l = 0;
     char *a, *z, *s = (char *)fmt;
 
-    va_start(ap, fmt);
     for (;;)
     {
         if (!*s)
@@ -120,7 +364,7 @@ void printf(const char *fmt, ...)
         for (z = s; s[0] == '%' && s[1] == '%'; z++, s += 2)
             ;
         l = z - a;
-        stdout(a, l);
+        stream_append(st, a, l);
         if (l)
             continue;
         if (s[1] == 0)
@@ -128,27 +372,51 @@ void printf(const char *fmt, ...)
         switch (s[1])
         {
         case 'd':
-            printint(va_arg(ap, int), 10, 1);
+            printint(st, va_arg(ap, int), 10, 1);
             break;
         case 'x':
-            printint(va_arg(ap, int), 16, 1);
+            printint(st, va_arg(ap, int), 16, 1);
             break;
         case 'p':
-            printptr(va_arg(ap, uint64));
+            printptr(st, va_arg(ap, uint64));
             break;
         case 's':
             if ((a = va_arg(ap, char *)) == 0)
                 a = "(null)";
             l = strlen(a);
-            stdout(a, l);
+            stream_append(st, a, l);
             break;
         default:
-            stdout("%", 1);
-            stdout(s + 1, 1);
+            stream_append(st, "%", 1);
+            stream_append(st, s + 1, 1);
             break;
         }
         s += 2;
     }
+}
+
+// 标准输出 (行缓冲)
+void printf(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    mutex_lock(&std_out.lk);
+    stream_vprintf(&std_out, fmt, ap);
+    stream_end(&std_out);
+    mutex_unlock(&std_out.lk);
+    va_end(ap);
+}
+
+void fprintf(stream_t* s, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    mutex_lock(&s->lk);
+    stream_vprintf(s, fmt, ap);
+    stream_end(s);
+    mutex_unlock(&s->lk);
     va_end(ap);
 }
 
@@ -175,4 +443,103 @@ void print_filestate(fstat_t* file)
     printf("nlink = %d ", (uint32)(file->nlink));
     printf("size = %d ", file->size);
     printf("type = %s\n", file_type[file->type]);
-}
\ No newline at end of file
+}
+
+// 格式: "prof <hart> <pid> <u|k> <pc>", kernel/profsym读取这样的行
+void prof_print(prof_sample_t* s, uint32 n)
+{
+    for (uint32 i = 0; i < n; i++)
+        printf("prof %d %d %s %p\n", s[i].hart, s[i].pid, s[i].user ? "u" : "k", s[i].pc);
+}
+
+static char* trace_names[] = {
+    [TRACE_EV_SWITCH] "switch",
+    [TRACE_EV_FORK]   "fork",
+    [TRACE_EV_CLONE]  "clone",
+    [TRACE_EV_WAIT]   "wait",
+    [TRACE_EV_REAP]   "reap",
+    [TRACE_EV_EXIT]   "exit",
+};
+
+// 时刻按微秒输出 (mtime 10MHz)
+void trace_print(trace_event_t* ev, uint32 n)
+{
+    for (uint32 i = 0; i < n; i++) {
+        char* name = "?";
+        if (ev[i].event < sizeof(trace_names) / sizeof(trace_names[0]) && trace_names[ev[i].event] != 0)
+            name = trace_names[ev[i].event];
+        printf("[%d us] hart %d pid %d %s", (int)(ev[i].time / 10), ev[i].hart, ev[i].pid, name);
+        switch (ev[i].event) {
+        case TRACE_EV_SWITCH:
+            printf(" -> pid %d prio %d\n", (int)ev[i].arg0, (int)ev[i].arg1);
+            break;
+        case TRACE_EV_FORK:
+            printf(" child %d\n", (int)ev[i].arg0);
+            break;
+        case TRACE_EV_CLONE:
+            printf(" thread %d entry %p\n", (int)ev[i].arg0, ev[i].arg1);
+            break;
+        case TRACE_EV_WAIT:
+            printf("%s\n", ev[i].arg0 ? " (sleep)" : "");
+            break;
+        case TRACE_EV_REAP:
+            printf(" child %d status %d\n", (int)ev[i].arg0, (int)ev[i].arg1);
+            break;
+        case TRACE_EV_EXIT:
+            printf(" status %d\n", (int)ev[i].arg0);
+            break;
+        default:
+            printf(" %p %p\n", ev[i].arg0, ev[i].arg1);
+            break;
+        }
+    }
+}
+// 用户数据页 (见内核proc/vdata.h)
+static inline vdata_t* vdata()
+{
+    return (vdata_t*)VDATA_ADDR;
+}
+
+// 返回用户态时内核把tp设为hartid
+static inline uint64 read_tp()
+{
+    uint64 x;
+    asm volatile("mv %0, tp" : "=r" (x));
+    return x;
+}
+
+uint64 vdata_ticks()
+{
+    return vdata()->ticks;
+}
+
+uint64 vdata_clock_ns()
+{
+    uint64 now;
+    asm volatile("rdtime %0" : "=r" (now));
+    return (now - vdata()->mtime_base) * vdata()->ns_per_mtime;
+}
+
+// 读的过程中被打断过 (可能换了hart或者别的进程在这个hart上运行过) 时重读
+int vdata_getpid()
+{
+    vdata_t* vd = vdata();
+    uint64 h;
+    uint32 seq, pid;
+    do {
+        h = read_tp();
+        seq = vd->cpu[h].seq;
+        pid = vd->cpu[h].pid;
+    } while (read_tp() != h || vd->cpu[h].seq != seq);
+    return (int)pid;
+}
+
+int vdata_hartid()
+{
+    return (int)read_tp();
+}
+
+int vdata_ncpu()
+{
+    return (int)vdata()->ncpu;
+}
@@ -8,6 +8,220 @@ int sys_exec(char* path, char** argv)
     return syscall(SYS_exec, path, argv);
 }
 
+// 创建执行path的子进程 (不复制当前进程的地址空间)
+// 成功返回子进程pid 失败返回-1
+int sys_spawn(char* path, char** argv)
+{
+    return syscall(SYS_spawn, path, argv);
+}
+
+// 创建npages页的共享内存对象
+// 成功返回对象id 失败返回-1
+int sys_shm_create(uint32 npages)
+{
+    return syscall(SYS_shm_create, npages);
+}
+
+// 映射共享内存对象
+// 成功返回起始地址 失败返回-1
+uint64 sys_shm_map(int id)
+{
+    return syscall(SYS_shm_map, id);
+}
+
+// 解除sys_shm_map建立的映射
+// 成功返回0 失败返回-1
+int sys_shm_unmap(uint64 addr)
+{
+    return syscall(SYS_shm_unmap, addr);
+}
+
+// 销毁共享内存对象 (已有的映射仍然有效)
+// 成功返回0 失败返回-1
+int sys_shm_destroy(int id)
+{
+    return syscall(SYS_shm_destroy, id);
+}
+
+// 读取当前进程的内存统计
+// 成功返回0
+int sys_memstat(memstat_t* st)
+{
+    return syscall(SYS_memstat, st);
+}
+
+// 设置进程的基础优先级 (pid = 0: 自己; 0最高, 共4级)
+// 返回原来的基础优先级 失败返回-1
+int sys_setpriority(int pid, int prio)
+{
+    return syscall(SYS_setpriority, pid, prio);
+}
+
+// 设置进程可以运行的hart (pid = 0: 自己; 第i位对应hart i)
+// 成功返回0 失败返回-1
+int sys_sched_setaffinity(int pid, uint32 mask)
+{
+    return syscall(SYS_sched_setaffinity, pid, mask);
+}
+
+// 读取进程的亲和性掩码 (pid = 0: 自己)
+// 失败返回-1
+int sys_sched_getaffinity(int pid)
+{
+    return syscall(SYS_sched_getaffinity, pid);
+}
+
+// 自己进入期限调度类: 每period_us微秒得到runtime_us微秒的CPU时间, 在周期开始后deadline_us之内 (runtime_us = 0: 离开)
+// 成功返回0 参数无效或带宽不够 (准入控制) 返回-1
+int sys_sched_setdeadline(uint32 runtime_us, uint32 deadline_us, uint32 period_us)
+{
+    return syscall(SYS_sched_setdeadline, runtime_us, deadline_us, period_us);
+}
+
+// 创建与自己共享地址空间和文件描述符表的线程: 从fn(arg)开始执行, 栈顶为stack (16字节对齐)
+// fn不能返回, 结束时调用sys_exit; 用sys_wait回收
+// 成功返回线程的pid 失败返回-1
+int sys_clone(void (*fn)(void*), void* arg, void* stack)
+{
+    return syscall(SYS_clone, fn, arg, stack);
+}
+
+// FUTEX_WAIT: *uaddr == val时睡眠, 被唤醒返回0 超时(timeout微秒, 0不超时)返回1 值不等返回-1
+// FUTEX_WAKE: 唤醒最多val个等在uaddr上的进程, 返回唤醒的个数
+int sys_futex(uint32* uaddr, int op, uint32 val, uint32 timeout)
+{
+    return syscall(SYS_futex, uaddr, op, val, timeout);
+}
+
+// 设置tick的周期(微秒, 0不变)和tickless模式(1启用 0关闭 <0不变)
+// 返回当前的周期(微秒) 周期超出范围返回-1
+int sys_timer_config(uint32 period_us, int tickless)
+{
+    return syscall(SYS_timer_config, period_us, tickless);
+}
+
+// 设置缺页时顺带映射的窗口页数 (0或1关闭, 最多32页)
+// 返回之前的窗口页数 超出范围返回-1
+int sys_fault_around(uint32 pages)
+{
+    return syscall(SYS_fault_around, pages);
+}
+
+// 读取时钟的纳秒数 (CLOCK_MONOTONIC: 启动以来, 精度100ns), clock无效返回-1
+uint64 sys_clock_gettime(int clock)
+{
+    return syscall(SYS_clock_gettime, clock);
+}
+
+// 一次陷入依次执行calls中的n个系统调用 (n不超过N_BATCH), 每一项的返回值写回ret
+// exec / fork / exit / clone不能批量执行 (返回值为-1)
+// 返回执行的项数 失败返回-1
+int sys_batch(batch_call_t* calls, uint32 n)
+{
+    return syscall(SYS_batch, calls, n);
+}
+
+// 读取进程的I/O统计 (pid为0时是当前进程)
+// 成功返回0 进程不存在返回-1
+int sys_iostat(int pid, iostat_t* st)
+{
+    return syscall(SYS_iostat, pid, st);
+}
+
+int sys_cpustat(int pid, cpustat_t* st)
+{
+    return syscall(SYS_cpustat, pid, st);
+}
+
+// 设置接收中断源irq (UART 10, virtio磁盘 1) 的hart (位图)
+// 成功返回0 中断源无效或掩码中没有存在的hart返回-1
+int sys_irq_setaffinity(int irq, uint32 mask)
+{
+    return syscall(SYS_irq_setaffinity, irq, mask);
+}
+
+// 读取锁竞争统计: 等待时间最长的前n类锁 (内核需要make LOCK_STAT=1), reset为1时之后清零
+// 返回写入的项数 没有锁统计返回-1
+int sys_lockstat(lockstat_t* st, uint32 n, int reset)
+{
+    return syscall(SYS_lockstat, st, n, reset);
+}
+
+// 读取热路径计时 (下标是TSTAT_*, 内核需要make TIME_STAT=1)
+// 返回写入的项数 没有热路径计时返回-1
+int sys_tstat(tstat_t* st, uint32 n)
+{
+    return syscall(SYS_tstat, st, n);
+}
+
+// 读取内核事件计数 (系统调用、缺页、调度、中断等, 所有hart的和)
+// 成功返回0
+int sys_kstat(kstat_t* st)
+{
+    return syscall(SYS_kstat, st);
+}
+
+// 读取内核日志 (各hart保留的最近部分, 按hart的顺序)
+// 返回复制的字节数
+int sys_dmesg(char* buf, uint32 len)
+{
+    return syscall(SYS_dmesg, buf, len);
+}
+
+// 设置打开的追踪类别 (TRACE_SCHED | TRACE_PROC), 返回原来的类别
+int sys_trace_set(uint32 mask)
+{
+    return syscall(SYS_trace, 0, mask, 0, 0);
+}
+
+// 取出最多n条追踪记录 (被覆盖而丢失的条数写入*lost, 可以为NULL), 返回取出的条数
+int sys_trace_read(trace_event_t* ev, uint32 n, uint64* lost)
+{
+    return syscall(SYS_trace, 1, ev, n, lost);
+}
+
+// 录制pid (0: 当前进程) 和它之后创建的进程的系统调用, 返回0 失败返回-1
+int sys_sysrec_start(int pid)
+{
+    return syscall(SYS_sysrec, SYSREC_START, pid, 0, 0);
+}
+
+// 停止录制pid (已经创建的子进程继续被录制), 返回0 失败返回-1
+int sys_sysrec_stop(int pid)
+{
+    return syscall(SYS_sysrec, SYSREC_STOP, pid, 0, 0);
+}
+
+// 取出最多n条录制的记录 (缓冲区满而丢弃的条数写入*lost, 可以为NULL), 返回取出的条数
+int sys_sysrec_read(sysrec_t* rec, uint32 n, uint64* lost)
+{
+    return syscall(SYS_sysrec, SYSREC_READ, rec, n, lost);
+}
+
+// 系统调用统计 (下标是系统调用号): who为SYSSTAT_GLOBAL时是所有进程, SYSSTAT_SELF时是当前进程
+// 返回写入的项数 失败返回-1
+int sys_sysstat(int who, sysstat_t* st, uint32 n)
+{
+    return syscall(SYS_sysstat, who, st, n);
+}
+
+// 开始采样分析: 每个hart每隔every个tick记录一次被时钟中断打断的位置
+int sys_prof_start(uint32 every)
+{
+    return syscall(SYS_prof, PROF_START, every, 0, 0);
+}
+
+int sys_prof_stop()
+{
+    return syscall(SYS_prof, PROF_STOP, 0, 0, 0);
+}
+
+// 取出最多n条采样 (环满时丢弃的采样数写入*dropped, 可以为NULL), 返回取出的条数
+int sys_prof_read(prof_sample_t* s, uint32 n, uint64* dropped)
+{
+    return syscall(SYS_prof, PROF_READ, s, n, dropped);
+}
+
 // 成功返回新的堆顶 失败返回-1
 uint64 sys_brk(uint64 new_heap_top)
 {
@@ -15,9 +229,9 @@ uint64 sys_brk(uint64 new_heap_top)
 }
 
 // 成功返回映射空间的起始地址, 失败返回-1
-uint64 sys_mmap(uint64 start, uint32 len)
+uint64 sys_mmap(uint64 start, uint32 len, int flags)
 {
-    return syscall(SYS_mmap, start, len);
+    return syscall(SYS_mmap, start, len, flags);
 }
 
 // 成功返回0 失败返回-1
@@ -121,3 +335,224 @@ int sys_unlink(char* path)
 {
     return syscall(SYS_unlink, path);
 }
+
+// 成功返回0
+int sys_bufstat(bufstat_t* st)
+{
+    return syscall(SYS_bufstat, st);
+}
+
+// 成功返回0
+int sys_diskstat(diskstat_t* st)
+{
+    return syscall(SYS_diskstat, st);
+}
+
+// 成功返回0
+int sys_statfs(statfs_t* st)
+{
+    return syscall(SYS_statfs, st);
+}
+
+// 成功返回0 失败返回-1
+int sys_ftruncate(int fd, uint32 size)
+{
+    return syscall(SYS_ftruncate, fd, size);
+}
+
+// 成功返回0 失败返回-1
+int sys_fallocate(int fd, uint32 offset, uint32 len)
+{
+    return syscall(SYS_fallocate, fd, offset, len);
+}
+
+// 成功返回fd 失败返回-1
+int sys_openat(int dirfd, char* path, uint32 open_mode)
+{
+    return syscall(SYS_openat, dirfd, path, open_mode);
+}
+
+// 成功返回0 失败返回-1
+int sys_mkdirat(int dirfd, char* path)
+{
+    return syscall(SYS_mkdirat, dirfd, path);
+}
+
+// 成功返回0 失败返回-1
+int sys_unlinkat(int dirfd, char* path)
+{
+    return syscall(SYS_unlinkat, dirfd, path);
+}
+
+// 成功返回0 失败返回-1
+int sys_linkat(int old_dirfd, char* old_path, int new_dirfd, char* new_path)
+{
+    return syscall(SYS_linkat, old_dirfd, old_path, new_dirfd, new_path);
+}
+
+// 成功返回0 失败返回-1
+int sys_fstatat(int dirfd, char* path, fstat_t* state)
+{
+    return syscall(SYS_fstatat, dirfd, path, state);
+}
+
+// names只使用name (可以直接传入getdents的结果), n不超过64, 不存在的文件type为0
+// 成功返回存在的文件数 失败返回-1
+int sys_fstatat_batch(int dirfd, dirent_t* names, int n, fstat_t* states)
+{
+    return syscall(SYS_fstatat_batch, dirfd, names, n, states);
+}
+
+// 成功返回读取的字节数 (0表示已读完), 失败返回-1
+int sys_getdents(int fd, dirent_t* addr, uint32 len)
+{
+    return syscall(SYS_getdents, fd, addr, len);
+}
+
+// 成功返回0 失败返回-1
+int sys_rename(char* old_path, char* new_path)
+{
+    return syscall(SYS_rename, old_path, new_path);
+}
+
+// 成功返回字节数 失败返回-1 (文件偏移量不变)
+uint32 sys_pread(int fd, uint32 len, void* addr, uint32 offset)
+{
+    return syscall(SYS_pread, fd, len, addr, offset);
+}
+
+// 成功返回字节数 失败返回-1 (文件偏移量不变)
+uint32 sys_pwrite(int fd, uint32 len, void* addr, uint32 offset)
+{
+    return syscall(SYS_pwrite, fd, len, addr, offset);
+}
+
+// 成功返回总字节数 失败返回-1
+uint32 sys_readv(int fd, iovec_t* iov, uint32 iovcnt)
+{
+    return syscall(SYS_readv, fd, iov, iovcnt);
+}
+
+// 成功返回总字节数 失败返回-1
+uint32 sys_writev(int fd, iovec_t* iov, uint32 iovcnt)
+{
+    return syscall(SYS_writev, fd, iov, iovcnt);
+}
+
+// fd[0]为读端, fd[1]为写端
+// 成功返回0 失败返回-1
+int sys_pipe(int* fd)
+{
+    return syscall(SYS_pipe, fd);
+}
+
+// 成功返回映射的起始地址 失败返回-1
+uint64 sys_mmap_file(uint64 start, uint32 len, int fd, uint32 offset, int prot)
+{
+    return syscall(SYS_mmap_file, start, len, fd, offset, prot);
+}
+
+// 成功返回0 失败返回-1
+int sys_msync(uint64 start, uint32 len)
+{
+    return syscall(SYS_msync, start, len);
+}
+
+// 成功返回复制的字节数 失败返回-1
+uint32 sys_copy_file_range(int fd_in, int fd_out, uint32 len)
+{
+    return syscall(SYS_copy_file_range, fd_in, fd_out, len);
+}
+
+// 成功返回移动的字节数 失败返回-1
+uint32 sys_splice(int fd_in, int fd_out, uint32 len)
+{
+    return syscall(SYS_splice, fd_in, fd_out, len);
+}
+
+// 成功返回总字节数 失败返回-1
+uint32 sys_vmsplice(int fd, iovec_t* iov, uint32 iovcnt)
+{
+    return syscall(SYS_vmsplice, fd, iov, iovcnt);
+}
+
+// 成功返回0 失败返回-1
+int sys_clone_file(int fd, char* path)
+{
+    return syscall(SYS_clone_file, fd, path);
+}
+
+// 成功返回0 失败返回-1
+int sys_fsync(int fd)
+{
+    return syscall(SYS_fsync, fd);
+}
+
+// 成功返回0 失败返回-1
+int sys_fdatasync(int fd)
+{
+    return syscall(SYS_fdatasync, fd);
+}
+
+// 返回0
+int sys_sync()
+{
+    return syscall(SYS_sync);
+}
+
+// 成功返回队列的用户地址 失败返回-1
+uint64 sys_uring_setup()
+{
+    return syscall(SYS_uring_setup);
+}
+
+// 返回处理的请求数 失败返回-1
+int sys_uring_enter()
+{
+    return syscall(SYS_uring_enter);
+}
+
+// 成功返回0 失败返回-1
+int sys_fadvise(int fd, uint32 offset, uint32 len, int advice)
+{
+    return syscall(SYS_fadvise, fd, offset, len, advice);
+}
+
+// 关机前调用
+// 返回0
+int sys_umount()
+{
+    return syscall(SYS_umount);
+}
+
+// 写回全部数据并干净卸载文件系统后关闭虚拟机
+// 不返回
+int sys_poweroff()
+{
+    return syscall(SYS_poweroff);
+}
+
+// 返回revents非0的fd数 (超时返回0) 失败返回-1
+int sys_poll(pollfd_t* fds, uint32 nfds, int timeout)
+{
+    return syscall(SYS_poll, fds, nfds, timeout);
+}
+
+// 成功返回fd 失败返回-1
+int sys_epoll_create()
+{
+    return syscall(SYS_epoll_create);
+}
+
+// 成功返回0 失败返回-1
+int sys_epoll_ctl(int epfd, int op, int fd, epoll_event_t* event)
+{
+    return syscall(SYS_epoll_ctl, epfd, op, fd, event);
+}
+
+// 返回报告的事件数 (超时返回0) 失败返回-1
+int sys_epoll_wait(int epfd, epoll_event_t* events, int max, int timeout)
+{
+    return syscall(SYS_epoll_wait, epfd, events, max, timeout);
+}
+
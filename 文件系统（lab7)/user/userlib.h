@@ -22,6 +22,19 @@ typedef __builtin_va_list va_list;
 #define MODE_CREATE    0x1 // 文件不存在则创建
 #define MODE_READ      0x2 // 读文件
 #define MODE_WRITE     0x4 // 写文件
+#define MODE_EXTENT    0x8 // 与MODE_CREATE一起使用: 新文件使用extent映射
+#define MODE_DIRECT    0x10 // 直接I/O: 偏移和长度按block大小 (sys_statfs的block_size) 对齐, 缓冲区按512字节对齐时绕过页缓存
+#define MODE_COMPRESS  0x20 // 与MODE_CREATE一起使用: 新文件透明压缩存放 (读写不变, 不支持直接I/O)
+
+// fadvise访问模式提示
+#define FADV_NORMAL     0 // 默认
+#define FADV_RANDOM     1 // 随机访问: 不预读
+#define FADV_SEQUENTIAL 2 // 顺序扫描一次: 最大预读窗口, 读过的页优先被替换
+#define FADV_WILLNEED   3 // 立即读入范围内的页
+#define FADV_DONTNEED   4 // 写回并丢弃范围内的页
+
+// *at系统调用的目录fd: 相对路径从当前工作目录开始
+#define AT_FDCWD       (-100)
 
 // 文件类型
 
@@ -31,6 +44,69 @@ typedef __builtin_va_list va_list;
 #define FD_DEVICE      3
 #define FD_PIPE        4
 
+// 文件映射的访问权限 (sys_mmap_file)
+
+#define PROT_READ  0x1
+#define PROT_WRITE 0x2
+
+// sys_mmap的标志
+
+#define MAP_POPULATE 0x1  // 立即分配所有页 (默认在第一次访问时分配)
+
+// 用户数据页: 内核维护的时间和进程信息, 读取不需要系统调用 (与内核memlayout.h的VDATA一致)
+
+#define VDATA_ADDR ((1ull << 38) - 275 * 4096)
+
+// sys_clock_gettime的时钟
+
+#define CLOCK_MONOTONIC 0  // 启动以来的时间 (纳秒)
+
+// sys_futex的操作
+
+#define FUTEX_WAIT 0  // 字的值等于val时睡眠, 直到被唤醒或超时
+#define FUTEX_WAKE 1  // 唤醒最多val个等在字上的进程
+
+// 追踪点的类别和事件号 (与内核lib/trace.h一致)
+
+#define TRACE_SCHED      (1u << 0)  // 调度器切换进程
+#define TRACE_PROC       (1u << 1)  // 进程的创建、等待和退出
+
+#define TRACE_EV_SWITCH  1  // 切换到arg0 (arg1: 优先级)
+#define TRACE_EV_FORK    2  // 创建子进程arg0
+#define TRACE_EV_CLONE   3  // 创建线程arg0 (arg1: 入口地址)
+#define TRACE_EV_WAIT    4  // 开始等待子进程 (arg0: 是否睡眠)
+#define TRACE_EV_REAP    5  // 回收子进程arg0 (arg1: 退出状态)
+#define TRACE_EV_EXIT    6  // 退出 (arg0: 退出状态)
+
+// sys_sysrec的操作 (与内核syscall/sysrec.h一致)
+
+#define SYSREC_START 0
+#define SYSREC_STOP  1
+#define SYSREC_READ  2
+
+// sys_sysstat的统计范围
+
+#define SYSSTAT_GLOBAL 0  // 所有进程
+#define SYSSTAT_SELF   1  // 当前进程 (只有calls / errors / time)
+
+// sys_tstat的计时点 (与内核lib/tstat.h一致)
+
+#define TSTAT_BUF_HIT       0  // buf_read: 命中缓存
+#define TSTAT_BUF_MISS      1  // buf_read: 从磁盘读入
+#define TSTAT_LOCATE_BLOCK  2  // inode_locate_block
+#define TSTAT_SEARCH_INODE  3  // 路径解析
+#define TSTAT_COPYIN        4  // uvm_copyin
+#define TSTAT_COPYOUT       5  // uvm_copyout
+#define TSTAT_SWTCH         6  // 进程切换到调度器
+#define TSTAT_DISK_RW       7  // virtio_disk_rw
+#define N_TSTAT             8
+
+// sys_prof的操作 (与内核lib/prof.h一致)
+
+#define PROF_START 0
+#define PROF_STOP  1
+#define PROF_READ  2
+
 // 支持LSEEK
 
 #define LSEEK_SET 0  // file->offset = offset
@@ -40,8 +116,40 @@ typedef __builtin_va_list va_list;
 // 来自user_syscall.c
 
 int sys_exec(char* path, char** argv);
+int sys_spawn(char* path, char** argv);
+int sys_shm_create(uint32 npages);
+uint64 sys_shm_map(int id);
+int sys_shm_unmap(uint64 addr);
+int sys_shm_destroy(int id);
+int sys_memstat(memstat_t* st);
+int sys_iostat(int pid, iostat_t* st);
+int sys_cpustat(int pid, cpustat_t* st);
+int sys_setpriority(int pid, int prio);
+int sys_sched_setaffinity(int pid, uint32 mask);
+int sys_sched_getaffinity(int pid);
+int sys_sched_setdeadline(uint32 runtime_us, uint32 deadline_us, uint32 period_us);
+int sys_irq_setaffinity(int irq, uint32 mask);
+int sys_clone(void (*fn)(void*), void* arg, void* stack);
+int sys_futex(uint32* uaddr, int op, uint32 val, uint32 timeout);
+int sys_timer_config(uint32 period_us, int tickless);
+int sys_fault_around(uint32 pages);
+uint64 sys_clock_gettime(int clock);
+int sys_batch(batch_call_t* calls, uint32 n);
+int sys_lockstat(lockstat_t* st, uint32 n, int reset);
+int sys_kstat(kstat_t* st);
+int sys_tstat(tstat_t* st, uint32 n);
+int sys_dmesg(char* buf, uint32 len);
+int sys_trace_set(uint32 mask);
+int sys_trace_read(trace_event_t* ev, uint32 n, uint64* lost);
+int sys_sysrec_start(int pid);
+int sys_sysrec_stop(int pid);
+int sys_sysrec_read(sysrec_t* rec, uint32 n, uint64* lost);
+int sys_sysstat(int who, sysstat_t* st, uint32 n);
+int sys_prof_start(uint32 every);
+int sys_prof_stop();
+int sys_prof_read(prof_sample_t* s, uint32 n, uint64* dropped);
 uint64 sys_brk(uint64 new_heap_top);
-uint64 sys_mmap(uint64 start, uint32 len);
+uint64 sys_mmap(uint64 start, uint32 len, int flags);
 uint64 sys_munmap(uint64 start, uint32 len);
 int sys_fork();
 int sys_wait(void* addr);
@@ -59,6 +167,66 @@ int sys_mkdir(char* path);
 int sys_chdir(char* path);
 int sys_link(char* old_path, char* new_path);
 int sys_unlink(char* path);
+int sys_bufstat(bufstat_t* st);
+int sys_diskstat(diskstat_t* st);
+int sys_statfs(statfs_t* st);
+int sys_ftruncate(int fd, uint32 size);
+int sys_fallocate(int fd, uint32 offset, uint32 len);
+int sys_openat(int dirfd, char* path, uint32 open_mode);
+int sys_mkdirat(int dirfd, char* path);
+int sys_unlinkat(int dirfd, char* path);
+int sys_linkat(int old_dirfd, char* old_path, int new_dirfd, char* new_path);
+int sys_fstatat(int dirfd, char* path, fstat_t* state);
+int sys_fstatat_batch(int dirfd, dirent_t* names, int n, fstat_t* states);
+int sys_getdents(int fd, dirent_t* addr, uint32 len);
+int sys_rename(char* old_path, char* new_path);
+uint32 sys_pread(int fd, uint32 len, void* addr, uint32 offset);
+uint32 sys_pwrite(int fd, uint32 len, void* addr, uint32 offset);
+uint32 sys_readv(int fd, iovec_t* iov, uint32 iovcnt);
+uint32 sys_writev(int fd, iovec_t* iov, uint32 iovcnt);
+int sys_pipe(int* fd);
+int sys_poll(pollfd_t* fds, uint32 nfds, int timeout);
+int sys_epoll_create();
+int sys_epoll_ctl(int epfd, int op, int fd, epoll_event_t* event);
+int sys_epoll_wait(int epfd, epoll_event_t* events, int max, int timeout);
+uint64 sys_mmap_file(uint64 start, uint32 len, int fd, uint32 offset, int prot);
+int sys_msync(uint64 start, uint32 len);
+uint32 sys_copy_file_range(int fd_in, int fd_out, uint32 len);
+uint32 sys_splice(int fd_in, int fd_out, uint32 len);
+uint32 sys_vmsplice(int fd, iovec_t* iov, uint32 iovcnt);
+int sys_clone_file(int fd, char* path);
+int sys_fsync(int fd);
+int sys_fdatasync(int fd);
+int sys_sync();
+uint64 sys_uring_setup();
+int sys_uring_enter();
+int sys_fadvise(int fd, uint32 offset, uint32 len, int advice);
+int sys_umount();
+int sys_poweroff();
+
+// 缓冲的输入输出流 (user_lib.c)
+// std_out按行缓冲: 一次printf / stream_write中写过换行符时写出; std_in一次读入一个缓冲区
+// 直接调用sys_exit的程序先stream_flush(&std_out) (从main返回时自动写出)
+
+#define STREAM_BUF   1024
+
+#define STREAM_UNBUF 0  // 每次写入之后都写出
+#define STREAM_LINE  1  // 写过换行符时写出
+#define STREAM_FULL  2  // 缓冲区满或stream_flush时写出
+
+typedef struct stream {
+    int    fd;
+    int    mode;
+    bool   nl;              // 缓冲区中有换行符
+    uint32 lk;              // mutex_lock
+    uint32 pos;             // 输入: 下一个读走的字节
+    uint32 len;             // 缓冲区中数据的末尾
+    char   buf[STREAM_BUF];
+} stream_t;
+
+extern stream_t std_out;
+extern stream_t std_in;
+
 
 // 来自user_lib.c
 
@@ -67,10 +235,35 @@ uint32 stdout(char* str, uint32 len);
 uint32 stdin(char* str, uint32 len);
 void   memset(void* begin, uint8 data, uint32 n);
 void   memmove(void* dst, const void* src, uint32 n);
+int    memcmp(const void* v1, const void* v2, uint32 n);
 int    strncmp(const char *p, const char *q, uint32 n);
 int    strlen(const char *str);
-void   printf(const char* fmt, ...);
+void   printf(const char* fmt, ...);                        // 写到std_out
+void   fprintf(stream_t* s, const char* fmt, ...);
+void   stream_init(stream_t* s, int fd, int mode);
+uint32 stream_write(stream_t* s, const void* buf, uint32 len);
+void   stream_flush(stream_t* s);
+uint32 stream_read(stream_t* s, void* buf, uint32 len);      // 同sys_read, 先返回缓冲的数据
+int    stream_getc(stream_t* s);                             // 文件结束返回-1
+uint32 stream_gets(stream_t* s, char* buf, uint32 len);      // 读一行 (含换行符, 最多len - 1字节), 以0结尾, 返回字节数
+void   mutex_lock(uint32* lk);                               // futex上的互斥锁
+void   mutex_unlock(uint32* lk);
 void   print_dirents(dirent_t* dir, uint32 count);
 void   print_filestate(fstat_t* file);
+void   trace_print(trace_event_t* ev, uint32 n);   // 解码并输出sys_trace_read取出的记录
+void   prof_print(prof_sample_t* s, uint32 n);      // 输出采样 (每条一行, 主机上用kernel/profsym解析符号)
+uint64 vdata_ticks();      // 已经过的tick数
+uint64 vdata_clock_ns();   // 同sys_clock_gettime(CLOCK_MONOTONIC)
+int    vdata_getpid();     // 当前进程的pid
+int    vdata_hartid();     // 当前所在的hart (读到之后可能已经迁移)
+int    vdata_ncpu();       // 运行的hart数
+
+// 来自malloc.c (大小类 + 线程缓存, 堆按块扩大, 大对象用mmap; 见malloc.c开头的说明)
+
+void*  malloc(uint64 n);                     // 返回16字节对齐的内存, 失败返回NULL
+void   free(void* p);
+void*  calloc(uint64 nmemb, uint64 size);    // 清零
+void*  realloc(void* p, uint64 n);
+void   malloc_thread_exit();                 // 线程调用sys_exit之前: 归还线程缓存
 
 #endif
\ No newline at end of file